@@ -23,6 +23,8 @@
 #ifndef __NM_REMOTE_CONNECTION_PRIVATE_H__
 #define __NM_REMOTE_CONNECTION_PRIVATE_H__
 
+#include "nm-remote-connection.h"
+
 #define NM_REMOTE_CONNECTION_INIT_RESULT "init-result"
 
 typedef enum {
@@ -32,5 +34,8 @@ typedef enum {
 	NM_REMOTE_CONNECTION_INIT_RESULT_INVISIBLE,
 } NMRemoteConnectionInitResult;
 
+void _nm_remote_connection_init_with_settings (NMRemoteConnection *self,
+                                               GHashTable *settings);
+
 #endif  /* __NM_REMOTE_CONNECTION_PRIVATE__ */
 
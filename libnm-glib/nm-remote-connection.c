@@ -331,6 +331,28 @@ removed_cb (DBusGProxy *proxy, gpointer user_data)
 	g_signal_emit (G_OBJECT (user_data), signals[REMOVED], 0);
 }
 
+/*
+ * _nm_remote_connection_init_with_settings:
+ * @self: a new, uninitialized #NMRemoteConnection
+ * @settings: the connection's settings, as returned by GetSettings
+ *
+ * Initializes @self from settings the settings service already returned
+ * with ListConnectionSettings, instead of asking for them again.
+ */
+void
+_nm_remote_connection_init_with_settings (NMRemoteConnection *self,
+                                          GHashTable *settings)
+{
+	NMRemoteConnectionPrivate *priv;
+
+	g_return_if_fail (NM_IS_REMOTE_CONNECTION (self));
+	g_return_if_fail (settings != NULL);
+
+	priv = NM_REMOTE_CONNECTION_GET_PRIVATE (self);
+	priv->visible = TRUE;
+	replace_settings (self, settings);
+}
+
 /****************************************************************/
 
 /**
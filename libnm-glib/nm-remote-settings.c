@@ -39,6 +39,9 @@ G_DEFINE_TYPE_WITH_CODE (NMRemoteSettings, nm_remote_settings, G_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_INITABLE, nm_remote_settings_async_initable_iface_init);
                          )
 
+/* Connections per ListConnectionSettings call */
+#define FETCH_PAGE_SIZE 1000
+
 #define NM_REMOTE_SETTINGS_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), NM_TYPE_REMOTE_SETTINGS, NMRemoteSettingsPrivate))
 
 typedef struct {
@@ -420,6 +423,25 @@ new_connection_cb (DBusGProxy *proxy, const char *path, gpointer user_data)
 	return connection;
 }
 
+static void
+fetch_connections_failed (NMRemoteSettings *self, GError *error)
+{
+	NMRemoteSettingsPrivate *priv = NM_REMOTE_SETTINGS_GET_PRIVATE (self);
+
+	/* Ignore settings service spawn errors */
+	if (   !g_error_matches (error, DBUS_GERROR, DBUS_GERROR_SERVICE_UNKNOWN)
+	    && !g_error_matches (error, DBUS_GERROR, DBUS_GERROR_NAME_HAS_NO_OWNER)) {
+		g_warning ("%s: error fetching connections: (%d) %s.",
+		           __func__,
+		           error->code,
+		           error->message ? error->message : "(unknown)");
+	}
+
+	/* We tried to read connections and failed */
+	priv->fetching = FALSE;
+	g_signal_emit (self, signals[CONNECTIONS_READ], 0);
+}
+
 static void
 fetch_connections_done (DBusGProxy *proxy,
                         DBusGProxyCall *call,
@@ -434,19 +456,8 @@ fetch_connections_done (DBusGProxy *proxy,
 	if (!dbus_g_proxy_end_call (proxy, call, &error, 
 	                            DBUS_TYPE_G_ARRAY_OF_OBJECT_PATH, &connections,
 	                            G_TYPE_INVALID)) {
-		/* Ignore settings service spawn errors */
-		if (   !g_error_matches (error, DBUS_GERROR, DBUS_GERROR_SERVICE_UNKNOWN)
-		    && !g_error_matches (error, DBUS_GERROR, DBUS_GERROR_NAME_HAS_NO_OWNER)) {
-			g_warning ("%s: error fetching connections: (%d) %s.",
-			           __func__,
-				       error->code,
-				       error->message ? error->message : "(unknown)");
-		}
+		fetch_connections_failed (self, error);
 		g_clear_error (&error);
-
-		/* We tried to read connections and failed */
-		priv->fetching = FALSE;
-		g_signal_emit (self, signals[CONNECTIONS_READ], 0);
 		return;
 	}
 
@@ -467,6 +478,108 @@ fetch_connections_done (DBusGProxy *proxy,
 	g_ptr_array_free (connections, TRUE);
 }
 
+/* Adds a connection listed by ListConnectionSettings; @settings is %NULL if
+ * the connection isn't visible to this user.
+ */
+static void
+add_listed_connection (NMRemoteSettings *self, const char *path, GHashTable *settings)
+{
+	NMRemoteSettingsPrivate *priv = NM_REMOTE_SETTINGS_GET_PRIVATE (self);
+	NMRemoteConnection *connection;
+
+	/* Might have been announced with NewConnection in the meantime */
+	if (   g_hash_table_lookup (priv->pending, path)
+	    || g_hash_table_lookup (priv->connections, path))
+		return;
+
+	connection = nm_remote_connection_new (priv->bus, path);
+	if (!connection)
+		return;
+
+	/* Invisible connections wait in the pending hash until they become
+	 * visible, just like the ones whose GetSettings call was denied.
+	 */
+	move_connection (self, connection, NULL, priv->pending);
+
+	if (settings) {
+		_nm_remote_connection_init_with_settings (connection, settings);
+
+		/* Invalid settings make the connection emit "removed" and drop out */
+		if (g_hash_table_lookup (priv->pending, path)) {
+			move_connection (self, connection, priv->pending, priv->connections);
+			g_signal_emit (self, signals[NEW_CONNECTION], 0, connection);
+		}
+	}
+	g_object_unref (connection); /* move_connection() takes a ref */
+}
+
+static void fetch_settings_page (NMRemoteSettings *self, const char *after);
+
+static void
+fetch_settings_done (DBusGProxy *proxy,
+                     DBusGProxyCall *call,
+                     gpointer user_data)
+{
+	NMRemoteSettings *self = NM_REMOTE_SETTINGS (user_data);
+	NMRemoteSettingsPrivate *priv = NM_REMOTE_SETTINGS_GET_PRIVATE (self);
+	GHashTable *connections = NULL;
+	GPtrArray *hidden = NULL;
+	char *last = NULL;
+	GHashTableIter iter;
+	gpointer key, value;
+	GError *error = NULL;
+	int i;
+
+	if (!dbus_g_proxy_end_call (proxy, call, &error,
+	                            DBUS_TYPE_G_MAP_OF_OBJECT_PATH_TO_MAP_OF_MAP_OF_VARIANT, &connections,
+	                            DBUS_TYPE_G_ARRAY_OF_OBJECT_PATH, &hidden,
+	                            DBUS_TYPE_G_OBJECT_PATH, &last,
+	                            G_TYPE_INVALID)) {
+		if (g_error_matches (error, DBUS_GERROR, DBUS_GERROR_UNKNOWN_METHOD)) {
+			/* Older settings services need a GetSettings call per connection */
+			dbus_g_proxy_begin_call (priv->proxy, "ListConnections",
+			                         fetch_connections_done, self, NULL,
+			                         G_TYPE_INVALID);
+		} else
+			fetch_connections_failed (self, error);
+		g_clear_error (&error);
+		return;
+	}
+
+	g_hash_table_iter_init (&iter, connections);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+		add_listed_connection (self, (const char *) key, (GHashTable *) value);
+
+	for (i = 0; i < hidden->len; i++) {
+		add_listed_connection (self, g_ptr_array_index (hidden, i), NULL);
+		g_free (g_ptr_array_index (hidden, i));
+	}
+
+	if (strcmp (last, "/"))
+		fetch_settings_page (self, last);
+	else {
+		/* Let listeners know we are done getting connections */
+		priv->fetching = FALSE;
+		g_signal_emit (self, signals[CONNECTIONS_READ], 0);
+	}
+
+	g_hash_table_destroy (connections);
+	g_ptr_array_free (hidden, TRUE);
+	g_free (last);
+}
+
+static void
+fetch_settings_page (NMRemoteSettings *self, const char *after)
+{
+	NMRemoteSettingsPrivate *priv = NM_REMOTE_SETTINGS_GET_PRIVATE (self);
+
+	dbus_g_proxy_begin_call (priv->proxy, "ListConnectionSettings",
+	                         fetch_settings_done, self, NULL,
+	                         DBUS_TYPE_G_OBJECT_PATH, after,
+	                         G_TYPE_UINT, FETCH_PAGE_SIZE,
+	                         G_TYPE_INVALID);
+}
+
 static gboolean
 fetch_connections (gpointer user_data)
 {
@@ -475,9 +588,8 @@ fetch_connections (gpointer user_data)
 
 	priv->fetch_id = 0;
 
-	dbus_g_proxy_begin_call (priv->proxy, "ListConnections",
-	                         fetch_connections_done, self, NULL,
-	                         G_TYPE_INVALID);
+	/* Get the connections and their settings in a few large replies */
+	fetch_settings_page (self, "/");
 	return FALSE;
 }
 
@@ -32,6 +32,7 @@
 #include <nm-setting-wired.h>
 #include <nm-utils.h>
 
+#include "nm-dbus-glib-types.h"
 #include "nm-remote-settings.h"
 
 static GPid spid = 0;
@@ -342,6 +343,191 @@ test_remove_connection (void)
 
 /*******************************************************************/
 
+#define NUM_FETCH_CONNECTIONS 5
+#define NUM_FETCH_CONNECTIONS_PERF 2000
+
+/* Small pages, so that a few connections take several of them */
+#define FETCH_PAGE_LIMIT 2
+
+static void
+connections_read_cb (NMRemoteSettings *s, gboolean *done)
+{
+	*done = TRUE;
+}
+
+static gboolean
+path_in_array (GPtrArray *paths, const char *path)
+{
+	guint i;
+
+	for (i = 0; i < paths->len; i++) {
+		if (!strcmp (g_ptr_array_index (paths, i), path))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static void
+fetch_all_connections (DBusGProxy *proxy,
+                       gboolean list_settings,
+                       GPtrArray *expected,
+                       gdouble *elapsed)
+{
+	NMRemoteSettings *fetcher;
+	GSList *list, *iter;
+	GTimer *timer;
+	time_t start, now;
+	gboolean done = FALSE;
+
+	test_assert (dbus_g_proxy_call (proxy, "SetListSettingsSupported", NULL,
+	                                G_TYPE_BOOLEAN, list_settings,
+	                                G_TYPE_INVALID,
+	                                G_TYPE_INVALID));
+
+	timer = g_timer_new ();
+	fetcher = nm_remote_settings_new (bus);
+	test_assert (fetcher != NULL);
+	g_signal_connect (fetcher, NM_REMOTE_SETTINGS_CONNECTIONS_READ,
+	                  G_CALLBACK (connections_read_cb), &done);
+
+	start = time (NULL);
+	do {
+		now = time (NULL);
+		g_main_context_iteration (NULL, FALSE);
+	} while ((done == FALSE) && (now - start < 10));
+	test_assert (done == TRUE);
+	if (elapsed)
+		*elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	/* Every connection exactly once, with its settings */
+	list = nm_remote_settings_list_connections (fetcher);
+	test_assert (g_slist_length (list) == expected->len);
+	for (iter = list; iter; iter = g_slist_next (iter)) {
+		NMConnection *connection = NM_CONNECTION (iter->data);
+		const char *path = nm_connection_get_path (connection);
+
+		test_assert (path_in_array (expected, path));
+		test_assert ((gpointer) nm_remote_settings_get_connection_by_path (fetcher, path) == (gpointer) connection);
+		test_assert (g_strcmp0 (nm_connection_get_id (connection), TEST_CON_ID) == 0);
+	}
+	g_slist_free (list);
+	g_object_unref (fetcher);
+}
+
+/* Has the service add @num copies of a test connection and returns the
+ * paths of all connections it now has.
+ */
+static GPtrArray *
+add_fetch_connections (DBusGProxy *proxy, guint num)
+{
+	NMConnection *connection;
+	NMSettingConnection *s_con;
+	GHashTable *hash;
+	GPtrArray *paths = NULL;
+	char *uuid;
+
+	connection = nm_connection_new ();
+	s_con = (NMSettingConnection *) nm_setting_connection_new ();
+	uuid = nm_utils_uuid_generate ();
+	g_object_set (G_OBJECT (s_con),
+	              NM_SETTING_CONNECTION_ID, TEST_CON_ID,
+	              NM_SETTING_CONNECTION_UUID, uuid,
+	              NM_SETTING_CONNECTION_TYPE, NM_SETTING_WIRED_SETTING_NAME,
+	              NULL);
+	g_free (uuid);
+	nm_connection_add_setting (connection, NM_SETTING (s_con));
+	nm_connection_add_setting (connection, nm_setting_wired_new ());
+	hash = nm_connection_to_hash (connection, NM_SETTING_HASH_FLAG_ALL);
+	g_object_unref (connection);
+
+	test_assert (dbus_g_proxy_call (proxy, "AddConnections", NULL,
+	                                DBUS_TYPE_G_MAP_OF_MAP_OF_VARIANT, hash,
+	                                G_TYPE_UINT, num,
+	                                G_TYPE_INVALID,
+	                                G_TYPE_INVALID));
+	g_hash_table_destroy (hash);
+
+	test_assert (dbus_g_proxy_call (proxy, "ListConnections", NULL,
+	                                G_TYPE_INVALID,
+	                                DBUS_TYPE_G_ARRAY_OF_OBJECT_PATH, &paths,
+	                                G_TYPE_INVALID));
+	test_assert (paths->len >= num);
+	return paths;
+}
+
+static void
+free_paths (GPtrArray *paths)
+{
+	guint i;
+
+	for (i = 0; i < paths->len; i++)
+		g_free (g_ptr_array_index (paths, i));
+	g_ptr_array_free (paths, TRUE);
+}
+
+static void
+test_fetch_connections (void)
+{
+	DBusGProxy *proxy;
+	GPtrArray *paths;
+
+	proxy = dbus_g_proxy_new_for_name (bus,
+	                                   NM_DBUS_SERVICE,
+	                                   NM_DBUS_PATH_SETTINGS,
+	                                   NM_DBUS_IFACE_SETTINGS);
+	test_assert (proxy != NULL);
+
+	paths = add_fetch_connections (proxy, NUM_FETCH_CONNECTIONS);
+
+	test_assert (dbus_g_proxy_call (proxy, "SetListSettingsPageLimit", NULL,
+	                                G_TYPE_UINT, FETCH_PAGE_LIMIT,
+	                                G_TYPE_INVALID,
+	                                G_TYPE_INVALID));
+
+	/* A GetSettings call per connection, like against an older daemon */
+	fetch_all_connections (proxy, FALSE, paths, NULL);
+
+	/* ListConnectionSettings, over several pages */
+	fetch_all_connections (proxy, TRUE, paths, NULL);
+
+	test_assert (dbus_g_proxy_call (proxy, "SetListSettingsPageLimit", NULL,
+	                                G_TYPE_UINT, 0,
+	                                G_TYPE_INVALID,
+	                                G_TYPE_INVALID));
+
+	free_paths (paths);
+	g_object_unref (proxy);
+}
+
+static void
+test_fetch_connections_perf (void)
+{
+	DBusGProxy *proxy;
+	GPtrArray *paths;
+	gdouble t_single, t_bulk;
+
+	proxy = dbus_g_proxy_new_for_name (bus,
+	                                   NM_DBUS_SERVICE,
+	                                   NM_DBUS_PATH_SETTINGS,
+	                                   NM_DBUS_IFACE_SETTINGS);
+	test_assert (proxy != NULL);
+
+	/* More than one ListConnectionSettings page */
+	paths = add_fetch_connections (proxy, NUM_FETCH_CONNECTIONS_PERF);
+
+	fetch_all_connections (proxy, FALSE, paths, &t_single);
+	fetch_all_connections (proxy, TRUE, paths, &t_bulk);
+
+	g_print ("%u connections: GetSettings each %.1f ms, ListConnectionSettings %.1f ms\n",
+	         paths->len, t_single * 1000, t_bulk * 1000);
+
+	free_paths (paths);
+	g_object_unref (proxy);
+}
+
+/*******************************************************************/
+
 #if GLIB_CHECK_VERSION(2,25,12)
 typedef GTestFixtureFunc TCFunc;
 #else
@@ -358,12 +544,12 @@ int main (int argc, char **argv)
 	GError *error = NULL;
 	int i = 100;
 
-	g_assert (argc == 3);
-
 	g_type_init ();
 	
 	g_test_init (&argc, &argv, NULL);
 
+	g_assert (argc == 3);
+
 	bus = dbus_g_bus_get (DBUS_BUS_SESSION, &error);
 	if (!bus) {
 		g_warning ("Error connecting to D-Bus: %s", error->message);
@@ -396,6 +582,9 @@ int main (int argc, char **argv)
 	g_test_suite_add (suite, TESTCASE (test_make_invisible, NULL));
 	g_test_suite_add (suite, TESTCASE (test_make_visible, NULL));
 	g_test_suite_add (suite, TESTCASE (test_remove_connection, NULL));
+	g_test_suite_add (suite, TESTCASE (test_fetch_connections, NULL));
+	if (g_test_perf ())
+		g_test_suite_add (suite, TESTCASE (test_fetch_connections_perf, NULL));
 
 	ret = g_test_run ();
 
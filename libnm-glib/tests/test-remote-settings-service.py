@@ -21,6 +21,9 @@ class UnknownPropertyException(dbus.DBusException):
 class PermissionDeniedException(dbus.DBusException):
     _dbus_error_name = IFACE_SETTINGS + '.PermissionDenied'
 
+class UnknownMethodException(dbus.DBusException):
+    _dbus_error_name = IFACE_DBUS + '.Error.UnknownMethod'
+
 mainloop = gobject.MainLoop()
 
 class Connection(dbus.service.Object):
@@ -61,6 +64,8 @@ class Settings(dbus.service.Object):
         self.connections = {}
         self.bus = bus
         self.counter = 1
+        self.list_settings = True
+        self.page_limit = 0
         self.props = {}
         self.props['Hostname'] = "foobar.baz"
         self.props['CanModify'] = True
@@ -78,6 +83,47 @@ class Settings(dbus.service.Object):
         print "Added connection %s" % path
         return path
 
+    @dbus.service.method(dbus_interface=IFACE_SETTINGS, in_signature='ou', out_signature='a{oa{sa{sv}}}aoo')
+    def ListConnectionSettings(self, after, max_count):
+        if not self.list_settings:
+            raise UnknownMethodException()
+        def index(path):
+            return int(path.rsplit('/', 1)[1])
+        start = -1
+        if after != '/':
+            start = index(after)
+        paths = sorted([p for p in self.connections.keys() if index(p) > start], key=index)
+        if self.page_limit and (not max_count or max_count > self.page_limit):
+            max_count = self.page_limit
+        last = '/'
+        if max_count and len(paths) > max_count:
+            paths = paths[:max_count]
+            last = paths[-1]
+        settings = dbus.Dictionary({}, signature='oa{sa{sv}}')
+        hidden = dbus.Array([], signature='o')
+        for path in paths:
+            if self.connections[path].visible:
+                settings[path] = self.connections[path].settings
+            else:
+                hidden.append(path)
+        return (settings, hidden, dbus.ObjectPath(last))
+
+    # Test helpers: add many connections at once, pretend to be a settings
+    # service without ListConnectionSettings, and return smaller pages than
+    # the client asks for
+    @dbus.service.method(dbus_interface=IFACE_SETTINGS, in_signature='a{sa{sv}}u', out_signature='')
+    def AddConnections(self, settings, count):
+        for i in range(count):
+            self.AddConnection(settings)
+
+    @dbus.service.method(dbus_interface=IFACE_SETTINGS, in_signature='b', out_signature='')
+    def SetListSettingsSupported(self, supported):
+        self.list_settings = supported
+
+    @dbus.service.method(dbus_interface=IFACE_SETTINGS, in_signature='u', out_signature='')
+    def SetListSettingsPageLimit(self, limit):
+        self.page_limit = limit
+
     def delete_connection(self, connection):
         del self.connections[connection.path]
 
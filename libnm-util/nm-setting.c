@@ -75,6 +75,223 @@ enum {
 	PROP_LAST
 };
 
+/*****************************************************************************/
+
+/* Every NMSetting operation walks all properties of the setting's class, so
+ * the property list is built once per class instead of on each call.  For
+ * each property we also remember the class that installed it, so values can
+ * be read through that class' get_property() without the name lookup and
+ * checks in g_object_get_property(), and how to compare and default-check
+ * plain scalar and string values without g_param_values_cmp() and a second
+ * temporary GValue.
+ */
+
+typedef enum {
+	PROP_KIND_OTHER = 0,
+	PROP_KIND_BOOLEAN,
+	PROP_KIND_CHAR,
+	PROP_KIND_UCHAR,
+	PROP_KIND_INT,
+	PROP_KIND_UINT,
+	PROP_KIND_INT64,
+	PROP_KIND_UINT64,
+	PROP_KIND_ENUM,
+	PROP_KIND_FLAGS,
+	PROP_KIND_STRING
+} PropertyKind;
+
+typedef struct {
+	GParamSpec *pspec;
+	GObjectClass *owner;   /* NULL if the value must be read by name */
+	PropertyKind kind;
+} PropertyInfo;
+
+typedef struct {
+	guint n_props;
+	PropertyInfo **props;
+} PropertyTable;
+
+G_LOCK_DEFINE_STATIC (property_tables);
+
+static GQuark
+property_info_quark (void)
+{
+	static GQuark quark;
+
+	if (G_UNLIKELY (!quark))
+		quark = g_quark_from_static_string ("nm-setting-property-info");
+	return quark;
+}
+
+static GQuark
+property_table_quark (void)
+{
+	static GQuark quark;
+
+	if (G_UNLIKELY (!quark))
+		quark = g_quark_from_static_string ("nm-setting-property-table");
+	return quark;
+}
+
+static PropertyKind
+property_kind_for_pspec (GParamSpec *pspec)
+{
+	if (G_IS_PARAM_SPEC_BOOLEAN (pspec))
+		return PROP_KIND_BOOLEAN;
+	if (G_IS_PARAM_SPEC_CHAR (pspec))
+		return PROP_KIND_CHAR;
+	if (G_IS_PARAM_SPEC_UCHAR (pspec))
+		return PROP_KIND_UCHAR;
+	if (G_IS_PARAM_SPEC_INT (pspec))
+		return PROP_KIND_INT;
+	if (G_IS_PARAM_SPEC_UINT (pspec))
+		return PROP_KIND_UINT;
+	if (G_IS_PARAM_SPEC_INT64 (pspec))
+		return PROP_KIND_INT64;
+	if (G_IS_PARAM_SPEC_UINT64 (pspec))
+		return PROP_KIND_UINT64;
+	if (G_IS_PARAM_SPEC_ENUM (pspec))
+		return PROP_KIND_ENUM;
+	if (G_IS_PARAM_SPEC_FLAGS (pspec))
+		return PROP_KIND_FLAGS;
+	if (G_IS_PARAM_SPEC_STRING (pspec))
+		return PROP_KIND_STRING;
+	return PROP_KIND_OTHER;
+}
+
+/* Called with the property_tables lock held */
+static PropertyInfo *
+property_info_ensure (GParamSpec *pspec)
+{
+	PropertyInfo *info;
+
+	info = g_param_spec_get_qdata (pspec, property_info_quark ());
+	if (info)
+		return info;
+
+	info = g_new0 (PropertyInfo, 1);
+	info->pspec = pspec;
+	info->kind = property_kind_for_pspec (pspec);
+
+	/* Overridden properties are redirected by GObject; let it do that */
+	if (   (pspec->flags & G_PARAM_READABLE)
+	    && !g_param_spec_get_redirect_target (pspec))
+		info->owner = g_type_class_peek (pspec->owner_type);
+
+	/* ParamSpecs live as long as their class, which is forever */
+	g_param_spec_set_qdata_full (pspec, property_info_quark (), info, g_free);
+	return info;
+}
+
+static const PropertyTable *
+property_table_get (NMSetting *setting)
+{
+	GType type = G_OBJECT_TYPE (setting);
+	PropertyTable *table;
+	GParamSpec **pspecs;
+	guint i;
+
+	table = g_type_get_qdata (type, property_table_quark ());
+	if (G_LIKELY (table))
+		return table;
+
+	G_LOCK (property_tables);
+	table = g_type_get_qdata (type, property_table_quark ());
+	if (!table) {
+		table = g_new0 (PropertyTable, 1);
+		pspecs = g_object_class_list_properties (G_OBJECT_GET_CLASS (setting), &table->n_props);
+		table->props = g_new0 (PropertyInfo *, table->n_props + 1);
+		for (i = 0; i < table->n_props; i++)
+			table->props[i] = property_info_ensure (pspecs[i]);
+		g_free (pspecs);
+		g_type_set_qdata (type, property_table_quark (), table);
+	}
+	G_UNLOCK (property_tables);
+
+	return table;
+}
+
+static const PropertyInfo *
+property_info_lookup (const GParamSpec *pspec)
+{
+	return g_param_spec_get_qdata ((GParamSpec *) pspec, property_info_quark ());
+}
+
+/* @value must be initialized to the property's value type */
+static inline void
+property_get_value (NMSetting *setting, const PropertyInfo *info, GValue *value)
+{
+	if (G_LIKELY (info->owner)) {
+		info->owner->get_property (G_OBJECT (setting),
+		                           info->pspec->param_id,
+		                           value,
+		                           info->pspec);
+	} else
+		g_object_get_property (G_OBJECT (setting), info->pspec->name, value);
+}
+
+static inline gboolean
+property_values_equal (const PropertyInfo *info, const GValue *a, const GValue *b)
+{
+	switch (info->kind) {
+	case PROP_KIND_BOOLEAN:
+		return g_value_get_boolean (a) == g_value_get_boolean (b);
+	case PROP_KIND_CHAR:
+		return g_value_get_char (a) == g_value_get_char (b);
+	case PROP_KIND_UCHAR:
+		return g_value_get_uchar (a) == g_value_get_uchar (b);
+	case PROP_KIND_INT:
+		return g_value_get_int (a) == g_value_get_int (b);
+	case PROP_KIND_UINT:
+		return g_value_get_uint (a) == g_value_get_uint (b);
+	case PROP_KIND_INT64:
+		return g_value_get_int64 (a) == g_value_get_int64 (b);
+	case PROP_KIND_UINT64:
+		return g_value_get_uint64 (a) == g_value_get_uint64 (b);
+	case PROP_KIND_ENUM:
+		return g_value_get_enum (a) == g_value_get_enum (b);
+	case PROP_KIND_FLAGS:
+		return g_value_get_flags (a) == g_value_get_flags (b);
+	case PROP_KIND_STRING:
+		return g_strcmp0 (g_value_get_string (a), g_value_get_string (b)) == 0;
+	default:
+		return g_param_values_cmp (info->pspec, a, b) == 0;
+	}
+}
+
+static inline gboolean
+property_value_is_default (const PropertyInfo *info, const GValue *value)
+{
+	GParamSpec *pspec = info->pspec;
+
+	switch (info->kind) {
+	case PROP_KIND_BOOLEAN:
+		return g_value_get_boolean (value) == G_PARAM_SPEC_BOOLEAN (pspec)->default_value;
+	case PROP_KIND_CHAR:
+		return g_value_get_char (value) == G_PARAM_SPEC_CHAR (pspec)->default_value;
+	case PROP_KIND_UCHAR:
+		return g_value_get_uchar (value) == G_PARAM_SPEC_UCHAR (pspec)->default_value;
+	case PROP_KIND_INT:
+		return g_value_get_int (value) == G_PARAM_SPEC_INT (pspec)->default_value;
+	case PROP_KIND_UINT:
+		return g_value_get_uint (value) == G_PARAM_SPEC_UINT (pspec)->default_value;
+	case PROP_KIND_INT64:
+		return g_value_get_int64 (value) == G_PARAM_SPEC_INT64 (pspec)->default_value;
+	case PROP_KIND_UINT64:
+		return g_value_get_uint64 (value) == G_PARAM_SPEC_UINT64 (pspec)->default_value;
+	case PROP_KIND_ENUM:
+		return g_value_get_enum (value) == G_PARAM_SPEC_ENUM (pspec)->default_value;
+	case PROP_KIND_FLAGS:
+		return g_value_get_flags (value) == G_PARAM_SPEC_FLAGS (pspec)->default_value;
+	case PROP_KIND_STRING:
+		return g_strcmp0 (g_value_get_string (value), G_PARAM_SPEC_STRING (pspec)->default_value) == 0;
+	default:
+		return g_param_value_defaults (pspec, (GValue *) value);
+	}
+}
+
+/*****************************************************************************/
+
 static void
 destroy_gvalue (gpointer data)
 {
@@ -100,15 +317,14 @@ GHashTable *
 nm_setting_to_hash (NMSetting *setting, NMSettingHashFlags flags)
 {
 	GHashTable *hash;
-	GParamSpec **property_specs;
-	guint n_property_specs;
+	const PropertyTable *table;
 	guint i;
 
 	g_return_val_if_fail (setting != NULL, NULL);
 	g_return_val_if_fail (NM_IS_SETTING (setting), NULL);
 
-	property_specs = g_object_class_list_properties (G_OBJECT_GET_CLASS (setting), &n_property_specs);
-	if (!property_specs) {
+	table = property_table_get (setting);
+	if (!table->n_props) {
 		g_warning ("%s: couldn't find property specs for object of type '%s'",
 		           __func__, g_type_name (G_OBJECT_TYPE (setting)));
 		return NULL;
@@ -117,9 +333,10 @@ nm_setting_to_hash (NMSetting *setting, NMSettingHashFlags flags)
 	hash = g_hash_table_new_full (g_str_hash, g_str_equal,
 	                              (GDestroyNotify) g_free, destroy_gvalue);
 
-	for (i = 0; i < n_property_specs; i++) {
-		GParamSpec *prop_spec = property_specs[i];
-		GValue *value;
+	for (i = 0; i < table->n_props; i++) {
+		const PropertyInfo *info = table->props[i];
+		GParamSpec *prop_spec = info->pspec;
+		GValue value = { 0 };
 
 		if (!(prop_spec->flags & NM_SETTING_PARAM_SERIALIZE))
 			continue;
@@ -132,17 +349,19 @@ nm_setting_to_hash (NMSetting *setting, NMSettingHashFlags flags)
 		    && !(prop_spec->flags & NM_SETTING_PARAM_SECRET))
 			continue;
 
-		value = g_slice_new0 (GValue);
-		g_value_init (value, prop_spec->value_type);
-		g_object_get_property (G_OBJECT (setting), prop_spec->name, value);
+		g_value_init (&value, prop_spec->value_type);
+		property_get_value (setting, info, &value);
 
 		/* Don't serialize values with default values */
-		if (!g_param_value_defaults (prop_spec, value))
-			g_hash_table_insert (hash, g_strdup (prop_spec->name), value);
-		else
-			destroy_gvalue (value);
+		if (!property_value_is_default (info, &value)) {
+			GValue *copy = g_slice_new (GValue);
+
+			/* Move the value and its contents to the heap */
+			*copy = value;
+			g_hash_table_insert (hash, g_strdup (prop_spec->name), copy);
+		} else
+			g_value_unset (&value);
 	}
-	g_free (property_specs);
 
 	/* Don't return empty hashes */
 	if (g_hash_table_size (hash) < 1) {
@@ -317,9 +536,10 @@ compare_property (NMSetting *setting,
 	              const GParamSpec *prop_spec,
 	              NMSettingCompareFlags flags)
 {
+	const PropertyInfo *info;
 	GValue value1 = { 0 };
 	GValue value2 = { 0 };
-	gboolean different;
+	gboolean same;
 
 	/* Handle compare flags */
 	if (prop_spec->flags & NM_SETTING_PARAM_SECRET) {
@@ -346,17 +566,23 @@ compare_property (NMSetting *setting,
 	}
 
 	g_value_init (&value1, prop_spec->value_type);
-	g_object_get_property (G_OBJECT (setting), prop_spec->name, &value1);
-
 	g_value_init (&value2, prop_spec->value_type);
-	g_object_get_property (G_OBJECT (other), prop_spec->name, &value2);
 
-	different = g_param_values_cmp ((GParamSpec *) prop_spec, &value1, &value2);
+	info = property_info_lookup (prop_spec);
+	if (G_LIKELY (info)) {
+		property_get_value (setting, info, &value1);
+		property_get_value (other, info, &value2);
+		same = property_values_equal (info, &value1, &value2);
+	} else {
+		g_object_get_property (G_OBJECT (setting), prop_spec->name, &value1);
+		g_object_get_property (G_OBJECT (other), prop_spec->name, &value2);
+		same = g_param_values_cmp ((GParamSpec *) prop_spec, &value1, &value2) == 0;
+	}
 
 	g_value_unset (&value1);
 	g_value_unset (&value2);
 
-	return different == 0 ? TRUE : FALSE;
+	return same;
 }
 
 /**
@@ -376,8 +602,7 @@ nm_setting_compare (NMSetting *a,
                     NMSetting *b,
                     NMSettingCompareFlags flags)
 {
-	GParamSpec **property_specs;
-	guint n_property_specs;
+	const PropertyTable *table;
 	gint same = TRUE;
 	guint i;
 
@@ -389,9 +614,9 @@ nm_setting_compare (NMSetting *a,
 		return FALSE;
 
 	/* And now all properties */
-	property_specs = g_object_class_list_properties (G_OBJECT_GET_CLASS (a), &n_property_specs);
-	for (i = 0; i < n_property_specs && same; i++) {
-		GParamSpec *prop_spec = property_specs[i];
+	table = property_table_get (a);
+	for (i = 0; i < table->n_props && same; i++) {
+		GParamSpec *prop_spec = table->props[i]->pspec;
 
 		/* Fuzzy compare ignores secrets and properties defined with the FUZZY_IGNORE flag */
 		if (   (flags & NM_SETTING_COMPARE_FLAG_FUZZY)
@@ -404,7 +629,6 @@ nm_setting_compare (NMSetting *a,
 
 		same = NM_SETTING_GET_CLASS (a)->compare_property (a, b, prop_spec, flags);
 	}
-	g_free (property_specs);
 
 	return same;
 }
@@ -473,8 +697,7 @@ nm_setting_diff (NMSetting *a,
                  gboolean invert_results,
                  GHashTable **results)
 {
-	GParamSpec **property_specs;
-	guint n_property_specs;
+	const PropertyTable *table;
 	guint i;
 	NMSettingDiffResult a_result = NM_SETTING_DIFF_RESULT_IN_A;
 	NMSettingDiffResult b_result = NM_SETTING_DIFF_RESULT_IN_B;
@@ -508,10 +731,11 @@ nm_setting_diff (NMSetting *a,
 	}
 
 	/* And now all properties */
-	property_specs = g_object_class_list_properties (G_OBJECT_GET_CLASS (a), &n_property_specs);
+	table = property_table_get (a);
 
-	for (i = 0; i < n_property_specs; i++) {
-		GParamSpec *prop_spec = property_specs[i];
+	for (i = 0; i < table->n_props; i++) {
+		const PropertyInfo *info = table->props[i];
+		GParamSpec *prop_spec = info->pspec;
 		GValue a_value = { 0 }, b_value = { 0 };
 		NMSettingDiffResult r = NM_SETTING_DIFF_RESULT_UNKNOWN, tmp;
 		gboolean different = TRUE;
@@ -524,16 +748,16 @@ nm_setting_diff (NMSetting *a,
 
 		if (b) {
 			g_value_init (&a_value, prop_spec->value_type);
-			g_object_get_property (G_OBJECT (a), prop_spec->name, &a_value);
+			property_get_value (a, info, &a_value);
 
 			g_value_init (&b_value, prop_spec->value_type);
-			g_object_get_property (G_OBJECT (b), prop_spec->name, &b_value);
+			property_get_value (b, info, &b_value);
 
-			different = !!g_param_values_cmp (prop_spec, &a_value, &b_value);
+			different = !property_values_equal (info, &a_value, &b_value);
 			if (different) {
-				if (!g_param_value_defaults (prop_spec, &a_value))
+				if (!property_value_is_default (info, &a_value))
 					r |= a_result;
-				if (!g_param_value_defaults (prop_spec, &b_value))
+				if (!property_value_is_default (info, &b_value))
 					r |= b_result;
 			}
 
@@ -547,7 +771,6 @@ nm_setting_diff (NMSetting *a,
 			g_hash_table_insert (*results, g_strdup (prop_spec->name), GUINT_TO_POINTER (tmp | r));
 		}
 	}
-	g_free (property_specs);
 
 	/* Don't return an empty hash table */
 	if (results_created && !g_hash_table_size (*results)) {
@@ -572,25 +795,23 @@ nm_setting_enumerate_values (NMSetting *setting,
 					    NMSettingValueIterFn func,
 					    gpointer user_data)
 {
-	GParamSpec **property_specs;
-	guint n_property_specs;
-	int i;
+	const PropertyTable *table;
+	guint i;
 
 	g_return_if_fail (NM_IS_SETTING (setting));
 	g_return_if_fail (func != NULL);
 
-	property_specs = g_object_class_list_properties (G_OBJECT_GET_CLASS (setting), &n_property_specs);
-	for (i = 0; i < n_property_specs; i++) {
-		GParamSpec *prop_spec = property_specs[i];
+	table = property_table_get (setting);
+	for (i = 0; i < table->n_props; i++) {
+		const PropertyInfo *info = table->props[i];
+		GParamSpec *prop_spec = info->pspec;
 		GValue value = { 0 };
 
 		g_value_init (&value, G_PARAM_SPEC_VALUE_TYPE (prop_spec));
-		g_object_get_property (G_OBJECT (setting), prop_spec->name, &value);
+		property_get_value (setting, info, &value);
 		func (setting, prop_spec->name, &value, prop_spec->flags, user_data);
 		g_value_unset (&value);
 	}
-
-	g_free (property_specs);
 }
 
 /**
@@ -604,16 +825,14 @@ nm_setting_enumerate_values (NMSetting *setting,
 void
 nm_setting_clear_secrets (NMSetting *setting)
 {
-	GParamSpec **property_specs;
-	guint n_property_specs;
+	const PropertyTable *table;
 	guint i;
 
 	g_return_if_fail (NM_IS_SETTING (setting));
 
-	property_specs = g_object_class_list_properties (G_OBJECT_GET_CLASS (setting), &n_property_specs);
-
-	for (i = 0; i < n_property_specs; i++) {
-		GParamSpec *prop_spec = property_specs[i];
+	table = property_table_get (setting);
+	for (i = 0; i < table->n_props; i++) {
+		GParamSpec *prop_spec = table->props[i]->pspec;
 		GValue value = { 0 };
 
 		if (prop_spec->flags & NM_SETTING_PARAM_SECRET) {
@@ -623,8 +842,6 @@ nm_setting_clear_secrets (NMSetting *setting)
 			g_value_unset (&value);
 		}
 	}
-
-	g_free (property_specs);
 }
 
 static void
@@ -660,25 +877,24 @@ nm_setting_clear_secrets_with_flags (NMSetting *setting,
                                      NMSettingClearSecretsWithFlagsFn func,
                                      gpointer user_data)
 {
-	GParamSpec **property_specs;
-	guint n_property_specs;
+	const PropertyTable *table;
 	guint i;
 
 	g_return_if_fail (setting);
 	g_return_if_fail (NM_IS_SETTING (setting));
 	g_return_if_fail (func != NULL);
 
-	property_specs = g_object_class_list_properties (G_OBJECT_GET_CLASS (setting), &n_property_specs);
-	for (i = 0; i < n_property_specs; i++) {
-		if (property_specs[i]->flags & NM_SETTING_PARAM_SECRET) {
+	table = property_table_get (setting);
+	for (i = 0; i < table->n_props; i++) {
+		GParamSpec *prop_spec = table->props[i]->pspec;
+
+		if (prop_spec->flags & NM_SETTING_PARAM_SECRET) {
 			NM_SETTING_GET_CLASS (setting)->clear_secrets_with_flags (setting,
-			                                                          property_specs[i],
+			                                                          prop_spec,
 			                                                          func,
 			                                                          user_data);
 		}
 	}
-
-	g_free (property_specs);
 }
 
 /**
@@ -919,35 +1135,35 @@ char *
 nm_setting_to_string (NMSetting *setting)
 {
 	GString *string;
-	GParamSpec **property_specs;
-	guint n_property_specs;
+	const PropertyTable *table;
 	guint i;
 
 	g_return_val_if_fail (NM_IS_SETTING (setting), NULL);
 
-	property_specs = g_object_class_list_properties (G_OBJECT_GET_CLASS (setting), &n_property_specs);
-	if (!property_specs)
+	table = property_table_get (setting);
+	if (!table->n_props)
 		return NULL;
 
 	string = g_string_new (nm_setting_get_name (setting));
 	g_string_append_c (string, '\n');
 
-	for (i = 0; i < n_property_specs; i++) {
-		GParamSpec *prop_spec = property_specs[i];
+	for (i = 0; i < table->n_props; i++) {
+		const PropertyInfo *info = table->props[i];
+		GParamSpec *prop_spec = info->pspec;
 		GValue value = { 0 };
 		char *value_str;
 		gboolean is_serializable;
 		gboolean is_default;
 
 		g_value_init (&value, prop_spec->value_type);
-		g_object_get_property (G_OBJECT (setting), prop_spec->name, &value);
+		property_get_value (setting, info, &value);
 
 		value_str = g_strdup_value_contents (&value);
 		g_string_append_printf (string, "\t%s : %s", prop_spec->name, value_str);
 		g_free (value_str);
 
 		is_serializable = prop_spec->flags & NM_SETTING_PARAM_SERIALIZE;
-		is_default = g_param_value_defaults (prop_spec, &value);
+		is_default = property_value_is_default (info, &value);
 
 		g_value_unset (&value);
 
@@ -965,7 +1181,6 @@ nm_setting_to_string (NMSetting *setting)
 		g_string_append_c (string, '\n');
 	}
 
-	g_free (property_specs);
 	g_string_append_c (string, '\n');
 
 	return g_string_free (string, FALSE);
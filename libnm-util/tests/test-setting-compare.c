@@ -0,0 +1,355 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ *
+ */
+
+/* Checks nm_setting_to_hash() and nm_setting_compare() against the
+ * straightforward implementation they replaced (list the class' properties
+ * and go through g_object_get_property() and g_param_values_cmp() for each
+ * one); both must give the same answers.  With "-m perf" both are also
+ * timed.
+ */
+
+#include <glib.h>
+#include <dbus/dbus-glib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "nm-test-helpers.h"
+#include <nm-utils.h>
+
+#include "nm-setting-connection.h"
+#include "nm-setting-wired.h"
+#include "nm-setting-wireless.h"
+#include "nm-setting-wireless-security.h"
+#include "nm-setting-ip4-config.h"
+#include "nm-setting-serial.h"
+
+#define ITERATIONS_PERF 20000
+
+static void
+destroy_gvalue (gpointer data)
+{
+	g_value_unset ((GValue *) data);
+	g_slice_free (GValue, data);
+}
+
+static GHashTable *
+reference_to_hash (NMSetting *setting)
+{
+	GHashTable *hash;
+	GParamSpec **pspecs;
+	guint n_pspecs, i;
+
+	hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, destroy_gvalue);
+
+	pspecs = g_object_class_list_properties (G_OBJECT_GET_CLASS (setting), &n_pspecs);
+	for (i = 0; i < n_pspecs; i++) {
+		GValue *value;
+
+		if (!(pspecs[i]->flags & NM_SETTING_PARAM_SERIALIZE))
+			continue;
+
+		value = g_slice_new0 (GValue);
+		g_value_init (value, pspecs[i]->value_type);
+		g_object_get_property (G_OBJECT (setting), pspecs[i]->name, value);
+
+		if (!g_param_value_defaults (pspecs[i], value))
+			g_hash_table_insert (hash, g_strdup (pspecs[i]->name), value);
+		else
+			destroy_gvalue (value);
+	}
+	g_free (pspecs);
+
+	return hash;
+}
+
+static gboolean
+reference_compare (NMSetting *a, NMSetting *b)
+{
+	GParamSpec **pspecs;
+	guint n_pspecs, i;
+	gboolean same = TRUE;
+
+	pspecs = g_object_class_list_properties (G_OBJECT_GET_CLASS (a), &n_pspecs);
+	for (i = 0; i < n_pspecs && same; i++) {
+		GValue value1 = { 0 }, value2 = { 0 };
+
+		g_value_init (&value1, pspecs[i]->value_type);
+		g_object_get_property (G_OBJECT (a), pspecs[i]->name, &value1);
+		g_value_init (&value2, pspecs[i]->value_type);
+		g_object_get_property (G_OBJECT (b), pspecs[i]->name, &value2);
+
+		same = g_param_values_cmp (pspecs[i], &value1, &value2) == 0;
+
+		g_value_unset (&value1);
+		g_value_unset (&value2);
+	}
+	g_free (pspecs);
+
+	return same;
+}
+
+static void
+check_hashes_equal (NMSetting *setting, GHashTable *hash, GHashTable *reference)
+{
+	GHashTableIter iter;
+	const char *key;
+	GValue *value, *other;
+	GParamSpec *pspec;
+
+	ASSERT (g_hash_table_size (hash) == g_hash_table_size (reference),
+	        "setting-compare", "%s: %u properties hashed, expected %u",
+	        nm_setting_get_name (setting),
+	        g_hash_table_size (hash), g_hash_table_size (reference));
+
+	g_hash_table_iter_init (&iter, reference);
+	while (g_hash_table_iter_next (&iter, (gpointer) &key, (gpointer) &value)) {
+		other = g_hash_table_lookup (hash, key);
+		ASSERT (other != NULL,
+		        "setting-compare", "%s: missing property '%s'",
+		        nm_setting_get_name (setting), key);
+
+		pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (setting), key);
+		ASSERT (g_param_values_cmp (pspec, value, other) == 0,
+		        "setting-compare", "%s: property '%s' differs",
+		        nm_setting_get_name (setting), key);
+	}
+}
+
+static NMSetting *
+make_connection_setting (void)
+{
+	NMSetting *s;
+
+	s = nm_setting_connection_new ();
+	g_object_set (s,
+	              NM_SETTING_CONNECTION_ID, "compare test connection",
+	              NM_SETTING_CONNECTION_UUID, "fbbd59d5-acab-4e30-8f86-258d272617e7",
+	              NM_SETTING_CONNECTION_TYPE, NM_SETTING_WIRELESS_SETTING_NAME,
+	              NM_SETTING_CONNECTION_AUTOCONNECT, FALSE,
+	              NM_SETTING_CONNECTION_TIMESTAMP, (guint64) 1234567890,
+	              NULL);
+	return s;
+}
+
+static NMSetting *
+make_wired_setting (void)
+{
+	NMSetting *s;
+
+	s = nm_setting_wired_new ();
+	g_object_set (s,
+	              NM_SETTING_WIRED_MTU, 1400,
+	              NM_SETTING_WIRED_SPEED, 100,
+	              NM_SETTING_WIRED_DUPLEX, "full",
+	              NULL);
+	return s;
+}
+
+static NMSetting *
+make_wireless_setting (void)
+{
+	NMSetting *s;
+	GByteArray *ssid;
+
+	ssid = g_byte_array_new ();
+	g_byte_array_append (ssid, (const guint8 *) "perf-test", strlen ("perf-test"));
+
+	s = nm_setting_wireless_new ();
+	g_object_set (s,
+	              NM_SETTING_WIRELESS_SSID, ssid,
+	              NM_SETTING_WIRELESS_MODE, "infrastructure",
+	              NM_SETTING_WIRELESS_CHANNEL, 6,
+	              NM_SETTING_WIRELESS_MTU, 1400,
+	              NULL);
+	g_byte_array_free (ssid, TRUE);
+	return s;
+}
+
+static NMSetting *
+make_wsec_setting (void)
+{
+	NMSetting *s;
+
+	s = nm_setting_wireless_security_new ();
+	g_object_set (s,
+	              NM_SETTING_WIRELESS_SECURITY_KEY_MGMT, "wpa-psk",
+	              NM_SETTING_WIRELESS_SECURITY_PSK, "really cool psk",
+	              NULL);
+	return s;
+}
+
+static NMSetting *
+make_ip4_setting (void)
+{
+	NMSetting *s;
+
+	s = nm_setting_ip4_config_new ();
+	g_object_set (s,
+	              NM_SETTING_IP4_CONFIG_METHOD, NM_SETTING_IP4_CONFIG_METHOD_AUTO,
+	              NM_SETTING_IP4_CONFIG_DHCP_CLIENT_ID, "perf-client",
+	              NM_SETTING_IP4_CONFIG_IGNORE_AUTO_DNS, TRUE,
+	              NULL);
+	return s;
+}
+
+static NMSetting *
+make_serial_setting (void)
+{
+	NMSetting *s;
+
+	s = nm_setting_serial_new ();
+	g_object_set (s,
+	              NM_SETTING_SERIAL_BAUD, 57600,
+	              NM_SETTING_SERIAL_PARITY, 'E',
+	              NULL);
+	return s;
+}
+
+typedef NMSetting * (*MakeSettingFunc) (void);
+
+static void
+test_setting_compare (MakeSettingFunc make_setting)
+{
+	NMSetting *a, *b;
+	GHashTable *hash, *reference;
+
+	a = make_setting ();
+	b = nm_setting_duplicate (a);
+
+	hash = nm_setting_to_hash (a, NM_SETTING_HASH_FLAG_ALL);
+	reference = reference_to_hash (a);
+	check_hashes_equal (a, hash, reference);
+	g_hash_table_destroy (hash);
+	g_hash_table_destroy (reference);
+
+	ASSERT (nm_setting_compare (a, b, NM_SETTING_COMPARE_FLAG_EXACT) == TRUE,
+	        "setting-compare", "%s: duplicate compares different", nm_setting_get_name (a));
+	ASSERT (reference_compare (a, b) == TRUE,
+	        "setting-compare", "%s: duplicate compares different", nm_setting_get_name (a));
+
+	g_object_unref (a);
+	g_object_unref (b);
+}
+
+static void
+test_setting_perf (MakeSettingFunc make_setting)
+{
+	NMSetting *a, *b;
+	GTimer *timer;
+	gdouble t_reference, t_table;
+	guint i;
+
+	a = make_setting ();
+	b = nm_setting_duplicate (a);
+
+	timer = g_timer_new ();
+
+	for (i = 0; i < ITERATIONS_PERF; i++) {
+		g_hash_table_destroy (reference_to_hash (a));
+		reference_compare (a, b);
+	}
+	t_reference = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	for (i = 0; i < ITERATIONS_PERF; i++) {
+		g_hash_table_destroy (nm_setting_to_hash (a, NM_SETTING_HASH_FLAG_ALL));
+		nm_setting_compare (a, b, NM_SETTING_COMPARE_FLAG_EXACT);
+	}
+	t_table = g_timer_elapsed (timer, NULL);
+
+	g_timer_destroy (timer);
+
+	fprintf (stdout, "%s: to_hash+compare x%d: generic %.1f ms, property table %.1f ms\n",
+	         nm_setting_get_name (a), ITERATIONS_PERF, t_reference * 1000, t_table * 1000);
+
+	g_object_unref (a);
+	g_object_unref (b);
+}
+
+static void
+test_setting_compare_diff (void)
+{
+	NMSetting *a, *b;
+	GHashTable *results = NULL;
+	gboolean same;
+
+	a = make_wired_setting ();
+	b = nm_setting_duplicate (a);
+	g_object_set (b,
+	              NM_SETTING_WIRED_MTU, 0,
+	              NM_SETTING_WIRED_DUPLEX, "half",
+	              NULL);
+
+	ASSERT (reference_compare (a, b) == FALSE,
+	        "setting-compare-diff", "modified setting compares equal");
+	ASSERT (nm_setting_compare (a, b, NM_SETTING_COMPARE_FLAG_EXACT) == FALSE,
+	        "setting-compare-diff", "modified setting compares equal");
+
+	same = nm_setting_diff (a, b, NM_SETTING_COMPARE_FLAG_EXACT, FALSE, &results);
+	ASSERT (same == FALSE, "setting-compare-diff", "diff found no differences");
+	ASSERT (g_hash_table_size (results) == 2,
+	        "setting-compare-diff", "unexpected number of differences %u",
+	        g_hash_table_size (results));
+
+	/* The MTU went back to its default in B, so it's only set in A */
+	ASSERT (GPOINTER_TO_UINT (g_hash_table_lookup (results, NM_SETTING_WIRED_MTU)) == NM_SETTING_DIFF_RESULT_IN_A,
+	        "setting-compare-diff", "unexpected MTU diff result");
+	ASSERT (GPOINTER_TO_UINT (g_hash_table_lookup (results, NM_SETTING_WIRED_DUPLEX)) == (NM_SETTING_DIFF_RESULT_IN_A | NM_SETTING_DIFF_RESULT_IN_B),
+	        "setting-compare-diff", "unexpected duplex diff result");
+
+	g_hash_table_destroy (results);
+	g_object_unref (a);
+	g_object_unref (b);
+}
+
+int main (int argc, char **argv)
+{
+	GError *error = NULL;
+	char *base;
+
+	g_type_init ();
+	g_test_init (&argc, &argv, NULL);
+
+	if (!nm_utils_init (&error))
+		FAIL ("nm-utils-init", "failed to initialize libnm-util: %s", error->message);
+
+	test_setting_compare (make_connection_setting);
+	test_setting_compare (make_wired_setting);
+	test_setting_compare (make_wireless_setting);
+	test_setting_compare (make_wsec_setting);
+	test_setting_compare (make_ip4_setting);
+	test_setting_compare (make_serial_setting);
+	test_setting_compare_diff ();
+
+	if (g_test_perf ()) {
+		test_setting_perf (make_connection_setting);
+		test_setting_perf (make_wired_setting);
+		test_setting_perf (make_wireless_setting);
+		test_setting_perf (make_wsec_setting);
+		test_setting_perf (make_ip4_setting);
+		test_setting_perf (make_serial_setting);
+	}
+
+	base = g_path_get_basename (argv[0]);
+	fprintf (stdout, "%s: SUCCESS\n", base);
+	g_free (base);
+	return 0;
+}
@@ -32,7 +32,6 @@
 
 #include "nm-utils.h"
 #include "nm-logging.h"
-#include "nm-dbus-glib-types.h"
 #include "nm-dhcp-client.h"
 
 typedef struct {
@@ -288,15 +287,33 @@ start_monitor (NMDHCPClient *self)
 {
 	NMDHCPClientPrivate *priv = NM_DHCP_CLIENT_GET_PRIVATE (self);
 
-	g_return_if_fail (priv->pid > 0);
-
 	/* Set up a timeout on the transaction to kill it after the timeout */
 	priv->timeout_id = g_timeout_add_seconds (priv->timeout,
 	                                          daemon_timeout,
 	                                          self);
-	priv->watch_id = g_child_watch_add (priv->pid,
-	                                    (GChildWatchFunc) daemon_watch_cb,
-	                                    self);
+	if (priv->pid > 0) {
+		priv->watch_id = g_child_watch_add (priv->pid,
+		                                    (GChildWatchFunc) daemon_watch_cb,
+		                                    self);
+	}
+}
+
+/* Takes the result of the class' ip4_start() or ip6_start(); returns TRUE
+ * if the client is running.  In-process clients are left with a PID of 0.
+ */
+static gboolean
+client_started (NMDHCPClient *self, GPid pid)
+{
+	NMDHCPClientPrivate *priv = NM_DHCP_CLIENT_GET_PRIVATE (self);
+
+	if (pid <= 0) {
+		priv->pid = -1;
+		return FALSE;
+	}
+
+	priv->pid = NM_DHCP_CLIENT_GET_CLASS (self)->in_process ? 0 : pid;
+	start_monitor (self);
+	return TRUE;
 }
 
 gboolean
@@ -318,11 +335,8 @@ nm_dhcp_client_start_ip4 (NMDHCPClient *self,
 	nm_log_info (LOGD_DHCP, "Activation (%s) Beginning DHCPv4 transaction (timeout in %d seconds)",
 	             priv->iface, priv->timeout);
 
-	priv->pid = NM_DHCP_CLIENT_GET_CLASS (self)->ip4_start (self, s_ip4, dhcp_anycast_addr, hostname);
-	if (priv->pid)
-		start_monitor (self);
-
-	return priv->pid ? TRUE : FALSE;
+	return client_started (self,
+	                       NM_DHCP_CLIENT_GET_CLASS (self)->ip4_start (self, s_ip4, dhcp_anycast_addr, hostname));
 }
 
 struct duid_header {
@@ -420,16 +434,13 @@ nm_dhcp_client_start_ip6 (NMDHCPClient *self,
 	nm_log_info (LOGD_DHCP, "Activation (%s) Beginning DHCPv6 transaction (timeout in %d seconds)",
 	             priv->iface, priv->timeout);
 
-	priv->pid = NM_DHCP_CLIENT_GET_CLASS (self)->ip6_start (self,
-	                                                        s_ip6,
-	                                                        dhcp_anycast_addr,
-	                                                        hostname,
-	                                                        info_only,
-	                                                        priv->duid);
-	if (priv->pid > 0)
-		start_monitor (self);
-
-	return priv->pid ? TRUE : FALSE;
+	return client_started (self,
+	                       NM_DHCP_CLIENT_GET_CLASS (self)->ip6_start (self,
+	                                                                   s_ip6,
+	                                                                   dhcp_anycast_addr,
+	                                                                   hostname,
+	                                                                   info_only,
+	                                                                   priv->duid));
 }
 
 void
@@ -482,8 +493,12 @@ nm_dhcp_client_stop (NMDHCPClient *self, gboolean release)
 		NM_DHCP_CLIENT_GET_CLASS (self)->stop (self, release, priv->duid);
 		priv->dead = TRUE;
 
-		nm_log_info (LOGD_DHCP, "(%s): canceled DHCP transaction, DHCP client pid %d",
-		             priv->iface, priv->pid);
+		if (NM_DHCP_CLIENT_GET_CLASS (self)->in_process)
+			nm_log_info (LOGD_DHCP, "(%s): canceled DHCP transaction", priv->iface);
+		else {
+			nm_log_info (LOGD_DHCP, "(%s): canceled DHCP transaction, DHCP client pid %d",
+			             priv->iface, priv->pid);
+		}
 	}
 
 	/* And clean stuff up */
@@ -575,58 +590,12 @@ string_to_state (const char *name)
 	return 255;
 }
 
-static char *
-garray_to_string (GArray *array, const char *key)
-{
-	GString *str;
-	int i;
-	unsigned char c;
-	char *converted = NULL;
-
-	g_return_val_if_fail (array != NULL, NULL);
-
-	/* Since the DHCP options come through environment variables, they should
-	 * already be UTF-8 safe, but just make sure.
-	 */
-	str = g_string_sized_new (array->len);
-	for (i = 0; i < array->len; i++) {
-		c = array->data[i];
-
-		/* Convert NULLs to spaces and non-ASCII characters to ? */
-		if (c == '\0')
-			c = ' ';
-		else if (c > 127)
-			c = '?';
-		str = g_string_append_c (str, c);
-	}
-	str = g_string_append_c (str, '\0');
-
-	converted = str->str;
-	if (!g_utf8_validate (converted, -1, NULL))
-		nm_log_warn (LOGD_DHCP, "DHCP option '%s' couldn't be converted to UTF-8", key);
-	g_string_free (str, FALSE);
-	return converted;
-}
-
 static void
 copy_option (gpointer key,
              gpointer value,
              gpointer user_data)
 {
-	GHashTable *hash = user_data;
-	const char *str_key = (const char *) key;
-	char *str_value = NULL;
-
-	if (G_VALUE_TYPE (value) != DBUS_TYPE_G_UCHAR_ARRAY) {
-		nm_log_warn (LOGD_DHCP, "unexpected key %s value type was not "
-		             "DBUS_TYPE_G_UCHAR_ARRAY",
-		             str_key);
-		return;
-	}
-
-	str_value = garray_to_string ((GArray *) g_value_get_boxed (value), str_key);
-	if (str_value)
-		g_hash_table_insert (hash, g_strdup (str_key), str_value);
+	g_hash_table_insert ((GHashTable *) user_data, g_strdup (key), g_strdup (value));
 }
 
 void
@@ -1264,6 +1233,9 @@ nm_dhcp_client_get_ip4_config (NMDHCPClient *self, gboolean test)
 		return NULL;
 	}
 
+	if (NM_DHCP_CLIENT_GET_CLASS (self)->ip4_get_config)
+		return NM_DHCP_CLIENT_GET_CLASS (self)->ip4_get_config (self);
+
 	if (!g_hash_table_size (priv->options)) {
 		/* We never got a response from the DHCP client */
 		return NULL;
@@ -104,6 +104,23 @@ typedef struct {
 	 */
 	GByteArray * (*get_duid) (NMDHCPClient *self);
 
+	/**
+	 * ip4_get_config:
+	 * @self: the #NMDHCPClient
+	 *
+	 * For clients that decode the lease themselves, returns the IPv4
+	 * configuration of the current lease instead of building it from the
+	 * option table.
+	 */
+	NMIP4Config * (*ip4_get_config) (NMDHCPClient *self);
+
+	/* TRUE for clients that run inside NetworkManager rather than as a
+	 * child process.  Their ip4_start() and ip6_start() return a positive
+	 * value on success that isn't a PID: there is no process to watch or
+	 * kill, and no events come in over D-Bus.
+	 */
+	gboolean in_process;
+
 	/* Signals */
 	void (*state_changed) (NMDHCPClient *self, NMDHCPState state);
 	void (*timeout)       (NMDHCPClient *self);
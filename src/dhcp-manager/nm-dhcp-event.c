@@ -0,0 +1,100 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#include <string.h>
+
+#include "nm-dhcp-event.h"
+#include "nm-dhcp-manager.h"
+
+/* Since the DHCP options come through environment variables, they should
+ * already be UTF-8 safe, but just make sure: non-ASCII characters are
+ * replaced with '?'.
+ */
+static char *
+sanitize_value (const char *value)
+{
+	char *str, *p;
+
+	str = g_strdup (value);
+	for (p = str; *p; p++) {
+		if ((unsigned char) *p > 127)
+			*p = '?';
+	}
+	return str;
+}
+
+/**
+ * nm_dhcp_event_parse:
+ * @buf: the received datagram
+ * @len: length of @buf
+ * @error: location for a #GError
+ *
+ * Decodes a DHCP client event.
+ *
+ * Returns: a table mapping option names to values, or %NULL if @buf is
+ * not a well-formed event
+ **/
+GHashTable *
+nm_dhcp_event_parse (const char *buf, gsize len, GError **error)
+{
+	GHashTable *options;
+	const char *p, *end, *eq;
+	gsize entry_len;
+
+	g_return_val_if_fail (buf != NULL, NULL);
+
+	if (   len < sizeof (NM_DHCP_EVENT_MAGIC)
+	    || memcmp (buf, NM_DHCP_EVENT_MAGIC, sizeof (NM_DHCP_EVENT_MAGIC)) != 0) {
+		g_set_error_literal (error,
+		                     NM_DHCP_MANAGER_ERROR, NM_DHCP_MANAGER_ERROR_INTERNAL,
+		                     "unknown event format");
+		return NULL;
+	}
+
+	/* Every entry, including the last one, must be terminated */
+	if (buf[len - 1] != '\0') {
+		g_set_error_literal (error,
+		                     NM_DHCP_MANAGER_ERROR, NM_DHCP_MANAGER_ERROR_INTERNAL,
+		                     "truncated event");
+		return NULL;
+	}
+
+	options = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+	end = buf + len;
+	for (p = buf + sizeof (NM_DHCP_EVENT_MAGIC); p < end; p += entry_len + 1) {
+		entry_len = strlen (p);
+
+		eq = strchr (p, '=');
+		if (!eq || eq == p) {
+			g_set_error (error,
+			             NM_DHCP_MANAGER_ERROR, NM_DHCP_MANAGER_ERROR_INTERNAL,
+			             "malformed option '%s'", p);
+			g_hash_table_destroy (options);
+			return NULL;
+		}
+
+		g_hash_table_insert (options,
+		                     g_strndup (p, eq - p),
+		                     sanitize_value (eq + 1));
+	}
+
+	return options;
+}
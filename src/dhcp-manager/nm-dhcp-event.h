@@ -0,0 +1,39 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#ifndef NM_DHCP_EVENT_H
+#define NM_DHCP_EVENT_H
+
+#include <glib.h>
+
+/* DHCP client events are sent by the nm-dhcp-client.action helper as one
+ * datagram on a unix socket.  The datagram is the magic below (including
+ * its terminating NUL) followed by the helper's environment, one
+ * "name=value" string per entry, each terminated by a NUL.
+ *
+ * Keep in sync with callouts/nm-dhcp-client-action.c.
+ */
+#define NM_DHCP_EVENT_SOCKET   NMRUNDIR "/dhcp-events"
+#define NM_DHCP_EVENT_MAGIC    "NMDHCP1"
+#define NM_DHCP_EVENT_MAX_SIZE 65536
+
+GHashTable *nm_dhcp_event_parse (const char *buf, gsize len, GError **error);
+
+#endif /* NM_DHCP_EVENT_H */
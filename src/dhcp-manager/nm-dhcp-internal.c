@@ -0,0 +1,751 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+
+#include "nm-dhcp-internal.h"
+#include "nm-dhcp-packet.h"
+#include "nm-utils.h"
+#include "nm-logging.h"
+
+G_DEFINE_TYPE (NMDHCPInternal, nm_dhcp_internal, NM_TYPE_DHCP_CLIENT)
+
+#define NM_DHCP_INTERNAL_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), NM_TYPE_DHCP_INTERNAL, NMDHCPInternalPrivate))
+
+#define RECV_BUF_SIZE      65536
+#define MAX_MESSAGE_SIZE   1500
+
+/* RFC 2131 4.1: 4, 8, 16, 32 and then 64 seconds, each +/- 1 second */
+#define RETRANSMIT_FIRST   4
+#define RETRANSMIT_MAX     64
+
+typedef enum {
+	STATE_INIT = 0,
+	STATE_SELECTING,
+	STATE_REQUESTING,
+	STATE_BOUND,
+	STATE_RENEWING,
+	STATE_REBINDING
+} InternalState;
+
+typedef struct {
+	int fd;
+	guint io_id;
+	guint8 *recv_buf;
+	int ifindex;
+
+	GByteArray *hwaddr;
+	GByteArray *client_id;
+	char *hostname;
+
+	InternalState state;
+	guint32 xid;
+	guint attempt;
+	guint retransmit_id;
+	guint lease_timer_id;
+
+	/* From the OFFER being requested, and then from the ACK */
+	guint32 offered;
+	guint32 server_id;
+	guint8 server_mac[ETH_ALEN];
+
+	NMDHCPLease *lease;
+} NMDHCPInternalPrivate;
+
+static const guint8 broadcast_mac[ETH_ALEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+static const guint8 requested_options[] = {
+	NM_DHCP_OPTION_SUBNET_MASK,
+	NM_DHCP_OPTION_ROUTER,
+	NM_DHCP_OPTION_DNS_SERVER,
+	NM_DHCP_OPTION_HOST_NAME,
+	NM_DHCP_OPTION_DOMAIN_NAME,
+	NM_DHCP_OPTION_INTERFACE_MTU,
+	NM_DHCP_OPTION_STATIC_ROUTE,
+	NM_DHCP_OPTION_NIS_DOMAIN,
+	NM_DHCP_OPTION_NIS_SERVERS,
+	NM_DHCP_OPTION_NETBIOS_NS,
+	NM_DHCP_OPTION_LEASE_TIME,
+	NM_DHCP_OPTION_SERVER_ID,
+	NM_DHCP_OPTION_RENEWAL_TIME,
+	NM_DHCP_OPTION_REBINDING_TIME,
+	NM_DHCP_OPTION_DOMAIN_SEARCH,
+	NM_DHCP_OPTION_CLASSLESS_ROUTE,
+	NM_DHCP_OPTION_MS_CLASSLESS_ROUTE,
+};
+
+GSList *
+nm_dhcp_internal_get_lease_config (const char *iface, const char *uuid, gboolean ipv6)
+{
+	/* Leases aren't persisted yet */
+	return NULL;
+}
+
+static const char *
+state_to_string (InternalState state)
+{
+	switch (state) {
+	case STATE_SELECTING:
+		return "selecting";
+	case STATE_REQUESTING:
+		return "requesting";
+	case STATE_BOUND:
+		return "bound";
+	case STATE_RENEWING:
+		return "renewing";
+	case STATE_REBINDING:
+		return "rebinding";
+	default:
+		return "init";
+	}
+}
+
+/* The client ID is either hex octets separated by ':', like dhclient takes
+ * it, or a plain string.  By default it's the hardware type and address.
+ */
+static GByteArray *
+make_client_id (NMSettingIP4Config *s_ip4, const GByteArray *hwaddr)
+{
+	GByteArray *client_id;
+	const char *str = NULL;
+	char **octets, **iter;
+	guint8 b;
+
+	if (s_ip4)
+		str = nm_setting_ip4_config_get_dhcp_client_id (s_ip4);
+
+	client_id = g_byte_array_new ();
+	if (str && *str) {
+		octets = g_strsplit (str, ":", -1);
+		for (iter = octets; *iter; iter++) {
+			if (   !**iter
+			    || strlen (*iter) > 2
+			    || !g_ascii_isxdigit ((*iter)[0])
+			    || ((*iter)[1] && !g_ascii_isxdigit ((*iter)[1])))
+				break;
+			b = (guint8) strtoul (*iter, NULL, 16);
+			g_byte_array_append (client_id, &b, 1);
+		}
+		if (*iter) {
+			g_byte_array_set_size (client_id, 0);
+			g_byte_array_append (client_id, (const guint8 *) str, strlen (str));
+		}
+		g_strfreev (octets);
+	} else {
+		b = 1;  /* ARPHRD_ETHER */
+		g_byte_array_append (client_id, &b, 1);
+		g_byte_array_append (client_id, hwaddr->data, hwaddr->len);
+	}
+	return client_id;
+}
+
+/*****************************************************************/
+
+static gboolean
+send_packet (NMDHCPInternal *self,
+             GByteArray *payload,
+             guint32 saddr,
+             guint32 daddr,
+             const guint8 *dest_mac)
+{
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+	const char *iface = nm_dhcp_client_get_iface (NM_DHCP_CLIENT (self));
+	struct sockaddr_ll sll;
+	GByteArray *datagram;
+	ssize_t sent;
+
+	datagram = nm_dhcp_packet_wrap_udp (payload, saddr, NM_DHCP_CLIENT_PORT,
+	                                    daddr, NM_DHCP_SERVER_PORT);
+
+	memset (&sll, 0, sizeof (sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons (ETH_P_IP);
+	sll.sll_ifindex = priv->ifindex;
+	sll.sll_halen = ETH_ALEN;
+	memcpy (sll.sll_addr, dest_mac, ETH_ALEN);
+
+	sent = sendto (priv->fd, datagram->data, datagram->len, 0,
+	               (struct sockaddr *) &sll, sizeof (sll));
+	if (sent < 0) {
+		nm_log_warn (LOGD_DHCP4, "(%s): could not send DHCP message: %s",
+		             iface, strerror (errno));
+	}
+	g_byte_array_free (datagram, TRUE);
+	return sent >= 0;
+}
+
+static void
+send_message (NMDHCPInternal *self, NMDHCPMessageType type)
+{
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+	GByteArray *packet;
+	guint32 ciaddr = 0, daddr = INADDR_BROADCAST;
+	const guint8 *dest_mac = broadcast_mac;
+	guint16 max_size = htons (MAX_MESSAGE_SIZE);
+
+	/* Once bound, the client has an address to renew and release from;
+	 * renewals and releases go straight to the server.
+	 */
+	if (   priv->lease
+	    && (   priv->state == STATE_RENEWING
+	        || priv->state == STATE_REBINDING
+	        || type == NM_DHCP_MSG_RELEASE))
+		ciaddr = priv->lease->address;
+	if (priv->state == STATE_RENEWING || type == NM_DHCP_MSG_RELEASE) {
+		daddr = priv->server_id;
+		dest_mac = priv->server_mac;
+	}
+
+	packet = nm_dhcp_packet_new (NM_DHCP_OP_REQUEST, type, priv->xid,
+	                             priv->hwaddr->data, priv->hwaddr->len,
+	                             ciaddr, 0);
+
+	if (type == NM_DHCP_MSG_REQUEST && priv->state == STATE_REQUESTING) {
+		nm_dhcp_packet_add_option (packet, NM_DHCP_OPTION_REQUESTED_IP, &priv->offered, 4);
+		nm_dhcp_packet_add_option (packet, NM_DHCP_OPTION_SERVER_ID, &priv->server_id, 4);
+	}
+	if (type == NM_DHCP_MSG_RELEASE)
+		nm_dhcp_packet_add_option (packet, NM_DHCP_OPTION_SERVER_ID, &priv->server_id, 4);
+
+	nm_dhcp_packet_add_option (packet, NM_DHCP_OPTION_CLIENT_ID,
+	                           priv->client_id->data, MIN (priv->client_id->len, 255));
+
+	if (type != NM_DHCP_MSG_RELEASE) {
+		nm_dhcp_packet_add_option (packet, NM_DHCP_OPTION_MAX_MESSAGE_SIZE, &max_size, 2);
+		if (priv->hostname) {
+			nm_dhcp_packet_add_option (packet, NM_DHCP_OPTION_HOST_NAME,
+			                           priv->hostname, MIN (strlen (priv->hostname), 255));
+		}
+		nm_dhcp_packet_add_option (packet, NM_DHCP_OPTION_PARAMETER_REQUEST,
+		                           requested_options, sizeof (requested_options));
+	}
+	nm_dhcp_packet_end (packet);
+
+	send_packet (self, packet, ciaddr, daddr, dest_mac);
+	g_byte_array_free (packet, TRUE);
+}
+
+static void start_discover (NMDHCPInternal *self);
+
+static gboolean
+retransmit_cb (gpointer user_data)
+{
+	NMDHCPInternal *self = NM_DHCP_INTERNAL (user_data);
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+	guint interval;
+
+	priv->retransmit_id = 0;
+
+	/* A server that stopped answering requests gets the whole
+	 * process started over.
+	 */
+	if (priv->state == STATE_REQUESTING && priv->attempt >= 4) {
+		start_discover (self);
+		return FALSE;
+	}
+
+	send_message (self, priv->state == STATE_SELECTING ? NM_DHCP_MSG_DISCOVER : NM_DHCP_MSG_REQUEST);
+
+	interval = MIN (RETRANSMIT_FIRST << MIN (priv->attempt, 4), RETRANSMIT_MAX);
+	priv->attempt++;
+	priv->retransmit_id = g_timeout_add (interval * 1000 + g_random_int_range (-1000, 1000),
+	                                     retransmit_cb, self);
+	return FALSE;
+}
+
+static void
+start_transmit (NMDHCPInternal *self, InternalState state)
+{
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+
+	nm_log_dbg (LOGD_DHCP4, "(%s): internal DHCP client %s -> %s",
+	            nm_dhcp_client_get_iface (NM_DHCP_CLIENT (self)),
+	            state_to_string (priv->state), state_to_string (state));
+
+	priv->state = state;
+	priv->attempt = 0;
+	if (priv->retransmit_id)
+		g_source_remove (priv->retransmit_id);
+	priv->retransmit_id = 0;
+	retransmit_cb (self);
+}
+
+static void
+start_discover (NMDHCPInternal *self)
+{
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+
+	priv->xid = g_random_int ();
+	priv->offered = 0;
+	priv->server_id = 0;
+	start_transmit (self, STATE_SELECTING);
+}
+
+static void
+drop_lease (NMDHCPInternal *self)
+{
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+
+	if (priv->lease_timer_id) {
+		g_source_remove (priv->lease_timer_id);
+		priv->lease_timer_id = 0;
+	}
+	nm_dhcp_lease_free (priv->lease);
+	priv->lease = NULL;
+}
+
+static void
+report (NMDHCPInternal *self, const char *reason)
+{
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+	GHashTable *options;
+
+	if (priv->lease)
+		options = nm_dhcp_lease_to_options (priv->lease);
+	else
+		options = g_hash_table_new (g_str_hash, g_str_equal);
+
+	nm_dhcp_client_new_options (NM_DHCP_CLIENT (self), options, reason);
+	g_hash_table_destroy (options);
+}
+
+static gboolean lease_timer_cb (gpointer user_data);
+
+static void
+schedule_lease_timer (NMDHCPInternal *self, guint32 seconds)
+{
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+
+	if (priv->lease_timer_id)
+		g_source_remove (priv->lease_timer_id);
+	priv->lease_timer_id = g_timeout_add_seconds (seconds, lease_timer_cb, self);
+}
+
+/* T1 starts renewing with the server that gave us the lease, T2 asks any
+ * server, and at expiry the address is gone.
+ */
+static gboolean
+lease_timer_cb (gpointer user_data)
+{
+	NMDHCPInternal *self = NM_DHCP_INTERNAL (user_data);
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+	const char *iface = nm_dhcp_client_get_iface (NM_DHCP_CLIENT (self));
+	NMDHCPLease *lease = priv->lease;
+
+	priv->lease_timer_id = 0;
+	g_return_val_if_fail (lease != NULL, FALSE);
+
+	switch (priv->state) {
+	case STATE_BOUND:
+		nm_log_info (LOGD_DHCP4, "(%s): renewing DHCP lease", iface);
+		priv->xid = g_random_int ();
+		start_transmit (self, STATE_RENEWING);
+		schedule_lease_timer (self, lease->t2 - lease->t1);
+		break;
+	case STATE_RENEWING:
+		nm_log_info (LOGD_DHCP4, "(%s): rebinding DHCP lease", iface);
+		priv->xid = g_random_int ();
+		start_transmit (self, STATE_REBINDING);
+		schedule_lease_timer (self, lease->lease_time - lease->t2);
+		break;
+	default:
+		nm_log_warn (LOGD_DHCP4, "(%s): DHCP lease expired", iface);
+		if (priv->retransmit_id) {
+			g_source_remove (priv->retransmit_id);
+			priv->retransmit_id = 0;
+		}
+		drop_lease (self);
+		priv->state = STATE_INIT;
+		report (self, "fail");
+		break;
+	}
+	return FALSE;
+}
+
+static void
+handle_ack (NMDHCPInternal *self, NMDHCPLease *lease, const guint8 *src_mac)
+{
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+	const char *reason;
+
+	if (!lease->address) {
+		nm_log_warn (LOGD_DHCP4, "(%s): ignoring DHCP ACK without an address",
+		             nm_dhcp_client_get_iface (NM_DHCP_CLIENT (self)));
+		nm_dhcp_lease_free (lease);
+		return;
+	}
+
+	if (priv->state == STATE_RENEWING)
+		reason = "renew";
+	else if (priv->state == STATE_REBINDING)
+		reason = "rebind";
+	else
+		reason = "bound";
+
+	if (priv->retransmit_id) {
+		g_source_remove (priv->retransmit_id);
+		priv->retransmit_id = 0;
+	}
+	drop_lease (self);
+
+	/* Fill in the defaults for the renewal timers (RFC 2131 4.4.5) */
+	if (lease->lease_time != G_MAXUINT32) {
+		lease->lease_time = MAX (lease->lease_time, 10);
+		if (!lease->t1 || lease->t1 >= lease->lease_time)
+			lease->t1 = lease->lease_time / 2;
+		if (!lease->t2 || lease->t2 >= lease->lease_time || lease->t2 <= lease->t1)
+			lease->t2 = (guint32) ((guint64) lease->lease_time * 7 / 8);
+		if (lease->t2 <= lease->t1)
+			lease->t2 = lease->t1 + 1;
+	}
+
+	if (lease->server_id)
+		priv->server_id = lease->server_id;
+	memcpy (priv->server_mac, src_mac, ETH_ALEN);
+	priv->lease = lease;
+	priv->state = STATE_BOUND;
+
+	if (lease->lease_time != G_MAXUINT32)
+		schedule_lease_timer (self, lease->t1);
+
+	report (self, reason);
+}
+
+static void
+handle_message (NMDHCPInternal *self,
+                NMDHCPMessageType type,
+                NMDHCPLease *lease,
+                const guint8 *src_mac)
+{
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+	const char *iface = nm_dhcp_client_get_iface (NM_DHCP_CLIENT (self));
+
+	switch (priv->state) {
+	case STATE_SELECTING:
+		if (type != NM_DHCP_MSG_OFFER || !lease->address || !lease->server_id)
+			break;
+		/* Take the first offer */
+		priv->offered = lease->address;
+		priv->server_id = lease->server_id;
+		start_transmit (self, STATE_REQUESTING);
+		break;
+	case STATE_REQUESTING:
+	case STATE_RENEWING:
+	case STATE_REBINDING:
+		if (type == NM_DHCP_MSG_ACK) {
+			if (   priv->state == STATE_REQUESTING
+			    && lease->server_id
+			    && lease->server_id != priv->server_id)
+				break;
+			handle_ack (self, lease, src_mac);
+			return;
+		}
+		if (type == NM_DHCP_MSG_NAK) {
+			nm_log_info (LOGD_DHCP4, "(%s): DHCP server declined the request", iface);
+			if (priv->lease) {
+				drop_lease (self);
+				report (self, "expire");
+			}
+			start_discover (self);
+		}
+		break;
+	default:
+		break;
+	}
+
+	nm_dhcp_lease_free (lease);
+}
+
+static gboolean
+socket_cb (GIOChannel *channel, GIOCondition condition, gpointer user_data)
+{
+	NMDHCPInternal *self = NM_DHCP_INTERNAL (user_data);
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+	struct sockaddr_ll sll;
+	socklen_t sll_len;
+	const guint8 *payload;
+	gsize payload_len;
+	NMDHCPMessageType type;
+	NMDHCPLease *lease;
+	ssize_t len;
+
+	/* Handling a message can get the client stopped and released */
+	g_object_ref (self);
+
+	/* Drain everything that's queued */
+	while (priv->fd >= 0) {
+		sll_len = sizeof (sll);
+		len = recvfrom (priv->fd, priv->recv_buf, RECV_BUF_SIZE, MSG_DONTWAIT,
+		                (struct sockaddr *) &sll, &sll_len);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (sll.sll_halen != ETH_ALEN)
+			continue;
+		if (!nm_dhcp_packet_unwrap_udp (priv->recv_buf, len, NM_DHCP_CLIENT_PORT,
+		                                &payload, &payload_len))
+			continue;
+		if (!nm_dhcp_packet_parse (payload, payload_len, NM_DHCP_OP_REPLY, priv->xid,
+		                           priv->hwaddr->data, priv->hwaddr->len,
+		                           &type, &lease))
+			continue;
+
+		/* Takes the lease */
+		handle_message (self, type, lease, sll.sll_addr);
+	}
+
+	g_object_unref (self);
+	return TRUE;
+}
+
+static void
+close_socket (NMDHCPInternal *self)
+{
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+
+	if (priv->io_id) {
+		g_source_remove (priv->io_id);
+		priv->io_id = 0;
+	}
+	if (priv->fd >= 0) {
+		close (priv->fd);
+		priv->fd = -1;
+	}
+}
+
+/* Only unfragmented UDP to the client port gets past the kernel */
+static const struct sock_filter dhcp_filter[] = {
+	BPF_STMT (BPF_LD | BPF_B | BPF_ABS, 9),                        /* IP protocol */
+	BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 6),
+	BPF_STMT (BPF_LD | BPF_H | BPF_ABS, 6),                        /* flags, fragment offset */
+	BPF_JUMP (BPF_JMP | BPF_JSET | BPF_K, 0x3FFF, 4, 0),
+	BPF_STMT (BPF_LDX | BPF_B | BPF_MSH, 0),                       /* IP header length */
+	BPF_STMT (BPF_LD | BPF_H | BPF_IND, 2),                        /* UDP destination port */
+	BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, NM_DHCP_CLIENT_PORT, 0, 1),
+	BPF_STMT (BPF_RET | BPF_K, 0xFFFFFFFF),
+	BPF_STMT (BPF_RET | BPF_K, 0),
+};
+
+static gboolean
+open_socket (NMDHCPInternal *self)
+{
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+	const char *iface = nm_dhcp_client_get_iface (NM_DHCP_CLIENT (self));
+	struct sock_fprog prog;
+	struct sockaddr_ll sll;
+	GIOChannel *channel;
+
+	priv->ifindex = if_nametoindex (iface);
+	if (!priv->ifindex) {
+		nm_log_warn (LOGD_DHCP4, "(%s): could not find interface index", iface);
+		return FALSE;
+	}
+
+	priv->fd = socket (AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, htons (ETH_P_IP));
+	if (priv->fd < 0) {
+		nm_log_warn (LOGD_DHCP4, "(%s): could not create DHCP socket: %s",
+		             iface, strerror (errno));
+		return FALSE;
+	}
+
+	prog.len = G_N_ELEMENTS (dhcp_filter);
+	prog.filter = (struct sock_filter *) dhcp_filter;
+	if (setsockopt (priv->fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof (prog)) < 0) {
+		nm_log_warn (LOGD_DHCP4, "(%s): could not attach DHCP socket filter: %s",
+		             iface, strerror (errno));
+		goto error;
+	}
+
+	memset (&sll, 0, sizeof (sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons (ETH_P_IP);
+	sll.sll_ifindex = priv->ifindex;
+	if (bind (priv->fd, (struct sockaddr *) &sll, sizeof (sll)) < 0) {
+		nm_log_warn (LOGD_DHCP4, "(%s): could not bind DHCP socket: %s",
+		             iface, strerror (errno));
+		goto error;
+	}
+
+	channel = g_io_channel_unix_new (priv->fd);
+	priv->io_id = g_io_add_watch (channel, G_IO_IN, socket_cb, self);
+	g_io_channel_unref (channel);
+	return TRUE;
+
+error:
+	close_socket (self);
+	return FALSE;
+}
+
+/*****************************************************************/
+
+static GPid
+ip4_start (NMDHCPClient *client,
+           NMSettingIP4Config *s_ip4,
+           guint8 *dhcp_anycast_addr,
+           const char *hostname)
+{
+	NMDHCPInternal *self = NM_DHCP_INTERNAL (client);
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+	const char *iface = nm_dhcp_client_get_iface (client);
+
+	g_object_get (client, NM_DHCP_CLIENT_HWADDR, &priv->hwaddr, NULL);
+	if (!priv->hwaddr || priv->hwaddr->len != ETH_ALEN) {
+		nm_log_warn (LOGD_DHCP4, "(%s): the internal DHCP client only supports Ethernet hardware addresses", iface);
+		return 0;
+	}
+
+	if (!open_socket (self))
+		return 0;
+
+	priv->client_id = make_client_id (s_ip4, priv->hwaddr);
+	if (hostname) {
+		char *dot;
+
+		/* Like dhclient, send only the host part */
+		priv->hostname = g_strdup (hostname);
+		dot = strchr (priv->hostname, '.');
+		if (dot)
+			*dot = '\0';
+	}
+
+	nm_log_info (LOGD_DHCP4, "(%s): starting internal DHCP client", iface);
+	start_discover (self);
+
+	/* Started; in-process clients have no PID to return */
+	return 1;
+}
+
+static GPid
+ip6_start (NMDHCPClient *client,
+           NMSettingIP6Config *s_ip6,
+           guint8 *dhcp_anycast_addr,
+           const char *hostname,
+           gboolean info_only,
+           const GByteArray *duid)
+{
+	nm_log_warn (LOGD_DHCP6, "(%s): the internal DHCP client does not support DHCPv6",
+	             nm_dhcp_client_get_iface (client));
+	return 0;
+}
+
+static void
+cleanup (NMDHCPInternal *self)
+{
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+
+	if (priv->retransmit_id) {
+		g_source_remove (priv->retransmit_id);
+		priv->retransmit_id = 0;
+	}
+	drop_lease (self);
+	close_socket (self);
+	priv->state = STATE_INIT;
+}
+
+static void
+stop (NMDHCPClient *client, gboolean release, const GByteArray *duid)
+{
+	NMDHCPInternal *self = NM_DHCP_INTERNAL (client);
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+
+	/* Not chaining up: there's no process to kill */
+	if (release && priv->lease && priv->fd >= 0 && priv->server_id) {
+		nm_log_info (LOGD_DHCP4, "(%s): releasing DHCP lease", nm_dhcp_client_get_iface (client));
+		send_message (self, NM_DHCP_MSG_RELEASE);
+	}
+	cleanup (self);
+}
+
+static NMIP4Config *
+ip4_get_config (NMDHCPClient *client)
+{
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (client);
+
+	if (!priv->lease)
+		return NULL;
+	return nm_dhcp_lease_to_ip4_config (priv->lease, nm_dhcp_client_get_iface (client));
+}
+
+/***************************************************/
+
+static void
+nm_dhcp_internal_init (NMDHCPInternal *self)
+{
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+
+	priv->fd = -1;
+	priv->recv_buf = g_malloc (RECV_BUF_SIZE);
+}
+
+static void
+dispose (GObject *object)
+{
+	NMDHCPInternal *self = NM_DHCP_INTERNAL (object);
+	NMDHCPInternalPrivate *priv = NM_DHCP_INTERNAL_GET_PRIVATE (self);
+
+	cleanup (self);
+
+	if (priv->hwaddr) {
+		g_byte_array_free (priv->hwaddr, TRUE);
+		priv->hwaddr = NULL;
+	}
+	if (priv->client_id) {
+		g_byte_array_free (priv->client_id, TRUE);
+		priv->client_id = NULL;
+	}
+	g_free (priv->hostname);
+	priv->hostname = NULL;
+	g_free (priv->recv_buf);
+	priv->recv_buf = NULL;
+
+	G_OBJECT_CLASS (nm_dhcp_internal_parent_class)->dispose (object);
+}
+
+static void
+nm_dhcp_internal_class_init (NMDHCPInternalClass *internal_class)
+{
+	NMDHCPClientClass *client_class = NM_DHCP_CLIENT_CLASS (internal_class);
+	GObjectClass *object_class = G_OBJECT_CLASS (internal_class);
+
+	g_type_class_add_private (internal_class, sizeof (NMDHCPInternalPrivate));
+
+	/* virtual methods */
+	object_class->dispose = dispose;
+
+	client_class->ip4_start = ip4_start;
+	client_class->ip6_start = ip6_start;
+	client_class->stop = stop;
+	client_class->ip4_get_config = ip4_get_config;
+	client_class->in_process = TRUE;
+}
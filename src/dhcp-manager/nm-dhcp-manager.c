@@ -23,8 +23,9 @@
 #include "config.h"
 #include <glib.h>
 #include <glib/gi18n.h>
-#include <dbus/dbus.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <signal.h>
 #include <string.h>
@@ -37,11 +38,11 @@
 #include "nm-dhcp-manager.h"
 #include "nm-dhcp-dhclient.h"
 #include "nm-dhcp-dhcpcd.h"
+#include "nm-dhcp-internal.h"
+#include "nm-dhcp-event.h"
 #include "nm-marshal.h"
 #include "nm-logging.h"
-#include "nm-dbus-manager.h"
 #include "nm-hostname-provider.h"
-#include "nm-dbus-glib-types.h"
 #include "nm-glib-compat.h"
 
 GQuark
@@ -55,9 +56,6 @@ nm_dhcp_manager_error_quark (void)
     return ret;
 }
 
-#define NM_DHCP_CLIENT_DBUS_SERVICE "org.freedesktop.nm_dhcp_client"
-#define NM_DHCP_CLIENT_DBUS_IFACE   "org.freedesktop.nm_dhcp_client"
-
 #define DHCP_TIMEOUT 45 /* default DHCP timeout, in seconds */
 
 static NMDHCPManager *singleton = NULL;
@@ -68,10 +66,14 @@ typedef struct {
 	GType               client_type;
 	GetLeaseConfigFunc  get_lease_config_func;
 
-	NMDBusManager *     dbus_mgr;
 	GHashTable *        clients;
-	DBusGProxy *        proxy;
+	GHashTable *        clients_by_pid;   /* pid -> client */
+	GHashTable *        clients_by_iface; /* "iface/family" -> client */
 	NMHostnameProvider *hostname_provider;
+
+	int                 event_fd;
+	guint               event_id;
+	char *              event_buf;
 } NMDHCPManagerPrivate;
 
 
@@ -80,59 +82,23 @@ typedef struct {
 G_DEFINE_TYPE (NMDHCPManager, nm_dhcp_manager, G_TYPE_OBJECT)
 
 static char *
-garray_to_string (GArray *array, const char *key)
+iface_key (const char *iface, gboolean ip6)
 {
-	GString *str;
-	int i;
-	unsigned char c;
-	char *converted = NULL;
-
-	g_return_val_if_fail (array != NULL, NULL);
-
-	/* Since the DHCP options come through environment variables, they should
-	 * already be UTF-8 safe, but just make sure.
-	 */
-	str = g_string_sized_new (array->len);
-	for (i = 0; i < array->len; i++) {
-		c = array->data[i];
-
-		/* Convert NULLs to spaces and non-ASCII characters to ? */
-		if (c == '\0')
-			c = ' ';
-		else if (c > 127)
-			c = '?';
-		str = g_string_append_c (str, c);
-	}
-	str = g_string_append_c (str, '\0');
-
-	converted = str->str;
-	if (!g_utf8_validate (converted, -1, NULL))
-		nm_log_warn (LOGD_DHCP, "DHCP option '%s' couldn't be converted to UTF-8", key);
-	g_string_free (str, FALSE);
-	return converted;
+	return g_strdup_printf ("%s/%d", iface, ip6 ? 6 : 4);
 }
 
 static NMDHCPClient *
 get_client_for_pid (NMDHCPManager *manager, GPid pid)
 {
-	NMDHCPManagerPrivate *priv;
-	GHashTableIter iter;
-	gpointer value;
-
-	g_return_val_if_fail (manager != NULL, NULL);
-	g_return_val_if_fail (NM_IS_DHCP_MANAGER (manager), NULL);
-
-	priv = NM_DHCP_MANAGER_GET_PRIVATE (manager);
-
-	g_hash_table_iter_init (&iter, priv->clients);
-	while (g_hash_table_iter_next (&iter, NULL, &value)) {
-		NMDHCPClient *candidate = NM_DHCP_CLIENT (value);
+	NMDHCPManagerPrivate *priv = NM_DHCP_MANAGER_GET_PRIVATE (manager);
+	NMDHCPClient *client;
 
-		if (nm_dhcp_client_get_pid (candidate) == pid)
-			return candidate;
-	}
+	client = g_hash_table_lookup (priv->clients_by_pid, GINT_TO_POINTER (pid));
 
-	return NULL;
+	/* The client may have been restarted or stopped since it was indexed */
+	if (client && nm_dhcp_client_get_pid (client) != pid)
+		client = NULL;
+	return client;
 }
 
 static NMDHCPClient *
@@ -140,105 +106,179 @@ get_client_for_iface (NMDHCPManager *manager,
                       const char *iface,
                       gboolean ip6)
 {
-	NMDHCPManagerPrivate *priv;
-	GHashTableIter iter;
-	gpointer value;
+	NMDHCPManagerPrivate *priv = NM_DHCP_MANAGER_GET_PRIVATE (manager);
+	NMDHCPClient *client;
+	char *key;
 
-	g_return_val_if_fail (manager != NULL, NULL);
-	g_return_val_if_fail (NM_IS_DHCP_MANAGER (manager), NULL);
 	g_return_val_if_fail (iface, NULL);
 
-	priv = NM_DHCP_MANAGER_GET_PRIVATE (manager);
-
-	g_hash_table_iter_init (&iter, priv->clients);
-	while (g_hash_table_iter_next (&iter, NULL, &value)) {
-		NMDHCPClient *candidate = NM_DHCP_CLIENT (value);
-
-		if (   !strcmp (iface, nm_dhcp_client_get_iface (candidate))
-		    && (nm_dhcp_client_get_ipv6 (candidate) == ip6))
-			return candidate;
-	}
-
-	return NULL;
-}
-
-static char *
-get_option (GHashTable *hash, const char *key)
-{
-	GValue *value;
-
-	value = g_hash_table_lookup (hash, key);
-	if (value == NULL)
-		return NULL;
-
-	if (G_VALUE_TYPE (value) != DBUS_TYPE_G_UCHAR_ARRAY) {
-		nm_log_warn (LOGD_DHCP, "unexpected key %s value type was not "
-		             "DBUS_TYPE_G_UCHAR_ARRAY",
-		             (char *) key);
-		return NULL;
-	}
-
-	return garray_to_string ((GArray *) g_value_get_boxed (value), key);
+	key = iface_key (iface, ip6);
+	client = g_hash_table_lookup (priv->clients_by_iface, key);
+	g_free (key);
+	return client;
 }
 
 static void
-nm_dhcp_manager_handle_event (DBusGProxy *proxy,
-                              GHashTable *options,
-                              gpointer user_data)
+handle_event (NMDHCPManager *manager, GHashTable *options)
 {
-	NMDHCPManager *manager;
-	NMDHCPManagerPrivate *priv;
 	NMDHCPClient *client;
-	char *iface = NULL;
-	char *pid_str = NULL;
-	char *reason = NULL;
+	const char *iface, *pid_str, *reason;
 	unsigned long temp;
 
-	manager = NM_DHCP_MANAGER (user_data);
-	priv = NM_DHCP_MANAGER_GET_PRIVATE (manager);
-
-	iface = get_option (options, "interface");
+	iface = g_hash_table_lookup (options, "interface");
 	if (iface == NULL) {
 		nm_log_warn (LOGD_DHCP, "DHCP event didn't have associated interface.");
-		goto out;
+		return;
 	}
 
-	pid_str = get_option (options, "pid");
+	pid_str = g_hash_table_lookup (options, "pid");
 	if (pid_str == NULL) {
 		nm_log_warn (LOGD_DHCP, "DHCP event didn't have associated PID.");
-		goto out;
+		return;
 	}
 
+	errno = 0;
 	temp = strtoul (pid_str, NULL, 10);
 	if ((temp == ULONG_MAX) && (errno == ERANGE)) {
 		nm_log_warn (LOGD_DHCP, "couldn't convert PID");
-		goto out;
+		return;
 	}
 
 	client = get_client_for_pid (manager, (GPid) temp);
 	if (client == NULL) {
 		nm_log_warn (LOGD_DHCP, "(pid %ld) unhandled DHCP event for interface %s", temp, iface);
-		goto out;
+		return;
 	}
 
 	if (strcmp (iface, nm_dhcp_client_get_iface (client))) {
 		nm_log_warn (LOGD_DHCP, "(pid %ld) received DHCP event from unexpected interface '%s' (expected '%s')",
 		             temp, iface, nm_dhcp_client_get_iface (client));
-		goto out;
+		return;
 	}
 
-	reason = get_option (options, "reason");
+	reason = g_hash_table_lookup (options, "reason");
 	if (reason == NULL) {
 		nm_log_warn (LOGD_DHCP, "(pid %ld) DHCP event didn't have a reason", temp);
-		goto out;
+		return;
 	}
 
 	nm_dhcp_client_new_options (client, options, reason);
+}
 
-out:
-	g_free (iface);
-	g_free (pid_str);
-	g_free (reason);
+static gboolean
+event_sender_is_root (struct msghdr *msg)
+{
+	struct cmsghdr *cmsg;
+	struct ucred *cred;
+
+	for (cmsg = CMSG_FIRSTHDR (msg); cmsg; cmsg = CMSG_NXTHDR (msg, cmsg)) {
+		if (   cmsg->cmsg_level == SOL_SOCKET
+		    && cmsg->cmsg_type == SCM_CREDENTIALS) {
+			cred = (struct ucred *) CMSG_DATA (cmsg);
+			return cred->uid == 0;
+		}
+	}
+	return FALSE;
+}
+
+static gboolean
+event_socket_cb (GIOChannel *channel, GIOCondition condition, gpointer user_data)
+{
+	NMDHCPManager *manager = NM_DHCP_MANAGER (user_data);
+	NMDHCPManagerPrivate *priv = NM_DHCP_MANAGER_GET_PRIVATE (manager);
+	char control[CMSG_SPACE (sizeof (struct ucred))];
+	struct iovec iov;
+	struct msghdr msg;
+	GHashTable *options;
+	GError *error = NULL;
+	ssize_t len;
+
+	/* Drain the socket; a renewal storm leaves many events queued */
+	while (TRUE) {
+		iov.iov_base = priv->event_buf;
+		iov.iov_len = NM_DHCP_EVENT_MAX_SIZE;
+		memset (&msg, 0, sizeof (msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof (control);
+
+		len = recvmsg (priv->event_fd, &msg, MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				nm_log_warn (LOGD_DHCP, "error reading DHCP event: %s", strerror (errno));
+			break;
+		}
+
+		if (!event_sender_is_root (&msg)) {
+			nm_log_warn (LOGD_DHCP, "ignoring DHCP event from unprivileged sender");
+			continue;
+		}
+		if (msg.msg_flags & MSG_TRUNC) {
+			nm_log_warn (LOGD_DHCP, "ignoring oversized DHCP event");
+			continue;
+		}
+
+		options = nm_dhcp_event_parse (priv->event_buf, len, &error);
+		if (!options) {
+			nm_log_warn (LOGD_DHCP, "invalid DHCP event: %s", error->message);
+			g_clear_error (&error);
+			continue;
+		}
+
+		handle_event (manager, options);
+		g_hash_table_destroy (options);
+	}
+
+	return TRUE;
+}
+
+static gboolean
+event_socket_setup (NMDHCPManager *self)
+{
+	NMDHCPManagerPrivate *priv = NM_DHCP_MANAGER_GET_PRIVATE (self);
+	struct sockaddr_un addr;
+	GIOChannel *channel;
+	int one = 1;
+
+	priv->event_fd = socket (AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (priv->event_fd < 0) {
+		nm_log_err (LOGD_DHCP, "could not create DHCP event socket: %s", strerror (errno));
+		return FALSE;
+	}
+
+	/* Have the kernel attach the sender's credentials to every event */
+	if (setsockopt (priv->event_fd, SOL_SOCKET, SO_PASSCRED, &one, sizeof (one)) < 0) {
+		nm_log_err (LOGD_DHCP, "could not set up DHCP event socket: %s", strerror (errno));
+		goto error;
+	}
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	g_strlcpy (addr.sun_path, NM_DHCP_EVENT_SOCKET, sizeof (addr.sun_path));
+
+	g_mkdir_with_parents (NMRUNDIR, 0755);
+	unlink (NM_DHCP_EVENT_SOCKET);
+	if (bind (priv->event_fd, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+		nm_log_err (LOGD_DHCP, "could not bind DHCP event socket '%s': %s",
+		            NM_DHCP_EVENT_SOCKET, strerror (errno));
+		goto error;
+	}
+	chmod (NM_DHCP_EVENT_SOCKET, 0600);
+
+	priv->event_buf = g_malloc (NM_DHCP_EVENT_MAX_SIZE);
+
+	channel = g_io_channel_unix_new (priv->event_fd);
+	priv->event_id = g_io_add_watch (channel, G_IO_IN, event_socket_cb, self);
+	g_io_channel_unref (channel);
+	return TRUE;
+
+error:
+	close (priv->event_fd);
+	priv->event_fd = -1;
+	return FALSE;
 }
 
 static GType
@@ -288,6 +328,10 @@ get_client_type (const char *client, GError **error)
 		return NM_TYPE_DHCP_DHCPCD;
 	}
 
+	/* Never the default; it has to be asked for */
+	if (!strcmp (client, "internal"))
+		return NM_TYPE_DHCP_INTERNAL;
+
 	g_set_error (error,
 	             NM_DHCP_MANAGER_ERROR, NM_DHCP_MANAGER_ERROR_BAD_CLIENT,
 	             _("unsupported DHCP client '%s'"), client);
@@ -298,7 +342,6 @@ NMDHCPManager *
 nm_dhcp_manager_new (const char *client, GError **error)
 {
 	NMDHCPManagerPrivate *priv;
-	DBusGConnection *g_connection;
 
 	g_warn_if_fail (singleton == NULL);
 
@@ -311,6 +354,8 @@ nm_dhcp_manager_new (const char *client, GError **error)
 		priv->get_lease_config_func = nm_dhcp_dhclient_get_lease_config;
 	else if (priv->client_type == NM_TYPE_DHCP_DHCPCD)
 		priv->get_lease_config_func = nm_dhcp_dhcpcd_get_lease_config;
+	else if (priv->client_type == NM_TYPE_DHCP_INTERNAL)
+		priv->get_lease_config_func = nm_dhcp_internal_get_lease_config;
 	else {
 		nm_log_warn (LOGD_DHCP, "No usable DHCP client found! DHCP configurations will fail.");
 	}
@@ -319,30 +364,39 @@ nm_dhcp_manager_new (const char *client, GError **error)
 	                                       NULL,
 	                                       (GDestroyNotify) g_object_unref);
 	g_assert (priv->clients);
+	priv->clients_by_pid = g_hash_table_new (g_direct_hash, g_direct_equal);
+	priv->clients_by_iface = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
-	priv->dbus_mgr = nm_dbus_manager_get ();
-	g_connection = nm_dbus_manager_get_connection (priv->dbus_mgr);
-	priv->proxy = dbus_g_proxy_new_for_name (g_connection,
-	                                         NM_DHCP_CLIENT_DBUS_SERVICE,
-	                                         "/",
-	                                         NM_DHCP_CLIENT_DBUS_IFACE);
-	g_assert (priv->proxy);
-
-	dbus_g_proxy_add_signal (priv->proxy,
-	                         "Event",
-	                         DBUS_TYPE_G_MAP_OF_VARIANT,
-	                         G_TYPE_INVALID);
-
-	dbus_g_proxy_connect_signal (priv->proxy, "Event",
-	                             G_CALLBACK (nm_dhcp_manager_handle_event),
-	                             singleton,
-	                             NULL);
+	/* Lease events from the DHCP clients' action scripts; the internal
+	 * client has none, and leaves the socket to whoever else has it.
+	 */
+	if (   priv->client_type != NM_TYPE_DHCP_INTERNAL
+	    && !event_socket_setup (singleton))
+		nm_log_warn (LOGD_DHCP, "DHCP events can't be received; DHCP configurations will fail.");
 
 	return singleton;
 }
 
 #define REMOVE_ID_TAG "remove-id"
 #define TIMEOUT_ID_TAG "timeout-id"
+#define PID_TAG "pid"
+
+static void
+unindex_client (NMDHCPManager *self, NMDHCPClient *client)
+{
+	NMDHCPManagerPrivate *priv = NM_DHCP_MANAGER_GET_PRIVATE (self);
+	gpointer pid;
+	char *key;
+
+	pid = g_object_get_data (G_OBJECT (client), PID_TAG);
+	if (pid && g_hash_table_lookup (priv->clients_by_pid, pid) == client)
+		g_hash_table_remove (priv->clients_by_pid, pid);
+
+	key = iface_key (nm_dhcp_client_get_iface (client), nm_dhcp_client_get_ipv6 (client));
+	if (g_hash_table_lookup (priv->clients_by_iface, key) == client)
+		g_hash_table_remove (priv->clients_by_iface, key);
+	g_free (key);
+}
 
 static void
 remove_client (NMDHCPManager *self, NMDHCPClient *client)
@@ -363,6 +417,7 @@ remove_client (NMDHCPManager *self, NMDHCPClient *client)
 	 * the DHCP client.
 	 */
 
+	unindex_client (self, client);
 	g_hash_table_remove (priv->clients, client);
 }
 
@@ -379,6 +434,25 @@ add_client (NMDHCPManager *self, NMDHCPClient *client)
 	g_object_set_data (G_OBJECT (client), TIMEOUT_ID_TAG, GUINT_TO_POINTER (id));
 
 	g_hash_table_insert (priv->clients, client, g_object_ref (client));
+	g_hash_table_insert (priv->clients_by_iface,
+	                     iface_key (nm_dhcp_client_get_iface (client), nm_dhcp_client_get_ipv6 (client)),
+	                     client);
+}
+
+/* The PID is only known once the client has been started */
+static void
+index_client_pid (NMDHCPManager *self, NMDHCPClient *client)
+{
+	NMDHCPManagerPrivate *priv = NM_DHCP_MANAGER_GET_PRIVATE (self);
+	gpointer pid;
+
+	/* In-process clients don't send events */
+	if (NM_DHCP_CLIENT_GET_CLASS (client)->in_process)
+		return;
+
+	pid = GINT_TO_POINTER (nm_dhcp_client_get_pid (client));
+	g_object_set_data (G_OBJECT (client), PID_TAG, pid);
+	g_hash_table_insert (priv->clients_by_pid, pid, client);
 }
 
 static NMDHCPClient *
@@ -435,7 +509,8 @@ client_start (NMDHCPManager *self,
 		remove_client (self, client);
 		g_object_unref (client);
 		client = NULL;
-	}
+	} else
+		index_client_pid (self, client);
 
 	return client;
 }
@@ -602,6 +677,7 @@ nm_dhcp_manager_get (void)
 static void
 nm_dhcp_manager_init (NMDHCPManager *manager)
 {
+	NM_DHCP_MANAGER_GET_PRIVATE (manager)->event_fd = -1;
 }
 
 static void
@@ -632,10 +708,18 @@ finalize (GObject *object)
 
 	if (priv->clients)
 		g_hash_table_destroy (priv->clients);
-	if (priv->proxy)
-		g_object_unref (priv->proxy);
-	if (priv->dbus_mgr)
-		g_object_unref (priv->dbus_mgr);
+	if (priv->clients_by_pid)
+		g_hash_table_destroy (priv->clients_by_pid);
+	if (priv->clients_by_iface)
+		g_hash_table_destroy (priv->clients_by_iface);
+
+	if (priv->event_id)
+		g_source_remove (priv->event_id);
+	if (priv->event_fd >= 0) {
+		close (priv->event_fd);
+		unlink (NM_DHCP_EVENT_SOCKET);
+	}
+	g_free (priv->event_buf);
 
 	G_OBJECT_CLASS (nm_dhcp_manager_parent_class)->finalize (object);
 }
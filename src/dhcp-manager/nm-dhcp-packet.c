@@ -0,0 +1,834 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include "nm-dhcp-packet.h"
+#include "nm-utils.h"
+#include "nm-logging.h"
+
+#define DHCP_MAGIC 0x63825363
+#define DHCP_MIN_PACKET_SIZE 300  /* BOOTP minimum, RFC 1542 */
+
+struct dhcp_header {
+	guint8  op;
+	guint8  htype;
+	guint8  hlen;
+	guint8  hops;
+	guint32 xid;
+	guint16 secs;
+	guint16 flags;
+	guint32 ciaddr;
+	guint32 yiaddr;
+	guint32 siaddr;
+	guint32 giaddr;
+	guint8  chaddr[16];
+	guint8  sname[64];
+	guint8  file[128];
+	guint32 magic;
+} __attribute__ ((packed));
+
+/**
+ * nm_dhcp_packet_new:
+ * @op: %NM_DHCP_OP_REQUEST or %NM_DHCP_OP_REPLY
+ * @type: the DHCP message type
+ * @xid: transaction ID
+ * @chaddr: client hardware address
+ * @chaddr_len: length of @chaddr, at most 16
+ * @ciaddr: client address, in network byte order
+ * @yiaddr: 'your' address, in network byte order
+ *
+ * Starts a DHCP message; options are added with nm_dhcp_packet_add_option()
+ * and the message is completed with nm_dhcp_packet_end().
+ *
+ * Returns: the message
+ **/
+GByteArray *
+nm_dhcp_packet_new (guint8 op,
+                    NMDHCPMessageType type,
+                    guint32 xid,
+                    const guint8 *chaddr,
+                    guint chaddr_len,
+                    guint32 ciaddr,
+                    guint32 yiaddr)
+{
+	GByteArray *packet;
+	struct dhcp_header hdr;
+	guint8 msg_type = type;
+
+	g_return_val_if_fail (chaddr != NULL, NULL);
+	g_return_val_if_fail (chaddr_len <= sizeof (hdr.chaddr), NULL);
+
+	memset (&hdr, 0, sizeof (hdr));
+	hdr.op = op;
+	hdr.htype = 1;  /* ARPHRD_ETHER */
+	hdr.hlen = chaddr_len;
+	hdr.xid = g_htonl (xid);
+	hdr.ciaddr = ciaddr;
+	hdr.yiaddr = yiaddr;
+	memcpy (hdr.chaddr, chaddr, chaddr_len);
+	hdr.magic = g_htonl (DHCP_MAGIC);
+
+	packet = g_byte_array_sized_new (DHCP_MIN_PACKET_SIZE);
+	g_byte_array_append (packet, (const guint8 *) &hdr, sizeof (hdr));
+	nm_dhcp_packet_add_option (packet, NM_DHCP_OPTION_MESSAGE_TYPE, &msg_type, 1);
+	return packet;
+}
+
+void
+nm_dhcp_packet_add_option (GByteArray *packet, guint8 code, const void *data, guint8 len)
+{
+	g_return_if_fail (packet != NULL);
+	g_return_if_fail (data != NULL || len == 0);
+
+	g_byte_array_append (packet, &code, 1);
+	g_byte_array_append (packet, &len, 1);
+	if (len)
+		g_byte_array_append (packet, data, len);
+}
+
+/* @value is in host byte order */
+void
+nm_dhcp_packet_add_option_u32 (GByteArray *packet, guint8 code, guint32 value)
+{
+	value = g_htonl (value);
+	nm_dhcp_packet_add_option (packet, code, &value, sizeof (value));
+}
+
+void
+nm_dhcp_packet_end (GByteArray *packet)
+{
+	static const guint8 zeros[DHCP_MIN_PACKET_SIZE] = { 0 };
+	guint8 end = NM_DHCP_OPTION_END;
+
+	g_return_if_fail (packet != NULL);
+
+	g_byte_array_append (packet, &end, 1);
+	if (packet->len < DHCP_MIN_PACKET_SIZE)
+		g_byte_array_append (packet, zeros, DHCP_MIN_PACKET_SIZE - packet->len);
+}
+
+/*****************************************************************/
+
+static gboolean
+option_get_u32 (GByteArray *opt, guint32 *out)
+{
+	if (!opt || opt->len != 4)
+		return FALSE;
+	memcpy (out, opt->data, 4);
+	return TRUE;
+}
+
+static GArray *
+option_get_addresses (GByteArray *opt)
+{
+	GArray *array;
+	guint32 addr;
+	guint i;
+
+	array = g_array_new (FALSE, FALSE, sizeof (guint32));
+	if (opt && (opt->len % 4) == 0) {
+		for (i = 0; i < opt->len; i += 4) {
+			memcpy (&addr, opt->data + i, 4);
+			g_array_append_val (array, addr);
+		}
+	}
+	return array;
+}
+
+/* Option strings aren't NUL-terminated and have no defined encoding */
+static char *
+sanitize_string (const guint8 *data, gsize len)
+{
+	char *str;
+	gsize i;
+
+	/* Some servers include the terminating NUL */
+	while (len && data[len - 1] == '\0')
+		len--;
+	if (!len)
+		return NULL;
+
+	str = g_malloc (len + 1);
+	for (i = 0; i < len; i++)
+		str[i] = g_ascii_isprint (data[i]) ? data[i] : '?';
+	str[len] = '\0';
+	return str;
+}
+
+static char *
+option_get_string (GByteArray *opt)
+{
+	return opt ? sanitize_string (opt->data, opt->len) : NULL;
+}
+
+/* RFC 3442: each route is the prefix length, the significant octets of
+ * the destination, and the router.
+ */
+static gboolean
+parse_classless_routes (GByteArray *opt, GArray *routes)
+{
+	NMDHCPRoute route;
+	guint pos = 0, octets;
+
+	while (pos < opt->len) {
+		memset (&route, 0, sizeof (route));
+		route.prefix = opt->data[pos++];
+		if (route.prefix > 32)
+			return FALSE;
+
+		octets = (route.prefix + 7) / 8;
+		if (pos + octets + 4 > opt->len)
+			return FALSE;
+		memcpy (&route.dest, opt->data + pos, octets);
+		pos += octets;
+		memcpy (&route.gateway, opt->data + pos, 4);
+		pos += 4;
+
+		g_array_append_val (routes, route);
+	}
+	return routes->len > 0;
+}
+
+/* RFC 3397: a list of DNS-encoded names that may use compression pointers
+ * into the (concatenated) option data.
+ */
+static char **
+parse_domain_search (GByteArray *opt)
+{
+	GPtrArray *domains;
+	GString *name;
+	gsize pos = 0, p, next;
+	guint hops;
+	guint8 c;
+
+	domains = g_ptr_array_new_with_free_func (g_free);
+	while (pos < opt->len) {
+		name = g_string_new (NULL);
+		p = pos;
+		next = 0;
+		hops = 0;
+
+		while (TRUE) {
+			if (p >= opt->len)
+				goto error;
+			c = opt->data[p];
+			if (c == 0) {
+				p++;
+				break;
+			}
+			if ((c & 0xC0) == 0xC0) {
+				/* Compression pointer; only follow a bounded number of them */
+				if (p + 1 >= opt->len || ++hops > 16)
+					goto error;
+				if (!next)
+					next = p + 2;
+				p = ((c & 0x3F) << 8) | opt->data[p + 1];
+				continue;
+			}
+			if ((c & 0xC0) || p + 1 + c > opt->len)
+				goto error;
+
+			if (name->len)
+				g_string_append_c (name, '.');
+			g_string_append_len (name, (const char *) opt->data + p + 1, c);
+			p += 1 + c;
+		}
+		pos = next ? next : p;
+
+		if (name->len) {
+			g_ptr_array_add (domains, sanitize_string ((const guint8 *) name->str, name->len));
+			g_string_free (name, TRUE);
+		} else
+			g_string_free (name, TRUE);
+	}
+
+	if (!domains->len) {
+		g_ptr_array_free (domains, TRUE);
+		return NULL;
+	}
+	g_ptr_array_add (domains, NULL);
+	return (char **) g_ptr_array_free (domains, FALSE);
+
+error:
+	g_string_free (name, TRUE);
+	g_ptr_array_free (domains, TRUE);
+	return NULL;
+}
+
+static NMDHCPLease *
+lease_from_options (const struct dhcp_header *hdr, GByteArray **opts)
+{
+	NMDHCPLease *lease;
+	GByteArray *classless;
+	guint32 tmp;
+	guint i;
+
+	lease = g_slice_new0 (NMDHCPLease);
+	lease->address = hdr->yiaddr;
+
+	option_get_u32 (opts[NM_DHCP_OPTION_SUBNET_MASK], &lease->netmask);
+	option_get_u32 (opts[NM_DHCP_OPTION_SERVER_ID], &lease->server_id);
+
+	lease->lease_time = G_MAXUINT32;
+	if (option_get_u32 (opts[NM_DHCP_OPTION_LEASE_TIME], &tmp))
+		lease->lease_time = g_ntohl (tmp);
+	if (option_get_u32 (opts[NM_DHCP_OPTION_RENEWAL_TIME], &tmp))
+		lease->t1 = g_ntohl (tmp);
+	if (option_get_u32 (opts[NM_DHCP_OPTION_REBINDING_TIME], &tmp))
+		lease->t2 = g_ntohl (tmp);
+
+	if (opts[NM_DHCP_OPTION_INTERFACE_MTU] && opts[NM_DHCP_OPTION_INTERFACE_MTU]->len == 2)
+		lease->mtu = (opts[NM_DHCP_OPTION_INTERFACE_MTU]->data[0] << 8) | opts[NM_DHCP_OPTION_INTERFACE_MTU]->data[1];
+
+	lease->routers = option_get_addresses (opts[NM_DHCP_OPTION_ROUTER]);
+	lease->dns_servers = option_get_addresses (opts[NM_DHCP_OPTION_DNS_SERVER]);
+	lease->nis_servers = option_get_addresses (opts[NM_DHCP_OPTION_NIS_SERVERS]);
+	lease->wins_servers = option_get_addresses (opts[NM_DHCP_OPTION_NETBIOS_NS]);
+
+	lease->host_name = option_get_string (opts[NM_DHCP_OPTION_HOST_NAME]);
+	lease->domain_name = option_get_string (opts[NM_DHCP_OPTION_DOMAIN_NAME]);
+	lease->nis_domain = option_get_string (opts[NM_DHCP_OPTION_NIS_DOMAIN]);
+	if (opts[NM_DHCP_OPTION_DOMAIN_SEARCH])
+		lease->domain_search = parse_domain_search (opts[NM_DHCP_OPTION_DOMAIN_SEARCH]);
+
+	/* If the server sends classless static routes, the classful
+	 * 'static routes' option MUST be ignored (RFC 3442).
+	 */
+	lease->routes = g_array_new (FALSE, FALSE, sizeof (NMDHCPRoute));
+	classless = opts[NM_DHCP_OPTION_CLASSLESS_ROUTE];
+	if (!classless)
+		classless = opts[NM_DHCP_OPTION_MS_CLASSLESS_ROUTE];
+	if (classless) {
+		lease->classless = parse_classless_routes (classless, lease->routes);
+		if (!lease->classless) {
+			nm_log_warn (LOGD_DHCP4, "ignoring invalid classless static routes");
+			g_array_set_size (lease->routes, 0);
+		}
+	}
+
+	if (!lease->classless && opts[NM_DHCP_OPTION_STATIC_ROUTE]) {
+		GByteArray *opt = opts[NM_DHCP_OPTION_STATIC_ROUTE];
+
+		for (i = 0; opt->len % 8 == 0 && i < opt->len; i += 8) {
+			NMDHCPRoute route;
+
+			memcpy (&route.dest, opt->data + i, 4);
+			memcpy (&route.gateway, opt->data + i + 4, 4);
+			route.prefix = 32;
+			g_array_append_val (lease->routes, route);
+		}
+	}
+
+	return lease;
+}
+
+/**
+ * nm_dhcp_packet_parse:
+ * @data: the DHCP message
+ * @len: length of @data
+ * @op: expected BOOTP operation
+ * @xid: expected transaction ID
+ * @chaddr: expected client hardware address, or %NULL to accept any
+ * @chaddr_len: length of @chaddr
+ * @out_type: on return, the DHCP message type
+ * @out_lease: on return, for OFFER and ACK messages, the offered lease
+ *
+ * Validates and decodes a DHCP message.  Options that are split into
+ * several parts (RFC 3396) are concatenated.
+ *
+ * Returns: %FALSE if @data isn't a well-formed DHCP message matching @op,
+ * @xid and @chaddr
+ **/
+gboolean
+nm_dhcp_packet_parse (const guint8 *data,
+                      gsize len,
+                      guint8 op,
+                      guint32 xid,
+                      const guint8 *chaddr,
+                      guint chaddr_len,
+                      NMDHCPMessageType *out_type,
+                      NMDHCPLease **out_lease)
+{
+	const struct dhcp_header *hdr = (const struct dhcp_header *) data;
+	GByteArray *opts[256] = { NULL };
+	const guint8 *p, *end;
+	guint8 code, optlen;
+	gboolean success = FALSE;
+	guint i;
+
+	g_return_val_if_fail (data != NULL, FALSE);
+
+	if (len < sizeof (*hdr))
+		return FALSE;
+	if (   hdr->op != op
+	    || hdr->xid != g_htonl (xid)
+	    || hdr->magic != g_htonl (DHCP_MAGIC))
+		return FALSE;
+	if (chaddr && (hdr->hlen != chaddr_len || memcmp (hdr->chaddr, chaddr, chaddr_len)))
+		return FALSE;
+
+	p = data + sizeof (*hdr);
+	end = data + len;
+	while (p < end) {
+		code = *p++;
+		if (code == NM_DHCP_OPTION_PAD)
+			continue;
+		if (code == NM_DHCP_OPTION_END)
+			break;
+
+		if (p >= end)
+			goto out;
+		optlen = *p++;
+		if (p + optlen > end)
+			goto out;
+
+		if (!opts[code])
+			opts[code] = g_byte_array_sized_new (optlen);
+		g_byte_array_append (opts[code], p, optlen);
+		p += optlen;
+	}
+
+	if (!opts[NM_DHCP_OPTION_MESSAGE_TYPE] || opts[NM_DHCP_OPTION_MESSAGE_TYPE]->len != 1)
+		goto out;
+
+	*out_type = opts[NM_DHCP_OPTION_MESSAGE_TYPE]->data[0];
+	if (out_lease) {
+		*out_lease = NULL;
+		if (*out_type == NM_DHCP_MSG_OFFER || *out_type == NM_DHCP_MSG_ACK)
+			*out_lease = lease_from_options (hdr, opts);
+	}
+	success = TRUE;
+
+out:
+	for (i = 0; i < G_N_ELEMENTS (opts); i++) {
+		if (opts[i])
+			g_byte_array_free (opts[i], TRUE);
+	}
+	return success;
+}
+
+/*****************************************************************/
+
+static guint32
+checksum_add (guint32 sum, const void *data, gsize len)
+{
+	const guint8 *p = data;
+
+	while (len > 1) {
+		sum += (p[0] << 8) | p[1];
+		p += 2;
+		len -= 2;
+	}
+	if (len)
+		sum += p[0] << 8;
+	return sum;
+}
+
+static guint16
+checksum_finish (guint32 sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	return g_htons (~sum & 0xFFFF);
+}
+
+static guint32
+udp_pseudo_header_sum (guint32 saddr, guint32 daddr, guint16 udp_len)
+{
+	struct {
+		guint32 saddr;
+		guint32 daddr;
+		guint8  zero;
+		guint8  protocol;
+		guint16 len;
+	} __attribute__ ((packed)) pseudo;
+
+	pseudo.saddr = saddr;
+	pseudo.daddr = daddr;
+	pseudo.zero = 0;
+	pseudo.protocol = IPPROTO_UDP;
+	pseudo.len = g_htons (udp_len);
+	return checksum_add (0, &pseudo, sizeof (pseudo));
+}
+
+/**
+ * nm_dhcp_packet_wrap_udp:
+ * @payload: the DHCP message
+ * @saddr: source address, in network byte order
+ * @sport: source port
+ * @daddr: destination address, in network byte order
+ * @dport: destination port
+ *
+ * Returns: an IPv4 datagram carrying @payload in UDP, for sending on a
+ * packet socket before the interface has an address
+ **/
+GByteArray *
+nm_dhcp_packet_wrap_udp (const GByteArray *payload,
+                         guint32 saddr,
+                         guint16 sport,
+                         guint32 daddr,
+                         guint16 dport)
+{
+	GByteArray *datagram;
+	struct iphdr ip;
+	struct udphdr udp;
+	guint32 sum;
+
+	g_return_val_if_fail (payload != NULL, NULL);
+
+	memset (&udp, 0, sizeof (udp));
+	udp.source = g_htons (sport);
+	udp.dest = g_htons (dport);
+	udp.len = g_htons (sizeof (udp) + payload->len);
+	sum = udp_pseudo_header_sum (saddr, daddr, sizeof (udp) + payload->len);
+	sum = checksum_add (sum, &udp, sizeof (udp));
+	sum = checksum_add (sum, payload->data, payload->len);
+	udp.check = checksum_finish (sum);
+	if (udp.check == 0)
+		udp.check = 0xFFFF;
+
+	memset (&ip, 0, sizeof (ip));
+	ip.version = 4;
+	ip.ihl = sizeof (ip) / 4;
+	ip.tos = IPTOS_LOWDELAY;
+	ip.tot_len = g_htons (sizeof (ip) + sizeof (udp) + payload->len);
+	ip.ttl = IPDEFTTL;
+	ip.protocol = IPPROTO_UDP;
+	ip.saddr = saddr;
+	ip.daddr = daddr;
+	ip.check = checksum_finish (checksum_add (0, &ip, sizeof (ip)));
+
+	datagram = g_byte_array_sized_new (sizeof (ip) + sizeof (udp) + payload->len);
+	g_byte_array_append (datagram, (const guint8 *) &ip, sizeof (ip));
+	g_byte_array_append (datagram, (const guint8 *) &udp, sizeof (udp));
+	g_byte_array_append (datagram, payload->data, payload->len);
+	return datagram;
+}
+
+/**
+ * nm_dhcp_packet_unwrap_udp:
+ * @data: an IPv4 datagram as read from a packet socket
+ * @len: length of @data
+ * @dport: the expected UDP destination port
+ * @out_payload: on return, the UDP payload
+ * @out_len: on return, the length of the UDP payload
+ *
+ * Returns: %TRUE if @data is an unfragmented UDP datagram to @dport with
+ * valid checksums
+ **/
+gboolean
+nm_dhcp_packet_unwrap_udp (const guint8 *data,
+                           gsize len,
+                           guint16 dport,
+                           const guint8 **out_payload,
+                           gsize *out_len)
+{
+	struct iphdr ip;
+	struct udphdr udp;
+	gsize ip_len, tot_len, udp_len;
+	guint32 sum;
+
+	g_return_val_if_fail (data != NULL, FALSE);
+
+	if (len < sizeof (ip))
+		return FALSE;
+	memcpy (&ip, data, sizeof (ip));
+
+	ip_len = ip.ihl * 4;
+	tot_len = g_ntohs (ip.tot_len);
+	if (   ip.version != 4
+	    || ip_len < sizeof (ip)
+	    || tot_len < ip_len + sizeof (udp)
+	    || tot_len > len
+	    || ip.protocol != IPPROTO_UDP)
+		return FALSE;
+
+	/* No fragments */
+	if (g_ntohs (ip.frag_off) & (IP_MF | IP_OFFMASK))
+		return FALSE;
+
+	if (checksum_finish (checksum_add (0, data, ip_len)) != 0)
+		return FALSE;
+
+	memcpy (&udp, data + ip_len, sizeof (udp));
+	udp_len = g_ntohs (udp.len);
+	if (   g_ntohs (udp.dest) != dport
+	    || udp_len < sizeof (udp)
+	    || udp_len > tot_len - ip_len)
+		return FALSE;
+
+	if (udp.check) {
+		sum = udp_pseudo_header_sum (ip.saddr, ip.daddr, udp_len);
+		sum = checksum_add (sum, data + ip_len, udp_len);
+		if (checksum_finish (sum) != 0)
+			return FALSE;
+	}
+
+	*out_payload = data + ip_len + sizeof (udp);
+	*out_len = udp_len - sizeof (udp);
+	return TRUE;
+}
+
+/*****************************************************************/
+
+void
+nm_dhcp_lease_free (NMDHCPLease *lease)
+{
+	if (!lease)
+		return;
+
+	g_array_free (lease->routers, TRUE);
+	g_array_free (lease->dns_servers, TRUE);
+	g_array_free (lease->nis_servers, TRUE);
+	g_array_free (lease->wins_servers, TRUE);
+	g_array_free (lease->routes, TRUE);
+	g_free (lease->host_name);
+	g_free (lease->domain_name);
+	g_free (lease->nis_domain);
+	g_strfreev (lease->domain_search);
+	g_slice_free (NMDHCPLease, lease);
+}
+
+static const char *
+ip4_to_string (guint32 addr, char *buf)
+{
+	return inet_ntop (AF_INET, &addr, buf, INET_ADDRSTRLEN);
+}
+
+/**
+ * nm_dhcp_lease_to_ip4_config:
+ * @lease: the lease
+ * @iface: interface name, for logging
+ *
+ * Builds the IPv4 configuration for @lease, the same way the configuration
+ * is built from the options of the external DHCP clients.
+ *
+ * Returns: a new #NMIP4Config
+ **/
+NMIP4Config *
+nm_dhcp_lease_to_ip4_config (const NMDHCPLease *lease, const char *iface)
+{
+	NMIP4Config *config;
+	NMIP4Address *addr;
+	NMIP4Route *route;
+	char buf[INET_ADDRSTRLEN], buf2[INET_ADDRSTRLEN];
+	guint32 prefix, gateway = 0;
+	char **domains, **s;
+	guint i;
+
+	g_return_val_if_fail (lease != NULL, NULL);
+
+	config = nm_ip4_config_new ();
+	addr = nm_ip4_address_new ();
+
+	nm_ip4_address_set_address (addr, lease->address);
+	nm_log_info (LOGD_DHCP4, "  address %s", ip4_to_string (lease->address, buf));
+
+	if (lease->netmask) {
+		prefix = nm_utils_ip4_netmask_to_prefix (lease->netmask);
+		nm_log_info (LOGD_DHCP4, "  prefix %d (%s)", prefix, ip4_to_string (lease->netmask, buf));
+	} else {
+		/* Get default netmask for the IP according to appropriate class. */
+		prefix = nm_utils_ip4_get_default_prefix (lease->address);
+		nm_log_info (LOGD_DHCP4, "  prefix %d (default)", prefix);
+	}
+	nm_ip4_address_set_prefix (addr, prefix);
+
+	for (i = 0; i < lease->routes->len; i++) {
+		NMDHCPRoute *r = &g_array_index (lease->routes, NMDHCPRoute, i);
+
+		/* A classless default route is the gateway */
+		if (lease->classless && r->prefix == 0) {
+			if (!gateway)
+				gateway = r->gateway;
+			continue;
+		}
+
+		route = nm_ip4_route_new ();
+		nm_ip4_route_set_dest (route, r->dest);
+		nm_ip4_route_set_prefix (route, r->prefix);
+		nm_ip4_route_set_next_hop (route, r->gateway);
+		nm_ip4_config_take_route (config, route);
+		nm_log_info (LOGD_DHCP4, "  %s static route %s/%d gw %s",
+		             lease->classless ? "classless" : "classful",
+		             ip4_to_string (r->dest, buf), r->prefix,
+		             ip4_to_string (r->gateway, buf2));
+	}
+
+	/* Without a classless default route, the first router is the gateway */
+	if (!gateway && lease->routers->len)
+		gateway = g_array_index (lease->routers, guint32, 0);
+	if (gateway) {
+		nm_ip4_address_set_gateway (addr, gateway);
+		nm_log_info (LOGD_DHCP4, "  gateway %s", ip4_to_string (gateway, buf));
+	}
+
+	nm_ip4_config_take_address (config, addr);
+
+	if (lease->host_name)
+		nm_log_info (LOGD_DHCP4, "  hostname '%s'", lease->host_name);
+
+	for (i = 0; i < lease->dns_servers->len; i++) {
+		guint32 ns = g_array_index (lease->dns_servers, guint32, i);
+
+		nm_ip4_config_add_nameserver (config, ns);
+		nm_log_info (LOGD_DHCP4, "  nameserver '%s'", ip4_to_string (ns, buf));
+	}
+
+	if (lease->domain_name) {
+		domains = g_strsplit (lease->domain_name, " ", 0);
+		for (s = domains; *s; s++) {
+			if (strlen (*s)) {
+				nm_log_info (LOGD_DHCP4, "  domain name '%s'", *s);
+				nm_ip4_config_add_domain (config, *s);
+			}
+		}
+		g_strfreev (domains);
+	}
+
+	for (s = lease->domain_search; s && *s; s++) {
+		nm_log_info (LOGD_DHCP4, "  domain search '%s'", *s);
+		nm_ip4_config_add_search (config, *s);
+	}
+
+	for (i = 0; i < lease->wins_servers->len; i++) {
+		guint32 wins = g_array_index (lease->wins_servers, guint32, i);
+
+		nm_ip4_config_add_wins (config, wins);
+		nm_log_info (LOGD_DHCP4, "  wins '%s'", ip4_to_string (wins, buf));
+	}
+
+	if (lease->mtu > 576)
+		nm_ip4_config_set_mtu (config, lease->mtu);
+
+	if (lease->nis_domain) {
+		nm_log_info (LOGD_DHCP4, "  NIS domain '%s'", lease->nis_domain);
+		nm_ip4_config_set_nis_domain (config, lease->nis_domain);
+	}
+
+	for (i = 0; i < lease->nis_servers->len; i++) {
+		guint32 nis = g_array_index (lease->nis_servers, guint32, i);
+
+		nm_ip4_config_add_nis_server (config, nis);
+		nm_log_info (LOGD_DHCP4, "  nis '%s'", ip4_to_string (nis, buf));
+	}
+
+	return config;
+}
+
+static void
+add_address_list (GHashTable *options, const char *key, GArray *addrs)
+{
+	GString *str;
+	char buf[INET_ADDRSTRLEN];
+	guint i;
+
+	if (!addrs->len)
+		return;
+
+	str = g_string_new (NULL);
+	for (i = 0; i < addrs->len; i++) {
+		if (str->len)
+			g_string_append_c (str, ' ');
+		g_string_append (str, ip4_to_string (g_array_index (addrs, guint32, i), buf));
+	}
+	g_hash_table_insert (options, g_strdup (key), g_string_free (str, FALSE));
+}
+
+/**
+ * nm_dhcp_lease_to_options:
+ * @lease: the lease
+ *
+ * Returns: the options of @lease, named and formatted like dhclient's, for
+ * the DHCP4Config D-Bus object
+ **/
+GHashTable *
+nm_dhcp_lease_to_options (const NMDHCPLease *lease)
+{
+	GHashTable *options;
+	GString *str;
+	char buf[INET_ADDRSTRLEN];
+	guint i;
+
+	g_return_val_if_fail (lease != NULL, NULL);
+
+	options = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+	g_hash_table_insert (options, g_strdup ("new_ip_address"),
+	                     g_strdup (ip4_to_string (lease->address, buf)));
+	if (lease->netmask) {
+		g_hash_table_insert (options, g_strdup ("new_subnet_mask"),
+		                     g_strdup (ip4_to_string (lease->netmask, buf)));
+	}
+	if (lease->server_id) {
+		g_hash_table_insert (options, g_strdup ("new_dhcp_server_identifier"),
+		                     g_strdup (ip4_to_string (lease->server_id, buf)));
+	}
+	if (lease->lease_time != G_MAXUINT32) {
+		g_hash_table_insert (options, g_strdup ("new_dhcp_lease_time"),
+		                     g_strdup_printf ("%u", lease->lease_time));
+	}
+	if (lease->mtu) {
+		g_hash_table_insert (options, g_strdup ("new_interface_mtu"),
+		                     g_strdup_printf ("%u", lease->mtu));
+	}
+
+	add_address_list (options, "new_routers", lease->routers);
+	add_address_list (options, "new_domain_name_servers", lease->dns_servers);
+	add_address_list (options, "new_nis_servers", lease->nis_servers);
+	add_address_list (options, "new_netbios_name_servers", lease->wins_servers);
+
+	if (lease->host_name)
+		g_hash_table_insert (options, g_strdup ("new_host_name"), g_strdup (lease->host_name));
+	if (lease->domain_name)
+		g_hash_table_insert (options, g_strdup ("new_domain_name"), g_strdup (lease->domain_name));
+	if (lease->nis_domain)
+		g_hash_table_insert (options, g_strdup ("new_nis_domain"), g_strdup (lease->nis_domain));
+	if (lease->domain_search) {
+		g_hash_table_insert (options, g_strdup ("new_domain_search"),
+		                     g_strjoinv (" ", lease->domain_search));
+	}
+
+	if (lease->routes->len) {
+		/* Classless routes in dhcpcd's format, classful ones like dhclient */
+		str = g_string_new (NULL);
+		for (i = 0; i < lease->routes->len; i++) {
+			NMDHCPRoute *r = &g_array_index (lease->routes, NMDHCPRoute, i);
+
+			if (str->len)
+				g_string_append_c (str, ' ');
+			g_string_append (str, ip4_to_string (r->dest, buf));
+			if (lease->classless)
+				g_string_append_printf (str, "/%u", r->prefix);
+			g_string_append_c (str, ' ');
+			g_string_append (str, ip4_to_string (r->gateway, buf));
+		}
+		g_hash_table_insert (options,
+		                     g_strdup (lease->classless ? "new_classless_static_routes" : "new_static_routes"),
+		                     g_string_free (str, FALSE));
+	}
+
+	return options;
+}
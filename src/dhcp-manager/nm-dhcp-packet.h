@@ -0,0 +1,144 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#ifndef NM_DHCP_PACKET_H
+#define NM_DHCP_PACKET_H
+
+#include <glib.h>
+
+#include "nm-ip4-config.h"
+
+/* DHCPv4 wire format (RFC 2131/2132) for the internal client */
+
+#define NM_DHCP_SERVER_PORT 67
+#define NM_DHCP_CLIENT_PORT 68
+
+#define NM_DHCP_OP_REQUEST  1
+#define NM_DHCP_OP_REPLY    2
+
+typedef enum {
+	NM_DHCP_MSG_DISCOVER = 1,
+	NM_DHCP_MSG_OFFER    = 2,
+	NM_DHCP_MSG_REQUEST  = 3,
+	NM_DHCP_MSG_DECLINE  = 4,
+	NM_DHCP_MSG_ACK      = 5,
+	NM_DHCP_MSG_NAK      = 6,
+	NM_DHCP_MSG_RELEASE  = 7,
+	NM_DHCP_MSG_INFORM   = 8,
+} NMDHCPMessageType;
+
+enum {
+	NM_DHCP_OPTION_PAD               = 0,
+	NM_DHCP_OPTION_SUBNET_MASK       = 1,
+	NM_DHCP_OPTION_ROUTER            = 3,
+	NM_DHCP_OPTION_DNS_SERVER        = 6,
+	NM_DHCP_OPTION_HOST_NAME         = 12,
+	NM_DHCP_OPTION_DOMAIN_NAME       = 15,
+	NM_DHCP_OPTION_INTERFACE_MTU     = 26,
+	NM_DHCP_OPTION_STATIC_ROUTE      = 33,
+	NM_DHCP_OPTION_NIS_DOMAIN        = 40,
+	NM_DHCP_OPTION_NIS_SERVERS       = 41,
+	NM_DHCP_OPTION_NETBIOS_NS        = 44,
+	NM_DHCP_OPTION_REQUESTED_IP      = 50,
+	NM_DHCP_OPTION_LEASE_TIME        = 51,
+	NM_DHCP_OPTION_MESSAGE_TYPE      = 53,
+	NM_DHCP_OPTION_SERVER_ID         = 54,
+	NM_DHCP_OPTION_PARAMETER_REQUEST = 55,
+	NM_DHCP_OPTION_MAX_MESSAGE_SIZE  = 57,
+	NM_DHCP_OPTION_RENEWAL_TIME      = 58,
+	NM_DHCP_OPTION_REBINDING_TIME    = 59,
+	NM_DHCP_OPTION_CLIENT_ID         = 61,
+	NM_DHCP_OPTION_DOMAIN_SEARCH     = 119,
+	NM_DHCP_OPTION_CLASSLESS_ROUTE   = 121,
+	NM_DHCP_OPTION_MS_CLASSLESS_ROUTE = 249,
+	NM_DHCP_OPTION_END               = 255,
+};
+
+typedef struct {
+	guint32 dest;
+	guint32 prefix;
+	guint32 gateway;
+} NMDHCPRoute;
+
+/* Everything the internal client uses from an OFFER or ACK; addresses are
+ * in network byte order.
+ */
+typedef struct {
+	guint32 address;
+	guint32 netmask;      /* 0 if the server didn't send one */
+	guint32 server_id;
+	guint32 lease_time;   /* seconds; G_MAXUINT32 for an infinite lease */
+	guint32 t1, t2;       /* 0 if the server didn't send them */
+	guint16 mtu;
+
+	GArray *routers;      /* guint32 */
+	GArray *dns_servers;  /* guint32 */
+	GArray *nis_servers;  /* guint32 */
+	GArray *wins_servers; /* guint32 */
+	GArray *routes;       /* NMDHCPRoute */
+	gboolean classless;   /* @routes came from option 121 or 249 */
+
+	char *host_name;
+	char *domain_name;
+	char *nis_domain;
+	char **domain_search;
+} NMDHCPLease;
+
+GByteArray * nm_dhcp_packet_new        (guint8 op,
+                                        NMDHCPMessageType type,
+                                        guint32 xid,
+                                        const guint8 *chaddr,
+                                        guint chaddr_len,
+                                        guint32 ciaddr,
+                                        guint32 yiaddr);
+void         nm_dhcp_packet_add_option (GByteArray *packet,
+                                        guint8 code,
+                                        const void *data,
+                                        guint8 len);
+void         nm_dhcp_packet_add_option_u32 (GByteArray *packet,
+                                            guint8 code,
+                                            guint32 value);
+void         nm_dhcp_packet_end        (GByteArray *packet);
+
+gboolean     nm_dhcp_packet_parse      (const guint8 *data,
+                                        gsize len,
+                                        guint8 op,
+                                        guint32 xid,
+                                        const guint8 *chaddr,
+                                        guint chaddr_len,
+                                        NMDHCPMessageType *out_type,
+                                        NMDHCPLease **out_lease);
+
+GByteArray * nm_dhcp_packet_wrap_udp   (const GByteArray *payload,
+                                        guint32 saddr,
+                                        guint16 sport,
+                                        guint32 daddr,
+                                        guint16 dport);
+gboolean     nm_dhcp_packet_unwrap_udp (const guint8 *data,
+                                        gsize len,
+                                        guint16 dport,
+                                        const guint8 **out_payload,
+                                        gsize *out_len);
+
+void         nm_dhcp_lease_free        (NMDHCPLease *lease);
+NMIP4Config *nm_dhcp_lease_to_ip4_config (const NMDHCPLease *lease, const char *iface);
+GHashTable * nm_dhcp_lease_to_options  (const NMDHCPLease *lease);
+
+#endif /* NM_DHCP_PACKET_H */
@@ -19,21 +19,28 @@
  */
 
 #include <config.h>
+#include <string.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include <pwd.h>
 
 #include <glib.h>
 #include <glib/gi18n.h>
+#include <dbus/dbus-glib.h>
 
 #include "nm-dns-dnsmasq.h"
 #include "nm-logging.h"
 #include "nm-ip4-config.h"
 #include "nm-ip6-config.h"
 #include "nm-dns-utils.h"
+#include "nm-dbus-manager.h"
 
 G_DEFINE_TYPE (NMDnsDnsmasq, nm_dns_dnsmasq, NM_TYPE_DNS_PLUGIN)
 
@@ -43,8 +50,57 @@ G_DEFINE_TYPE (NMDnsDnsmasq, nm_dns_dnsmasq, NM_TYPE_DNS_PLUGIN)
 #define CONFFILE NMRUNDIR "/dnsmasq.conf"
 #define CONFDIR NMCONFDIR "/dnsmasq.d"
 
+#define DNSMASQ_DBUS_SERVICE   "org.freedesktop.NetworkManager.dnsmasq"
+#define DNSMASQ_DBUS_PATH      "/uk/org/thekelleys/dnsmasq"
+#define DNSMASQ_DBUS_INTERFACE "uk.org.thekelleys.dnsmasq"
+
+#define DBUS_TYPE_G_ARRAY_OF_STRV (dbus_g_type_get_collection ("GPtrArray", G_TYPE_STRV))
+
+#define STATS_TIMEOUT 2
+
+/* Seconds a new dnsmasq has to claim its bus name */
+#define CLAIM_TIMEOUT 10
+
+enum {
+	CACHE_STATS_CHANGED,
+	LAST_SIGNAL
+};
+static guint signals[LAST_SIGNAL] = { 0 };
+
+/* CHAOS TXT names dnsmasq answers with its cache counters */
+static const char *stats_names[] = {
+	"cachesize.bind",
+	"hits.bind",
+	"misses.bind",
+	"evictions.bind",
+};
+
 typedef struct {
-	guint32 foo;
+	guint cache_size;
+	gboolean cache_size_changed;
+
+	NMDBusManager *dbus_mgr;
+	guint name_owner_id;
+	DBusGProxy *proxy;
+	DBusGProxyCall *call;
+	gboolean on_bus;          /* the dnsmasq we started owns its bus name */
+	gboolean no_dbus;         /* dnsmasq can't be reconfigured over D-Bus */
+	guint claim_id;           /* waiting for dnsmasq to claim its bus name */
+
+	/* Upstream servers, each { address, domain } or { address } */
+	GPtrArray *servers;
+	char *conf;               /* config text for 'servers' */
+	char *pushed;             /* config text the running dnsmasq has */
+
+	/* Cache statistics */
+	int stats_fd;
+	guint stats_io_id;
+	guint stats_timeout_id;
+	guint16 stats_id;
+	guint32 stats_pending[G_N_ELEMENTS (stats_names)];
+	guint stats_received;
+	NMDnsDnsmasqCacheStats stats;
+	gboolean have_stats;
 } NMDnsDnsmasqPrivate;
 
 /*******************************************/
@@ -68,8 +124,19 @@ find_dnsmasq (void)
 	return NULL;
 }
 
+static void
+add_server (GPtrArray *servers, const char *addr, const char *domain)
+{
+	char **server;
+
+	server = g_new0 (char *, 3);
+	server[0] = g_strdup (addr);
+	server[1] = g_strdup (domain);
+	g_ptr_array_add (servers, server);
+}
+
 static gboolean
-add_ip4_config (GString *str, NMIP4Config *ip4, gboolean split)
+add_ip4_config (GPtrArray *servers, NMIP4Config *ip4, gboolean split)
 {
 	char buf[INET_ADDRSTRLEN + 1];
 	struct in_addr addr;
@@ -94,9 +161,7 @@ add_ip4_config (GString *str, NMIP4Config *ip4, gboolean split)
 		/* searches are preferred over domains */
 		n = nm_ip4_config_get_num_searches (ip4);
 		for (i = 0; i < n; i++) {
-			g_string_append_printf (str, "server=/%s/%s\n",
-				                    nm_ip4_config_get_search (ip4, i),
-				                    buf);
+			add_server (servers, buf, nm_ip4_config_get_search (ip4, i));
 			added = TRUE;
 		}
 
@@ -104,9 +169,7 @@ add_ip4_config (GString *str, NMIP4Config *ip4, gboolean split)
 			/* If not searches, use any domains */
 			n = nm_ip4_config_get_num_domains (ip4);
 			for (i = 0; i < n; i++) {
-				g_string_append_printf (str, "server=/%s/%s\n",
-							            nm_ip4_config_get_domain (ip4, i),
-							            buf);
+				add_server (servers, buf, nm_ip4_config_get_domain (ip4, i));
 				added = TRUE;
 			}
 		}
@@ -117,7 +180,7 @@ add_ip4_config (GString *str, NMIP4Config *ip4, gboolean split)
 		domains = nm_dns_utils_get_ip4_rdns_domains (ip4);
 		if (domains) {
 			for (iter = domains; iter && *iter; iter++)
-				g_string_append_printf (str, "server=/%s/%s\n", *iter, buf);
+				add_server (servers, buf, *iter);
 			g_strfreev (domains);
 			added = TRUE;
 		}
@@ -130,7 +193,7 @@ add_ip4_config (GString *str, NMIP4Config *ip4, gboolean split)
 			memset (&buf[0], 0, sizeof (buf));
 			addr.s_addr = nm_ip4_config_get_nameserver (ip4, i);
 			if (inet_ntop (AF_INET, &addr, buf, sizeof (buf)))
-				g_string_append_printf (str, "server=%s\n", buf);
+				add_server (servers, buf, NULL);
 		}
 	}
 
@@ -183,7 +246,7 @@ error:
 }
 
 static gboolean
-add_ip6_config (GString *str, NMIP6Config *ip6, gboolean split, const char *iface)
+add_ip6_config (GPtrArray *servers, NMIP6Config *ip6, gboolean split, const char *iface)
 {
 	const struct in6_addr *addr;
 	char *buf;
@@ -206,9 +269,7 @@ add_ip6_config (GString *str, NMIP6Config *ip6, gboolean split, const char *ifac
 		/* searches are preferred over domains */
 		n = nm_ip6_config_get_num_searches (ip6);
 		for (i = 0; i < n; i++) {
-			g_string_append_printf (str, "server=/%s/%s\n",
-				                    nm_ip6_config_get_search (ip6, i),
-				                    buf);
+			add_server (servers, buf, nm_ip6_config_get_search (ip6, i));
 			added = TRUE;
 		}
 
@@ -216,9 +277,7 @@ add_ip6_config (GString *str, NMIP6Config *ip6, gboolean split, const char *ifac
 			/* If not searches, use any domains */
 			n = nm_ip6_config_get_num_domains (ip6);
 			for (i = 0; i < n; i++) {
-				g_string_append_printf (str, "server=/%s/%s\n",
-							            nm_ip6_config_get_domain (ip6, i),
-							            buf);
+				add_server (servers, buf, nm_ip6_config_get_domain (ip6, i));
 				added = TRUE;
 			}
 		}
@@ -233,7 +292,7 @@ add_ip6_config (GString *str, NMIP6Config *ip6, gboolean split, const char *ifac
 			addr = nm_ip6_config_get_nameserver (ip6, i);
 			buf = ip6_addr_to_string (addr, iface);
 			if (buf) {
-				g_string_append_printf (str, "server=%s\n", buf);
+				add_server (servers, buf, NULL);
 				g_free (buf);
 			}
 		}
@@ -242,6 +301,405 @@ add_ip6_config (GString *str, NMIP6Config *ip6, gboolean split, const char *ifac
 	return TRUE;
 }
 
+static char *
+servers_to_conf (GPtrArray *servers)
+{
+	GString *conf;
+	char **server;
+	guint i;
+
+	conf = g_string_sized_new (150);
+	for (i = 0; i < servers->len; i++) {
+		server = g_ptr_array_index (servers, i);
+		if (server[1])
+			g_string_append_printf (conf, "server=/%s/%s\n", server[1], server[0]);
+		else
+			g_string_append_printf (conf, "server=%s\n", server[0]);
+	}
+	return g_string_free (conf, FALSE);
+}
+
+/****************************************************************/
+
+/* dnsmasq reports its cache counters as TXT records in the CHAOS class */
+
+static GByteArray *
+build_stats_query (guint16 id, const char *name)
+{
+	GByteArray *query;
+	guint8 header[12] = { 0 };
+	guint8 trailer[5] = { 0, 0, 16, 0, 3 };  /* root label, TXT, CHAOS */
+	char **labels, **iter;
+	guint8 len;
+
+	header[0] = id >> 8;
+	header[1] = id & 0xFF;
+	header[5] = 1;  /* one question */
+
+	query = g_byte_array_sized_new (64);
+	g_byte_array_append (query, header, sizeof (header));
+
+	labels = g_strsplit (name, ".", -1);
+	for (iter = labels; *iter; iter++) {
+		len = strlen (*iter);
+		g_byte_array_append (query, &len, 1);
+		g_byte_array_append (query, (const guint8 *) *iter, len);
+	}
+	g_strfreev (labels);
+
+	g_byte_array_append (query, trailer, sizeof (trailer));
+	return query;
+}
+
+static gboolean
+skip_name (const guint8 *buf, gsize len, gsize *pos)
+{
+	while (*pos < len) {
+		guint8 c = buf[*pos];
+
+		if (c == 0) {
+			*pos += 1;
+			return TRUE;
+		}
+		if ((c & 0xC0) == 0xC0) {
+			*pos += 2;
+			return *pos <= len;
+		}
+		*pos += 1 + c;
+	}
+	return FALSE;
+}
+
+static gboolean
+parse_stats_reply (const guint8 *buf, gsize len, guint16 *out_id, guint32 *out_value)
+{
+	gsize pos = 12;
+	guint txt_len;
+	char *str;
+
+	if (len < 12 || !(buf[2] & 0x80) || (buf[3] & 0x0F) || buf[5] != 1 || !(buf[6] || buf[7]))
+		return FALSE;
+	*out_id = (buf[0] << 8) | buf[1];
+
+	/* Question, then the answer's name, type, class, TTL and length */
+	if (!skip_name (buf, len, &pos))
+		return FALSE;
+	pos += 4;
+	if (!skip_name (buf, len, &pos) || pos + 10 > len)
+		return FALSE;
+	if (buf[pos] != 0 || buf[pos + 1] != 16)
+		return FALSE;
+	pos += 10;
+
+	if (pos >= len)
+		return FALSE;
+	txt_len = buf[pos++];
+	if (pos + txt_len > len)
+		return FALSE;
+
+	str = g_strndup ((const char *) buf + pos, txt_len);
+	*out_value = strtoul (str, NULL, 10);
+	g_free (str);
+	return TRUE;
+}
+
+static void
+stats_done (NMDnsDnsmasq *self)
+{
+	NMDnsDnsmasqPrivate *priv = NM_DNS_DNSMASQ_GET_PRIVATE (self);
+
+	if (priv->stats_io_id) {
+		g_source_remove (priv->stats_io_id);
+		priv->stats_io_id = 0;
+	}
+	if (priv->stats_timeout_id) {
+		g_source_remove (priv->stats_timeout_id);
+		priv->stats_timeout_id = 0;
+	}
+	if (priv->stats_fd >= 0) {
+		close (priv->stats_fd);
+		priv->stats_fd = -1;
+	}
+}
+
+static gboolean
+stats_timeout_cb (gpointer user_data)
+{
+	NMDnsDnsmasq *self = NM_DNS_DNSMASQ (user_data);
+
+	NM_DNS_DNSMASQ_GET_PRIVATE (self)->stats_timeout_id = 0;
+	nm_log_dbg (LOGD_DNS, "dnsmasq did not report cache statistics");
+	stats_done (self);
+	return FALSE;
+}
+
+static gboolean
+stats_reply_cb (GIOChannel *channel, GIOCondition condition, gpointer user_data)
+{
+	NMDnsDnsmasq *self = NM_DNS_DNSMASQ (user_data);
+	NMDnsDnsmasqPrivate *priv = NM_DNS_DNSMASQ_GET_PRIVATE (self);
+	guint8 buf[512];
+	ssize_t len;
+	guint16 id;
+	guint32 value, idx;
+
+	while ((len = recv (priv->stats_fd, buf, sizeof (buf), MSG_DONTWAIT)) > 0) {
+		if (!parse_stats_reply (buf, len, &id, &value))
+			continue;
+
+		idx = (guint16) (id - priv->stats_id);
+		if (idx >= G_N_ELEMENTS (stats_names) || (priv->stats_received & (1 << idx)))
+			continue;
+		priv->stats_pending[idx] = value;
+		priv->stats_received |= 1 << idx;
+	}
+
+	if (priv->stats_received != (1 << G_N_ELEMENTS (stats_names)) - 1)
+		return TRUE;
+
+	priv->stats.cache_size = priv->stats_pending[0];
+	priv->stats.hits = priv->stats_pending[1];
+	priv->stats.misses = priv->stats_pending[2];
+	priv->stats.evictions = priv->stats_pending[3];
+	priv->have_stats = TRUE;
+
+	nm_log_dbg (LOGD_DNS, "dnsmasq cache: size %u, %u hits, %u misses, %u evictions",
+	             priv->stats.cache_size, priv->stats.hits,
+	             priv->stats.misses, priv->stats.evictions);
+
+	priv->stats_io_id = 0;
+	stats_done (self);
+	g_signal_emit (self, signals[CACHE_STATS_CHANGED], 0);
+	return FALSE;
+}
+
+/* Asks the running dnsmasq for its cache counters; the answers are logged
+ * and kept for nm_dns_dnsmasq_get_cache_stats(), and announced with
+ * NM_DNS_DNSMASQ_CACHE_STATS_CHANGED.
+ */
+static void
+request_stats (NMDnsDnsmasq *self)
+{
+	NMDnsDnsmasqPrivate *priv = NM_DNS_DNSMASQ_GET_PRIVATE (self);
+	struct sockaddr_in sin;
+	GIOChannel *channel;
+	GByteArray *query;
+	guint i;
+
+	if (priv->stats_fd >= 0)
+		return;
+
+	priv->stats_fd = socket (AF_INET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (priv->stats_fd < 0)
+		return;
+
+	memset (&sin, 0, sizeof (sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons (53);
+	sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+	if (connect (priv->stats_fd, (struct sockaddr *) &sin, sizeof (sin)) < 0) {
+		stats_done (self);
+		return;
+	}
+
+	priv->stats_id = g_random_int_range (0, G_MAXUINT16);
+	priv->stats_received = 0;
+	for (i = 0; i < G_N_ELEMENTS (stats_names); i++) {
+		query = build_stats_query ((guint16) (priv->stats_id + i), stats_names[i]);
+		send (priv->stats_fd, query->data, query->len, 0);
+		g_byte_array_free (query, TRUE);
+	}
+
+	channel = g_io_channel_unix_new (priv->stats_fd);
+	priv->stats_io_id = g_io_add_watch (channel, G_IO_IN, stats_reply_cb, self);
+	g_io_channel_unref (channel);
+	priv->stats_timeout_id = g_timeout_add_seconds (STATS_TIMEOUT, stats_timeout_cb, self);
+}
+
+/**
+ * nm_dns_dnsmasq_get_cache_stats:
+ * @self: the dnsmasq plugin
+ * @stats: on return, the counters dnsmasq reported last
+ *
+ * dnsmasq is asked for its cache counters on every DNS update.
+ *
+ * Returns: %FALSE if dnsmasq hasn't reported any yet
+ **/
+gboolean
+nm_dns_dnsmasq_get_cache_stats (NMDnsDnsmasq *self, NMDnsDnsmasqCacheStats *stats)
+{
+	NMDnsDnsmasqPrivate *priv;
+
+	g_return_val_if_fail (NM_IS_DNS_DNSMASQ (self), FALSE);
+	g_return_val_if_fail (stats != NULL, FALSE);
+
+	priv = NM_DNS_DNSMASQ_GET_PRIVATE (self);
+	if (priv->have_stats)
+		*stats = priv->stats;
+	return priv->have_stats;
+}
+
+/****************************************************************/
+
+static GPid spawn_dnsmasq (NMDnsDnsmasq *self);
+
+static void
+set_servers_done (DBusGProxy *proxy, DBusGProxyCall *call, gpointer user_data)
+{
+	NMDnsDnsmasq *self = NM_DNS_DNSMASQ (user_data);
+	NMDnsDnsmasqPrivate *priv = NM_DNS_DNSMASQ_GET_PRIVATE (self);
+	GError *error = NULL;
+
+	priv->call = NULL;
+	if (dbus_g_proxy_end_call (proxy, call, &error, G_TYPE_INVALID)) {
+		nm_log_dbg (LOGD_DNS, "dnsmasq upstream servers updated");
+		return;
+	}
+
+	if (g_error_matches (error, DBUS_GERROR, DBUS_GERROR_UNKNOWN_METHOD)) {
+		/* SetServersEx is new in dnsmasq 2.69 */
+		nm_log_info (LOGD_DNS, "dnsmasq can't be reconfigured at runtime; restarting it on DNS changes");
+		priv->no_dbus = TRUE;
+	} else {
+		nm_log_warn (LOGD_DNS, "could not update dnsmasq upstream servers: %s; restarting it",
+		             error && error->message ? error->message : "(unknown)");
+	}
+	g_clear_error (&error);
+
+	/* The config file is current, so a new dnsmasq gets it all */
+	nm_dns_plugin_child_kill (NM_DNS_PLUGIN (self));
+	spawn_dnsmasq (self);
+}
+
+/* Hands the current servers to the running dnsmasq, which keeps its cache */
+static void
+push_servers (NMDnsDnsmasq *self)
+{
+	NMDnsDnsmasqPrivate *priv = NM_DNS_DNSMASQ_GET_PRIVATE (self);
+
+	if (!priv->on_bus || !priv->conf || !g_strcmp0 (priv->conf, priv->pushed))
+		return;
+
+	if (priv->call)
+		dbus_g_proxy_cancel_call (priv->proxy, priv->call);
+
+	priv->call = dbus_g_proxy_begin_call (priv->proxy, "SetServersEx",
+	                                      set_servers_done, self, NULL,
+	                                      DBUS_TYPE_G_ARRAY_OF_STRV, priv->servers,
+	                                      G_TYPE_INVALID);
+
+	g_free (priv->pushed);
+	priv->pushed = g_strdup (priv->conf);
+}
+
+static void
+name_owner_changed (NMDBusManager *dbus_mgr,
+                    const char *name,
+                    const char *old_owner,
+                    const char *new_owner,
+                    gpointer user_data)
+{
+	NMDnsDnsmasq *self = NM_DNS_DNSMASQ (user_data);
+	NMDnsDnsmasqPrivate *priv = NM_DNS_DNSMASQ_GET_PRIVATE (self);
+
+	if (strcmp (name, DNSMASQ_DBUS_SERVICE) != 0)
+		return;
+
+	priv->on_bus = (new_owner && strlen (new_owner));
+	if (priv->on_bus) {
+		/* Catch up with anything that changed while dnsmasq was starting */
+		nm_log_dbg (LOGD_DNS, "dnsmasq appeared on the bus");
+		if (priv->claim_id) {
+			g_source_remove (priv->claim_id);
+			priv->claim_id = 0;
+		}
+		push_servers (self);
+	}
+}
+
+static gboolean
+claim_timeout (gpointer user_data)
+{
+	NMDnsDnsmasq *self = NM_DNS_DNSMASQ (user_data);
+	NMDnsDnsmasqPrivate *priv = NM_DNS_DNSMASQ_GET_PRIVATE (self);
+
+	priv->claim_id = 0;
+	if (priv->on_bus)
+		return FALSE;
+
+	/* Most likely the bus policy doesn't let the dnsmasq user own the
+	 * name.  Go back to restarting dnsmasq on every change, and do so now
+	 * if the servers changed while it was starting.
+	 */
+	nm_log_warn (LOGD_DNS, "dnsmasq did not claim %s; restarting it on DNS changes instead",
+	             DNSMASQ_DBUS_SERVICE);
+	priv->no_dbus = TRUE;
+	if (g_strcmp0 (priv->conf, priv->pushed)) {
+		nm_dns_plugin_child_kill (NM_DNS_PLUGIN (self));
+		if (!spawn_dnsmasq (self))
+			g_signal_emit_by_name (self, NM_DNS_PLUGIN_FAILED);
+	}
+	return FALSE;
+}
+
+static GPid
+spawn_dnsmasq (NMDnsDnsmasq *self)
+{
+	NMDnsDnsmasqPrivate *priv = NM_DNS_DNSMASQ_GET_PRIVATE (self);
+	const char *argv[15];
+	char *cache_size;
+	GPid pid;
+	guint idx = 0;
+
+	cache_size = g_strdup_printf ("--cache-size=%u", priv->cache_size);
+
+	argv[idx++] = find_dnsmasq ();
+	argv[idx++] = "--no-resolv";  /* Use only commandline */
+	argv[idx++] = "--keep-in-foreground";
+	argv[idx++] = "--no-hosts"; /* don't use /etc/hosts to resolve */
+	argv[idx++] = "--bind-interfaces";
+	argv[idx++] = "--pid-file=" PIDFILE;
+	argv[idx++] = "--listen-address=127.0.0.1"; /* Should work for both 4 and 6 */
+	argv[idx++] = "--conf-file=" CONFFILE;
+	argv[idx++] = cache_size;
+	argv[idx++] = "--proxy-dnssec"; /* Allow DNSSEC to pass through */
+
+	/* Lets NM change the upstream servers without a restart.  dnsmasq
+	 * claims its bus name after dropping privileges; the bus policy lets
+	 * the dedicated dnsmasq user own it.  Without that user dnsmasq runs as
+	 * nobody, fails to claim the name, and claim_timeout() gives up on D-Bus.
+	 */
+	if (!priv->no_dbus) {
+		if (getpwnam (DNSMASQ_USER))
+			argv[idx++] = "--user=" DNSMASQ_USER;
+		argv[idx++] = "--enable-dbus=" DNSMASQ_DBUS_SERVICE;
+	}
+
+	/* dnsmasq exits if the conf dir is not present */
+	if (g_file_test (CONFDIR, G_FILE_TEST_IS_DIR))
+		argv[idx++] = "--conf-dir=" CONFDIR;
+
+	argv[idx++] = NULL;
+	g_warn_if_fail (idx <= G_N_ELEMENTS (argv));
+
+	/* The new instance reads the config file */
+	priv->on_bus = FALSE;
+	if (priv->claim_id) {
+		g_source_remove (priv->claim_id);
+		priv->claim_id = 0;
+	}
+	if (!priv->no_dbus)
+		priv->claim_id = g_timeout_add_seconds (CLAIM_TIMEOUT, claim_timeout, self);
+	g_free (priv->pushed);
+	priv->pushed = g_strdup (priv->conf);
+	priv->cache_size_changed = FALSE;
+
+	/* And finally spawn dnsmasq */
+	pid = nm_dns_plugin_child_spawn (NM_DNS_PLUGIN (self), argv, PIDFILE, "bin/dnsmasq");
+	g_free (cache_size);
+	return pid;
+}
+
 static gboolean
 update (NMDnsPlugin *plugin,
         const GSList *vpn_configs,
@@ -251,86 +709,85 @@ update (NMDnsPlugin *plugin,
         const char *iface)
 {
 	NMDnsDnsmasq *self = NM_DNS_DNSMASQ (plugin);
-	GString *conf;
+	NMDnsDnsmasqPrivate *priv = NM_DNS_DNSMASQ_GET_PRIVATE (self);
+	GPtrArray *servers;
 	GSList *iter;
-	const char *argv[15];
+	char *conf;
 	GError *error = NULL;
 	int ignored;
-	GPid pid = 0;
-	guint idx = 0;
+	gboolean running;
 
-	/* Kill the old dnsmasq; there doesn't appear to be a way to get dnsmasq
-	 * to reread the config file using SIGHUP or similar.  This is a small race
-	 * here when restarting dnsmasq when DNS requests could go to the upstream
-	 * servers instead of to dnsmasq.
-	 */
-	nm_dns_plugin_child_kill (plugin);
-
-	/* Build up the new dnsmasq config file */
-	conf = g_string_sized_new (150);
+	servers = g_ptr_array_new_with_free_func ((GDestroyNotify) g_strfreev);
 
 	/* Use split DNS for VPN configs */
 	for (iter = (GSList *) vpn_configs; iter; iter = g_slist_next (iter)) {
 		if (NM_IS_IP4_CONFIG (iter->data))
-			add_ip4_config (conf, NM_IP4_CONFIG (iter->data), TRUE);
+			add_ip4_config (servers, NM_IP4_CONFIG (iter->data), TRUE);
 		else if (NM_IS_IP6_CONFIG (iter->data))
-			add_ip6_config (conf, NM_IP6_CONFIG (iter->data), TRUE, iface);
+			add_ip6_config (servers, NM_IP6_CONFIG (iter->data), TRUE, iface);
 	}
 
 	/* Now add interface configs without split DNS */
 	for (iter = (GSList *) dev_configs; iter; iter = g_slist_next (iter)) {
 		if (NM_IS_IP4_CONFIG (iter->data))
-			add_ip4_config (conf, NM_IP4_CONFIG (iter->data), FALSE);
+			add_ip4_config (servers, NM_IP4_CONFIG (iter->data), FALSE);
 		else if (NM_IS_IP6_CONFIG (iter->data))
-			add_ip6_config (conf, NM_IP6_CONFIG (iter->data), FALSE, iface);
+			add_ip6_config (servers, NM_IP6_CONFIG (iter->data), FALSE, iface);
 	}
 
 	/* And any other random configs */
 	for (iter = (GSList *) other_configs; iter; iter = g_slist_next (iter)) {
 		if (NM_IS_IP4_CONFIG (iter->data))
-			add_ip4_config (conf, NM_IP4_CONFIG (iter->data), FALSE);
+			add_ip4_config (servers, NM_IP4_CONFIG (iter->data), FALSE);
 		else if (NM_IS_IP6_CONFIG (iter->data))
-			add_ip6_config (conf, NM_IP6_CONFIG (iter->data), FALSE, iface);
+			add_ip6_config (servers, NM_IP6_CONFIG (iter->data), FALSE, iface);
+	}
+
+	conf = servers_to_conf (servers);
+	running = nm_dns_plugin_child_pid (plugin) > 0;
+
+	if (running && !priv->cache_size_changed && !g_strcmp0 (conf, priv->conf)) {
+		nm_log_dbg (LOGD_DNS, "dnsmasq configuration unchanged");
+		g_ptr_array_unref (servers);
+		g_free (conf);
+		return TRUE;
 	}
 
-	/* Write out the config file */
-	if (!g_file_set_contents (CONFFILE, conf->str, -1, &error)) {
+	/* Write out the config file; it's what a new dnsmasq starts with */
+	if (!g_file_set_contents (CONFFILE, conf, -1, &error)) {
 		nm_log_warn (LOGD_DNS, "Failed to write dnsmasq config file %s: (%d) %s",
 		             CONFFILE,
 		             error ? error->code : -1,
 		             error && error->message ? error->message : "(unknown)");
 		g_clear_error (&error);
-		goto out;
+		g_ptr_array_unref (servers);
+		g_free (conf);
+		return FALSE;
 	}
 	ignored = chmod (CONFFILE, 0644);
 
 	nm_log_dbg (LOGD_DNS, "dnsmasq local caching DNS configuration:");
-	nm_log_dbg (LOGD_DNS, "%s", conf->str);
-
-	argv[idx++] = find_dnsmasq ();
-	argv[idx++] = "--no-resolv";  /* Use only commandline */
-	argv[idx++] = "--keep-in-foreground";
-	argv[idx++] = "--no-hosts"; /* don't use /etc/hosts to resolve */
-	argv[idx++] = "--bind-interfaces";
-	argv[idx++] = "--pid-file=" PIDFILE;
-	argv[idx++] = "--listen-address=127.0.0.1"; /* Should work for both 4 and 6 */
-	argv[idx++] = "--conf-file=" CONFFILE;
-	argv[idx++] = "--cache-size=400";
-	argv[idx++] = "--proxy-dnssec"; /* Allow DNSSEC to pass through */
-
-	/* dnsmasq exits if the conf dir is not present */
-	if (g_file_test (CONFDIR, G_FILE_TEST_IS_DIR))
-		argv[idx++] = "--conf-dir=" CONFDIR;
-
-	argv[idx++] = NULL;
-	g_warn_if_fail (idx <= G_N_ELEMENTS (argv));
-
-	/* And finally spawn dnsmasq */
-	pid = nm_dns_plugin_child_spawn (NM_DNS_PLUGIN (self), argv, PIDFILE, "bin/dnsmasq");
+	nm_log_dbg (LOGD_DNS, "%s", conf);
+
+	if (priv->servers)
+		g_ptr_array_unref (priv->servers);
+	priv->servers = servers;
+	g_free (priv->conf);
+	priv->conf = conf;
+
+	/* A running dnsmasq is told about the new servers instead of being
+	 * restarted, which would throw away its cache and briefly let queries
+	 * go straight to the upstream servers.  If it hasn't claimed its bus
+	 * name yet, the servers are pushed when it does.
+	 */
+	if (running && !priv->cache_size_changed && !priv->no_dbus) {
+		request_stats (self);
+		push_servers (self);
+		return TRUE;
+	}
 
-out:
-	g_string_free (conf, TRUE);
-	return pid ? TRUE : FALSE;
+	nm_dns_plugin_child_kill (plugin);
+	return spawn_dnsmasq (self) ? TRUE : FALSE;
 }
 
 /****************************************************************/
@@ -353,10 +810,34 @@ dm_exit_code_to_msg (int status)
 	return "Unknown error";
 }
 
+/* Whether "dnsmasq --version" lists "no-DBus" among its compile time
+ * options.  Only asked once dnsmasq has failed, so blocking is fine.
+ */
+static gboolean
+dnsmasq_lacks_dbus (void)
+{
+	const char *argv[] = { find_dnsmasq (), "--version", NULL };
+	char *output = NULL;
+	int status = -1;
+	gboolean lacks = FALSE;
+
+	if (!argv[0])
+		return FALSE;
+
+	if (g_spawn_sync ("/", (char **) argv, NULL, G_SPAWN_STDERR_TO_DEV_NULL,
+	                  NULL, NULL, &output, NULL, &status, NULL)) {
+		if (WIFEXITED (status) && WEXITSTATUS (status) == 0 && output)
+			lacks = (strstr (output, "no-DBus") != NULL);
+	}
+	g_free (output);
+	return lacks;
+}
+
 static void
 child_quit (NMDnsPlugin *plugin, gint status)
 {
 	NMDnsDnsmasq *self = NM_DNS_DNSMASQ (plugin);
+	NMDnsDnsmasqPrivate *priv = NM_DNS_DNSMASQ_GET_PRIVATE (self);
 	gboolean failed = TRUE;
 	int err;
 
@@ -375,6 +856,32 @@ child_quit (NMDnsPlugin *plugin, gint status)
 	} else {
 		nm_log_warn (LOGD_DNS, "dnsmasq died from an unknown cause");
 	}
+
+	/* A dnsmasq built without D-Bus support refuses --enable-dbus as a
+	 * configuration problem; try once more without it.  Other configuration
+	 * problems are reported as they are.
+	 */
+	if (   WIFEXITED (status)
+	    && WEXITSTATUS (status) == 1
+	    && !priv->no_dbus
+	    && !priv->on_bus
+	    && priv->conf
+	    && dnsmasq_lacks_dbus ()) {
+		nm_log_info (LOGD_DNS, "retrying dnsmasq without D-Bus support");
+		priv->no_dbus = TRUE;
+		if (spawn_dnsmasq (self))
+			return;
+	}
+
+	priv->on_bus = FALSE;
+	if (priv->claim_id) {
+		g_source_remove (priv->claim_id);
+		priv->claim_id = 0;
+	}
+	g_free (priv->conf);
+	priv->conf = NULL;
+	g_free (priv->pushed);
+	priv->pushed = NULL;
 	unlink (CONFFILE);
 
 	if (failed)
@@ -403,6 +910,27 @@ get_name (NMDnsPlugin *plugin)
 
 /****************************************************************/
 
+/**
+ * nm_dns_dnsmasq_set_cache_size:
+ * @self: the dnsmasq plugin
+ * @cache_size: number of names dnsmasq caches; 0 disables caching
+ *
+ * A running dnsmasq is restarted with the new size on the next DNS update.
+ **/
+void
+nm_dns_dnsmasq_set_cache_size (NMDnsDnsmasq *self, guint cache_size)
+{
+	NMDnsDnsmasqPrivate *priv;
+
+	g_return_if_fail (NM_IS_DNS_DNSMASQ (self));
+
+	priv = NM_DNS_DNSMASQ_GET_PRIVATE (self);
+	if (priv->cache_size != cache_size) {
+		priv->cache_size = cache_size;
+		priv->cache_size_changed = TRUE;
+	}
+}
+
 NMDnsDnsmasq *
 nm_dns_dnsmasq_new (void)
 {
@@ -412,13 +940,57 @@ nm_dns_dnsmasq_new (void)
 static void
 nm_dns_dnsmasq_init (NMDnsDnsmasq *self)
 {
+	NMDnsDnsmasqPrivate *priv = NM_DNS_DNSMASQ_GET_PRIVATE (self);
+
+	priv->cache_size = NM_DNS_DNSMASQ_DEFAULT_CACHE_SIZE;
+	priv->stats_fd = -1;
+
+	priv->dbus_mgr = nm_dbus_manager_get ();
+	priv->name_owner_id = g_signal_connect (priv->dbus_mgr,
+	                                        NM_DBUS_MANAGER_NAME_OWNER_CHANGED,
+	                                        G_CALLBACK (name_owner_changed),
+	                                        self);
+	priv->proxy = dbus_g_proxy_new_for_name (nm_dbus_manager_get_connection (priv->dbus_mgr),
+	                                         DNSMASQ_DBUS_SERVICE,
+	                                         DNSMASQ_DBUS_PATH,
+	                                         DNSMASQ_DBUS_INTERFACE);
 }
 
 static void
 dispose (GObject *object)
 {
+	NMDnsDnsmasqPrivate *priv = NM_DNS_DNSMASQ_GET_PRIVATE (object);
+
 	unlink (CONFFILE);
 
+	stats_done (NM_DNS_DNSMASQ (object));
+
+	if (priv->claim_id) {
+		g_source_remove (priv->claim_id);
+		priv->claim_id = 0;
+	}
+
+	if (priv->dbus_mgr) {
+		if (priv->call)
+			dbus_g_proxy_cancel_call (priv->proxy, priv->call);
+		priv->call = NULL;
+		g_object_unref (priv->proxy);
+		priv->proxy = NULL;
+
+		g_signal_handler_disconnect (priv->dbus_mgr, priv->name_owner_id);
+		g_object_unref (priv->dbus_mgr);
+		priv->dbus_mgr = NULL;
+	}
+
+	if (priv->servers) {
+		g_ptr_array_unref (priv->servers);
+		priv->servers = NULL;
+	}
+	g_free (priv->conf);
+	priv->conf = NULL;
+	g_free (priv->pushed);
+	priv->pushed = NULL;
+
 	G_OBJECT_CLASS (nm_dns_dnsmasq_parent_class)->dispose (object);
 }
 
@@ -437,5 +1009,13 @@ nm_dns_dnsmasq_class_init (NMDnsDnsmasqClass *dns_class)
 	plugin_class->is_caching = is_caching;
 	plugin_class->update = update;
 	plugin_class->get_name = get_name;
-}
 
+	/* signals */
+	signals[CACHE_STATS_CHANGED] =
+		g_signal_new (NM_DNS_DNSMASQ_CACHE_STATS_CHANGED,
+					  G_OBJECT_CLASS_TYPE (object_class),
+					  G_SIGNAL_RUN_FIRST,
+					  0, NULL, NULL,
+					  g_cclosure_marshal_VOID__VOID,
+					  G_TYPE_NONE, 0);
+}
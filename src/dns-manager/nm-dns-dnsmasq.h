@@ -31,6 +31,8 @@
 #define NM_IS_DNS_DNSMASQ_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), NM_TYPE_DNS_DNSMASQ))
 #define NM_DNS_DNSMASQ_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), NM_TYPE_DNS_DNSMASQ, NMDnsDnsmasqClass))
 
+#define NM_DNS_DNSMASQ_DEFAULT_CACHE_SIZE 400
+
 typedef struct {
 	NMDnsPlugin parent;
 } NMDnsDnsmasq;
@@ -39,9 +41,24 @@ typedef struct {
 	NMDnsPluginClass parent;
 } NMDnsDnsmasqClass;
 
+/* Emitted when dnsmasq reported new cache counters */
+#define NM_DNS_DNSMASQ_CACHE_STATS_CHANGED "cache-stats-changed"
+
 GType nm_dns_dnsmasq_get_type (void);
 
 NMDnsDnsmasq *nm_dns_dnsmasq_new (void);
 
+void nm_dns_dnsmasq_set_cache_size (NMDnsDnsmasq *self, guint cache_size);
+
+typedef struct {
+	guint32 cache_size;
+	guint32 hits;
+	guint32 misses;
+	guint32 evictions;
+} NMDnsDnsmasqCacheStats;
+
+gboolean nm_dns_dnsmasq_get_cache_stats (NMDnsDnsmasq *self,
+                                         NMDnsDnsmasqCacheStats *stats);
+
 #endif /* NM_DNS_DNSMASQ_H */
 
@@ -56,6 +56,13 @@ G_DEFINE_TYPE(NMDnsManager, nm_dns_manager, G_TYPE_OBJECT)
                                        NM_TYPE_DNS_MANAGER, \
                                        NMDnsManagerPrivate))
 
+enum {
+	PROP_0,
+	PROP_CACHE_STATS,
+
+	LAST_PROP
+};
+
 #define HASH_LEN 20
 
 typedef struct {
@@ -70,7 +77,18 @@ typedef struct {
 	guint updates_queue;
 
 	guint8 hash[HASH_LEN];  /* SHA1 hash of current DNS config */
-	guint8 prev_hash[HASH_LEN];  /* Hash when begin_updates() was called */
+
+	/* Changes are collected for update_window milliseconds and then
+	 * committed with a single update_dns().
+	 */
+	guint update_window;
+	guint update_id;
+	guint pending;          /* changes since the last commit */
+	guint coalesced;        /* changes that didn't need an update of their own */
+
+	char *last_contents;    /* what was last handed to resolv.conf/resolvconf/netconfig */
+	guint8 plugin_hash[HASH_LEN];  /* plugin input of the last successful plugin update */
+	gboolean plugins_caching;
 
 	GSList *plugins;
 
@@ -331,41 +349,27 @@ dispatch_netconfig (const char *domain,
 #endif
 
 
-static gboolean
-write_resolv_conf (FILE *f, const char *domain,
-                   char **searches,
-                   char **nameservers,
-                   GError **error)
+static char *
+render_resolv_conf (const char *domain,
+                    char **searches,
+                    char **nameservers)
 {
-	char *domain_str = NULL;
-	char *searches_str = NULL;
-	char *nameservers_str = NULL;
 	int i;
-	gboolean retval = FALSE;
 	GString *str;
 
-	if (fprintf (f, "%s","# Generated by NetworkManager\n") < 0) {
-		g_set_error (error,
-		             NM_DNS_MANAGER_ERROR,
-		             NM_DNS_MANAGER_ERROR_SYSTEM,
-		             "Could not write " RESOLV_CONF ": %s\n",
-		             g_strerror (errno));
-		return FALSE;
-	}
+	str = g_string_new ("# Generated by NetworkManager\n");
 
 	if (domain)
-		domain_str = g_strconcat ("domain ", domain, "\n", NULL);
+		g_string_append_printf (str, "domain %s\n", domain);
 
 	if (searches) {
 		char *tmp_str;
 
 		tmp_str = g_strjoinv (" ", searches);
-		searches_str = g_strconcat ("search ", tmp_str, "\n", NULL);
+		g_string_append_printf (str, "search %s\n", tmp_str);
 		g_free (tmp_str);
 	}
 
-	str = g_string_new ("");
-
 	if (nameservers) {
 		int num = g_strv_length (nameservers);
 
@@ -384,19 +388,21 @@ write_resolv_conf (FILE *f, const char *domain,
 		}
 	}
 
-	nameservers_str = g_string_free (str, FALSE);
-
-	if (fprintf (f, "%s%s%s",
-	             domain_str ? domain_str : "",
-	             searches_str ? searches_str : "",
-	             strlen (nameservers_str) ? nameservers_str : "") != -1)
-		retval = TRUE;
-
-	g_free (domain_str);
-	g_free (searches_str);
-	g_free (nameservers_str);
+	return g_string_free (str, FALSE);
+}
 
-	return retval;
+static gboolean
+write_resolv_conf (FILE *f, const char *contents, GError **error)
+{
+	if (fputs (contents, f) < 0) {
+		g_set_error (error,
+		             NM_DNS_MANAGER_ERROR,
+		             NM_DNS_MANAGER_ERROR_SYSTEM,
+		             "Could not write " RESOLV_CONF ": %s\n",
+		             g_strerror (errno));
+		return FALSE;
+	}
+	return TRUE;
 }
 
 #ifdef RESOLVCONF_PATH
@@ -404,6 +410,7 @@ static gboolean
 dispatch_resolvconf (const char *domain,
                      char **searches,
                      char **nameservers,
+                     const char *contents,
                      const char *iface,
                      GError **error)
 {
@@ -425,7 +432,7 @@ dispatch_resolvconf (const char *domain,
 			             RESOLVCONF_PATH,
 			             g_strerror (errno));
 		else {
-			retval = write_resolv_conf (f, domain, searches, nameservers, error);
+			retval = write_resolv_conf (f, contents, error);
 			retval &= (pclose (f) == 0);
 		}
 	} else {
@@ -442,9 +449,7 @@ dispatch_resolvconf (const char *domain,
 #endif
 
 static gboolean
-update_resolv_conf (const char *domain,
-                    char **searches,
-                    char **nameservers,
+update_resolv_conf (const char *contents,
                     const char *iface,
                     GError **error)
 {
@@ -492,7 +497,7 @@ update_resolv_conf (const char *domain,
 		strcpy (tmp_resolv_conf_realpath, RESOLV_CONF);
 	}
 
-	write_resolv_conf (f, domain, searches, nameservers, error);
+	write_resolv_conf (f, contents, error);
 
 	if (fclose (f) < 0) {
 		if (*error == NULL) {
@@ -538,22 +543,32 @@ compute_hash (NMDnsManager *self, guint8 buffer[HASH_LEN])
 	sum = g_checksum_new (G_CHECKSUM_SHA1);
 	g_assert (len == g_checksum_type_get_length (G_CHECKSUM_SHA1));
 
-	if (priv->ip4_vpn_config)
+	/* The role of a config matters to the plugins, so mark each one */
+	if (priv->ip4_vpn_config) {
+		g_checksum_update (sum, (const guchar *) "v4", 2);
 		nm_ip4_config_hash (priv->ip4_vpn_config, sum, TRUE);
-	if (priv->ip4_device_config)
+	}
+	if (priv->ip4_device_config) {
+		g_checksum_update (sum, (const guchar *) "d4", 2);
 		nm_ip4_config_hash (priv->ip4_device_config, sum, TRUE);
+	}
 
-	if (priv->ip6_vpn_config)
+	if (priv->ip6_vpn_config) {
+		g_checksum_update (sum, (const guchar *) "v6", 2);
 		nm_ip6_config_hash (priv->ip6_vpn_config, sum, TRUE);
-	if (priv->ip6_device_config)
+	}
+	if (priv->ip6_device_config) {
+		g_checksum_update (sum, (const guchar *) "d6", 2);
 		nm_ip6_config_hash (priv->ip6_device_config, sum, TRUE);
+	}
 
 	/* add any other configs we know about */
+	g_checksum_update (sum, (const guchar *) "o", 1);
 	for (iter = priv->configs; iter; iter = g_slist_next (iter)) {
 		if (   (iter->data == priv->ip4_vpn_config)
-		    && (iter->data == priv->ip4_device_config)
-		    && (iter->data == priv->ip6_vpn_config)
-		    && (iter->data == priv->ip6_device_config))
+		    || (iter->data == priv->ip4_device_config)
+		    || (iter->data == priv->ip6_vpn_config)
+		    || (iter->data == priv->ip6_device_config))
 			continue;
 
 		if (NM_IS_IP4_CONFIG (iter->data))
@@ -562,7 +577,11 @@ compute_hash (NMDnsManager *self, guint8 buffer[HASH_LEN])
 			nm_ip6_config_hash (NM_IP6_CONFIG (iter->data), sum, TRUE);
 	}
 
-	memset (buffer, 0, sizeof (buffer));
+	/* The domain of the hostname ends up in the searches */
+	if (priv->hostname)
+		g_checksum_update (sum, (const guchar *) priv->hostname, strlen (priv->hostname) + 1);
+
+	memset (buffer, 0, HASH_LEN);
 	g_checksum_get_digest (sum, buffer, &len);
 	g_checksum_free (sum);
 }
@@ -581,6 +600,11 @@ update_dns (NMDnsManager *self,
 	char **searches = NULL;
 	char **nameservers = NULL;
 	char **nis_servers = NULL;
+	char *contents;
+	GString *snapshot;
+	GChecksum *sum;
+	guint8 plugin_hash[HASH_LEN];
+	gsize hash_len = HASH_LEN;
 	int num, i, len;
 	gboolean success = FALSE, caching = FALSE;
 
@@ -702,7 +726,26 @@ update_dns (NMDnsManager *self,
 			other_configs = g_slist_append (other_configs, iter->data);
 	}
 
+	/* Plugins see the raw configs, the interface and whether caching is
+	 * allowed; if none of that changed since their last successful update
+	 * there's no point in reloading them.
+	 */
+	sum = g_checksum_new (G_CHECKSUM_SHA1);
+	g_checksum_update (sum, priv->hash, HASH_LEN);
+	if (iface)
+		g_checksum_update (sum, (const guchar *) iface, strlen (iface));
+	g_checksum_update (sum, (const guchar *) (no_caching ? "n" : "c"), 1);
+	g_checksum_get_digest (sum, plugin_hash, &hash_len);
+	g_checksum_free (sum);
+
+	if (priv->plugins && !memcmp (plugin_hash, priv->plugin_hash, HASH_LEN)) {
+		nm_log_dbg (LOGD_DNS, "DNS: plugin configuration unchanged");
+		caching = priv->plugins_caching;
+		goto plugins_done;
+	}
+
 	/* Let any plugins do their thing first */
+	success = TRUE;
 	for (iter = priv->plugins; iter; iter = g_slist_next (iter)) {
 		NMDnsPlugin *plugin = NM_DNS_PLUGIN (iter->data);
 		const char *plugin_name = nm_dns_plugin_get_name (plugin);
@@ -729,8 +772,19 @@ update_dns (NMDnsManager *self,
 			 * caching DNS configuration to resolv.conf.
 			 */
 			caching = FALSE;
+			success = FALSE;
 		}
 	}
+
+	/* Failed plugins are retried on the next update */
+	if (success)
+		memcpy (priv->plugin_hash, plugin_hash, HASH_LEN);
+	else
+		memset (priv->plugin_hash, 0, HASH_LEN);
+	priv->plugins_caching = caching;
+	success = FALSE;
+
+plugins_done:
 	g_slist_free (vpn_configs);
 	g_slist_free (dev_configs);
 	g_slist_free (other_configs);
@@ -746,8 +800,27 @@ update_dns (NMDnsManager *self,
 		nameservers[0] = g_strdup ("127.0.0.1");
 	}
 
+	contents = render_resolv_conf (domain, searches, nameservers);
+
+	/* Skip the rewrite (and the resolvconf/netconfig spawn) when the output
+	 * would be byte-identical to what was written last time.
+	 */
+	snapshot = g_string_new (contents);
+#ifdef NETCONFIG_PATH
+	/* netconfig is also told the interface and NIS data */
+	g_string_append_printf (snapshot, "\n%s\n%s\n", iface ? iface : "", nis_domain ? nis_domain : "");
+	for (i = 0; nis_servers && nis_servers[i]; i++)
+		g_string_append_printf (snapshot, "%s ", nis_servers[i]);
+#endif
+
+	if (priv->last_contents && !strcmp (snapshot->str, priv->last_contents)) {
+		nm_log_dbg (LOGD_DNS, "DNS: resolv.conf unchanged; not rewriting it");
+		success = TRUE;
+		goto done;
+	}
+
 #ifdef RESOLVCONF_PATH
-	success = dispatch_resolvconf (domain, searches, nameservers, iface, error);
+	success = dispatch_resolvconf (domain, searches, nameservers, contents, iface, error);
 #endif
 
 #ifdef NETCONFIG_PATH
@@ -759,8 +832,14 @@ update_dns (NMDnsManager *self,
 #endif
 
 	if (success == FALSE)
-		success = update_resolv_conf (domain, searches, nameservers, iface, error);
+		success = update_resolv_conf (contents, iface, error);
 
+	g_free (priv->last_contents);
+	priv->last_contents = success ? g_strdup (snapshot->str) : NULL;
+
+done:
+	g_string_free (snapshot, TRUE);
+	g_free (contents);
 	if (searches)
 		g_strfreev (searches);
 	if (nameservers)
@@ -791,6 +870,87 @@ plugin_failed (NMDnsPlugin *plugin, gpointer user_data)
 	}
 }
 
+static void
+commit_updates (NMDnsManager *self)
+{
+	NMDnsManagerPrivate *priv = NM_DNS_MANAGER_GET_PRIVATE (self);
+	GError *error = NULL;
+	static const guint8 failed[HASH_LEN] = { 0 };
+	guint8 new[HASH_LEN];
+	guint pending = priv->pending;
+
+	if (priv->update_id) {
+		g_source_remove (priv->update_id);
+		priv->update_id = 0;
+	}
+	priv->pending = 0;
+
+	/* Changes that cancel each other out don't need any work at all,
+	 * unless the last update failed somewhere and should be retried.
+	 */
+	compute_hash (self, new);
+	if (   !memcmp (new, priv->hash, HASH_LEN)
+	    && priv->last_contents
+	    && memcmp (priv->plugin_hash, failed, HASH_LEN)) {
+		priv->coalesced += pending;
+		nm_log_dbg (LOGD_DNS, "DNS configuration did not change (%u changes dropped)", pending);
+		return;
+	}
+
+	if (pending > 1) {
+		priv->coalesced += pending - 1;
+		nm_log_dbg (LOGD_DNS, "DNS: committing %u changes in one update (%u coalesced so far)",
+		            pending, priv->coalesced);
+	}
+
+	if (!update_dns (self, priv->last_iface, FALSE, &error)) {
+		nm_log_warn (LOGD_DNS, "could not commit DNS changes: (%d) %s",
+		             error ? error->code : -1,
+		             error && error->message ? error->message : "(unknown)");
+		g_clear_error (&error);
+	}
+}
+
+static gboolean
+update_window_cb (gpointer user_data)
+{
+	NMDnsManager *self = NM_DNS_MANAGER (user_data);
+
+	NM_DNS_MANAGER_GET_PRIVATE (self)->update_id = 0;
+	commit_updates (self);
+	return FALSE;
+}
+
+static void
+schedule_commit (NMDnsManager *self)
+{
+	NMDnsManagerPrivate *priv = NM_DNS_MANAGER_GET_PRIVATE (self);
+
+	if (priv->update_window == 0)
+		commit_updates (self);
+	else if (priv->update_id == 0)
+		priv->update_id = g_timeout_add (priv->update_window, update_window_cb, self);
+}
+
+static void
+request_update (NMDnsManager *self, const char *iface)
+{
+	NMDnsManagerPrivate *priv = NM_DNS_MANAGER_GET_PRIVATE (self);
+
+	if (iface && g_strcmp0 (iface, priv->last_iface)) {
+		g_free (priv->last_iface);
+		priv->last_iface = g_strdup (iface);
+	}
+
+	priv->pending++;
+
+	/* nm_dns_manager_end_updates() takes care of it */
+	if (priv->updates_queue)
+		return;
+
+	schedule_commit (self);
+}
+
 gboolean
 nm_dns_manager_add_ip4_config (NMDnsManager *mgr,
                                const char *iface,
@@ -798,7 +958,6 @@ nm_dns_manager_add_ip4_config (NMDnsManager *mgr,
                                NMDnsIPConfigType cfg_type)
 {
 	NMDnsManagerPrivate *priv;
-	GError *error = NULL;
 
 	g_return_val_if_fail (mgr != NULL, FALSE);
 	g_return_val_if_fail (iface != NULL, FALSE);
@@ -821,12 +980,7 @@ nm_dns_manager_add_ip4_config (NMDnsManager *mgr,
 	if (!g_slist_find (priv->configs, config))
 		priv->configs = g_slist_append (priv->configs, g_object_ref (config));
 
-	if (!priv->updates_queue && !update_dns (mgr, iface, FALSE, &error)) {
-		nm_log_warn (LOGD_DNS, "could not commit DNS changes: (%d) %s",
-		             error ? error->code : -1,
-		             error && error->message ? error->message : "(unknown)");
-		g_clear_error (&error);
-	}
+	request_update (mgr, iface);
 
 	return TRUE;
 }
@@ -837,7 +991,6 @@ nm_dns_manager_remove_ip4_config (NMDnsManager *mgr,
                                   NMIP4Config *config)
 {
 	NMDnsManagerPrivate *priv;
-	GError *error = NULL;
 
 	g_return_val_if_fail (mgr != NULL, FALSE);
 	g_return_val_if_fail (iface != NULL, FALSE);
@@ -858,12 +1011,7 @@ nm_dns_manager_remove_ip4_config (NMDnsManager *mgr,
 
 	g_object_unref (config);
 
-	if (!priv->updates_queue && !update_dns (mgr, iface, FALSE, &error)) {
-		nm_log_warn (LOGD_DNS, "could not commit DNS changes: (%d) %s",
-		             error ? error->code : -1,
-		             error && error->message ? error->message : "(unknown)");
-		g_clear_error (&error);
-	}
+	request_update (mgr, iface);
 
 	return TRUE;
 }
@@ -875,7 +1023,6 @@ nm_dns_manager_add_ip6_config (NMDnsManager *mgr,
                                NMDnsIPConfigType cfg_type)
 {
 	NMDnsManagerPrivate *priv;
-	GError *error = NULL;
 
 	g_return_val_if_fail (mgr != NULL, FALSE);
 	g_return_val_if_fail (iface != NULL, FALSE);
@@ -898,12 +1045,7 @@ nm_dns_manager_add_ip6_config (NMDnsManager *mgr,
 	if (!g_slist_find (priv->configs, config))
 		priv->configs = g_slist_append (priv->configs, g_object_ref (config));
 
-	if (!priv->updates_queue && !update_dns (mgr, iface, FALSE, &error)) {
-		nm_log_warn (LOGD_DNS, "could not commit DNS changes: (%d) %s",
-		             error ? error->code : -1,
-		             error && error->message ? error->message : "(unknown)");
-		g_clear_error (&error);
-	}
+	request_update (mgr, iface);
 
 	return TRUE;
 }
@@ -914,7 +1056,6 @@ nm_dns_manager_remove_ip6_config (NMDnsManager *mgr,
                                   NMIP6Config *config)
 {
 	NMDnsManagerPrivate *priv;
-	GError *error = NULL;
 
 	g_return_val_if_fail (mgr != NULL, FALSE);
 	g_return_val_if_fail (iface != NULL, FALSE);
@@ -935,12 +1076,7 @@ nm_dns_manager_remove_ip6_config (NMDnsManager *mgr,
 
 	g_object_unref (config);	
 
-	if (!priv->updates_queue && !update_dns (mgr, iface, FALSE, &error)) {
-		nm_log_warn (LOGD_DNS, "could not commit DNS changes: (%d) %s",
-		             error ? error->code : -1,
-		             error && error->message ? error->message : "(unknown)");
-		g_clear_error (&error);
-	}
+	request_update (mgr, iface);
 
 	return TRUE;
 }
@@ -950,7 +1086,6 @@ nm_dns_manager_set_hostname (NMDnsManager *mgr,
                                const char *hostname)
 {
 	NMDnsManagerPrivate *priv = NM_DNS_MANAGER_GET_PRIVATE (mgr);
-	GError *error = NULL;
 	const char *filtered = NULL;
 
 	/* Certain hostnames we don't want to include in resolv.conf 'searches' */
@@ -973,12 +1108,7 @@ nm_dns_manager_set_hostname (NMDnsManager *mgr,
 	 * wants one.  But hostname changes are system-wide and *not* tied to a
 	 * specific interface, so netconfig can't really handle this.  Fake it.
 	 */
-	if (!priv->updates_queue && !update_dns (mgr, priv->last_iface, FALSE, &error)) {
-		nm_log_warn (LOGD_DNS, "could not commit DNS changes: (%d) %s",
-		             error ? error->code : -1,
-		             error && error->message ? error->message : "(unknown)");
-		g_clear_error (&error);
-	}
+	request_update (mgr, NULL);
 }
 
 void
@@ -989,10 +1119,6 @@ nm_dns_manager_begin_updates (NMDnsManager *mgr, const char *func)
 	g_return_if_fail (mgr != NULL);
 	priv = NM_DNS_MANAGER_GET_PRIVATE (mgr);
 
-	/* Save current hash when starting a new batch */
-	if (priv->updates_queue == 0)
-		memcpy (priv->prev_hash, priv->hash, sizeof (priv->hash));
-
 	priv->updates_queue++;
 
 	nm_log_dbg (LOGD_DNS, "(%s): queueing DNS updates (%d)", func, priv->updates_queue);
@@ -1002,35 +1128,75 @@ void
 nm_dns_manager_end_updates (NMDnsManager *mgr, const char *func)
 {
 	NMDnsManagerPrivate *priv;
-	GError *error = NULL;
-	gboolean changed;
-	guint8 new[HASH_LEN];
 
 	g_return_if_fail (mgr != NULL);
 
 	priv = NM_DNS_MANAGER_GET_PRIVATE (mgr);
 	g_return_if_fail (priv->updates_queue > 0);
 
-	compute_hash (mgr, new);
-	changed = (memcmp (new, priv->prev_hash, sizeof (new)) != 0) ? TRUE : FALSE;
-	nm_log_dbg (LOGD_DNS, "(%s): DNS configuration %s", __func__, changed ? "changed" : "did not change");
-
 	priv->updates_queue--;
-	if ((priv->updates_queue > 0) || (changed == FALSE)) {
+	if ((priv->updates_queue > 0) || (priv->pending == 0)) {
 		nm_log_dbg (LOGD_DNS, "(%s): no DNS changes to commit (%d)", func, priv->updates_queue);
 		return;
 	}
 
 	/* Commit all the outstanding changes */
-	nm_log_dbg (LOGD_DNS, "(%s): committing DNS changes (%d)", func, priv->updates_queue);
-	if (!update_dns (mgr, priv->last_iface, FALSE, &error)) {
-		nm_log_warn (LOGD_DNS, "could not commit DNS changes: (%d) %s",
-			         error ? error->code : -1,
-			         error && error->message ? error->message : "(unknown)");
-		g_clear_error (&error);
-	}
+	nm_log_dbg (LOGD_DNS, "(%s): committing %u DNS changes", func, priv->pending);
+	schedule_commit (mgr);
+}
+
+/**
+ * nm_dns_manager_set_update_window:
+ * @mgr: the DNS manager
+ * @window: time in milliseconds
+ *
+ * Sets how long DNS changes are collected before they are committed
+ * together; 0 commits every change immediately.
+ **/
+void
+nm_dns_manager_set_update_window (NMDnsManager *mgr, guint window)
+{
+	g_return_if_fail (NM_IS_DNS_MANAGER (mgr));
+
+	NM_DNS_MANAGER_GET_PRIVATE (mgr)->update_window = window;
+}
 
-	memset (priv->prev_hash, 0, sizeof (priv->prev_hash));
+/**
+ * nm_dns_manager_flush_updates:
+ * @mgr: the DNS manager
+ *
+ * Commits changes that are waiting for the update window to pass, so that
+ * resolv.conf is current before, eg, dispatcher scripts run.  Changes held
+ * back by nm_dns_manager_begin_updates() stay queued.
+ **/
+void
+nm_dns_manager_flush_updates (NMDnsManager *mgr)
+{
+	g_return_if_fail (NM_IS_DNS_MANAGER (mgr));
+
+	if (NM_DNS_MANAGER_GET_PRIVATE (mgr)->update_id)
+		commit_updates (mgr);
+}
+
+/**
+ * nm_dns_manager_get_coalesced_updates:
+ * @mgr: the DNS manager
+ *
+ * Returns: the number of DNS changes so far that were folded into another
+ * change's update, or that turned out not to change anything
+ **/
+guint
+nm_dns_manager_get_coalesced_updates (NMDnsManager *mgr)
+{
+	g_return_val_if_fail (NM_IS_DNS_MANAGER (mgr), 0);
+
+	return NM_DNS_MANAGER_GET_PRIVATE (mgr)->coalesced;
+}
+
+static void
+cache_stats_changed (NMDnsDnsmasq *plugin, gpointer user_data)
+{
+	g_object_notify (G_OBJECT (user_data), NM_DNS_MANAGER_CACHE_STATS);
 }
 
 static void
@@ -1070,12 +1236,37 @@ load_plugins (NMDnsManager *self, const char **plugins)
 			g_signal_connect (plugin, NM_DNS_PLUGIN_FAILED,
 			                  G_CALLBACK (plugin_failed),
 			                  self);
+			if (NM_IS_DNS_DNSMASQ (plugin)) {
+				g_signal_connect (plugin, NM_DNS_DNSMASQ_CACHE_STATS_CHANGED,
+				                  G_CALLBACK (cache_stats_changed),
+				                  self);
+			}
 		}
 	} else {
 		/* Create default plugins */
 	}
 }
 
+/**
+ * nm_dns_manager_set_cache_size:
+ * @mgr: the DNS manager
+ * @cache_size: number of names the local caching nameserver keeps
+ *
+ * Sets the cache size of the caching DNS plugin, if one is loaded.
+ **/
+void
+nm_dns_manager_set_cache_size (NMDnsManager *mgr, guint cache_size)
+{
+	GSList *iter;
+
+	g_return_if_fail (NM_IS_DNS_MANAGER (mgr));
+
+	for (iter = NM_DNS_MANAGER_GET_PRIVATE (mgr)->plugins; iter; iter = g_slist_next (iter)) {
+		if (NM_IS_DNS_DNSMASQ (iter->data))
+			nm_dns_dnsmasq_set_cache_size (NM_DNS_DNSMASQ (iter->data), cache_size);
+	}
+}
+
 /******************************************************************/
 
 NMDnsManager *
@@ -1106,8 +1297,12 @@ nm_dns_manager_error_quark (void)
 static void
 nm_dns_manager_init (NMDnsManager *self)
 {
+	NMDnsManagerPrivate *priv = NM_DNS_MANAGER_GET_PRIVATE (self);
+
+	priv->update_window = NM_DNS_MANAGER_DEFAULT_UPDATE_WINDOW;
+
 	/* Set the initial hash */
-	compute_hash (self, NM_DNS_MANAGER_GET_PRIVATE (self)->hash);
+	compute_hash (self, priv->hash);
 }
 
 static void
@@ -1120,6 +1315,12 @@ dispose (GObject *object)
 	if (priv->disposed == FALSE) {
 		priv->disposed = TRUE;
 
+		/* The update below includes anything still waiting for the window */
+		if (priv->update_id) {
+			g_source_remove (priv->update_id);
+			priv->update_id = 0;
+		}
+
 		g_slist_foreach (priv->plugins, (GFunc) g_object_unref, NULL);
 		g_slist_free (priv->plugins);
 		priv->plugins = NULL;
@@ -1155,10 +1356,50 @@ finalize (GObject *object)
 
 	g_free (priv->hostname);
 	g_free (priv->last_iface);
+	g_free (priv->last_contents);
 
 	G_OBJECT_CLASS (nm_dns_manager_parent_class)->finalize (object);
 }
 
+/* Counters of the caching plugin, by name; NULL until it reported any */
+static GHashTable *
+get_cache_stats (NMDnsManager *self)
+{
+	NMDnsManagerPrivate *priv = NM_DNS_MANAGER_GET_PRIVATE (self);
+	NMDnsDnsmasqCacheStats stats;
+	GHashTable *hash;
+	GSList *iter;
+
+	for (iter = priv->plugins; iter; iter = g_slist_next (iter)) {
+		if (!NM_IS_DNS_DNSMASQ (iter->data))
+			continue;
+		if (!nm_dns_dnsmasq_get_cache_stats (NM_DNS_DNSMASQ (iter->data), &stats))
+			break;
+
+		hash = g_hash_table_new (g_str_hash, g_str_equal);
+		g_hash_table_insert (hash, "cache-size", GUINT_TO_POINTER (stats.cache_size));
+		g_hash_table_insert (hash, "hits", GUINT_TO_POINTER (stats.hits));
+		g_hash_table_insert (hash, "misses", GUINT_TO_POINTER (stats.misses));
+		g_hash_table_insert (hash, "evictions", GUINT_TO_POINTER (stats.evictions));
+		return hash;
+	}
+	return NULL;
+}
+
+static void
+get_property (GObject *object, guint prop_id,
+              GValue *value, GParamSpec *pspec)
+{
+	switch (prop_id) {
+	case PROP_CACHE_STATS:
+		g_value_take_boxed (value, get_cache_stats (NM_DNS_MANAGER (object)));
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
+}
+
 static void
 nm_dns_manager_class_init (NMDnsManagerClass *klass)
 {
@@ -1166,7 +1407,18 @@ nm_dns_manager_class_init (NMDnsManagerClass *klass)
 
 	object_class->dispose = dispose;
 	object_class->finalize = finalize;
+	object_class->get_property = get_property;
 
 	g_type_class_add_private (object_class, sizeof (NMDnsManagerPrivate));
+
+	/* properties */
+	g_object_class_install_property
+		(object_class, PROP_CACHE_STATS,
+		 g_param_spec_boxed (NM_DNS_MANAGER_CACHE_STATS,
+		                     "Cache statistics",
+		                     "Counters of the local caching nameserver "
+		                     "(cache-size, hits, misses, evictions)",
+		                     G_TYPE_HASH_TABLE,
+		                     G_PARAM_READABLE));
 }
 
@@ -54,6 +54,9 @@ G_BEGIN_DECLS
 #define NM_IS_DNS_MANAGER_CLASS(k) (G_TYPE_CHECK_CLASS_TYPE ((k), NM_TYPE_DNS_MANAGER))
 #define NM_DNS_MANAGER_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), NM_TYPE_DNS_MANAGER, NMDnsManagerClass)) 
 
+/* Properties */
+#define NM_DNS_MANAGER_CACHE_STATS "cache-stats"
+
 typedef struct {
 	GObject parent;
 } NMDnsManager;
@@ -66,6 +69,15 @@ GType nm_dns_manager_get_type (void);
 
 NMDnsManager * nm_dns_manager_get (const char **plugins);
 
+void nm_dns_manager_set_cache_size (NMDnsManager *mgr, guint cache_size);
+
+/* Milliseconds DNS changes are collected before being committed together */
+#define NM_DNS_MANAGER_DEFAULT_UPDATE_WINDOW 50
+
+void nm_dns_manager_set_update_window (NMDnsManager *mgr, guint window);
+void nm_dns_manager_flush_updates (NMDnsManager *mgr);
+guint nm_dns_manager_get_coalesced_updates (NMDnsManager *mgr);
+
 /* Allow changes to be batched together */
 void nm_dns_manager_begin_updates (NMDnsManager *mgr, const char *func);
 void nm_dns_manager_end_updates (NMDnsManager *mgr, const char *func);
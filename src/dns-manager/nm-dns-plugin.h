@@ -110,5 +110,8 @@ GPid nm_dns_plugin_child_spawn (NMDnsPlugin *self,
 
 gboolean nm_dns_plugin_child_kill (NMDnsPlugin *self);
 
+/* PID of the running child, or 0 */
+GPid nm_dns_plugin_child_pid (NMDnsPlugin *self);
+
 #endif /* NM_DNS_PLUGIN_H */
 
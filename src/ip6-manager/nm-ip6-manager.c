@@ -31,6 +31,7 @@
 
 #include "nm-ip6-manager.h"
 #include "nm-netlink-monitor.h"
+#include "nm-netlink-index.h"
 #include "nm-netlink-utils.h"
 #include "nm-netlink-compat.h"
 #include "NetworkManagerUtils.h"
@@ -52,7 +53,8 @@ typedef struct {
 	GHashTable *devices;
 
 	struct nl_sock *nlh;
-	struct nl_cache *addr_cache, *route_cache;
+	struct nl_cache *route_cache;
+	NMNetlinkAddrIndex *addr_index;
 
 	guint netlink_id;
 } NMIP6ManagerPrivate;
@@ -124,7 +126,8 @@ typedef struct {
 
 	time_t last_solicitation;
 
-	guint ip6flags_poll_id;
+	guint enable_ip6_id;
+	guint ip6_info_id;
 
 	guint32 ra_flags;
 } NMIP6Device;
@@ -162,8 +165,10 @@ nm_ip6_device_destroy (NMIP6Device *device)
 		g_array_free (device->dnssl_domains, TRUE);
 	if (device->dnssl_timeout_id)
 		g_source_remove (device->dnssl_timeout_id);
-	if (device->ip6flags_poll_id)
-		g_source_remove (device->ip6flags_poll_id);
+	if (device->enable_ip6_id)
+		g_source_remove (device->enable_ip6_id);
+	if (device->ip6_info_id)
+		g_source_remove (device->ip6_info_id);
 
 	g_slice_free (NMIP6Device, device);
 }
@@ -439,12 +444,6 @@ finish_addrconf (gpointer user_data)
 	device->addrconf_complete = TRUE;
 	ifindex = device->ifindex;
 
-	/* We're done, stop polling IPv6 flags */
-	if (device->ip6flags_poll_id) {
-		g_source_remove (device->ip6flags_poll_id);
-		device->ip6flags_poll_id = 0;
-	}
-
 	/* And tell listeners that addrconf is complete */
 	if (info->success) {
 		g_signal_emit (manager, signals[ADDRCONF_COMPLETE], 0,
@@ -668,6 +667,7 @@ check_addresses (NMIP6Device *device)
 {
 	NMIP6Manager *manager = device->manager;
 	NMIP6ManagerPrivate *priv = NM_IP6_MANAGER_GET_PRIVATE (manager);
+	GSList *addrs, *iter;
 	struct rtnl_addr *rtnladdr;
 	struct nl_addr *nladdr;
 	struct in6_addr *addr;
@@ -677,14 +677,11 @@ check_addresses (NMIP6Device *device)
 	device->has_nonlinklocal = FALSE;
 
 	/* Look for any IPv6 addresses the kernel may have set for the device */
-	for (rtnladdr = (struct rtnl_addr *) nl_cache_get_first (priv->addr_cache);
-		 rtnladdr;
-		 rtnladdr = (struct rtnl_addr *) nl_cache_get_next ((struct nl_object *) rtnladdr)) {
+	addrs = nm_netlink_addr_index_get (priv->addr_index, device->ifindex, AF_INET6);
+	for (iter = addrs; iter; iter = g_slist_next (iter)) {
 		char buf[INET6_ADDRSTRLEN];
 
-		if (rtnl_addr_get_ifindex (rtnladdr) != device->ifindex)
-			continue;
-
+		rtnladdr = iter->data;
 		nladdr = rtnl_addr_get_local (rtnladdr);
 		if (!nladdr || nl_addr_get_family (nladdr) != AF_INET6)
 			continue;
@@ -707,6 +704,8 @@ check_addresses (NMIP6Device *device)
 			device->has_nonlinklocal = TRUE;
 		}
 	}
+	g_slist_foreach (addrs, (GFunc) nl_object_put, NULL);
+	g_slist_free (addrs);
 
 	/* There might be a LL address hanging around on the interface from
 	 * before in the initial run, but if it goes away later, make sure we
@@ -855,6 +854,32 @@ dump_route_change (NMIP6Device *device, struct nlmsghdr *hdr, struct rtnl_route
 	nm_log_dbg (LOGD_IP6, "(%s) %s route: %s via %s",device_get_iface (device), event, dst_str, gateway_str);
 }
 
+static gboolean
+request_ip6_info_cb (gpointer user_data)
+{
+	NMIP6Device *device = user_data;
+	NMIP6ManagerPrivate *priv = NM_IP6_MANAGER_GET_PRIVATE (device->manager);
+	GError *error = NULL;
+
+	device->ip6_info_id = 0;
+	if (!nm_netlink_monitor_request_ip6_info (priv->monitor, device->ifindex, &error)) {
+		nm_log_dbg (LOGD_IP6, "(%s): could not request IPv6 flags: %s",
+		            device->iface, error->message);
+		g_error_free (error);
+	}
+	return FALSE;
+}
+
+/* Asks the kernel for the device's IPv6 flags; requests made in the same
+ * main loop iteration share one answer.
+ */
+static void
+request_ip6_info (NMIP6Device *device)
+{
+	if (!device->ip6_info_id)
+		device->ip6_info_id = g_idle_add (request_ip6_info_cb, device);
+}
+
 static NMIP6Device *
 process_address_change (NMIP6Manager *manager, struct nl_msg *msg)
 {
@@ -862,7 +887,7 @@ process_address_change (NMIP6Manager *manager, struct nl_msg *msg)
 	NMIP6Device *device;
 	struct nlmsghdr *hdr;
 	struct rtnl_addr *rtnladdr;
-	int old_size;
+	gboolean changed;
 
 	hdr = nlmsg_hdr (msg);
 	rtnladdr = NULL;
@@ -874,20 +899,29 @@ process_address_change (NMIP6Manager *manager, struct nl_msg *msg)
 
 	device = nm_ip6_manager_get_device (manager, rtnl_addr_get_ifindex (rtnladdr));
 
-	old_size = nl_cache_nitems (priv->addr_cache);
-	nl_cache_include (priv->addr_cache, (struct nl_object *)rtnladdr, NULL, NULL);
-
 	/* The kernel will re-notify us of automatically-added addresses
 	 * every time it gets another router advertisement. We only want
 	 * to notify higher levels if we actually changed something.
 	 */
-	nm_log_dbg (LOGD_IP6, "(%s): address cache size: %d -> %d:",
-		    device_get_iface (device), old_size, nl_cache_nitems (priv->addr_cache));
+	if (hdr->nlmsg_type == RTM_NEWADDR)
+		changed = nm_netlink_addr_index_add (priv->addr_index, rtnladdr);
+	else
+		changed = nm_netlink_addr_index_remove (priv->addr_index, rtnladdr);
+
 	dump_address_change (device, hdr, rtnladdr);
 	rtnl_addr_put (rtnladdr);
-	if (nl_cache_nitems (priv->addr_cache) == old_size)
+	if (!changed)
 		return NULL;
 
+	/* A new address on a device still doing addrconf means an RA arrived;
+	 * older kernels don't announce the RA flags themselves, so ask about
+	 * this interface.
+	 */
+	if (   device
+	    && !device->addrconf_complete
+	    && hdr->nlmsg_type == RTM_NEWADDR)
+		request_ip6_info (device);
+
 	return device;
 }
 
@@ -1261,6 +1295,7 @@ process_nduseropt (NMIP6Manager *manager, struct nl_msg *msg)
 
 static struct nla_policy link_policy[IFLA_MAX + 1] = {
 	[IFLA_PROTINFO] = { .type = NLA_NESTED },
+	[IFLA_AF_SPEC]  = { .type = NLA_NESTED },
 };
 
 static struct nla_policy link_prot_policy[IFLA_INET6_MAX + 1] = {
@@ -1275,7 +1310,8 @@ process_newlink (NMIP6Manager *manager, struct nl_msg *msg)
 	NMIP6Device *device;
 	struct nlattr *tb[IFLA_MAX + 1];
 	struct nlattr *pi[IFLA_INET6_MAX + 1];
-	int err;
+	struct nlattr *inet6 = NULL, *af;
+	int err, rem;
 
 	/* FIXME: we have to do this manually for now since libnl doesn't yet
 	 * support the IFLA_PROTINFO attribute of NEWLINK messages.  When it does,
@@ -1290,8 +1326,20 @@ process_newlink (NMIP6Manager *manager, struct nl_msg *msg)
 		return NULL;
 	}
 
+	/* AF_INET6 link messages carry the IPv6 flags in PROTINFO; generic
+	 * ones, like the answer to request_ip6_info(), in IFLA_AF_SPEC.
+	 */
 	ifi = nlmsg_data (hdr);
-	if (ifi->ifi_family != AF_INET6) {
+	if (ifi->ifi_family == AF_INET6)
+		inet6 = tb[IFLA_PROTINFO];
+	else if (ifi->ifi_family == AF_UNSPEC && tb[IFLA_AF_SPEC]) {
+		nla_for_each_nested (af, tb[IFLA_AF_SPEC], rem) {
+			if (nla_type (af) == AF_INET6)
+				inet6 = af;
+		}
+		if (!inet6)
+			return NULL;
+	} else {
 		nm_log_dbg (LOGD_IP6, "ignoring netlink message family %d", ifi->ifi_family);
 		return NULL;
 	}
@@ -1303,12 +1351,12 @@ process_newlink (NMIP6Manager *manager, struct nl_msg *msg)
 		return NULL;
 	}
 
-	if (!tb[IFLA_PROTINFO]) {
+	if (!inet6) {
 		nm_log_dbg (LOGD_IP6, "(%s): message had no PROTINFO attribute", device->iface);
 		return NULL;
 	}
 
-	err = nla_parse_nested (pi, IFLA_INET6_MAX, tb[IFLA_PROTINFO], link_prot_policy);
+	err = nla_parse_nested (pi, IFLA_INET6_MAX, inet6, link_prot_policy);
 	if (err < 0) {
 		nm_log_dbg (LOGD_IP6, "(%s): error parsing PROTINFO flags", device->iface);
 		return NULL;
@@ -1401,10 +1449,18 @@ nm_ip6_manager_prepare_interface (NMIP6Manager *manager,
 }
 
 static gboolean
-poll_ip6_flags (gpointer user_data)
+enable_ip6 (gpointer user_data)
 {
-	nm_netlink_monitor_request_ip6_info (NM_NETLINK_MONITOR (user_data), NULL);
-	return TRUE;
+	NMIP6Device *device = user_data;
+
+	device->enable_ip6_id = 0;
+	nm_utils_do_sysctl (device->disable_ip6_path, "0");
+
+	/* The deletion of the old addresses has been processed by now, so
+	 * this only sees what the kernel configures from here on.
+	 */
+	nm_ip6_device_sync_from_netlink (device);
+	return FALSE;
 }
 
 void
@@ -1435,20 +1491,24 @@ nm_ip6_manager_begin_addrconf (NMIP6Manager *manager, int ifindex)
 	                                                         info,
 	                                                         (GDestroyNotify) g_free);
 
+	/* Kick off the initial IPv6 flags request; after that, changes to the
+	 * flags arrive as RTNLGRP_IPV6_IFINFO events.
+	 */
+	request_ip6_info (device);
+
 	/* Bounce IPv6 on the interface to ensure the kernel will start looking for
 	 * new RAs; there doesn't seem to be a better way to do this right now.
+	 * IPv6 is turned back on from an idle handler, which only runs once the
+	 * netlink events for the flushed addresses have been dispatched.
 	 */
 	if (device->target_state >= NM_IP6_DEVICE_GOT_ADDRESS) {
 		nm_utils_do_sysctl (device->disable_ip6_path, "1");
-		g_usleep (200);
-		nm_utils_do_sysctl (device->disable_ip6_path, "0");
+		if (device->enable_ip6_id)
+			g_source_remove (device->enable_ip6_id);
+		device->enable_ip6_id = g_idle_add (enable_ip6, device);
+		return;
 	}
 
-	device->ip6flags_poll_id = g_timeout_add_seconds (1, poll_ip6_flags, priv->monitor);
-
-	/* Kick off the initial IPv6 flags request */
-	nm_netlink_monitor_request_ip6_info (priv->monitor, NULL);
-
 	/* Sync flags, etc, from netlink; this will also notice if the
 	 * device is already fully configured and schedule the
 	 * ADDRCONF_COMPLETE signal in that case.
@@ -1466,18 +1526,13 @@ nm_ip6_manager_cancel_addrconf (NMIP6Manager *manager, int ifindex)
 	                     GINT_TO_POINTER (ifindex));
 }
 
-#define FIRST_ROUTE(m) ((struct rtnl_route *) nl_cache_get_first (m))
-#define NEXT_ROUTE(m) ((struct rtnl_route *) nl_cache_get_next ((struct nl_object *) m))
-
-#define FIRST_ADDR(m) ((struct rtnl_addr *) nl_cache_get_first (m))
-#define NEXT_ADDR(m) ((struct rtnl_addr *) nl_cache_get_next ((struct nl_object *) m))
-
 NMIP6Config *
 nm_ip6_manager_get_ip6_config (NMIP6Manager *manager, int ifindex)
 {
 	NMIP6ManagerPrivate *priv;
 	NMIP6Device *device;
 	NMIP6Config *config;
+	GSList *addrs, *routes, *iter;
 	struct rtnl_addr *rtnladdr;
 	struct nl_addr *nladdr;
 	struct in6_addr *addr;
@@ -1508,22 +1563,18 @@ nm_ip6_manager_get_ip6_config (NMIP6Manager *manager, int ifindex)
 		return NULL;
 	}
 
-	/* Make sure we refill the route and address caches, otherwise we won't get
-	 * up-to-date information here since the netlink route/addr change messages
-	 * may be lagging a bit.
+	/* Routes come from the netlink monitor's route index, which reads any
+	 * route events still queued before answering, so no routing table dump
+	 * is needed.  Addresses come from our own index, which is kept current
+	 * by the address events that drive addrconf in the first place.
 	 */
-	nl_cache_refill (priv->nlh, priv->route_cache);
-	nl_cache_refill (priv->nlh, priv->addr_cache);
+	routes = nm_netlink_get_routes (device->ifindex, AF_INET6);
 
 	/* Add routes */
-	for (rtnlroute = FIRST_ROUTE (priv->route_cache); rtnlroute; rtnlroute = NEXT_ROUTE (rtnlroute)) {
-		/* Make sure it's an IPv6 route for this device */
-		if (rtnl_route_get_oif (rtnlroute) != device->ifindex)
-			continue;
-		if (rtnl_route_get_family (rtnlroute) != AF_INET6)
-			continue;
+	for (iter = routes; iter; iter = g_slist_next (iter)) {
+		rtnlroute = iter->data;
 
-		/* And ignore cache/cloned routes as they aren't part of the interface's
+		/* Ignore cache/cloned routes as they aren't part of the interface's
 		 * permanent routing configuration.
 		 */
 		if (rtnl_route_get_flags (rtnlroute) & RTM_F_CLONED)
@@ -1562,12 +1613,13 @@ nm_ip6_manager_get_ip6_config (NMIP6Manager *manager, int ifindex)
 			nm_ip6_route_set_metric (ip6route, metric);
 		nm_ip6_config_take_route (config, ip6route);
 	}
+	g_slist_foreach (routes, (GFunc) nl_object_put, NULL);
+	g_slist_free (routes);
 
 	/* Add addresses */
-	for (rtnladdr = FIRST_ADDR (priv->addr_cache); rtnladdr; rtnladdr = NEXT_ADDR (rtnladdr)) {
-		if (rtnl_addr_get_ifindex (rtnladdr) != device->ifindex)
-			continue;
-
+	addrs = nm_netlink_addr_index_get (priv->addr_index, device->ifindex, AF_INET6);
+	for (iter = addrs; iter; iter = g_slist_next (iter)) {
+		rtnladdr = iter->data;
 		nladdr = rtnl_addr_get_local (rtnladdr);
 		if (!nladdr || nl_addr_get_family (nladdr) != AF_INET6)
 			continue;
@@ -1581,6 +1633,8 @@ nm_ip6_manager_get_ip6_config (NMIP6Manager *manager, int ifindex)
 		if (gateway)
 			nm_ip6_address_set_gateway (ip6addr, gateway);
 	}
+	g_slist_foreach (addrs, (GFunc) nl_object_put, NULL);
+	g_slist_free (addrs);
 
 	/* Add DNS servers */
 	if (device->rdnss_servers) {
@@ -1635,10 +1689,17 @@ nm_ip6_manager_get (void)
 	return singleton;
 }
 
+static void
+addr_index_fill_cb (struct nl_object *obj, void *arg)
+{
+	nm_netlink_addr_index_add ((NMNetlinkAddrIndex *) arg, (struct rtnl_addr *) obj);
+}
+
 static void
 nm_ip6_manager_init (NMIP6Manager *manager)
 {
 	NMIP6ManagerPrivate *priv = NM_IP6_MANAGER_GET_PRIVATE (manager);
+	struct nl_cache *addr_cache = NULL;
 
 	priv->devices = g_hash_table_new_full (g_direct_hash, g_direct_equal,
 	                                       NULL,
@@ -1650,13 +1711,22 @@ nm_ip6_manager_init (NMIP6Manager *manager)
 	nm_netlink_monitor_subscribe (priv->monitor, RTNLGRP_IPV6_ROUTE, NULL);
 	nm_netlink_monitor_subscribe (priv->monitor, RTNLGRP_ND_USEROPT, NULL);
 	nm_netlink_monitor_subscribe (priv->monitor, RTNLGRP_LINK, NULL);
+	nm_netlink_monitor_subscribe (priv->monitor, RTNLGRP_IPV6_IFINFO, NULL);
 
 	priv->netlink_id = g_signal_connect (priv->monitor, "notification",
 	                                     G_CALLBACK (netlink_notification), manager);
 
 	priv->nlh = nm_netlink_get_default_handle ();
-	rtnl_addr_alloc_cache (priv->nlh, &priv->addr_cache);
-	g_warn_if_fail (priv->addr_cache != NULL);
+
+	/* Seed the address index once; address events keep it current */
+	priv->addr_index = nm_netlink_addr_index_new ();
+	rtnl_addr_alloc_cache (priv->nlh, &addr_cache);
+	g_warn_if_fail (addr_cache != NULL);
+	if (addr_cache) {
+		nl_cache_foreach (addr_cache, addr_index_fill_cb, priv->addr_index);
+		nl_cache_free (addr_cache);
+	}
+
 	rtnl_route_alloc_cache (priv->nlh, NETLINK_ROUTE, NL_AUTO_PROVIDE, &priv->route_cache);
 	g_warn_if_fail (priv->route_cache != NULL);
 }
@@ -1670,7 +1740,7 @@ finalize (GObject *object)
 
 	g_hash_table_destroy (priv->devices);
 	g_object_unref (priv->monitor);
-	nl_cache_free (priv->addr_cache);
+	nm_netlink_addr_index_free (priv->addr_index);
 	nl_cache_free (priv->route_cache);
 
 	singleton = NULL;
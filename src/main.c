@@ -55,6 +55,9 @@
 #include "nm-config.h"
 #include "nm-posix-signals.h"
 #include "nm-system.h"
+#include "nm-properties-changed-signal.h"
+#include "nm-share-rules.h"
+#include "nm-dispatcher.h"
 
 #if !defined(NM_DIST_VERSION)
 # define NM_DIST_VERSION VERSION
@@ -544,6 +547,14 @@ main (int argc, char *argv[])
 		nm_log_err (LOGD_CORE, "failed to start the DNS manager.");
 		goto done;
 	}
+	if (nm_config_get_dns_cache_size (config) >= 0)
+		nm_dns_manager_set_cache_size (dns_mgr, nm_config_get_dns_cache_size (config));
+	if (nm_config_get_dns_update_window (config) >= 0)
+		nm_dns_manager_set_update_window (dns_mgr, nm_config_get_dns_update_window (config));
+	/* Dispatcher scripts must see pending DNS changes in resolv.conf */
+	nm_dispatcher_set_flush_func ((DispatcherFlushFunc) nm_dns_manager_flush_updates, dns_mgr);
+	if (nm_config_get_properties_changed_interval (config) >= 0)
+		nm_properties_changed_signal_set_interval (nm_config_get_properties_changed_interval (config));
 
 	settings = nm_settings_new (nm_config_get_path (config),
 	                            nm_config_get_plugins (config),
@@ -644,8 +655,10 @@ done:
 	if (vpn_manager)
 		g_object_unref (vpn_manager);
 
-	if (dns_mgr)
+	if (dns_mgr) {
+		nm_dispatcher_set_flush_func (NULL, NULL);
 		g_object_unref (dns_mgr);
+	}
 
 	if (dhcp_mgr)
 		g_object_unref (dhcp_mgr);
@@ -659,6 +672,9 @@ done:
 	if (dbus_mgr)
 		g_object_unref (dbus_mgr);
 
+	/* Finish tearing down connection sharing before exiting */
+	nm_share_rules_flush_sync ();
+
 	nm_logging_shutdown ();
 
 	if (pidfile && wrote_pidfile)
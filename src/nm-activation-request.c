@@ -23,8 +23,6 @@
 
 #include <string.h>
 #include <stdlib.h>
-#include <sys/wait.h>
-#include <unistd.h>
 #include <dbus/dbus-glib.h>
 
 #include "nm-activation-request.h"
@@ -34,7 +32,7 @@
 #include "nm-device.h"
 #include "nm-active-connection.h"
 #include "nm-settings-connection.h"
-#include "nm-posix-signals.h"
+#include "nm-share-rules.h"
 
 
 G_DEFINE_TYPE (NMActRequest, nm_act_request, NM_TYPE_ACTIVE_CONNECTION)
@@ -43,11 +41,6 @@ G_DEFINE_TYPE (NMActRequest, nm_act_request, NM_TYPE_ACTIVE_CONNECTION)
                                        NM_TYPE_ACT_REQUEST, \
                                        NMActRequestPrivate))
 
-typedef struct {
-	char *table;
-	char *rule;
-} ShareRule;
-
 typedef struct {
 	NMConnection *connection;
 	NMDevice *device;
@@ -183,83 +176,23 @@ static void
 clear_share_rules (NMActRequest *req)
 {
 	NMActRequestPrivate *priv = NM_ACT_REQUEST_GET_PRIVATE (req);
-	GSList *iter;
-
-	for (iter = priv->share_rules; iter; iter = g_slist_next (iter)) {
-		ShareRule *rule = (ShareRule *) iter->data;
-
-		g_free (rule->table);
-		g_free (rule->rule);
-		g_free (rule);
-	}
 
+	g_slist_foreach (priv->share_rules, (GFunc) nm_share_rule_free, NULL);
 	g_slist_free (priv->share_rules);
 	priv->share_rules = NULL;
 }
 
-static void
-share_child_setup (gpointer user_data G_GNUC_UNUSED)
-{
-	/* We are in the child process at this point */
-	pid_t pid = getpid ();
-	setpgid (pid, pid);
-
-	nm_unblock_posix_signals (NULL);
-}
-
 void
 nm_act_request_set_shared (NMActRequest *req, gboolean shared)
 {
 	NMActRequestPrivate *priv = NM_ACT_REQUEST_GET_PRIVATE (req);
-	GSList *list, *iter;
 
 	g_return_if_fail (NM_IS_ACT_REQUEST (req));
 
 	NM_ACT_REQUEST_GET_PRIVATE (req)->shared = shared;
 
-	/* Tear the rules down in reverse order when sharing is stopped */
-	list = g_slist_copy (priv->share_rules);
-	if (!shared)
-		list = g_slist_reverse (list);
-
-	/* Send the rules to iptables */
-	for (iter = list; iter; iter = g_slist_next (iter)) {
-		ShareRule *rule = (ShareRule *) iter->data;
-		char *envp[1] = { NULL };
-		char **argv;
-		char *cmd;
-
-		cmd = g_strdup_printf ("%s --table %s %s %s",
-		                       IPTABLES_PATH,
-		                       rule->table,
-		                       shared ? "--insert" : "--delete",
-		                       rule->rule);
-		if (!cmd)
-			continue;
-
-		argv = g_strsplit (cmd, " ", 0);
-		if (argv && argv[0]) {
-			int status;
-			GError *error = NULL;
-
-			nm_log_info (LOGD_SHARING, "Executing: %s", cmd);
-			if (!g_spawn_sync ("/", argv, envp, G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL,
-			                   share_child_setup, NULL, NULL, NULL, &status, &error)) {
-				nm_log_warn (LOGD_SHARING, "Error executing command: (%d) %s",
-				             error ? error->code : -1,
-				             (error && error->message) ? error->message : "(unknown)");
-				g_clear_error (&error);
-			} else if (WEXITSTATUS (status)) {
-				nm_log_warn (LOGD_SHARING, "** Command returned exit status %d.",
-				             WEXITSTATUS (status));
-			}
-		}
-		g_free (cmd);
-		if (argv)
-			g_strfreev (argv);
-	}
-
-	g_slist_free (list);
+	/* Send the whole rule set to iptables at once */
+	nm_share_rules_apply (priv->share_rules, shared);
 
 	/* Clear the share rule list when sharing is stopped */
 	if (!shared)
@@ -280,16 +213,13 @@ nm_act_request_add_share_rule (NMActRequest *req,
                                const char *table_rule)
 {
 	NMActRequestPrivate *priv = NM_ACT_REQUEST_GET_PRIVATE (req);
-	ShareRule *rule;
 
 	g_return_if_fail (NM_IS_ACT_REQUEST (req));
 	g_return_if_fail (table != NULL);
 	g_return_if_fail (table_rule != NULL);
 
-	rule = g_malloc0 (sizeof (ShareRule));
-	rule->table = g_strdup (table);
-	rule->rule = g_strdup (table_rule);
-	priv->share_rules = g_slist_append (priv->share_rules, rule);
+	priv->share_rules = g_slist_append (priv->share_rules,
+	                                    nm_share_rule_new (table, table_rule));
 }
 
 /********************************************************************/
@@ -32,6 +32,9 @@ struct NMConfig {
 	char **plugins;
 	char *dhcp_client;
 	char **dns_plugins;
+	gint dns_cache_size;
+	gint dns_update_window;
+	gint properties_changed_interval;
 	char *log_level;
 	char *log_domains;
 	char *connectivity_uri;
@@ -84,6 +87,33 @@ nm_config_get_dns_plugins (NMConfig *config)
 	return (const char **) config->dns_plugins;
 }
 
+/* Returns -1 if not configured */
+gint
+nm_config_get_dns_cache_size (NMConfig *config)
+{
+	g_return_val_if_fail (config != NULL, -1);
+
+	return config->dns_cache_size;
+}
+
+/* Returns -1 if not configured */
+gint
+nm_config_get_dns_update_window (NMConfig *config)
+{
+	g_return_val_if_fail (config != NULL, -1);
+
+	return config->dns_update_window;
+}
+
+/* Returns -1 if not configured */
+gint
+nm_config_get_properties_changed_interval (NMConfig *config)
+{
+	g_return_val_if_fail (config != NULL, -1);
+
+	return config->properties_changed_interval;
+}
+
 const char *
 nm_config_get_log_level (NMConfig *config)
 {
@@ -165,6 +195,12 @@ fill_from_file (NMConfig *config,
 
 		config->dhcp_client = g_key_file_get_value (kf, "main", "dhcp", NULL);
 		config->dns_plugins = g_key_file_get_string_list (kf, "main", "dns", NULL, NULL);
+		if (g_key_file_has_key (kf, "main", "dns-cache-size", NULL))
+			config->dns_cache_size = MAX (g_key_file_get_integer (kf, "main", "dns-cache-size", NULL), 0);
+		if (g_key_file_has_key (kf, "main", "dns-update-window", NULL))
+			config->dns_update_window = MAX (g_key_file_get_integer (kf, "main", "dns-update-window", NULL), 0);
+		if (g_key_file_has_key (kf, "main", "properties-changed-interval", NULL))
+			config->properties_changed_interval = MAX (g_key_file_get_integer (kf, "main", "properties-changed-interval", NULL), 0);
 
 		if (cli_log_level && strlen (cli_log_level))
 			config->log_level = g_strdup (cli_log_level);
@@ -212,6 +248,9 @@ nm_config_new (const char *cli_config_path,
 	GError *local = NULL;
 
 	config = g_malloc0 (sizeof (*config));
+	config->dns_cache_size = -1;
+	config->dns_update_window = -1;
+	config->properties_changed_interval = -1;
 
 	if (cli_config_path) {
 		/* Bad user-specific config file path is a hard error */
@@ -47,6 +47,9 @@ const char *nm_config_get_path (NMConfig *config);
 const char **nm_config_get_plugins (NMConfig *config);
 const char *nm_config_get_dhcp_client (NMConfig *config);
 const char **nm_config_get_dns_plugins (NMConfig *config);
+gint nm_config_get_dns_cache_size (NMConfig *config);
+gint nm_config_get_dns_update_window (NMConfig *config);
+gint nm_config_get_properties_changed_interval (NMConfig *config);
 const char *nm_config_get_log_level (NMConfig *config);
 const char *nm_config_get_log_domains (NMConfig *config);
 const char *nm_config_get_connectivity_uri (NMConfig *config);
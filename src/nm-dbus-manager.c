@@ -30,6 +30,10 @@
 #include <dbus/dbus-glib-lowlevel.h>
 #include <string.h>
 #include "nm-logging.h"
+#include "nm-dbus-glib-types.h"
+
+/* Time to wait for the bus daemon to tell us who a caller is */
+#define CALLER_INFO_TIMEOUT 5000
 
 enum {
 	DBUS_CONNECTION_CHANGED = 0,
@@ -54,11 +58,38 @@ typedef struct {
 	guint proxy_destroy_id;
 
 	guint reconnect_id;
+
+	/* Unique bus name -> CallerInfo; unique names are never reused, so
+	 * entries stay valid until the name leaves the bus.
+	 */
+	GHashTable *callers;
+	/* Unique bus name -> CallerRequest, for lookups still in flight */
+	GHashTable *caller_requests;
+	gboolean no_credentials_method;
 } NMDBusManagerPrivate;
 
+typedef struct {
+	gulong uid;
+	gulong pid;
+} CallerInfo;
+
+typedef struct {
+	NMDBusManagerCallerInfoFunc func;
+	gpointer user_data;
+} CallerCallback;
+
+typedef struct {
+	NMDBusManager *self;
+	char *sender;
+	DBusGProxyCall *call;
+	gboolean invalidated;
+	GSList *callbacks;
+} CallerRequest;
+
 static gboolean nm_dbus_manager_init_bus (NMDBusManager *self);
 static void nm_dbus_manager_cleanup (NMDBusManager *self, gboolean dispose);
 static void start_reconnection_timeout (NMDBusManager *self);
+static void caller_requests_fail_all (NMDBusManager *self);
 
 NMDBusManager *
 nm_dbus_manager_get (void)
@@ -80,6 +111,10 @@ nm_dbus_manager_get (void)
 static void
 nm_dbus_manager_init (NMDBusManager *self)
 {
+	NMDBusManagerPrivate *priv = NM_DBUS_MANAGER_GET_PRIVATE (self);
+
+	priv->callers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	priv->caller_requests = g_hash_table_new (g_str_hash, g_str_equal);
 }
 
 static void
@@ -97,12 +132,24 @@ nm_dbus_manager_dispose (GObject *object)
 	G_OBJECT_CLASS (nm_dbus_manager_parent_class)->dispose (object);
 }
 
+static void
+nm_dbus_manager_finalize (GObject *object)
+{
+	NMDBusManagerPrivate *priv = NM_DBUS_MANAGER_GET_PRIVATE (object);
+
+	g_hash_table_destroy (priv->callers);
+	g_hash_table_destroy (priv->caller_requests);
+
+	G_OBJECT_CLASS (nm_dbus_manager_parent_class)->finalize (object);
+}
+
 static void
 nm_dbus_manager_class_init (NMDBusManagerClass *klass)
 {
 	GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
 	object_class->dispose = nm_dbus_manager_dispose;
+	object_class->finalize = nm_dbus_manager_finalize;
 
 	signals[DBUS_CONNECTION_CHANGED] =
 		g_signal_new (NM_DBUS_MANAGER_DBUS_CONNECTION_CHANGED,
@@ -130,6 +177,12 @@ nm_dbus_manager_cleanup (NMDBusManager *self, gboolean dispose)
 {
 	NMDBusManagerPrivate *priv = NM_DBUS_MANAGER_GET_PRIVATE (self);
 
+	/* Lookups can't complete without the bus, and callers on the next
+	 * connection are different clients altogether.
+	 */
+	caller_requests_fail_all (self);
+	g_hash_table_remove_all (priv->callers);
+
 	if (priv->proxy) {
 		if (dispose) {
 			g_signal_handler_disconnect (priv->proxy, priv->proxy_destroy_id);
@@ -231,6 +284,251 @@ nm_dbus_manager_name_has_owner (NMDBusManager *self,
 	return has_owner;
 }
 
+/**************************************************************/
+
+static void
+caller_request_finish (CallerRequest *req, const CallerInfo *info, GError *error)
+{
+	NMDBusManager *self = req->self;
+	NMDBusManagerPrivate *priv = NM_DBUS_MANAGER_GET_PRIVATE (self);
+	GSList *iter;
+
+	g_hash_table_remove (priv->caller_requests, req->sender);
+
+	if (info && !req->invalidated) {
+		g_hash_table_insert (priv->callers,
+		                     g_strdup (req->sender),
+		                     g_memdup (info, sizeof (*info)));
+	}
+
+	g_object_ref (self);
+	for (iter = req->callbacks; iter; iter = g_slist_next (iter)) {
+		CallerCallback *cb = iter->data;
+
+		cb->func (self,
+		          req->sender,
+		          info ? info->uid : G_MAXULONG,
+		          info ? info->pid : 0,
+		          error,
+		          cb->user_data);
+		g_slice_free (CallerCallback, cb);
+	}
+	g_object_unref (self);
+
+	g_slist_free (req->callbacks);
+	g_free (req->sender);
+	g_slice_free (CallerRequest, req);
+}
+
+static void caller_request_send (CallerRequest *req);
+
+static void
+caller_request_done (DBusGProxy *proxy, DBusGProxyCall *call, gpointer user_data)
+{
+	CallerRequest *req = user_data;
+	NMDBusManagerPrivate *priv = NM_DBUS_MANAGER_GET_PRIVATE (req->self);
+	CallerInfo info = { G_MAXULONG, 0 };
+	GHashTable *credentials = NULL;
+	GValue *value;
+	guint32 uid = 0;
+	GError *error = NULL;
+	gboolean success;
+
+	req->call = NULL;
+
+	if (priv->no_credentials_method) {
+		success = dbus_g_proxy_end_call (proxy, call, &error,
+		                                 G_TYPE_UINT, &uid,
+		                                 G_TYPE_INVALID);
+		if (success)
+			info.uid = uid;
+	} else {
+		success = dbus_g_proxy_end_call (proxy, call, &error,
+		                                 DBUS_TYPE_G_MAP_OF_VARIANT, &credentials,
+		                                 G_TYPE_INVALID);
+		if (success) {
+			value = g_hash_table_lookup (credentials, "UnixUserID");
+			if (value && G_VALUE_HOLDS_UINT (value))
+				info.uid = g_value_get_uint (value);
+			else {
+				g_set_error_literal (&error, DBUS_GERROR, DBUS_GERROR_FAILED,
+				                     "Bus daemon did not return the caller's user ID");
+				success = FALSE;
+			}
+
+			value = g_hash_table_lookup (credentials, "ProcessID");
+			if (value && G_VALUE_HOLDS_UINT (value))
+				info.pid = g_value_get_uint (value);
+
+			g_hash_table_unref (credentials);
+		} else if (dbus_g_error_has_name (error, DBUS_ERROR_UNKNOWN_METHOD)) {
+			/* Bus daemons older than 1.7 only have GetConnectionUnixUser */
+			priv->no_credentials_method = TRUE;
+			g_clear_error (&error);
+			caller_request_send (req);
+			return;
+		}
+	}
+
+	caller_request_finish (req, success ? &info : NULL, error);
+	g_clear_error (&error);
+}
+
+static void
+caller_request_send (CallerRequest *req)
+{
+	NMDBusManagerPrivate *priv = NM_DBUS_MANAGER_GET_PRIVATE (req->self);
+	GError *error = NULL;
+
+	if (priv->proxy) {
+		req->call = dbus_g_proxy_begin_call_with_timeout (priv->proxy,
+		                                                  priv->no_credentials_method ?
+		                                                    "GetConnectionUnixUser" :
+		                                                    "GetConnectionCredentials",
+		                                                  caller_request_done,
+		                                                  req, NULL,
+		                                                  CALLER_INFO_TIMEOUT,
+		                                                  G_TYPE_STRING, req->sender,
+		                                                  G_TYPE_INVALID);
+	}
+
+	if (!req->call) {
+		g_set_error_literal (&error, DBUS_GERROR, DBUS_GERROR_DISCONNECTED,
+		                     "Not connected to the system bus");
+		caller_request_finish (req, NULL, error);
+		g_error_free (error);
+	}
+}
+
+static void
+caller_requests_fail_all (NMDBusManager *self)
+{
+	NMDBusManagerPrivate *priv = NM_DBUS_MANAGER_GET_PRIVATE (self);
+	GHashTableIter iter;
+	CallerRequest *req;
+	GSList *requests = NULL, *r;
+	GError *error;
+
+	g_hash_table_iter_init (&iter, priv->caller_requests);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer) &req)) {
+		if (req->call && priv->proxy)
+			dbus_g_proxy_cancel_call (priv->proxy, req->call);
+		req->call = NULL;
+		requests = g_slist_prepend (requests, req);
+	}
+
+	error = g_error_new_literal (DBUS_GERROR, DBUS_GERROR_DISCONNECTED,
+	                             "Disconnected from the system bus");
+	for (r = requests; r; r = g_slist_next (r))
+		caller_request_finish (r->data, NULL, error);
+	g_error_free (error);
+	g_slist_free (requests);
+}
+
+/**
+ * nm_dbus_manager_get_caller_info_async:
+ * @self: the #NMDBusManager
+ * @sender: unique bus name of the caller
+ * @callback: called with the caller's user and process ID
+ * @user_data: data for @callback
+ *
+ * Asks the bus daemon for the credentials of @sender without blocking.
+ * Results are cached until @sender leaves the bus, and concurrent lookups
+ * for the same caller share one request.  If the credentials are already
+ * known, @callback is called before this function returns.
+ **/
+void
+nm_dbus_manager_get_caller_info_async (NMDBusManager *self,
+                                       const char *sender,
+                                       NMDBusManagerCallerInfoFunc callback,
+                                       gpointer user_data)
+{
+	NMDBusManagerPrivate *priv;
+	CallerInfo *info;
+	CallerRequest *req;
+	CallerCallback *cb;
+
+	g_return_if_fail (NM_IS_DBUS_MANAGER (self));
+	g_return_if_fail (sender != NULL);
+	g_return_if_fail (callback != NULL);
+
+	priv = NM_DBUS_MANAGER_GET_PRIVATE (self);
+
+	info = g_hash_table_lookup (priv->callers, sender);
+	if (info) {
+		callback (self, sender, info->uid, info->pid, NULL, user_data);
+		return;
+	}
+
+	cb = g_slice_new0 (CallerCallback);
+	cb->func = callback;
+	cb->user_data = user_data;
+
+	req = g_hash_table_lookup (priv->caller_requests, sender);
+	if (req) {
+		req->callbacks = g_slist_append (req->callbacks, cb);
+		return;
+	}
+
+	req = g_slice_new0 (CallerRequest);
+	req->self = self;
+	req->sender = g_strdup (sender);
+	req->callbacks = g_slist_append (NULL, cb);
+	g_hash_table_insert (priv->caller_requests, req->sender, req);
+
+	caller_request_send (req);
+}
+
+/**
+ * nm_dbus_manager_get_caller_info_cached:
+ * @self: the #NMDBusManager
+ * @sender: unique bus name of the caller
+ * @out_uid: (out) (allow-none): on return, the caller's user ID
+ * @out_pid: (out) (allow-none): on return, the caller's process ID, or 0
+ *
+ * Looks up credentials previously resolved with
+ * nm_dbus_manager_get_caller_info_async(); never talks to the bus.
+ *
+ * Returns: %TRUE if @sender is still on the bus and its credentials are known
+ **/
+gboolean
+nm_dbus_manager_get_caller_info_cached (NMDBusManager *self,
+                                        const char *sender,
+                                        gulong *out_uid,
+                                        gulong *out_pid)
+{
+	CallerInfo *info;
+
+	g_return_val_if_fail (NM_IS_DBUS_MANAGER (self), FALSE);
+	g_return_val_if_fail (sender != NULL, FALSE);
+
+	info = g_hash_table_lookup (NM_DBUS_MANAGER_GET_PRIVATE (self)->callers, sender);
+	if (!info)
+		return FALSE;
+
+	if (out_uid)
+		*out_uid = info->uid;
+	if (out_pid)
+		*out_pid = info->pid;
+	return TRUE;
+}
+
+static void
+forget_caller (NMDBusManager *self, const char *name)
+{
+	NMDBusManagerPrivate *priv = NM_DBUS_MANAGER_GET_PRIVATE (self);
+	CallerRequest *req;
+
+	g_hash_table_remove (priv->callers, name);
+
+	/* A reply racing with the name going away must not be cached */
+	req = g_hash_table_lookup (priv->caller_requests, name);
+	if (req)
+		req->invalidated = TRUE;
+}
+
+/**************************************************************/
+
 static void
 proxy_name_owner_changed (DBusGProxy *proxy,
 					 const char *name,
@@ -238,6 +536,9 @@ proxy_name_owner_changed (DBusGProxy *proxy,
 					 const char *new_owner,
 					 gpointer user_data)
 {
+	if (name[0] == ':' && (!new_owner || !new_owner[0]))
+		forget_caller (NM_DBUS_MANAGER (user_data), name);
+
 	g_signal_emit (G_OBJECT (user_data), signals[NAME_OWNER_CHANGED],
 	               0, name, old_owner, new_owner);
 }
@@ -75,6 +75,24 @@ gboolean nm_dbus_manager_name_has_owner   (NMDBusManager *self,
 DBusConnection * nm_dbus_manager_get_dbus_connection (NMDBusManager *self);
 DBusGConnection * nm_dbus_manager_get_connection (NMDBusManager *self);
 
+/* @uid is G_MAXULONG and @error is set if the lookup failed */
+typedef void (*NMDBusManagerCallerInfoFunc) (NMDBusManager *self,
+                                             const char *sender,
+                                             gulong uid,
+                                             gulong pid,
+                                             GError *error,
+                                             gpointer user_data);
+
+void     nm_dbus_manager_get_caller_info_async  (NMDBusManager *self,
+                                                 const char *sender,
+                                                 NMDBusManagerCallerInfoFunc callback,
+                                                 gpointer user_data);
+
+gboolean nm_dbus_manager_get_caller_info_cached (NMDBusManager *self,
+                                                 const char *sender,
+                                                 gulong *out_uid,
+                                                 gulong *out_pid);
+
 G_END_DECLS
 
 #endif /* __NM_DBUS_MANAGER_H__ */
@@ -303,22 +303,18 @@ connection_match_config (NMDevice *self, const GSList *connections)
 
 /******************************************************************/
 
-static void
-set_sysfs_uint (const char *iface,
-                GObject *obj,
-                const char *obj_prop,
-                const char *dir,
-                const char *sysfs_prop,
-                gboolean default_if_zero,
-                gboolean user_hz_compensate)
+static guint32
+get_option_uint (GObject *obj,
+                 const char *obj_prop,
+                 gboolean default_if_zero,
+                 gboolean user_hz_compensate)
 {
-	char *path, *s;
 	GParamSpec *pspec;
 	GValue val = { 0 };
 	guint32 uval = 0;
 
 	pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (obj), obj_prop);
-	g_return_if_fail (pspec != NULL);
+	g_return_val_if_fail (pspec != NULL, 0);
 
 	/* Get the property's value */
 	g_value_init (&val, G_PARAM_SPEC_VALUE_TYPE (pspec));
@@ -350,8 +346,22 @@ set_sysfs_uint (const char *iface,
 	if (user_hz_compensate)
 		uval *= 100;
 
+	return uval;
+}
+
+static void
+set_sysfs_uint (const char *iface,
+                GObject *obj,
+                const char *obj_prop,
+                const char *dir,
+                const char *sysfs_prop,
+                gboolean default_if_zero,
+                gboolean user_hz_compensate)
+{
+	char *path, *s;
+
 	path = g_strdup_printf ("/sys/class/net/%s/%s/%s", iface, dir, sysfs_prop);
-	s = g_strdup_printf ("%u", uval);
+	s = g_strdup_printf ("%u", get_option_uint (obj, obj_prop, default_if_zero, user_hz_compensate));
 	/* FIXME: how should failure be handled? */
 	nm_utils_do_sysctl (path, s);
 	g_free (path);
@@ -364,6 +374,7 @@ act_stage1_prepare (NMDevice *dev, NMDeviceStateReason *reason)
 	NMActStageReturn ret = NM_ACT_STAGE_RETURN_SUCCESS;
 	NMConnection *connection;
 	NMSettingBridge *s_bridge;
+	NMSystemBridgeConfig config;
 	const char *iface;
 
 	g_return_val_if_fail (reason != NULL, NM_ACT_STAGE_RETURN_FAILURE);
@@ -379,12 +390,13 @@ act_stage1_prepare (NMDevice *dev, NMDeviceStateReason *reason)
 		iface = nm_device_get_ip_iface (dev);
 		g_assert (iface);
 
-		set_sysfs_uint (iface, G_OBJECT (s_bridge), NM_SETTING_BRIDGE_STP, "bridge", "stp_state", FALSE, FALSE);
-		set_sysfs_uint (iface, G_OBJECT (s_bridge), NM_SETTING_BRIDGE_PRIORITY, "bridge", "priority", TRUE, FALSE);
-		set_sysfs_uint (iface, G_OBJECT (s_bridge), NM_SETTING_BRIDGE_FORWARD_DELAY, "bridge", "forward_delay", TRUE, TRUE);
-		set_sysfs_uint (iface, G_OBJECT (s_bridge), NM_SETTING_BRIDGE_HELLO_TIME, "bridge", "hello_time", TRUE, TRUE);
-		set_sysfs_uint (iface, G_OBJECT (s_bridge), NM_SETTING_BRIDGE_MAX_AGE, "bridge", "max_age", TRUE, TRUE);
-		set_sysfs_uint (iface, G_OBJECT (s_bridge), NM_SETTING_BRIDGE_AGEING_TIME, "bridge", "ageing_time", TRUE, TRUE);
+		config.stp_state = get_option_uint (G_OBJECT (s_bridge), NM_SETTING_BRIDGE_STP, FALSE, FALSE);
+		config.priority = get_option_uint (G_OBJECT (s_bridge), NM_SETTING_BRIDGE_PRIORITY, TRUE, FALSE);
+		config.forward_delay = get_option_uint (G_OBJECT (s_bridge), NM_SETTING_BRIDGE_FORWARD_DELAY, TRUE, TRUE);
+		config.hello_time = get_option_uint (G_OBJECT (s_bridge), NM_SETTING_BRIDGE_HELLO_TIME, TRUE, TRUE);
+		config.max_age = get_option_uint (G_OBJECT (s_bridge), NM_SETTING_BRIDGE_MAX_AGE, TRUE, TRUE);
+		config.ageing_time = get_option_uint (G_OBJECT (s_bridge), NM_SETTING_BRIDGE_AGEING_TIME, TRUE, TRUE);
+		nm_system_apply_bridge_config (nm_device_get_ip_ifindex (dev), iface, &config);
 	}
 	return ret;
 }
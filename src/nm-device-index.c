@@ -0,0 +1,353 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#include <string.h>
+
+#include "nm-device-index.h"
+
+typedef enum {
+	KEY_IFINDEX = 0,
+	KEY_UDI,
+	KEY_PATH,
+	KEY_IFACE,
+	KEY_IP_IFACE,
+	KEY_LAST
+} KeyType;
+
+typedef struct {
+	gpointer device;
+	guint64 serial;
+	int ifindex;
+	char *keys[KEY_LAST];   /* string keys; KEY_IFINDEX is unused */
+} Entry;
+
+struct _NMDeviceIndex {
+	GHashTable *entries;            /* device -> Entry */
+	GHashTable *tables[KEY_LAST];   /* key -> GSList of Entry, by serial */
+	guint64 next_serial;
+};
+
+NMDeviceIndex *
+nm_device_index_new (void)
+{
+	NMDeviceIndex *index;
+	guint i;
+
+	index = g_slice_new0 (NMDeviceIndex);
+	index->entries = g_hash_table_new (g_direct_hash, g_direct_equal);
+	index->tables[KEY_IFINDEX] = g_hash_table_new (g_direct_hash, g_direct_equal);
+	for (i = KEY_UDI; i < KEY_LAST; i++)
+		index->tables[i] = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	return index;
+}
+
+static void
+entry_free (Entry *entry)
+{
+	guint i;
+
+	for (i = 0; i < KEY_LAST; i++)
+		g_free (entry->keys[i]);
+	g_slice_free (Entry, entry);
+}
+
+static void
+free_bucket (gpointer key, gpointer value, gpointer user_data)
+{
+	g_slist_free ((GSList *) value);
+}
+
+void
+nm_device_index_free (NMDeviceIndex *index)
+{
+	GHashTableIter iter;
+	gpointer value;
+	guint i;
+
+	g_return_if_fail (index != NULL);
+
+	for (i = 0; i < KEY_LAST; i++) {
+		g_hash_table_foreach (index->tables[i], free_bucket, NULL);
+		g_hash_table_destroy (index->tables[i]);
+	}
+
+	g_hash_table_iter_init (&iter, index->entries);
+	while (g_hash_table_iter_next (&iter, NULL, &value))
+		entry_free (value);
+	g_hash_table_destroy (index->entries);
+
+	g_slice_free (NMDeviceIndex, index);
+}
+
+guint
+nm_device_index_size (NMDeviceIndex *index)
+{
+	g_return_val_if_fail (index != NULL, 0);
+
+	return g_hash_table_size (index->entries);
+}
+
+static gint
+entry_serial_cmp (gconstpointer a, gconstpointer b)
+{
+	const Entry *ea = a, *eb = b;
+
+	if (ea->serial < eb->serial)
+		return -1;
+	return ea->serial > eb->serial;
+}
+
+static gboolean
+entry_get_key (Entry *entry, KeyType type, gpointer *out_key)
+{
+	if (type == KEY_IFINDEX) {
+		/* Devices without a kernel interface all have ifindex 0 */
+		*out_key = GINT_TO_POINTER (entry->ifindex);
+		return entry->ifindex > 0;
+	}
+
+	*out_key = entry->keys[type];
+	return entry->keys[type] != NULL;
+}
+
+static void
+bucket_add (NMDeviceIndex *index, KeyType type, Entry *entry)
+{
+	GHashTable *table = index->tables[type];
+	gpointer key;
+	GSList *list;
+
+	if (!entry_get_key (entry, type, &key))
+		return;
+
+	/* Buckets are short and almost always hold a single device; keeping
+	 * them sorted by registration order preserves the device list's
+	 * first-match semantics.
+	 */
+	list = g_hash_table_lookup (table, key);
+	list = g_slist_insert_sorted (list, entry, entry_serial_cmp);
+	if (type == KEY_IFINDEX)
+		g_hash_table_insert (table, key, list);
+	else
+		g_hash_table_insert (table, g_strdup (key), list);
+}
+
+static void
+bucket_remove (NMDeviceIndex *index, KeyType type, Entry *entry)
+{
+	GHashTable *table = index->tables[type];
+	gpointer key;
+	GSList *list;
+
+	if (!entry_get_key (entry, type, &key))
+		return;
+
+	list = g_hash_table_lookup (table, key);
+	list = g_slist_remove (list, entry);
+	if (!list)
+		g_hash_table_remove (table, key);
+	else if (type == KEY_IFINDEX)
+		g_hash_table_insert (table, key, list);
+	else
+		g_hash_table_insert (table, g_strdup (key), list);
+}
+
+static void
+entry_set_keys (Entry *entry,
+                int ifindex,
+                const char *udi,
+                const char *path,
+                const char *iface,
+                const char *ip_iface)
+{
+	guint i;
+
+	for (i = 0; i < KEY_LAST; i++)
+		g_free (entry->keys[i]);
+
+	entry->ifindex = ifindex;
+	entry->keys[KEY_IFINDEX] = NULL;
+	entry->keys[KEY_UDI] = g_strdup (udi);
+	entry->keys[KEY_PATH] = g_strdup (path);
+	entry->keys[KEY_IFACE] = g_strdup (iface);
+	entry->keys[KEY_IP_IFACE] = g_strdup (ip_iface);
+}
+
+/**
+ * nm_device_index_add:
+ * @index: the index
+ * @device: the device
+ * @ifindex: the device's kernel interface index, or 0 if it has none
+ * @udi: the device's UDI
+ * @path: the device's D-Bus path, if already exported
+ * @iface: the device's interface name
+ * @ip_iface: the device's IP interface name
+ *
+ * Registers @device under the given keys; %NULL keys are not indexed.
+ **/
+void
+nm_device_index_add (NMDeviceIndex *index,
+                     gpointer device,
+                     int ifindex,
+                     const char *udi,
+                     const char *path,
+                     const char *iface,
+                     const char *ip_iface)
+{
+	Entry *entry;
+	guint i;
+
+	g_return_if_fail (index != NULL);
+	g_return_if_fail (device != NULL);
+	g_return_if_fail (g_hash_table_lookup (index->entries, device) == NULL);
+
+	entry = g_slice_new0 (Entry);
+	entry->device = device;
+	entry->serial = index->next_serial++;
+	entry_set_keys (entry, ifindex, udi, path, iface, ip_iface);
+	g_hash_table_insert (index->entries, device, entry);
+
+	for (i = 0; i < KEY_LAST; i++)
+		bucket_add (index, i, entry);
+}
+
+/**
+ * nm_device_index_update:
+ * @index: the index
+ * @device: a device already in @index
+ * @ifindex: the device's kernel interface index, or 0 if it has none
+ * @udi: the device's UDI
+ * @path: the device's D-Bus path
+ * @iface: the device's interface name
+ * @ip_iface: the device's IP interface name
+ *
+ * Re-registers @device after some of its keys changed, eg when it was
+ * exported on D-Bus or its IP interface changed.  The device keeps its
+ * place in the registration order.
+ **/
+void
+nm_device_index_update (NMDeviceIndex *index,
+                        gpointer device,
+                        int ifindex,
+                        const char *udi,
+                        const char *path,
+                        const char *iface,
+                        const char *ip_iface)
+{
+	Entry *entry;
+	guint i;
+
+	g_return_if_fail (index != NULL);
+
+	entry = g_hash_table_lookup (index->entries, device);
+	g_return_if_fail (entry != NULL);
+
+	for (i = 0; i < KEY_LAST; i++)
+		bucket_remove (index, i, entry);
+	entry_set_keys (entry, ifindex, udi, path, iface, ip_iface);
+	for (i = 0; i < KEY_LAST; i++)
+		bucket_add (index, i, entry);
+}
+
+void
+nm_device_index_remove (NMDeviceIndex *index, gpointer device)
+{
+	Entry *entry;
+	guint i;
+
+	g_return_if_fail (index != NULL);
+
+	entry = g_hash_table_lookup (index->entries, device);
+	if (!entry)
+		return;
+
+	for (i = 0; i < KEY_LAST; i++)
+		bucket_remove (index, i, entry);
+	g_hash_table_remove (index->entries, device);
+	entry_free (entry);
+}
+
+static gpointer
+lookup_first (NMDeviceIndex *index, KeyType type, gconstpointer key)
+{
+	GSList *list;
+
+	list = g_hash_table_lookup (index->tables[type], key);
+	return list ? ((Entry *) list->data)->device : NULL;
+}
+
+gpointer
+nm_device_index_lookup_ifindex (NMDeviceIndex *index, int ifindex)
+{
+	g_return_val_if_fail (index != NULL, NULL);
+
+	if (ifindex <= 0)
+		return NULL;
+	return lookup_first (index, KEY_IFINDEX, GINT_TO_POINTER (ifindex));
+}
+
+gpointer
+nm_device_index_lookup_udi (NMDeviceIndex *index, const char *udi)
+{
+	g_return_val_if_fail (index != NULL, NULL);
+	g_return_val_if_fail (udi != NULL, NULL);
+
+	return lookup_first (index, KEY_UDI, udi);
+}
+
+gpointer
+nm_device_index_lookup_path (NMDeviceIndex *index, const char *path)
+{
+	g_return_val_if_fail (index != NULL, NULL);
+	g_return_val_if_fail (path != NULL, NULL);
+
+	return lookup_first (index, KEY_PATH, path);
+}
+
+gpointer
+nm_device_index_lookup_ip_iface (NMDeviceIndex *index, const char *ip_iface)
+{
+	g_return_val_if_fail (index != NULL, NULL);
+
+	if (!ip_iface)
+		return NULL;
+	return lookup_first (index, KEY_IP_IFACE, ip_iface);
+}
+
+/**
+ * nm_device_index_lookup_iface:
+ * @index: the index
+ * @iface: an interface name
+ *
+ * Returns: a newly allocated list of the devices with interface name
+ * @iface in registration order; free with g_slist_free().
+ **/
+GSList *
+nm_device_index_lookup_iface (NMDeviceIndex *index, const char *iface)
+{
+	GSList *list, *devices = NULL;
+
+	g_return_val_if_fail (index != NULL, NULL);
+	g_return_val_if_fail (iface != NULL, NULL);
+
+	for (list = g_hash_table_lookup (index->tables[KEY_IFACE], iface); list; list = list->next)
+		devices = g_slist_prepend (devices, ((Entry *) list->data)->device);
+	return g_slist_reverse (devices);
+}
@@ -0,0 +1,61 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#ifndef NM_DEVICE_INDEX_H
+#define NM_DEVICE_INDEX_H
+
+#include <glib.h>
+
+/* Lookup tables for the manager's devices by ifindex, UDI, D-Bus path,
+ * interface and IP interface name.  The index stores the keys a device was
+ * registered with, so it has to be told about changes through
+ * nm_device_index_update().  Where several devices share a key, lookups
+ * return the one registered first, like a scan of the device list would.
+ */
+typedef struct _NMDeviceIndex NMDeviceIndex;
+
+NMDeviceIndex *nm_device_index_new              (void);
+void           nm_device_index_free             (NMDeviceIndex *index);
+guint          nm_device_index_size             (NMDeviceIndex *index);
+
+void           nm_device_index_add              (NMDeviceIndex *index,
+                                                 gpointer device,
+                                                 int ifindex,
+                                                 const char *udi,
+                                                 const char *path,
+                                                 const char *iface,
+                                                 const char *ip_iface);
+void           nm_device_index_update           (NMDeviceIndex *index,
+                                                 gpointer device,
+                                                 int ifindex,
+                                                 const char *udi,
+                                                 const char *path,
+                                                 const char *iface,
+                                                 const char *ip_iface);
+void           nm_device_index_remove           (NMDeviceIndex *index,
+                                                 gpointer device);
+
+gpointer       nm_device_index_lookup_ifindex   (NMDeviceIndex *index, int ifindex);
+gpointer       nm_device_index_lookup_udi       (NMDeviceIndex *index, const char *udi);
+gpointer       nm_device_index_lookup_path      (NMDeviceIndex *index, const char *path);
+gpointer       nm_device_index_lookup_ip_iface  (NMDeviceIndex *index, const char *ip_iface);
+GSList *       nm_device_index_lookup_iface     (NMDeviceIndex *index, const char *iface);
+
+#endif  /* NM_DEVICE_INDEX_H */
@@ -81,6 +81,9 @@ NMConnectionProvider *nm_device_get_connection_provider (NMDevice *device);
 
 void nm_device_recheck_available_connections (NMDevice *device);
 
+void nm_device_recheck_available_connections_by_key (NMDevice *device,
+                                                     const char *key);
+
 void nm_device_queued_state_clear (NMDevice *device);
 
 NMDeviceState nm_device_queued_state_peek (NMDevice *device);
@@ -40,6 +40,7 @@
 #include "nm-device.h"
 #include "nm-device-wifi.h"
 #include "nm-device-private.h"
+#include "nm-wifi-ap-table.h"
 #include "nm-utils.h"
 #include "nm-logging.h"
 #include "nm-marshal.h"
@@ -138,7 +139,7 @@ struct _NMDeviceWifiPrivate {
 
 	gint8             invalid_strength_counter;
 
-	GSList *          ap_list;
+	NMWifiApTable *   aps;
 	NMAccessPoint *   current_ap;
 	guint32           rate;
 	gboolean          enabled; /* rfkilled or not */
@@ -183,8 +184,7 @@ static void supplicant_iface_new_bss_cb (NMSupplicantInterface * iface,
                                          NMDeviceWifi * self);
 
 static void supplicant_iface_bss_updated_cb (NMSupplicantInterface *iface,
-                                             const char *object_path,
-                                             GHashTable *properties,
+                                             const char **object_paths,
                                              NMDeviceWifi *self);
 
 static void supplicant_iface_bss_removed_cb (NMSupplicantInterface *iface,
@@ -471,9 +471,9 @@ static NMAccessPoint *
 get_ap_by_path (NMDeviceWifi *self, const char *path)
 {
 	NMDeviceWifiPrivate *priv = NM_DEVICE_WIFI_GET_PRIVATE (self);
-	GSList *iter;
+	GList *iter;
 
-	for (iter = priv->ap_list; iter; iter = g_slist_next (iter)) {
+	for (iter = nm_wifi_ap_table_get_list (priv->aps); iter; iter = g_list_next (iter)) {
 		if (g_strcmp0 (path, nm_ap_get_dbus_path (NM_AP (iter->data))) == 0)
 			return NM_AP (iter->data);
 	}
@@ -484,13 +484,8 @@ static NMAccessPoint *
 get_ap_by_supplicant_path (NMDeviceWifi *self, const char *path)
 {
 	NMDeviceWifiPrivate *priv = NM_DEVICE_WIFI_GET_PRIVATE (self);
-	GSList *iter;
 
-	for (iter = priv->ap_list; iter && path; iter = g_slist_next (iter)) {
-		if (g_strcmp0 (path, nm_ap_get_supplicant_path (NM_AP (iter->data))) == 0)
-			return NM_AP (iter->data);
-	}
-	return NULL;
+	return nm_wifi_ap_table_lookup_supplicant_path (priv->aps, path);
 }
 
 static NMAccessPoint *
@@ -502,7 +497,7 @@ get_active_ap (NMDeviceWifi *self,
 	const char *iface = nm_device_get_iface (NM_DEVICE (self));
 	struct ether_addr bssid;
 	GByteArray *ssid;
-	GSList *iter;
+	GList *iter;
 	int i = 0;
 	NMAccessPoint *match_nofreq = NULL, *active_ap = NULL;
 	gboolean found_a_band = FALSE;
@@ -538,7 +533,7 @@ get_active_ap (NMDeviceWifi *self,
 		nm_log_dbg (LOGD_WIFI, "  Pass #%d %s", i, i > 1 ? "(ignoring SSID)" : "");
 
 		/* Find this SSID + BSSID in the device's AP list */
-		for (iter = priv->ap_list; iter; iter = g_slist_next (iter)) {
+		for (iter = nm_wifi_ap_table_get_list (priv->aps); iter; iter = g_list_next (iter)) {
 			NMAccessPoint *ap = NM_AP (iter->data);
 			const struct ether_addr	*ap_bssid = nm_ap_get_address (ap);
 			const GByteArray *ap_ssid = nm_ap_get_ssid (ap);
@@ -681,8 +676,7 @@ set_active_ap (NMDeviceWifi *self, NMAccessPoint *new_ap)
 		 * do a lot of searches looking for the current AP, it saves
 		 * time to have it in front.
 		 */
-		priv->ap_list = g_slist_remove (priv->ap_list, new_ap);
-		priv->ap_list = g_slist_prepend (priv->ap_list, new_ap);
+		nm_wifi_ap_table_move_to_front (priv->aps, new_ap);
 
 		/* Update seen BSSIDs cache */
 		update_seen_bssids_cache (self, priv->current_ap);
@@ -875,16 +869,63 @@ _set_hw_addr (NMDeviceWifi *self, const guint8 *addr, const char *detail)
 	return success;
 }
 
+/* Availability keys are the hex-encoded SSID, ignoring trailing NULs like
+ * nm_utils_same_ssid() does, so only connections for the SSID of an
+ * appearing or disappearing AP get rechecked.
+ */
+static char *
+ssid_to_availability_key (const GByteArray *ssid)
+{
+	GString *key;
+	guint len, i;
+
+	if (!ssid)
+		return NULL;
+
+	len = ssid->len;
+	while (len > 0 && ssid->data[len - 1] == '\0')
+		len--;
+	if (len == 0)
+		return NULL;
+
+	key = g_string_sized_new (len * 2);
+	for (i = 0; i < len; i++)
+		g_string_append_printf (key, "%02x", ssid->data[i]);
+	return g_string_free (key, FALSE);
+}
+
+static char *
+get_availability_key (NMDevice *device, NMConnection *connection)
+{
+	NMSettingWireless *s_wifi;
+
+	s_wifi = nm_connection_get_setting_wireless (connection);
+	if (!s_wifi)
+		return NULL;
+	return ssid_to_availability_key (nm_setting_wireless_get_ssid (s_wifi));
+}
+
+static void
+recheck_available_connections_for_ap (NMDeviceWifi *self, NMAccessPoint *ap)
+{
+	char *key;
+
+	key = ssid_to_availability_key (nm_ap_get_ssid (ap));
+	nm_device_recheck_available_connections_by_key (NM_DEVICE (self), key);
+	g_free (key);
+}
+
 static void
 remove_access_point (NMDeviceWifi *device, NMAccessPoint *ap)
 {
 	NMDeviceWifiPrivate *priv = NM_DEVICE_WIFI_GET_PRIVATE (device);
 
 	g_signal_emit (device, signals[ACCESS_POINT_REMOVED], 0, ap);
-	priv->ap_list = g_slist_remove (priv->ap_list, ap);
-	g_object_unref (ap);
+	g_object_ref (ap);
+	nm_wifi_ap_table_remove (priv->aps, ap);
 
-	nm_device_recheck_available_connections (NM_DEVICE (device));
+	recheck_available_connections_for_ap (device, ap);
+	g_object_unref (ap);
 }
 
 static void
@@ -893,12 +934,10 @@ remove_all_aps (NMDeviceWifi *self)
 	NMDeviceWifiPrivate *priv = NM_DEVICE_WIFI_GET_PRIVATE (self);
 
 	/* Remove outdated APs */
-	while (g_slist_length (priv->ap_list)) {
-		NMAccessPoint *ap = NM_AP (priv->ap_list->data);
+	while (nm_wifi_ap_table_size (priv->aps)) {
+		NMAccessPoint *ap = NM_AP (nm_wifi_ap_table_get_list (priv->aps)->data);
 		remove_access_point (self, ap);
 	}
-	g_slist_free (priv->ap_list);
-	priv->ap_list = NULL;
 }
 
 static void
@@ -1111,7 +1150,7 @@ check_connection_available (NMDevice *device, NMConnection *connection)
 	NMDeviceWifiPrivate *priv = NM_DEVICE_WIFI_GET_PRIVATE (device);
 	NMSettingWireless *s_wifi;
 	const char *mode;
-	GSList *ap_iter = NULL;
+	GList *ap_iter = NULL;
 
 	s_wifi = nm_connection_get_setting_wireless (connection);
 
@@ -1127,7 +1166,7 @@ check_connection_available (NMDevice *device, NMConnection *connection)
 		return TRUE;
 
 	/* check if its visible */
-	for (ap_iter = priv->ap_list; ap_iter; ap_iter = g_slist_next (ap_iter)) {
+	for (ap_iter = nm_wifi_ap_table_get_list (priv->aps); ap_iter; ap_iter = g_list_next (ap_iter)) {
 		if (nm_ap_check_compatible (NM_AP (ap_iter->data), connection))
 			return TRUE;
 	}
@@ -1187,7 +1226,7 @@ complete_connection (NMDevice *device,
 	char *format, *str_ssid = NULL;
 	NMAccessPoint *ap = NULL;
 	const GByteArray *ssid = NULL;
-	GSList *iter;
+	GList *iter;
 
 	s_wifi = nm_connection_get_setting_wireless (connection);
 	s_wsec = nm_connection_get_setting_wireless_security (connection);
@@ -1213,7 +1252,7 @@ complete_connection (NMDevice *device,
 		}
 
 		/* Find a compatible AP in the scan list */
-		for (iter = priv->ap_list; iter; iter = g_slist_next (iter)) {
+		for (iter = nm_wifi_ap_table_get_list (priv->aps); iter; iter = g_list_next (iter)) {
 			if (nm_ap_check_compatible (NM_AP (iter->data), connection)) {
 				ap = NM_AP (iter->data);
 				break;
@@ -1382,7 +1421,8 @@ get_best_auto_connection (NMDevice *dev,
 {
 	NMDeviceWifi *self = NM_DEVICE_WIFI (dev);
 	NMDeviceWifiPrivate *priv = NM_DEVICE_WIFI_GET_PRIVATE (self);
-	GSList *iter, *ap_iter;
+	GSList *iter;
+	GList *ap_iter;
 
 	for (iter = connections; iter; iter = g_slist_next (iter)) {
 		NMConnection *connection = NM_CONNECTION (iter->data);
@@ -1441,7 +1481,7 @@ get_best_auto_connection (NMDevice *dev,
 		if (s_ip4 && !strcmp (method, NM_SETTING_IP4_CONFIG_METHOD_SHARED))
 			return connection;
 
-		for (ap_iter = priv->ap_list; ap_iter; ap_iter = g_slist_next (ap_iter)) {
+		for (ap_iter = nm_wifi_ap_table_get_list (priv->aps); ap_iter; ap_iter = g_list_next (ap_iter)) {
 			NMAccessPoint *ap = NM_AP (ap_iter->data);
 
 			if (nm_ap_check_compatible (ap, connection)) {
@@ -1458,13 +1498,13 @@ static void
 ap_list_dump (NMDeviceWifi *self)
 {
 	NMDeviceWifiPrivate *priv = NM_DEVICE_WIFI_GET_PRIVATE (self);
-	GSList * elt;
+	GList * elt;
 	int i = 0;
 
 	g_return_if_fail (NM_IS_DEVICE_WIFI (self));
 
 	nm_log_dbg (LOGD_WIFI_SCAN, "Current AP list:");
-	for (elt = priv->ap_list; elt; elt = g_slist_next (elt), i++) {
+	for (elt = nm_wifi_ap_table_get_list (priv->aps); elt; elt = g_list_next (elt), i++) {
 		NMAccessPoint * ap = NM_AP (elt->data);
 		nm_ap_dump (ap, "List AP: ");
 	}
@@ -1477,11 +1517,11 @@ impl_device_get_access_points (NMDeviceWifi *self,
                                GError **err)
 {
 	NMDeviceWifiPrivate *priv = NM_DEVICE_WIFI_GET_PRIVATE (self);
-	GSList *elt;
+	GList *elt;
 
 	*aps = g_ptr_array_new ();
 
-	for (elt = priv->ap_list; elt; elt = g_slist_next (elt)) {
+	for (elt = nm_wifi_ap_table_get_list (priv->aps); elt; elt = g_list_next (elt)) {
 		NMAccessPoint * ap = NM_AP (elt->data);
 
 		if (nm_ap_get_ssid (ap))
@@ -1924,7 +1964,7 @@ merge_scanned_ap (NMDeviceWifi *self,
 
 	found_ap = get_ap_by_supplicant_path (self, nm_ap_get_supplicant_path (merge_ap));
 	if (!found_ap)
-		found_ap = nm_ap_match_in_list (merge_ap, priv->ap_list, strict_match);
+		found_ap = nm_wifi_ap_table_match (priv->aps, merge_ap, strict_match);
 	if (found_ap) {
 		nm_log_dbg (LOGD_WIFI_SCAN, "(%s): merging AP '%s' " MAC_FMT " (%p) with existing (%p)",
 		            nm_device_get_iface (NM_DEVICE (self)),
@@ -1938,10 +1978,11 @@ merge_scanned_ap (NMDeviceWifi *self,
 		nm_ap_set_wpa_flags (found_ap, nm_ap_get_wpa_flags (merge_ap));
 		nm_ap_set_rsn_flags (found_ap, nm_ap_get_rsn_flags (merge_ap));
 		nm_ap_set_strength (found_ap, nm_ap_get_strength (merge_ap));
-		nm_ap_set_last_seen (found_ap, nm_ap_get_last_seen (merge_ap));
+		nm_wifi_ap_table_touch (priv->aps, found_ap, nm_ap_get_last_seen (merge_ap));
 		nm_ap_set_broadcast (found_ap, nm_ap_get_broadcast (merge_ap));
 		nm_ap_set_freq (found_ap, nm_ap_get_freq (merge_ap));
 		nm_ap_set_max_bitrate (found_ap, nm_ap_get_max_bitrate (merge_ap));
+		nm_wifi_ap_table_update (priv->aps, found_ap);
 
 		/* If the AP is noticed in a scan, it's automatically no longer
 		 * fake, since it clearly exists somewhere.
@@ -1955,11 +1996,10 @@ merge_scanned_ap (NMDeviceWifi *self,
 		            MAC_ARG (bssid->ether_addr_octet),
 		            merge_ap);
 
-		g_object_ref (merge_ap);
-		priv->ap_list = g_slist_prepend (priv->ap_list, merge_ap);
+		nm_wifi_ap_table_add (priv->aps, merge_ap);
 		nm_ap_export_to_dbus (merge_ap);
 		g_signal_emit (self, signals[ACCESS_POINT_ADDED], 0, merge_ap);
-		nm_device_recheck_available_connections (NM_DEVICE (self));
+		recheck_available_connections_for_ap (self, merge_ap);
 	}
 }
 
@@ -1970,21 +2010,23 @@ cull_scan_list (NMDeviceWifi *self)
 {
 	NMDeviceWifiPrivate *priv = NM_DEVICE_WIFI_GET_PRIVATE (self);
 	time_t now = time (NULL);
-	GSList *outdated_list = NULL;
+	const guint prune_interval_s = SCAN_INTERVAL_MAX * 3;
+	GSList *outdated_list = NULL, *candidates;
 	GSList *elt;
-	guint32 removed = 0, total = 0;
+	guint32 removed = 0, total;
 
 	priv->scanlist_cull_id = 0;
 
 	nm_log_dbg (LOGD_WIFI_SCAN, "(%s): checking scan list for outdated APs",
 	            nm_device_get_iface (NM_DEVICE (self)));
 
-	/* Walk the access point list and remove any access points older than
-	 * three times the inactive scan interval.
+	/* Remove any access points older than three times the inactive scan
+	 * interval; the table hands back only those, oldest first.
 	 */
-	for (elt = priv->ap_list; elt; elt = g_slist_next (elt), total++) {
+	total = nm_wifi_ap_table_size (priv->aps);
+	candidates = nm_wifi_ap_table_get_seen_before (priv->aps, now - prune_interval_s);
+	for (elt = candidates; elt; elt = g_slist_next (elt)) {
 		NMAccessPoint *ap = elt->data;
-		const guint prune_interval_s = SCAN_INTERVAL_MAX * 3;
 
 		/* Don't cull the associated AP or manually created APs */
 		if (ap == priv->current_ap || nm_ap_get_fake (ap))
@@ -2001,9 +2043,9 @@ cull_scan_list (NMDeviceWifi *self)
 		    && g_object_get_data (G_OBJECT (ap), WPAS_REMOVED_TAG) == NULL)
 			continue;
 
-		if (nm_ap_get_last_seen (ap) + prune_interval_s < now)
-			outdated_list = g_slist_append (outdated_list, ap);
+		outdated_list = g_slist_prepend (outdated_list, ap);
 	}
+	g_slist_free (candidates);
 
 	/* Remove outdated APs */
 	for (elt = outdated_list; elt; elt = g_slist_next (elt)) {
@@ -2033,9 +2075,6 @@ cull_scan_list (NMDeviceWifi *self)
 
 	ap_list_dump (self);
 
-	if(removed > 0)
-	    nm_device_recheck_available_connections (NM_DEVICE (self));
-
 	return FALSE;
 }
 
@@ -2088,26 +2127,29 @@ supplicant_iface_new_bss_cb (NMSupplicantInterface *iface,
 
 static void
 supplicant_iface_bss_updated_cb (NMSupplicantInterface *iface,
-                                 const char *object_path,
-                                 GHashTable *properties,
+                                 const char **object_paths,
                                  NMDeviceWifi *self)
 {
+	NMDeviceWifiPrivate *priv = NM_DEVICE_WIFI_GET_PRIVATE (self);
 	NMDeviceState state;
 	NMAccessPoint *ap;
+	guint32 now = (guint32) time (NULL);
+	const char **iter;
 
 	g_return_if_fail (self != NULL);
-	g_return_if_fail (object_path != NULL);
-	g_return_if_fail (properties != NULL);
+	g_return_if_fail (object_paths != NULL);
 
 	/* Ignore new APs when unavailable or unamnaged */
 	state = nm_device_get_state (NM_DEVICE (self));
 	if (state <= NM_DEVICE_STATE_UNAVAILABLE)
 		return;
 
-	/* Update the AP's last-seen property */
-	ap = get_ap_by_supplicant_path (self, object_path);
-	if (ap)
-		nm_ap_set_last_seen (ap, (guint32) time (NULL));
+	/* Update the APs' last-seen property */
+	for (iter = object_paths; *iter; iter++) {
+		ap = get_ap_by_supplicant_path (self, *iter);
+		if (ap)
+			nm_wifi_ap_table_touch (priv->aps, ap, now);
+	}
 
 	/* Remove outdated access points */
 	schedule_scanlist_cull (self);
@@ -2930,7 +2972,7 @@ act_stage1_prepare (NMDevice *dev, NMDeviceStateReason *reason)
 	NMConnection *connection;
 	NMSettingWireless *s_wireless;
 	const GByteArray *cloned_mac;
-	GSList *iter;
+	GList *iter;
 	const char *mode;
 
 	req = nm_device_get_act_request (NM_DEVICE (self));
@@ -2977,7 +3019,7 @@ act_stage1_prepare (NMDevice *dev, NMDeviceStateReason *reason)
 			goto done;
 
 		/* Find a compatible AP in the scan list */
-		for (iter = priv->ap_list; iter; iter = g_slist_next (iter)) {
+		for (iter = nm_wifi_ap_table_get_list (priv->aps); iter; iter = g_list_next (iter)) {
 			NMAccessPoint *candidate = NM_AP (iter->data);
 
 			if (nm_ap_check_compatible (candidate, connection)) {
@@ -3002,10 +3044,11 @@ act_stage1_prepare (NMDevice *dev, NMDeviceStateReason *reason)
 		else if (nm_ap_is_hotspot (ap))
 			nm_ap_set_address (ap, (const struct ether_addr *) &priv->hw_addr);
 
-		priv->ap_list = g_slist_prepend (priv->ap_list, ap);
+		nm_wifi_ap_table_add (priv->aps, ap);
+		g_object_unref (ap);
 		nm_ap_export_to_dbus (ap);
 		g_signal_emit (self, signals[ACCESS_POINT_ADDED], 0, ap);
-		nm_device_recheck_available_connections (NM_DEVICE (self));
+		recheck_available_connections_for_ap (self, ap);
 	}
 
 	nm_active_connection_set_specific_object (NM_ACTIVE_CONNECTION (req), nm_ap_get_dbus_path (ap));
@@ -3347,14 +3390,15 @@ activation_success_handler (NMDevice *dev)
 		 */
 
 		/* If the better match was a hidden AP, update it's SSID */
-		if (!ssid || nm_utils_is_empty_ssid (ssid->data, ssid->len))
+		if (!ssid || nm_utils_is_empty_ssid (ssid->data, ssid->len)) {
 			nm_ap_set_ssid (tmp_ap, nm_ap_get_ssid (ap));
+			recheck_available_connections_for_ap (self, tmp_ap);
+		}
 
 		nm_active_connection_set_specific_object (NM_ACTIVE_CONNECTION (req),
 		                                          nm_ap_get_dbus_path (tmp_ap));
 
-		priv->ap_list = g_slist_remove (priv->ap_list, ap);
-		g_object_unref (ap);
+		nm_wifi_ap_table_remove (priv->aps, ap);
 	}
 
 done:
@@ -3622,7 +3666,10 @@ nm_device_wifi_new (const char *udi,
 static void
 nm_device_wifi_init (NMDeviceWifi *self)
 {
-	NM_DEVICE_WIFI_GET_PRIVATE (self)->mode = NM_802_11_MODE_INFRA;
+	NMDeviceWifiPrivate *priv = NM_DEVICE_WIFI_GET_PRIVATE (self);
+
+	priv->mode = NM_802_11_MODE_INFRA;
+	priv->aps = nm_wifi_ap_table_new ();
 }
 
 static void
@@ -3653,6 +3700,8 @@ dispose (GObject *object)
 
 	set_active_ap (self, NULL);
 	remove_all_aps (self);
+	nm_wifi_ap_table_free (priv->aps);
+	priv->aps = NULL;
 
 	if (priv->wifi_data)
 		wifi_utils_deinit (priv->wifi_data);
@@ -3752,6 +3801,7 @@ nm_device_wifi_class_init (NMDeviceWifiClass *klass)
 	parent_class->is_available = is_available;
 	parent_class->check_connection_compatible = check_connection_compatible;
 	parent_class->check_connection_available = check_connection_available;
+	parent_class->get_availability_key = get_availability_key;
 	parent_class->complete_connection = complete_connection;
 	parent_class->set_enabled = set_enabled;
 
@@ -64,6 +64,7 @@
 #include "nm-settings-connection.h"
 #include "nm-connection-provider.h"
 #include "nm-posix-signals.h"
+#include "nm-share-rules.h"
 #include "nm-manager-auth.h"
 #include "nm-dbus-glib-types.h"
 #include "nm-dispatcher.h"
@@ -181,6 +182,8 @@ typedef struct {
 	RfKillType    rfkill_type;
 	gboolean      firmware_missing;
 	GHashTable *  available_connections;
+	GHashTable *  availability_keys;   /* NMConnection -> availability key */
+	GHashTable *  availability_index;  /* availability key -> GSList of NMConnection */
 
 	guint32         ip4_address;
 
@@ -307,6 +310,8 @@ nm_device_init (NMDevice *self)
 	priv->rfkill_type = RFKILL_TYPE_UNKNOWN;
 	priv->autoconnect = DEFAULT_AUTOCONNECT;
 	priv->available_connections = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, NULL);
+	priv->availability_keys = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, g_free);
+	priv->availability_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_slist_free);
 }
 
 static void
@@ -3244,24 +3249,12 @@ nm_device_activate_schedule_ip6_config_timeout (NMDevice *self)
 	             nm_device_get_iface (self));
 }
 
-static void
-share_child_setup (gpointer user_data G_GNUC_UNUSED)
-{
-	/* We are in the child process at this point */
-	pid_t pid = getpid ();
-	setpgid (pid, pid);
-
-	nm_unblock_posix_signals (NULL);
-}
-
 static gboolean
 share_init (void)
 {
-	int status;
-	char *modules[] = { "ip_tables", "iptable_nat", "nf_nat_ftp", "nf_nat_irc",
-	                    "nf_nat_sip", "nf_nat_tftp", "nf_nat_pptp", "nf_nat_h323",
-	                    NULL };
-	char **iter;
+	const char *modules[] = { "ip_tables", "iptable_nat", "nf_nat_ftp", "nf_nat_irc",
+	                          "nf_nat_sip", "nf_nat_tftp", "nf_nat_pptp", "nf_nat_h323",
+	                          NULL };
 
 	if (!nm_utils_do_sysctl ("/proc/sys/net/ipv4/ip_forward", "1")) {
 		nm_log_err (LOGD_SHARING, "Error starting IP forwarding: (%d) %s",
@@ -3274,20 +3267,8 @@ share_init (void)
 					errno, strerror (errno));
 	}
 
-	for (iter = modules; *iter; iter++) {
-		char *argv[3] = { "/sbin/modprobe", *iter, NULL };
-		char *envp[1] = { NULL };
-		GError *error = NULL;
-
-		if (!g_spawn_sync ("/", argv, envp, G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL,
-		                   share_child_setup, NULL, NULL, NULL, &status, &error)) {
-			nm_log_err (LOGD_SHARING, "error loading NAT module %s: (%d) %s",
-			            *iter, error ? error->code : 0,
-			            (error && error->message) ? error->message : "unknown");
-			if (error)
-				g_error_free (error);
-		}
-	}
+	/* The share rules are only sent to iptables once this has finished */
+	nm_share_rules_load_modules (modules);
 
 	return TRUE;
 }
@@ -4332,6 +4313,8 @@ dispose (GObject *object)
 	}
 
 	g_hash_table_unref (priv->available_connections);
+	g_hash_table_unref (priv->availability_index);
+	g_hash_table_unref (priv->availability_keys);
 
 	activation_source_clear (self, TRUE, AF_INET);
 	activation_source_clear (self, TRUE, AF_INET6);
@@ -5506,28 +5489,43 @@ _signal_available_connections_changed (NMDevice *device)
 static void
 _clear_available_connections (NMDevice *device, gboolean do_signal)
 {
-	g_hash_table_remove_all (NM_DEVICE_GET_PRIVATE (device)->available_connections);
-	if (do_signal == TRUE)
+	NMDevicePrivate *priv = NM_DEVICE_GET_PRIVATE (device);
+	gboolean had_any;
+
+	had_any = g_hash_table_size (priv->available_connections) > 0;
+	g_hash_table_remove_all (priv->available_connections);
+	if (do_signal == TRUE && had_any)
 		_signal_available_connections_changed (device);
 }
 
+/* Re-evaluates one connection; returns TRUE if its membership in the
+ * available connections changed.
+ */
 static gboolean
-_try_add_available_connection (NMDevice *self, NMConnection *connection)
+_recheck_available_connection (NMDevice *self, NMConnection *connection)
 {
-	if (nm_device_get_state (self) < NM_DEVICE_STATE_DISCONNECTED)
-		return FALSE;
+	NMDevicePrivate *priv = NM_DEVICE_GET_PRIVATE (self);
+	gboolean available = FALSE, was_available;
 
-	if (nm_device_check_connection_compatible (self, connection, NULL)) {
+	if (   nm_device_get_state (self) >= NM_DEVICE_STATE_DISCONNECTED
+	    && nm_device_check_connection_compatible (self, connection, NULL)) {
 		/* Let subclasses implement additional checks on the connection */
 		if (   NM_DEVICE_GET_CLASS (self)->check_connection_available
-		    && NM_DEVICE_GET_CLASS (self)->check_connection_available (self, connection)) {
-
-			g_hash_table_insert (NM_DEVICE_GET_PRIVATE (self)->available_connections,
-					             g_object_ref (connection),
-					             GUINT_TO_POINTER (1));
-		}
+		    && NM_DEVICE_GET_CLASS (self)->check_connection_available (self, connection))
+			available = TRUE;
 	}
-	return FALSE;
+
+	was_available = g_hash_table_lookup (priv->available_connections, connection) != NULL;
+	if (available == was_available)
+		return FALSE;
+
+	if (available) {
+		g_hash_table_insert (priv->available_connections,
+		                     g_object_ref (connection),
+		                     GUINT_TO_POINTER (1));
+	} else
+		g_hash_table_remove (priv->available_connections, connection);
+	return TRUE;
 }
 
 static gboolean
@@ -5545,50 +5543,168 @@ check_connection_available (NMDevice *device, NMConnection *connection)
 	return TRUE;
 }
 
+static void
+_availability_index_remove (NMDevice *self, NMConnection *connection)
+{
+	NMDevicePrivate *priv = NM_DEVICE_GET_PRIVATE (self);
+	const char *key;
+	char *orig_key = NULL;
+	GSList *bucket = NULL;
+
+	key = g_hash_table_lookup (priv->availability_keys, connection);
+	if (!key)
+		return;
+
+	/* Steal the bucket so the list head can change underneath */
+	if (g_hash_table_lookup_extended (priv->availability_index, key,
+	                                  (gpointer *) &orig_key, (gpointer *) &bucket)) {
+		g_hash_table_steal (priv->availability_index, key);
+		bucket = g_slist_remove (bucket, connection);
+		if (bucket)
+			g_hash_table_insert (priv->availability_index, orig_key, bucket);
+		else
+			g_free (orig_key);
+	}
+
+	g_hash_table_remove (priv->availability_keys, connection);
+}
+
+/* (Re)indexes @connection under its current key; safe to call for a
+ * connection that is already indexed.
+ */
+static void
+_availability_index_add (NMDevice *self, NMConnection *connection)
+{
+	NMDevicePrivate *priv = NM_DEVICE_GET_PRIVATE (self);
+	char *key, *orig_key = NULL;
+	GSList *bucket = NULL;
+
+	_availability_index_remove (self, connection);
+
+	if (!NM_DEVICE_GET_CLASS (self)->get_availability_key)
+		return;
+
+	key = NM_DEVICE_GET_CLASS (self)->get_availability_key (self, connection);
+	if (!key)
+		return;
+
+	if (g_hash_table_lookup_extended (priv->availability_index, key,
+	                                  (gpointer *) &orig_key, (gpointer *) &bucket))
+		g_hash_table_steal (priv->availability_index, key);
+	else
+		orig_key = g_strdup (key);
+
+	bucket = g_slist_prepend (bucket, connection);
+	g_hash_table_insert (priv->availability_index, orig_key, bucket);
+	g_hash_table_insert (priv->availability_keys, g_object_ref (connection), key);
+}
+
+/**
+ * nm_device_recheck_available_connections:
+ * @device: the #NMDevice
+ *
+ * Re-evaluates every connection from the connection provider and signals
+ * the AvailableConnections property only if the set changed.
+ **/
 void
 nm_device_recheck_available_connections (NMDevice *device)
 {
 	NMDevicePrivate *priv;
 	const GSList *connections, *iter;
+	GHashTable *stale;
+	GHashTableIter hiter;
+	NMConnection *connection;
+	gboolean changed = FALSE;
 
 	g_return_if_fail (device != NULL);
 	g_return_if_fail (NM_IS_DEVICE (device));
 
 	priv = NM_DEVICE_GET_PRIVATE(device);
 
-	_clear_available_connections (device, FALSE);
+	/* Connections no longer known to the provider get dropped below */
+	stale = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_hash_table_iter_init (&hiter, priv->available_connections);
+	while (g_hash_table_iter_next (&hiter, (gpointer) &connection, NULL))
+		g_hash_table_insert (stale, connection, connection);
+
+	g_hash_table_remove_all (priv->availability_index);
+	g_hash_table_remove_all (priv->availability_keys);
 
 	connections = nm_connection_provider_get_connections (priv->con_provider);
-	for (iter = connections; iter; iter = g_slist_next (iter))
-		_try_add_available_connection (device, NM_CONNECTION (iter->data));
+	for (iter = connections; iter; iter = g_slist_next (iter)) {
+		connection = NM_CONNECTION (iter->data);
+
+		g_hash_table_remove (stale, connection);
+		_availability_index_add (device, connection);
+		changed |= _recheck_available_connection (device, connection);
+	}
+
+	g_hash_table_iter_init (&hiter, stale);
+	while (g_hash_table_iter_next (&hiter, (gpointer) &connection, NULL))
+		changed |= _del_available_connection (device, connection);
+	g_hash_table_destroy (stale);
 
-	_signal_available_connections_changed (device);
+	if (changed)
+		_signal_available_connections_changed (device);
+}
+
+/**
+ * nm_device_recheck_available_connections_by_key:
+ * @device: the #NMDevice
+ * @key: an availability key, as returned by the class' get_availability_key()
+ *
+ * Re-evaluates only the connections indexed under @key, for example after
+ * an access point with that SSID appeared or disappeared.
+ **/
+void
+nm_device_recheck_available_connections_by_key (NMDevice *device, const char *key)
+{
+	NMDevicePrivate *priv;
+	GSList *iter;
+	gboolean changed = FALSE;
+
+	g_return_if_fail (NM_IS_DEVICE (device));
+
+	if (!key)
+		return;
+
+	priv = NM_DEVICE_GET_PRIVATE (device);
+	for (iter = g_hash_table_lookup (priv->availability_index, key); iter; iter = g_slist_next (iter))
+		changed |= _recheck_available_connection (device, NM_CONNECTION (iter->data));
+
+	if (changed)
+		_signal_available_connections_changed (device);
 }
 
 static void
 cp_connection_added (NMConnectionProvider *cp, NMConnection *connection, gpointer user_data)
 {
-	if (_try_add_available_connection (NM_DEVICE (user_data), connection))
+	_availability_index_add (NM_DEVICE (user_data), connection);
+	if (_recheck_available_connection (NM_DEVICE (user_data), connection))
 		_signal_available_connections_changed (NM_DEVICE (user_data));
 }
 
 static void
 cp_connections_loaded (NMConnectionProvider *cp, NMConnection *connection, gpointer user_data)
 {
+	NMDevice *self = NM_DEVICE (user_data);
 	const GSList *connections, *iter;
 	gboolean added = FALSE;
 
 	connections = nm_connection_provider_get_connections (cp);
-	for (iter = connections; iter; iter = g_slist_next (iter))
-		added |= _try_add_available_connection (NM_DEVICE (user_data), NM_CONNECTION (iter->data));
+	for (iter = connections; iter; iter = g_slist_next (iter)) {
+		_availability_index_add (self, NM_CONNECTION (iter->data));
+		added |= _recheck_available_connection (self, NM_CONNECTION (iter->data));
+	}
 
 	if (added)
-		_signal_available_connections_changed (NM_DEVICE (user_data));
+		_signal_available_connections_changed (self);
 }
 
 static void
 cp_connection_removed (NMConnectionProvider *cp, NMConnection *connection, gpointer user_data)
 {
+	_availability_index_remove (NM_DEVICE (user_data), connection);
 	if (_del_available_connection (NM_DEVICE (user_data), connection))
 		_signal_available_connections_changed (NM_DEVICE (user_data));
 }
@@ -5596,14 +5712,10 @@ cp_connection_removed (NMConnectionProvider *cp, NMConnection *connection, gpoin
 static void
 cp_connection_updated (NMConnectionProvider *cp, NMConnection *connection, gpointer user_data)
 {
-	gboolean added, deleted;
-
-	/* FIXME: don't remove it from the hash if it's just going to get re-added */
-	deleted = _del_available_connection (NM_DEVICE (user_data), connection);
-	added = _try_add_available_connection (NM_DEVICE (user_data), connection);
+	/* The SSID or network name may have changed */
+	_availability_index_add (NM_DEVICE (user_data), connection);
 
-	/* Only signal if the connection was removed OR added, but not both */
-	if (added != deleted)
+	if (_recheck_available_connection (NM_DEVICE (user_data), connection))
 		_signal_available_connections_changed (NM_DEVICE (user_data));
 }
 
@@ -143,6 +143,14 @@ typedef struct {
 	gboolean    (* check_connection_available) (NMDevice *self,
 	                                            NMConnection *connection);
 
+	/* Returns a key (eg SSID or NSP name) naming the live network that
+	 * @connection depends on for availability, or NULL.  Used to recheck
+	 * only the affected connections when a network appears or disappears;
+	 * see nm_device_recheck_available_connections_by_key().
+	 */
+	char *      (* get_availability_key)        (NMDevice *self,
+	                                             NMConnection *connection);
+
 	gboolean    (* complete_connection)         (NMDevice *self,
 	                                             NMConnection *connection,
 	                                             const char *specific_object,
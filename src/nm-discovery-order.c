@@ -0,0 +1,104 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#include "nm-discovery-order.h"
+
+typedef struct {
+	GHashTable *by_ifindex;
+	GHashTable *seen;
+	GSList *ordered;
+	NMDiscoveryIfindexFunc get_ifindex;
+	NMDiscoveryDependFunc depends_on;
+	gpointer user_data;
+} OrderData;
+
+static void
+visit (OrderData *data, gpointer item)
+{
+	int ifindex, deps[2] = { 0, 0 };
+	guint i;
+
+	/* Already placed, or on the current path if the links form a loop */
+	if (g_hash_table_lookup (data->seen, item))
+		return;
+	g_hash_table_insert (data->seen, item, item);
+
+	ifindex = data->get_ifindex (item);
+	if (ifindex > 0)
+		data->depends_on (ifindex, &deps[0], &deps[1], data->user_data);
+
+	for (i = 0; i < G_N_ELEMENTS (deps); i++) {
+		gpointer dep;
+
+		if (deps[i] <= 0 || deps[i] == ifindex)
+			continue;
+		dep = g_hash_table_lookup (data->by_ifindex, GINT_TO_POINTER (deps[i]));
+		if (dep)
+			visit (data, dep);
+	}
+
+	data->ordered = g_slist_prepend (data->ordered, item);
+}
+
+/**
+ * nm_discovery_order:
+ * @items: (transfer full): the devices, in the order they were found
+ * @get_ifindex: returns the interface index of an item, or <= 0 for none
+ * @depends_on: returns the interfaces an interface index depends on
+ * @user_data: passed to @depends_on
+ *
+ * Returns: (transfer full): @items, reordered; dependencies that aren't in
+ *   @items are ignored.
+ **/
+GSList *
+nm_discovery_order (GSList *items,
+                    NMDiscoveryIfindexFunc get_ifindex,
+                    NMDiscoveryDependFunc depends_on,
+                    gpointer user_data)
+{
+	OrderData data;
+	GSList *iter;
+
+	g_return_val_if_fail (get_ifindex != NULL, items);
+	g_return_val_if_fail (depends_on != NULL, items);
+
+	data.by_ifindex = g_hash_table_new (g_direct_hash, g_direct_equal);
+	data.seen = g_hash_table_new (g_direct_hash, g_direct_equal);
+	data.ordered = NULL;
+	data.get_ifindex = get_ifindex;
+	data.depends_on = depends_on;
+	data.user_data = user_data;
+
+	for (iter = items; iter; iter = g_slist_next (iter)) {
+		int ifindex = get_ifindex (iter->data);
+
+		/* Like the old lookups, the first device with an index wins */
+		if (ifindex > 0 && !g_hash_table_lookup (data.by_ifindex, GINT_TO_POINTER (ifindex)))
+			g_hash_table_insert (data.by_ifindex, GINT_TO_POINTER (ifindex), iter->data);
+	}
+
+	for (iter = items; iter; iter = g_slist_next (iter))
+		visit (&data, iter->data);
+
+	g_hash_table_destroy (data.by_ifindex);
+	g_hash_table_destroy (data.seen);
+	g_slist_free (items);
+	return g_slist_reverse (data.ordered);
+}
@@ -0,0 +1,45 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#ifndef NM_DISCOVERY_ORDER_H
+#define NM_DISCOVERY_ORDER_H
+
+#include <glib.h>
+
+/* Orders the devices found at startup so that each one comes after the
+ * devices it needs: VLANs after their parent, and bond or bridge ports after
+ * their master.  Otherwise the order of the list is kept.
+ */
+typedef int  (*NMDiscoveryIfindexFunc) (gpointer item);
+
+/* Sets *out_parent and *out_master to the interface indexes @ifindex depends
+ * on, or leaves them 0.
+ */
+typedef void (*NMDiscoveryDependFunc)  (int ifindex,
+                                        int *out_parent,
+                                        int *out_master,
+                                        gpointer user_data);
+
+GSList *nm_discovery_order (GSList *items,
+                            NMDiscoveryIfindexFunc get_ifindex,
+                            NMDiscoveryDependFunc depends_on,
+                            gpointer user_data);
+
+#endif  /* NM_DISCOVERY_ORDER_H */
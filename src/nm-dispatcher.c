@@ -32,6 +32,24 @@
 
 static GSList *requests = NULL;
 
+static DispatcherFlushFunc flush_func = NULL;
+static gpointer flush_data = NULL;
+
+/**
+ * nm_dispatcher_set_flush_func:
+ * @func: function to call before each dispatcher call, or %NULL
+ * @user_data: data for @func
+ *
+ * Lets whoever batches state that scripts read (like the DNS manager's
+ * update window) write it out before the scripts run.
+ **/
+void
+nm_dispatcher_set_flush_func (DispatcherFlushFunc func, gpointer user_data)
+{
+	flush_func = func;
+	flush_data = user_data;
+}
+
 static void
 dump_object_to_props (GObject *object, GHashTable *hash)
 {
@@ -275,6 +293,12 @@ _dispatcher_call (DispatcherAction action,
 	if (action == DISPATCHER_ACTION_VPN_UP)
 		g_return_val_if_fail (vpn_ip4_config != NULL, NULL);
 
+	/* Scripts expect eg resolv.conf to match the configuration they are
+	 * told about, even if it is normally written out a little later.
+	 */
+	if (flush_func)
+		flush_func (flush_data);
+
 	dbus_mgr = nm_dbus_manager_get ();
 	g_connection = nm_dbus_manager_get_connection (dbus_mgr);
 	proxy = dbus_g_proxy_new_for_name (g_connection,
@@ -61,4 +61,11 @@ gconstpointer nm_dispatcher_call_vpn (DispatcherAction action,
 
 void nm_dispatcher_call_cancel (gconstpointer call);
 
+/* Called before every dispatcher call, to write out anything the scripts
+ * may read that is still pending (eg resolv.conf).
+ */
+typedef void (*DispatcherFlushFunc) (gpointer user_data);
+
+void nm_dispatcher_set_flush_func (DispatcherFlushFunc func, gpointer user_data);
+
 #endif /* NM_DISPATCHER_H */
@@ -54,6 +54,9 @@ typedef struct {
 	char *permission;
 	guint idle_id;
 	gboolean disposed;
+
+	char *cache_key;   /* set if the result may be cached */
+	gint64 start_time;
 } AuthCall;
 
 typedef struct {
@@ -72,7 +75,149 @@ free_data (gpointer data)
 	g_free (tmp);
 }
 
+static NMAuthStats auth_stats;
+
 #if WITH_POLKIT
+
+/* PolicyKit results for non-interactive checks, keyed by (bus name, action).
+ * Bus names are unique and never reused, so an entry can only go stale
+ * when the policy, the temporary authorizations or the set of active
+ * sessions changes; the first two are announced by the authority's
+ * "changed" signal, the last by the session monitor.  Entries also expire
+ * after a short while in case a temporary authorization runs out quietly.
+ * The cache is bounded, evicting the least recently used entry.
+ */
+#define AUTH_CACHE_MAX_ENTRIES 256
+#define AUTH_CACHE_TTL         (10 * G_USEC_PER_SEC)
+#define AUTH_STATS_LOG_INTERVAL 100
+
+typedef struct {
+	char *key;
+	NMAuthCallResult result;
+	gint64 expires;
+	GList *lru_link;
+} AuthCacheEntry;
+
+static GHashTable *auth_cache = NULL;  /* key -> AuthCacheEntry */
+static GQueue auth_cache_lru = G_QUEUE_INIT;  /* most recently used first */
+
+static void pk_authority_changed_cb (GObject *object, gpointer unused);
+
+static char *
+auth_cache_key (const char *owner, const char *permission)
+{
+	return g_strdup_printf ("%s %s", owner, permission);
+}
+
+static void
+auth_cache_entry_free (gpointer data)
+{
+	AuthCacheEntry *entry = data;
+
+	g_queue_delete_link (&auth_cache_lru, entry->lru_link);
+	g_free (entry->key);
+	g_slice_free (AuthCacheEntry, entry);
+}
+
+static void
+auth_cache_flush (void)
+{
+	if (auth_cache && g_hash_table_size (auth_cache)) {
+		nm_log_dbg (LOGD_CORE, "flushing %u cached authorization results",
+		            g_hash_table_size (auth_cache));
+		g_hash_table_remove_all (auth_cache);
+	}
+}
+
+static void
+session_changed_cb (NMSessionMonitor *monitor, gpointer user_data)
+{
+	auth_cache_flush ();
+}
+
+static void
+auth_cache_init (void)
+{
+	NMSessionMonitor *monitor;
+
+	if (auth_cache)
+		return;
+
+	auth_cache = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, auth_cache_entry_free);
+
+	/* The monitor is a singleton; keep our reference for the process lifetime */
+	monitor = nm_session_monitor_get ();
+	g_signal_connect (monitor, NM_SESSION_MONITOR_CHANGED, G_CALLBACK (session_changed_cb), NULL);
+}
+
+/* A non-interactive result says everything about an interactive check
+ * except when the caller could authenticate: then the interactive check
+ * has to ask the user.
+ */
+static gboolean
+auth_cache_lookup (const char *key, gboolean allow_interaction, NMAuthCallResult *out_result)
+{
+	AuthCacheEntry *entry;
+
+	entry = g_hash_table_lookup (auth_cache, key);
+	if (!entry)
+		return FALSE;
+
+	if (entry->expires <= g_get_monotonic_time ()) {
+		g_hash_table_remove (auth_cache, key);
+		return FALSE;
+	}
+
+	if (allow_interaction && entry->result == NM_AUTH_CALL_RESULT_AUTH)
+		return FALSE;
+
+	g_queue_unlink (&auth_cache_lru, entry->lru_link);
+	g_queue_push_head_link (&auth_cache_lru, entry->lru_link);
+
+	*out_result = entry->result;
+	return TRUE;
+}
+
+static void
+auth_cache_add (char *key, NMAuthCallResult result)
+{
+	AuthCacheEntry *entry;
+
+	while (g_hash_table_size (auth_cache) >= AUTH_CACHE_MAX_ENTRIES) {
+		entry = g_queue_peek_tail (&auth_cache_lru);
+		g_hash_table_remove (auth_cache, entry->key);
+	}
+
+	entry = g_slice_new0 (AuthCacheEntry);
+	entry->key = key;
+	entry->result = result;
+	entry->expires = g_get_monotonic_time () + AUTH_CACHE_TTL;
+	g_queue_push_head (&auth_cache_lru, entry);
+	entry->lru_link = g_queue_peek_head_link (&auth_cache_lru);
+
+	/* Replaces (and frees) any older entry for the key */
+	g_hash_table_replace (auth_cache, entry->key, entry);
+}
+
+static void
+auth_stats_add_call (gint64 start_time)
+{
+	guint64 elapsed = g_get_monotonic_time () - start_time;
+
+	auth_stats.pk_calls++;
+	auth_stats.pk_time_total_us += elapsed;
+	auth_stats.pk_time_max_us = MAX (auth_stats.pk_time_max_us, elapsed);
+
+	if (auth_stats.pk_calls % AUTH_STATS_LOG_INTERVAL == 0) {
+		nm_log_dbg (LOGD_CORE, "authorization: %" G_GUINT64_FORMAT " cache hits, %"
+		            G_GUINT64_FORMAT " misses; %" G_GUINT64_FORMAT " PolicyKit calls, "
+		            "avg %" G_GUINT64_FORMAT " us, max %" G_GUINT64_FORMAT " us",
+		            auth_stats.cache_hits, auth_stats.cache_misses, auth_stats.pk_calls,
+		            auth_stats.pk_time_total_us / auth_stats.pk_calls,
+		            auth_stats.pk_time_max_us);
+	}
+}
+
 static PolkitAuthority *
 pk_authority_get (void)
 {
@@ -88,6 +233,13 @@ pk_authority_get (void)
 			g_clear_error (&error);
 			return NULL;
 		}
+
+		/* Cached results must be dropped whenever polkit says so */
+		auth_cache_init ();
+		g_signal_connect (authority,
+		                  "changed",
+		                  G_CALLBACK (pk_authority_changed_cb),
+		                  NULL);
 	}
 
 	/* Yes, ref every time; we want to keep the object alive */
@@ -313,6 +465,8 @@ auth_call_free (AuthCall *call)
 	call->disposed = TRUE;
 	g_free (call->permission);
 	call->permission = NULL;
+	g_free (call->cache_key);
+	call->cache_key = NULL;
 	call->chain = NULL;
 	g_object_unref (call->cancellable);
 	call->cancellable = NULL;
@@ -360,6 +514,7 @@ pk_call_cb (GObject *object, GAsyncResult *result, gpointer user_data)
 	}
 
 	pk_result = polkit_authority_check_authorization_finish (chain->authority, result, &error);
+	auth_stats_add_call (call->start_time);
 	if (error) {
 		if (!chain->error)
 			chain->error = g_error_copy (error);
@@ -381,6 +536,11 @@ pk_call_cb (GObject *object, GAsyncResult *result, gpointer user_data)
 			call_result = NM_AUTH_CALL_RESULT_NO;
 
 		nm_auth_chain_set_data (chain, call->permission, GUINT_TO_POINTER (call_result), NULL);
+
+		if (call->cache_key) {
+			auth_cache_add (call->cache_key, call_result);
+			call->cache_key = NULL;
+		}
 	}
 
 	g_clear_error (&error);
@@ -401,26 +561,48 @@ nm_auth_chain_add_call (NMAuthChain *self,
 #if WITH_POLKIT
 	PolkitSubject *subject;
 	PolkitCheckAuthorizationFlags flags = POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE;
+	NMAuthCallResult cached;
+	char *key;
 
 	g_return_val_if_fail (self != NULL, FALSE);
 	g_return_val_if_fail (self->owner != NULL, FALSE);
 	g_return_val_if_fail (permission != NULL, FALSE);
 
-	subject = polkit_system_bus_name_new (self->owner);
-	if (!subject)
-		return FALSE;
-
-	call = auth_call_new (self, permission);
-
 	if (self->authority == NULL) {
 		/* No polkit, no authorization */
+		call = auth_call_new (self, permission);
 		auth_call_schedule_early_finish (call, g_error_new_literal (0, 0, "PolicyKit unavailable"));
-		g_object_unref (subject);
 		return FALSE;
 	}
 
-	if (allow_interaction)
+	key = auth_cache_key (self->owner, permission);
+	if (auth_cache_lookup (key, allow_interaction, &cached)) {
+		auth_stats.cache_hits++;
+		call = auth_call_new (self, permission);
+		nm_auth_chain_set_data (self, permission, GUINT_TO_POINTER (cached), NULL);
+		auth_call_schedule_early_finish (call, NULL);
+		g_free (key);
+		return TRUE;
+	}
+	auth_stats.cache_misses++;
+
+	subject = polkit_system_bus_name_new (self->owner);
+	if (!subject) {
+		g_free (key);
+		return FALSE;
+	}
+
+	call = auth_call_new (self, permission);
+	call->start_time = g_get_monotonic_time ();
+
+	/* Whether the user would agree to an interactive request is not
+	 * something we can remember, so only cache non-interactive checks.
+	 */
+	if (allow_interaction) {
 		flags = POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION;
+		g_free (key);
+	} else
+		call->cache_key = key;
 
 	polkit_authority_check_authorization (self->authority,
 	                                      subject,
@@ -475,19 +657,55 @@ nm_auth_chain_unref (NMAuthChain *self)
 
 /************ utils **************/
 
-gboolean
-nm_auth_get_caller_uid (DBusGMethodInvocation *context,
-                        NMDBusManager *dbus_mgr,
-                        gulong *out_uid,
-                        char **out_error_desc)
+typedef struct {
+	DBusGMethodInvocation *context;
+	NMAuthCallerUidFunc callback;
+	gpointer user_data;
+} CallerUidInfo;
+
+static void
+caller_uid_done (NMDBusManager *dbus_mgr,
+                 const char *sender,
+                 gulong uid,
+                 gulong pid,
+                 GError *error,
+                 gpointer user_data)
+{
+	CallerUidInfo *info = user_data;
+
+	if (error) {
+		nm_log_dbg (LOGD_CORE, "could not get credentials of %s: %s", sender, error->message);
+		info->callback (info->context, G_MAXULONG,
+		                "Could not determine the user ID of the requestor",
+		                info->user_data);
+	} else
+		info->callback (info->context, uid, NULL, info->user_data);
+
+	g_slice_free (CallerUidInfo, info);
+}
+
+/**
+ * nm_auth_get_caller_uid_async:
+ * @context: the D-Bus method invocation
+ * @dbus_mgr: (allow-none): the #NMDBusManager
+ * @callback: called with the caller's UID, or with an error description
+ * @user_data: data for @callback
+ *
+ * Determines the user ID of the process that sent @context without blocking
+ * the main loop.  Credentials are cached by the #NMDBusManager until the
+ * caller leaves the bus, in which case @callback is called right away.
+ **/
+void
+nm_auth_get_caller_uid_async (DBusGMethodInvocation *context,
+                              NMDBusManager *dbus_mgr,
+                              NMAuthCallerUidFunc callback,
+                              gpointer user_data)
 {
-	DBusConnection *connection;
-	char *sender = NULL;
-	gboolean success = FALSE;
-	DBusError dbus_error;
+	CallerUidInfo *info;
+	char *sender;
 
-	g_return_val_if_fail (context != NULL, FALSE);
-	g_return_val_if_fail (out_uid != NULL, FALSE);
+	g_return_if_fail (context != NULL);
+	g_return_if_fail (callback != NULL);
 
 	if (!dbus_mgr) {
 		dbus_mgr = nm_dbus_manager_get ();
@@ -495,37 +713,26 @@ nm_auth_get_caller_uid (DBusGMethodInvocation *context,
 	} else
 		g_object_ref (dbus_mgr);
 
-	*out_uid = G_MAXULONG;
-
 	sender = dbus_g_method_get_sender (context);
 	if (!sender) {
-		if (out_error_desc)
-			*out_error_desc = g_strdup ("Could not determine D-Bus requestor");
+		callback (context, G_MAXULONG, "Could not determine D-Bus requestor", user_data);
 		goto out;
 	}
 
-	connection = nm_dbus_manager_get_dbus_connection (dbus_mgr);
-	if (!connection) {
-		if (out_error_desc)
-			*out_error_desc = g_strdup ("Could not get the D-Bus system bus");
+	if (!nm_dbus_manager_get_dbus_connection (dbus_mgr)) {
+		callback (context, G_MAXULONG, "Could not get the D-Bus system bus", user_data);
 		goto out;
 	}
 
-	dbus_error_init (&dbus_error);
-	/* FIXME: do this async */
-	*out_uid = dbus_bus_get_unix_user (connection, sender, &dbus_error);
-	if (dbus_error_is_set (&dbus_error)) {
-		if (out_error_desc)
-			*out_error_desc = g_strdup_printf ("Could not determine the user ID of the requestor");
-		dbus_error_free (&dbus_error);
-		*out_uid = G_MAXULONG;
-	} else
-		success = TRUE;
+	info = g_slice_new0 (CallerUidInfo);
+	info->context = context;
+	info->callback = callback;
+	info->user_data = user_data;
+	nm_dbus_manager_get_caller_info_async (dbus_mgr, sender, caller_uid_done, info);
 
 out:
 	g_object_unref (dbus_mgr);
 	g_free (sender);
-	return success;
 }
 
 gboolean
@@ -584,6 +791,8 @@ pk_authority_changed_cb (GObject *object, gpointer unused)
 {
 	GSList *iter;
 
+	auth_cache_flush ();
+
 	for (iter = funcs; iter; iter = g_slist_next (iter)) {
 		PkChangedInfo *info = iter->data;
 
@@ -597,24 +806,16 @@ nm_auth_changed_func_register (GDestroyNotify callback, gpointer callback_data)
 {
 #if WITH_POLKIT
 	PolkitAuthority *authority;
-	static guint32 changed_id = 0;
 #endif
 	PkChangedInfo *info;
 	GSList *iter;
 	gboolean found = FALSE;
 
 #if WITH_POLKIT
+	/* Makes sure the authority's changed signal is hooked up */
 	authority = pk_authority_get ();
 	if (!authority)
 		return;
-
-	/* Hook up the changed signal the first time a callback is registered */
-	if (changed_id == 0) {
-		changed_id = g_signal_connect (authority,
-		                               "changed",
-		                               G_CALLBACK (pk_authority_changed_cb),
-		                               &funcs);
-	}
 #endif
 
 	/* No duplicates */
@@ -655,3 +856,17 @@ nm_auth_changed_func_unregister (GDestroyNotify callback, gpointer callback_data
 	}
 }
 
+/**
+ * nm_auth_get_stats:
+ * @out_stats: on return, the authorization counters
+ *
+ * Returns how many permission checks were answered from the cache, and how
+ * many PolicyKit calls were made and how long they took.
+ **/
+void
+nm_auth_get_stats (NMAuthStats *out_stats)
+{
+	g_return_if_fail (out_stats != NULL);
+
+	*out_stats = auth_stats;
+}
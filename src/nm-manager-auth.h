@@ -93,10 +93,17 @@ gboolean nm_auth_chain_add_call (NMAuthChain *chain,
 void nm_auth_chain_unref (NMAuthChain *chain);
 
 /* Utils */
-gboolean nm_auth_get_caller_uid (DBusGMethodInvocation *context,
-                                 NMDBusManager *dbus_mgr,
-                                 gulong *out_uid,
-                                 char **out_error_desc);
+
+/* @uid is G_MAXULONG and @error_desc is set if the UID could not be found */
+typedef void (*NMAuthCallerUidFunc) (DBusGMethodInvocation *context,
+                                     gulong uid,
+                                     const char *error_desc,
+                                     gpointer user_data);
+
+void nm_auth_get_caller_uid_async (DBusGMethodInvocation *context,
+                                   NMDBusManager *dbus_mgr,
+                                   NMAuthCallerUidFunc callback,
+                                   gpointer user_data);
 
 /* Caller must free returned error description */
 gboolean nm_auth_uid_in_acl (NMConnection *connection,
@@ -104,6 +111,16 @@ gboolean nm_auth_uid_in_acl (NMConnection *connection,
                              gulong uid,
                              char **out_error_desc);
 
+typedef struct {
+	guint64 cache_hits;
+	guint64 cache_misses;
+	guint64 pk_calls;
+	guint64 pk_time_total_us;
+	guint64 pk_time_max_us;
+} NMAuthStats;
+
+void nm_auth_get_stats (NMAuthStats *out_stats);
+
 void nm_auth_changed_func_register (GDestroyNotify callback, gpointer callback_data);
 
 void nm_auth_changed_func_unregister (GDestroyNotify callback, gpointer callback_data);
@@ -68,6 +68,8 @@
 #include "NetworkManagerUtils.h"
 #include "nm-utils.h"
 #include "nm-device-factory.h"
+#include "nm-device-index.h"
+#include "nm-discovery-order.h"
 #include "wifi-utils.h"
 #include "nm-enum-types.h"
 #include "nm-sleep-monitor.h"
@@ -165,6 +167,10 @@ static GSList * remove_one_device (NMManager *manager,
                                    NMDevice *device,
                                    gboolean quitting);
 
+static void device_index_keys_changed (NMDevice *device,
+                                       GParamSpec *pspec,
+                                       gpointer user_data);
+
 static void rfkill_change_wifi (const char *desc, gboolean enabled);
 
 #define SSD_POKE_INTERVAL 120
@@ -209,6 +215,7 @@ typedef struct {
 	guint ac_cleanup_id;
 
 	GSList *devices;
+	NMDeviceIndex *device_index;
 	NMState state;
 #if WITH_CONCHECK
 	NMConnectivity *connectivity;
@@ -248,6 +255,13 @@ typedef struct {
 
 	GHashTable *nm_bridges;
 
+	/* Startup discovery: one link snapshot for classifying all devices,
+	 * and the devices udev reported, created once they're all known.
+	 */
+	GHashTable *startup_links;
+	GSList *discovered;
+	gboolean discovering;
+
 	gboolean disposed;
 } NMManagerPrivate;
 
@@ -407,47 +421,37 @@ active_connection_get_by_path (NMManager *manager, const char *path)
 static NMDevice *
 nm_manager_get_device_by_udi (NMManager *manager, const char *udi)
 {
-	GSList *iter;
-
 	g_return_val_if_fail (udi != NULL, NULL);
 
-	for (iter = NM_MANAGER_GET_PRIVATE (manager)->devices; iter; iter = iter->next) {
-		if (!strcmp (nm_device_get_udi (NM_DEVICE (iter->data)), udi))
-			return NM_DEVICE (iter->data);
-	}
-	return NULL;
+	return nm_device_index_lookup_udi (NM_MANAGER_GET_PRIVATE (manager)->device_index, udi);
 }
 
 static NMDevice *
 nm_manager_get_device_by_path (NMManager *manager, const char *path)
 {
-	GSList *iter;
-
 	g_return_val_if_fail (path != NULL, NULL);
 
-	for (iter = NM_MANAGER_GET_PRIVATE (manager)->devices; iter; iter = iter->next) {
-		if (!strcmp (nm_device_get_path (NM_DEVICE (iter->data)), path))
-			return NM_DEVICE (iter->data);
-	}
-	return NULL;
+	return nm_device_index_lookup_path (NM_MANAGER_GET_PRIVATE (manager)->device_index, path);
 }
 
 NMDevice *
 nm_manager_get_device_by_master (NMManager *manager, const char *master, const char *driver)
 {
-	GSList *iter;
+	GSList *candidates, *iter;
+	NMDevice *device = NULL;
 
 	g_return_val_if_fail (master != NULL, NULL);
 
-	for (iter = NM_MANAGER_GET_PRIVATE (manager)->devices; iter; iter = iter->next) {
-		NMDevice *device = NM_DEVICE (iter->data);
-
-		if (!strcmp (nm_device_get_iface (device), master) &&
-		    (!driver || !strcmp (nm_device_get_driver (device), driver)))
-			return device;
+	candidates = nm_device_index_lookup_iface (NM_MANAGER_GET_PRIVATE (manager)->device_index, master);
+	for (iter = candidates; iter; iter = iter->next) {
+		if (!driver || !g_strcmp0 (nm_device_get_driver (iter->data), driver)) {
+			device = iter->data;
+			break;
+		}
 	}
+	g_slist_free (candidates);
 
-	return NULL;
+	return device;
 }
 
 static gboolean
@@ -623,6 +627,8 @@ remove_one_device (NMManager *manager,
 	}
 
 	g_signal_handlers_disconnect_by_func (device, manager_device_state_changed, manager);
+	g_signal_handlers_disconnect_by_func (device, device_index_keys_changed, manager);
+	nm_device_index_remove (priv->device_index, device);
 
 	nm_settings_device_removed (priv->settings, device);
 	g_signal_emit (manager, signals[DEVICE_REMOVED], 0, device);
@@ -664,7 +670,7 @@ aipd_handle_event (DBusGProxy *proxy,
 {
 	NMManager *manager = NM_MANAGER (user_data);
 	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (manager);
-	GSList *iter;
+	GSList *candidates;
 	gboolean handled = FALSE;
 
 	if (!event || !iface) {
@@ -680,15 +686,12 @@ aipd_handle_event (DBusGProxy *proxy,
 		return;
 	}
 
-	for (iter = priv->devices; iter; iter = g_slist_next (iter)) {
-		NMDevice *candidate = NM_DEVICE (iter->data);
-
-		if (!strcmp (nm_device_get_iface (candidate), iface)) {
-			nm_device_handle_autoip4_event (candidate, event, address);
-			handled = TRUE;
-			break;
-		}
+	candidates = nm_device_index_lookup_iface (priv->device_index, iface);
+	if (candidates) {
+		nm_device_handle_autoip4_event (candidates->data, event, address);
+		handled = TRUE;
 	}
+	g_slist_free (candidates);
 
 	if (!handled)
 		nm_log_warn (LOGD_AUTOIP4, "(%s): unhandled avahi-autoipd event", iface);
@@ -873,29 +876,23 @@ out:
 }
 
 static void
-pending_activation_check_authorized (PendingActivation *pending,
-                                     NMDBusManager *dbus_mgr)
+pending_activation_caller_uid_cb (DBusGMethodInvocation *context,
+                                  gulong sender_uid,
+                                  const char *error_desc,
+                                  gpointer user_data)
 {
-	char *error_desc = NULL;
-	gulong sender_uid = G_MAXULONG;
+	PendingActivation *pending = user_data;
 	GError *error;
 	const char *wifi_permission = NULL;
 	NMConnection *connection;
 	NMSettings *settings;
 
-	g_return_if_fail (pending != NULL);
-	g_return_if_fail (dbus_mgr != NULL);
-
-	if (!nm_auth_get_caller_uid (pending->context, 
-	                             dbus_mgr,
-	                             &sender_uid,
-	                             &error_desc)) {
+	if (error_desc) {
 		error = g_error_new_literal (NM_MANAGER_ERROR,
 		                             NM_MANAGER_ERROR_PERMISSION_DENIED,
 		                             error_desc);
 		pending->callback (pending, error);
 		g_error_free (error);
-		g_free (error_desc);
 		return;
 	}
 
@@ -941,6 +938,19 @@ pending_activation_check_authorized (PendingActivation *pending,
 	}
 }
 
+static void
+pending_activation_check_authorized (PendingActivation *pending,
+                                     NMDBusManager *dbus_mgr)
+{
+	g_return_if_fail (pending != NULL);
+	g_return_if_fail (dbus_mgr != NULL);
+
+	nm_auth_get_caller_uid_async (pending->context,
+	                              dbus_mgr,
+	                              pending_activation_caller_uid_cb,
+	                              pending);
+}
+
 static void
 pending_activation_destroy (PendingActivation *pending,
                             GError *error,
@@ -1766,47 +1776,88 @@ device_auth_done_cb (NMAuthChain *chain,
 	nm_auth_chain_unref (chain);
 }
 
+typedef struct {
+	NMManager *self;
+	NMDevice *device;
+	char *permission;
+	gboolean allow_interaction;
+	NMDeviceAuthRequestFunc callback;
+	gpointer user_data;
+} DeviceAuthRequest;
+
 static void
-device_auth_request_cb (NMDevice *device,
-                        DBusGMethodInvocation *context,
-                        const char *permission,
-                        gboolean allow_interaction,
-                        NMDeviceAuthRequestFunc callback,
-                        gpointer user_data,
-                        NMManager *self)
+device_auth_caller_uid_cb (DBusGMethodInvocation *context,
+                           gulong sender_uid,
+                           const char *error_desc,
+                           gpointer user_data)
 {
-	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (self);
+	DeviceAuthRequest *request = user_data;
+	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (request->self);
 	GError *error = NULL;
-	gulong sender_uid = G_MAXULONG;
-	char *error_desc = NULL;
 	NMAuthChain *chain;
 
-	/* Get the caller's UID for the root check */
-	if (!nm_auth_get_caller_uid (context, priv->dbus_mgr, &sender_uid, &error_desc)) {
+	if (error_desc) {
 		error = g_error_new_literal (NM_MANAGER_ERROR,
 		                             NM_MANAGER_ERROR_PERMISSION_DENIED,
 		                             error_desc);
-		callback (device, context, error, user_data);
+		request->callback (request->device, context, error, request->user_data);
 		g_error_free (error);
-		g_free (error_desc);
-		return;
-	}
-
-	/* Yay for root */
-	if (0 == sender_uid)
-		callback (device, context, NULL, user_data);
-	else {
+	} else if (0 == sender_uid) {
+		/* Yay for root */
+		request->callback (request->device, context, NULL, request->user_data);
+	} else {
 		/* Otherwise validate the non-root request */
-		chain = nm_auth_chain_new (context, NULL, device_auth_done_cb, self);
+		chain = nm_auth_chain_new (context, NULL, device_auth_done_cb, request->self);
 		g_assert (chain);
 		priv->auth_chains = g_slist_append (priv->auth_chains, chain);
 
-		nm_auth_chain_set_data (chain, "device", g_object_ref (device), g_object_unref);
-		nm_auth_chain_set_data (chain, "requested-permission", g_strdup (permission), g_free);
-		nm_auth_chain_set_data (chain, "callback", callback, NULL);
-		nm_auth_chain_set_data (chain, "user-data", user_data, NULL);
-		nm_auth_chain_add_call (chain, permission, allow_interaction);
+		nm_auth_chain_set_data (chain, "device", g_object_ref (request->device), g_object_unref);
+		nm_auth_chain_set_data (chain, "requested-permission", g_strdup (request->permission), g_free);
+		nm_auth_chain_set_data (chain, "callback", request->callback, NULL);
+		nm_auth_chain_set_data (chain, "user-data", request->user_data, NULL);
+		nm_auth_chain_add_call (chain, request->permission, request->allow_interaction);
 	}
+
+	g_object_unref (request->device);
+	g_object_unref (request->self);
+	g_free (request->permission);
+	g_slice_free (DeviceAuthRequest, request);
+}
+
+static void
+device_auth_request_cb (NMDevice *device,
+                        DBusGMethodInvocation *context,
+                        const char *permission,
+                        gboolean allow_interaction,
+                        NMDeviceAuthRequestFunc callback,
+                        gpointer user_data,
+                        NMManager *self)
+{
+	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (self);
+	DeviceAuthRequest *request;
+
+	/* Get the caller's UID for the root check */
+	request = g_slice_new0 (DeviceAuthRequest);
+	request->self = g_object_ref (self);
+	request->device = g_object_ref (device);
+	request->permission = g_strdup (permission);
+	request->allow_interaction = allow_interaction;
+	request->callback = callback;
+	request->user_data = user_data;
+	nm_auth_get_caller_uid_async (context, priv->dbus_mgr, device_auth_caller_uid_cb, request);
+}
+
+static void
+device_index_keys_changed (NMDevice *device, GParamSpec *pspec, gpointer user_data)
+{
+	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (user_data);
+
+	nm_device_index_update (priv->device_index, device,
+	                        nm_device_get_ifindex (device),
+	                        nm_device_get_udi (device),
+	                        nm_device_get_path (device),
+	                        nm_device_get_iface (device),
+	                        nm_device_get_ip_iface (device));
 }
 
 static void
@@ -1843,6 +1894,20 @@ add_device (NMManager *self, NMDevice *device)
 	nm_device_set_connection_provider (device, NM_CONNECTION_PROVIDER (priv->settings));
 
 	priv->devices = g_slist_append (priv->devices, device);
+	nm_device_index_add (priv->device_index, device,
+	                     nm_device_get_ifindex (device),
+	                     nm_device_get_udi (device),
+	                     NULL,
+	                     nm_device_get_iface (device),
+	                     nm_device_get_ip_iface (device));
+
+	/* Keep the device index current when the device's keys change */
+	g_signal_connect (device, "notify::" NM_DEVICE_UDI,
+	                  G_CALLBACK (device_index_keys_changed),
+	                  self);
+	g_signal_connect (device, "notify::" NM_DEVICE_IP_IFACE,
+	                  G_CALLBACK (device_index_keys_changed),
+	                  self);
 
 	g_signal_connect (device, "state-changed",
 					  G_CALLBACK (manager_device_state_changed),
@@ -1893,6 +1958,7 @@ add_device (NMManager *self, NMDevice *device)
 
 	path = g_strdup_printf ("/org/freedesktop/NetworkManager/Devices/%d", devcount++);
 	nm_device_set_path (device, path);
+	device_index_keys_changed (device, NULL, self);
 	dbus_g_connection_register_g_object (nm_dbus_manager_get_connection (priv->dbus_mgr),
 	                                     path,
 	                                     G_OBJECT (device));
@@ -2012,31 +2078,14 @@ bluez_manager_bdaddr_removed_cb (NMBluezManager *bluez_mgr,
 static NMDevice *
 find_device_by_ip_iface (NMManager *self, const gchar *iface)
 {
-	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (self);
-	GSList *iter;
-
-	for (iter = priv->devices; iter; iter = g_slist_next (iter)) {
-		NMDevice *candidate = iter->data;
-
-		if (g_strcmp0 (nm_device_get_ip_iface (candidate), iface) == 0)
-			return candidate;
-	}
-	return NULL;
+	return nm_device_index_lookup_ip_iface (NM_MANAGER_GET_PRIVATE (self)->device_index, iface);
 }
 
+/* Devices without a kernel interface (ifindex 0) are never returned */
 static NMDevice *
 find_device_by_ifindex (NMManager *self, guint32 ifindex)
 {
-	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (self);
-	GSList *iter;
-
-	for (iter = priv->devices; iter; iter = g_slist_next (iter)) {
-		NMDevice *candidate = NM_DEVICE (iter->data);
-
-		if (ifindex == nm_device_get_ifindex (candidate))
-			return candidate;
-	}
-	return NULL;
+	return nm_device_index_lookup_ifindex (NM_MANAGER_GET_PRIVATE (self)->device_index, ifindex);
 }
 
 #define PLUGIN_PREFIX "libnm-device-plugin-"
@@ -2183,22 +2232,53 @@ is_infiniband (GUdevDevice *device)
 	return etype == ARPHRD_INFINIBAND;
 }
 
+/* Uses the startup link snapshot while there is one */
+static int
+get_iface_type (NMManager *self, int ifindex)
+{
+	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (self);
+	NMSystemLinkInfo *info;
+
+	if (priv->startup_links) {
+		info = g_hash_table_lookup (priv->startup_links, GINT_TO_POINTER (ifindex));
+		if (info)
+			return info->type;
+	}
+	return nm_system_get_iface_type (ifindex, NULL);
+}
+
 static gboolean
-is_bond (int ifindex)
+get_vlan_parent (NMManager *self, int ifindex, int *out_parent_ifindex)
 {
-	return (nm_system_get_iface_type (ifindex, NULL) == NM_IFACE_TYPE_BOND);
+	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (self);
+	NMSystemLinkInfo *info;
+
+	if (priv->startup_links) {
+		info = g_hash_table_lookup (priv->startup_links, GINT_TO_POINTER (ifindex));
+		if (info && info->type == NM_IFACE_TYPE_VLAN) {
+			*out_parent_ifindex = info->parent;
+			return info->parent > 0;
+		}
+	}
+	return nm_system_get_iface_vlan_info (ifindex, out_parent_ifindex, NULL);
 }
 
 static gboolean
-is_bridge (int ifindex)
+is_bond (NMManager *self, int ifindex)
 {
-	return (nm_system_get_iface_type (ifindex, NULL) == NM_IFACE_TYPE_BRIDGE);
+	return (get_iface_type (self, ifindex) == NM_IFACE_TYPE_BOND);
 }
 
 static gboolean
-is_vlan (int ifindex)
+is_bridge (NMManager *self, int ifindex)
 {
-	return (nm_system_get_iface_type (ifindex, NULL) == NM_IFACE_TYPE_VLAN);
+	return (get_iface_type (self, ifindex) == NM_IFACE_TYPE_BRIDGE);
+}
+
+static gboolean
+is_vlan (NMManager *self, int ifindex)
+{
+	return (get_iface_type (self, ifindex) == NM_IFACE_TYPE_VLAN);
 }
 
 static gboolean
@@ -2208,31 +2288,24 @@ is_adsl (GUdevDevice *device)
 }
 
 static void
-udev_device_added_cb (NMUdevManager *udev_mgr,
-                      GUdevDevice *udev_device,
-                      const char *iface,
-                      const char *sysfs_path,
-                      const char *driver,
-                      int ifindex,
-                      gpointer user_data)
+add_udev_device (NMManager *self,
+                 GUdevDevice *udev_device,
+                 const char *iface,
+                 const char *sysfs_path,
+                 const char *driver,
+                 int ifindex)
 {
-	NMManager *self = NM_MANAGER (user_data);
 	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (self);
 	NMDevice *device = NULL;
 	GSList *iter;
 	GError *error = NULL;
 
-	g_return_if_fail (udev_device != NULL);
-	g_return_if_fail (iface != NULL);
-	g_return_if_fail (sysfs_path != NULL);
-	g_return_if_fail (driver != NULL);
-
 	/* Most devices will have an ifindex here */
 	if (ifindex > 0) {
 		device = find_device_by_ifindex (self, ifindex);
 		if (device) {
 			/* If it's a virtual device we may need to update its UDI */
-			if (nm_system_get_iface_type (ifindex, iface) != NM_IFACE_TYPE_UNSPEC)
+			if (get_iface_type (self, ifindex) != NM_IFACE_TYPE_UNSPEC)
 				g_object_set (G_OBJECT (device), NM_DEVICE_UDI, sysfs_path, NULL);
 			return;
 		}
@@ -2272,32 +2345,28 @@ udev_device_added_cb (NMUdevManager *udev_mgr,
 			device = nm_device_wifi_new (sysfs_path, iface, driver);
 		else if (is_infiniband (udev_device))
 			device = nm_device_infiniband_new (sysfs_path, iface, driver);
-		else if (is_bond (ifindex))
+		else if (is_bond (self, ifindex))
 			device = nm_device_bond_new (sysfs_path, iface);
-		else if (is_bridge (ifindex)) {
+		else if (is_bridge (self, ifindex)) {
 
 			/* FIXME: always create device when we handle bridges non-destructively */
 			if (bridge_created_by_nm (self, iface))
 				device = nm_device_bridge_new (sysfs_path, iface);
 			else
 				nm_log_info (LOGD_BRIDGE, "(%s): ignoring bridge not created by NetworkManager", iface);
-		} else if (is_vlan (ifindex)) {
+		} else if (is_vlan (self, ifindex)) {
 			int parent_ifindex = -1;
 			NMDevice *parent;
 
-			/* Have to find the parent device */
-			if (nm_system_get_iface_vlan_info (ifindex, &parent_ifindex, NULL)) {
+			/* Have to find the parent device; at startup, parents are
+			 * created before their VLANs.
+			 */
+			if (get_vlan_parent (self, ifindex, &parent_ifindex)) {
 				parent = find_device_by_ifindex (self, parent_ifindex);
 				if (parent)
 					device = nm_device_vlan_new (sysfs_path, iface, parent);
-				else {
-					/* If udev signaled the VLAN interface before it signaled
-					 * the VLAN's parent at startup we may not know about the
-					 * parent device yet.  But we'll find it on the second pass
-					 * from nm_manager_start().
-					 */
+				else
 					nm_log_dbg (LOGD_HW, "(%s): VLAN parent interface unknown", iface);
-				}
 			} else
 				nm_log_err (LOGD_HW, "(%s): failed to get VLAN parent ifindex", iface);
 		} else if (is_adsl (udev_device))
@@ -2310,6 +2379,103 @@ udev_device_added_cb (NMUdevManager *udev_mgr,
 		add_device (self, device);
 }
 
+typedef struct {
+	GUdevDevice *udev_device;
+	char *iface;
+	char *sysfs_path;
+	char *driver;
+	int ifindex;
+} DiscoveredDevice;
+
+static void
+udev_device_added_cb (NMUdevManager *udev_mgr,
+                      GUdevDevice *udev_device,
+                      const char *iface,
+                      const char *sysfs_path,
+                      const char *driver,
+                      int ifindex,
+                      gpointer user_data)
+{
+	NMManager *self = NM_MANAGER (user_data);
+	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (self);
+	DiscoveredDevice *discovered;
+
+	g_return_if_fail (udev_device != NULL);
+	g_return_if_fail (iface != NULL);
+	g_return_if_fail (sysfs_path != NULL);
+	g_return_if_fail (driver != NULL);
+
+	if (!priv->discovering) {
+		add_udev_device (self, udev_device, iface, sysfs_path, driver, ifindex);
+		return;
+	}
+
+	/* Created by add_discovered_devices() once udev has listed everything */
+	discovered = g_slice_new0 (DiscoveredDevice);
+	discovered->udev_device = g_object_ref (udev_device);
+	discovered->iface = g_strdup (iface);
+	discovered->sysfs_path = g_strdup (sysfs_path);
+	discovered->driver = g_strdup (driver);
+	discovered->ifindex = ifindex;
+	priv->discovered = g_slist_prepend (priv->discovered, discovered);
+}
+
+static int
+discovered_device_get_ifindex (gpointer item)
+{
+	return ((DiscoveredDevice *) item)->ifindex;
+}
+
+static void
+discovered_device_depends_on (int ifindex, int *out_parent, int *out_master, gpointer user_data)
+{
+	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (user_data);
+	NMSystemLinkInfo *info;
+
+	if (priv->startup_links) {
+		info = g_hash_table_lookup (priv->startup_links, GINT_TO_POINTER (ifindex));
+		if (info) {
+			*out_parent = info->parent;
+			*out_master = info->master;
+		}
+	} else
+		nm_system_get_iface_vlan_info (ifindex, out_parent, NULL);
+}
+
+static guint
+add_discovered_devices (NMManager *self)
+{
+	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (self);
+	GSList *ordered, *iter;
+	guint count = 0;
+
+	ordered = nm_discovery_order (g_slist_reverse (priv->discovered),
+	                              discovered_device_get_ifindex,
+	                              discovered_device_depends_on,
+	                              self);
+	priv->discovered = NULL;
+
+	for (iter = ordered; iter; iter = g_slist_next (iter)) {
+		DiscoveredDevice *discovered = iter->data;
+
+		add_udev_device (self,
+		                 discovered->udev_device,
+		                 discovered->iface,
+		                 discovered->sysfs_path,
+		                 discovered->driver,
+		                 discovered->ifindex);
+
+		g_object_unref (discovered->udev_device);
+		g_free (discovered->iface);
+		g_free (discovered->sysfs_path);
+		g_free (discovered->driver);
+		g_slice_free (DiscoveredDevice, discovered);
+		count++;
+	}
+	g_slist_free (ordered);
+	return count;
+}
+
 static void
 udev_device_removed_cb (NMUdevManager *manager,
                         GUdevDevice *udev_device,
@@ -2785,7 +2951,6 @@ nm_manager_activate_connection (NMManager *manager,
 	NMManagerPrivate *priv;
 	NMDevice *device = NULL;
 	gulong sender_uid = 0;
-	DBusError dbus_error;
 	NMDeviceState state;
 	char *iface;
 	NMDevice *master_device = NULL;
@@ -2799,17 +2964,15 @@ nm_manager_activate_connection (NMManager *manager,
 
 	priv = NM_MANAGER_GET_PRIVATE (manager);
 
-	/* Get the UID of the user that originated the request, if any */
+	/* Get the UID of the user that originated the request, if any.  It was
+	 * resolved when the request was authorized, and is cached for as long as
+	 * the sender stays on the bus.
+	 */
 	if (dbus_sender) {
-		dbus_error_init (&dbus_error);
-		sender_uid = dbus_bus_get_unix_user (nm_dbus_manager_get_dbus_connection (priv->dbus_mgr),
-		                                     dbus_sender,
-		                                     &dbus_error);
-		if (dbus_error_is_set (&dbus_error)) {
+		if (!nm_dbus_manager_get_caller_info_cached (priv->dbus_mgr, dbus_sender, &sender_uid, NULL)) {
 			g_set_error_literal (error,
 			                     NM_MANAGER_ERROR, NM_MANAGER_ERROR_PERMISSION_DENIED,
 			                     "Failed to get unix user for dbus sender");
-			dbus_error_free (&dbus_error);
 			return NULL;
 		}
 	}
@@ -3208,6 +3371,74 @@ deactivate_net_auth_done_cb (NMAuthChain *chain,
 	nm_auth_chain_unref (chain);
 }
 
+/* State of a D-Bus request waiting for the caller's UID */
+typedef struct {
+	NMManager *self;
+	char *path;
+	gboolean enable;
+} CallerRequest;
+
+static CallerRequest *
+caller_request_new (NMManager *self, const char *path, gboolean enable)
+{
+	CallerRequest *request;
+
+	request = g_slice_new0 (CallerRequest);
+	request->self = g_object_ref (self);
+	request->path = g_strdup (path);
+	request->enable = enable;
+	return request;
+}
+
+static void
+caller_request_free (CallerRequest *request)
+{
+	g_object_unref (request->self);
+	g_free (request->path);
+	g_slice_free (CallerRequest, request);
+}
+
+static void
+deactivate_caller_uid_cb (DBusGMethodInvocation *context,
+                          gulong sender_uid,
+                          const char *error_desc,
+                          gpointer user_data)
+{
+	CallerRequest *request = user_data;
+	NMManager *self = request->self;
+	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (self);
+	GError *error = NULL;
+	NMAuthChain *chain;
+
+	if (error_desc) {
+		error = g_error_new_literal (NM_MANAGER_ERROR,
+		                             NM_MANAGER_ERROR_PERMISSION_DENIED,
+		                             error_desc);
+		dbus_g_method_return_error (context, error);
+		g_error_free (error);
+	} else if (0 == sender_uid) {
+		/* Yay for root */
+		if (!nm_manager_deactivate_connection (self,
+		                                       request->path,
+		                                       NM_DEVICE_STATE_REASON_USER_REQUESTED,
+		                                       &error)) {
+			dbus_g_method_return_error (context, error);
+			g_clear_error (&error);
+		} else
+			dbus_g_method_return (context);
+	} else {
+		/* Otherwise validate the user request */
+		chain = nm_auth_chain_new (context, NULL, deactivate_net_auth_done_cb, self);
+		g_assert (chain);
+		priv->auth_chains = g_slist_append (priv->auth_chains, chain);
+
+		nm_auth_chain_set_data (chain, "path", g_strdup (request->path), g_free);
+		nm_auth_chain_add_call (chain, NM_AUTH_PERMISSION_NETWORK_CONTROL, TRUE);
+	}
+
+	caller_request_free (request);
+}
+
 static void
 impl_manager_deactivate_connection (NMManager *self,
                                     const char *active_path,
@@ -3217,9 +3448,6 @@ impl_manager_deactivate_connection (NMManager *self,
 	NMConnection *connection = NULL;
 	GError *error = NULL;
 	GSList *iter;
-	NMAuthChain *chain;
-	gulong sender_uid = G_MAXULONG;
-	char *error_desc = NULL;
 
 	/* Find the connection by its object path */
 	for (iter = priv->active_connections; iter; iter = g_slist_next (iter)) {
@@ -3243,40 +3471,10 @@ impl_manager_deactivate_connection (NMManager *self,
 	/* Need to check the caller's permissions and stuff before we can
 	 * deactivate the connection.
 	 */
-	if (!nm_auth_get_caller_uid (context, 
-		                         priv->dbus_mgr,
-	                             &sender_uid,
-	                             &error_desc)) {
-		error = g_error_new_literal (NM_MANAGER_ERROR,
-		                             NM_MANAGER_ERROR_PERMISSION_DENIED,
-		                             error_desc);
-		dbus_g_method_return_error (context, error);
-		g_error_free (error);
-		g_free (error_desc);
-		return;
-	}
-
-	/* Yay for root */
-	if (0 == sender_uid) {
-		if (!nm_manager_deactivate_connection (self,
-		                                       active_path,
-		                                       NM_DEVICE_STATE_REASON_USER_REQUESTED,
-		                                       &error)) {
-			dbus_g_method_return_error (context, error);
-			g_clear_error (&error);
-		} else
-			dbus_g_method_return (context);
-
-		return;
-	}
-
-	/* Otherwise validate the user request */
-	chain = nm_auth_chain_new (context, NULL, deactivate_net_auth_done_cb, self);
-	g_assert (chain);
-	priv->auth_chains = g_slist_append (priv->auth_chains, chain);
-
-	nm_auth_chain_set_data (chain, "path", g_strdup (active_path), g_free);
-	nm_auth_chain_add_call (chain, NM_AUTH_PERMISSION_NETWORK_CONTROL, TRUE);
+	nm_auth_get_caller_uid_async (context,
+	                              priv->dbus_mgr,
+	                              deactivate_caller_uid_cb,
+	                              caller_request_new (self, active_path, FALSE));
 }
 
 static void
@@ -3399,6 +3597,40 @@ sleep_auth_done_cb (NMAuthChain *chain,
 
 	nm_auth_chain_unref (chain);
 }
+
+static void
+sleep_caller_uid_cb (DBusGMethodInvocation *context,
+                     gulong sender_uid,
+                     const char *error_desc,
+                     gpointer user_data)
+{
+	CallerRequest *request = user_data;
+	NMManager *self = request->self;
+	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (self);
+	GError *error;
+	NMAuthChain *chain;
+
+	if (error_desc) {
+		error = g_error_new_literal (NM_MANAGER_ERROR,
+		                             NM_MANAGER_ERROR_PERMISSION_DENIED,
+		                             error_desc);
+		dbus_g_method_return_error (context, error);
+		g_error_free (error);
+	} else if (0 == sender_uid) {
+		/* Root doesn't need PK authentication */
+		_internal_sleep (self, request->enable);
+		dbus_g_method_return (context);
+	} else {
+		chain = nm_auth_chain_new (context, NULL, sleep_auth_done_cb, self);
+		g_assert (chain);
+		priv->auth_chains = g_slist_append (priv->auth_chains, chain);
+
+		nm_auth_chain_set_data (chain, "sleep", GUINT_TO_POINTER (request->enable), NULL);
+		nm_auth_chain_add_call (chain, NM_AUTH_PERMISSION_SLEEP_WAKE, TRUE);
+	}
+
+	caller_request_free (request);
+}
 #endif
 
 static void
@@ -3408,11 +3640,6 @@ impl_manager_sleep (NMManager *self,
 {
 	NMManagerPrivate *priv;
 	GError *error = NULL;
-#if 0
-	NMAuthChain *chain;
-	gulong sender_uid = G_MAXULONG;
-	const char *error_desc = NULL;
-#endif
 
 	g_return_if_fail (NM_IS_MANAGER (self));
 
@@ -3440,28 +3667,10 @@ impl_manager_sleep (NMManager *self,
 	return;
 
 #if 0
-	if (!nm_auth_get_caller_uid (context, priv->dbus_mgr, &sender_uid, &error_desc)) {
-		error = g_error_new_literal (NM_MANAGER_ERROR,
-		                             NM_MANAGER_ERROR_PERMISSION_DENIED,
-		                             error_desc);
-		dbus_g_method_return_error (context, error);
-		g_error_free (error);
-		return;
-	}
-
-	/* Root doesn't need PK authentication */
-	if (0 == sender_uid) {
-		_internal_sleep (self, do_sleep);
-		dbus_g_method_return (context);
-		return;
-	}
-
-	chain = nm_auth_chain_new (context, NULL, sleep_auth_done_cb, self);
-	g_assert (chain);
-	priv->auth_chains = g_slist_append (priv->auth_chains, chain);
-
-	nm_auth_chain_set_data (chain, "sleep", GUINT_TO_POINTER (do_sleep), NULL);
-	nm_auth_chain_add_call (chain, NM_AUTH_PERMISSION_SLEEP_WAKE, TRUE);
+	nm_auth_get_caller_uid_async (context,
+	                              priv->dbus_mgr,
+	                              sleep_caller_uid_cb,
+	                              caller_request_new (self, NULL, do_sleep));
 #endif
 }
 
@@ -3550,16 +3759,47 @@ enable_net_done_cb (NMAuthChain *chain,
 	nm_auth_chain_unref (chain);
 }
 
+static void
+enable_caller_uid_cb (DBusGMethodInvocation *context,
+                      gulong sender_uid,
+                      const char *error_desc,
+                      gpointer user_data)
+{
+	CallerRequest *request = user_data;
+	NMManager *self = request->self;
+	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (self);
+	GError *error;
+	NMAuthChain *chain;
+
+	if (error_desc) {
+		error = g_error_new_literal (NM_MANAGER_ERROR,
+		                             NM_MANAGER_ERROR_PERMISSION_DENIED,
+		                             error_desc);
+		dbus_g_method_return_error (context, error);
+		g_error_free (error);
+	} else if (0 == sender_uid) {
+		/* Root doesn't need PK authentication */
+		_internal_enable (self, request->enable);
+		dbus_g_method_return (context);
+	} else {
+		chain = nm_auth_chain_new (context, NULL, enable_net_done_cb, self);
+		g_assert (chain);
+		priv->auth_chains = g_slist_append (priv->auth_chains, chain);
+
+		nm_auth_chain_set_data (chain, "enable", GUINT_TO_POINTER (request->enable), NULL);
+		nm_auth_chain_add_call (chain, NM_AUTH_PERMISSION_ENABLE_DISABLE_NETWORK, TRUE);
+	}
+
+	caller_request_free (request);
+}
+
 static void
 impl_manager_enable (NMManager *self,
                      gboolean enable,
                      DBusGMethodInvocation *context)
 {
 	NMManagerPrivate *priv;
-	NMAuthChain *chain;
 	GError *error = NULL;
-	gulong sender_uid = G_MAXULONG;
-	char *error_desc = NULL;
 
 	g_return_if_fail (NM_IS_MANAGER (self));
 
@@ -3574,29 +3814,10 @@ impl_manager_enable (NMManager *self,
 		return;
 	}
 
-	if (!nm_auth_get_caller_uid (context, priv->dbus_mgr, &sender_uid, &error_desc)) {
-		error = g_error_new_literal (NM_MANAGER_ERROR,
-		                             NM_MANAGER_ERROR_PERMISSION_DENIED,
-		                             error_desc);
-		dbus_g_method_return_error (context, error);
-		g_error_free (error);
-		g_free (error_desc);
-		return;
-	}
-
-	/* Root doesn't need PK authentication */
-	if (0 == sender_uid) {
-		_internal_enable (self, enable);
-		dbus_g_method_return (context);
-		return;
-	}
-
-	chain = nm_auth_chain_new (context, NULL, enable_net_done_cb, self);
-	g_assert (chain);
-	priv->auth_chains = g_slist_append (priv->auth_chains, chain);
-
-	nm_auth_chain_set_data (chain, "enable", GUINT_TO_POINTER (enable), NULL);
-	nm_auth_chain_add_call (chain, NM_AUTH_PERMISSION_ENABLE_DISABLE_NETWORK, TRUE);
+	nm_auth_get_caller_uid_async (context,
+	                              priv->dbus_mgr,
+	                              enable_caller_uid_cb,
+	                              caller_request_new (self, NULL, enable));
 }
 
 /* Permissions */
@@ -3721,7 +3942,10 @@ void
 nm_manager_start (NMManager *self)
 {
 	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (self);
-	guint i;
+	GTimer *startup, *discovery;
+	guint i, discovered;
+
+	startup = g_timer_new ();
 
 	/* Set initial radio enabled/disabled state */
 	for (i = 0; i < RFKILL_TYPE_MAX; i++) {
@@ -3759,16 +3983,25 @@ nm_manager_start (NMManager *self)
 	priv->nm_bridges = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	read_nm_created_bridges (self);
 
-	nm_udev_manager_query_devices (priv->udev_mgr);
-	nm_bluez_manager_query_devices (priv->bluez_mgr);
-
-	/* Query devices again to ensure that we catch all virtual interfaces (like
-	 * VLANs) that require a parent.  If during the first pass the VLAN
-	 * interface was detected first, the parent wouldn't exist yet and creating
-	 * the VLAN would fail.  The second query ensures that we'll have a valid
-	 * parent for the VLAN during the second pass.
+	/* Classify every interface from a single netlink dump, and create the
+	 * devices only when udev has listed all of them, so that parents come
+	 * before their VLANs and masters before their ports.
 	 */
-	nm_udev_manager_query_devices (priv->udev_mgr);
+	discovery = g_timer_new ();
+	priv->startup_links = nm_system_get_links ();
+	priv->discovering = TRUE;
+	nm_udev_manager_query_devices (priv->udev_mgr, priv->startup_links);
+	priv->discovering = FALSE;
+	discovered = add_discovered_devices (self);
+	if (priv->startup_links) {
+		g_hash_table_destroy (priv->startup_links);
+		priv->startup_links = NULL;
+	}
+	nm_log_dbg (LOGD_HW, "discovered %u interfaces in %.1f ms",
+	            discovered, g_timer_elapsed (discovery, NULL) * 1000);
+	g_timer_destroy (discovery);
+
+	nm_bluez_manager_query_devices (priv->bluez_mgr);
 
 	/*
 	 * Connections added before the manager is started do not emit
@@ -3779,6 +4012,10 @@ nm_manager_start (NMManager *self)
 	/* FIXME: remove when we handle bridges non-destructively */
 	g_hash_table_unref (priv->nm_bridges);
 	priv->nm_bridges = NULL;
+
+	nm_log_info (LOGD_CORE, "startup complete: %u devices ready in %.1f ms",
+	             g_slist_length (priv->devices), g_timer_elapsed (startup, NULL) * 1000);
+	g_timer_destroy (startup);
 }
 
 static gboolean
@@ -3940,6 +4177,61 @@ prop_set_auth_done_cb (NMAuthChain *chain,
 	nm_auth_chain_unref (chain);
 }
 
+typedef struct {
+	NMManager *self;
+	DBusConnection *connection;
+	DBusMessage *message;
+	const char *glib_propname;
+	const char *permission;
+	gboolean set_enabled;
+	char *objpath;
+} PropSetRequest;
+
+static void
+prop_set_caller_info_cb (NMDBusManager *dbus_mgr,
+                         const char *sender,
+                         gulong uid,
+                         gulong pid,
+                         GError *error,
+                         gpointer user_data)
+{
+	PropSetRequest *request = user_data;
+	NMManagerPrivate *priv = NM_MANAGER_GET_PRIVATE (request->self);
+	DBusMessage *reply = NULL;
+	NMAuthChain *chain;
+
+	if (error) {
+		reply = dbus_message_new_error (request->message, NM_PERM_DENIED_ERROR,
+		                                "Could not determine the user ID of the requestor");
+	} else if (uid > 0) {
+		/* Otherwise validate the user request */
+		chain = nm_auth_chain_new_raw_message (request->message, prop_set_auth_done_cb, request->self);
+		g_assert (chain);
+		priv->auth_chains = g_slist_append (priv->auth_chains, chain);
+		nm_auth_chain_set_data (chain, "prop", g_strdup (request->glib_propname), g_free);
+		nm_auth_chain_set_data (chain, "permission", g_strdup (request->permission), g_free);
+		nm_auth_chain_set_data (chain, "enabled", GUINT_TO_POINTER (request->set_enabled), NULL);
+		nm_auth_chain_set_data (chain, "message", dbus_message_ref (request->message), (GDestroyNotify) dbus_message_unref);
+		nm_auth_chain_set_data (chain, "objectpath", g_strdup (request->objpath), g_free);
+		nm_auth_chain_add_call (chain, request->permission, TRUE);
+	} else {
+		/* Yay for root */
+		g_object_set (request->self, request->glib_propname, request->set_enabled, NULL);
+		reply = dbus_message_new_method_return (request->message);
+	}
+
+	if (reply) {
+		dbus_connection_send (request->connection, reply, NULL);
+		dbus_message_unref (reply);
+	}
+
+	g_object_unref (request->self);
+	dbus_connection_unref (request->connection);
+	dbus_message_unref (request->message);
+	g_free (request->objpath);
+	g_slice_free (PropSetRequest, request);
+}
+
 static DBusHandlerResult
 prop_filter (DBusConnection *connection,
              DBusMessage *message,
@@ -3954,11 +4246,9 @@ prop_filter (DBusConnection *connection,
 	const char *sender = NULL;
 	const char *objpath = NULL;
 	const char *glib_propname = NULL, *permission = NULL;
-	DBusError dbus_error;
-	gulong uid = G_MAXULONG;
 	DBusMessage *reply = NULL;
 	gboolean set_enabled = FALSE;
-	NMAuthChain *chain;
+	PropSetRequest *request;
 
 	/* The sole purpose of this function is to validate property accesses
 	 * on the NMManager object since dbus-glib doesn't yet give us this
@@ -4021,31 +4311,16 @@ prop_filter (DBusConnection *connection,
 		goto out;
 	}
 
-	dbus_error_init (&dbus_error);
-	uid = dbus_bus_get_unix_user (connection, sender, &dbus_error);
-	if (dbus_error_is_set (&dbus_error)) {
-		reply = dbus_message_new_error (message, NM_PERM_DENIED_ERROR,
-		                                "Could not determine the user ID of the requestor");
-		dbus_error_free (&dbus_error);
-		goto out;
-	}
-
-	if (uid > 0) {
-		/* Otherwise validate the user request */
-		chain = nm_auth_chain_new_raw_message (message, prop_set_auth_done_cb, self);
-		g_assert (chain);
-		priv->auth_chains = g_slist_append (priv->auth_chains, chain);
-		nm_auth_chain_set_data (chain, "prop", g_strdup (glib_propname), g_free);
-		nm_auth_chain_set_data (chain, "permission", g_strdup (permission), g_free);
-		nm_auth_chain_set_data (chain, "enabled", GUINT_TO_POINTER (set_enabled), NULL);
-		nm_auth_chain_set_data (chain, "message", dbus_message_ref (message), (GDestroyNotify) dbus_message_unref);
-		nm_auth_chain_set_data (chain, "objectpath", g_strdup (objpath), g_free);
-		nm_auth_chain_add_call (chain, permission, TRUE);
-	} else {
-		/* Yay for root */
-		g_object_set (self, glib_propname, set_enabled, NULL);
-		reply = dbus_message_new_method_return (message);
-	}
+	/* The reply is sent once the caller's UID is known */
+	request = g_slice_new0 (PropSetRequest);
+	request->self = g_object_ref (self);
+	request->connection = dbus_connection_ref (connection);
+	request->message = dbus_message_ref (message);
+	request->glib_propname = glib_propname;
+	request->permission = permission;
+	request->set_enabled = set_enabled;
+	request->objpath = g_strdup (objpath);
+	nm_dbus_manager_get_caller_info_async (priv->dbus_mgr, sender, prop_set_caller_info_cb, request);
 
 out:
 	if (reply) {
@@ -4269,6 +4544,11 @@ dispose (GObject *object)
 
 	g_slist_free (priv->factories);
 
+	if (priv->device_index) {
+		nm_device_index_free (priv->device_index);
+		priv->device_index = NULL;
+	}
+
 	if (priv->timestamp_update_id) {
 		g_source_remove (priv->timestamp_update_id);
 		priv->timestamp_update_id = 0;
@@ -4532,6 +4812,8 @@ nm_manager_init (NMManager *manager)
 	priv->sleeping = FALSE;
 	priv->state = NM_STATE_DISCONNECTED;
 
+	priv->device_index = nm_device_index_new ();
+
 	priv->dbus_mgr = nm_dbus_manager_get ();
 
 	priv->modem_manager = nm_modem_manager_get ();
@@ -4743,6 +5025,8 @@ nm_manager_class_init (NMManagerClass *manager_class)
 	signals[PROPERTIES_CHANGED] =
 		nm_properties_changed_signal_new (object_class,
 		                                  G_STRUCT_OFFSET (NMManagerClass, properties_changed));
+	/* Global state goes out before the objects it refers to */
+	nm_properties_changed_signal_set_priority (object_class, NM_PROPERTIES_CHANGED_PRIORITY_HIGH);
 
 	signals[CHECK_PERMISSIONS] =
 		g_signal_new ("check-permissions",
@@ -0,0 +1,662 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/if.h>
+
+#include "nm-netlink-index.h"
+
+/* The index holds its own reference on every object, so entries stay valid
+ * even while the cache they came from replaces them.
+ */
+
+struct _NMNetlinkAddrIndex {
+	/* ifindex -> GPtrArray of struct rtnl_addr */
+	GHashTable *by_ifindex;
+};
+
+NMNetlinkAddrIndex *
+nm_netlink_addr_index_new (void)
+{
+	NMNetlinkAddrIndex *index;
+
+	index = g_slice_new0 (NMNetlinkAddrIndex);
+	index->by_ifindex = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+	                                           NULL, (GDestroyNotify) g_ptr_array_unref);
+	return index;
+}
+
+void
+nm_netlink_addr_index_free (NMNetlinkAddrIndex *index)
+{
+	g_return_if_fail (index != NULL);
+
+	g_hash_table_destroy (index->by_ifindex);
+	g_slice_free (NMNetlinkAddrIndex, index);
+}
+
+void
+nm_netlink_addr_index_clear (NMNetlinkAddrIndex *index)
+{
+	g_return_if_fail (index != NULL);
+
+	g_hash_table_remove_all (index->by_ifindex);
+}
+
+static int
+find_identical (GPtrArray *addrs, struct rtnl_addr *addr)
+{
+	guint i;
+
+	for (i = 0; i < addrs->len; i++) {
+		if (nl_object_identical (g_ptr_array_index (addrs, i), (struct nl_object *) addr))
+			return i;
+	}
+	return -1;
+}
+
+/**
+ * nm_netlink_addr_index_add:
+ * @index: the index
+ * @addr: a kernel address
+ *
+ * Adds @addr to the index, replacing any address that is identical to it
+ * (same interface, family, local address and prefix).
+ *
+ * Returns: %TRUE if @addr was not in the index yet, %FALSE if it only
+ * replaced an identical entry
+ **/
+gboolean
+nm_netlink_addr_index_add (NMNetlinkAddrIndex *index, struct rtnl_addr *addr)
+{
+	GPtrArray *addrs;
+	gpointer key;
+	int i;
+
+	g_return_val_if_fail (index != NULL, FALSE);
+	g_return_val_if_fail (addr != NULL, FALSE);
+
+	key = GINT_TO_POINTER (rtnl_addr_get_ifindex (addr));
+	addrs = g_hash_table_lookup (index->by_ifindex, key);
+	if (!addrs) {
+		addrs = g_ptr_array_new_with_free_func ((GDestroyNotify) nl_object_put);
+		g_hash_table_insert (index->by_ifindex, key, addrs);
+	}
+
+	nl_object_get ((struct nl_object *) addr);
+	i = find_identical (addrs, addr);
+	if (i >= 0) {
+		nl_object_put (g_ptr_array_index (addrs, i));
+		g_ptr_array_index (addrs, i) = addr;
+		return FALSE;
+	}
+
+	g_ptr_array_add (addrs, addr);
+	return TRUE;
+}
+
+/**
+ * nm_netlink_addr_index_remove:
+ * @index: the index
+ * @addr: a kernel address
+ *
+ * Removes the address identical to @addr from the index, if any.
+ *
+ * Returns: %TRUE if an address was removed
+ **/
+gboolean
+nm_netlink_addr_index_remove (NMNetlinkAddrIndex *index, struct rtnl_addr *addr)
+{
+	GPtrArray *addrs;
+	gpointer key;
+	int i;
+
+	g_return_val_if_fail (index != NULL, FALSE);
+	g_return_val_if_fail (addr != NULL, FALSE);
+
+	key = GINT_TO_POINTER (rtnl_addr_get_ifindex (addr));
+	addrs = g_hash_table_lookup (index->by_ifindex, key);
+	if (!addrs)
+		return FALSE;
+
+	i = find_identical (addrs, addr);
+	if (i >= 0)
+		g_ptr_array_remove_index_fast (addrs, i);
+	if (addrs->len == 0)
+		g_hash_table_remove (index->by_ifindex, key);
+	return i >= 0;
+}
+
+/**
+ * nm_netlink_addr_index_get:
+ * @index: the index
+ * @ifindex: interface index
+ * @family: address family, or AF_UNSPEC for all families
+ *
+ * Returns: a list of the addresses on @ifindex; each address carries a new
+ * reference which the caller must release with nl_object_put().
+ **/
+GSList *
+nm_netlink_addr_index_get (NMNetlinkAddrIndex *index, int ifindex, int family)
+{
+	GPtrArray *addrs;
+	GSList *list = NULL;
+	struct rtnl_addr *addr;
+	guint i;
+
+	g_return_val_if_fail (index != NULL, NULL);
+
+	addrs = g_hash_table_lookup (index->by_ifindex, GINT_TO_POINTER (ifindex));
+	if (!addrs)
+		return NULL;
+
+	for (i = addrs->len; i > 0; i--) {
+		addr = g_ptr_array_index (addrs, i - 1);
+		if (family != AF_UNSPEC && rtnl_addr_get_family (addr) != family)
+			continue;
+		nl_object_get ((struct nl_object *) addr);
+		list = g_slist_prepend (list, addr);
+	}
+	return list;
+}
+
+/*****************************************************************/
+
+static char *
+addr_key (struct rtnl_addr *addr)
+{
+	struct nl_addr *local = rtnl_addr_get_local (addr);
+	int family = rtnl_addr_get_family (addr);
+	char buf[INET6_ADDRSTRLEN + 1] = { 0 };
+
+	if (local && nl_addr_get_binary_addr (local))
+		inet_ntop (family, nl_addr_get_binary_addr (local), buf, sizeof (buf));
+
+	return g_strdup_printf ("%d %s/%d", family, buf, rtnl_addr_get_prefixlen (addr));
+}
+
+/**
+ * nm_netlink_addr_diff:
+ * @existing: list of struct rtnl_addr currently configured on an interface
+ * @addrs: array of the addresses that should be configured
+ * @num_addrs: number of elements in @addrs
+ *
+ * Compares the addresses already on an interface with the wanted ones.  Every
+ * wanted address that is already present is released and its slot in @addrs
+ * set to %NULL, so that only the addresses that still need to be added are
+ * left in @addrs.
+ *
+ * Returns: the list of addresses from @existing that are not wanted anymore;
+ * the list does not hold references, and must be freed with g_slist_free().
+ **/
+GSList *
+nm_netlink_addr_diff (GSList *existing, struct rtnl_addr **addrs, int num_addrs)
+{
+	GHashTable *wanted;
+	GSList *iter, *unwanted = NULL;
+	char *key;
+	int i;
+
+	wanted = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	for (i = 0; addrs && i < num_addrs; i++) {
+		if (!addrs[i])
+			continue;
+
+		key = addr_key (addrs[i]);
+		if (!g_hash_table_lookup (wanted, key))
+			g_hash_table_insert (wanted, key, GINT_TO_POINTER (i + 1));
+		else
+			g_free (key);
+	}
+
+	for (iter = existing; iter; iter = g_slist_next (iter)) {
+		struct rtnl_addr *addr = iter->data;
+
+		key = addr_key (addr);
+		i = GPOINTER_TO_INT (g_hash_table_lookup (wanted, key)) - 1;
+		if (i >= 0 && nl_object_identical ((struct nl_object *) addr, (struct nl_object *) addrs[i])) {
+			/* Already on the interface; don't add it again */
+			rtnl_addr_put (addrs[i]);
+			addrs[i] = NULL;
+			g_hash_table_remove (wanted, key);
+		} else
+			unwanted = g_slist_prepend (unwanted, addr);
+		g_free (key);
+	}
+
+	g_hash_table_destroy (wanted);
+	return g_slist_reverse (unwanted);
+}
+
+/*****************************************************************/
+
+typedef struct {
+	char *id;
+	char *lookup_key;
+	int oif;
+	struct rtnl_route *route;
+} RouteEntry;
+
+struct _NMNetlinkRouteIndex {
+	/* route identity -> RouteEntry */
+	GHashTable *by_id;
+	/* (family, oif, table, dst) -> GSList of RouteEntry */
+	GHashTable *by_lookup;
+	/* oif -> GHashTable set of RouteEntry */
+	GHashTable *by_oif;
+};
+
+static int
+route_get_oif (struct rtnl_route *route)
+{
+	/* Unreachable/blackhole routes have no nexthop at all */
+	if (rtnl_route_get_nnexthops (route) < 1)
+		return 0;
+	return rtnl_route_nh_get_ifindex (rtnl_route_nexthop_n (route, 0));
+}
+
+static void
+append_addr (GString *str, struct nl_addr *addr)
+{
+	char buf[INET6_ADDRSTRLEN + 1] = { 0 };
+
+	if (!addr || !nl_addr_get_binary_addr (addr) || nl_addr_iszero (addr)) {
+		g_string_append_printf (str, " */%d", addr ? nl_addr_get_prefixlen (addr) : 0);
+		return;
+	}
+
+	inet_ntop (nl_addr_get_family (addr), nl_addr_get_binary_addr (addr), buf, sizeof (buf));
+	g_string_append_printf (str, " %s/%d", buf, nl_addr_get_prefixlen (addr));
+}
+
+static char *
+route_lookup_key (int family, int oif, guint32 table, struct nl_addr *dst)
+{
+	GString *str;
+
+	str = g_string_sized_new (64);
+	g_string_append_printf (str, "%d %d %u", family, oif, table);
+	append_addr (str, dst);
+	return g_string_free (str, FALSE);
+}
+
+/* Mirrors how the kernel tells routes apart: IPv4 by table, tos, metric and
+ * destination; IPv6 additionally allows several routes to the same
+ * destination that only differ in their nexthop.
+ */
+static char *
+route_id (struct rtnl_route *route)
+{
+	GString *str;
+	int family = rtnl_route_get_family (route);
+
+	str = g_string_sized_new (96);
+	g_string_append_printf (str, "%d %u %u %u",
+	                        family,
+	                        rtnl_route_get_table (route),
+	                        rtnl_route_get_tos (route),
+	                        rtnl_route_get_priority (route));
+	append_addr (str, rtnl_route_get_dst (route));
+
+	if (family == AF_INET6) {
+		g_string_append_printf (str, " dev %d", route_get_oif (route));
+		if (rtnl_route_get_nnexthops (route) > 0)
+			append_addr (str, rtnl_route_nh_get_gateway (rtnl_route_nexthop_n (route, 0)));
+	}
+	return g_string_free (str, FALSE);
+}
+
+static void
+route_entry_free (gpointer data)
+{
+	RouteEntry *entry = data;
+
+	g_free (entry->id);
+	g_free (entry->lookup_key);
+	rtnl_route_put (entry->route);
+	g_slice_free (RouteEntry, entry);
+}
+
+NMNetlinkRouteIndex *
+nm_netlink_route_index_new (void)
+{
+	NMNetlinkRouteIndex *index;
+
+	index = g_slice_new0 (NMNetlinkRouteIndex);
+	index->by_id = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, route_entry_free);
+	index->by_lookup = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                          NULL, (GDestroyNotify) g_slist_free);
+	index->by_oif = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+	                                       NULL, (GDestroyNotify) g_hash_table_destroy);
+	return index;
+}
+
+void
+nm_netlink_route_index_free (NMNetlinkRouteIndex *index)
+{
+	g_return_if_fail (index != NULL);
+
+	nm_netlink_route_index_clear (index);
+	g_hash_table_destroy (index->by_oif);
+	g_hash_table_destroy (index->by_lookup);
+	g_hash_table_destroy (index->by_id);
+	g_slice_free (NMNetlinkRouteIndex, index);
+}
+
+void
+nm_netlink_route_index_clear (NMNetlinkRouteIndex *index)
+{
+	g_return_if_fail (index != NULL);
+
+	/* Secondary indexes first; they point into the entries */
+	g_hash_table_remove_all (index->by_oif);
+	g_hash_table_remove_all (index->by_lookup);
+	g_hash_table_remove_all (index->by_id);
+}
+
+guint
+nm_netlink_route_index_size (NMNetlinkRouteIndex *index)
+{
+	g_return_val_if_fail (index != NULL, 0);
+
+	return g_hash_table_size (index->by_id);
+}
+
+static void
+route_entry_unlink (NMNetlinkRouteIndex *index, RouteEntry *entry)
+{
+	GHashTable *oif_routes;
+	GSList *list;
+
+	oif_routes = g_hash_table_lookup (index->by_oif, GINT_TO_POINTER (entry->oif));
+	if (oif_routes) {
+		g_hash_table_remove (oif_routes, entry);
+		if (g_hash_table_size (oif_routes) == 0)
+			g_hash_table_remove (index->by_oif, GINT_TO_POINTER (entry->oif));
+	}
+
+	list = g_hash_table_lookup (index->by_lookup, entry->lookup_key);
+	if (list) {
+		/* The key is owned by the entry at the head of the list */
+		g_hash_table_steal (index->by_lookup, entry->lookup_key);
+		list = g_slist_remove (list, entry);
+		if (list)
+			g_hash_table_insert (index->by_lookup, ((RouteEntry *) list->data)->lookup_key, list);
+	}
+
+	g_hash_table_remove (index->by_id, entry->id);
+}
+
+/**
+ * nm_netlink_route_index_add:
+ * @index: the index
+ * @route: a kernel route
+ *
+ * Adds @route to the index, replacing a route the kernel would consider the
+ * same.  Cloned (cached) routes are ignored.
+ **/
+void
+nm_netlink_route_index_add (NMNetlinkRouteIndex *index, struct rtnl_route *route)
+{
+	RouteEntry *entry;
+	GHashTable *oif_routes;
+	GSList *list;
+	char *id;
+
+	g_return_if_fail (index != NULL);
+	g_return_if_fail (route != NULL);
+
+	if (rtnl_route_get_flags (route) & RTM_F_CLONED)
+		return;
+
+	id = route_id (route);
+	entry = g_hash_table_lookup (index->by_id, id);
+	if (entry)
+		route_entry_unlink (index, entry);
+
+	entry = g_slice_new0 (RouteEntry);
+	entry->id = id;
+	entry->oif = route_get_oif (route);
+	entry->lookup_key = route_lookup_key (rtnl_route_get_family (route),
+	                                      entry->oif,
+	                                      rtnl_route_get_table (route),
+	                                      rtnl_route_get_dst (route));
+	entry->route = route;
+	nl_object_get ((struct nl_object *) route);
+	g_hash_table_insert (index->by_id, entry->id, entry);
+
+	oif_routes = g_hash_table_lookup (index->by_oif, GINT_TO_POINTER (entry->oif));
+	if (!oif_routes) {
+		oif_routes = g_hash_table_new (g_direct_hash, g_direct_equal);
+		g_hash_table_insert (index->by_oif, GINT_TO_POINTER (entry->oif), oif_routes);
+	}
+	g_hash_table_insert (oif_routes, entry, entry);
+
+	/* Append behind the head so the head entry, which owns the key, stays */
+	list = g_hash_table_lookup (index->by_lookup, entry->lookup_key);
+	if (list)
+		list->next = g_slist_prepend (list->next, entry);
+	else
+		g_hash_table_insert (index->by_lookup, entry->lookup_key, g_slist_prepend (NULL, entry));
+}
+
+void
+nm_netlink_route_index_remove (NMNetlinkRouteIndex *index, struct rtnl_route *route)
+{
+	RouteEntry *entry;
+	char *id;
+
+	g_return_if_fail (index != NULL);
+	g_return_if_fail (route != NULL);
+
+	id = route_id (route);
+	entry = g_hash_table_lookup (index->by_id, id);
+	if (entry)
+		route_entry_unlink (index, entry);
+	g_free (id);
+}
+
+static guint
+route_index_remove_oif (NMNetlinkRouteIndex *index, int ifindex, int family)
+{
+	GHashTable *oif_routes;
+	GHashTableIter iter;
+	GSList *doomed = NULL, *l;
+	RouteEntry *entry;
+	guint n;
+
+	oif_routes = g_hash_table_lookup (index->by_oif, GINT_TO_POINTER (ifindex));
+	if (!oif_routes)
+		return 0;
+
+	/* Unlinking changes the set being walked, so collect first */
+	g_hash_table_iter_init (&iter, oif_routes);
+	while (g_hash_table_iter_next (&iter, (gpointer) &entry, NULL)) {
+		if (family == AF_UNSPEC || rtnl_route_get_family (entry->route) == family)
+			doomed = g_slist_prepend (doomed, entry);
+	}
+
+	n = g_slist_length (doomed);
+	for (l = doomed; l; l = g_slist_next (l))
+		route_entry_unlink (index, l->data);
+	g_slist_free (doomed);
+	return n;
+}
+
+static gboolean
+same_addr (struct nl_addr *a, struct nl_addr *b)
+{
+	if (!a || !b || nl_addr_get_family (a) != nl_addr_get_family (b))
+		return FALSE;
+	if (nl_addr_get_len (a) != nl_addr_get_len (b))
+		return FALSE;
+	return !memcmp (nl_addr_get_binary_addr (a), nl_addr_get_binary_addr (b), nl_addr_get_len (a));
+}
+
+/**
+ * nm_netlink_route_index_link_changed:
+ * @index: the index
+ * @ifindex: interface index
+ * @flags: the interface's flags, eg IFF_UP
+ * @removed: whether the interface is gone
+ *
+ * The kernel flushes the IPv4 routes through an interface that is taken
+ * down, and every route through one that is deleted, without sending
+ * RTM_DELROUTE for them; drop them from the index as well.
+ **/
+void
+nm_netlink_route_index_link_changed (NMNetlinkRouteIndex *index,
+                                     int ifindex,
+                                     guint flags,
+                                     gboolean removed)
+{
+	g_return_if_fail (index != NULL);
+
+	if (ifindex <= 0)
+		return;
+
+	if (removed)
+		route_index_remove_oif (index, ifindex, AF_UNSPEC);
+	else if (!(flags & IFF_UP))
+		route_index_remove_oif (index, ifindex, AF_INET);
+}
+
+/**
+ * nm_netlink_route_index_addr_removed:
+ * @index: the index
+ * @addr: the address that was removed
+ * @last: whether it was the interface's last address of its family
+ *
+ * Removing an IPv4 address silently takes the routes that use it as their
+ * preferred source with it, on any interface; removing the last one takes
+ * all IPv4 routes through the interface.  Drop them from the index too.
+ **/
+void
+nm_netlink_route_index_addr_removed (NMNetlinkRouteIndex *index,
+                                     struct rtnl_addr *addr,
+                                     gboolean last)
+{
+	struct nl_addr *local;
+	GHashTableIter iter;
+	GSList *doomed = NULL, *l;
+	RouteEntry *entry;
+
+	g_return_if_fail (index != NULL);
+	g_return_if_fail (addr != NULL);
+
+	if (rtnl_addr_get_family (addr) != AF_INET)
+		return;
+
+	if (last)
+		route_index_remove_oif (index, rtnl_addr_get_ifindex (addr), AF_INET);
+
+	local = rtnl_addr_get_local (addr);
+	if (!local)
+		return;
+
+	g_hash_table_iter_init (&iter, index->by_id);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer) &entry)) {
+		if (   rtnl_route_get_family (entry->route) == AF_INET
+		    && same_addr (rtnl_route_get_pref_src (entry->route), local))
+			doomed = g_slist_prepend (doomed, entry);
+	}
+	for (l = doomed; l; l = g_slist_next (l))
+		route_entry_unlink (index, l->data);
+	g_slist_free (doomed);
+}
+
+static void
+collect_route (gpointer key, gpointer value, gpointer user_data)
+{
+	RouteEntry *entry = value;
+	gpointer *data = user_data;
+	int family = GPOINTER_TO_INT (data[0]);
+
+	if (family != AF_UNSPEC && rtnl_route_get_family (entry->route) != family)
+		return;
+
+	nl_object_get ((struct nl_object *) entry->route);
+	data[1] = g_slist_prepend (data[1], entry->route);
+}
+
+/**
+ * nm_netlink_route_index_get:
+ * @index: the index
+ * @ifindex: outgoing interface index, or 0 for all routes
+ * @family: address family, or AF_UNSPEC for all families
+ *
+ * Returns: a list of the routes through @ifindex; each route carries a new
+ * reference which the caller must release with nl_object_put().
+ **/
+GSList *
+nm_netlink_route_index_get (NMNetlinkRouteIndex *index, int ifindex, int family)
+{
+	GHashTable *routes;
+	gpointer data[2] = { GINT_TO_POINTER (family), NULL };
+
+	g_return_val_if_fail (index != NULL, NULL);
+
+	if (ifindex > 0) {
+		routes = g_hash_table_lookup (index->by_oif, GINT_TO_POINTER (ifindex));
+		if (routes)
+			g_hash_table_foreach (routes, collect_route, data);
+	} else
+		g_hash_table_foreach (index->by_id, collect_route, data);
+
+	return data[1];
+}
+
+/**
+ * nm_netlink_route_index_lookup:
+ * @index: the index
+ * @family: address family
+ * @ifindex: outgoing interface index
+ * @table: routing table, eg RT_TABLE_MAIN
+ * @dst: destination with prefix length, or %NULL for the default route
+ *
+ * Returns: the routes to @dst through @ifindex in @table, which differ only
+ * in metric or type of service; each route carries a new reference which the
+ * caller must release with nl_object_put().
+ **/
+GSList *
+nm_netlink_route_index_lookup (NMNetlinkRouteIndex *index,
+                               int family,
+                               int ifindex,
+                               guint32 table,
+                               struct nl_addr *dst)
+{
+	GSList *iter, *routes = NULL;
+	RouteEntry *entry;
+	char *key;
+
+	g_return_val_if_fail (index != NULL, NULL);
+
+	key = route_lookup_key (family, ifindex, table, dst);
+	for (iter = g_hash_table_lookup (index->by_lookup, key); iter; iter = g_slist_next (iter)) {
+		entry = iter->data;
+		nl_object_get ((struct nl_object *) entry->route);
+		routes = g_slist_prepend (routes, entry->route);
+	}
+	g_free (key);
+
+	return routes;
+}
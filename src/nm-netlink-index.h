@@ -0,0 +1,73 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#ifndef NM_NETLINK_INDEX_H
+#define NM_NETLINK_INDEX_H
+
+#include <glib.h>
+#include <netlink/route/addr.h>
+#include <netlink/route/route.h>
+
+/* Per-interface index of kernel addresses */
+typedef struct _NMNetlinkAddrIndex NMNetlinkAddrIndex;
+
+NMNetlinkAddrIndex *nm_netlink_addr_index_new    (void);
+void                nm_netlink_addr_index_free   (NMNetlinkAddrIndex *index);
+void                nm_netlink_addr_index_clear  (NMNetlinkAddrIndex *index);
+gboolean            nm_netlink_addr_index_add    (NMNetlinkAddrIndex *index,
+                                                  struct rtnl_addr *addr);
+gboolean            nm_netlink_addr_index_remove (NMNetlinkAddrIndex *index,
+                                                  struct rtnl_addr *addr);
+GSList *            nm_netlink_addr_index_get    (NMNetlinkAddrIndex *index,
+                                                  int ifindex,
+                                                  int family);
+
+GSList *            nm_netlink_addr_diff         (GSList *existing,
+                                                  struct rtnl_addr **addrs,
+                                                  int num_addrs);
+
+/* Index of kernel routes by (family, oif, table, dst) */
+typedef struct _NMNetlinkRouteIndex NMNetlinkRouteIndex;
+
+NMNetlinkRouteIndex *nm_netlink_route_index_new    (void);
+void                 nm_netlink_route_index_free   (NMNetlinkRouteIndex *index);
+void                 nm_netlink_route_index_clear  (NMNetlinkRouteIndex *index);
+guint                nm_netlink_route_index_size   (NMNetlinkRouteIndex *index);
+void                 nm_netlink_route_index_add    (NMNetlinkRouteIndex *index,
+                                                    struct rtnl_route *route);
+void                 nm_netlink_route_index_remove (NMNetlinkRouteIndex *index,
+                                                    struct rtnl_route *route);
+void                 nm_netlink_route_index_link_changed (NMNetlinkRouteIndex *index,
+                                                          int ifindex,
+                                                          guint flags,
+                                                          gboolean removed);
+void                 nm_netlink_route_index_addr_removed (NMNetlinkRouteIndex *index,
+                                                          struct rtnl_addr *addr,
+                                                          gboolean last);
+GSList *             nm_netlink_route_index_get    (NMNetlinkRouteIndex *index,
+                                                    int ifindex,
+                                                    int family);
+GSList *             nm_netlink_route_index_lookup (NMNetlinkRouteIndex *index,
+                                                    int family,
+                                                    int ifindex,
+                                                    guint32 table,
+                                                    struct nl_addr *dst);
+
+#endif  /* NM_NETLINK_INDEX_H */
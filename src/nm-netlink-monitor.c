@@ -30,6 +30,7 @@
 
 #include <errno.h>
 #include <string.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <linux/types.h>
@@ -44,6 +45,7 @@
 #endif
 #include <netlink/object.h>
 #include <netlink/route/addr.h>
+#include <netlink/route/route.h>
 #include <netlink/route/rtnl.h>
 
 #include <glib.h>
@@ -51,16 +53,26 @@
 
 #include "nm-netlink-compat.h"
 #include "nm-netlink-monitor.h"
+#include "nm-netlink-index.h"
 #include "nm-logging.h"
 
 #define EVENT_CONDITIONS      ((GIOCondition) (G_IO_IN | G_IO_PRI))
 #define ERROR_CONDITIONS      ((GIOCondition) (G_IO_ERR | G_IO_NVAL))
 #define DISCONNECT_CONDITIONS ((GIOCondition) (G_IO_HUP))
 
+/* Large enough to absorb a burst of notifications from a few thousand links */
+#define EVENT_RCVBUF_SIZE     (4 * 1024 * 1024)
+
 #define NM_NETLINK_MONITOR_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
                                            NM_TYPE_NETLINK_MONITOR, \
                                            NMNetlinkMonitorPrivate))
 
+typedef struct {
+	int ifindex;
+	char *name;
+	struct rtnl_link *link;
+} LinkEntry;
+
 typedef struct {
 	/* Async event listener connection */
 	struct nl_sock *nlh_event;
@@ -69,7 +81,26 @@ typedef struct {
 
 	/* Sync/blocking request/response connection */
 	struct nl_sock *nlh_sync;
+
+	/* Kernel object caches; dumped once over the sync connection and
+	 * then kept current from the notifications on the event connection.
+	 */
 	struct nl_cache * link_cache;
+	struct nl_cache * addr_cache;
+	NMNetlinkRouteIndex *route_index;
+	gboolean have_routes;
+	GHashTable *links_by_index;
+	GHashTable *links_by_name;
+	NMNetlinkAddrIndex *addr_index;
+	guint resync_id;
+
+	/* Notifications read while servicing a cache lookup are queued and
+	 * emitted from the main loop instead of re-entering the caller.
+	 */
+	gboolean processing;
+	gboolean defer_emission;
+	GQueue *pending_msgs;
+	guint pending_id;
 
 	guint request_status_id;
 
@@ -137,14 +168,26 @@ log_error_limited (NMNetlinkMonitor *monitor, guint32 code, const char *fmt, ...
 
 /****************************************************************/
 
+static void
+emit_carrier (NMNetlinkMonitor *self, int ifindex, guint flags)
+{
+	nm_log_dbg (LOGD_HW, "netlink link message: iface idx %d flags 0x%X", ifindex, flags);
+
+	/* IFF_LOWER_UP is the indicator of carrier status since kernel commit
+	 * b00055aacdb172c05067612278ba27265fcd05ce in 2.6.17.
+	 */
+	if (flags & IFF_LOWER_UP)
+		g_signal_emit (self, signals[CARRIER_ON], 0, ifindex);
+	else
+		g_signal_emit (self, signals[CARRIER_OFF], 0, ifindex);
+}
+
 static void
 link_msg_handler (struct nl_object *obj, void *arg)
 {
 	NMNetlinkMonitor *self = NM_NETLINK_MONITOR (arg);
 	struct rtnl_link *filter;
 	struct rtnl_link *link_obj;
-	guint flags;
-	guint ifidx;
 
 	filter = rtnl_link_alloc ();
 	if (!filter) {
@@ -161,22 +204,292 @@ link_msg_handler (struct nl_object *obj, void *arg)
 	}
 
 	link_obj = (struct rtnl_link *) obj;
-	flags = rtnl_link_get_flags (link_obj);
-	ifidx = rtnl_link_get_ifindex (link_obj);
+	emit_carrier (self, rtnl_link_get_ifindex (link_obj), rtnl_link_get_flags (link_obj));
 
-	nm_log_dbg (LOGD_HW, "netlink link message: iface idx %d flags 0x%X", ifidx, flags);
+	rtnl_link_put (filter);
+}
 
-	/* IFF_LOWER_UP is the indicator of carrier status since kernel commit
-	 * b00055aacdb172c05067612278ba27265fcd05ce in 2.6.17.
+/****************************************************************/
+
+static void
+link_entry_free (gpointer data)
+{
+	LinkEntry *entry = data;
+
+	g_free (entry->name);
+	if (entry->link)
+		rtnl_link_put (entry->link);
+	g_slice_free (LinkEntry, entry);
+}
+
+static void
+link_index_remove (NMNetlinkMonitorPrivate *priv, int ifindex)
+{
+	LinkEntry *entry;
+
+	entry = g_hash_table_lookup (priv->links_by_index, GINT_TO_POINTER (ifindex));
+	if (!entry)
+		return;
+
+	if (entry->name && g_hash_table_lookup (priv->links_by_name, entry->name) == entry)
+		g_hash_table_remove (priv->links_by_name, entry->name);
+	g_hash_table_remove (priv->links_by_index, GINT_TO_POINTER (ifindex));
+}
+
+static void
+link_index_add (NMNetlinkMonitorPrivate *priv, struct rtnl_link *link)
+{
+	int ifindex = rtnl_link_get_ifindex (link);
+	const char *name = rtnl_link_get_name (link);
+	LinkEntry *entry;
+
+	if (ifindex <= 0)
+		return;
+
+	entry = g_hash_table_lookup (priv->links_by_index, GINT_TO_POINTER (ifindex));
+	if (!entry) {
+		entry = g_slice_new0 (LinkEntry);
+		entry->ifindex = ifindex;
+		g_hash_table_insert (priv->links_by_index, GINT_TO_POINTER (ifindex), entry);
+	}
+
+	/* Interface was renamed (or is new) */
+	if (g_strcmp0 (entry->name, name) != 0) {
+		if (entry->name && g_hash_table_lookup (priv->links_by_name, entry->name) == entry)
+			g_hash_table_remove (priv->links_by_name, entry->name);
+		g_free (entry->name);
+		entry->name = g_strdup (name);
+		if (entry->name)
+			g_hash_table_replace (priv->links_by_name, entry->name, entry);
+	}
+
+	if (entry->link != link) {
+		nl_object_get (OBJ_CAST (link));
+		if (entry->link)
+			rtnl_link_put (entry->link);
+		entry->link = link;
+	}
+}
+
+static void
+link_index_rebuild_cb (struct nl_object *obj, void *arg)
+{
+	link_index_add ((NMNetlinkMonitorPrivate *) arg, (struct rtnl_link *) obj);
+}
+
+static void
+link_index_rebuild (NMNetlinkMonitorPrivate *priv)
+{
+	g_hash_table_remove_all (priv->links_by_name);
+	g_hash_table_remove_all (priv->links_by_index);
+	nl_cache_foreach (priv->link_cache, link_index_rebuild_cb, priv);
+}
+
+static LinkEntry *
+link_index_lookup (NMNetlinkMonitorPrivate *priv, int ifindex)
+{
+	return g_hash_table_lookup (priv->links_by_index, GINT_TO_POINTER (ifindex));
+}
+
+static void
+addr_index_rebuild_cb (struct nl_object *obj, void *arg)
+{
+	nm_netlink_addr_index_add ((NMNetlinkAddrIndex *) arg, (struct rtnl_addr *) obj);
+}
+
+static void
+addr_index_rebuild (NMNetlinkMonitorPrivate *priv)
+{
+	nm_netlink_addr_index_clear (priv->addr_index);
+	if (priv->addr_cache)
+		nl_cache_foreach (priv->addr_cache, addr_index_rebuild_cb, priv->addr_index);
+}
+
+static void
+cache_change_cb (struct nl_cache *cache, struct nl_object *obj, int action, void *arg)
+{
+	NMNetlinkMonitorPrivate *priv = arg;
+	struct rtnl_link *link;
+	struct rtnl_addr *addr;
+	GSList *left;
+
+	if (cache == priv->link_cache) {
+		link = (struct rtnl_link *) obj;
+		if (action == NL_ACT_DEL)
+			link_index_remove (priv, rtnl_link_get_ifindex (link));
+		else
+			link_index_add (priv, link);
+
+		/* Routes the kernel flushed without a word */
+		if (priv->have_routes) {
+			nm_netlink_route_index_link_changed (priv->route_index,
+			                                     rtnl_link_get_ifindex (link),
+			                                     rtnl_link_get_flags (link),
+			                                     action == NL_ACT_DEL);
+		}
+	} else if (cache == priv->addr_cache) {
+		addr = (struct rtnl_addr *) obj;
+		if (action != NL_ACT_DEL) {
+			nm_netlink_addr_index_add (priv->addr_index, addr);
+			return;
+		}
+
+		nm_netlink_addr_index_remove (priv->addr_index, addr);
+		if (priv->have_routes && rtnl_addr_get_family (addr) == AF_INET) {
+			left = nm_netlink_addr_index_get (priv->addr_index,
+			                                  rtnl_addr_get_ifindex (addr),
+			                                  AF_INET);
+			nm_netlink_route_index_addr_removed (priv->route_index, addr, left == NULL);
+			g_slist_foreach (left, (GFunc) nl_object_put, NULL);
+			g_slist_free (left);
+		}
+	}
+}
+
+static void
+cache_include_cb (struct nl_object *obj, void *arg)
+{
+	NMNetlinkMonitorPrivate *priv = arg;
+	const char *type = nl_object_get_type (obj);
+	struct nl_cache *cache = NULL;
+
+	if (!type)
+		return;
+
+	if (!strcmp (type, "route/link")) {
+		/* Only the generic link info is cached; the per-family link dumps
+		 * (AF_INET6, AF_BRIDGE) describe the same interfaces again.
+		 */
+		if (rtnl_link_get_family ((struct rtnl_link *) obj) == AF_UNSPEC)
+			cache = priv->link_cache;
+	} else if (!strcmp (type, "route/addr"))
+		cache = priv->addr_cache;
+	else if (!strcmp (type, "route/route") && priv->have_routes) {
+		/* Routes are only kept in the index; a full routing table is too
+		 * big to hold twice.
+		 */
+		if (nl_object_get_msgtype (obj) == RTM_DELROUTE)
+			nm_netlink_route_index_remove (priv->route_index, (struct rtnl_route *) obj);
+		else
+			nm_netlink_route_index_add (priv->route_index, (struct rtnl_route *) obj);
+	}
+
+	if (cache)
+		nl_cache_include (cache, obj, cache_change_cb, priv);
+}
+
+static void
+route_index_fill_cb (struct nl_object *obj, void *arg)
+{
+	nm_netlink_route_index_add ((NMNetlinkRouteIndex *) arg, (struct rtnl_route *) obj);
+}
+
+static int
+dump_routes (NMNetlinkMonitorPrivate *priv)
+{
+	struct nl_cache *cache = NULL;
+	int err;
+
+	err = rtnl_route_alloc_cache (priv->nlh_sync, AF_UNSPEC, 0, &cache);
+	if (err < 0)
+		return err;
+
+	nm_netlink_route_index_clear (priv->route_index);
+	nl_cache_foreach (cache, route_index_fill_cb, priv->route_index);
+	nl_cache_free (cache);
+	priv->have_routes = TRUE;
+
+	nm_log_dbg (LOGD_HW, "netlink route index holds %u routes",
+	            nm_netlink_route_index_size (priv->route_index));
+	return 0;
+}
+
+static gboolean
+refill_caches (NMNetlinkMonitor *self, GError **error)
+{
+	NMNetlinkMonitorPrivate *priv = NM_NETLINK_MONITOR_GET_PRIVATE (self);
+	struct nl_cache *caches[] = { priv->link_cache, priv->addr_cache };
+	guint i;
+	int err;
+
+	for (i = 0; i < G_N_ELEMENTS (caches); i++) {
+		if (!caches[i])
+			continue;
+		err = nl_cache_refill (priv->nlh_sync, caches[i]);
+		if (err < 0) {
+			g_set_error (error,
+			             NM_NETLINK_MONITOR_ERROR,
+			             NM_NETLINK_MONITOR_ERROR_LINK_CACHE_UPDATE,
+			             caches[i] == priv->link_cache
+			                 ? _("error updating link cache: %s")
+			                 : _("error updating address cache: %s"),
+			             nl_geterror (err));
+			return FALSE;
+		}
+	}
+
+	link_index_rebuild (priv);
+	addr_index_rebuild (priv);
+
+	err = dump_routes (priv);
+	if (err < 0) {
+		g_set_error (error,
+		             NM_NETLINK_MONITOR_ERROR,
+		             NM_NETLINK_MONITOR_ERROR_LINK_CACHE_UPDATE,
+		             _("error updating route cache: %s"),
+		             nl_geterror (err));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void process_pending_events (NMNetlinkMonitor *self);
+
+static gboolean
+resync_caches (gpointer user_data)
+{
+	NMNetlinkMonitor *self = NM_NETLINK_MONITOR (user_data);
+	NMNetlinkMonitorPrivate *priv = NM_NETLINK_MONITOR_GET_PRIVATE (self);
+	GError *error = NULL;
+
+	priv->resync_id = 0;
+
+	/* Apply whatever is still queued first so that stale notifications
+	 * can't undo the fresh dump afterwards.
 	 */
-	if (flags & IFF_LOWER_UP)
-		g_signal_emit (self, signals[CARRIER_ON], 0, ifidx);
-	else
-		g_signal_emit (self, signals[CARRIER_OFF], 0, ifidx);
+	process_pending_events (self);
 
-	rtnl_link_put (filter);
+	nm_log_info (LOGD_HW, "netlink event socket overrun; resynchronizing link, address and route caches");
+	if (!refill_caches (self, &error)) {
+		nm_log_err (LOGD_HW, "%s", error->message);
+		g_clear_error (&error);
+	}
+
+	/* Carrier changes may have been among the dropped notifications */
+	nm_netlink_monitor_request_status (self);
+	return FALSE;
+}
+
+static void
+handle_recv_error (NMNetlinkMonitor *self, int err)
+{
+	NMNetlinkMonitorPrivate *priv = NM_NETLINK_MONITOR_GET_PRIVATE (self);
+
+	/* ENOBUFS; the kernel dropped notifications and the caches are stale */
+	if (err == -NLE_NOMEM) {
+		if (!priv->resync_id)
+			priv->resync_id = g_idle_add_full (G_PRIORITY_HIGH, resync_caches, self, NULL);
+		return;
+	}
+
+	log_error_limited (self, NM_NETLINK_MONITOR_ERROR_PROCESSING_MESSAGE,
+	                   _("error processing netlink message: %s"),
+	                   nl_geterror (err));
 }
 
+/****************************************************************/
+
 static int
 event_msg_recv (struct nl_msg *msg, void *arg)
 {
@@ -219,24 +532,104 @@ event_msg_recv (struct nl_msg *msg, void *arg)
 	return NL_OK;
 }
 
+static void
+emit_msg (NMNetlinkMonitor *self, struct nl_msg *msg)
+{
+	/* Let clients handle generic messages */
+	g_signal_emit (self, signals[NOTIFICATION], 0, msg);
+
+	/* Parse carrier messages */
+	nl_msg_parse (msg, &link_msg_handler, self);
+}
+
+static void
+emit_pending_msgs (NMNetlinkMonitor *self)
+{
+	NMNetlinkMonitorPrivate *priv = NM_NETLINK_MONITOR_GET_PRIVATE (self);
+	struct nl_msg *msg;
+
+	if (priv->pending_id) {
+		g_source_remove (priv->pending_id);
+		priv->pending_id = 0;
+	}
+
+	while ((msg = g_queue_pop_head (priv->pending_msgs))) {
+		emit_msg (self, msg);
+		nlmsg_free (msg);
+	}
+}
+
+static gboolean
+emit_pending_msgs_cb (gpointer user_data)
+{
+	NMNetlinkMonitor *self = NM_NETLINK_MONITOR (user_data);
+
+	NM_NETLINK_MONITOR_GET_PRIVATE (self)->pending_id = 0;
+	emit_pending_msgs (self);
+	return FALSE;
+}
+
 static int
 event_msg_ready (struct nl_msg *msg, void *arg)
 {
 	NMNetlinkMonitor *self = NM_NETLINK_MONITOR (arg);
+	NMNetlinkMonitorPrivate *priv = NM_NETLINK_MONITOR_GET_PRIVATE (self);
 
 	/* By the time the message gets here we've already checked the sender
 	 * and we're sure it's safe to parse this message.
 	 */
 
-	/* Let clients handle generic messages */
-	g_signal_emit (self, signals[NOTIFICATION], 0, msg);
+	/* Update the caches before anyone hears about the change */
+	nl_msg_parse (msg, &cache_include_cb, priv);
 
-	/* Parse carrier messages */
-	nl_msg_parse (msg, &link_msg_handler, self);
+	if (priv->defer_emission) {
+		nlmsg_get (msg);
+		g_queue_push_tail (priv->pending_msgs, msg);
+		if (!priv->pending_id)
+			priv->pending_id = g_idle_add (emit_pending_msgs_cb, self);
+		return NL_OK;
+	}
+
+	/* Keep notifications in order */
+	emit_pending_msgs (self);
+	emit_msg (self, msg);
 
 	return NL_OK;
 }
 
+/* Reads everything currently queued on the event socket so that cache
+ * lookups see the effects of requests that were just sent over the sync
+ * socket (the kernel queues the notification before it sends the ACK).
+ */
+static void
+process_pending_events (NMNetlinkMonitor *self)
+{
+	NMNetlinkMonitorPrivate *priv = NM_NETLINK_MONITOR_GET_PRIVATE (self);
+	struct pollfd pfd;
+	int err;
+
+	/* Called back from a signal handler; the caches are as current as the
+	 * message being processed.
+	 */
+	if (priv->processing || !priv->nlh_event || !priv->event_id)
+		return;
+
+	pfd.fd = nl_socket_get_fd (priv->nlh_event);
+	pfd.events = POLLIN;
+
+	priv->processing = TRUE;
+	priv->defer_emission = TRUE;
+	while (poll (&pfd, 1, 0) > 0 && (pfd.revents & POLLIN)) {
+		err = nl_recvmsgs_default (priv->nlh_event);
+		if (err < 0) {
+			handle_recv_error (self, err);
+			break;
+		}
+	}
+	priv->defer_emission = FALSE;
+	priv->processing = FALSE;
+}
+
 static gboolean
 event_handler (GIOChannel *channel,
                GIOCondition io_condition,
@@ -270,12 +663,11 @@ event_handler (GIOChannel *channel,
 	g_return_val_if_fail (!(io_condition & ~EVENT_CONDITIONS), FALSE);
 
 	/* Process the netlink messages */
+	priv->processing = TRUE;
 	err = nl_recvmsgs_default (priv->nlh_event);
-	if (err < 0) {
-		log_error_limited (self, NM_NETLINK_MONITOR_ERROR_PROCESSING_MESSAGE,
-		                   _("error processing netlink message: %s"),
-		                   nl_geterror (err));
-	}
+	priv->processing = FALSE;
+	if (err < 0)
+		handle_recv_error (self, err);
 
 	return TRUE;
 }
@@ -322,6 +714,10 @@ event_connection_setup (NMNetlinkMonitor *self, GError **error)
 	NMNetlinkMonitorPrivate *priv = NM_NETLINK_MONITOR_GET_PRIVATE (self);
 	GError *channel_error = NULL;
 	GIOFlags channel_flags;
+	const int cache_groups[] = { RTNLGRP_LINK,
+	                             RTNLGRP_IPV4_IFADDR, RTNLGRP_IPV6_IFADDR,
+	                             RTNLGRP_IPV4_ROUTE, RTNLGRP_IPV6_ROUTE };
+	guint i;
 	int fd;
 
 	g_return_val_if_fail (priv->io_channel == NULL, FALSE);
@@ -341,9 +737,17 @@ event_connection_setup (NMNetlinkMonitor *self, GError **error)
 
 	nl_socket_disable_seq_check (priv->nlh_event);
 
-	/* Subscribe to the LINK group for internal carrier signals */
-	if (!nm_netlink_monitor_subscribe (self, RTNLGRP_LINK, error))
-		goto error;
+	/* Dropped notifications force a full resync, so make them rare */
+	nl_socket_set_buffer_size (priv->nlh_event, EVENT_RCVBUF_SIZE, 0);
+
+	/* Subscribe to the LINK group for internal carrier signals, and to the
+	 * address and route groups to keep the caches current.  This happens
+	 * before the caches are dumped so no change can fall in between.
+	 */
+	for (i = 0; i < G_N_ELEMENTS (cache_groups); i++) {
+		if (!nm_netlink_monitor_subscribe (self, cache_groups[i], error))
+			goto error;
+	}
 
 	fd = nl_socket_get_fd (priv->nlh_event);
 	priv->io_channel = g_io_channel_unix_new (fd);
@@ -381,9 +785,6 @@ static gboolean
 sync_connection_setup (NMNetlinkMonitor *self, GError **error)
 {
 	NMNetlinkMonitorPrivate *priv = NM_NETLINK_MONITOR_GET_PRIVATE (self);
-#ifdef LIBNL_NEEDS_ADDR_CACHING_WORKAROUND
-	struct nl_cache *addr_cache;
-#endif
 	int err;
 
 	/* Set up the event listener connection */
@@ -399,6 +800,26 @@ sync_connection_setup (NMNetlinkMonitor *self, GError **error)
 	if (!nlh_setup (priv->nlh_sync, NULL, self, error))
 		goto error;
 
+	err = rtnl_link_alloc_cache (priv->nlh_sync, AF_UNSPEC, &priv->link_cache);
+	if (err < 0) {
+		g_set_error (error, NM_NETLINK_MONITOR_ERROR,
+		             NM_NETLINK_MONITOR_ERROR_NETLINK_ALLOC_LINK_CACHE,
+		             _("unable to allocate netlink link cache for monitoring link status: %s"),
+		             nl_geterror (err));
+		goto error;
+	}
+	nl_cache_mngt_provide (priv->link_cache);
+	link_index_rebuild (priv);
+
+	err = rtnl_addr_alloc_cache (priv->nlh_sync, &priv->addr_cache);
+	if (err < 0) {
+		g_set_error (error, NM_NETLINK_MONITOR_ERROR,
+		             NM_NETLINK_MONITOR_ERROR_NETLINK_ALLOC_ADDR_CACHE,
+		             _("unable to allocate netlink address cache: %s"),
+		             nl_geterror (err));
+		goto error;
+	}
+
 #ifdef LIBNL_NEEDS_ADDR_CACHING_WORKAROUND
 	/* Work around apparent libnl bug; rtnl_addr requires that all
 	 * addresses have the "peer" attribute set in order to be compared
@@ -406,26 +827,35 @@ sync_connection_setup (NMNetlinkMonitor *self, GError **error)
 	 * result, most addresses will not compare as equal even to
 	 * themselves, busting caching.
 	 */
-	rtnl_addr_alloc_cache (priv->nlh_sync, &addr_cache);
-	g_warn_if_fail (addr_cache != NULL);
-	nl_cache_get_ops (addr_cache)->co_obj_ops->oo_id_attrs &= ~0x80;
-	nl_cache_free (addr_cache);
+	nl_cache_get_ops (priv->addr_cache)->co_obj_ops->oo_id_attrs &= ~0x80;
 #endif
+	addr_index_rebuild (priv);
 
-	err = rtnl_link_alloc_cache (priv->nlh_sync, AF_UNSPEC, &priv->link_cache);
+	err = dump_routes (priv);
 	if (err < 0) {
 		g_set_error (error, NM_NETLINK_MONITOR_ERROR,
-		             NM_NETLINK_MONITOR_ERROR_NETLINK_ALLOC_LINK_CACHE,
-		             _("unable to allocate netlink link cache for monitoring link status: %s"),
+		             NM_NETLINK_MONITOR_ERROR_NETLINK_ALLOC_ROUTE_CACHE,
+		             _("unable to allocate netlink route cache: %s"),
 		             nl_geterror (err));
 		goto error;
 	}
-	nl_cache_mngt_provide (priv->link_cache);
 
 	return TRUE;
 
 error:
+	nm_netlink_route_index_clear (priv->route_index);
+	priv->have_routes = FALSE;
+
+	nm_netlink_addr_index_clear (priv->addr_index);
+	if (priv->addr_cache) {
+		nl_cache_free (priv->addr_cache);
+		priv->addr_cache = NULL;
+	}
+
+	g_hash_table_remove_all (priv->links_by_name);
+	g_hash_table_remove_all (priv->links_by_index);
 	if (priv->link_cache) {
+		nl_cache_mngt_unprovide (priv->link_cache);
 		nl_cache_free (priv->link_cache);
 		priv->link_cache = NULL;
 	}
@@ -577,21 +1007,60 @@ nm_netlink_monitor_unsubscribe (NMNetlinkMonitor *self, int group)
 
 /***************************************************************/
 
+/**
+ * nm_netlink_monitor_request_ip6_info:
+ * @self: the monitor
+ * @ifindex: interface index
+ * @error: location for a #GError
+ *
+ * Asks the kernel about one interface.  The answer arrives as a NEWLINK
+ * notification whose IFLA_AF_SPEC attribute carries the interface's IPv6
+ * flags; unlike an AF_INET6 link dump it doesn't describe every other
+ * interface on the host as well.
+ *
+ * Returns: %TRUE if the request was sent
+ **/
 gboolean
-nm_netlink_monitor_request_ip6_info (NMNetlinkMonitor *self, GError **error)
+nm_netlink_monitor_request_ip6_info (NMNetlinkMonitor *self, int ifindex, GError **error)
 {
 	NMNetlinkMonitorPrivate *priv;
+	struct ifinfomsg ifi;
+	struct nl_msg *msg;
+	int err;
 
 	g_return_val_if_fail (self != NULL, FALSE);
 	g_return_val_if_fail (NM_IS_NETLINK_MONITOR (self), FALSE);
+	g_return_val_if_fail (ifindex > 0, FALSE);
 
 	priv = NM_NETLINK_MONITOR_GET_PRIVATE (self);
 
-	/* FIXME: nl_rtgen_request() gets the return value screwed up with
-	 * libnl-1.1; revisit this and return a proper error when we port to
-	 * a later libnl.
+	msg = nlmsg_alloc_simple (RTM_GETLINK, NLM_F_REQUEST);
+	if (!msg) {
+		g_set_error (error, NM_NETLINK_MONITOR_ERROR,
+		             NM_NETLINK_MONITOR_ERROR_BAD_ALLOC,
+		             "%s", _("error allocating netlink message"));
+		return FALSE;
+	}
+
+	/* The kernel has no AF_INET6 handler for single-link requests and
+	 * answers with the generic link info, so ask for that directly.
 	 */
-	nl_rtgen_request (priv->nlh_event, RTM_GETLINK, AF_INET6, NLM_F_DUMP);
+	memset (&ifi, 0, sizeof (ifi));
+	ifi.ifi_family = AF_UNSPEC;
+	ifi.ifi_index = ifindex;
+
+	err = nlmsg_append (msg, &ifi, sizeof (ifi), NLMSG_ALIGNTO);
+	if (err >= 0)
+		err = nl_send_auto (priv->nlh_event, msg);
+	nlmsg_free (msg);
+
+	if (err < 0) {
+		g_set_error (error, NM_NETLINK_MONITOR_ERROR,
+		             NM_NETLINK_MONITOR_ERROR_GENERIC,
+		             _("error requesting link info: %s"),
+		             nl_geterror (err));
+		return FALSE;
+	}
 
 	return TRUE;
 }
@@ -620,18 +1089,23 @@ deferred_emit_carrier_state (gpointer user_data)
 {
 	NMNetlinkMonitor *self = NM_NETLINK_MONITOR (user_data);
 	NMNetlinkMonitorPrivate *priv = NM_NETLINK_MONITOR_GET_PRIVATE (self);
-	int err;
+	GList *indexes, *iter;
+	LinkEntry *entry;
 
 	priv->request_status_id = 0;
 
-	/* Update the link cache with latest state, and if there are no errors
-	 * emit the link states for all the interfaces in the cache.
+	/* Emit the link states for all the interfaces in the cache.  Handlers
+	 * may look up links themselves, which can change the index, so walk
+	 * a snapshot of it.
 	 */
-	err = nl_cache_refill (priv->nlh_sync, priv->link_cache);
-	if (err < 0)
-		nm_log_err (LOGD_HW, "error updating link cache: %s", nl_geterror (err));
-	else
-		nl_cache_foreach_filter (priv->link_cache, NULL, link_msg_handler, self);
+	process_pending_events (self);
+	indexes = g_hash_table_get_keys (priv->links_by_index);
+	for (iter = indexes; iter; iter = g_list_next (iter)) {
+		entry = link_index_lookup (priv, GPOINTER_TO_INT (iter->data));
+		if (entry && entry->link)
+			emit_carrier (self, entry->ifindex, rtnl_link_get_flags (entry->link));
+	}
+	g_list_free (indexes);
 
 	return FALSE;
 }
@@ -650,23 +1124,6 @@ nm_netlink_monitor_request_status (NMNetlinkMonitor *self)
 		priv->request_status_id = g_idle_add (deferred_emit_carrier_state, self);
 }
 
-typedef struct {
-	NMNetlinkMonitor *self;
-	struct rtnl_link *filter;
-	GError *error;
-	guint32 flags;
-} GetFlagsInfo;
-
-static void
-get_flags_sync_cb (struct nl_object *obj, void *arg)
-{
-	GetFlagsInfo *info = arg;
-
-	/* Ensure this cache item matches our filter */
-	if (nl_object_match_filter (obj, OBJ_CAST (info->filter)) != 0)
-		info->flags = rtnl_link_get_flags ((struct rtnl_link *) obj);
-}
-
 gboolean
 nm_netlink_monitor_get_flags_sync (NMNetlinkMonitor *self,
                                    guint32 ifindex,
@@ -674,9 +1131,7 @@ nm_netlink_monitor_get_flags_sync (NMNetlinkMonitor *self,
                                    GError **error)
 {
 	NMNetlinkMonitorPrivate *priv;
-	GetFlagsInfo info;
-	struct rtnl_link *filter;
-	int err;
+	LinkEntry *entry;
 
 	g_return_val_if_fail (self != NULL, FALSE);
 	g_return_val_if_fail (NM_IS_NETLINK_MONITOR (self), FALSE);
@@ -684,58 +1139,11 @@ nm_netlink_monitor_get_flags_sync (NMNetlinkMonitor *self,
 
 	priv = NM_NETLINK_MONITOR_GET_PRIVATE (self);
 
-	/* Update the link cache with the latest information */
-	err = nl_cache_refill (priv->nlh_sync, priv->link_cache);
-	if (err < 0) {
-		g_set_error (error,
-		             NM_NETLINK_MONITOR_ERROR,
-		             NM_NETLINK_MONITOR_ERROR_LINK_CACHE_UPDATE,
-		             _("error updating link cache: %s"),
-		             nl_geterror (err));
-		return FALSE;
-	}
-
-	/* HACK: Apparently to get it working we have to refill the cache twice;
-	 * otherwise some kernels (or maybe libnl?) only send a few of the
-	 * interfaces in the refill request.
-	 */
-	if (nl_cache_refill (priv->nlh_sync, priv->link_cache)) {
-		g_set_error (error,
-		             NM_NETLINK_MONITOR_ERROR,
-		             NM_NETLINK_MONITOR_ERROR_LINK_CACHE_UPDATE,
-		             _("error updating link cache: %s"),
-		             nl_geterror (err));
-		return FALSE;
-	}
-
-	/* Set up the filter */
-	filter = rtnl_link_alloc ();
-	if (!filter) {
-		g_set_error (error,
-		             NM_NETLINK_MONITOR_ERROR,
-		             NM_NETLINK_MONITOR_ERROR_BAD_ALLOC,
-		             _("error processing netlink message: %s"),
-		             nl_geterror (err));
-		return FALSE;
-	}
-	rtnl_link_set_ifindex (filter, ifindex);
-
-	memset (&info, 0, sizeof (info));
-	info.self = self;
-	info.filter = filter;
-	info.error = NULL;
-	nl_cache_foreach_filter (priv->link_cache, NULL, get_flags_sync_cb, &info);
+	/* Bring the link cache up-to-date with any queued notifications */
+	process_pending_events (self);
 
-	rtnl_link_put (filter);
-
-	if (info.error) {
-		if (error)
-			*error = info.error;
-		else
-			g_error_free (info.error);
-		return FALSE;
-	} else
-		*ifflags = info.flags;
+	entry = link_index_lookup (priv, ifindex);
+	*ifflags = (entry && entry->link) ? rtnl_link_get_flags (entry->link) : 0;
 
 	return TRUE; /* success */
 }
@@ -755,20 +1163,121 @@ nm_netlink_get_default_handle (void)
 	return nlh;
 }
 
+/**
+ * nm_netlink_get_addr_cache:
+ *
+ * Returns: the daemon-wide cache of all IPv4 and IPv6 addresses, brought
+ * up-to-date with any pending notifications.  The cache is owned by the
+ * netlink monitor and must not be modified or freed by the caller.
+ **/
+struct nl_cache *
+nm_netlink_get_addr_cache (void)
+{
+	NMNetlinkMonitor *self;
+	struct nl_cache *cache;
+
+	self = nm_netlink_monitor_get ();
+	process_pending_events (self);
+	cache = NM_NETLINK_MONITOR_GET_PRIVATE (self)->addr_cache;
+	g_object_unref (self);
+
+	return cache;
+}
+
+/**
+ * nm_netlink_get_addresses:
+ * @ifindex: interface index
+ * @family: address family, or AF_UNSPEC for all families
+ *
+ * Returns: the addresses currently configured on the interface, without
+ * walking the addresses of any other interface.  Each address in the
+ * returned list carries a reference which the caller must release with
+ * nl_object_put() before freeing the list.
+ **/
+GSList *
+nm_netlink_get_addresses (int ifindex, int family)
+{
+	NMNetlinkMonitor *self;
+	GSList *addrs;
+
+	g_return_val_if_fail (ifindex > 0, NULL);
+
+	self = nm_netlink_monitor_get ();
+	process_pending_events (self);
+	addrs = nm_netlink_addr_index_get (NM_NETLINK_MONITOR_GET_PRIVATE (self)->addr_index,
+	                                   ifindex, family);
+	g_object_unref (self);
+
+	return addrs;
+}
+
+/**
+ * nm_netlink_get_routes:
+ * @ifindex: outgoing interface index, or 0 for all interfaces
+ * @family: address family, or AF_UNSPEC for all families
+ *
+ * Returns: the routes through the interface, taken from the route index
+ * instead of a routing table dump.  Each route in the returned list carries
+ * a reference which the caller must release with nl_object_put() before
+ * freeing the list.
+ **/
+GSList *
+nm_netlink_get_routes (int ifindex, int family)
+{
+	NMNetlinkMonitor *self;
+	GSList *routes;
+
+	self = nm_netlink_monitor_get ();
+	process_pending_events (self);
+	routes = nm_netlink_route_index_get (NM_NETLINK_MONITOR_GET_PRIVATE (self)->route_index,
+	                                     ifindex, family);
+	g_object_unref (self);
+
+	return routes;
+}
+
+/**
+ * nm_netlink_lookup_routes:
+ * @family: address family
+ * @ifindex: outgoing interface index
+ * @table: routing table, eg RT_TABLE_MAIN
+ * @dst: destination with prefix length, or %NULL for the default route
+ *
+ * Returns: the routes to @dst through the interface; see
+ * nm_netlink_get_routes() for how to free the result.
+ **/
+GSList *
+nm_netlink_lookup_routes (int family, int ifindex, guint32 table, struct nl_addr *dst)
+{
+	NMNetlinkMonitor *self;
+	GSList *routes;
+
+	self = nm_netlink_monitor_get ();
+	process_pending_events (self);
+	routes = nm_netlink_route_index_lookup (NM_NETLINK_MONITOR_GET_PRIVATE (self)->route_index,
+	                                        family, ifindex, table, dst);
+	g_object_unref (self);
+
+	return routes;
+}
+
 int
 nm_netlink_iface_to_index (const char *iface)
 {
 	NMNetlinkMonitor *self;
 	NMNetlinkMonitorPrivate *priv;
-	int idx;
+	LinkEntry *entry;
+	int idx = 0;
 
 	g_return_val_if_fail (iface != NULL, -1);
 
 	self = nm_netlink_monitor_get ();
 	priv = NM_NETLINK_MONITOR_GET_PRIVATE (self);
 
-	nl_cache_refill (priv->nlh_sync, priv->link_cache);
-	idx = rtnl_link_name2i (priv->link_cache, iface);
+	process_pending_events (self);
+	entry = g_hash_table_lookup (priv->links_by_name, iface);
+	if (entry)
+		idx = entry->ifindex;
 	g_object_unref (self);
 
 	return idx;
@@ -781,12 +1290,12 @@ nm_netlink_iface_to_index (const char *iface)
  * Returns: the device name corresponding to the kernel interface index; caller
  * owns returned value and must free it when it is no longer required
  **/
-#define MAX_IFACE_LEN 33
 char *
 nm_netlink_index_to_iface (int idx)
 {
 	NMNetlinkMonitor *self;
 	NMNetlinkMonitorPrivate *priv;
+	LinkEntry *entry;
 	char *buf = NULL;
 
 	g_return_val_if_fail (idx >= 0, NULL);
@@ -794,15 +1303,12 @@ nm_netlink_index_to_iface (int idx)
 	self = nm_netlink_monitor_get ();
 	priv = NM_NETLINK_MONITOR_GET_PRIVATE (self);
 
-	buf = g_malloc0 (MAX_IFACE_LEN);
-	g_assert (buf);
-
-	nl_cache_refill (priv->nlh_sync, priv->link_cache);
-	if (!rtnl_link_i2name (priv->link_cache, idx, buf, MAX_IFACE_LEN - 1)) {
+	process_pending_events (self);
+	entry = link_index_lookup (priv, idx);
+	if (entry && entry->name)
+		buf = g_strdup (entry->name);
+	else
 		nm_log_warn (LOGD_HW, "(%d) failed to find interface name for index", idx);
-		g_free (buf);
-		buf = NULL;
-	}
 
 	g_object_unref (self);
 	return buf;
@@ -813,6 +1319,7 @@ nm_netlink_index_to_rtnl_link (int idx)
 {
 	NMNetlinkMonitor *self;
 	NMNetlinkMonitorPrivate *priv;
+	LinkEntry *entry;
 	struct rtnl_link *ret = NULL;
 
 	if (idx <= 0)
@@ -821,8 +1328,12 @@ nm_netlink_index_to_rtnl_link (int idx)
 	self = nm_netlink_monitor_get ();
 	priv = NM_NETLINK_MONITOR_GET_PRIVATE (self);
 
-	nl_cache_refill (priv->nlh_sync, priv->link_cache);
-	ret = rtnl_link_get (priv->link_cache, idx);
+	process_pending_events (self);
+	entry = link_index_lookup (priv, idx);
+	if (entry && entry->link) {
+		ret = entry->link;
+		nl_object_get (OBJ_CAST (ret));
+	}
 	g_object_unref (self);
 
 	return ret;
@@ -865,6 +1376,12 @@ nm_netlink_monitor_init (NMNetlinkMonitor *self)
 	NMNetlinkMonitorPrivate *priv = NM_NETLINK_MONITOR_GET_PRIVATE (self);
 
 	priv->subscriptions = g_hash_table_new (g_direct_hash, g_direct_equal);
+	priv->links_by_index = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+	                                              NULL, link_entry_free);
+	priv->links_by_name = g_hash_table_new (g_str_hash, g_str_equal);
+	priv->addr_index = nm_netlink_addr_index_new ();
+	priv->route_index = nm_netlink_route_index_new ();
+	priv->pending_msgs = g_queue_new ();
 }
 
 static void
@@ -875,14 +1392,34 @@ finalize (GObject *object)
 	if (priv->request_status_id)
 		g_source_remove (priv->request_status_id);
 
+	if (priv->resync_id)
+		g_source_remove (priv->resync_id);
+
+	if (priv->pending_id)
+		g_source_remove (priv->pending_id);
+	g_queue_foreach (priv->pending_msgs, (GFunc) nlmsg_free, NULL);
+	g_queue_free (priv->pending_msgs);
+
 	if (priv->io_channel)
 		nm_netlink_monitor_close_connection (NM_NETLINK_MONITOR (object));
 
+	g_hash_table_destroy (priv->links_by_name);
+	g_hash_table_destroy (priv->links_by_index);
+	nm_netlink_addr_index_free (priv->addr_index);
+
 	if (priv->link_cache) {
+		nl_cache_mngt_unprovide (priv->link_cache);
 		nl_cache_free (priv->link_cache);
 		priv->link_cache = NULL;
 	}
 
+	if (priv->addr_cache) {
+		nl_cache_free (priv->addr_cache);
+		priv->addr_cache = NULL;
+	}
+
+	nm_netlink_route_index_free (priv->route_index);
+
 	if (priv->nlh_event) {
 		nl_socket_free (priv->nlh_event);
 		priv->nlh_event = NULL;
@@ -43,7 +43,9 @@ typedef enum {
 	NM_NETLINK_MONITOR_ERROR_PROCESSING_MESSAGE,
 	NM_NETLINK_MONITOR_ERROR_BAD_ALLOC,
 	NM_NETLINK_MONITOR_ERROR_WAITING_FOR_SOCKET_DATA,
-	NM_NETLINK_MONITOR_ERROR_LINK_CACHE_UPDATE
+	NM_NETLINK_MONITOR_ERROR_LINK_CACHE_UPDATE,
+	NM_NETLINK_MONITOR_ERROR_NETLINK_ALLOC_ADDR_CACHE,
+	NM_NETLINK_MONITOR_ERROR_NETLINK_ALLOC_ROUTE_CACHE
 } NMNetlinkMonitorError;
 
 typedef struct {
@@ -79,6 +81,7 @@ void              nm_netlink_monitor_unsubscribe      (NMNetlinkMonitor *monitor
                                                        int group);
 
 gboolean          nm_netlink_monitor_request_ip6_info (NMNetlinkMonitor *monitor,
+                                                       int ifindex,
                                                        GError **error);
 
 gboolean          nm_netlink_monitor_request_bridge_info (NMNetlinkMonitor *monitor,
@@ -98,5 +101,12 @@ int               nm_netlink_iface_to_index     (const char *iface);
 char *            nm_netlink_index_to_iface     (int idx);
 struct rtnl_link *nm_netlink_index_to_rtnl_link (int idx);
 struct nl_sock *  nm_netlink_get_default_handle (void);
+struct nl_cache * nm_netlink_get_addr_cache     (void);
+GSList *          nm_netlink_get_addresses      (int ifindex, int family);
+GSList *          nm_netlink_get_routes         (int ifindex, int family);
+GSList *          nm_netlink_lookup_routes      (int family,
+                                                 int ifindex,
+                                                 guint32 table,
+                                                 struct nl_addr *dst);
 
 #endif  /* NM_NETLINK_MONITOR_H */
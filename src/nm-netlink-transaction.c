@@ -0,0 +1,649 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netlink/msg.h>
+#include <netlink/socket.h>
+
+#include "nm-netlink-transaction.h"
+#include "nm-netlink-monitor.h"
+#include "nm-logging.h"
+
+/* The kernel refuses datagrams larger than the socket's send buffer, so
+ * very large transactions are split over several sendmsg() calls.
+ */
+#define TRANSACTION_MAX_DATAGRAM (64 * 1024)
+
+/* Room for a full datagram; the kernel wants 32 bytes of it for itself */
+#define TRANSACTION_SNDBUF_SIZE (2 * TRANSACTION_MAX_DATAGRAM)
+
+/* Every request is acknowledged separately; make room for a few hundred */
+#define TRANSACTION_RCVBUF_SIZE (1024 * 1024)
+
+/* Seconds to wait for outstanding acknowledgements */
+#define TRANSACTION_TIMEOUT 10
+
+typedef struct {
+	NMNetlinkTransaction *trans;
+	struct nl_object *object;
+	struct nl_msg *msg;
+	int msgtype;
+	guint32 seq;
+	gboolean done;
+} Request;
+
+struct _NMNetlinkTransaction {
+	int ifindex;
+	GPtrArray *requests;
+	gboolean committed;
+	guint pending;
+	guint failed;
+	guint timeout_id;
+
+	NMNetlinkTransactionErrorFunc error_func;
+	NMNetlinkTransactionDoneFunc done_func;
+	gpointer user_data;
+};
+
+/* All transactions share one socket; acknowledgements are matched back to
+ * their request by sequence number.  It is separate from the monitor's
+ * synchronous socket so that requests made with rtnl_*_add() in the
+ * meantime never see our acknowledgements.
+ */
+typedef struct {
+	struct nl_sock *sk;
+	GIOChannel *channel;
+	guint watch_id;
+	guint32 seq;
+	GHashTable *pending;
+	guint max_datagram;
+} TransactionSocket;
+
+static TransactionSocket *tsock = NULL;
+
+static void
+warn_transaction (NMNetlinkTransaction *trans, const char *msg)
+{
+	char *iface = nm_netlink_index_to_iface (trans->ifindex);
+
+	nm_log_warn (LOGD_DEVICE, "(%s): %s", iface ? iface : "unknown", msg);
+	g_free (iface);
+}
+
+/*****************************************************************/
+
+static void
+request_free (Request *req)
+{
+	if (req->msg)
+		nlmsg_free (req->msg);
+	nl_object_put (req->object);
+	g_slice_free (Request, req);
+}
+
+/**
+ * nm_netlink_transaction_new:
+ * @ifindex: the interface the requests apply to, used for logging
+ *
+ * Returns: a new empty transaction
+ **/
+NMNetlinkTransaction *
+nm_netlink_transaction_new (int ifindex)
+{
+	NMNetlinkTransaction *trans;
+
+	trans = g_slice_new0 (NMNetlinkTransaction);
+	trans->ifindex = ifindex;
+	trans->requests = g_ptr_array_new_with_free_func ((GDestroyNotify) request_free);
+	return trans;
+}
+
+/**
+ * nm_netlink_transaction_free:
+ * @trans: a transaction which was not committed
+ *
+ * Drops all queued requests of @trans without sending them.  Committed
+ * transactions free themselves once all requests have been acknowledged.
+ **/
+void
+nm_netlink_transaction_free (NMNetlinkTransaction *trans)
+{
+	g_return_if_fail (trans != NULL);
+
+	if (trans->timeout_id)
+		g_source_remove (trans->timeout_id);
+	g_ptr_array_free (trans->requests, TRUE);
+	g_slice_free (NMNetlinkTransaction, trans);
+}
+
+int
+nm_netlink_transaction_get_ifindex (NMNetlinkTransaction *trans)
+{
+	g_return_val_if_fail (trans != NULL, 0);
+
+	return trans->ifindex;
+}
+
+guint
+nm_netlink_transaction_get_size (NMNetlinkTransaction *trans)
+{
+	g_return_val_if_fail (trans != NULL, 0);
+
+	return trans->requests->len;
+}
+
+static gboolean
+add_request (NMNetlinkTransaction *trans,
+             struct nl_object *object,
+             struct nl_msg *msg,
+             int err)
+{
+	Request *req;
+
+	if (err < 0 || !msg) {
+		warn_transaction (trans, "failed to build netlink request");
+		return FALSE;
+	}
+
+	req = g_slice_new0 (Request);
+	req->trans = trans;
+	req->object = object;
+	nl_object_get (object);
+	req->msg = msg;
+	req->msgtype = nlmsg_hdr (msg)->nlmsg_type;
+	g_ptr_array_add (trans->requests, req);
+	return TRUE;
+}
+
+/**
+ * nm_netlink_transaction_add_address:
+ * @trans: the transaction
+ * @addr: the address to add
+ * @flags: flags to pass to the request, eg %NLM_F_REPLACE
+ *
+ * Queues adding @addr.  The request is built immediately, so @addr may be
+ * changed or released afterwards.
+ *
+ * Returns: %TRUE if the request could be built
+ **/
+gboolean
+nm_netlink_transaction_add_address (NMNetlinkTransaction *trans,
+                                    struct rtnl_addr *addr,
+                                    int flags)
+{
+	struct nl_msg *msg = NULL;
+	int err;
+
+	g_return_val_if_fail (trans != NULL, FALSE);
+	g_return_val_if_fail (!trans->committed, FALSE);
+	g_return_val_if_fail (addr != NULL, FALSE);
+
+	err = rtnl_addr_build_add_request (addr, flags, &msg);
+	return add_request (trans, (struct nl_object *) addr, msg, err);
+}
+
+/**
+ * nm_netlink_transaction_delete_address:
+ * @trans: the transaction
+ * @addr: the address to remove
+ *
+ * Queues removing @addr.
+ *
+ * Returns: %TRUE if the request could be built
+ **/
+gboolean
+nm_netlink_transaction_delete_address (NMNetlinkTransaction *trans,
+                                       struct rtnl_addr *addr)
+{
+	struct nl_msg *msg = NULL;
+	int err;
+
+	g_return_val_if_fail (trans != NULL, FALSE);
+	g_return_val_if_fail (!trans->committed, FALSE);
+	g_return_val_if_fail (addr != NULL, FALSE);
+
+	err = rtnl_addr_build_delete_request (addr, 0, &msg);
+	return add_request (trans, (struct nl_object *) addr, msg, err);
+}
+
+/**
+ * nm_netlink_transaction_add_route:
+ * @trans: the transaction
+ * @route: the route to add
+ * @flags: flags to pass to the request, eg %NLM_F_REPLACE
+ *
+ * Queues adding @route.
+ *
+ * Returns: %TRUE if the request could be built
+ **/
+gboolean
+nm_netlink_transaction_add_route (NMNetlinkTransaction *trans,
+                                  struct rtnl_route *route,
+                                  int flags)
+{
+	struct nl_msg *msg = NULL;
+	int err;
+
+	g_return_val_if_fail (trans != NULL, FALSE);
+	g_return_val_if_fail (!trans->committed, FALSE);
+	g_return_val_if_fail (route != NULL, FALSE);
+
+	err = rtnl_route_build_add_request (route, flags, &msg);
+	return add_request (trans, (struct nl_object *) route, msg, err);
+}
+
+/**
+ * nm_netlink_transaction_delete_route:
+ * @trans: the transaction
+ * @route: the route to remove
+ *
+ * Queues removing @route.
+ *
+ * Returns: %TRUE if the request could be built
+ **/
+gboolean
+nm_netlink_transaction_delete_route (NMNetlinkTransaction *trans,
+                                     struct rtnl_route *route)
+{
+	struct nl_msg *msg = NULL;
+	int err;
+
+	g_return_val_if_fail (trans != NULL, FALSE);
+	g_return_val_if_fail (!trans->committed, FALSE);
+	g_return_val_if_fail (route != NULL, FALSE);
+
+	err = rtnl_route_build_del_request (route, 0, &msg);
+	return add_request (trans, (struct nl_object *) route, msg, err);
+}
+
+/**
+ * nm_netlink_transaction_change_link:
+ * @trans: the transaction
+ * @old: the link as currently known
+ * @changes: a link object holding only the attributes to change
+ *
+ * Queues changing the attributes of @old set in @changes, eg the MTU.
+ * @changes is what the error callback receives if the request fails.
+ *
+ * Returns: %TRUE if the request could be built
+ **/
+gboolean
+nm_netlink_transaction_change_link (NMNetlinkTransaction *trans,
+                                    struct rtnl_link *old,
+                                    struct rtnl_link *changes)
+{
+	struct nl_msg *msg = NULL;
+	int err;
+
+	g_return_val_if_fail (trans != NULL, FALSE);
+	g_return_val_if_fail (!trans->committed, FALSE);
+	g_return_val_if_fail (old != NULL, FALSE);
+	g_return_val_if_fail (changes != NULL, FALSE);
+
+	err = rtnl_link_build_change_request (old, changes, 0, &msg);
+	return add_request (trans, (struct nl_object *) changes, msg, err);
+}
+
+/*****************************************************************/
+
+static void
+transaction_finish (NMNetlinkTransaction *trans)
+{
+	if (trans->timeout_id) {
+		g_source_remove (trans->timeout_id);
+		trans->timeout_id = 0;
+	}
+
+	if (trans->done_func)
+		trans->done_func (trans, trans->failed, trans->user_data);
+	nm_netlink_transaction_free (trans);
+}
+
+static void
+request_done (Request *req, int err)
+{
+	NMNetlinkTransaction *trans = req->trans;
+
+	g_return_if_fail (req->done == FALSE);
+	g_return_if_fail (trans->pending > 0);
+
+	req->done = TRUE;
+	if (req->seq && tsock)
+		g_hash_table_remove (tsock->pending, GUINT_TO_POINTER (req->seq));
+
+	if (err < 0) {
+		trans->failed++;
+		if (trans->error_func)
+			trans->error_func (trans, req->object, req->msgtype, err, trans->user_data);
+	}
+
+	if (--trans->pending == 0)
+		transaction_finish (trans);
+}
+
+static int
+ack_cb (struct nl_msg *msg, void *arg)
+{
+	Request *req;
+
+	req = g_hash_table_lookup (tsock->pending, GUINT_TO_POINTER (nlmsg_hdr (msg)->nlmsg_seq));
+	if (req)
+		request_done (req, 0);
+	return NL_OK;
+}
+
+static int
+error_cb (struct sockaddr_nl *nla, struct nlmsgerr *e, void *arg)
+{
+	Request *req;
+	int err;
+
+	err = -nl_syserr2nlerr (e->error);
+
+	/* LIBNL Bug: Aliased ESRCH */
+	if (err == -NLE_FAILURE)
+		err = -NLE_OBJ_NOTFOUND;
+
+	req = g_hash_table_lookup (tsock->pending, GUINT_TO_POINTER (e->msg.nlmsg_seq));
+	if (req)
+		request_done (req, err);
+
+	/* Keep going; one failed request says nothing about the others */
+	return NL_SKIP;
+}
+
+static gboolean
+tsock_has_data (void)
+{
+	struct pollfd pfd;
+
+	pfd.fd = nl_socket_get_fd (tsock->sk);
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	return poll (&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+static void
+transaction_complete_pending (NMNetlinkTransaction *trans, const char *reason)
+{
+	guint i;
+
+	/* The outcome of the outstanding requests is unknown; the kernel did
+	 * process them though, and the monitor's caches will tell the real state.
+	 */
+	warn_transaction (trans, reason);
+
+	/* Hold the last pending slot so the transaction outlives the loop */
+	trans->pending++;
+	for (i = 0; i < trans->requests->len; i++) {
+		Request *req = g_ptr_array_index (trans->requests, i);
+
+		if (!req->done)
+			request_done (req, 0);
+	}
+	if (--trans->pending == 0)
+		transaction_finish (trans);
+}
+
+static void
+complete_all_pending (void)
+{
+	GHashTable *transactions;
+	GHashTableIter iter;
+	Request *req;
+	GList *list, *l;
+
+	transactions = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_hash_table_iter_init (&iter, tsock->pending);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer) &req))
+		g_hash_table_insert (transactions, req->trans, req->trans);
+
+	list = g_hash_table_get_keys (transactions);
+	for (l = list; l; l = g_list_next (l))
+		transaction_complete_pending (l->data, "netlink acknowledgements lost");
+	g_list_free (list);
+	g_hash_table_destroy (transactions);
+}
+
+static gboolean
+tsock_event (GIOChannel *channel, GIOCondition condition, gpointer user_data)
+{
+	int err;
+
+	if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+		nm_log_warn (LOGD_DEVICE, "error on netlink transaction socket");
+		complete_all_pending ();
+
+		/* Start over with a fresh socket on the next commit */
+		g_io_channel_unref (tsock->channel);
+		nl_socket_free (tsock->sk);
+		g_hash_table_destroy (tsock->pending);
+		g_slice_free (TransactionSocket, tsock);
+		tsock = NULL;
+		return FALSE;
+	}
+
+	/* Each acknowledgement is a datagram of its own; take all that are
+	 * queued rather than waking up once per request.
+	 */
+	do {
+		err = nl_recvmsgs_default (tsock->sk);
+		if (err == -NLE_NOMEM) {
+			/* ENOBUFS: the receive buffer overflowed */
+			complete_all_pending ();
+			break;
+		} else if (err < 0 && err != -NLE_AGAIN) {
+			nm_log_warn (LOGD_DEVICE, "error reading netlink acknowledgements: (%d) %s",
+			             err, nl_geterror (err));
+			break;
+		}
+	} while (g_hash_table_size (tsock->pending) && tsock_has_data ());
+
+	return TRUE;
+}
+
+/**
+ * nm_netlink_transaction_setup_socket:
+ * @sk: a connected netlink socket
+ *
+ * Sizes the buffers of @sk for transactions.  The send buffer the kernel
+ * ends up using may be smaller than asked for (net.core.wmem_max), so the
+ * datagram size is derived from what it reports back.
+ *
+ * Returns: the largest datagram @sk can send, or 0 on error
+ **/
+guint
+nm_netlink_transaction_setup_socket (struct nl_sock *sk)
+{
+	int sndbuf = 0;
+	socklen_t len = sizeof (sndbuf);
+	int err;
+
+	err = nl_socket_set_buffer_size (sk, TRANSACTION_RCVBUF_SIZE, TRANSACTION_SNDBUF_SIZE);
+	if (err < 0) {
+		nm_log_warn (LOGD_DEVICE, "unable to size netlink transaction socket buffers: %s",
+		             nl_geterror (err));
+	}
+
+	if (getsockopt (nl_socket_get_fd (sk), SOL_SOCKET, SO_SNDBUF, &sndbuf, &len) < 0) {
+		nm_log_err (LOGD_DEVICE, "unable to read netlink transaction send buffer size: (%d) %s",
+		            errno, strerror (errno));
+		return 0;
+	}
+
+	/* netlink_sendmsg() refuses anything longer than sk_sndbuf - 32 */
+	if (sndbuf <= 32)
+		return 0;
+	return MIN (TRANSACTION_MAX_DATAGRAM, sndbuf - 32);
+}
+
+static TransactionSocket *
+get_socket (void)
+{
+	struct nl_sock *sk;
+	guint max_datagram;
+	int err;
+
+	if (tsock)
+		return tsock;
+
+	sk = nl_socket_alloc ();
+	if (!sk)
+		return NULL;
+
+	err = nl_connect (sk, NETLINK_ROUTE);
+	if (err < 0) {
+		nm_log_err (LOGD_DEVICE, "unable to connect netlink transaction socket: %s",
+		            nl_geterror (err));
+		nl_socket_free (sk);
+		return NULL;
+	}
+
+	nl_socket_disable_seq_check (sk);
+	nl_socket_set_nonblocking (sk);
+	max_datagram = nm_netlink_transaction_setup_socket (sk);
+	if (!max_datagram) {
+		nl_socket_free (sk);
+		return NULL;
+	}
+	nl_socket_modify_cb (sk, NL_CB_ACK, NL_CB_CUSTOM, ack_cb, NULL);
+	nl_socket_modify_err_cb (sk, NL_CB_CUSTOM, error_cb, NULL);
+
+	tsock = g_slice_new0 (TransactionSocket);
+	tsock->sk = sk;
+	tsock->seq = (guint32) time (NULL);
+	tsock->pending = g_hash_table_new (g_direct_hash, g_direct_equal);
+	tsock->max_datagram = max_datagram;
+	tsock->channel = g_io_channel_unix_new (nl_socket_get_fd (sk));
+	g_io_channel_set_encoding (tsock->channel, NULL, NULL);
+	tsock->watch_id = g_io_add_watch (tsock->channel,
+	                                  G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+	                                  tsock_event, NULL);
+	return tsock;
+}
+
+static gboolean
+transaction_timeout (gpointer user_data)
+{
+	NMNetlinkTransaction *trans = user_data;
+
+	trans->timeout_id = 0;
+	transaction_complete_pending (trans, "timed out waiting for netlink acknowledgements");
+	return FALSE;
+}
+
+static void
+send_datagram (NMNetlinkTransaction *trans, GByteArray *buf, guint first, guint last)
+{
+	int err;
+	guint i;
+
+	if (buf->len == 0)
+		return;
+
+	err = nl_sendto (tsock->sk, buf->data, buf->len);
+	if (err < 0) {
+		for (i = first; i < last; i++)
+			request_done (g_ptr_array_index (trans->requests, i), err);
+	}
+	g_byte_array_set_size (buf, 0);
+}
+
+/**
+ * nm_netlink_transaction_commit:
+ * @trans: the transaction
+ * @error_func: called for each request the kernel rejected
+ * @done_func: called once all requests have been acknowledged
+ * @user_data: user data for @error_func and @done_func
+ *
+ * Sends all requests of @trans to the kernel in as few datagrams as
+ * possible.  By the time this returns the kernel has applied them; errors
+ * are reported asynchronously through @error_func.  Ownership of @trans
+ * passes to the transaction machinery, which frees it after @done_func.
+ **/
+void
+nm_netlink_transaction_commit (NMNetlinkTransaction *trans,
+                               NMNetlinkTransactionErrorFunc error_func,
+                               NMNetlinkTransactionDoneFunc done_func,
+                               gpointer user_data)
+{
+	static const guint8 padding[NLMSG_ALIGNTO] = { 0 };
+	GByteArray *buf;
+	guint32 port;
+	guint i, first = 0;
+
+	g_return_if_fail (trans != NULL);
+	g_return_if_fail (!trans->committed);
+
+	trans->committed = TRUE;
+	trans->error_func = error_func;
+	trans->done_func = done_func;
+	trans->user_data = user_data;
+
+	/* One extra slot keeps the transaction alive until everything is sent */
+	trans->pending = trans->requests->len + 1;
+
+	if (!get_socket ()) {
+		for (i = 0; i < trans->requests->len; i++)
+			request_done (g_ptr_array_index (trans->requests, i), -NLE_BAD_SOCK);
+		goto out;
+	}
+
+	port = nl_socket_get_local_port (tsock->sk);
+	buf = g_byte_array_sized_new (4096);
+	for (i = 0; i < trans->requests->len; i++) {
+		Request *req = g_ptr_array_index (trans->requests, i);
+		struct nlmsghdr *hdr = nlmsg_hdr (req->msg);
+
+		if (buf->len + NLMSG_ALIGN (hdr->nlmsg_len) > tsock->max_datagram) {
+			send_datagram (trans, buf, first, i);
+			first = i;
+		}
+
+		if (++tsock->seq == 0)
+			tsock->seq++;
+		req->seq = tsock->seq;
+		hdr->nlmsg_seq = req->seq;
+		hdr->nlmsg_pid = port;
+		hdr->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+		g_hash_table_insert (tsock->pending, GUINT_TO_POINTER (req->seq), req);
+
+		g_byte_array_append (buf, (const guint8 *) hdr, hdr->nlmsg_len);
+		g_byte_array_append (buf, padding, NLMSG_ALIGN (hdr->nlmsg_len) - hdr->nlmsg_len);
+
+		/* The message is in the datagram now */
+		nlmsg_free (req->msg);
+		req->msg = NULL;
+	}
+	send_datagram (trans, buf, first, trans->requests->len);
+	g_byte_array_free (buf, TRUE);
+
+	if (trans->pending > 1)
+		trans->timeout_id = g_timeout_add_seconds (TRANSACTION_TIMEOUT, transaction_timeout, trans);
+
+out:
+	if (--trans->pending == 0)
+		transaction_finish (trans);
+}
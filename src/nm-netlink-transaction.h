@@ -0,0 +1,92 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#ifndef NM_NETLINK_TRANSACTION_H
+#define NM_NETLINK_TRANSACTION_H
+
+#include <glib.h>
+#include <netlink/netlink.h>
+#include <netlink/route/addr.h>
+#include <netlink/route/route.h>
+#include <netlink/route/link.h>
+
+/* A batch of rtnetlink requests sent to the kernel in one go.  The kernel
+ * handles every message of a datagram in order during the sendmsg() call
+ * itself, so the changes are in effect once the commit returns; only the
+ * acknowledgements are collected later from the main loop.
+ */
+typedef struct _NMNetlinkTransaction NMNetlinkTransaction;
+
+/**
+ * NMNetlinkTransactionErrorFunc:
+ * @trans: the transaction
+ * @object: the address, route or link the failed request was built from
+ * @msgtype: the request's message type, eg %RTM_NEWROUTE
+ * @err: the netlink error the kernel returned for the request
+ * @user_data: the user data passed to nm_netlink_transaction_commit()
+ *
+ * Called once for every request of @trans the kernel rejected.
+ **/
+typedef void (*NMNetlinkTransactionErrorFunc) (NMNetlinkTransaction *trans,
+                                               struct nl_object *object,
+                                               int msgtype,
+                                               int err,
+                                               gpointer user_data);
+
+/**
+ * NMNetlinkTransactionDoneFunc:
+ * @trans: the transaction
+ * @num_failed: the number of requests that failed
+ * @user_data: the user data passed to nm_netlink_transaction_commit()
+ *
+ * Called once every request of @trans has been acknowledged.  @trans is
+ * freed after this returns.
+ **/
+typedef void (*NMNetlinkTransactionDoneFunc) (NMNetlinkTransaction *trans,
+                                              guint num_failed,
+                                              gpointer user_data);
+
+NMNetlinkTransaction *nm_netlink_transaction_new            (int ifindex);
+void                  nm_netlink_transaction_free           (NMNetlinkTransaction *trans);
+int                   nm_netlink_transaction_get_ifindex    (NMNetlinkTransaction *trans);
+guint                 nm_netlink_transaction_get_size       (NMNetlinkTransaction *trans);
+
+gboolean              nm_netlink_transaction_add_address    (NMNetlinkTransaction *trans,
+                                                             struct rtnl_addr *addr,
+                                                             int flags);
+gboolean              nm_netlink_transaction_delete_address (NMNetlinkTransaction *trans,
+                                                             struct rtnl_addr *addr);
+gboolean              nm_netlink_transaction_add_route      (NMNetlinkTransaction *trans,
+                                                             struct rtnl_route *route,
+                                                             int flags);
+gboolean              nm_netlink_transaction_delete_route   (NMNetlinkTransaction *trans,
+                                                             struct rtnl_route *route);
+gboolean              nm_netlink_transaction_change_link    (NMNetlinkTransaction *trans,
+                                                             struct rtnl_link *old,
+                                                             struct rtnl_link *changes);
+
+guint                 nm_netlink_transaction_setup_socket   (struct nl_sock *sk);
+
+void                  nm_netlink_transaction_commit         (NMNetlinkTransaction *trans,
+                                                             NMNetlinkTransactionErrorFunc error_func,
+                                                             NMNetlinkTransactionDoneFunc done_func,
+                                                             gpointer user_data);
+
+#endif  /* NM_NETLINK_TRANSACTION_H */
@@ -85,8 +85,7 @@ nm_netlink_find_address (int ifindex,
                          void *addr,  /* struct in_addr or struct in6_addr */
                          int prefix)
 {
-	struct nl_sock *nlh = NULL;
-	struct nl_cache *cache = NULL;
+	GSList *addrs, *iter;
 	FindAddrInfo info;
 
 	g_return_val_if_fail (ifindex > 0, FALSE);
@@ -106,15 +105,13 @@ nm_netlink_find_address (int ifindex,
 	else
 		g_assert_not_reached ();
 
-	nlh = nm_netlink_get_default_handle ();
-	if (nlh) {
-		rtnl_addr_alloc_cache(nlh, &cache);
-		if (cache) {
-			nl_cache_mngt_provide (cache);
-			nl_cache_foreach (cache, find_one_address, &info);
-			nl_cache_free (cache);
-		}
+	addrs = nm_netlink_get_addresses (ifindex, family);
+	for (iter = addrs; iter; iter = g_slist_next (iter)) {
+		find_one_address (iter->data, &info);
+		nl_object_put (iter->data);
 	}
+	g_slist_free (addrs);
+
 	return info.found;
 }
 
@@ -161,30 +158,30 @@ nm_netlink_route_new (int ifindex,
 }
 
 /**
- * _route_add:
- * @route: the route to add
+ * _route_build:
+ * @route: the route to fill in
  * @family: address family, either %AF_INET or %AF_INET6
  * @dest: the route destination address, either a struct in_addr or a struct
  *   in6_addr depending on @family
  * @dest_prefix: the CIDR prefix of @dest
  * @gateway: the gateway through which to reach @dest, if any; given as a
  *   struct in_addr or struct in6_addr depending on @family
- * @flags: flags to pass to rtnl_route_add(), eg %NLM_F_REPLACE
+ *
+ * Sets the destination and gateway of @route without sending anything to
+ * the kernel.
  *
  * Returns: zero if succeeded or the netlink error otherwise.
  **/
 static int
-_route_add (struct rtnl_route *route,
-            int family,
-            const void *dest, /* in_addr or in6_addr */
-            int dest_prefix,
-            const void *gateway, /* in_addr or in6_addr */
-            int flags)
+_route_build (struct rtnl_route *route,
+              int family,
+              const void *dest, /* in_addr or in6_addr */
+              int dest_prefix,
+              const void *gateway) /* in_addr or in6_addr */
 {
-	struct nl_sock *sk;
 	struct nl_addr *dest_addr, *gw_addr;
 	void *tmp_addr;
-	int addrlen, err, log;
+	int addrlen, log;
 
 	if (family == AF_INET) {
 		addrlen = sizeof (struct in_addr);
@@ -195,8 +192,6 @@ _route_add (struct rtnl_route *route,
 	} else
 		g_assert_not_reached ();
 
-	sk = nm_netlink_get_default_handle ();
-
 	/* Build up the destination address */
 	if (dest) {
 		/* Copy to preserve const */
@@ -230,6 +225,38 @@ _route_add (struct rtnl_route *route,
 			nm_log_err (LOGD_DEVICE | log, "Invalid gateway");
 	}
 
+	return 0;
+}
+
+/**
+ * _route_add:
+ * @route: the route to add
+ * @family: address family, either %AF_INET or %AF_INET6
+ * @dest: the route destination address, either a struct in_addr or a struct
+ *   in6_addr depending on @family
+ * @dest_prefix: the CIDR prefix of @dest
+ * @gateway: the gateway through which to reach @dest, if any; given as a
+ *   struct in_addr or struct in6_addr depending on @family
+ * @flags: flags to pass to rtnl_route_add(), eg %NLM_F_REPLACE
+ *
+ * Returns: zero if succeeded or the netlink error otherwise.
+ **/
+static int
+_route_add (struct rtnl_route *route,
+            int family,
+            const void *dest, /* in_addr or in6_addr */
+            int dest_prefix,
+            const void *gateway, /* in_addr or in6_addr */
+            int flags)
+{
+	struct nl_sock *sk;
+	int err;
+
+	err = _route_build (route, family, dest, dest_prefix, gateway);
+	if (err < 0)
+		return err;
+
+	sk = nm_netlink_get_default_handle ();
 	err = rtnl_route_add (sk, route, flags);
 
 	/* LIBNL Bug: Aliased ESRCH */
@@ -239,6 +266,48 @@ _route_add (struct rtnl_route *route,
 	return err;
 }
 
+/**
+ * nm_netlink_route4_build:
+ * @route: the route to fill in
+ * @dest: the route destination address in network byte order
+ * @dest_prefix: the CIDR prefix of @dest
+ * @gateway: the gateway through which to reach @dest, if any, in network byte order
+ *
+ * Sets up an IPv4 route with the given parameters without adding it, eg
+ * for queueing it in an #NMNetlinkTransaction.
+ *
+ * Returns: zero if succeeded or the netlink error otherwise.
+ **/
+int
+nm_netlink_route4_build (struct rtnl_route *route,
+                         guint32 *dst,
+                         int prefix,
+                         guint32 *gw)
+{
+	return _route_build (route, AF_INET, dst, prefix, gw);
+}
+
+/**
+ * nm_netlink_route6_build:
+ * @route: the route to fill in
+ * @dest: the route destination address
+ * @dest_prefix: the CIDR prefix of @dest
+ * @gateway: the gateway through which to reach @dest, if any
+ *
+ * Sets up an IPv6 route with the given parameters without adding it, eg
+ * for queueing it in an #NMNetlinkTransaction.
+ *
+ * Returns: zero if succeeded or the netlink error otherwise.
+ **/
+int
+nm_netlink_route6_build (struct rtnl_route *route,
+                         const struct in6_addr *dst,
+                         int prefix,
+                         const struct in6_addr *gw)
+{
+	return _route_build (route, AF_INET6, dst, prefix, gw);
+}
+
 /**
  * nm_netlink_route4_add:
  * @route: the route to add
@@ -381,18 +450,10 @@ foreach_route_cb (struct nl_object *object, void *user_data)
 	if (nm_logging_level_enabled (LOGL_DEBUG))
 		dump_route (route);
 
-	if (   info->ifindex > 0
-	    && rtnl_route_get_oif (route) != info->ifindex)
-		return;
-
 	if (   info->scope != RT_SCOPE_UNIVERSE
 	    && rtnl_route_get_scope (route) != info->scope)
 		return;
 
-	if (   info->family != AF_UNSPEC
-	    && rtnl_route_get_family (route) != info->family)
-		return;
-
 	dst = rtnl_route_get_dst (route);
 
 	/* Check for IPv6 LL and MC routes that might need to be ignored */
@@ -412,7 +473,7 @@ foreach_route_cb (struct nl_object *object, void *user_data)
 
 	info->out_route = info->callback (route, dst, info->iface, info->user_data);
 	if (info->out_route) {
-		/* Ref the route so it sticks around after the cache is cleared */
+		/* Ref the route so it sticks around after the list is freed */
 		rtnl_route_get (info->out_route);
 	}
 }
@@ -427,7 +488,8 @@ foreach_route_cb (struct nl_object *object, void *user_data)
  * @user_data: data passed to @callback
  *
  * Filters each route in the routing table against the given @ifindex and
- * @family (if given) and calls @callback for each matching route.
+ * @family (if given) and calls @callback for each matching route.  Only the
+ * routes through @ifindex are looked at, without dumping the routing table.
  *
  * Returns: a route if @callback returned one; the caller must dispose of the
  * route using rtnl_route_put() when it is no longer required.
@@ -440,7 +502,7 @@ nm_netlink_foreach_route (int ifindex,
                           NlRouteForeachFunc callback,
                           gpointer user_data)
 {
-	struct nl_cache *cache;
+	GSList *routes, *iter;
 	ForeachRouteInfo info;
 
 	memset (&info, 0, sizeof (info));
@@ -452,12 +514,16 @@ nm_netlink_foreach_route (int ifindex,
 	info.user_data = user_data;
 	info.iface = nm_netlink_index_to_iface (ifindex);
 
-	rtnl_route_alloc_cache (nm_netlink_get_default_handle (), family, NL_AUTO_PROVIDE, &cache);
-	g_warn_if_fail (cache != NULL);
-	if (cache) {
-		nl_cache_foreach (cache, foreach_route_cb, &info);
-		nl_cache_free (cache);
+	/* The route index already filters by interface and family; the callback
+	 * is free to delete routes since it walks a private list.
+	 */
+	routes = nm_netlink_get_routes (ifindex, family);
+	for (iter = routes; iter; iter = g_slist_next (iter)) {
+		foreach_route_cb (iter->data, &info);
+		nl_object_put (iter->data);
 	}
+	g_slist_free (routes);
+
 	g_free (info.iface);
 	return info.out_route;
 }
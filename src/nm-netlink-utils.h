@@ -53,6 +53,16 @@ int nm_netlink_route6_add (struct rtnl_route *route,
                           const struct in6_addr *gw,
                           int flags);
 
+int nm_netlink_route4_build (struct rtnl_route *route,
+                             guint32 *dst,
+                             int prefix,
+                             guint32 *gw);
+
+int nm_netlink_route6_build (struct rtnl_route *route,
+                             const struct in6_addr *dst,
+                             int prefix,
+                             const struct in6_addr *gw);
+
 gboolean nm_netlink_route_delete (struct rtnl_route *route);
 
 /**
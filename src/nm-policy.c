@@ -848,6 +848,32 @@ activate_data_free (ActivateData *data)
 	g_free (data);
 }
 
+static void
+add_autoconnect_candidate (NMSettings *settings,
+                           NMSettingsConnection *candidate,
+                           gpointer user_data)
+{
+	GSList **list = user_data;
+	const char *permission;
+
+	/* Ignore connections that were tried too many times or are not visible
+	 * to any logged-in users.  Also ignore shared wifi connections for
+	 * which no user has the shared wifi permission.
+	 */
+	if (get_connection_auto_retries (NM_CONNECTION (candidate)) == 0)
+		return;
+	if (nm_settings_connection_is_visible (candidate) == FALSE)
+		return;
+
+	permission = nm_utils_get_shared_wifi_permission (NM_CONNECTION (candidate));
+	if (permission) {
+		if (nm_settings_connection_check_permission (candidate, permission) == FALSE)
+			return;
+	}
+
+	*list = g_slist_prepend (*list, candidate);
+}
+
 static gboolean
 auto_activate_device (gpointer user_data)
 {
@@ -855,7 +881,7 @@ auto_activate_device (gpointer user_data)
 	NMPolicy *policy;
 	NMConnection *best_connection;
 	char *specific_object = NULL;
-	GSList *connections, *iter;
+	GSList *connections = NULL;
 
 	g_assert (data);
 	policy = data->policy;
@@ -870,35 +896,11 @@ auto_activate_device (gpointer user_data)
 	if (nm_device_get_act_request (data->device))
 		goto out;
 
-	iter = connections = nm_settings_get_connections (policy->settings);
-
-	/* Remove connections that shouldn't be auto-activated */
-	while (iter) {
-		NMSettingsConnection *candidate = NM_SETTINGS_CONNECTION (iter->data);
-		gboolean remove_it = FALSE;
-		const char *permission;
-
-		/* Grab next item before we possibly delete the current item */
-		iter = g_slist_next (iter);
-
-		/* Ignore connections that were tried too many times or are not visible
-		 * to any logged-in users.  Also ignore shared wifi connections for
-		 * which no user has the shared wifi permission.
-		 */
-		if (   get_connection_auto_retries (NM_CONNECTION (candidate)) == 0
-		    || nm_settings_connection_is_visible (candidate) == FALSE)
-			remove_it = TRUE;
-		else {
-			permission = nm_utils_get_shared_wifi_permission (NM_CONNECTION (candidate));
-			if (permission) {
-				if (nm_settings_connection_check_permission (candidate, permission) == FALSE)
-					remove_it = TRUE;
-			}
-		}
-
-		if (remove_it)
-			connections = g_slist_remove (connections, candidate);
-	}
+	/* Collect the connections that may be auto-activated, keeping the
+	 * settings' autoconnect/timestamp ordering.
+	 */
+	nm_settings_for_each_connection_sorted (policy->settings, add_autoconnect_candidate, &connections);
+	connections = g_slist_reverse (connections);
 
 	best_connection = nm_device_get_best_auto_connection (data->device, connections, &specific_object);
 	if (best_connection) {
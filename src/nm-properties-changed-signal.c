@@ -23,39 +23,52 @@
 #include <stdio.h>
 
 #include <dbus/dbus-glib.h>
-#ifdef DEBUG
 #include "nm-logging.h"
-#endif
 #include "nm-properties-changed-signal.h"
 #include "nm-dbus-glib-types.h"
 
 #define NM_DBUS_PROPERTY_CHANGED "NM_DBUS_PROPERTY_CHANGED"
 
+#define NUM_PRIORITIES (NM_PROPERTIES_CHANGED_PRIORITY_HIGH + 1)
+
+/* Dirty properties of one object, waiting for the next flush */
 typedef struct {
-	GHashTable *hash;
+	GObject *object;
 	gulong signal_id;
-	guint idle_id;
+	NMPropertiesChangedPriority priority;
+	GPtrArray *dirty;    /* GParamSpec */
+	GList *link;         /* in queues[priority], or NULL */
 } PropertiesChangedInfo;
 
-static void
-destroy_value (gpointer data)
+/* Objects with dirty properties, highest priority last, each in the order
+ * they first changed.  One source flushes all of them.
+ */
+static GQueue queues[NUM_PRIORITIES];
+static guint flush_id = 0;
+static guint flush_interval = 0;
+static gint64 last_flush = 0;
+
+static guint64 emitted = 0;
+static guint64 coalesced = 0;
+
+static GQuark
+dbus_name_quark (void)
 {
-	GValue *val = (GValue *) data;
+	static GQuark quark = 0;
 
-	g_value_unset (val);
-	g_slice_free (GValue, val);
+	if (G_UNLIKELY (!quark))
+		quark = g_quark_from_static_string ("nm-properties-changed-dbus-name");
+	return quark;
 }
 
-static PropertiesChangedInfo *
-properties_changed_info_new (void)
+static GQuark
+priority_quark (void)
 {
-	PropertiesChangedInfo *info;
+	static GQuark quark = 0;
 
-	info = g_slice_new0 (PropertiesChangedInfo);
-	info->hash = g_hash_table_new_full (g_str_hash, g_str_equal, 
-								 (GDestroyNotify) g_free,
-								 destroy_value);
-	return info;
+	if (G_UNLIKELY (!quark))
+		quark = g_quark_from_static_string ("nm-properties-changed-priority");
+	return quark;
 }
 
 static void
@@ -63,13 +76,72 @@ properties_changed_info_destroy (gpointer data)
 {
 	PropertiesChangedInfo *info = (PropertiesChangedInfo *) data;
 
-	if (info->idle_id)
-		g_source_remove (info->idle_id);
+	/* The object is going away; drop its pending changes */
+	if (info->link)
+		g_queue_delete_link (&queues[info->priority], info->link);
 
-	g_hash_table_destroy (info->hash);
+	g_ptr_array_free (info->dirty, TRUE);
 	g_slice_free (PropertiesChangedInfo, info);
 }
 
+static char*
+uscore_to_wincaps (const char *uscore)
+{
+	const char *p;
+	GString *str;
+	gboolean last_was_uscore;
+
+	last_was_uscore = TRUE;
+  
+	str = g_string_new (NULL);
+	p = uscore;
+	while (p && *p) {
+		if (*p == '-' || *p == '_')
+			last_was_uscore = TRUE;
+		else {
+			if (last_was_uscore) {
+				g_string_append_c (str, g_ascii_toupper (*p));
+				last_was_uscore = FALSE;
+			} else
+				g_string_append_c (str, *p);
+		}
+		++p;
+	}
+
+	return g_string_free (str, FALSE);
+}
+
+/* The D-Bus name of a property, computed once per GParamSpec */
+static const char *
+get_dbus_name (GParamSpec *pspec)
+{
+	const char *name;
+	char *wincaps;
+
+	name = g_param_spec_get_qdata (pspec, dbus_name_quark ());
+	if (G_UNLIKELY (!name)) {
+		wincaps = uscore_to_wincaps (pspec->name);
+		name = g_intern_string (wincaps);
+		g_free (wincaps);
+		g_param_spec_set_qdata (pspec, dbus_name_quark (), (gpointer) name);
+	}
+	return name;
+}
+
+static NMPropertiesChangedPriority
+get_priority (GType type)
+{
+	gpointer p;
+
+	/* Subclasses inherit the priority of their parents */
+	for (; type; type = g_type_parent (type)) {
+		p = g_type_get_qdata (type, priority_quark ());
+		if (p)
+			return GPOINTER_TO_INT (p) - 1;
+	}
+	return NM_PROPERTIES_CHANGED_PRIORITY_DEFAULT;
+}
+
 #ifdef DEBUG
 static void
 add_to_string (gpointer key, gpointer value, gpointer user_data)
@@ -97,71 +169,107 @@ add_to_string (gpointer key, gpointer value, gpointer user_data)
 }
 #endif
 
-static gboolean
-properties_changed (gpointer data)
+static void
+emit_properties_changed (PropertiesChangedInfo *info)
 {
-	GObject *object = G_OBJECT (data);
-	PropertiesChangedInfo *info = (PropertiesChangedInfo *) g_object_get_data (object, NM_DBUS_PROPERTY_CHANGED);
-
-	g_assert (info);
+	GObject *object = info->object;
+	GHashTable *hash;
+	GValue *values;
+	guint i, n = info->dirty->len;
+
+	/* Read the values now, so a property that changed several times since
+	 * the last flush is only read and sent once.  The names are static and
+	 * the values live in one block, so the hash owns nothing.
+	 */
+	values = g_new0 (GValue, n);
+	hash = g_hash_table_new (g_str_hash, g_str_equal);
+	for (i = 0; i < n; i++) {
+		GParamSpec *pspec = g_ptr_array_index (info->dirty, i);
+
+		g_value_init (&values[i], pspec->value_type);
+		g_object_get_property (object, pspec->name, &values[i]);
+		g_hash_table_insert (hash, (gpointer) get_dbus_name (pspec), &values[i]);
+	}
+	g_ptr_array_set_size (info->dirty, 0);
 
 #ifdef DEBUG
 	{
 		char buf[2048] = { 0, };
-		g_hash_table_foreach (info->hash, add_to_string, &buf);
+		g_hash_table_foreach (hash, add_to_string, &buf);
 		nm_log_dbg (LOGD_CORE, "%s -> %s", G_OBJECT_TYPE_NAME (object), buf);
 	}
 #endif
 
-	g_signal_emit (object, info->signal_id, 0, info->hash);
-	g_hash_table_remove_all (info->hash);
+	g_signal_emit (object, info->signal_id, 0, hash);
+	emitted++;
 
-	return FALSE;
+	g_hash_table_destroy (hash);
+	for (i = 0; i < n; i++)
+		g_value_unset (&values[i]);
+	g_free (values);
 }
 
-static void
-idle_id_reset (gpointer data)
+static PropertiesChangedInfo *
+pop_dirty_object (void)
 {
-	GObject *object = G_OBJECT (data);
-	PropertiesChangedInfo *info = (PropertiesChangedInfo *) g_object_get_data (object, NM_DBUS_PROPERTY_CHANGED);
+	PropertiesChangedInfo *info;
+	int i;
 
-	/* info is unset when the object is being destroyed */
-	if (info)
-		info->idle_id = 0;
+	for (i = NUM_PRIORITIES - 1; i >= 0; i--) {
+		info = g_queue_pop_head (&queues[i]);
+		if (info) {
+			info->link = NULL;
+			return info;
+		}
+	}
+	return NULL;
 }
 
-static char*
-uscore_to_wincaps (const char *uscore)
+static gboolean
+flush_properties_changed (gpointer user_data)
 {
-	const char *p;
-	GString *str;
-	gboolean last_was_uscore;
+	PropertiesChangedInfo *info;
+	guint64 old_emitted = emitted, old_coalesced = coalesced;
 
-	last_was_uscore = TRUE;
-  
-	str = g_string_new (NULL);
-	p = uscore;
-	while (p && *p) {
-		if (*p == '-' || *p == '_')
-			last_was_uscore = TRUE;
-		else {
-			if (last_was_uscore) {
-				g_string_append_c (str, g_ascii_toupper (*p));
-				last_was_uscore = FALSE;
-			} else
-				g_string_append_c (str, *p);
-		}
-		++p;
+	flush_id = 0;
+	last_flush = g_get_monotonic_time ();
+
+	/* Signal handlers may change more properties; those go out in this
+	 * flush too, in priority order.
+	 */
+	while ((info = pop_dirty_object ())) {
+		GObject *object = g_object_ref (info->object);
+
+		emit_properties_changed (info);
+		g_object_unref (object);
 	}
 
-	return g_string_free (str, FALSE);
+	nm_log_dbg (LOGD_CORE, "PropertiesChanged: %" G_GUINT64_FORMAT " signals, "
+	            "%" G_GUINT64_FORMAT " changes coalesced",
+	            emitted - old_emitted, coalesced - old_coalesced);
+	return FALSE;
+}
+
+static void
+schedule_flush (void)
+{
+	gint64 since;
+
+	if (flush_id)
+		return;
+
+	since = (g_get_monotonic_time () - last_flush) / 1000;
+	if (flush_interval && since >= 0 && since < flush_interval)
+		flush_id = g_timeout_add (flush_interval - since, flush_properties_changed, NULL);
+	else
+		flush_id = g_idle_add (flush_properties_changed, NULL);
 }
 
 static void
 notify (GObject *object, GParamSpec *pspec)
 {
 	PropertiesChangedInfo *info;
-	GValue *value;
+	guint i;
 
 	/* Ignore properties that shouldn't be exported */
 	if (pspec->flags & NM_PROPERTY_PARAM_NO_EXPORT)
@@ -169,29 +277,49 @@ notify (GObject *object, GParamSpec *pspec)
 
 	info = (PropertiesChangedInfo *) g_object_get_data (object, NM_DBUS_PROPERTY_CHANGED);
 	if (!info) {
-		info = properties_changed_info_new ();
-		g_object_set_data_full (object, NM_DBUS_PROPERTY_CHANGED, info, properties_changed_info_destroy);
+		info = g_slice_new0 (PropertiesChangedInfo);
+		info->object = object;
+		info->dirty = g_ptr_array_sized_new (4);
+		info->priority = get_priority (G_OBJECT_TYPE (object));
 		info->signal_id = g_signal_lookup ("properties-changed", G_OBJECT_TYPE (object));
 		g_assert (info->signal_id);
+		g_object_set_data_full (object, NM_DBUS_PROPERTY_CHANGED, info, properties_changed_info_destroy);
 	}
 
-	value = g_slice_new0 (GValue);
-	g_value_init (value, pspec->value_type);
-	g_object_get_property (object, pspec->name, value);
-	g_hash_table_insert (info->hash, uscore_to_wincaps (pspec->name), value);
-
-	if (!info->idle_id)
-		info->idle_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, properties_changed, object, idle_id_reset);
+	/* Objects rarely have more than a few dirty properties at once */
+	for (i = 0; i < info->dirty->len; i++) {
+		if (g_ptr_array_index (info->dirty, i) == pspec) {
+			coalesced++;
+			return;
+		}
+	}
+	g_ptr_array_add (info->dirty, pspec);
+
+	if (!info->link) {
+		g_queue_push_tail (&queues[info->priority], info);
+		info->link = g_queue_peek_tail_link (&queues[info->priority]);
+		schedule_flush ();
+	} else
+		coalesced++;
 }
 
 guint
 nm_properties_changed_signal_new (GObjectClass *object_class,
 						    guint class_offset)
 {
-	guint id;
+	GParamSpec **pspecs;
+	guint id, i, n = 0;
 
 	object_class->notify = notify;
 
+	/* Work out the D-Bus names of the properties up front */
+	pspecs = g_object_class_list_properties (object_class, &n);
+	for (i = 0; i < n; i++) {
+		if (!(pspecs[i]->flags & NM_PROPERTY_PARAM_NO_EXPORT))
+			get_dbus_name (pspecs[i]);
+	}
+	g_free (pspecs);
+
 	id = g_signal_new ("properties-changed",
 				    G_OBJECT_CLASS_TYPE (object_class),
 				    G_SIGNAL_RUN_FIRST,
@@ -202,3 +330,52 @@ nm_properties_changed_signal_new (GObjectClass *object_class,
 
 	return id;
 }
+
+/**
+ * nm_properties_changed_signal_set_priority:
+ * @object_class: a class using nm_properties_changed_signal_new()
+ * @priority: when its changes go out relative to other objects'
+ *
+ * Objects of @object_class and its subclasses emit PropertiesChanged before
+ * all objects of lower priority that changed in the same main loop
+ * iteration.
+ **/
+void
+nm_properties_changed_signal_set_priority (GObjectClass *object_class,
+                                           NMPropertiesChangedPriority priority)
+{
+	g_return_if_fail (priority < NUM_PRIORITIES);
+
+	g_type_set_qdata (G_OBJECT_CLASS_TYPE (object_class), priority_quark (),
+	                  GINT_TO_POINTER (priority + 1));
+}
+
+/**
+ * nm_properties_changed_signal_set_interval:
+ * @interval: milliseconds
+ *
+ * Lets at least @interval ms pass between two flushes of PropertiesChanged
+ * signals; changes made in the meantime are merged into the next flush.
+ * With 0, the default, changes go out on the next idle main loop
+ * iteration.
+ **/
+void
+nm_properties_changed_signal_set_interval (guint interval)
+{
+	flush_interval = interval;
+}
+
+/**
+ * nm_properties_changed_signal_get_counters:
+ * @out_emitted: (out): number of PropertiesChanged signals emitted
+ * @out_coalesced: (out): number of property changes that were merged into
+ *   a signal already waiting to go out
+ **/
+void
+nm_properties_changed_signal_get_counters (guint64 *out_emitted, guint64 *out_coalesced)
+{
+	if (out_emitted)
+		*out_emitted = emitted;
+	if (out_coalesced)
+		*out_coalesced = coalesced;
+}
@@ -26,7 +26,21 @@
 
 #define NM_PROPERTY_PARAM_NO_EXPORT    (1 << (0 + G_PARAM_USER_SHIFT))
 
+typedef enum {
+	NM_PROPERTIES_CHANGED_PRIORITY_LOW = 0,
+	NM_PROPERTIES_CHANGED_PRIORITY_DEFAULT,
+	NM_PROPERTIES_CHANGED_PRIORITY_HIGH
+} NMPropertiesChangedPriority;
+
 guint nm_properties_changed_signal_new (GObjectClass *object_class,
 								guint class_offset);
 
+void nm_properties_changed_signal_set_priority (GObjectClass *object_class,
+                                                NMPropertiesChangedPriority priority);
+
+void nm_properties_changed_signal_set_interval (guint interval);
+
+void nm_properties_changed_signal_get_counters (guint64 *out_emitted,
+                                                guint64 *out_coalesced);
+
 #endif /* _NM_PROPERTIES_CHANGED_SIGNAL_H_ */
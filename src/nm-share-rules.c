@@ -0,0 +1,451 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "nm-share-rules.h"
+#include "nm-logging.h"
+#include "nm-posix-signals.h"
+
+/* One command run on behalf of connection sharing.  Commands that touch
+ * iptables must not overlap: a teardown racing the setup it undoes could
+ * leave rules behind, so they are queued and run one after another.
+ */
+typedef struct {
+	char **argv;
+	char *input;       /* written to the command's stdin, or NULL */
+	gsize input_len;
+	gsize written;
+	GSList *rules;     /* for running a batch rule by rule */
+	gboolean add;
+
+	GPid pid;
+	guint child_watch;
+	guint input_watch;
+	int input_fd;
+} ShareJob;
+
+static GQueue jobs = G_QUEUE_INIT;
+static ShareJob *running = NULL;
+
+static void run_next_job (void);
+
+NMShareRule *
+nm_share_rule_new (const char *table, const char *rule)
+{
+	NMShareRule *share_rule;
+
+	g_return_val_if_fail (table != NULL, NULL);
+	g_return_val_if_fail (rule != NULL, NULL);
+
+	share_rule = g_slice_new0 (NMShareRule);
+	share_rule->table = g_strdup (table);
+	share_rule->rule = g_strdup (rule);
+	return share_rule;
+}
+
+void
+nm_share_rule_free (NMShareRule *rule)
+{
+	g_return_if_fail (rule != NULL);
+
+	g_free (rule->table);
+	g_free (rule->rule);
+	g_slice_free (NMShareRule, rule);
+}
+
+static GSList *
+copy_rules (GSList *rules)
+{
+	GSList *copy = NULL, *iter;
+
+	for (iter = rules; iter; iter = g_slist_next (iter)) {
+		NMShareRule *rule = iter->data;
+
+		copy = g_slist_prepend (copy, nm_share_rule_new (rule->table, rule->rule));
+	}
+	return g_slist_reverse (copy);
+}
+
+char *
+nm_share_rules_to_restore_input (GSList *rules, gboolean add)
+{
+	GString *input;
+	GSList *ordered, *tables = NULL, *iter, *t;
+
+	/* Tear the rules down in reverse order when sharing is stopped */
+	ordered = g_slist_copy (rules);
+	if (!add)
+		ordered = g_slist_reverse (ordered);
+
+	/* Tables in the order they are first used */
+	for (iter = ordered; iter; iter = g_slist_next (iter)) {
+		NMShareRule *rule = iter->data;
+
+		if (!g_slist_find_custom (tables, rule->table, (GCompareFunc) strcmp))
+			tables = g_slist_append (tables, rule->table);
+	}
+
+	input = g_string_sized_new (128 * g_slist_length (ordered));
+	for (t = tables; t; t = g_slist_next (t)) {
+		const char *table = t->data;
+
+		g_string_append_printf (input, "*%s\n", table);
+		for (iter = ordered; iter; iter = g_slist_next (iter)) {
+			NMShareRule *rule = iter->data;
+
+			if (!strcmp (rule->table, table)) {
+				g_string_append_printf (input, "%s %s\n",
+				                        add ? "--insert" : "--delete",
+				                        rule->rule);
+			}
+		}
+		g_string_append (input, "COMMIT\n");
+	}
+
+	g_slist_free (tables);
+	g_slist_free (ordered);
+	return g_string_free (input, FALSE);
+}
+
+/********************************************************************/
+
+static ShareJob *
+share_job_new (char **argv)
+{
+	ShareJob *job;
+
+	job = g_slice_new0 (ShareJob);
+	job->argv = argv;
+	job->input_fd = -1;
+	return job;
+}
+
+static void
+share_job_free (ShareJob *job)
+{
+	if (job->input_watch)
+		g_source_remove (job->input_watch);
+	if (job->input_fd >= 0)
+		close (job->input_fd);
+	if (job->child_watch)
+		g_source_remove (job->child_watch);
+	g_strfreev (job->argv);
+	g_free (job->input);
+	g_slist_foreach (job->rules, (GFunc) nm_share_rule_free, NULL);
+	g_slist_free (job->rules);
+	g_slice_free (ShareJob, job);
+}
+
+/* The old way: one iptables call per rule */
+static GSList *
+rule_jobs_new (GSList *rules, gboolean add)
+{
+	GSList *list = NULL, *iter;
+
+	for (iter = rules; iter; iter = g_slist_next (iter)) {
+		NMShareRule *rule = iter->data;
+		char *cmd;
+
+		cmd = g_strdup_printf ("%s --table %s %s %s",
+		                       IPTABLES_PATH,
+		                       rule->table,
+		                       add ? "--insert" : "--delete",
+		                       rule->rule);
+		list = g_slist_prepend (list, share_job_new (g_strsplit (cmd, " ", 0)));
+		g_free (cmd);
+	}
+
+	/* Deleting in reverse order, as with the batch */
+	return add ? g_slist_reverse (list) : list;
+}
+
+static void
+push_rule_jobs (GSList *rules, gboolean add)
+{
+	GSList *list, *iter;
+
+	/* Ahead of anything queued after the failed batch */
+	list = g_slist_reverse (rule_jobs_new (rules, add));
+	for (iter = list; iter; iter = g_slist_next (iter))
+		g_queue_push_head (&jobs, iter->data);
+	g_slist_free (list);
+}
+
+static void
+share_child_setup (gpointer user_data G_GNUC_UNUSED)
+{
+	/* We are in the child process at this point */
+	pid_t pid = getpid ();
+	setpgid (pid, pid);
+
+	nm_unblock_posix_signals (NULL);
+}
+
+static gboolean
+input_writable_cb (GIOChannel *channel, GIOCondition condition, gpointer user_data)
+{
+	ShareJob *job = user_data;
+	ssize_t n;
+
+	if (condition & G_IO_OUT) {
+		n = write (job->input_fd, job->input + job->written, job->input_len - job->written);
+		if (n < 0 && (errno == EAGAIN || errno == EINTR))
+			return TRUE;
+		if (n > 0) {
+			job->written += n;
+			if (job->written < job->input_len)
+				return TRUE;
+		}
+	}
+
+	if (job->written < job->input_len)
+		nm_log_warn (LOGD_SHARING, "Could not pass all rules to %s", job->argv[0]);
+
+	/* Closing stdin lets iptables-restore apply what it was given */
+	close (job->input_fd);
+	job->input_fd = -1;
+	job->input_watch = 0;
+	return FALSE;
+}
+
+static void
+job_finished (ShareJob *job, int status)
+{
+	gboolean failed = TRUE;
+
+	if (WIFEXITED (status)) {
+		if (WEXITSTATUS (status) == 0)
+			failed = FALSE;
+		else {
+			nm_log_warn (LOGD_SHARING, "** Command returned exit status %d.",
+			             WEXITSTATUS (status));
+		}
+	} else
+		nm_log_warn (LOGD_SHARING, "** Command died with signal %d.", WTERMSIG (status));
+
+	/* A rule that is already gone fails the whole teardown batch, so take
+	 * the others out one by one.  A failed setup batch left the table as it
+	 * was and is not retried.
+	 */
+	if (failed && job->rules && !job->add)
+		push_rule_jobs (job->rules, FALSE);
+}
+
+static void
+job_exited_cb (GPid pid, gint status, gpointer user_data)
+{
+	ShareJob *job = user_data;
+
+	g_assert (job == running);
+	job->child_watch = 0;
+
+	job_finished (job, status);
+
+	running = NULL;
+	share_job_free (job);
+	run_next_job ();
+}
+
+static gboolean
+job_start (ShareJob *job, gboolean sync)
+{
+	char *envp[1] = { NULL };
+	char *cmd;
+	int *stdin_fd = job->input ? &job->input_fd : NULL;
+	GError *error = NULL;
+
+	cmd = g_strjoinv (" ", job->argv);
+	nm_log_info (LOGD_SHARING, "Executing: %s", cmd);
+	g_free (cmd);
+	if (job->input)
+		nm_log_dbg (LOGD_SHARING, "Input:\n%s", job->input);
+
+	if (!g_spawn_async_with_pipes ("/", job->argv, envp,
+	                               G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL,
+	                               share_child_setup, NULL,
+	                               &job->pid, stdin_fd, NULL, NULL, &error)) {
+		nm_log_warn (LOGD_SHARING, "Error executing command: (%d) %s",
+		             error ? error->code : -1,
+		             (error && error->message) ? error->message : "(unknown)");
+
+		/* No iptables-restore; fall back to one iptables call per rule */
+		if (job->rules && g_error_matches (error, G_SPAWN_ERROR, G_SPAWN_ERROR_NOENT))
+			push_rule_jobs (job->rules, job->add);
+		g_clear_error (&error);
+		return FALSE;
+	}
+
+	/* job_wait() takes it from here */
+	if (sync)
+		return TRUE;
+
+	if (job->input) {
+		GIOChannel *channel;
+
+		fcntl (job->input_fd, F_SETFL, fcntl (job->input_fd, F_GETFL) | O_NONBLOCK);
+		channel = g_io_channel_unix_new (job->input_fd);
+		job->input_watch = g_io_add_watch (channel, G_IO_OUT | G_IO_ERR | G_IO_HUP,
+		                                   input_writable_cb, job);
+		g_io_channel_unref (channel);
+	}
+
+	job->child_watch = g_child_watch_add (job->pid, job_exited_cb, job);
+	return TRUE;
+}
+
+/* Blocks until a started job's command has its input and has exited */
+static void
+job_wait (ShareJob *job)
+{
+	int status = 0;
+	ssize_t n;
+
+	if (job->input_watch) {
+		g_source_remove (job->input_watch);
+		job->input_watch = 0;
+	}
+	if (job->child_watch) {
+		g_source_remove (job->child_watch);
+		job->child_watch = 0;
+	}
+
+	if (job->input_fd >= 0) {
+		fcntl (job->input_fd, F_SETFL, fcntl (job->input_fd, F_GETFL) & ~O_NONBLOCK);
+		while (job->written < job->input_len) {
+			n = write (job->input_fd, job->input + job->written, job->input_len - job->written);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0) {
+				nm_log_warn (LOGD_SHARING, "Could not pass all rules to %s", job->argv[0]);
+				break;
+			}
+			job->written += n;
+		}
+		close (job->input_fd);
+		job->input_fd = -1;
+	}
+
+	while (waitpid (job->pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			nm_log_warn (LOGD_SHARING, "Error waiting for %s: (%d) %s",
+			             job->argv[0], errno, strerror (errno));
+			return;
+		}
+	}
+	job_finished (job, status);
+}
+
+static void
+run_next_job (void)
+{
+	ShareJob *job;
+
+	while (!running && (job = g_queue_pop_head (&jobs))) {
+		if (job_start (job, FALSE))
+			running = job;
+		else
+			share_job_free (job);
+	}
+}
+
+static void
+queue_job (ShareJob *job)
+{
+	g_queue_push_tail (&jobs, job);
+
+	/* Without a main loop, eg while shutting down, nothing would ever
+	 * feed the command its input or start the next one.
+	 */
+	if (g_main_depth () == 0)
+		nm_share_rules_flush_sync ();
+	else
+		run_next_job ();
+}
+
+void
+nm_share_rules_apply (GSList *rules, gboolean add)
+{
+	ShareJob *job;
+	char **argv;
+
+	if (!rules)
+		return;
+
+	/* --noflush keeps the rules that are already in each table */
+	argv = g_new0 (char *, 3);
+	argv[0] = g_strdup (IPTABLES_RESTORE_PATH);
+	argv[1] = g_strdup ("--noflush");
+
+	job = share_job_new (argv);
+	job->input = nm_share_rules_to_restore_input (rules, add);
+	job->input_len = strlen (job->input);
+	job->rules = copy_rules (rules);
+	job->add = add;
+
+	queue_job (job);
+}
+
+void
+nm_share_rules_load_modules (const char **modules)
+{
+	GPtrArray *argv;
+	const char **iter;
+
+	g_return_if_fail (modules != NULL);
+
+	/* One modprobe for all of them */
+	argv = g_ptr_array_new ();
+	g_ptr_array_add (argv, g_strdup ("/sbin/modprobe"));
+	g_ptr_array_add (argv, g_strdup ("--all"));
+	for (iter = modules; *iter; iter++)
+		g_ptr_array_add (argv, g_strdup (*iter));
+	g_ptr_array_add (argv, NULL);
+
+	queue_job (share_job_new ((char **) g_ptr_array_free (argv, FALSE)));
+}
+
+void
+nm_share_rules_flush_sync (void)
+{
+	ShareJob *job;
+
+	/* Finish the command in flight first, then everything queued after
+	 * it, in order.
+	 */
+	if (running) {
+		job = running;
+		running = NULL;
+		job_wait (job);
+		share_job_free (job);
+	}
+
+	while ((job = g_queue_pop_head (&jobs))) {
+		if (job_start (job, TRUE))
+			job_wait (job);
+		share_job_free (job);
+	}
+}
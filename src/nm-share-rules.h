@@ -0,0 +1,55 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#ifndef NM_SHARE_RULES_H
+#define NM_SHARE_RULES_H
+
+#include <glib.h>
+
+typedef struct {
+	char *table;
+	char *rule;    /* chain and match, eg "INPUT --in-interface wlan0 ..." */
+} NMShareRule;
+
+NMShareRule *nm_share_rule_new  (const char *table, const char *rule);
+void         nm_share_rule_free (NMShareRule *rule);
+
+/* Returns iptables-restore input that inserts (@add) or deletes @rules,
+ * grouped by table so that each table is committed in one go.  Rules are
+ * inserted in list order and deleted in reverse order.
+ */
+char *nm_share_rules_to_restore_input (GSList *rules, gboolean add);
+
+/* Queues @rules to be inserted or deleted without blocking the main loop.
+ * Requests run one at a time, in the order they were made.
+ */
+void  nm_share_rules_apply (GSList *rules, gboolean add);
+
+/* Queues loading of the modules connection sharing needs; rules applied
+ * afterwards wait until modprobe has finished.
+ */
+void  nm_share_rules_load_modules (const char **modules);
+
+/* Runs everything still queued to completion, blocking.  Used when the main
+ * loop has stopped, so that sharing is torn down before the daemon exits.
+ */
+void  nm_share_rules_flush_sync (void);
+
+#endif /* NM_SHARE_RULES_H */
@@ -45,6 +45,8 @@
 #include <linux/if_bonding.h>
 #include <linux/if_vlan.h>
 #include <linux/if_bridge.h>
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
 
 #include "nm-system.h"
 #include "nm-device.h"
@@ -53,6 +55,8 @@
 #include "nm-logging.h"
 #include "nm-netlink-monitor.h"
 #include "nm-netlink-utils.h"
+#include "nm-netlink-index.h"
+#include "nm-netlink-transaction.h"
 #include "nm-netlink-compat.h"
 
 #include <netlink/route/addr.h>
@@ -155,15 +159,14 @@ nm_system_device_set_ip4_route (int ifindex,
 static gboolean
 sync_addresses (int ifindex,
                 int family,
-				struct rtnl_addr **addrs,
-				int num_addrs)
+                struct rtnl_addr **addrs,
+                int num_addrs,
+                NMNetlinkTransaction *trans)
 {
-	struct nl_sock *nlh;
-	struct nl_cache *addr_cache = NULL;
-	struct rtnl_addr *filter_addr = NULL, *match_addr;
-	struct nl_object *match;
+	GSList *existing = NULL, *unwanted = NULL, *iter;
+	struct rtnl_addr *match_addr;
 	struct nl_addr *nladdr;
-	int i, err;
+	int i;
 	guint32 log_domain = (family == AF_INET) ? LOGD_IP4 : LOGD_IP6;
 	char buf[INET6_ADDRSTRLEN + 1];
 	char *iface = NULL;
@@ -171,54 +174,22 @@ sync_addresses (int ifindex,
 
 	log_domain |= LOGD_DEVICE;
 
-	nlh = nm_netlink_get_default_handle ();
-	if (!nlh)
-		return FALSE;
-
-	err = rtnl_addr_alloc_cache (nlh, &addr_cache);
-	if (err < 0)
-		return FALSE;
-
-	filter_addr = rtnl_addr_alloc ();
-	if (!filter_addr)
-		goto out;
-
-	rtnl_addr_set_ifindex (filter_addr, ifindex);
-	if (family)
-		rtnl_addr_set_family (filter_addr, family);
-
 	iface = nm_netlink_index_to_iface (ifindex);
 	if (!iface)
 		goto out;
 
 	nm_log_dbg (log_domain, "(%s): syncing addresses (family %d)", iface, family);
 
-	/* Walk through the cache, comparing the addresses already on
-	 * the interface to the addresses in addrs.
+	/* Compare the addresses already on the interface to the addresses in
+	 * addrs; the ones already present are dropped from addrs, and the ones
+	 * not in addrs are returned for removal.
 	 */
-	for (match = nl_cache_get_first (addr_cache); match; match = nl_cache_get_next (match)) {
-		gboolean buf_valid = FALSE;
-		match_addr = (struct rtnl_addr *) match;
+	existing = nm_netlink_get_addresses (ifindex, family);
+	unwanted = nm_netlink_addr_diff (existing, addrs, num_addrs);
 
-		/* Skip addresses not on our interface */
-		if (!nl_object_match_filter (match, (struct nl_object *) filter_addr))
-			continue;
-
-		if (addrs) {
-			for (i = 0; i < num_addrs; i++) {
-				if (addrs[i] && nl_object_identical (match, (struct nl_object *) addrs[i]))
-					break;
-			}
-
-			if (addrs[i]) {
-				/* match == addrs[i], so remove it from addrs so we don't
-				 * try to add it to the interface again below.
-				 */
-				rtnl_addr_put (addrs[i]);
-				addrs[i] = NULL;
-				continue;
-			}
-		}
+	for (iter = unwanted; iter; iter = g_slist_next (iter)) {
+		gboolean buf_valid = FALSE;
+		match_addr = iter->data;
 
 		nladdr = rtnl_addr_get_local (match_addr);
 
@@ -248,11 +219,7 @@ sync_addresses (int ifindex,
 		}
 
 		/* Otherwise, match_addr should be removed from the interface. */
-		err = rtnl_addr_delete (nlh, match_addr, 0);
-		if (err < 0) {
-			nm_log_err (log_domain, "(%s): error %d returned from rtnl_addr_delete(): %s",
-						iface, err, nl_geterror (err));
-		}
+		nm_netlink_transaction_delete_address (trans, match_addr);
 	}
 
 	/* Now add the remaining new addresses */
@@ -280,29 +247,140 @@ sync_addresses (int ifindex,
 			            iface, buf, nl_addr_get_prefixlen (nladdr));
 		}
 
-		err = rtnl_addr_add (nlh, addrs[i], 0);
-		if (err < 0 && (err != -NLE_EXIST)) {
-			nm_log_err (log_domain,
-			            "(%s): error %d returned from rtnl_addr_add():\n%s",
-			            iface, err, nl_geterror (err));
-		}
-
+		nm_netlink_transaction_add_address (trans, addrs[i], 0);
 		rtnl_addr_put (addrs[i]);
 	}
 	g_free (addrs);
 	success = TRUE;
 
 out:
-	if (filter_addr)
-		rtnl_addr_put (filter_addr);
-	if (addr_cache)
-		nl_cache_free (addr_cache);
+	g_slist_free (unwanted);
+	g_slist_foreach (existing, (GFunc) nl_object_put, NULL);
+	g_slist_free (existing);
 	g_free (iface);
 	return success;
 }
 
+static int
+add_route_via_gateway (struct rtnl_route *route)
+{
+	struct nl_sock *nlh;
+	struct rtnl_route *gw_route;
+	struct nl_addr *gw;
+	guint32 mss = 0;
+	int family, err;
+
+	nlh = nm_netlink_get_default_handle ();
+	g_return_val_if_fail (nlh != NULL, -NLE_BAD_SOCK);
+
+	family = rtnl_route_get_family (route);
+	rtnl_route_get_metric (route, RTAX_ADVMSS, &mss);
+
+	gw_route = nm_netlink_route_new (rtnl_route_get_oif (route), family, mss, NULL);
+	g_return_val_if_fail (gw_route != NULL, -NLE_NOMEM);
+
+	gw = nl_addr_clone (rtnl_route_get_gateway (route));
+	nl_addr_set_prefixlen (gw, family == AF_INET ? 32 : 128);
+	rtnl_route_set_dst (gw_route, gw);
+	nl_addr_put (gw);
+
+	/* Add route to gateway over bridge */
+	err = rtnl_route_add (nlh, gw_route, 0);
+	if (!err) {
+		/* Try adding the route again */
+		err = rtnl_route_add (nlh, route, 0);
+		if (err)
+			nm_netlink_route_delete (gw_route);
+	}
+	rtnl_route_put (gw_route);
+
+	/* LIBNL Bug: Aliased ESRCH */
+	if (err == -NLE_FAILURE)
+		err = -NLE_OBJ_NOTFOUND;
+	return err;
+}
+
+/* Maps the kernel's rejections of an IP configuration transaction back to
+ * the address, route or link change they belong to.
+ */
+static void
+apply_config_error (NMNetlinkTransaction *trans,
+                    struct nl_object *object,
+                    int msgtype,
+                    int err,
+                    gpointer user_data)
+{
+	char *iface = nm_netlink_index_to_iface (nm_netlink_transaction_get_ifindex (trans));
+	char buf[INET6_ADDRSTRLEN + 5];
+	guint32 log_domain = LOGD_DEVICE;
+	int family;
+
+	switch (msgtype) {
+	case RTM_NEWADDR:
+	case RTM_DELADDR:
+		family = rtnl_addr_get_family ((struct rtnl_addr *) object);
+		log_domain |= (family == AF_INET) ? LOGD_IP4 : LOGD_IP6;
+
+		if (msgtype == RTM_NEWADDR && err == -NLE_EXIST)
+			break;
+		nl_addr2str (rtnl_addr_get_local ((struct rtnl_addr *) object), buf, sizeof (buf));
+		nm_log_err (log_domain, "(%s): error %d %s address '%s': %s",
+		            iface ? iface : "unknown", err,
+		            msgtype == RTM_NEWADDR ? "adding" : "removing",
+		            buf, nl_geterror (err));
+		break;
+	case RTM_NEWROUTE: {
+		struct rtnl_route *route = (struct rtnl_route *) object;
+		struct nl_addr *gw = rtnl_route_get_gateway (route);
+
+		family = rtnl_route_get_family (route);
+		log_domain |= (family == AF_INET) ? LOGD_IP4 : LOGD_IP6;
+
+		/* Gateway might be over a bridge; try adding a route to gateway first */
+		if (err == -NLE_OBJ_NOTFOUND && gw && !nl_addr_iszero (gw))
+			err = add_route_via_gateway (route);
+
+		if (err && (family == AF_INET || err != -NLE_EXIST)) {
+			nm_log_err (log_domain, "(%s): failed to set IPv%d route: %s",
+			            iface ? iface : "unknown", family == AF_INET ? 4 : 6,
+			            nl_geterror (err));
+		}
+		break;
+	}
+	case RTM_NEWLINK:
+	case RTM_SETLINK:
+		nm_log_warn (LOGD_HW, "(%s): failed to change interface MTU",
+		             iface ? iface : "unknown");
+		break;
+	default:
+		break;
+	}
+
+	g_free (iface);
+}
+
+static void
+queue_mtu_change (NMNetlinkTransaction *trans, int ifindex, guint32 mtu)
+{
+	struct rtnl_link *old, *new;
+
+	old = nm_netlink_index_to_rtnl_link (ifindex);
+	if (!old)
+		return;
+
+	if (rtnl_link_get_mtu (old) != mtu) {
+		new = rtnl_link_alloc ();
+		if (new) {
+			rtnl_link_set_mtu (new, mtu);
+			nm_netlink_transaction_change_link (trans, old, new);
+			rtnl_link_put (new);
+		}
+	}
+	rtnl_link_put (old);
+}
+
 static gboolean
-add_ip4_addresses (NMIP4Config *config, int ifindex)
+add_ip4_addresses (NMIP4Config *config, int ifindex, NMNetlinkTransaction *trans)
 {
 	char *iface;
 	int num_addrs, i;
@@ -343,7 +421,7 @@ add_ip4_addresses (NMIP4Config *config, int ifindex)
 	}
 	g_free (iface);
 
-	return sync_addresses (ifindex, AF_INET, addrs, num_addrs);
+	return sync_addresses (ifindex, AF_INET, addrs, num_addrs, trans);
 }
 
 struct rtnl_route *
@@ -394,7 +472,9 @@ nm_system_add_ip4_vpn_gateway_route (NMDevice *parent_device, guint32 vpn_gw)
 /*
  * nm_system_apply_ip4_config
  *
- * Set IPv4 configuration of the device from an NMIP4Config object.
+ * Set IPv4 configuration of the device from an NMIP4Config object.  All
+ * address, route and MTU changes go to the kernel as one netlink
+ * transaction; failures are logged as their acknowledgements arrive.
  *
  */
 gboolean
@@ -403,21 +483,29 @@ nm_system_apply_ip4_config (int ifindex,
                             int priority,
                             NMIP4ConfigCompareFlags flags)
 {
+	NMNetlinkTransaction *trans;
 	int i;
 
 	g_return_val_if_fail (ifindex > 0, FALSE);
 	g_return_val_if_fail (config != NULL, FALSE);
 
+	trans = nm_netlink_transaction_new (ifindex);
+
+	/* The kernel handles the requests in order, so the addresses and thus
+	 * their subnet routes exist by the time the routes are added.
+	 */
 	if (flags & NM_IP4_COMPARE_FLAG_ADDRESSES) {
-		if (!add_ip4_addresses (config, ifindex))
+		if (!add_ip4_addresses (config, ifindex, trans)) {
+			nm_netlink_transaction_free (trans);
 			return FALSE;
-		sleep (1);
+		}
 	}
 
 	if (flags & NM_IP4_COMPARE_FLAG_ROUTES) {
 		for (i = 0; i < nm_ip4_config_get_num_routes (config); i++) {
 			NMIP4Route *route = nm_ip4_config_get_route (config, i);
 			struct rtnl_route *tmp;
+			guint32 dest, gw;
 
 			/* Don't add the route if it's more specific than one of the subnets
 			 * the device already has an IP address on.
@@ -434,21 +522,27 @@ nm_system_apply_ip4_config (int ifindex,
 			    && nm_ip4_route_get_dest (route) == 0)
 				continue;
 
-			tmp = nm_system_device_set_ip4_route (ifindex,
-			                                      nm_ip4_route_get_dest (route),
-			                                      nm_ip4_route_get_prefix (route),
-			                                      nm_ip4_route_get_next_hop (route),
-			                                      nm_ip4_route_get_metric (route),
-			                                      nm_ip4_config_get_mss (config));
+			tmp = nm_netlink_route_new (ifindex, AF_INET, nm_ip4_config_get_mss (config),
+			                            NMNL_PROP_PRIO, nm_ip4_route_get_metric (route),
+			                            NULL);
+			if (!tmp)
+				continue;
+
+			dest = nm_ip4_route_get_dest (route);
+			gw = nm_ip4_route_get_next_hop (route);
+			if (nm_netlink_route4_build (tmp, &dest, nm_ip4_route_get_prefix (route), &gw) == 0)
+				nm_netlink_transaction_add_route (trans, tmp, 0);
 			rtnl_route_put (tmp);
 		}
 	}
 
 	if (flags & NM_IP4_COMPARE_FLAG_MTU) {
 		if (nm_ip4_config_get_mtu (config))
-			nm_system_iface_set_mtu (ifindex, nm_ip4_config_get_mtu (config));
+			queue_mtu_change (trans, ifindex, nm_ip4_config_get_mtu (config));
 	}
 
+	nm_netlink_transaction_commit (trans, apply_config_error, NULL, NULL);
+
 	if (priority > 0)
 		nm_system_device_set_priority (ifindex, config, priority);
 
@@ -601,7 +695,7 @@ nm_system_add_ip6_vpn_gateway_route (NMDevice *parent_device,
 }
 
 static gboolean
-add_ip6_addresses (NMIP6Config *config, int ifindex)
+add_ip6_addresses (NMIP6Config *config, int ifindex, NMNetlinkTransaction *trans)
 {
 	char *iface;
 	int num_addrs, i;
@@ -633,13 +727,14 @@ add_ip6_addresses (NMIP6Config *config, int ifindex)
 	}
 	g_free (iface);
 
-	return sync_addresses (ifindex, AF_INET6, addrs, num_addrs);
+	return sync_addresses (ifindex, AF_INET6, addrs, num_addrs, trans);
 }
 
 /*
  * nm_system_apply_ip6_config
  *
- * Set IPv6 configuration of the device from an NMIP6Config object.
+ * Set IPv6 configuration of the device from an NMIP6Config object.  Like
+ * for IPv4, addresses and routes are sent as one netlink transaction.
  *
  */
 gboolean
@@ -648,23 +743,25 @@ nm_system_apply_ip6_config (int ifindex,
                             int priority,
                             NMIP6ConfigCompareFlags flags)
 {
+	NMNetlinkTransaction *trans;
 	int i;
 
 	g_return_val_if_fail (ifindex > 0, FALSE);
 	g_return_val_if_fail (config != NULL, FALSE);
 
+	trans = nm_netlink_transaction_new (ifindex);
+
 	if (flags & NM_IP6_COMPARE_FLAG_ADDRESSES) {
-		if (!add_ip6_addresses (config, ifindex))
+		if (!add_ip6_addresses (config, ifindex, trans)) {
+			nm_netlink_transaction_free (trans);
 			return FALSE;
-		sleep (1); // FIXME?
+		}
 	}
 
 	if (flags & NM_IP6_COMPARE_FLAG_ROUTES) {
-		char *iface = nm_netlink_index_to_iface (ifindex);
-
 		for (i = 0; i < nm_ip6_config_get_num_routes (config); i++) {
 			NMIP6Route *route = nm_ip6_config_get_route (config, i);
-			int err;
+			struct rtnl_route *tmp;
 
 			/* Don't add the route if it doesn't have a gateway and the connection
 			 * is never supposed to be the default connection.
@@ -673,25 +770,23 @@ nm_system_apply_ip6_config (int ifindex,
 			    && IN6_IS_ADDR_UNSPECIFIED (nm_ip6_route_get_dest (route)))
 				continue;
 
-			err = nm_system_set_ip6_route (ifindex,
-			                               nm_ip6_route_get_dest (route),
-			                               nm_ip6_route_get_prefix (route),
-			                               nm_ip6_route_get_next_hop (route),
-			                               nm_ip6_route_get_metric (route),
-			                               nm_ip6_config_get_mss (config),
-			                               RTPROT_UNSPEC,
-			                               RT_TABLE_UNSPEC,
-			                               NULL);
-			if (err && (err != -NLE_EXIST)) {
-				nm_log_err (LOGD_DEVICE | LOGD_IP6,
-				            "(%s): failed to set IPv6 route: %s",
-				            iface ? iface : "unknown",
-				            nl_geterror (err));
-			}
+			tmp = nm_netlink_route_new (ifindex, AF_INET6, nm_ip6_config_get_mss (config),
+			                            NMNL_PROP_PRIO, nm_ip6_route_get_metric (route),
+			                            NULL);
+			if (!tmp)
+				continue;
+
+			if (nm_netlink_route6_build (tmp,
+			                             nm_ip6_route_get_dest (route),
+			                             nm_ip6_route_get_prefix (route),
+			                             nm_ip6_route_get_next_hop (route)) == 0)
+				nm_netlink_transaction_add_route (trans, tmp, 0);
+			rtnl_route_put (tmp);
 		}
-		g_free (iface);
 	}
 
+	nm_netlink_transaction_commit (trans, apply_config_error, NULL, NULL);
+
 // FIXME
 //	if (priority > 0)
 //		nm_system_device_set_priority (iface, config, priority);
@@ -1175,27 +1270,10 @@ add_default_ip6_route (int ifindex, const struct in6_addr *gw, int mss)
 	return err;
 }
 
-static struct rtnl_route *
-find_static_default_routes (struct rtnl_route *route,
-                            struct nl_addr *dst,
-                            const char *iface,
-                            gpointer user_data)
-{
-	GList **def_routes = user_data;
-
-	if (   nl_addr_get_prefixlen (dst) == 0
-	    && rtnl_route_get_protocol (route) == RTPROT_STATIC) {
-		rtnl_route_get (route);
-		*def_routes = g_list_prepend (*def_routes, route);
-	}
-
-	return NULL;
-}
-
 static int
 replace_default_ip6_route (int ifindex, const struct in6_addr *gw, int mss)
 {
-	GList *def_routes, *iter;
+	GSList *def_routes, *iter;
 	struct rtnl_route *route;
 	char *iface;
 	char gw_str[INET6_ADDRSTRLEN + 1];
@@ -1219,12 +1297,11 @@ replace_default_ip6_route (int ifindex, const struct in6_addr *gw, int mss)
 	 * and then add a new default route of our own with a lower metric than
 	 * the kernel ones.
 	 */
-	def_routes = NULL;
-	nm_netlink_foreach_route (ifindex, AF_INET6, RT_SCOPE_UNIVERSE, TRUE,
-	                          find_static_default_routes, &def_routes);
+	def_routes = nm_netlink_lookup_routes (AF_INET6, ifindex, RT_TABLE_MAIN, NULL);
 	for (iter = def_routes; iter; iter = iter->next) {
 		route = iter->data;
-		if (!nm_netlink_route_delete (route)) {
+		if (   rtnl_route_get_protocol (route) == RTPROT_STATIC
+		    && !nm_netlink_route_delete (route)) {
 			iface = nm_netlink_index_to_iface (ifindex);
 			nm_log_err (LOGD_DEVICE | LOGD_IP6,
 			            "(%s): failed to delete existing IPv6 default route",
@@ -1233,7 +1310,7 @@ replace_default_ip6_route (int ifindex, const struct in6_addr *gw, int mss)
 		}
 		rtnl_route_put (route);
 	}
-	g_list_free (def_routes);
+	g_slist_free (def_routes);
 
 	return add_default_ip6_route (ifindex, gw, mss);
 }
@@ -1352,8 +1429,17 @@ out:
 gboolean
 nm_system_iface_flush_addresses (int ifindex, int family)
 {
+	NMNetlinkTransaction *trans;
+
 	g_return_val_if_fail (ifindex > 0, FALSE);
-	return sync_addresses (ifindex, family, NULL, 0);
+
+	trans = nm_netlink_transaction_new (ifindex);
+	if (!sync_addresses (ifindex, family, NULL, 0, trans)) {
+		nm_netlink_transaction_free (trans);
+		return FALSE;
+	}
+	nm_netlink_transaction_commit (trans, apply_config_error, NULL, NULL);
+	return TRUE;
 }
 
 
@@ -1462,29 +1548,87 @@ nm_system_device_set_priority (int ifindex,
 	}
 }
 
+/* Netlink attributes for bond and bridge options (IFLA_BOND_* other than
+ * the mode from Linux 3.14; IFLA_BR_FORWARD_DELAY, HELLO_TIME and MAX_AGE
+ * from 4.0, the others from 4.1).  Defined here so NM builds against older
+ * kernel headers.  Older kernels silently ignore attributes they don't
+ * know, so support is checked before using them; see
+ * link_info_data_supported().
+ */
+#define NM_IFLA_BOND_MODE              1
+#define NM_IFLA_BOND_MIIMON            3
+#define NM_IFLA_BOND_UPDELAY           4
+#define NM_IFLA_BOND_DOWNDELAY         5
+#define NM_IFLA_BOND_USE_CARRIER       6
+#define NM_IFLA_BOND_ARP_INTERVAL      7
+#define NM_IFLA_BOND_ARP_IP_TARGET     8
+#define NM_IFLA_BOND_ARP_VALIDATE      9
+#define NM_IFLA_BOND_PRIMARY           11
+#define NM_IFLA_BOND_PRIMARY_RESELECT  12
+#define NM_IFLA_BOND_FAIL_OVER_MAC     13
+#define NM_IFLA_BOND_XMIT_HASH_POLICY  14
+#define NM_IFLA_BOND_RESEND_IGMP       15
+#define NM_IFLA_BOND_NUM_PEER_NOTIF    16
+#define NM_IFLA_BOND_MIN_LINKS         18
+#define NM_IFLA_BOND_AD_LACP_RATE      21
+#define NM_IFLA_BOND_AD_SELECT         22
+
+#define NM_IFLA_BR_FORWARD_DELAY       1
+#define NM_IFLA_BR_HELLO_TIME          2
+#define NM_IFLA_BR_MAX_AGE             3
+#define NM_IFLA_BR_AGEING_TIME         4
+#define NM_IFLA_BR_STP_STATE           5
+#define NM_IFLA_BR_PRIORITY            6
+
+/* Names of enumerated bond option values, indexed by their kernel value */
+static const char *bond_modes[] = { "balance-rr", "active-backup", "balance-xor", "broadcast",
+                                    "802.3ad", "balance-tlb", "balance-alb", NULL };
+static const char *bond_arp_validate[] = { "none", "active", "backup", "all", NULL };
+static const char *bond_fail_over_mac[] = { "none", "active", "follow", NULL };
+static const char *bond_lacp_rate[] = { "slow", "fast", NULL };
+static const char *bond_primary_reselect[] = { "always", "better", "failure", NULL };
+static const char *bond_xmit_hash_policy[] = { "layer2", "layer3+4", "layer2+3", NULL };
+static const char *bond_ad_select[] = { "stable", "bandwidth", "count", NULL };
+
+#define BOND_MODE(m) (1 << (m))
+#define BOND_MODES_ARP (BOND_MODE (0) | BOND_MODE (1) | BOND_MODE (2) | BOND_MODE (3))
+#define BOND_MODES_PRIMARY (BOND_MODE (1) | BOND_MODE (5) | BOND_MODE (6))
+
+typedef enum {
+	BOND_ATTR_NONE = 0,
+	BOND_ATTR_U8,
+	BOND_ATTR_U32,
+	BOND_ATTR_IFINDEX
+} BondAttrType;
+
 static const struct {
 	const char *option;
 	const char *default_value;
+	int nl_attr;           /* NM_IFLA_BOND_*, or 0 if there is none */
+	BondAttrType nl_type;
+	const char **names;    /* for enumerated values */
+	guint modes;           /* the modes the kernel accepts it in; 0 for all */
 } bonding_defaults[] = {
-	{ "mode", "balance-rr" },
-	{ "arp_interval", "0" },
-	{ "miimon", "0" },
-
-	{ "ad_select", "stable" },
-	{ "arp_validate", "none" },
-	{ "downdelay", "0" },
-	{ "fail_over_mac", "none" },
-	{ "lacp_rate", "slow" },
-	{ "min_links", "0" },
-	{ "num_grat_arp", "1" },
-	{ "num_unsol_na", "1" },
-	{ "primary", "" },
-	{ "primary_reselect", "always" },
-	{ "resend_igmp", "1" },
-	{ "updelay", "0" },
-	{ "use_carrier", "1" },
-	{ "xmit_hash_policy", "layer2" },
-	{ NULL, NULL }
+	{ "mode", "balance-rr", NM_IFLA_BOND_MODE, BOND_ATTR_U8, bond_modes, 0 },
+	{ "arp_interval", "0", NM_IFLA_BOND_ARP_INTERVAL, BOND_ATTR_U32, NULL, BOND_MODES_ARP },
+	{ "miimon", "0", NM_IFLA_BOND_MIIMON, BOND_ATTR_U32, NULL, 0 },
+
+	{ "ad_select", "stable", NM_IFLA_BOND_AD_SELECT, BOND_ATTR_U8, bond_ad_select, BOND_MODE (4) },
+	{ "arp_validate", "none", NM_IFLA_BOND_ARP_VALIDATE, BOND_ATTR_U32, bond_arp_validate, BOND_MODES_ARP },
+	{ "downdelay", "0", NM_IFLA_BOND_DOWNDELAY, BOND_ATTR_U32, NULL, 0 },
+	{ "fail_over_mac", "none", NM_IFLA_BOND_FAIL_OVER_MAC, BOND_ATTR_U8, bond_fail_over_mac, 0 },
+	{ "lacp_rate", "slow", NM_IFLA_BOND_AD_LACP_RATE, BOND_ATTR_U8, bond_lacp_rate, BOND_MODE (4) },
+	{ "min_links", "0", NM_IFLA_BOND_MIN_LINKS, BOND_ATTR_U32, NULL, 0 },
+	{ "num_grat_arp", "1", NM_IFLA_BOND_NUM_PEER_NOTIF, BOND_ATTR_U8, NULL, 0 },
+	/* Same kernel setting as num_grat_arp */
+	{ "num_unsol_na", "1", 0, BOND_ATTR_NONE, NULL, 0 },
+	{ "primary", "", NM_IFLA_BOND_PRIMARY, BOND_ATTR_IFINDEX, NULL, BOND_MODES_PRIMARY },
+	{ "primary_reselect", "always", NM_IFLA_BOND_PRIMARY_RESELECT, BOND_ATTR_U8, bond_primary_reselect, BOND_MODES_PRIMARY },
+	{ "resend_igmp", "1", NM_IFLA_BOND_RESEND_IGMP, BOND_ATTR_U32, NULL, 0 },
+	{ "updelay", "0", NM_IFLA_BOND_UPDELAY, BOND_ATTR_U32, NULL, 0 },
+	{ "use_carrier", "1", NM_IFLA_BOND_USE_CARRIER, BOND_ATTR_U8, NULL, 0 },
+	{ "xmit_hash_policy", "layer2", NM_IFLA_BOND_XMIT_HASH_POLICY, BOND_ATTR_U8, bond_xmit_hash_policy, BOND_MODE (2) | BOND_MODE (4) },
+	{ NULL, NULL, 0, BOND_ATTR_NONE, NULL, 0 }
 };
 
 static void
@@ -1508,6 +1652,7 @@ remove_bonding_entries (const char *iface, const char *path)
 		}
 	}
 	g_strfreev (entries);
+	g_free (value);
 }
 
 static gboolean
@@ -1521,34 +1666,329 @@ option_valid_for_nm_setting (const char *option, const char **valid_opts)
 	return FALSE;
 }
 
-gboolean
-nm_system_apply_bonding_config (const char *iface, NMSettingBond *s_bond)
+static const char *
+get_bonding_value (NMSettingBond *s_bond, const char **valid_opts, int i)
+{
+	const char *value = NULL;
+
+	if (option_valid_for_nm_setting (bonding_defaults[i].option, valid_opts))
+		value = nm_setting_bond_get_option_by_name (s_bond, bonding_defaults[i].option);
+	return value ? value : bonding_defaults[i].default_value;
+}
+
+/* Like sysfs, accepts either the name or the number of a value */
+static gboolean
+bond_value_to_uint (const char *value, const char **names, guint32 *out_value)
+{
+	char *end = NULL;
+	long num;
+	int i;
+
+	for (i = 0; names && names[i]; i++) {
+		if (!strcmp (value, names[i])) {
+			*out_value = i;
+			return TRUE;
+		}
+	}
+
+	errno = 0;
+	num = strtol (value, &end, 10);
+	if (!*value || !end || *end || errno || num < 0 || num > G_MAXUINT32)
+		return FALSE;
+	*out_value = num;
+	return TRUE;
+}
+
+/* Starts an RTM_NEWLINK changing the kind-specific (IFLA_INFO_DATA)
+ * attributes of an existing link; returns the message, with the nests to
+ * close in @out_linkinfo and @out_data.
+ */
+static struct nl_msg *
+link_info_data_msg_new (int ifindex,
+                        const char *kind,
+                        struct nlattr **out_linkinfo,
+                        struct nlattr **out_data)
+{
+	struct nl_msg *msg;
+	struct ifinfomsg ifi;
+
+	msg = nlmsg_alloc_simple (RTM_NEWLINK, NLM_F_REQUEST | NLM_F_ACK);
+	if (!msg)
+		return NULL;
+
+	memset (&ifi, 0, sizeof (ifi));
+	ifi.ifi_family = AF_UNSPEC;
+	ifi.ifi_index = ifindex;
+	if (nlmsg_append (msg, &ifi, sizeof (ifi), NLMSG_ALIGNTO) < 0)
+		goto error;
+
+	*out_linkinfo = nla_nest_start (msg, IFLA_LINKINFO);
+	if (!*out_linkinfo || nla_put_string (msg, IFLA_INFO_KIND, kind) < 0)
+		goto error;
+	*out_data = nla_nest_start (msg, IFLA_INFO_DATA);
+	if (!*out_data)
+		goto error;
+	return msg;
+
+error:
+	nlmsg_free (msg);
+	return NULL;
+}
+
+/* Sends the message and waits for the kernel's answer; frees @msg */
+static int
+link_info_data_msg_send (struct nl_msg *msg, struct nlattr *linkinfo, struct nlattr *data)
+{
+	struct nl_sock *nlh;
+	int err;
+
+	nla_nest_end (msg, data);
+	nla_nest_end (msg, linkinfo);
+
+	nlh = nm_netlink_get_default_handle ();
+	if (!nlh)
+		err = -NLE_BAD_SOCK;
+	else {
+		err = nl_send_auto (nlh, msg);
+		if (err >= 0)
+			err = nl_wait_for_ack (nlh);
+	}
+	nlmsg_free (msg);
+	return err;
+}
+
+typedef struct {
+	int attr;
+	gboolean found;
+} LinkInfoDataCheck;
+
+static int
+link_info_data_check_cb (struct nl_msg *msg, void *arg)
+{
+	LinkInfoDataCheck *check = arg;
+	struct nlattr *tb[IFLA_MAX + 1];
+	struct nlattr *info[IFLA_INFO_MAX + 1];
+	struct nlattr *nla;
+	int rem;
+
+	if (nlmsg_hdr (msg)->nlmsg_type != RTM_NEWLINK)
+		return NL_SKIP;
+	if (nlmsg_parse (nlmsg_hdr (msg), sizeof (struct ifinfomsg), tb, IFLA_MAX, NULL) < 0)
+		return NL_SKIP;
+	if (!tb[IFLA_LINKINFO])
+		return NL_SKIP;
+	if (nla_parse_nested (info, IFLA_INFO_MAX, tb[IFLA_LINKINFO], NULL) < 0)
+		return NL_SKIP;
+	if (!info[IFLA_INFO_DATA])
+		return NL_SKIP;
+
+	nla_for_each_nested (nla, info[IFLA_INFO_DATA], rem) {
+		if (nla_type (nla) == check->attr) {
+			check->found = TRUE;
+			break;
+		}
+	}
+	return NL_SKIP;
+}
+
+/* Kernels too old to know an IFLA_INFO_DATA attribute don't refuse it but
+ * drop it silently, so instead check that the kernel reports @attr for an
+ * existing link of the same kind.  @attr must be one it always reports.
+ * The answer is the same for every link of a kind, so it's kept in
+ * @cached (initially -1).
+ */
+static gboolean
+link_info_data_supported (int ifindex, int attr, int *cached)
+{
+	struct nl_sock *nlh;
+	struct nl_msg *msg;
+	struct nl_cb *cb;
+	struct ifinfomsg ifi;
+	LinkInfoDataCheck check = { attr, FALSE };
+	int err;
+
+	if (*cached >= 0)
+		return *cached;
+
+	nlh = nm_netlink_get_default_handle ();
+	if (!nlh)
+		return FALSE;
+
+	msg = nlmsg_alloc_simple (RTM_GETLINK, NLM_F_REQUEST);
+	if (!msg)
+		return FALSE;
+	memset (&ifi, 0, sizeof (ifi));
+	ifi.ifi_family = AF_UNSPEC;
+	ifi.ifi_index = ifindex;
+	if (nlmsg_append (msg, &ifi, sizeof (ifi), NLMSG_ALIGNTO) < 0) {
+		nlmsg_free (msg);
+		return FALSE;
+	}
+
+	err = nl_send_auto (nlh, msg);
+	nlmsg_free (msg);
+	if (err < 0)
+		return FALSE;
+
+	cb = nl_cb_clone (nl_socket_get_cb (nlh));
+	if (!cb)
+		return FALSE;
+	nl_cb_set (cb, NL_CB_VALID, NL_CB_CUSTOM, link_info_data_check_cb, &check);
+	err = nl_recvmsgs (nlh, cb);
+	nl_cb_put (cb);
+	if (err < 0)
+		return FALSE;
+
+	*cached = check.found;
+	return check.found;
+}
+
+static gboolean
+apply_bonding_config_netlink (const char *iface, NMSettingBond *s_bond, const char **valid_opts)
+{
+	struct nl_msg *msg;
+	struct nlattr *linkinfo = NULL, *data = NULL, *targets;
+	const char *value;
+	char path[FILENAME_MAX];
+	char *current = NULL;
+	static int supported = -1;
+	guint32 mode, miimon = 0, num;
+	int ifindex, i, err;
+
+	ifindex = nm_netlink_iface_to_index (iface);
+	if (ifindex <= 0)
+		return FALSE;
+
+	/* 3.13 only knows the mode and active slave.  MIN_LINKS came with the
+	 * other options in 3.14 and, unlike AD_SELECT, is reported in all modes.
+	 */
+	if (!link_info_data_supported (ifindex, NM_IFLA_BOND_MIN_LINKS, &supported))
+		return FALSE;
+
+	if (!bond_value_to_uint (get_bonding_value (s_bond, valid_opts, 0), bond_modes, &mode) || mode > 6)
+		return FALSE;
+
+	for (i = 1; bonding_defaults[i].option; i++) {
+		if (bonding_defaults[i].nl_attr == NM_IFLA_BOND_MIIMON) {
+			if (!bond_value_to_uint (get_bonding_value (s_bond, valid_opts, i), NULL, &miimon))
+				return FALSE;
+			break;
+		}
+	}
+
+	msg = link_info_data_msg_new (ifindex, "bond", &linkinfo, &data);
+	if (!msg)
+		return FALSE;
+
+	/* The mode can only be changed while the bond is down, so it is only
+	 * sent when it differs.
+	 */
+	snprintf (path, sizeof (path), "/sys/class/net/%s/bonding/mode", iface);
+	if (g_file_get_contents (path, &current, NULL, NULL)) {
+		guint32 current_mode;
+		char *space = strchr (g_strstrip (current), ' ');
+
+		if (space)
+			*space = '\0';
+		if (   !bond_value_to_uint (current, bond_modes, &current_mode)
+		    || current_mode != mode)
+			NLA_PUT_U8 (msg, NM_IFLA_BOND_MODE, mode);
+		g_free (current);
+	} else
+		NLA_PUT_U8 (msg, NM_IFLA_BOND_MODE, mode);
+
+	/* The kernel refuses the whole request if an option doesn't apply to
+	 * the mode, so those are left alone.  Likewise updelay and downdelay
+	 * without MII monitoring (miimon 0, eg for ARP monitored bonds).
+	 */
+	for (i = 1; bonding_defaults[i].option; i++) {
+		if (!bonding_defaults[i].nl_attr)
+			continue;
+		if (bonding_defaults[i].modes && !(bonding_defaults[i].modes & BOND_MODE (mode)))
+			continue;
+		if (   miimon == 0
+		    && (   bonding_defaults[i].nl_attr == NM_IFLA_BOND_UPDELAY
+		        || bonding_defaults[i].nl_attr == NM_IFLA_BOND_DOWNDELAY))
+			continue;
+
+		value = get_bonding_value (s_bond, valid_opts, i);
+		if (bonding_defaults[i].nl_type == BOND_ATTR_IFINDEX) {
+			num = 0;
+			if (*value) {
+				int primary = nm_netlink_iface_to_index (value);
+
+				/* sysfs can name an interface that doesn't exist yet */
+				if (primary <= 0)
+					goto error;
+				num = primary;
+			}
+		} else if (!bond_value_to_uint (value, bonding_defaults[i].names, &num))
+			goto error;
+
+		if (bonding_defaults[i].nl_type == BOND_ATTR_U8) {
+			if (num > G_MAXUINT8)
+				goto error;
+			NLA_PUT_U8 (msg, bonding_defaults[i].nl_attr, num);
+		} else
+			NLA_PUT_U32 (msg, bonding_defaults[i].nl_attr, num);
+	}
+
+	/* Replaces all targets; an empty list removes the old ones */
+	targets = nla_nest_start (msg, NM_IFLA_BOND_ARP_IP_TARGET);
+	if (!targets)
+		goto error;
+	value = nm_setting_bond_get_option_by_name (s_bond, "arp_ip_target");
+	if (value) {
+		char **addresses;
+		struct in_addr addr;
+		int n = 0;
+
+		addresses = g_strsplit (value, ",", -1);
+		for (i = 0; addresses[i]; i++) {
+			if (inet_pton (AF_INET, g_strstrip (addresses[i]), &addr) != 1) {
+				g_strfreev (addresses);
+				goto error;
+			}
+			if (nla_put_u32 (msg, n++, addr.s_addr) < 0) {
+				g_strfreev (addresses);
+				goto error;
+			}
+		}
+		g_strfreev (addresses);
+	}
+	nla_nest_end (msg, targets);
+
+	err = link_info_data_msg_send (msg, linkinfo, data);
+	if (err < 0) {
+		nm_log_dbg (LOGD_HW, "(%s): kernel refused bonding options over netlink: %s",
+		            iface, nl_geterror (err));
+		return FALSE;
+	}
+	return TRUE;
+
+nla_put_failure:
+error:
+	nlmsg_free (msg);
+	return FALSE;
+}
+
+static void
+apply_bonding_config_sysfs (const char *iface, NMSettingBond *s_bond, const char **valid_opts)
 {
-	const char **valid_opts;
 	const char *option, *value;
 	char path[FILENAME_MAX];
 	char *current, *space;
 	gboolean ret;
 	int i;
 
-	g_return_val_if_fail (iface != NULL, FALSE);
-
-	/* Remove old slaves and arp_ip_targets */
+	/* Remove old arp_ip_targets */
 	snprintf (path, sizeof (path), "/sys/class/net/%s/bonding/arp_ip_target", iface);
 	remove_bonding_entries (iface, path);
-	snprintf (path, sizeof (path), "/sys/class/net/%s/bonding/slaves", iface);
-	remove_bonding_entries (iface, path);
 
 	/* Apply config/defaults */
-	valid_opts = nm_setting_bond_get_valid_options (s_bond);
 	for (i = 0; bonding_defaults[i].option; i++) {
 		option = bonding_defaults[i].option;
-		if (option_valid_for_nm_setting (option, valid_opts))
-			value = nm_setting_bond_get_option_by_name (s_bond, option);
-		else
-			value = NULL;
-		if (!value)
-			value = bonding_defaults[i].default_value;
+		value = get_bonding_value (s_bond, valid_opts, i);
 
 		snprintf (path, sizeof (path), "/sys/class/net/%s/bonding/%s", iface, option);
 		if (g_file_get_contents (path, &current, NULL, NULL)) {
@@ -1563,6 +2003,7 @@ nm_system_apply_bonding_config (const char *iface, NMSettingBond *s_bond)
 					             "'%s' to '%s'", iface, option, value);
 				}
 			}
+			g_free (current);
 		}
 	}
 
@@ -1583,6 +2024,33 @@ nm_system_apply_bonding_config (const char *iface, NMSettingBond *s_bond)
 		}
 		g_strfreev (addresses);
 	}
+}
+
+/**
+ * nm_system_apply_bonding_config:
+ * @iface: the bond master
+ * @s_bond: the options to apply; unset ones get their default value
+ *
+ * Releases the bond's slaves and applies all options in one netlink
+ * request, or one sysfs file at a time on kernels that don't support it.
+ *
+ * Returns: %TRUE
+ **/
+gboolean
+nm_system_apply_bonding_config (const char *iface, NMSettingBond *s_bond)
+{
+	const char **valid_opts;
+	char path[FILENAME_MAX];
+
+	g_return_val_if_fail (iface != NULL, FALSE);
+
+	/* Remove old slaves */
+	snprintf (path, sizeof (path), "/sys/class/net/%s/bonding/slaves", iface);
+	remove_bonding_entries (iface, path);
+
+	valid_opts = nm_setting_bond_get_valid_options (s_bond);
+	if (!apply_bonding_config_netlink (iface, s_bond, valid_opts))
+		apply_bonding_config_sysfs (iface, s_bond, valid_opts);
 
 	return TRUE;
 }
@@ -1865,6 +2333,20 @@ out:
 	return res;
 }
 
+static int
+iface_type_from_kind (const char *kind)
+{
+	if (!g_strcmp0 (kind, "bond"))
+		return NM_IFACE_TYPE_BOND;
+	else if (!g_strcmp0 (kind, "vlan"))
+		return NM_IFACE_TYPE_VLAN;
+	else if (!g_strcmp0 (kind, "bridge"))
+		return NM_IFACE_TYPE_BRIDGE;
+	else if (!g_strcmp0 (kind, "dummy"))
+		return NM_IFACE_TYPE_DUMMY;
+	return NM_IFACE_TYPE_UNSPEC;
+}
+
 /**
  * nm_system_get_iface_type:
  * @ifindex: interface index
@@ -1880,7 +2362,6 @@ nm_system_get_iface_type (int ifindex, const char *name)
 {
 	struct rtnl_link *result;
 	struct nl_sock *nlh;
-	char *type;
 	int res = NM_IFACE_TYPE_UNSPEC;
 	int err;
 
@@ -1898,22 +2379,59 @@ nm_system_get_iface_type (int ifindex, const char *name)
 		goto out;
 	}
 
-	type = rtnl_link_get_type (result);
-
-	if (!g_strcmp0 (type, "bond"))
-		res = NM_IFACE_TYPE_BOND;
-	else if (!g_strcmp0 (type, "vlan"))
-		res = NM_IFACE_TYPE_VLAN;
-	else if (!g_strcmp0 (type, "bridge"))
-		res = NM_IFACE_TYPE_BRIDGE;
-	else if (!g_strcmp0 (type, "dummy"))
-		res = NM_IFACE_TYPE_DUMMY;
-
+	res = iface_type_from_kind (rtnl_link_get_type (result));
 	rtnl_link_put (result);
 out:
 	return res;
 }
 
+/**
+ * nm_system_get_links:
+ *
+ * Reads every link from the kernel in one netlink dump and classifies it by
+ * its IFLA_INFO_KIND, so that callers handling many interfaces at once don't
+ * have to ask the kernel about each one with nm_system_get_iface_type() and
+ * nm_system_get_iface_vlan_info().
+ *
+ * Returns: a hash table mapping interface indexes (as GINT_TO_POINTER) to
+ *   #NMSystemLinkInfo, or %NULL if the links could not be read.  Free with
+ *   g_hash_table_destroy().
+ **/
+GHashTable *
+nm_system_get_links (void)
+{
+	struct nl_sock *nlh;
+	struct nl_cache *cache = NULL;
+	struct nl_object *object;
+	GHashTable *links;
+
+	nlh = nm_netlink_get_default_handle ();
+	if (!nlh)
+		return NULL;
+
+	if (rtnl_link_alloc_cache (nlh, AF_UNSPEC, &cache) < 0 || !cache) {
+		nm_log_warn (LOGD_HW, "failed to read the list of links");
+		return NULL;
+	}
+
+	links = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+	for (object = nl_cache_get_first (cache); object; object = nl_cache_get_next (object)) {
+		struct rtnl_link *link = (struct rtnl_link *) object;
+		NMSystemLinkInfo *info;
+
+		info = g_new0 (NMSystemLinkInfo, 1);
+		info->ifindex = rtnl_link_get_ifindex (link);
+		info->type = iface_type_from_kind (rtnl_link_get_type (link));
+		if (info->type == NM_IFACE_TYPE_VLAN)
+			info->parent = rtnl_link_get_link (link);
+		info->master = rtnl_link_get_master (link);
+		g_hash_table_insert (links, GINT_TO_POINTER (info->ifindex), info);
+	}
+
+	nl_cache_free (cache);
+	return links;
+}
+
 /**
  * nm_system_get_iface_vlan_info:
  * @ifindex: the VLAN interface index
@@ -2428,6 +2946,72 @@ nm_system_del_bridge (const char *iface)
 	return TRUE;
 }
 
+static void
+set_bridge_sysfs (const char *iface, const char *option, guint32 value)
+{
+	char path[FILENAME_MAX], buf[16];
+
+	snprintf (path, sizeof (path), "/sys/class/net/%s/bridge/%s", iface, option);
+	snprintf (buf, sizeof (buf), "%u", value);
+	if (!nm_utils_do_sysctl (path, buf)) {
+		nm_log_warn (LOGD_BRIDGE, "(%s): failed to set bridge attribute '%s' to '%s'",
+		             iface, option, buf);
+	}
+}
+
+/**
+ * nm_system_apply_bridge_config:
+ * @ifindex: the bridge's interface index
+ * @iface: the bridge's interface name
+ * @config: the options to apply
+ *
+ * Applies all bridge options in one netlink request, or one sysfs file at a
+ * time on kernels that don't support it.
+ **/
+void
+nm_system_apply_bridge_config (int ifindex, const char *iface, const NMSystemBridgeConfig *config)
+{
+	static int supported = -1;
+	struct nl_msg *msg;
+	struct nlattr *linkinfo = NULL, *data = NULL;
+	int err;
+
+	g_return_if_fail (iface != NULL);
+	g_return_if_fail (config != NULL);
+
+	/* 4.0 knows only the timers; the rest, PRIORITY included, came in 4.1 */
+	if (!link_info_data_supported (ifindex, NM_IFLA_BR_PRIORITY, &supported))
+		goto sysfs;
+
+	msg = link_info_data_msg_new (ifindex, "bridge", &linkinfo, &data);
+	if (msg) {
+		NLA_PUT_U32 (msg, NM_IFLA_BR_FORWARD_DELAY, config->forward_delay);
+		NLA_PUT_U32 (msg, NM_IFLA_BR_HELLO_TIME, config->hello_time);
+		NLA_PUT_U32 (msg, NM_IFLA_BR_MAX_AGE, config->max_age);
+		NLA_PUT_U32 (msg, NM_IFLA_BR_AGEING_TIME, config->ageing_time);
+		NLA_PUT_U32 (msg, NM_IFLA_BR_STP_STATE, config->stp_state);
+		NLA_PUT_U16 (msg, NM_IFLA_BR_PRIORITY, config->priority);
+
+		err = link_info_data_msg_send (msg, linkinfo, data);
+		if (err >= 0)
+			return;
+		nm_log_dbg (LOGD_BRIDGE, "(%s): kernel refused bridge options over netlink: %s",
+		            iface, nl_geterror (err));
+	}
+	goto sysfs;
+
+nla_put_failure:
+	nlmsg_free (msg);
+
+sysfs:
+	set_bridge_sysfs (iface, "stp_state", config->stp_state);
+	set_bridge_sysfs (iface, "priority", config->priority);
+	set_bridge_sysfs (iface, "forward_delay", config->forward_delay);
+	set_bridge_sysfs (iface, "hello_time", config->hello_time);
+	set_bridge_sysfs (iface, "max_age", config->max_age);
+	set_bridge_sysfs (iface, "ageing_time", config->ageing_time);
+}
+
 static int
 _bridge_attach_compat (int master_ifindex,
                        const char *master_iface,
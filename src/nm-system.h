@@ -119,6 +119,15 @@ enum {
 
 int             nm_system_get_iface_type      (int ifindex, const char *name);
 
+typedef struct {
+	int ifindex;
+	int type;     /* NM_IFACE_TYPE_* */
+	int parent;   /* VLAN parent interface index, or 0 */
+	int master;   /* bond or bridge master interface index, or 0 */
+} NMSystemLinkInfo;
+
+GHashTable *    nm_system_get_links           (void);
+
 gboolean        nm_system_get_iface_vlan_info (int ifindex,
                                                int *out_parent_ifindex,
                                                int *out_vlan_id);
@@ -131,6 +140,20 @@ gboolean        nm_system_del_vlan_iface (const char *iface);
 gboolean        nm_system_create_bridge (const char *iface, gboolean *out_exists);
 gboolean        nm_system_del_bridge (const char *iface);
 
+/* Time values are in 1/100 seconds, like the kernel's sysfs files */
+typedef struct {
+	guint32 stp_state;
+	guint32 priority;
+	guint32 forward_delay;
+	guint32 hello_time;
+	guint32 max_age;
+	guint32 ageing_time;
+} NMSystemBridgeConfig;
+
+void            nm_system_apply_bridge_config (int ifindex,
+                                               const char *iface,
+                                               const NMSystemBridgeConfig *config);
+
 gboolean        nm_system_bridge_attach (int master_ifindex,
                                          const char *master_iface,
                                          int slave_ifindex,
@@ -36,6 +36,9 @@ typedef struct {
 	RfKillState rfkill_states[RFKILL_TYPE_MAX];
 	GSList *killswitches;
 
+	/* Link snapshot while nm_udev_manager_query_devices() runs */
+	GHashTable *links;
+
 	gboolean disposed;
 } NMUdevManagerPrivate;
 
@@ -341,8 +344,23 @@ rfkill_remove (NMUdevManager *self,
 	}
 }
 
+static int
+get_iface_type (NMUdevManager *self, int ifindex, const char *ifname)
+{
+	NMUdevManagerPrivate *priv = NM_UDEV_MANAGER_GET_PRIVATE (self);
+	NMSystemLinkInfo *info;
+
+	if (priv->links) {
+		info = g_hash_table_lookup (priv->links, GINT_TO_POINTER (ifindex));
+		if (info)
+			return info->type;
+	}
+	return nm_system_get_iface_type (ifindex, ifname);
+}
+
 static gboolean
-dev_get_attrs (GUdevDevice *udev_device,
+dev_get_attrs (NMUdevManager *self,
+               GUdevDevice *udev_device,
                const char **out_ifname,
                const char **out_path,
                char **out_driver,
@@ -397,7 +415,7 @@ dev_get_attrs (GUdevDevice *udev_device,
 		ifindex = g_udev_device_get_sysfs_attr_as_int (udev_device, "ifindex");
 
 	if (!driver) {
-		switch (nm_system_get_iface_type (ifindex, ifname)) {
+		switch (get_iface_type (self, ifindex, ifname)) {
 		case NM_IFACE_TYPE_BOND:
 			driver = "bonding";
 			break;
@@ -445,7 +463,7 @@ net_add (NMUdevManager *self, GUdevDevice *udev_device)
 
 	g_return_if_fail (udev_device != NULL);
 
-	if (!dev_get_attrs (udev_device, &ifname, &path, &driver, &ifindex))
+	if (!dev_get_attrs (self, udev_device, &ifname, &path, &driver, &ifindex))
 		return;
 
 	if (ifindex < 0) {
@@ -501,7 +519,7 @@ adsl_add (NMUdevManager *self, GUdevDevice *udev_device)
 
 	nm_log_dbg (LOGD_HW, "adsl_add: ATM Device detected from udev. Adding ..");
 
-	if (dev_get_attrs (udev_device, &ifname, &path, &driver, &ifindex))
+	if (dev_get_attrs (self, udev_device, &ifname, &path, &driver, &ifindex))
 		g_signal_emit (self, signals[DEVICE_ADDED], 0, udev_device, ifname, path, driver, ifindex);
 	g_free (driver);
 }
@@ -514,8 +532,16 @@ adsl_remove (NMUdevManager *self, GUdevDevice *device)
 	g_signal_emit (self, signals[DEVICE_REMOVED], 0, device);
 }
 
+/**
+ * nm_udev_manager_query_devices:
+ * @self: the #NMUdevManager
+ * @links: (allow-none): a snapshot from nm_system_get_links(), used instead
+ *   of asking the kernel about each interface
+ *
+ * Emits #NMUdevManager::device-added for every network device udev knows.
+ **/
 void
-nm_udev_manager_query_devices (NMUdevManager *self)
+nm_udev_manager_query_devices (NMUdevManager *self, GHashTable *links)
 {
 	NMUdevManagerPrivate *priv = NM_UDEV_MANAGER_GET_PRIVATE (self);
 	GUdevEnumerator *enumerator;
@@ -524,6 +550,8 @@ nm_udev_manager_query_devices (NMUdevManager *self)
 	g_return_if_fail (self != NULL);
 	g_return_if_fail (NM_IS_UDEV_MANAGER (self));
 
+	priv->links = links;
+
 	enumerator = g_udev_enumerator_new (priv->client);
 	g_udev_enumerator_add_match_subsystem (enumerator, "net");
 	g_udev_enumerator_add_match_is_initialized (enumerator);
@@ -547,6 +575,8 @@ nm_udev_manager_query_devices (NMUdevManager *self)
 	}
 	g_list_free (devices);
 	g_object_unref (enumerator);
+
+	priv->links = NULL;
 }
 
 static void
@@ -66,7 +66,7 @@ GType nm_udev_manager_get_type (void);
 
 NMUdevManager *nm_udev_manager_new (void);
 
-void nm_udev_manager_query_devices (NMUdevManager *manager);
+void nm_udev_manager_query_devices (NMUdevManager *manager, GHashTable *links);
 
 RfKillState nm_udev_manager_get_rfkill_state (NMUdevManager *manager, RfKillType rtype);
 
@@ -0,0 +1,476 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#include <string.h>
+#include <netinet/ether.h>
+
+#include "nm-wifi-ap-table.h"
+#include "NetworkManagerUtils.h"
+
+struct _NMWifiApTable {
+	GQueue aps;                /* NMAccessPoint, newest first */
+	GHashTable *entries;       /* NMAccessPoint -> ApEntry */
+	GHashTable *by_path;       /* supplicant path -> ApEntry */
+	GHashTable *by_bss;        /* "bssid/ssid/mode/freq" -> GSList of ApEntry */
+	GHashTable *by_network;    /* "ssid/mode/freq" -> GSList of ApEntry */
+	GSequence *by_last_seen;   /* ApEntry, oldest first */
+	guint64 serial;
+};
+
+typedef struct {
+	NMAccessPoint *ap;
+	GList *link;
+	GSequenceIter *seen_iter;
+	glong last_seen;
+	guint64 serial;
+
+	/* Keys the entry is currently indexed under */
+	char *path;
+	char *bss_key;
+	char *network_key;
+
+	gulong notify_id;
+} ApEntry;
+
+#define ANY_BSSID "*"
+
+/* SSIDs compare equal ignoring trailing NULs, see nm_utils_same_ssid() */
+static void
+append_ssid (GString *key, const GByteArray *ssid)
+{
+	guint len, i;
+
+	if (!ssid) {
+		g_string_append_c (key, '-');
+		return;
+	}
+
+	len = ssid->len;
+	while (len > 0 && ssid->data[len - 1] == '\0')
+		len--;
+	for (i = 0; i < len; i++)
+		g_string_append_printf (key, "%02x", ssid->data[i]);
+}
+
+static char *
+build_network_key (NMAccessPoint *ap)
+{
+	GString *key = g_string_sized_new (80);
+
+	append_ssid (key, nm_ap_get_ssid (ap));
+	g_string_append_printf (key, "/%d/%u", nm_ap_get_mode (ap), nm_ap_get_freq (ap));
+	return g_string_free (key, FALSE);
+}
+
+static char *
+build_bss_key (NMAccessPoint *ap, const struct ether_addr *bssid)
+{
+	GString *key = g_string_sized_new (100);
+	char *network_key;
+
+	if (bssid && nm_ethernet_address_is_valid (bssid)) {
+		g_string_append_printf (key, "%02x:%02x:%02x:%02x:%02x:%02x",
+		                        bssid->ether_addr_octet[0], bssid->ether_addr_octet[1],
+		                        bssid->ether_addr_octet[2], bssid->ether_addr_octet[3],
+		                        bssid->ether_addr_octet[4], bssid->ether_addr_octet[5]);
+	} else
+		g_string_append (key, ANY_BSSID);
+
+	network_key = build_network_key (ap);
+	g_string_append_c (key, '/');
+	g_string_append (key, network_key);
+	g_free (network_key);
+
+	return g_string_free (key, FALSE);
+}
+
+static void
+bucket_add (GHashTable *hash, const char *key, ApEntry *entry)
+{
+	char *orig_key = NULL;
+	GSList *bucket = NULL;
+
+	if (g_hash_table_lookup_extended (hash, key, (gpointer *) &orig_key, (gpointer *) &bucket))
+		g_hash_table_steal (hash, key);
+	else
+		orig_key = g_strdup (key);
+
+	g_hash_table_insert (hash, orig_key, g_slist_prepend (bucket, entry));
+}
+
+static void
+bucket_remove (GHashTable *hash, const char *key, ApEntry *entry)
+{
+	char *orig_key = NULL;
+	GSList *bucket = NULL;
+
+	if (!g_hash_table_lookup_extended (hash, key, (gpointer *) &orig_key, (gpointer *) &bucket))
+		return;
+
+	g_hash_table_steal (hash, key);
+	bucket = g_slist_remove (bucket, entry);
+	if (bucket)
+		g_hash_table_insert (hash, orig_key, bucket);
+	else
+		g_free (orig_key);
+}
+
+static void
+entry_unindex (NMWifiApTable *table, ApEntry *entry)
+{
+	if (entry->path) {
+		if (g_hash_table_lookup (table->by_path, entry->path) == entry)
+			g_hash_table_remove (table->by_path, entry->path);
+		g_free (entry->path);
+		entry->path = NULL;
+	}
+
+	bucket_remove (table->by_bss, entry->bss_key, entry);
+	g_free (entry->bss_key);
+	entry->bss_key = NULL;
+
+	bucket_remove (table->by_network, entry->network_key, entry);
+	g_free (entry->network_key);
+	entry->network_key = NULL;
+}
+
+static void
+entry_index (NMWifiApTable *table, ApEntry *entry)
+{
+	const char *path;
+
+	path = nm_ap_get_supplicant_path (entry->ap);
+	if (path) {
+		entry->path = g_strdup (path);
+		g_hash_table_insert (table->by_path, g_strdup (path), entry);
+	}
+
+	entry->bss_key = build_bss_key (entry->ap, nm_ap_get_address (entry->ap));
+	bucket_add (table->by_bss, entry->bss_key, entry);
+
+	entry->network_key = build_network_key (entry->ap);
+	bucket_add (table->by_network, entry->network_key, entry);
+}
+
+static gint
+last_seen_cmp (gconstpointer pa, gconstpointer pb, gpointer user_data)
+{
+	const ApEntry *a = pa, *b = pb;
+
+	if (a->last_seen != b->last_seen)
+		return a->last_seen < b->last_seen ? -1 : 1;
+	if (a->serial != b->serial)
+		return a->serial < b->serial ? -1 : 1;
+	return 0;
+}
+
+static void
+ap_key_changed (NMAccessPoint *ap, GParamSpec *pspec, gpointer user_data)
+{
+	const char *name = g_param_spec_get_name (pspec);
+
+	if (   !strcmp (name, NM_AP_SSID)
+	    || !strcmp (name, NM_AP_HW_ADDRESS)
+	    || !strcmp (name, NM_AP_MODE)
+	    || !strcmp (name, NM_AP_FREQUENCY))
+		nm_wifi_ap_table_update ((NMWifiApTable *) user_data, ap);
+}
+
+static void
+entry_free (ApEntry *entry)
+{
+	g_signal_handler_disconnect (entry->ap, entry->notify_id);
+	g_object_unref (entry->ap);
+	g_free (entry->path);
+	g_free (entry->bss_key);
+	g_free (entry->network_key);
+	g_slice_free (ApEntry, entry);
+}
+
+NMWifiApTable *
+nm_wifi_ap_table_new (void)
+{
+	NMWifiApTable *table;
+
+	table = g_slice_new0 (NMWifiApTable);
+	g_queue_init (&table->aps);
+	table->entries = g_hash_table_new (g_direct_hash, g_direct_equal);
+	table->by_path = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	table->by_bss = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_slist_free);
+	table->by_network = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_slist_free);
+	table->by_last_seen = g_sequence_new (NULL);
+	return table;
+}
+
+void
+nm_wifi_ap_table_free (NMWifiApTable *table)
+{
+	GHashTableIter iter;
+	ApEntry *entry;
+
+	g_return_if_fail (table != NULL);
+
+	g_hash_table_iter_init (&iter, table->entries);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer) &entry))
+		entry_free (entry);
+
+	g_queue_clear (&table->aps);
+	g_hash_table_destroy (table->entries);
+	g_hash_table_destroy (table->by_path);
+	g_hash_table_destroy (table->by_bss);
+	g_hash_table_destroy (table->by_network);
+	g_sequence_free (table->by_last_seen);
+	g_slice_free (NMWifiApTable, table);
+}
+
+guint
+nm_wifi_ap_table_size (NMWifiApTable *table)
+{
+	g_return_val_if_fail (table != NULL, 0);
+
+	return g_queue_get_length (&table->aps);
+}
+
+/**
+ * nm_wifi_ap_table_get_list:
+ * @table: the table
+ *
+ * Returns: the APs, newest first; owned by the table and only valid until
+ * the next addition or removal
+ **/
+GList *
+nm_wifi_ap_table_get_list (NMWifiApTable *table)
+{
+	g_return_val_if_fail (table != NULL, NULL);
+
+	return table->aps.head;
+}
+
+void
+nm_wifi_ap_table_add (NMWifiApTable *table, NMAccessPoint *ap)
+{
+	ApEntry *entry;
+
+	g_return_if_fail (table != NULL);
+	g_return_if_fail (NM_IS_AP (ap));
+	g_return_if_fail (g_hash_table_lookup (table->entries, ap) == NULL);
+
+	entry = g_slice_new0 (ApEntry);
+	entry->ap = g_object_ref (ap);
+	entry->serial = table->serial++;
+	entry->last_seen = nm_ap_get_last_seen (ap);
+
+	g_queue_push_head (&table->aps, ap);
+	entry->link = table->aps.head;
+	entry->seen_iter = g_sequence_insert_sorted (table->by_last_seen, entry, last_seen_cmp, NULL);
+	g_hash_table_insert (table->entries, ap, entry);
+	entry_index (table, entry);
+
+	entry->notify_id = g_signal_connect (ap, "notify", G_CALLBACK (ap_key_changed), table);
+}
+
+gboolean
+nm_wifi_ap_table_remove (NMWifiApTable *table, NMAccessPoint *ap)
+{
+	ApEntry *entry;
+
+	g_return_val_if_fail (table != NULL, FALSE);
+
+	entry = g_hash_table_lookup (table->entries, ap);
+	if (!entry)
+		return FALSE;
+
+	entry_unindex (table, entry);
+	g_sequence_remove (entry->seen_iter);
+	g_queue_delete_link (&table->aps, entry->link);
+	g_hash_table_remove (table->entries, ap);
+	entry_free (entry);
+	return TRUE;
+}
+
+/**
+ * nm_wifi_ap_table_update:
+ * @table: the table
+ * @ap: an AP in @table
+ *
+ * Re-indexes @ap after its supplicant path or matching properties changed.
+ **/
+void
+nm_wifi_ap_table_update (NMWifiApTable *table, NMAccessPoint *ap)
+{
+	ApEntry *entry;
+
+	g_return_if_fail (table != NULL);
+
+	entry = g_hash_table_lookup (table->entries, ap);
+	if (entry) {
+		entry_unindex (table, entry);
+		entry_index (table, entry);
+	}
+}
+
+/**
+ * nm_wifi_ap_table_touch:
+ * @table: the table
+ * @ap: an AP in @table
+ * @last_seen: time the AP was last seen, in seconds
+ *
+ * Sets the last-seen time of @ap and keeps the expiry order up to date.
+ **/
+void
+nm_wifi_ap_table_touch (NMWifiApTable *table, NMAccessPoint *ap, glong last_seen)
+{
+	ApEntry *entry;
+
+	g_return_if_fail (table != NULL);
+
+	nm_ap_set_last_seen (ap, last_seen);
+
+	entry = g_hash_table_lookup (table->entries, ap);
+	if (entry && entry->last_seen != last_seen) {
+		entry->last_seen = last_seen;
+		g_sequence_sort_changed (entry->seen_iter, last_seen_cmp, NULL);
+	}
+}
+
+void
+nm_wifi_ap_table_move_to_front (NMWifiApTable *table, NMAccessPoint *ap)
+{
+	ApEntry *entry;
+
+	g_return_if_fail (table != NULL);
+
+	entry = g_hash_table_lookup (table->entries, ap);
+	if (!entry || entry->link == table->aps.head)
+		return;
+
+	g_queue_unlink (&table->aps, entry->link);
+	g_queue_push_head_link (&table->aps, entry->link);
+}
+
+NMAccessPoint *
+nm_wifi_ap_table_lookup_supplicant_path (NMWifiApTable *table, const char *path)
+{
+	ApEntry *entry;
+
+	g_return_val_if_fail (table != NULL, NULL);
+
+	if (!path)
+		return NULL;
+
+	entry = g_hash_table_lookup (table->by_path, path);
+	return entry ? entry->ap : NULL;
+}
+
+static NMAccessPoint *
+match_in_bucket (GHashTable *hash,
+                 const char *key,
+                 NMAccessPoint *find_ap,
+                 gboolean strict_match)
+{
+	GSList *iter;
+
+	for (iter = g_hash_table_lookup (hash, key); iter; iter = g_slist_next (iter)) {
+		ApEntry *entry = iter->data;
+
+		if (nm_ap_match (entry->ap, find_ap, strict_match))
+			return entry->ap;
+	}
+	return NULL;
+}
+
+/**
+ * nm_wifi_ap_table_match:
+ * @table: the table
+ * @find_ap: the AP to look for
+ * @strict_match: as for nm_ap_match()
+ *
+ * Indexed equivalent of nm_ap_match_in_list().  Only APs with the same SSID,
+ * mode and frequency, and where it matters the same or an unknown BSSID,
+ * are compared.
+ *
+ * Returns: the matching AP, or %NULL
+ **/
+NMAccessPoint *
+nm_wifi_ap_table_match (NMWifiApTable *table,
+                        NMAccessPoint *find_ap,
+                        gboolean strict_match)
+{
+	const struct ether_addr *find_addr;
+	NMAccessPoint *found = NULL;
+	char *key;
+
+	g_return_val_if_fail (table != NULL, NULL);
+	g_return_val_if_fail (NM_IS_AP (find_ap), NULL);
+
+	find_addr = nm_ap_get_address (find_ap);
+	if (!strict_match && !nm_ethernet_address_is_valid (find_addr)) {
+		/* BSSID doesn't matter */
+		key = build_network_key (find_ap);
+		found = match_in_bucket (table->by_network, key, find_ap, strict_match);
+		g_free (key);
+		return found;
+	}
+
+	/* Same BSSID first, then APs whose BSSID isn't known yet */
+	if (nm_ethernet_address_is_valid (find_addr)) {
+		key = build_bss_key (find_ap, find_addr);
+		found = match_in_bucket (table->by_bss, key, find_ap, strict_match);
+		g_free (key);
+	}
+
+	if (!found) {
+		key = build_bss_key (find_ap, NULL);
+		found = match_in_bucket (table->by_bss, key, find_ap, strict_match);
+		g_free (key);
+	}
+
+	return found;
+}
+
+/**
+ * nm_wifi_ap_table_get_seen_before:
+ * @table: the table
+ * @before: a time in seconds
+ *
+ * Walks only the APs not seen since @before.
+ *
+ * Returns: a list of those APs, oldest first; free with g_slist_free()
+ **/
+GSList *
+nm_wifi_ap_table_get_seen_before (NMWifiApTable *table, glong before)
+{
+	GSequenceIter *iter;
+	GSList *list = NULL;
+
+	g_return_val_if_fail (table != NULL, NULL);
+
+	for (iter = g_sequence_get_begin_iter (table->by_last_seen);
+	     !g_sequence_iter_is_end (iter);
+	     iter = g_sequence_iter_next (iter)) {
+		ApEntry *entry = g_sequence_get (iter);
+
+		if (entry->last_seen >= before)
+			break;
+		list = g_slist_prepend (list, entry->ap);
+	}
+
+	return g_slist_reverse (list);
+}
@@ -0,0 +1,64 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager -- Network link manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#ifndef NM_WIFI_AP_TABLE_H
+#define NM_WIFI_AP_TABLE_H
+
+#include <glib.h>
+
+#include "nm-wifi-ap.h"
+
+/* The scan list of a Wi-Fi device.  Access points are kept newest first
+ * (like the list they replace), indexed by supplicant object path and by
+ * (BSSID, SSID, mode, frequency), and ordered by the time they were last
+ * seen so expired entries can be found without walking the whole list.
+ *
+ * The table follows SSID, BSSID, mode and frequency changes through the
+ * APs' property notifications; supplicant path and last-seen changes must
+ * go through nm_wifi_ap_table_update() and nm_wifi_ap_table_touch().
+ */
+typedef struct _NMWifiApTable NMWifiApTable;
+
+NMWifiApTable *nm_wifi_ap_table_new                 (void);
+void           nm_wifi_ap_table_free                (NMWifiApTable *table);
+guint          nm_wifi_ap_table_size                (NMWifiApTable *table);
+GList *        nm_wifi_ap_table_get_list            (NMWifiApTable *table);
+
+void           nm_wifi_ap_table_add                 (NMWifiApTable *table,
+                                                     NMAccessPoint *ap);
+gboolean       nm_wifi_ap_table_remove              (NMWifiApTable *table,
+                                                     NMAccessPoint *ap);
+void           nm_wifi_ap_table_update              (NMWifiApTable *table,
+                                                     NMAccessPoint *ap);
+void           nm_wifi_ap_table_touch               (NMWifiApTable *table,
+                                                     NMAccessPoint *ap,
+                                                     glong last_seen);
+void           nm_wifi_ap_table_move_to_front       (NMWifiApTable *table,
+                                                     NMAccessPoint *ap);
+
+NMAccessPoint *nm_wifi_ap_table_lookup_supplicant_path (NMWifiApTable *table,
+                                                        const char *path);
+NMAccessPoint *nm_wifi_ap_table_match               (NMWifiApTable *table,
+                                                     NMAccessPoint *find_ap,
+                                                     gboolean strict_match);
+GSList *       nm_wifi_ap_table_get_seen_before     (NMWifiApTable *table,
+                                                     glong before);
+
+#endif  /* NM_WIFI_AP_TABLE_H */
@@ -308,6 +308,8 @@ nm_ap_class_init (NMAccessPointClass *ap_class)
 	signals[PROPERTIES_CHANGED] = 
 		nm_properties_changed_signal_new (object_class,
 								    G_STRUCT_OFFSET (NMAccessPointClass, properties_changed));
+	/* Scan results can wait for everything else */
+	nm_properties_changed_signal_set_priority (object_class, NM_PROPERTIES_CHANGED_PRIORITY_LOW);
 
 	dbus_g_object_type_install_info (G_TYPE_FROM_CLASS (ap_class),
 							   &dbus_glib_nm_access_point_object_info);
@@ -1247,6 +1249,75 @@ capabilities_compatible (NM80211ApSecurityFlags a_flags, NM80211ApSecurityFlags
 	return TRUE;
 }
 
+/**
+ * nm_ap_match:
+ * @list_ap: a known access point
+ * @find_ap: the access point to look for
+ * @strict_match: whether BSSID and security flags must match exactly
+ *
+ * Returns: %TRUE if @find_ap describes the same BSS as @list_ap
+ **/
+gboolean
+nm_ap_match (NMAccessPoint *list_ap,
+             NMAccessPoint *find_ap,
+             gboolean strict_match)
+{
+	const GByteArray * list_ssid = nm_ap_get_ssid (list_ap);
+	const struct ether_addr * list_addr = nm_ap_get_address (list_ap);
+
+	const GByteArray * find_ssid = nm_ap_get_ssid (find_ap);
+	const struct ether_addr * find_addr = nm_ap_get_address (find_ap);
+
+	/* SSID match; if both APs are hiding their SSIDs,
+	 * let matching continue on BSSID and other properties
+	 */
+	if (   (!list_ssid && find_ssid)
+	    || (list_ssid && !find_ssid)
+	    || !nm_utils_same_ssid (list_ssid, find_ssid, TRUE))
+		return FALSE;
+
+	/* BSSID match */
+	if (   (strict_match || nm_ethernet_address_is_valid (find_addr))
+	    && nm_ethernet_address_is_valid (list_addr)
+	    && memcmp (list_addr->ether_addr_octet, 
+	               find_addr->ether_addr_octet,
+	               ETH_ALEN) != 0) {
+		return FALSE;
+	}
+
+	/* mode match */
+	if (nm_ap_get_mode (list_ap) != nm_ap_get_mode (find_ap))
+		return FALSE;
+
+	/* Frequency match */
+	if (nm_ap_get_freq (list_ap) != nm_ap_get_freq (find_ap))
+		return FALSE;
+
+	/* AP flags */
+	if (nm_ap_get_flags (list_ap) != nm_ap_get_flags (find_ap))
+		return FALSE;
+
+	if (strict_match) {
+		if (nm_ap_get_wpa_flags (list_ap) != nm_ap_get_wpa_flags (find_ap))
+			return FALSE;
+
+		if (nm_ap_get_rsn_flags (list_ap) != nm_ap_get_rsn_flags (find_ap))
+			return FALSE;
+	} else {
+		NM80211ApSecurityFlags list_wpa_flags = nm_ap_get_wpa_flags (list_ap);
+		NM80211ApSecurityFlags find_wpa_flags = nm_ap_get_wpa_flags (find_ap);
+		NM80211ApSecurityFlags list_rsn_flags = nm_ap_get_rsn_flags (list_ap);
+		NM80211ApSecurityFlags find_rsn_flags = nm_ap_get_rsn_flags (find_ap);
+
+		/* Just ensure that there is overlap in the capabilities */
+		if (   !capabilities_compatible (list_wpa_flags, find_wpa_flags)
+		    && !capabilities_compatible (list_rsn_flags, find_rsn_flags))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
 NMAccessPoint *
 nm_ap_match_in_list (NMAccessPoint *find_ap,
                      GSList *ap_list,
@@ -1257,61 +1328,8 @@ nm_ap_match_in_list (NMAccessPoint *find_ap,
 	g_return_val_if_fail (find_ap != NULL, NULL);
 
 	for (iter = ap_list; iter; iter = g_slist_next (iter)) {
-		NMAccessPoint * list_ap = NM_AP (iter->data);
-		const GByteArray * list_ssid = nm_ap_get_ssid (list_ap);
-		const struct ether_addr * list_addr = nm_ap_get_address (list_ap);
-
-		const GByteArray * find_ssid = nm_ap_get_ssid (find_ap);
-		const struct ether_addr * find_addr = nm_ap_get_address (find_ap);
-
-		/* SSID match; if both APs are hiding their SSIDs,
-		 * let matching continue on BSSID and other properties
-		 */
-		if (   (!list_ssid && find_ssid)
-		    || (list_ssid && !find_ssid)
-		    || !nm_utils_same_ssid (list_ssid, find_ssid, TRUE))
-			continue;
-
-		/* BSSID match */
-		if (   (strict_match || nm_ethernet_address_is_valid (find_addr))
-		    && nm_ethernet_address_is_valid (list_addr)
-		    && memcmp (list_addr->ether_addr_octet, 
-		               find_addr->ether_addr_octet,
-		               ETH_ALEN) != 0) {
-			continue;
-		}
-
-		/* mode match */
-		if (nm_ap_get_mode (list_ap) != nm_ap_get_mode (find_ap))
-			continue;
-
-		/* Frequency match */
-		if (nm_ap_get_freq (list_ap) != nm_ap_get_freq (find_ap))
-			continue;
-
-		/* AP flags */
-		if (nm_ap_get_flags (list_ap) != nm_ap_get_flags (find_ap))
-			continue;
-
-		if (strict_match) {
-			if (nm_ap_get_wpa_flags (list_ap) != nm_ap_get_wpa_flags (find_ap))
-				continue;
-
-			if (nm_ap_get_rsn_flags (list_ap) != nm_ap_get_rsn_flags (find_ap))
-				continue;
-		} else {
-			NM80211ApSecurityFlags list_wpa_flags = nm_ap_get_wpa_flags (list_ap);
-			NM80211ApSecurityFlags find_wpa_flags = nm_ap_get_wpa_flags (find_ap);
-			NM80211ApSecurityFlags list_rsn_flags = nm_ap_get_rsn_flags (list_ap);
-			NM80211ApSecurityFlags find_rsn_flags = nm_ap_get_rsn_flags (find_ap);
-
-			/* Just ensure that there is overlap in the capabilities */
-			if (   !capabilities_compatible (list_wpa_flags, find_wpa_flags)
-			    && !capabilities_compatible (list_rsn_flags, find_rsn_flags))
-				continue;
-		}
-
-		return list_ap;
+		if (nm_ap_match (NM_AP (iter->data), find_ap, strict_match))
+			return NM_AP (iter->data);
 	}
 
 	return NULL;
@@ -114,6 +114,10 @@ gboolean            nm_ap_complete_connection (NMAccessPoint *self,
                                                gboolean lock_bssid,
                                                GError **error);
 
+gboolean            nm_ap_match (NMAccessPoint *list_ap,
+                                 NMAccessPoint *find_ap,
+                                 gboolean strict_match);
+
 NMAccessPoint *     nm_ap_match_in_list (NMAccessPoint *find_ap,
                                          GSList *ap_list,
                                          gboolean strict_match);
@@ -239,26 +239,29 @@ agent_register_permissions_done (NMAuthChain *chain,
 	nm_auth_chain_unref (chain);
 }
 
+typedef struct {
+	NMAgentManager *self;
+	char *identifier;
+} RegisterInfo;
+
 static void
-impl_agent_manager_register (NMAgentManager *self,
-                             const char *identifier,
-                             DBusGMethodInvocation *context)
+register_caller_uid_cb (DBusGMethodInvocation *context,
+                        gulong sender_uid,
+                        const char *error_desc,
+                        gpointer user_data)
 {
+	RegisterInfo *info = user_data;
+	NMAgentManager *self = info->self;
 	NMAgentManagerPrivate *priv = NM_AGENT_MANAGER_GET_PRIVATE (self);
-	char *error_desc = NULL, *sender = NULL;
-	gulong sender_uid = G_MAXULONG;
+	char *sender = NULL;
 	GError *error = NULL, *local = NULL;
 	NMSecretAgent *agent;
 	NMAuthChain *chain;
 
-	if (!nm_auth_get_caller_uid (context, 
-		                         priv->dbus_mgr,
-	                             &sender_uid,
-	                             &error_desc)) {
+	if (error_desc) {
 		error = g_error_new_literal (NM_AGENT_MANAGER_ERROR,
 		                             NM_AGENT_MANAGER_ERROR_SENDER_UNKNOWN,
 		                             error_desc);
-		g_free (error_desc);
 		goto done;
 	}
 
@@ -281,11 +284,11 @@ impl_agent_manager_register (NMAgentManager *self,
 	}
 
 	/* Validate the identifier */
-	if (!validate_identifier (identifier, &error))
+	if (!validate_identifier (info->identifier, &error))
 		goto done;
 
 	/* Success, add the new agent */
-	agent = nm_secret_agent_new (priv->dbus_mgr, sender, identifier, sender_uid);
+	agent = nm_secret_agent_new (priv->dbus_mgr, sender, info->identifier, sender_uid);
 	if (!agent) {
 		error = g_error_new_literal (NM_AGENT_MANAGER_ERROR,
 		                             NM_AGENT_MANAGER_ERROR_INTERNAL_ERROR,
@@ -310,6 +313,24 @@ done:
 	g_clear_error (&error);
 	g_clear_error (&local);
 	g_free (sender);
+
+	g_object_unref (info->self);
+	g_free (info->identifier);
+	g_slice_free (RegisterInfo, info);
+}
+
+static void
+impl_agent_manager_register (NMAgentManager *self,
+                             const char *identifier,
+                             DBusGMethodInvocation *context)
+{
+	NMAgentManagerPrivate *priv = NM_AGENT_MANAGER_GET_PRIVATE (self);
+	RegisterInfo *info;
+
+	info = g_slice_new0 (RegisterInfo);
+	info->self = g_object_ref (self);
+	info->identifier = g_strdup (identifier);
+	nm_auth_get_caller_uid_async (context, priv->dbus_mgr, register_caller_uid_cb, info);
 }
 
 static void
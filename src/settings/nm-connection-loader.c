@@ -0,0 +1,129 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager system settings service
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#include <unistd.h>
+
+#include "nm-connection-loader.h"
+#include "nm-logging.h"
+
+/* Parsing is mostly CPU bound; past this many threads the directory and
+ * the page cache are the bottleneck.
+ */
+#define MAX_THREADS 16
+
+typedef struct {
+	GPtrArray *paths;
+	gpointer *results;
+	NMConnectionLoaderReadFunc read_func;
+	gpointer user_data;
+} LoaderJob;
+
+guint
+nm_connection_loader_get_default_threads (void)
+{
+	long n;
+
+	n = sysconf (_SC_NPROCESSORS_ONLN);
+	if (n < 1)
+		return 1;
+	return MIN (n, MAX_THREADS);
+}
+
+static void
+read_one (gpointer data, gpointer user_data)
+{
+	LoaderJob *job = user_data;
+	guint i = GPOINTER_TO_UINT (data) - 1;
+
+	/* Every file has its own result slot, so no locking is needed */
+	job->results[i] = job->read_func (g_ptr_array_index (job->paths, i), job->user_data);
+}
+
+/**
+ * nm_connection_loader_run:
+ * @paths: the files to read
+ * @max_threads: the number of worker threads to use, or 0 for one per CPU
+ * @read_func: parses one file; called on a worker thread
+ * @claim_func: takes the result of @read_func; called on this thread
+ * @user_data: passed to @read_func and @claim_func
+ *
+ * Reads all of @paths in parallel and waits for the workers to finish,
+ * then hands every result to @claim_func in the order of @paths.
+ **/
+void
+nm_connection_loader_run (GPtrArray *paths,
+                          guint max_threads,
+                          NMConnectionLoaderReadFunc read_func,
+                          NMConnectionLoaderClaimFunc claim_func,
+                          gpointer user_data)
+{
+	LoaderJob job;
+	GThreadPool *pool = NULL;
+	GError *error = NULL;
+	GTimer *timer;
+	guint i;
+
+	g_return_if_fail (paths != NULL);
+	g_return_if_fail (read_func != NULL);
+	g_return_if_fail (claim_func != NULL);
+
+	if (paths->len == 0)
+		return;
+
+	if (max_threads == 0)
+		max_threads = nm_connection_loader_get_default_threads ();
+	max_threads = MIN (max_threads, paths->len);
+
+	job.paths = paths;
+	job.results = g_new0 (gpointer, paths->len);
+	job.read_func = read_func;
+	job.user_data = user_data;
+
+	timer = g_timer_new ();
+
+	if (max_threads > 1) {
+		pool = g_thread_pool_new (read_one, &job, max_threads, TRUE, &error);
+		if (!pool) {
+			nm_log_warn (LOGD_SETTINGS, "could not start connection loader threads: %s",
+			             error ? error->message : "(unknown)");
+			g_clear_error (&error);
+			max_threads = 1;
+		}
+	}
+
+	if (pool) {
+		for (i = 0; i < paths->len; i++)
+			g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), NULL);
+		/* Waits for every queued file to be read */
+		g_thread_pool_free (pool, FALSE, TRUE);
+	} else {
+		for (i = 0; i < paths->len; i++)
+			read_one (GUINT_TO_POINTER (i + 1), &job);
+	}
+
+	nm_log_dbg (LOGD_SETTINGS, "read %u connection files with %u thread(s) in %.1f ms",
+	            paths->len, max_threads, g_timer_elapsed (timer, NULL) * 1000);
+	g_timer_destroy (timer);
+
+	for (i = 0; i < paths->len; i++)
+		claim_func (g_ptr_array_index (paths, i), job.results[i], user_data);
+
+	g_free (job.results);
+}
@@ -0,0 +1,47 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager system settings service
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#ifndef NM_CONNECTION_LOADER_H
+#define NM_CONNECTION_LOADER_H
+
+#include <glib.h>
+
+/* Reads a batch of connection files on a pool of worker threads.  The read
+ * function runs on the workers and must only parse and verify the file (no
+ * NMSettingsConnection, D-Bus or main loop work); the claim function is then
+ * called on the calling thread for every file, in the order given, with
+ * whatever the read function returned.
+ */
+typedef gpointer (*NMConnectionLoaderReadFunc)  (const char *path,
+                                                 gpointer user_data);
+
+typedef void     (*NMConnectionLoaderClaimFunc) (const char *path,
+                                                 gpointer result,
+                                                 gpointer user_data);
+
+guint nm_connection_loader_get_default_threads (void);
+
+void  nm_connection_loader_run (GPtrArray *paths,
+                                guint max_threads,
+                                NMConnectionLoaderReadFunc read_func,
+                                NMConnectionLoaderClaimFunc claim_func,
+                                gpointer user_data);
+
+#endif  /* NM_CONNECTION_LOADER_H */
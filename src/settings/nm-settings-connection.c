@@ -32,6 +32,7 @@
 #include <nm-utils.h>
 
 #include "nm-settings-connection.h"
+#include "nm-state-db.h"
 #include "nm-session-monitor.h"
 #include "nm-dbus-manager.h"
 #include "nm-settings-error.h"
@@ -70,6 +71,7 @@ G_DEFINE_TYPE (NMSettingsConnection, nm_settings_connection, NM_TYPE_CONNECTION)
 enum {
 	PROP_0 = 0,
 	PROP_VISIBLE,
+	PROP_TIMESTAMP,
 };
 
 enum {
@@ -515,40 +517,51 @@ commit_changes (NMSettingsConnection *connection,
 	g_object_unref (connection);
 }
 
-static void
-remove_entry_from_db (NMSettingsConnection *connection, const char* db_name)
+/* The timestamps and seen-bssids databases are shared by all connections
+ * and only read once; updates are written back in batches.
+ */
+#define STATE_DB_FLUSH_INTERVAL 10  /* seconds */
+
+static NMStateDb *timestamps_db = NULL;
+static NMStateDb *seen_bssids_db = NULL;
+
+static NMStateDb *
+state_db_get (NMStateDb **db, const char *filename, const char *group)
 {
-	GKeyFile *key_file;
-	const char *db_file;
+	GError *error = NULL;
 
-	if (strcmp (db_name, "timestamps") == 0)
-		db_file = SETTINGS_TIMESTAMPS_FILE;
-	else if (strcmp (db_name, "seen-bssids") == 0)
-		db_file = SETTINGS_SEEN_BSSIDS_FILE;
-	else
-		return;
+	if (*db == NULL) {
+		*db = nm_state_db_new (filename, group, STATE_DB_FLUSH_INTERVAL);
+		if (!nm_state_db_load (*db, &error)) {
+			nm_log_warn (LOGD_SETTINGS, "error parsing %s file '%s': %s",
+			             group, filename, error->message);
+			g_clear_error (&error);
+		}
+	}
+	return *db;
+}
 
-	key_file = g_key_file_new ();
-	if (g_key_file_load_from_file (key_file, db_file, G_KEY_FILE_KEEP_COMMENTS, NULL)) {
-		const char *connection_uuid;
-		char *data;
-		gsize len;
-		GError *error = NULL;
+#define TIMESTAMPS_DB() state_db_get (&timestamps_db, SETTINGS_TIMESTAMPS_FILE, "timestamps")
+#define SEEN_BSSIDS_DB() state_db_get (&seen_bssids_db, SETTINGS_SEEN_BSSIDS_FILE, "seen-bssids")
 
-		connection_uuid = nm_connection_get_uuid (NM_CONNECTION (connection));
+/**
+ * nm_settings_connection_flush_databases:
+ *
+ * Writes out pending timestamp and seen-BSSID updates immediately.
+ **/
+void
+nm_settings_connection_flush_databases (void)
+{
+	NMStateDb *dbs[] = { timestamps_db, seen_bssids_db };
+	GError *error = NULL;
+	guint i;
 
-		g_key_file_remove_key (key_file, db_name, connection_uuid, NULL);
-		data = g_key_file_to_data (key_file, &len, &error);
-		if (data) {
-			g_file_set_contents (db_file, data, len, &error);
-			g_free (data);
-		}
-		if (error) {
-			nm_log_warn (LOGD_SETTINGS, "error writing %s file '%s': %s", db_name, db_file, error->message);
-			g_error_free (error);
+	for (i = 0; i < G_N_ELEMENTS (dbs); i++) {
+		if (dbs[i] && !nm_state_db_flush (dbs[i], &error)) {
+			nm_log_warn (LOGD_SETTINGS, "error writing connection state: %s", error->message);
+			g_clear_error (&error);
 		}
 	}
-	g_key_file_free (key_file);
 }
 
 static void
@@ -569,10 +582,10 @@ do_delete (NMSettingsConnection *connection,
 	g_object_unref (for_agents);
 
 	/* Remove timestamp from timestamps database file */
-	remove_entry_from_db (connection, "timestamps");
+	nm_state_db_remove (TIMESTAMPS_DB (), nm_connection_get_uuid (NM_CONNECTION (connection)));
 
 	/* Remove connection from seen-bssids database file */
-	remove_entry_from_db (connection, "seen-bssids");
+	nm_state_db_remove (SEEN_BSSIDS_DB (), nm_connection_get_uuid (NM_CONNECTION (connection)));
 
 	callback (connection, NULL, user_data);
 	g_object_unref (connection);
@@ -935,29 +948,15 @@ pk_auth_cb (NMAuthChain *chain,
 
 static gboolean
 check_user_in_acl (NMConnection *connection,
-                   DBusGMethodInvocation *context,
-                   NMDBusManager *dbus_mgr,
+                   gulong sender_uid,
                    NMSessionMonitor *session_monitor,
-                   gulong *out_sender_uid,
                    GError **error)
 {
-	gulong sender_uid = G_MAXULONG;
 	char *error_desc = NULL;
 
 	g_return_val_if_fail (connection != NULL, FALSE);
-	g_return_val_if_fail (context != NULL, FALSE);
 	g_return_val_if_fail (session_monitor != NULL, FALSE);
 
-	/* Get the caller's UID */
-	if (!nm_auth_get_caller_uid (context, dbus_mgr, &sender_uid, &error_desc)) {
-		g_set_error_literal (error,
-		                     NM_SETTINGS_ERROR,
-		                     NM_SETTINGS_ERROR_PERMISSION_DENIED,
-		                     error_desc);
-		g_free (error_desc);
-		return FALSE;
-	}
-
 	/* Make sure the UID can view this connection */
 	if (0 != sender_uid) {
 		if (!nm_auth_uid_in_acl (connection, session_monitor, sender_uid, &error_desc)) {
@@ -970,48 +969,91 @@ check_user_in_acl (NMConnection *connection,
 		}
 	}
 
-	if (out_sender_uid)
-		*out_sender_uid = sender_uid;
 	return TRUE;
 }
 
+typedef struct {
+	NMSettingsConnection *self;
+	NMConnection *new_connection;
+	const char *check_permission;
+	AuthCallback callback;
+	gpointer callback_data;
+} AuthStartInfo;
+
 static void
-auth_start (NMSettingsConnection *self,
-            DBusGMethodInvocation *context,
-            const char *check_permission,
-            AuthCallback callback,
-            gpointer callback_data)
+auth_start_caller_uid_cb (DBusGMethodInvocation *context,
+                          gulong sender_uid,
+                          const char *error_desc,
+                          gpointer user_data)
 {
+	AuthStartInfo *info = user_data;
+	NMSettingsConnection *self = info->self;
 	NMSettingsConnectionPrivate *priv = NM_SETTINGS_CONNECTION_GET_PRIVATE (self);
 	NMAuthChain *chain;
-	gulong sender_uid = G_MAXULONG;
 	GError *error = NULL;
 
-	if (!check_user_in_acl (NM_CONNECTION (self),
-	                        context,
-	                        priv->dbus_mgr,
-	                        priv->session_monitor,
-	                        &sender_uid,
-	                        &error)) {
-		callback (self, context, G_MAXULONG, error, callback_data);
-		g_clear_error (&error);
-		return;
+	if (error_desc) {
+		error = g_error_new_literal (NM_SETTINGS_ERROR,
+		                             NM_SETTINGS_ERROR_PERMISSION_DENIED,
+		                             error_desc);
+	} else if (   check_user_in_acl (NM_CONNECTION (self), sender_uid, priv->session_monitor, &error)
+	           && info->new_connection) {
+		/* Updates must not make the connection invisible to the caller */
+		check_user_in_acl (info->new_connection, sender_uid, priv->session_monitor, &error);
 	}
 
-	if (check_permission) {
+	if (error) {
+		info->callback (self, context, G_MAXULONG, error, info->callback_data);
+		g_error_free (error);
+	} else if (info->check_permission) {
 		chain = nm_auth_chain_new (context, NULL, pk_auth_cb, self);
 		g_assert (chain);
-		nm_auth_chain_set_data (chain, "perm", (gpointer) check_permission, NULL);
-		nm_auth_chain_set_data (chain, "callback", callback, NULL);
-		nm_auth_chain_set_data (chain, "callback-data", callback_data, NULL);
+		nm_auth_chain_set_data (chain, "perm", (gpointer) info->check_permission, NULL);
+		nm_auth_chain_set_data (chain, "callback", info->callback, NULL);
+		nm_auth_chain_set_data (chain, "callback-data", info->callback_data, NULL);
 		nm_auth_chain_set_data_ulong (chain, "sender-uid", sender_uid);
 
-		nm_auth_chain_add_call (chain, check_permission, TRUE);
+		nm_auth_chain_add_call (chain, info->check_permission, TRUE);
 		priv->pending_auths = g_slist_append (priv->pending_auths, chain);
 	} else {
 		/* Don't need polkit auth, automatic success */
-		callback (self, context, sender_uid, NULL, callback_data);
+		info->callback (self, context, sender_uid, NULL, info->callback_data);
 	}
+
+	g_object_unref (info->self);
+	g_slice_free (AuthStartInfo, info);
+}
+
+/* @new_connection, if given, must be visible to the caller as well */
+static void
+auth_start_full (NMSettingsConnection *self,
+                 DBusGMethodInvocation *context,
+                 NMConnection *new_connection,
+                 const char *check_permission,
+                 AuthCallback callback,
+                 gpointer callback_data)
+{
+	NMSettingsConnectionPrivate *priv = NM_SETTINGS_CONNECTION_GET_PRIVATE (self);
+	AuthStartInfo *info;
+
+	info = g_slice_new0 (AuthStartInfo);
+	info->self = g_object_ref (self);
+	info->new_connection = new_connection;
+	info->check_permission = check_permission;
+	info->callback = callback;
+	info->callback_data = callback_data;
+
+	nm_auth_get_caller_uid_async (context, priv->dbus_mgr, auth_start_caller_uid_cb, info);
+}
+
+static void
+auth_start (NMSettingsConnection *self,
+            DBusGMethodInvocation *context,
+            const char *check_permission,
+            AuthCallback callback,
+            gpointer callback_data)
+{
+	auth_start_full (self, context, NULL, check_permission, callback, callback_data);
 }
 
 /**** DBus method handlers ************************************/
@@ -1048,6 +1090,80 @@ check_writable (NMConnection *connection, GError **error)
 	return TRUE;
 }
 
+/**
+ * nm_settings_connection_get_settings_hash:
+ * @self: the connection
+ *
+ * Returns: the connection's settings as GetSettings() returns them: with the
+ * real timestamp and seen BSSIDs, and without secrets.  Free with
+ * g_hash_table_destroy().
+ **/
+GHashTable *
+nm_settings_connection_get_settings_hash (NMSettingsConnection *self)
+{
+	GHashTable *settings;
+	NMConnection *dupl_con;
+	NMSettingConnection *s_con;
+	NMSettingWireless *s_wifi;
+	guint64 timestamp = 0;
+	GSList *bssid_list;
+
+	g_return_val_if_fail (NM_IS_SETTINGS_CONNECTION (self), NULL);
+
+	dupl_con = nm_connection_duplicate (NM_CONNECTION (self));
+	g_assert (dupl_con);
+
+	/* Timestamp is not updated in connection's 'timestamp' property,
+	 * because it would force updating the connection and in turn
+	 * writing to /etc periodically, which we want to avoid. Rather real
+	 * timestamps are kept track of in a private variable. So, substitute
+	 * timestamp property with the real one here before returning the settings.
+	 */
+	nm_settings_connection_get_timestamp (self, &timestamp);
+	if (timestamp) {
+		s_con = nm_connection_get_setting_connection (NM_CONNECTION (dupl_con));
+		g_assert (s_con);
+		g_object_set (s_con, NM_SETTING_CONNECTION_TIMESTAMP, timestamp, NULL);
+	}
+	/* Seen BSSIDs are not updated in 802-11-wireless 'seen-bssids' property
+	 * from the same reason as timestamp. Thus we put it here to GetSettings()
+	 * return settings too.
+	 */
+	bssid_list = nm_settings_connection_get_seen_bssids (self);
+	s_wifi = nm_connection_get_setting_wireless (NM_CONNECTION (dupl_con));
+	if (bssid_list && s_wifi) {
+		g_object_set (s_wifi, NM_SETTING_WIRELESS_SEEN_BSSIDS, bssid_list, NULL);
+		nm_utils_slist_free (bssid_list, g_free);
+	}
+
+	/* Secrets should *never* be returned by the GetSettings method, they
+	 * get returned by the GetSecrets method which can be better
+	 * protected against leakage of secrets to unprivileged callers.
+	 */
+	settings = nm_connection_to_hash (NM_CONNECTION (dupl_con), NM_SETTING_HASH_FLAG_NO_SECRETS);
+	g_assert (settings);
+	g_object_unref (dupl_con);
+	return settings;
+}
+
+/**
+ * nm_settings_connection_is_visible_to_uid:
+ * @self: the connection
+ * @uid: the caller's UID
+ *
+ * Returns: %TRUE if the connection's permissions let @uid read its settings
+ **/
+gboolean
+nm_settings_connection_is_visible_to_uid (NMSettingsConnection *self, gulong uid)
+{
+	NMSettingsConnectionPrivate *priv;
+
+	g_return_val_if_fail (NM_IS_SETTINGS_CONNECTION (self), FALSE);
+
+	priv = NM_SETTINGS_CONNECTION_GET_PRIVATE (self);
+	return check_user_in_acl (NM_CONNECTION (self), uid, priv->session_monitor, NULL);
+}
+
 static void
 get_settings_auth_cb (NMSettingsConnection *self, 
                       DBusGMethodInvocation *context,
@@ -1059,47 +1175,10 @@ get_settings_auth_cb (NMSettingsConnection *self,
 		dbus_g_method_return_error (context, error);
 	else {
 		GHashTable *settings;
-		NMConnection *dupl_con;
-		NMSettingConnection *s_con;
-		NMSettingWireless *s_wifi;
-		guint64 timestamp = 0;
-		GSList *bssid_list;
-
-		dupl_con = nm_connection_duplicate (NM_CONNECTION (self));
-		g_assert (dupl_con);
-
-		/* Timestamp is not updated in connection's 'timestamp' property,
-		 * because it would force updating the connection and in turn
-		 * writing to /etc periodically, which we want to avoid. Rather real
-		 * timestamps are kept track of in a private variable. So, substitute
-		 * timestamp property with the real one here before returning the settings.
-		 */
-		nm_settings_connection_get_timestamp (self, &timestamp);
-		if (timestamp) {
-			s_con = nm_connection_get_setting_connection (NM_CONNECTION (dupl_con));
-			g_assert (s_con);
-			g_object_set (s_con, NM_SETTING_CONNECTION_TIMESTAMP, timestamp, NULL);
-		}
-		/* Seen BSSIDs are not updated in 802-11-wireless 'seen-bssids' property
-		 * from the same reason as timestamp. Thus we put it here to GetSettings()
-		 * return settings too.
-		 */
-		bssid_list = nm_settings_connection_get_seen_bssids (self);
-		s_wifi = nm_connection_get_setting_wireless (NM_CONNECTION (dupl_con));
-		if (bssid_list && s_wifi) {
-			g_object_set (s_wifi, NM_SETTING_WIRELESS_SEEN_BSSIDS, bssid_list, NULL);
-			nm_utils_slist_free (bssid_list, g_free);
-		}
 
-		/* Secrets should *never* be returned by the GetSettings method, they
-		 * get returned by the GetSecrets method which can be better
-		 * protected against leakage of secrets to unprivileged callers.
-		 */
-		settings = nm_connection_to_hash (NM_CONNECTION (dupl_con), NM_SETTING_HASH_FLAG_NO_SECRETS);
-		g_assert (settings);
+		settings = nm_settings_connection_get_settings_hash (self);
 		dbus_g_method_return (context, settings);
 		g_hash_table_destroy (settings);
-		g_object_unref (dupl_con);
 	}
 }
 
@@ -1212,7 +1291,6 @@ impl_settings_connection_update (NMSettingsConnection *self,
                                  GHashTable *new_settings,
                                  DBusGMethodInvocation *context)
 {
-	NMSettingsConnectionPrivate *priv = NM_SETTINGS_CONNECTION_GET_PRIVATE (self);
 	NMConnection *tmp;
 	GError *error = NULL;
 
@@ -1239,23 +1317,12 @@ impl_settings_connection_update (NMSettingsConnection *self,
 	 * that's sending the update request.  You can't make a connection
 	 * invisible to yourself.
 	 */
-	if (!check_user_in_acl (tmp,
-	                        context,
-	                        priv->dbus_mgr,
-	                        priv->session_monitor,
-	                        NULL,
-	                        &error)) {
-		dbus_g_method_return_error (context, error);
-		g_clear_error (&error);
-		g_object_unref (tmp);
-		return;
-	}
-
-	auth_start (self,
-	            context,
-	            get_modify_permission_update (NM_CONNECTION (self), tmp),
-	            update_auth_cb,
-	            tmp);
+	auth_start_full (self,
+	                 context,
+	                 tmp,
+	                 get_modify_permission_update (NM_CONNECTION (self), tmp),
+	                 update_auth_cb,
+	                 tmp);
 }
 
 static void
@@ -1449,42 +1516,22 @@ nm_settings_connection_update_timestamp (NMSettingsConnection *connection,
                                          gboolean flush_to_disk)
 {
 	NMSettingsConnectionPrivate *priv = NM_SETTINGS_CONNECTION_GET_PRIVATE (connection);
-	const char *connection_uuid;
-	GKeyFile *timestamps_file;
-	char *data, *tmp;
-	gsize len;
-	GError *error = NULL;
+	char *tmp;
 
 	/* Update timestamp in private storage */
-	priv->timestamp = timestamp;
-	priv->timestamp_set = TRUE;
+	if (priv->timestamp != timestamp || !priv->timestamp_set) {
+		priv->timestamp = timestamp;
+		priv->timestamp_set = TRUE;
+		g_object_notify (G_OBJECT (connection), NM_SETTINGS_CONNECTION_TIMESTAMP);
+	}
 
 	if (flush_to_disk == FALSE)
 		return;
 
-	/* Save timestamp to timestamps database file */
-	timestamps_file = g_key_file_new ();
-	if (!g_key_file_load_from_file (timestamps_file, SETTINGS_TIMESTAMPS_FILE, G_KEY_FILE_KEEP_COMMENTS, &error)) {
-		if (!(error->domain == G_FILE_ERROR && error->code == G_FILE_ERROR_NOENT))
-			nm_log_warn (LOGD_SETTINGS, "error parsing timestamps file '%s': %s", SETTINGS_TIMESTAMPS_FILE, error->message);
-		g_clear_error (&error);
-	}
-
-	connection_uuid = nm_connection_get_uuid (NM_CONNECTION (connection));
+	/* Save timestamp to timestamps database; the file is rewritten later */
 	tmp = g_strdup_printf ("%" G_GUINT64_FORMAT, timestamp);
-	g_key_file_set_value (timestamps_file, "timestamps", connection_uuid, tmp);
+	nm_state_db_set (TIMESTAMPS_DB (), nm_connection_get_uuid (NM_CONNECTION (connection)), tmp);
 	g_free (tmp);
- 
-	data = g_key_file_to_data (timestamps_file, &len, &error);
-	if (data) {
-		g_file_set_contents (SETTINGS_TIMESTAMPS_FILE, data, len, &error);
-		g_free (data);
-	}
-	if (error) {
-		nm_log_warn (LOGD_SETTINGS, "error saving timestamp to file '%s': %s", SETTINGS_TIMESTAMPS_FILE, error->message);
-		g_error_free (error);
-	}
-	g_key_file_free (timestamps_file);
 }
 
 /**
@@ -1499,31 +1546,19 @@ nm_settings_connection_read_and_fill_timestamp (NMSettingsConnection *connection
 {
 	NMSettingsConnectionPrivate *priv = NM_SETTINGS_CONNECTION_GET_PRIVATE (connection);
 	const char *connection_uuid;
-	guint64 timestamp = 0;
-	GKeyFile *timestamps_file;
-	GError *err = NULL;
-	char *tmp_str;
+	const char *tmp_str;
 
 	/* Get timestamp from database file */
-	timestamps_file = g_key_file_new ();
-	g_key_file_load_from_file (timestamps_file, SETTINGS_TIMESTAMPS_FILE, G_KEY_FILE_KEEP_COMMENTS, NULL);
 	connection_uuid = nm_connection_get_uuid (NM_CONNECTION (connection));
-	tmp_str = g_key_file_get_value (timestamps_file, "timestamps", connection_uuid, &err);
-	if (tmp_str) {
-		timestamp = g_ascii_strtoull (tmp_str, NULL, 10);
-		g_free (tmp_str);
-	}
+	tmp_str = connection_uuid ? nm_state_db_get (TIMESTAMPS_DB (), connection_uuid) : NULL;
 
 	/* Update connection's timestamp */
-	if (!err) {
-		priv->timestamp = timestamp;
+	if (tmp_str) {
+		priv->timestamp = g_ascii_strtoull (tmp_str, NULL, 10);
 		priv->timestamp_set = TRUE;
-	} else {
-		nm_log_dbg (LOGD_SETTINGS, "failed to read connection timestamp for '%s': (%d) %s",
-		            connection_uuid, err->code, err->message);
-		g_clear_error (&err);
-	}
-	g_key_file_free (timestamps_file);
+		g_object_notify (G_OBJECT (connection), NM_SETTINGS_CONNECTION_TIMESTAMP);
+	} else
+		nm_log_dbg (LOGD_SETTINGS, "no connection timestamp for '%s'", connection_uuid);
 }
 
 static guint
@@ -1613,14 +1648,9 @@ nm_settings_connection_add_seen_bssid (NMSettingsConnection *connection,
                                        const struct ether_addr *seen_bssid)
 {
 	NMSettingsConnectionPrivate *priv = NM_SETTINGS_CONNECTION_GET_PRIVATE (connection);
-	const char *connection_uuid;
-	GKeyFile *seen_bssids_file;
-	char *data, *bssid_str;
-	const char **list;
-	gsize len;
-	GError *error = NULL;
+	char *bssid_str;
+	GString *value;
 	GHashTableIter iter;
-	guint n;
 
 	g_return_if_fail (seen_bssid != NULL);
 
@@ -1632,40 +1662,17 @@ nm_settings_connection_add_seen_bssid (NMSettingsConnection *connection,
 	g_return_if_fail (bssid_str != NULL);
 	g_hash_table_insert (priv->seen_bssids, mac_dup (seen_bssid), bssid_str);
 
-	/* Build up a list of all the BSSIDs in string form */
-	n = 0;
-	list = g_malloc0 (g_hash_table_size (priv->seen_bssids) * sizeof (char *));
+	/* Build up the list of all the BSSIDs in keyfile list form */
+	value = g_string_sized_new (g_hash_table_size (priv->seen_bssids) * 18);
 	g_hash_table_iter_init (&iter, priv->seen_bssids);
-	while (g_hash_table_iter_next (&iter, NULL, (gpointer) &bssid_str))
-		list[n++] = bssid_str;
-
-	/* Save BSSID to seen-bssids file */
-	seen_bssids_file = g_key_file_new ();
-	g_key_file_set_list_separator (seen_bssids_file, ',');
-	if (!g_key_file_load_from_file (seen_bssids_file, SETTINGS_SEEN_BSSIDS_FILE, G_KEY_FILE_KEEP_COMMENTS, &error)) {
-		if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
-			nm_log_warn (LOGD_SETTINGS, "error parsing seen-bssids file '%s': %s",
-			             SETTINGS_SEEN_BSSIDS_FILE, error->message);
-		}
-		g_clear_error (&error);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer) &bssid_str)) {
+		g_string_append (value, bssid_str);
+		g_string_append_c (value, ',');
 	}
 
-	connection_uuid = nm_connection_get_uuid (NM_CONNECTION (connection));
-	g_key_file_set_string_list (seen_bssids_file, "seen-bssids", connection_uuid, list, n);
-	g_free (list);
-
-	data = g_key_file_to_data (seen_bssids_file, &len, &error);
-	if (data) {
-		g_file_set_contents (SETTINGS_SEEN_BSSIDS_FILE, data, len, &error);
-		g_free (data);
-	}
-	g_key_file_free (seen_bssids_file);
-
-	if (error) {
-		nm_log_warn (LOGD_SETTINGS, "error saving seen-bssids to file '%s': %s",
-		             SETTINGS_SEEN_BSSIDS_FILE, error->message);
-		g_error_free (error);
-	}
+	/* Save BSSIDs to seen-bssids database */
+	nm_state_db_set (SEEN_BSSIDS_DB (), nm_connection_get_uuid (NM_CONNECTION (connection)), value->str);
+	g_string_free (value, TRUE);
 }
 
 static void
@@ -1693,25 +1700,25 @@ nm_settings_connection_read_and_fill_seen_bssids (NMSettingsConnection *connecti
 {
 	NMSettingsConnectionPrivate *priv = NM_SETTINGS_CONNECTION_GET_PRIVATE (connection);
 	const char *connection_uuid;
-	GKeyFile *seen_bssids_file;
-	char **tmp_strv = NULL;
+	const char *value = NULL;
+	char **tmp_strv;
 	gsize i, len = 0;
 	NMSettingWireless *s_wifi;
 
 	/* Get seen BSSIDs from database file */
-	seen_bssids_file = g_key_file_new ();
-	g_key_file_set_list_separator (seen_bssids_file, ',');
-	if (g_key_file_load_from_file (seen_bssids_file, SETTINGS_SEEN_BSSIDS_FILE, G_KEY_FILE_KEEP_COMMENTS, NULL)) {
-		connection_uuid = nm_connection_get_uuid (NM_CONNECTION (connection));
-		tmp_strv = g_key_file_get_string_list (seen_bssids_file, "seen-bssids", connection_uuid, &len, NULL);
-	}
-	g_key_file_free (seen_bssids_file);
+	connection_uuid = nm_connection_get_uuid (NM_CONNECTION (connection));
+	if (connection_uuid)
+		value = nm_state_db_get (SEEN_BSSIDS_DB (), connection_uuid);
 
 	/* Update connection's seen-bssids */
-	if (tmp_strv) {
+	if (value) {
 		g_hash_table_remove_all (priv->seen_bssids);
-		for (i = 0; i < len; i++)
-			add_seen_bssid_string (connection, tmp_strv[i]);
+		tmp_strv = g_strsplit (value, ",", -1);
+		for (i = 0; tmp_strv[i]; i++) {
+			g_strstrip (tmp_strv[i]);
+			if (*tmp_strv[i])
+				add_seen_bssid_string (connection, tmp_strv[i]);
+		}
 		g_strfreev (tmp_strv);
 	} else {
 		/* If this connection didn't have an entry in the seen-bssids database,
@@ -1806,6 +1813,9 @@ get_property (GObject *object, guint prop_id,
 	case PROP_VISIBLE:
 		g_value_set_boolean (value, NM_SETTINGS_CONNECTION_GET_PRIVATE (object)->visible);
 		break;
+	case PROP_TIMESTAMP:
+		g_value_set_uint64 (value, NM_SETTINGS_CONNECTION_GET_PRIVATE (object)->timestamp);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -1844,6 +1854,15 @@ nm_settings_connection_class_init (NMSettingsConnectionClass *class)
 		                       FALSE,
 		                       G_PARAM_READABLE));
 
+	/* Not exported; lets NMSettings keep its connection ordering current */
+	g_object_class_install_property
+		(object_class, PROP_TIMESTAMP,
+		 g_param_spec_uint64 (NM_SETTINGS_CONNECTION_TIMESTAMP,
+		                      "Timestamp",
+		                      "Last activation timestamp",
+		                      0, G_MAXUINT64, 0,
+		                      G_PARAM_READABLE));
+
 	/* Signals */
 	signals[UPDATED] = 
 		g_signal_new (NM_SETTINGS_CONNECTION_UPDATED,
@@ -41,6 +41,7 @@ G_BEGIN_DECLS
 #define NM_SETTINGS_CONNECTION_CANCEL_SECRETS "cancel-secrets"
 
 #define NM_SETTINGS_CONNECTION_VISIBLE "visible"
+#define NM_SETTINGS_CONNECTION_TIMESTAMP "timestamp"
 
 typedef struct _NMSettingsConnection NMSettingsConnection;
 
@@ -115,6 +116,11 @@ void nm_settings_connection_cancel_secrets (NMSettingsConnection *connection,
 
 gboolean nm_settings_connection_is_visible (NMSettingsConnection *self);
 
+gboolean nm_settings_connection_is_visible_to_uid (NMSettingsConnection *self,
+                                                   gulong uid);
+
+GHashTable *nm_settings_connection_get_settings_hash (NMSettingsConnection *self);
+
 void nm_settings_connection_recheck_visibility (NMSettingsConnection *self);
 
 gboolean nm_settings_connection_check_permission (NMSettingsConnection *self,
@@ -141,6 +147,8 @@ void nm_settings_connection_add_seen_bssid (NMSettingsConnection *connection,
 
 void nm_settings_connection_read_and_fill_seen_bssids (NMSettingsConnection *connection);
 
+void nm_settings_connection_flush_databases (void);
+
 G_END_DECLS
 
 #endif /* NM_SETTINGS_CONNECTION_H */
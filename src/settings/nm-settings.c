@@ -94,6 +94,11 @@ static gboolean impl_settings_list_connections (NMSettings *self,
                                                 GPtrArray **connections,
                                                 GError **error);
 
+static void impl_settings_list_connection_settings (NMSettings *self,
+                                                   const char *after,
+                                                   guint max_count,
+                                                   DBusGMethodInvocation *context);
+
 static gboolean impl_settings_get_connection_by_uuid (NMSettings *self,
                                                       const char *uuid,
                                                       char **out_object_path,
@@ -131,6 +136,8 @@ typedef struct {
 	GSList *plugins;
 	gboolean connections_loaded;
 	GHashTable *connections;
+	GHashTable *connections_by_uuid;
+	GSequence *connections_sorted;
 	GSList *unmanaged_specs;
 } NMSettingsPrivate;
 
@@ -159,15 +166,156 @@ enum {
 	LAST_PROP
 };
 
+/* Ordering and UUID index of the connections.  Each connection carries a
+ * SortEntry with the sort keys and UUID it was last indexed by; both indexes
+ * are brought up to date when the connection is updated (plugins re-reading
+ * a file go through nm_settings_connection_replace_and_commit() too), when
+ * its timestamp changes, and when it is removed.
+ */
+#define SORT_ENTRY_TAG "sort-entry-tag"
+
+typedef struct {
+	NMSettingsConnection *connection;
+	GSequenceIter *iter;
+	char *uuid;
+	gboolean autoconnect;
+	guint64 timestamp;
+} SortEntry;
+
+static void
+sort_entry_read_keys (SortEntry *entry, gboolean *out_changed, gboolean *out_uuid_changed)
+{
+	NMSettingConnection *s_con;
+	gboolean autoconnect = FALSE;
+	guint64 timestamp = 0;
+	const char *uuid;
+
+	s_con = nm_connection_get_setting_connection (NM_CONNECTION (entry->connection));
+	if (s_con)
+		autoconnect = nm_setting_connection_get_autoconnect (s_con);
+	nm_settings_connection_get_timestamp (entry->connection, &timestamp);
+	uuid = nm_connection_get_uuid (NM_CONNECTION (entry->connection));
+
+	if (out_changed)
+		*out_changed = (autoconnect != entry->autoconnect || timestamp != entry->timestamp);
+	if (out_uuid_changed)
+		*out_uuid_changed = g_strcmp0 (uuid, entry->uuid) != 0;
+
+	entry->autoconnect = autoconnect;
+	entry->timestamp = timestamp;
+	if (g_strcmp0 (uuid, entry->uuid) != 0) {
+		g_free (entry->uuid);
+		entry->uuid = g_strdup (uuid);
+	}
+}
+
+/* Autoconnect connections first, then most recently used first */
+static gint
+sort_entry_cmp (gconstpointer pa, gconstpointer pb, gpointer user_data)
+{
+	const SortEntry *a = pa, *b = pb;
+
+	if (a->autoconnect != b->autoconnect)
+		return a->autoconnect ? -1 : 1;
+	if (a->timestamp > b->timestamp)
+		return -1;
+	else if (a->timestamp == b->timestamp)
+		return 0;
+	return 1;
+}
+
+static void
+sort_entry_free (SortEntry *entry)
+{
+	g_free (entry->uuid);
+	g_slice_free (SortEntry, entry);
+}
+
+static void
+uuid_index_add (NMSettingsPrivate *priv, SortEntry *entry)
+{
+	if (entry->uuid)
+		g_hash_table_insert (priv->connections_by_uuid, g_strdup (entry->uuid), entry->connection);
+}
+
+static void
+uuid_index_remove (NMSettingsPrivate *priv, SortEntry *entry)
+{
+	/* Only drop the key if it points to this connection; plugins might
+	 * (wrongly) provide several connections with the same UUID.
+	 */
+	if (   entry->uuid
+	    && g_hash_table_lookup (priv->connections_by_uuid, entry->uuid) == entry->connection)
+		g_hash_table_remove (priv->connections_by_uuid, entry->uuid);
+}
+
+static void
+connection_index_add (NMSettings *self, NMSettingsConnection *connection)
+{
+	NMSettingsPrivate *priv = NM_SETTINGS_GET_PRIVATE (self);
+	SortEntry *entry;
+
+	entry = g_slice_new0 (SortEntry);
+	entry->connection = connection;
+	sort_entry_read_keys (entry, NULL, NULL);
+	entry->iter = g_sequence_insert_sorted (priv->connections_sorted, entry, sort_entry_cmp, NULL);
+	uuid_index_add (priv, entry);
+
+	g_object_set_data_full (G_OBJECT (connection), SORT_ENTRY_TAG,
+	                        entry, (GDestroyNotify) sort_entry_free);
+}
+
+static void
+connection_index_remove (NMSettings *self, NMSettingsConnection *connection)
+{
+	NMSettingsPrivate *priv = NM_SETTINGS_GET_PRIVATE (self);
+	SortEntry *entry;
+
+	entry = g_object_get_data (G_OBJECT (connection), SORT_ENTRY_TAG);
+	if (!entry)
+		return;
+
+	uuid_index_remove (priv, entry);
+	g_sequence_remove (entry->iter);
+	g_object_set_data (G_OBJECT (connection), SORT_ENTRY_TAG, NULL);
+}
+
+static gboolean
+connection_index_refresh_entry (NMSettingsPrivate *priv, SortEntry *entry)
+{
+	gboolean changed = FALSE, uuid_changed = FALSE;
+
+	uuid_index_remove (priv, entry);
+	sort_entry_read_keys (entry, &changed, &uuid_changed);
+	uuid_index_add (priv, entry);
+
+	if (changed)
+		g_sequence_sort_changed (entry->iter, sort_entry_cmp, NULL);
+	return changed;
+}
+
+static void
+connection_index_refresh (NMSettings *self, NMSettingsConnection *connection)
+{
+	SortEntry *entry;
+
+	entry = g_object_get_data (G_OBJECT (connection), SORT_ENTRY_TAG);
+	if (entry)
+		connection_index_refresh_entry (NM_SETTINGS_GET_PRIVATE (self), entry);
+}
+
 static void
 load_connections (NMSettings *self)
 {
 	NMSettingsPrivate *priv = NM_SETTINGS_GET_PRIVATE (self);
 	GSList *iter;
+	GTimer *timer;
 
 	if (priv->connections_loaded)
 		return;
 
+	timer = g_timer_new ();
+
 	for (iter = priv->plugins; iter; iter = g_slist_next (iter)) {
 		NMSystemConfigInterface *plugin = NM_SYSTEM_CONFIG_INTERFACE (iter->data);
 		GSList *plugin_connections;
@@ -187,6 +335,11 @@ load_connections (NMSettings *self)
 
 	priv->connections_loaded = TRUE;
 
+	nm_log_info (LOGD_SETTINGS, "loaded %u connections in %.1f ms",
+	             g_hash_table_size (priv->connections),
+	             g_timer_elapsed (timer, NULL) * 1000);
+	g_timer_destroy (timer);
+
 	/* FIXME: Bad hack */
 	unmanaged_specs_changed (NULL, self);
 
@@ -234,12 +387,143 @@ impl_settings_list_connections (NMSettings *self,
 	return TRUE;
 }
 
+typedef struct {
+	gint64 index;
+	NMSettingsConnection *connection;
+} PathIndex;
+
+/* Connections are exported as NM_DBUS_PATH_SETTINGS/<n>; anything else,
+ * like "/", sorts before all of them.
+ */
+static gint64
+connection_path_index (const char *path)
+{
+	const char *p;
+	char *end = NULL;
+	gint64 index;
+
+	p = strrchr (path, '/');
+	if (!p || !p[1])
+		return -1;
+	index = g_ascii_strtoll (p + 1, &end, 10);
+	return (end && *end == '\0') ? index : -1;
+}
+
+static int
+path_index_cmp (gconstpointer a, gconstpointer b)
+{
+	const PathIndex *pa = a, *pb = b;
+
+	return pa->index < pb->index ? -1 : (pa->index > pb->index);
+}
+
+typedef struct {
+	NMSettings *self;
+	char *after;
+	guint max_count;
+} ListSettingsInfo;
+
+static void
+list_settings_caller_uid_cb (DBusGMethodInvocation *context,
+                             gulong caller_uid,
+                             const char *caller_error_desc,
+                             gpointer user_data)
+{
+	ListSettingsInfo *info = user_data;
+	NMSettingsPrivate *priv = NM_SETTINGS_GET_PRIVATE (info->self);
+	GHashTable *settings;
+	GPtrArray *hidden;
+	GArray *page;
+	GHashTableIter iter;
+	gpointer data;
+	gint64 after;
+	const char *last = "/";
+	guint i;
+	GError *error;
+
+	if (caller_error_desc) {
+		error = g_error_new (NM_SETTINGS_ERROR,
+		                     NM_SETTINGS_ERROR_PERMISSION_DENIED,
+		                     "Unable to determine UID of request: %s.",
+		                     caller_error_desc);
+		dbus_g_method_return_error (context, error);
+		g_error_free (error);
+		goto out;
+	}
+
+	load_connections (info->self);
+
+	/* Everything after @after, in the order the connections were exported;
+	 * new connections get higher numbers, so paging by the last path seen
+	 * neither skips nor repeats connections when others come or go.
+	 */
+	after = connection_path_index (info->after);
+	page = g_array_sized_new (FALSE, FALSE, sizeof (PathIndex), g_hash_table_size (priv->connections));
+	g_hash_table_iter_init (&iter, priv->connections);
+	while (g_hash_table_iter_next (&iter, NULL, &data)) {
+		PathIndex item;
+
+		item.connection = data;
+		item.index = connection_path_index (nm_connection_get_path (NM_CONNECTION (data)));
+		if (item.index > after)
+			g_array_append_val (page, item);
+	}
+	g_array_sort (page, path_index_cmp);
+
+	if (info->max_count && page->len > info->max_count) {
+		g_array_set_size (page, info->max_count);
+		last = nm_connection_get_path (NM_CONNECTION (g_array_index (page, PathIndex, page->len - 1).connection));
+	}
+
+	settings = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+	                                  (GDestroyNotify) g_hash_table_destroy);
+	hidden = g_ptr_array_new ();
+	for (i = 0; i < page->len; i++) {
+		NMSettingsConnection *connection = g_array_index (page, PathIndex, i).connection;
+		const char *path = nm_connection_get_path (NM_CONNECTION (connection));
+
+		/* Same check as GetSettings(); clients watch hidden connections
+		 * for Updated to learn when they become visible.
+		 */
+		if (nm_settings_connection_is_visible_to_uid (connection, caller_uid))
+			g_hash_table_insert (settings, (gpointer) path,
+			                     nm_settings_connection_get_settings_hash (connection));
+		else
+			g_ptr_array_add (hidden, (gpointer) path);
+	}
+
+	dbus_g_method_return (context, settings, hidden, last);
+
+	g_hash_table_destroy (settings);
+	g_ptr_array_free (hidden, TRUE);
+	g_array_free (page, TRUE);
+
+out:
+	g_object_unref (info->self);
+	g_free (info->after);
+	g_slice_free (ListSettingsInfo, info);
+}
+
+static void
+impl_settings_list_connection_settings (NMSettings *self,
+                                        const char *after,
+                                        guint max_count,
+                                        DBusGMethodInvocation *context)
+{
+	NMSettingsPrivate *priv = NM_SETTINGS_GET_PRIVATE (self);
+	ListSettingsInfo *info;
+
+	info = g_slice_new0 (ListSettingsInfo);
+	info->self = g_object_ref (self);
+	info->after = g_strdup (after);
+	info->max_count = max_count;
+	nm_auth_get_caller_uid_async (context, priv->dbus_mgr, list_settings_caller_uid_cb, info);
+}
+
 NMSettingsConnection *
 nm_settings_get_connection_by_uuid (NMSettings *self, const char *uuid)
 {
 	NMSettingsPrivate *priv;
-	NMSettingsConnection *candidate;
-	GHashTableIter iter;
 
 	g_return_val_if_fail (self != NULL, NULL);
 	g_return_val_if_fail (NM_IS_SETTINGS (self), NULL);
@@ -249,13 +533,7 @@ nm_settings_get_connection_by_uuid (NMSettings *self, const char *uuid)
 
 	load_connections (self);
 
-	g_hash_table_iter_init (&iter, priv->connections);
-	while (g_hash_table_iter_next (&iter, NULL, (gpointer) &candidate)) {
-		if (g_strcmp0 (uuid, nm_connection_get_uuid (NM_CONNECTION (candidate))) == 0)
-			return candidate;
-	}
-
-	return NULL;
+	return g_hash_table_lookup (priv->connections_by_uuid, uuid);
 }
 
 static gboolean
@@ -279,53 +557,65 @@ impl_settings_get_connection_by_uuid (NMSettings *self,
 	return !!connection;
 }
 
-static int
-connection_sort (gconstpointer pa, gconstpointer pb)
-{
-	NMConnection *a = NM_CONNECTION (pa);
-	NMSettingConnection *con_a;
-	NMConnection *b = NM_CONNECTION (pb);
-	NMSettingConnection *con_b;
-	guint64 ts_a = 0, ts_b = 0;
-
-	con_a = nm_connection_get_setting_connection (a);
-	g_assert (con_a);
-	con_b = nm_connection_get_setting_connection (b);
-	g_assert (con_b);
-
-	if (nm_setting_connection_get_autoconnect (con_a) != nm_setting_connection_get_autoconnect (con_b)) {
-		if (nm_setting_connection_get_autoconnect (con_a))
-			return -1;
-		return 1;
-	}
-
-	nm_settings_connection_get_timestamp (NM_SETTINGS_CONNECTION (pa), &ts_a);
-	nm_settings_connection_get_timestamp (NM_SETTINGS_CONNECTION (pb), &ts_b);
-	if (ts_a > ts_b)
-		return -1;
-	else if (ts_a == ts_b)
-		return 0;
-	return 1;
-}
-
-/* Returns a list of NMSettingsConnections.  Caller must free the list with
+/* Returns a list of NMSettingsConnections, autoconnect connections first and
+ * then most recently used first.  Caller must free the list with
  * g_slist_free().
  */
 GSList *
 nm_settings_get_connections (NMSettings *self)
 {
-	GHashTableIter iter;
-	gpointer data = NULL;
+	NMSettingsPrivate *priv;
+	GSequenceIter *iter;
 	GSList *list = NULL;
 
 	g_return_val_if_fail (NM_IS_SETTINGS (self), NULL);
 
-	g_hash_table_iter_init (&iter, NM_SETTINGS_GET_PRIVATE (self)->connections);
-	while (g_hash_table_iter_next (&iter, NULL, &data))
-		list = g_slist_insert_sorted (list, data, connection_sort);
+	priv = NM_SETTINGS_GET_PRIVATE (self);
+
+	/* Walk backwards so prepending yields the right order */
+	iter = g_sequence_get_end_iter (priv->connections_sorted);
+	while (!g_sequence_iter_is_begin (iter)) {
+		SortEntry *entry;
+
+		iter = g_sequence_iter_prev (iter);
+		entry = g_sequence_get (iter);
+		list = g_slist_prepend (list, entry->connection);
+	}
 	return list;
 }
 
+/**
+ * nm_settings_for_each_connection_sorted:
+ * @self: the #NMSettings
+ * @for_each_func: called for every connection
+ * @user_data: user data for @for_each_func
+ *
+ * Like nm_settings_get_connections(), but walks the maintained ordering
+ * directly instead of building a list.  @for_each_func must not add or
+ * remove connections.
+ **/
+void
+nm_settings_for_each_connection_sorted (NMSettings *self,
+                                        NMSettingsForEachFunc for_each_func,
+                                        gpointer user_data)
+{
+	NMSettingsPrivate *priv;
+	GSequenceIter *iter;
+
+	g_return_if_fail (NM_IS_SETTINGS (self));
+	g_return_if_fail (for_each_func != NULL);
+
+	priv = NM_SETTINGS_GET_PRIVATE (self);
+
+	for (iter = g_sequence_get_begin_iter (priv->connections_sorted);
+	     !g_sequence_iter_is_end (iter);
+	     iter = g_sequence_iter_next (iter)) {
+		SortEntry *entry = g_sequence_get (iter);
+
+		for_each_func (self, entry->connection, user_data);
+	}
+}
+
 NMSettingsConnection *
 nm_settings_get_connection_by_path (NMSettings *self, const char *path)
 {
@@ -669,6 +959,7 @@ load_plugins (NMSettings *self, const char **plugins, GError **error)
 #define UPDATED_ID_TAG "updated-id-tag"
 #define VISIBLE_ID_TAG "visible-id-tag"
 #define UNREG_ID_TAG "unreg-id-tag"
+#define TIMESTAMP_ID_TAG "timestamp-id-tag"
 
 static void
 connection_removed (NMSettingsConnection *obj, gpointer user_data)
@@ -695,7 +986,12 @@ connection_removed (NMSettingsConnection *obj, gpointer user_data)
 	if (id)
 		g_signal_handler_disconnect (connection, id);
 
+	id = GPOINTER_TO_UINT (g_object_get_data (connection, TIMESTAMP_ID_TAG));
+	if (id)
+		g_signal_handler_disconnect (connection, id);
+
 	/* Forget about the connection internally */
+	connection_index_remove (NM_SETTINGS (user_data), obj);
 	g_hash_table_remove (NM_SETTINGS_GET_PRIVATE (user_data)->connections,
 	                     (gpointer) nm_connection_get_path (NM_CONNECTION (connection)));
 
@@ -724,6 +1020,9 @@ connection_unregister (NMSettingsConnection *obj, gpointer user_data)
 static void
 connection_updated (NMSettingsConnection *connection, gpointer user_data)
 {
+	/* Autoconnect or UUID may have changed */
+	connection_index_refresh (NM_SETTINGS (user_data), connection);
+
 	/* Re-emit for listeners like NMPolicy */
 	g_signal_emit (NM_SETTINGS (user_data),
 	               signals[CONNECTION_UPDATED],
@@ -732,6 +1031,14 @@ connection_updated (NMSettingsConnection *connection, gpointer user_data)
 	g_signal_emit_by_name (NM_SETTINGS (user_data), NM_CP_SIGNAL_CONNECTION_UPDATED, connection);
 }
 
+static void
+connection_timestamp_changed (NMSettingsConnection *connection,
+                              GParamSpec *pspec,
+                              gpointer user_data)
+{
+	connection_index_refresh (NM_SETTINGS (user_data), connection);
+}
+
 static void
 connection_visibility_changed (NMSettingsConnection *connection,
                                GParamSpec *pspec,
@@ -804,20 +1111,15 @@ claim_connection (NMSettings *self,
 	NMSettingsPrivate *priv = NM_SETTINGS_GET_PRIVATE (self);
 	static guint32 ec_counter = 0;
 	GError *error = NULL;
-	GHashTableIter iter;
-	gpointer data;
 	char *path;
 	guint id;
 
 	g_return_if_fail (NM_IS_SETTINGS_CONNECTION (connection));
-	g_return_if_fail (nm_connection_get_path (NM_CONNECTION (connection)) == NULL);
 
-	g_hash_table_iter_init (&iter, priv->connections);
-	while (g_hash_table_iter_next (&iter, NULL, &data)) {
-		/* prevent duplicates */
-		if (data == connection)
-			return;
-	}
+	/* Claimed connections always have a D-Bus path, so this also prevents
+	 * duplicates without walking every connection for each new one.
+	 */
+	g_return_if_fail (nm_connection_get_path (NM_CONNECTION (connection)) == NULL);
 
 	if (!nm_connection_verify (NM_CONNECTION (connection), &error)) {
 		nm_log_warn (LOGD_SETTINGS, "plugin provided invalid connection: '%s' / '%s' invalid: %d",
@@ -859,6 +1161,11 @@ claim_connection (NMSettings *self,
 	                       self);
 	g_object_set_data (G_OBJECT (connection), VISIBLE_ID_TAG, GUINT_TO_POINTER (id));
 
+	id = g_signal_connect (connection, "notify::" NM_SETTINGS_CONNECTION_TIMESTAMP,
+	                       G_CALLBACK (connection_timestamp_changed),
+	                       self);
+	g_object_set_data (G_OBJECT (connection), TIMESTAMP_ID_TAG, GUINT_TO_POINTER (id));
+
 	/* Export the connection over D-Bus */
 	g_warn_if_fail (nm_connection_get_path (NM_CONNECTION (connection)) == NULL);
 	path = g_strdup_printf ("%s/%u", NM_DBUS_PATH_SETTINGS, ec_counter++);
@@ -869,6 +1176,7 @@ claim_connection (NMSettings *self,
 	g_hash_table_insert (priv->connections,
 	                     (gpointer) nm_connection_get_path (NM_CONNECTION (connection)),
 	                     g_object_ref (connection));
+	connection_index_add (self, connection);
 
 	/* Only emit the individual connection-added signal after connections
 	 * have been initially loaded.  While getting the first list of connections
@@ -896,6 +1204,7 @@ remove_default_wired_connection (NMSettings *self,
 	if (g_hash_table_lookup (priv->connections, path)) {
 		if (do_signal)
 			g_signal_emit_by_name (G_OBJECT (connection), NM_SETTINGS_CONNECTION_REMOVED);
+		connection_index_remove (self, connection);
 		g_hash_table_remove (priv->connections, path);
 	}
 }
@@ -908,20 +1217,16 @@ add_new_connection (NMSettings *self,
 	NMSettingsPrivate *priv = NM_SETTINGS_GET_PRIVATE (self);
 	GSList *iter;
 	NMSettingsConnection *added = NULL;
-	GHashTableIter citer;
-	NMConnection *candidate = NULL;
+	const char *uuid;
 
 	/* Make sure a connection with this UUID doesn't already exist */
-	g_hash_table_iter_init (&citer, priv->connections);
-	while (g_hash_table_iter_next (&citer, NULL, (gpointer *) &candidate)) {
-		if (g_strcmp0 (nm_connection_get_uuid (connection),
-		               nm_connection_get_uuid (candidate)) == 0) {
-			g_set_error_literal (error,
-			                     NM_SETTINGS_ERROR,
-			                     NM_SETTINGS_ERROR_UUID_EXISTS,
-			                     "A connection with this UUID already exists.");
-			return NULL;
-		}
+	uuid = nm_connection_get_uuid (connection);
+	if (uuid && g_hash_table_lookup (priv->connections_by_uuid, uuid)) {
+		g_set_error_literal (error,
+		                     NM_SETTINGS_ERROR,
+		                     NM_SETTINGS_ERROR_UUID_EXISTS,
+		                     "A connection with this UUID already exists.");
+		return NULL;
 	}
 
 	/* 1) plugin writes the NMConnection to disk
@@ -1097,66 +1402,38 @@ is_adhoc_wpa (NMConnection *connection)
 	return TRUE;
 }
 
-void
-nm_settings_add_connection (NMSettings *self,
-                            NMConnection *connection,
-                            DBusGMethodInvocation *context,
-                            NMSettingsAddCallback callback,
-                            gpointer user_data)
+typedef struct {
+	NMSettings *self;
+	NMConnection *connection;
+	NMSettingsAddCallback callback;
+	gpointer callback_data;
+} AddConnectionInfo;
+
+static void
+add_connection_caller_uid_cb (DBusGMethodInvocation *context,
+                              gulong caller_uid,
+                              const char *caller_error_desc,
+                              gpointer user_data)
 {
+	AddConnectionInfo *info = user_data;
+	NMSettings *self = info->self;
 	NMSettingsPrivate *priv = NM_SETTINGS_GET_PRIVATE (self);
+	NMConnection *connection = info->connection;
+	NMSettingsAddCallback callback = info->callback;
 	NMSettingConnection *s_con;
 	NMAuthChain *chain;
-	GError *error = NULL, *tmp_error = NULL;
-	gulong caller_uid = G_MAXULONG;
+	GError *error = NULL;
 	char *error_desc = NULL;
 	const char *perm;
 
-	/* Connection must be valid, of course */
-	if (!nm_connection_verify (connection, &tmp_error)) {
-		error = g_error_new (NM_SETTINGS_ERROR,
-		                     NM_SETTINGS_ERROR_INVALID_CONNECTION,
-		                     "The connection was invalid: %s",
-		                     tmp_error ? tmp_error->message : "(unknown)");
-		g_error_free (tmp_error);
-		callback (self, NULL, error, context, user_data);
-		g_error_free (error);
-		return;
-	}
-
-	/* The kernel doesn't support Ad-Hoc WPA connections well at this time,
-	 * and turns them into open networks.  It's been this way since at least
-	 * 2.6.30 or so; until that's fixed, disable WPA-protected Ad-Hoc networks.
-	 */
-	if (is_adhoc_wpa (connection)) {
-		error = g_error_new_literal (NM_SETTINGS_ERROR,
-		                             NM_SETTINGS_ERROR_INVALID_CONNECTION,
-		                             "WPA Ad-Hoc disabled due to kernel bugs");
-		callback (self, NULL, error, context, user_data);
-		g_error_free (error);
-		return;
-	}
-
-	/* Do any of the plugins support adding? */
-	if (!get_plugin (self, NM_SYSTEM_CONFIG_INTERFACE_CAP_MODIFY_CONNECTIONS)) {
-		error = g_error_new_literal (NM_SETTINGS_ERROR,
-		                             NM_SETTINGS_ERROR_ADD_NOT_SUPPORTED,
-		                             "None of the registered plugins support add.");
-		callback (self, NULL, error, context, user_data);
-		g_error_free (error);
-		return;
-	}
-
-	/* Get the caller's UID */
-	if (!nm_auth_get_caller_uid (context, priv->dbus_mgr, &caller_uid, &error_desc)) {
+	if (caller_error_desc) {
 		error = g_error_new (NM_SETTINGS_ERROR,
 		                     NM_SETTINGS_ERROR_NOT_PRIVILEGED,
 		                     "Unable to determine UID of request: %s.",
-		                     error_desc ? error_desc : "(unknown)");
-		g_free (error_desc);
-		callback (self, NULL, error, context, user_data);
+		                     caller_error_desc);
+		callback (self, NULL, error, context, info->callback_data);
 		g_error_free (error);
-		return;
+		goto out;
 	}
 
 	/* Ensure the caller's username exists in the connection's permissions,
@@ -1168,9 +1445,9 @@ nm_settings_add_connection (NMSettings *self,
 			                             NM_SETTINGS_ERROR_NOT_PRIVILEGED,
 			                             error_desc);
 			g_free (error_desc);
-			callback (self, NULL, error, context, user_data);
+			callback (self, NULL, error, context, info->callback_data);
 			g_error_free (error);
-			return;
+			goto out;
 		}
 
 		/* Caller is allowed to add this connection */
@@ -1195,8 +1472,68 @@ nm_settings_add_connection (NMSettings *self,
 	nm_auth_chain_set_data (chain, "perm", (gpointer) perm, NULL);
 	nm_auth_chain_set_data (chain, "connection", g_object_ref (connection), g_object_unref);
 	nm_auth_chain_set_data (chain, "callback", callback, NULL);
-	nm_auth_chain_set_data (chain, "callback-data", user_data, NULL);
+	nm_auth_chain_set_data (chain, "callback-data", info->callback_data, NULL);
 	nm_auth_chain_set_data_ulong (chain, "caller-uid", caller_uid);
+
+out:
+	g_object_unref (info->connection);
+	g_object_unref (info->self);
+	g_slice_free (AddConnectionInfo, info);
+}
+
+void
+nm_settings_add_connection (NMSettings *self,
+                            NMConnection *connection,
+                            DBusGMethodInvocation *context,
+                            NMSettingsAddCallback callback,
+                            gpointer user_data)
+{
+	NMSettingsPrivate *priv = NM_SETTINGS_GET_PRIVATE (self);
+	AddConnectionInfo *info;
+	GError *error = NULL, *tmp_error = NULL;
+
+	/* Connection must be valid, of course */
+	if (!nm_connection_verify (connection, &tmp_error)) {
+		error = g_error_new (NM_SETTINGS_ERROR,
+		                     NM_SETTINGS_ERROR_INVALID_CONNECTION,
+		                     "The connection was invalid: %s",
+		                     tmp_error ? tmp_error->message : "(unknown)");
+		g_error_free (tmp_error);
+		callback (self, NULL, error, context, user_data);
+		g_error_free (error);
+		return;
+	}
+
+	/* The kernel doesn't support Ad-Hoc WPA connections well at this time,
+	 * and turns them into open networks.  It's been this way since at least
+	 * 2.6.30 or so; until that's fixed, disable WPA-protected Ad-Hoc networks.
+	 */
+	if (is_adhoc_wpa (connection)) {
+		error = g_error_new_literal (NM_SETTINGS_ERROR,
+		                             NM_SETTINGS_ERROR_INVALID_CONNECTION,
+		                             "WPA Ad-Hoc disabled due to kernel bugs");
+		callback (self, NULL, error, context, user_data);
+		g_error_free (error);
+		return;
+	}
+
+	/* Do any of the plugins support adding? */
+	if (!get_plugin (self, NM_SYSTEM_CONFIG_INTERFACE_CAP_MODIFY_CONNECTIONS)) {
+		error = g_error_new_literal (NM_SETTINGS_ERROR,
+		                             NM_SETTINGS_ERROR_ADD_NOT_SUPPORTED,
+		                             "None of the registered plugins support add.");
+		callback (self, NULL, error, context, user_data);
+		g_error_free (error);
+		return;
+	}
+
+	/* Get the caller's UID */
+	info = g_slice_new0 (AddConnectionInfo);
+	info->self = g_object_ref (self);
+	info->connection = g_object_ref (connection);
+	info->callback = callback;
+	info->callback_data = user_data;
+	nm_auth_get_caller_uid_async (context, priv->dbus_mgr, add_connection_caller_uid_cb, info);
 }
 
 static void
@@ -1795,6 +2132,8 @@ nm_settings_init (NMSettings *self)
 	NMSettingsPrivate *priv = NM_SETTINGS_GET_PRIVATE (self);
 
 	priv->connections = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
+	priv->connections_by_uuid = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	priv->connections_sorted = g_sequence_new (NULL);
 
 	priv->session_monitor = nm_session_monitor_get ();
 
@@ -1833,8 +2172,13 @@ finalize (GObject *object)
 	NMSettings *self = NM_SETTINGS (object);
 	NMSettingsPrivate *priv = NM_SETTINGS_GET_PRIVATE (self);
 
+	g_sequence_free (priv->connections_sorted);
+	g_hash_table_destroy (priv->connections_by_uuid);
 	g_hash_table_destroy (priv->connections);
 
+	/* Don't lose batched timestamp and seen-bssids updates */
+	nm_settings_connection_flush_databases ();
+
 	clear_unmanaged_specs (self);
 
 	g_slist_foreach (priv->plugins, (GFunc) g_object_unref, NULL);
@@ -88,6 +88,10 @@ void nm_settings_for_each_connection (NMSettings *settings,
                                       NMSettingsForEachFunc for_each_func,
                                       gpointer user_data);
 
+void nm_settings_for_each_connection_sorted (NMSettings *settings,
+                                             NMSettingsForEachFunc for_each_func,
+                                             gpointer user_data);
+
 typedef void (*NMSettingsAddCallback) (NMSettings *settings,
                                        NMSettingsConnection *connection,
                                        GError *error,
@@ -0,0 +1,371 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager system settings service
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "nm-state-db.h"
+#include "nm-logging.h"
+
+struct _NMStateDb {
+	char *filename;
+	char *journal_path;
+	char *group;
+	guint flush_interval;
+
+	GKeyFile *keyfile;     /* other groups and comments of the file */
+	GHashTable *values;    /* key -> value */
+	gboolean loaded;
+	gboolean dirty;
+	guint flush_id;
+	int journal_fd;
+};
+
+#define JOURNAL_SET    'S'
+#define JOURNAL_REMOVE 'D'
+
+NMStateDb *
+nm_state_db_new (const char *filename, const char *group, guint flush_interval)
+{
+	NMStateDb *db;
+
+	g_return_val_if_fail (filename != NULL, NULL);
+	g_return_val_if_fail (group != NULL, NULL);
+
+	db = g_slice_new0 (NMStateDb);
+	db->filename = g_strdup (filename);
+	db->journal_path = g_strdup_printf ("%s.journal", filename);
+	db->group = g_strdup (group);
+	db->flush_interval = flush_interval;
+	db->keyfile = g_key_file_new ();
+	db->values = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	db->journal_fd = -1;
+	return db;
+}
+
+void
+nm_state_db_free (NMStateDb *db)
+{
+	GError *error = NULL;
+
+	g_return_if_fail (db != NULL);
+
+	if (db->dirty && !nm_state_db_flush (db, &error)) {
+		nm_log_warn (LOGD_SETTINGS, "error saving '%s': %s", db->filename, error->message);
+		g_clear_error (&error);
+	}
+
+	if (db->flush_id)
+		g_source_remove (db->flush_id);
+	if (db->journal_fd >= 0)
+		close (db->journal_fd);
+
+	g_key_file_free (db->keyfile);
+	g_hash_table_destroy (db->values);
+	g_free (db->filename);
+	g_free (db->journal_path);
+	g_free (db->group);
+	g_slice_free (NMStateDb, db);
+}
+
+static gboolean
+flush_cb (gpointer user_data)
+{
+	NMStateDb *db = user_data;
+	GError *error = NULL;
+
+	db->flush_id = 0;
+	if (!nm_state_db_flush (db, &error)) {
+		nm_log_warn (LOGD_SETTINGS, "error saving '%s': %s", db->filename, error->message);
+		g_clear_error (&error);
+	}
+	return FALSE;
+}
+
+static void
+schedule_flush (NMStateDb *db)
+{
+	db->dirty = TRUE;
+	if (db->flush_id == 0)
+		db->flush_id = g_timeout_add_seconds (db->flush_interval, flush_cb, db);
+}
+
+static void
+journal_append (NMStateDb *db, char op, const char *key, const char *value)
+{
+	GString *line;
+	char *escaped;
+	ssize_t written = 0;
+
+	if (db->journal_fd < 0) {
+		db->journal_fd = open (db->journal_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+		if (db->journal_fd < 0) {
+			nm_log_dbg (LOGD_SETTINGS, "could not open journal '%s': %s",
+			            db->journal_path, strerror (errno));
+			return;
+		}
+	}
+
+	line = g_string_sized_new (64);
+	g_string_append_c (line, op);
+	g_string_append_c (line, '\t');
+	escaped = g_strescape (key, NULL);
+	g_string_append (line, escaped);
+	g_free (escaped);
+	if (value) {
+		g_string_append_c (line, '\t');
+		escaped = g_strescape (value, NULL);
+		g_string_append (line, escaped);
+		g_free (escaped);
+	}
+	g_string_append_c (line, '\n');
+
+	/* Records are appended whole; a torn last line is skipped on replay */
+	while (written < line->len) {
+		ssize_t n = write (db->journal_fd, line->str + written, line->len - written);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			nm_log_dbg (LOGD_SETTINGS, "could not write journal '%s': %s",
+			            db->journal_path, strerror (errno));
+			break;
+		}
+		written += n;
+	}
+	g_string_free (line, TRUE);
+}
+
+static guint
+journal_replay (NMStateDb *db)
+{
+	char *contents = NULL;
+	char **lines, **iter;
+	guint applied = 0;
+
+	if (!g_file_get_contents (db->journal_path, &contents, NULL, NULL))
+		return 0;
+
+	lines = g_strsplit (contents, "\n", -1);
+	for (iter = lines; iter && *iter; iter++) {
+		char **fields;
+
+		/* The last record is torn unless it was terminated */
+		if (*(iter + 1) == NULL)
+			break;
+
+		if (strlen (*iter) < 3 || (*iter)[1] != '\t')
+			continue;
+
+		fields = g_strsplit (*iter + 2, "\t", 2);
+		if (fields[0]) {
+			char *key = g_strcompress (fields[0]);
+
+			if ((*iter)[0] == JOURNAL_SET && fields[1]) {
+				g_hash_table_insert (db->values, key, g_strcompress (fields[1]));
+				applied++;
+			} else if ((*iter)[0] == JOURNAL_REMOVE) {
+				g_hash_table_remove (db->values, key);
+				g_free (key);
+				applied++;
+			} else
+				g_free (key);
+		}
+		g_strfreev (fields);
+	}
+	g_strfreev (lines);
+	g_free (contents);
+
+	return applied;
+}
+
+/**
+ * nm_state_db_load:
+ * @db: the database
+ * @error: location for a #GError
+ *
+ * Reads the database file and any journal left by an unclean shutdown.
+ * Only the first call does any work; a missing file is not an error.
+ *
+ * Returns: %FALSE if the file exists but could not be parsed
+ **/
+gboolean
+nm_state_db_load (NMStateDb *db, GError **error)
+{
+	GError *local = NULL;
+	gboolean success = TRUE;
+	char **keys;
+	gsize i, len = 0;
+
+	g_return_val_if_fail (db != NULL, FALSE);
+
+	if (db->loaded)
+		return TRUE;
+	db->loaded = TRUE;
+
+	if (g_key_file_load_from_file (db->keyfile, db->filename, G_KEY_FILE_KEEP_COMMENTS, &local)) {
+		keys = g_key_file_get_keys (db->keyfile, db->group, &len, NULL);
+		for (i = 0; i < len; i++) {
+			char *value = g_key_file_get_value (db->keyfile, db->group, keys[i], NULL);
+
+			if (value)
+				g_hash_table_insert (db->values, g_strdup (keys[i]), value);
+		}
+		g_strfreev (keys);
+	} else {
+		if (!g_error_matches (local, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+			g_propagate_error (error, local);
+			local = NULL;
+			success = FALSE;
+		}
+		g_clear_error (&local);
+	}
+
+	/* Changes made after the last successful write */
+	if (journal_replay (db))
+		schedule_flush (db);
+
+	return success;
+}
+
+/**
+ * nm_state_db_flush:
+ * @db: the database
+ * @error: location for a #GError
+ *
+ * Atomically rewrites the database file if anything changed, and then
+ * discards the journal.
+ *
+ * Returns: %TRUE on success
+ **/
+gboolean
+nm_state_db_flush (NMStateDb *db, GError **error)
+{
+	GHashTableIter iter;
+	const char *key, *value;
+	char *data;
+	gsize len;
+	gboolean success;
+
+	g_return_val_if_fail (db != NULL, FALSE);
+
+	if (db->flush_id) {
+		g_source_remove (db->flush_id);
+		db->flush_id = 0;
+	}
+
+	if (!db->dirty)
+		return TRUE;
+
+	g_key_file_remove_group (db->keyfile, db->group, NULL);
+	g_hash_table_iter_init (&iter, db->values);
+	while (g_hash_table_iter_next (&iter, (gpointer) &key, (gpointer) &value))
+		g_key_file_set_value (db->keyfile, db->group, key, value);
+
+	data = g_key_file_to_data (db->keyfile, &len, error);
+	if (!data)
+		return FALSE;
+
+	/* g_file_set_contents() writes a temporary file and renames it */
+	success = g_file_set_contents (db->filename, data, len, error);
+	g_free (data);
+	if (!success)
+		return FALSE;
+
+	/* Everything in the journal is in the file now */
+	if (db->journal_fd >= 0) {
+		close (db->journal_fd);
+		db->journal_fd = -1;
+	}
+	unlink (db->journal_path);
+
+	db->dirty = FALSE;
+	return TRUE;
+}
+
+const char *
+nm_state_db_get (NMStateDb *db, const char *key)
+{
+	g_return_val_if_fail (db != NULL, NULL);
+	g_return_val_if_fail (key != NULL, NULL);
+
+	nm_state_db_load (db, NULL);
+	return g_hash_table_lookup (db->values, key);
+}
+
+/**
+ * nm_state_db_set:
+ * @db: the database
+ * @key: the key
+ * @value: the new value
+ *
+ * Sets @key to @value in memory and journals the change; the file itself
+ * is rewritten by the next scheduled flush.  Setting an unchanged value
+ * does nothing.
+ **/
+void
+nm_state_db_set (NMStateDb *db, const char *key, const char *value)
+{
+	g_return_if_fail (db != NULL);
+	g_return_if_fail (key != NULL);
+	g_return_if_fail (value != NULL);
+
+	nm_state_db_load (db, NULL);
+
+	if (g_strcmp0 (g_hash_table_lookup (db->values, key), value) == 0)
+		return;
+
+	g_hash_table_insert (db->values, g_strdup (key), g_strdup (value));
+	journal_append (db, JOURNAL_SET, key, value);
+	schedule_flush (db);
+}
+
+void
+nm_state_db_remove (NMStateDb *db, const char *key)
+{
+	g_return_if_fail (db != NULL);
+	g_return_if_fail (key != NULL);
+
+	nm_state_db_load (db, NULL);
+
+	if (!g_hash_table_remove (db->values, key))
+		return;
+
+	journal_append (db, JOURNAL_REMOVE, key, NULL);
+	schedule_flush (db);
+}
+
+gboolean
+nm_state_db_is_dirty (NMStateDb *db)
+{
+	g_return_val_if_fail (db != NULL, FALSE);
+
+	return db->dirty;
+}
+
+char *
+nm_state_db_get_journal_path (NMStateDb *db)
+{
+	g_return_val_if_fail (db != NULL, NULL);
+
+	return g_strdup (db->journal_path);
+}
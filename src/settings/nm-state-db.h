@@ -0,0 +1,48 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager system settings service
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+#ifndef NM_STATE_DB_H
+#define NM_STATE_DB_H
+
+#include <glib.h>
+
+/* A single-group keyfile database (like NMSTATEDIR/timestamps) kept in
+ * memory.  The file is read once; changes are appended to a journal file
+ * next to it and written back as a whole, atomically, at most once per
+ * flush interval.  A journal left over from a crash is replayed on load.
+ */
+typedef struct _NMStateDb NMStateDb;
+
+NMStateDb * nm_state_db_new     (const char *filename,
+                                 const char *group,
+                                 guint flush_interval);
+void        nm_state_db_free    (NMStateDb *db);
+
+gboolean    nm_state_db_load    (NMStateDb *db, GError **error);
+gboolean    nm_state_db_flush   (NMStateDb *db, GError **error);
+
+const char *nm_state_db_get     (NMStateDb *db, const char *key);
+void        nm_state_db_set     (NMStateDb *db, const char *key, const char *value);
+void        nm_state_db_remove  (NMStateDb *db, const char *key);
+
+gboolean    nm_state_db_is_dirty (NMStateDb *db);
+char *      nm_state_db_get_journal_path (NMStateDb *db);
+
+#endif  /* NM_STATE_DB_H */
@@ -95,49 +95,48 @@ files_changed_cb (NMInotifyHelper *ih,
 	g_signal_emit (self, signals[IFCFG_CHANGED], 0);
 }
 
+/**
+ * nm_ifcfg_connection_new_parsed:
+ * @full_path: the ifcfg file @parsed was read from
+ * @parsed: the connection read from @full_path
+ * @unmanaged: (transfer full): unmanaged spec, if any
+ * @keyfile: (transfer full): keys file of the connection, if any
+ * @routefile: (transfer full): IPv4 route file of the connection, if any
+ * @route6file: (transfer full): IPv6 route file of the connection, if any
+ * @error: location for a #GError
+ *
+ * Creates the settings connection for an ifcfg file that connection_from_file()
+ * has already read, for example on a connection loader thread.
+ *
+ * Returns: the new connection, or %NULL on error
+ **/
 NMIfcfgConnection *
-nm_ifcfg_connection_new (const char *full_path,
-                         NMConnection *source,
-                         GError **error,
-                         gboolean *ignore_error)
+nm_ifcfg_connection_new_parsed (const char *full_path,
+                                NMConnection *parsed,
+                                char *unmanaged,
+                                char *keyfile,
+                                char *routefile,
+                                char *route6file,
+                                GError **error)
 {
 	GObject *object;
 	NMIfcfgConnectionPrivate *priv;
-	NMConnection *tmp;
-	char *unmanaged = NULL;
-	char *keyfile = NULL;
-	char *routefile = NULL;
-	char *route6file = NULL;
 	NMInotifyHelper *ih;
 
 	g_return_val_if_fail (full_path != NULL, NULL);
-
-	/* If we're given a connection already, prefer that instead of re-reading */
-	if (source)
-		tmp = g_object_ref (source);
-	else {
-		tmp = connection_from_file (full_path, NULL, NULL, NULL,
-		                            &unmanaged,
-		                            &keyfile,
-		                            &routefile,
-		                            &route6file,
-		                            error,
-		                            ignore_error);
-		if (!tmp)
-			return NULL;
-	}
+	g_return_val_if_fail (parsed != NULL, NULL);
 
 	object = (GObject *) g_object_new (NM_TYPE_IFCFG_CONNECTION,
 	                                   NM_IFCFG_CONNECTION_UNMANAGED, unmanaged,
 	                                   NULL);
+	g_free (unmanaged);
 	if (!object)
-		goto out;
+		goto error;
 
 	/* Update our settings with what was read from the file */
-	if (!nm_settings_connection_replace_settings (NM_SETTINGS_CONNECTION (object), tmp, error)) {
+	if (!nm_settings_connection_replace_settings (NM_SETTINGS_CONNECTION (object), parsed, error)) {
 		g_object_unref (object);
-		object = NULL;
-		goto out;
+		goto error;
 	}
 
 	priv = NM_IFCFG_CONNECTION_GET_PRIVATE (object);
@@ -157,9 +156,53 @@ nm_ifcfg_connection_new (const char *full_path,
 	priv->route6file = route6file;
 	priv->route6file_wd = nm_inotify_helper_add_watch (ih, route6file);
 
-out:
-	g_object_unref (tmp);
 	return (NMIfcfgConnection *) object;
+
+error:
+	g_free (keyfile);
+	g_free (routefile);
+	g_free (route6file);
+	return NULL;
+}
+
+NMIfcfgConnection *
+nm_ifcfg_connection_new (const char *full_path,
+                         NMConnection *source,
+                         GError **error,
+                         gboolean *ignore_error)
+{
+	NMIfcfgConnection *connection;
+	NMConnection *tmp;
+	char *unmanaged = NULL;
+	char *keyfile = NULL;
+	char *routefile = NULL;
+	char *route6file = NULL;
+
+	g_return_val_if_fail (full_path != NULL, NULL);
+
+	/* If we're given a connection already, prefer that instead of re-reading */
+	if (source)
+		tmp = g_object_ref (source);
+	else {
+		tmp = connection_from_file (full_path, NULL, NULL, NULL,
+		                            &unmanaged,
+		                            &keyfile,
+		                            &routefile,
+		                            &route6file,
+		                            error,
+		                            ignore_error);
+		if (!tmp)
+			return NULL;
+	}
+
+	connection = nm_ifcfg_connection_new_parsed (full_path, tmp,
+	                                             unmanaged,
+	                                             keyfile,
+	                                             routefile,
+	                                             route6file,
+	                                             error);
+	g_object_unref (tmp);
+	return connection;
 }
 
 const char *
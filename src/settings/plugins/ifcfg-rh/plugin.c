@@ -47,7 +47,9 @@
 
 #include "nm-ifcfg-connection.h"
 #include "nm-inotify-helper.h"
+#include "nm-connection-loader.h"
 #include "shvar.h"
+#include "reader.h"
 #include "writer.h"
 #include "utils.h"
 
@@ -111,15 +113,43 @@ connection_ifcfg_changed (NMIfcfgConnection *connection, gpointer user_data)
 	connection_new_or_changed (plugin, path, connection);
 }
 
+static void
+_internal_add_connection (SCPluginIfcfg *self, NMIfcfgConnection *connection)
+{
+	SCPluginIfcfgPrivate *priv = SC_PLUGIN_IFCFG_GET_PRIVATE (self);
+	const char *cid;
+
+	cid = nm_connection_get_id (NM_CONNECTION (connection));
+	g_assert (cid);
+
+	g_hash_table_insert (priv->connections,
+	                     (gpointer) nm_ifcfg_connection_get_path (connection),
+	                     connection);
+	PLUGIN_PRINT (IFCFG_PLUGIN_NAME, "    read connection '%s'", cid);
+
+	if (nm_ifcfg_connection_get_unmanaged_spec (connection)) {
+		PLUGIN_PRINT (IFCFG_PLUGIN_NAME, "Ignoring connection '%s' and its "
+		              "device due to NM_CONTROLLED/BRIDGE/VLAN.", cid);
+	} else {
+		/* Wait for the connection to become unmanaged once it knows the
+		 * hardware IDs of its device, if/when the device gets plugged in.
+		 */
+		g_signal_connect (G_OBJECT (connection), "notify::" NM_IFCFG_CONNECTION_UNMANAGED,
+		                  G_CALLBACK (connection_unmanaged_changed), self);
+	}
+
+	/* watch changes of ifcfg hardlinks */
+	g_signal_connect (G_OBJECT (connection), "ifcfg-changed",
+	                  G_CALLBACK (connection_ifcfg_changed), self);
+}
+
 static NMIfcfgConnection *
 _internal_new_connection (SCPluginIfcfg *self,
                           const char *path,
                           NMConnection *source,
                           GError **error)
 {
-	SCPluginIfcfgPrivate *priv = SC_PLUGIN_IFCFG_GET_PRIVATE (self);
 	NMIfcfgConnection *connection;
-	const char *cid;
 	GError *local = NULL;
 	gboolean ignore_error = FALSE;
 
@@ -137,30 +167,70 @@ _internal_new_connection (SCPluginIfcfg *self,
 		return NULL;
 	}
 
-	cid = nm_connection_get_id (NM_CONNECTION (connection));
-	g_assert (cid);
+	_internal_add_connection (self, connection);
+	return connection;
+}
 
-	g_hash_table_insert (priv->connections,
-	                     (gpointer) nm_ifcfg_connection_get_path (connection),
-	                     connection);
-	PLUGIN_PRINT (IFCFG_PLUGIN_NAME, "    read connection '%s'", cid);
+typedef struct {
+	NMConnection *connection;
+	char *unmanaged;
+	char *keyfile;
+	char *routefile;
+	char *route6file;
+	GError *error;
+	gboolean ignore_error;
+} ReadResult;
+
+/* Runs on a connection loader thread */
+static gpointer
+read_ifcfg_file (const char *path, gpointer user_data)
+{
+	ReadResult *result = g_slice_new0 (ReadResult);
+
+	result->connection = connection_from_file (path, NULL, NULL, NULL,
+	                                           &result->unmanaged,
+	                                           &result->keyfile,
+	                                           &result->routefile,
+	                                           &result->route6file,
+	                                           &result->error,
+	                                           &result->ignore_error);
+	return result;
+}
 
-	if (nm_ifcfg_connection_get_unmanaged_spec (connection)) {
-		PLUGIN_PRINT (IFCFG_PLUGIN_NAME, "Ignoring connection '%s' and its "
-		              "device due to NM_CONTROLLED/BRIDGE/VLAN.", cid);
+static void
+claim_ifcfg_file (const char *path, gpointer data, gpointer user_data)
+{
+	SCPluginIfcfg *self = SC_PLUGIN_IFCFG (user_data);
+	ReadResult *result = data;
+	NMIfcfgConnection *connection = NULL;
+
+	PLUGIN_PRINT (IFCFG_PLUGIN_NAME, "parsing %s ... ", path);
+
+	if (result->connection) {
+		/* Takes the file names */
+		connection = nm_ifcfg_connection_new_parsed (path, result->connection,
+		                                             result->unmanaged,
+		                                             result->keyfile,
+		                                             result->routefile,
+		                                             result->route6file,
+		                                             &result->error);
+		g_object_unref (result->connection);
 	} else {
-		/* Wait for the connection to become unmanaged once it knows the
-		 * hardware IDs of its device, if/when the device gets plugged in.
-		 */
-		g_signal_connect (G_OBJECT (connection), "notify::" NM_IFCFG_CONNECTION_UNMANAGED,
-		                  G_CALLBACK (connection_unmanaged_changed), self);
+		g_free (result->unmanaged);
+		g_free (result->keyfile);
+		g_free (result->routefile);
+		g_free (result->route6file);
 	}
 
-	/* watch changes of ifcfg hardlinks */
-	g_signal_connect (G_OBJECT (connection), "ifcfg-changed",
-	                  G_CALLBACK (connection_ifcfg_changed), self);
+	if (connection)
+		_internal_add_connection (self, connection);
+	else if (!result->ignore_error) {
+		PLUGIN_PRINT (IFCFG_PLUGIN_NAME, "    error: %s",
+		              (result->error && result->error->message) ? result->error->message : "(unknown)");
+	}
 
-	return connection;
+	g_clear_error (&result->error);
+	g_slice_free (ReadResult, result);
 }
 
 static void
@@ -168,11 +238,13 @@ read_connections (SCPluginIfcfg *plugin)
 {
 	GDir *dir;
 	GError *err = NULL;
+	GPtrArray *paths;
 
 	dir = g_dir_open (IFCFG_DIR, 0, &err);
 	if (dir) {
 		const char *item;
 
+		paths = g_ptr_array_new_with_free_func (g_free);
 		while ((item = g_dir_read_name (dir))) {
 			char *full_path;
 
@@ -181,11 +253,15 @@ read_connections (SCPluginIfcfg *plugin)
 
 			full_path = g_build_filename (IFCFG_DIR, item, NULL);
 			if (utils_get_ifcfg_name (full_path, TRUE))
-				_internal_new_connection (plugin, full_path, NULL, NULL);
-			g_free (full_path);
+				g_ptr_array_add (paths, full_path);
+			else
+				g_free (full_path);
 		}
-
 		g_dir_close (dir);
+
+		/* Parse the files in parallel, then create the connections here */
+		nm_connection_loader_run (paths, 0, read_ifcfg_file, claim_ifcfg_file, plugin);
+		g_ptr_array_free (paths, TRUE);
 	} else {
 		PLUGIN_WARN (IFCFG_PLUGIN_NAME, "Can not read directory '%s': %s", IFCFG_DIR, err->message);
 		g_error_free (err);
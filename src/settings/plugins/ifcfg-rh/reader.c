@@ -409,16 +409,16 @@ fill_ip4_setting_from_ibft (shvarFile *ifcfg,
 
 		/* HWADDR */
 		if (!skip && (p = match_iscsiadm_tag (*iter, ISCSI_HWADDR_TAG, &skip))) {
-			struct ether_addr *ibft_mac;
+			struct ether_addr ibft_mac;
 
-			ibft_mac = ether_aton (p);
-			if (!ibft_mac) {
+			/* Reentrant; files are parsed on connection loader threads */
+			if (!ether_aton_r (p, &ibft_mac)) {
 				g_warning ("%s: malformed iscsiadm record: invalid hwaddress.", __func__);
 				skip = TRUE;
 				continue;
 			}
 
-			if (memcmp (ifcfg_mac->data, (guint8 *) ibft_mac->ether_addr_octet, ETH_ALEN)) {
+			if (memcmp (ifcfg_mac->data, (guint8 *) ibft_mac.ether_addr_octet, ETH_ALEN)) {
 				/* This record isn't for the current device, ignore it */
 				skip = TRUE;
 				continue;
@@ -38,6 +38,78 @@
 
 #include "shvar.h"
 
+/* Lines are kept in file order in lineList so rewrites are faithful;
+ * lineIndex maps each key to the first line that sets it, which is the
+ * one svGetValue() has always returned.
+ */
+
+static char *
+line_get_key(const char *line)
+{
+    const char *eq = strchr(line, '=');
+
+    return eq ? g_strndup(line, eq - line) : NULL;
+}
+
+static void
+index_line(shvarFile *s, GList *link)
+{
+    char *key = line_get_key(link->data);
+
+    if (!key)
+	return;
+    if (g_hash_table_lookup(s->lineIndex, key))
+	g_free(key);
+    else
+	g_hash_table_insert(s->lineIndex, key, link);
+}
+
+static void
+append_line(shvarFile *s, char *line)
+{
+    GList *link = g_list_alloc();
+
+    link->data = line;
+    link->prev = s->lastLine;
+    if (s->lastLine)
+	s->lastLine->next = link;
+    else
+	s->lineList = link;
+    s->lastLine = link;
+
+    index_line(s, link);
+}
+
+static void
+remove_line(shvarFile *s, GList *link)
+{
+    char *key = line_get_key(link->data);
+    GList *iter, *next = link->next;
+
+    if (link == s->lastLine)
+	s->lastLine = link->prev;
+    s->lineList = g_list_remove_link(s->lineList, link);
+
+    /* A later line setting the same key becomes the visible one */
+    if (key && g_hash_table_lookup(s->lineIndex, key) == link) {
+	g_hash_table_remove(s->lineIndex, key);
+	for (iter = next; iter; iter = iter->next) {
+	    char *other = line_get_key(iter->data);
+	    gboolean same = other && !strcmp(other, key);
+
+	    g_free(other);
+	    if (same) {
+		g_hash_table_insert(s->lineIndex, g_strdup(key), iter);
+		break;
+	    }
+	}
+    }
+    g_free(key);
+
+    g_free(link->data);
+    g_list_free_1(link);
+}
+
 /* Open the file <name>, returning a shvarFile on success and NULL on failure.
    Add a wrinkle to let the caller specify whether or not to create the file
    (actually, return a structure anyway) if it doesn't exist. */
@@ -48,6 +120,7 @@ svOpenFile(const char *name, gboolean create)
     int closefd = 0;
 
     s = g_malloc0(sizeof(shvarFile));
+    s->lineIndex = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
     s->fd = -1;
     if (create)
@@ -71,7 +144,7 @@ svOpenFile(const char *name, gboolean create)
 
 	/* we'd use g_strsplit() here, but we want a list, not an array */
 	for(p = s->arena; (q = strchr(p, '\n')) != NULL; p = q + 1) {
-		s->lineList = g_list_append(s->lineList, g_strndup(p, q - p));
+		append_line(s, g_strndup(p, q - p));
 	}
 
 	/* closefd is set if we opened the file read-only, so go ahead and
@@ -90,6 +163,9 @@ svOpenFile(const char *name, gboolean create)
 
 bail:
     if (s->fd != -1) close(s->fd);
+    g_list_foreach (s->lineList, (GFunc) g_free, NULL);
+    g_list_free (s->lineList);
+    g_hash_table_destroy (s->lineIndex);
     g_free (s->arena);
     g_free (s->fileName);
     g_free (s);
@@ -189,28 +265,16 @@ char *
 svGetValue(shvarFile *s, const char *key, gboolean verbatim)
 {
     char *value = NULL;
-    char *line;
-    char *keyString;
-    int len;
 
     g_assert(s);
     g_assert(key);
 
-    keyString = g_malloc0(strlen(key) + 2);
-    strcpy(keyString, key);
-    keyString[strlen(key)] = '=';
-    len = strlen(keyString);
-
-    for (s->current = s->lineList; s->current; s->current = s->current->next) {
-	line = s->current->data;
-	if (!strncmp(keyString, line, len)) {
-	    value = g_strdup(line + len);
-	    if (!verbatim)
-	      svUnescape(value);
-	    break;
-	}
+    s->current = g_hash_table_lookup(s->lineIndex, key);
+    if (s->current) {
+	value = g_strdup((char *) s->current->data + strlen(key) + 1);
+	if (!verbatim)
+	  svUnescape(value);
     }
-    g_free(keyString);
 
     if (value) {
 	if (value[0]) {
@@ -297,14 +361,16 @@ svSetValue(shvarFile *s, const char *key, const char *value, gboolean verbatim)
 	/* delete value somehow */
 	if (val2) {
 	    /* change/append line to get key= */
-	    if (s->current) s->current->data = keyValue;
-	    else s->lineList = g_list_append(s->lineList, keyValue);
+	    if (s->current) {
+		g_free(s->current->data);
+		s->current->data = keyValue;
+	    } else append_line(s, keyValue);
 	    s->modified = 1;
 	    goto end;
-	} else if (val1) {
+	} else if (val1 && s->current) {
 	    /* delete line */
-	    s->lineList = g_list_remove_link(s->lineList, s->current);
-	    g_list_free_1(s->current);
+	    remove_line(s, s->current);
+	    s->current = NULL;
 	    s->modified = 1;
 	}
 	goto bail; /* do not need keyValue */
@@ -313,7 +379,7 @@ svSetValue(shvarFile *s, const char *key, const char *value, gboolean verbatim)
     if (!val1) {
 	if (val2 && !strcmp(val2, newval)) goto end;
 	/* append line */
-	s->lineList = g_list_append(s->lineList, keyValue);
+	append_line(s, keyValue);
 	s->modified = 1;
 	goto end;
     }
@@ -322,16 +388,18 @@ svSetValue(shvarFile *s, const char *key, const char *value, gboolean verbatim)
     if (val1 && !strcmp(val1, newval)) goto end;
 
     /* At this point, val1 && val1 != value */
-    if (val2 && !strcmp(val2, newval)) {
+    if (val2 && !strcmp(val2, newval) && s->current) {
 	/* delete line */
-	s->lineList = g_list_remove_link(s->lineList, s->current);
-	g_list_free_1(s->current);
+	remove_line(s, s->current);
+	s->current = NULL;
 	s->modified = 1;
 	goto bail; /* do not need keyValue */
     } else {
 	/* change line */
-	if (s->current) s->current->data = keyValue;
-	else s->lineList = g_list_append(s->lineList, keyValue);
+	if (s->current) {
+	    g_free(s->current->data);
+	    s->current->data = keyValue;
+	} else append_line(s, keyValue);
 	s->modified = 1;
     }
 
@@ -395,6 +463,7 @@ svCloseFile(shvarFile *s)
     g_free(s->fileName);
     g_list_foreach (s->lineList, (GFunc) g_free, NULL);
     g_list_free(s->lineList); /* implicitly frees s->current */
+    g_hash_table_destroy(s->lineIndex);
     g_free(s);
     return 0;
 }
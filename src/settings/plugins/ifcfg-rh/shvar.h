@@ -46,6 +46,9 @@ struct _shvarFile {
 					   points to element of lineList */
 	shvarFile	*parent;	/* set explicitly */
 	int		modified;	/* ignore */
+	GHashTable	*lineIndex;	/* ignore; key -> first line of lineList
+					   setting it */
+	GList		*lastLine;	/* ignore; tail of lineList */
 };
 
 
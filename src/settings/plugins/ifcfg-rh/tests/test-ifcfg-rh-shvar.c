@@ -0,0 +1,371 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/* NetworkManager system settings service - ifcfg-rh plugin
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ */
+
+/* Writes a few ifcfg files with shvar, parses them back and checks that
+ * indexed svGetValue() lookups give the same answers as the linear scan
+ * over the line list they replaced, before and after the files change.
+ * With "-m perf" it also times writing, parsing, looking up and rewriting
+ * a large ifcfg tree.
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nm-test-helpers.h"
+
+#include "shvar.h"
+
+#define NUM_FILES 4
+#define NUM_FILES_PERF 10000
+
+/* Keys written for each connection, like writer.c does for an ethernet
+ * connection with static IPv4 and automatic IPv6.
+ */
+static const char *written_keys[] = {
+	"TYPE", "DEVICE", "HWADDR", "ONBOOT", "BOOTPROTO", "IPADDR", "PREFIX",
+	"GATEWAY", "DNS1", "DNS2", "DOMAIN", "DEFROUTE", "PEERDNS", "PEERROUTES",
+	"IPV4_FAILURE_FATAL", "IPV6INIT", "IPV6_AUTOCONF", "IPV6_DEFROUTE",
+	"IPV6_PEERDNS", "IPV6_PEERROUTES", "IPV6_FAILURE_FATAL", "NAME", "UUID",
+	"USERCTL", "MTU", "ZONE", "DHCP_HOSTNAME", "ETHTOOL_OPTS", NULL
+};
+
+/* Keys reader.c asks for; most of them aren't in a given file */
+static const char *read_keys[] = {
+	"TYPE", "DEVICE", "HWADDR", "MACADDR", "ONBOOT", "BOOTPROTO", "IPADDR",
+	"IPADDR0", "IPADDR1", "IPADDR2", "PREFIX", "PREFIX0", "NETMASK",
+	"NETMASK0", "GATEWAY", "GATEWAY0", "DNS1", "DNS2", "DNS3", "DOMAIN",
+	"DEFROUTE", "PEERDNS", "PEERROUTES", "IPV4_FAILURE_FATAL", "IPV6INIT",
+	"IPV6_AUTOCONF", "DHCPV6C", "IPV6ADDR", "IPV6ADDR_SECONDARIES",
+	"IPV6_DEFAULTGW", "IPV6_DEFROUTE", "IPV6_PEERDNS", "IPV6_PEERROUTES",
+	"IPV6_FAILURE_FATAL", "IPV6_PRIVACY", "NAME", "UUID", "USERCTL", "USERS",
+	"MTU", "ZONE", "DHCP_HOSTNAME", "DHCP_CLIENT_ID", "DHCP_SEND_HOSTNAME",
+	"ETHTOOL_OPTS", "SUBCHANNELS", "PORTNAME", "NETTYPE", "CTCPROT",
+	"OPTIONS", "MASTER", "BONDING_OPTS", "BRIDGE", "VLAN", "PHYSDEV",
+	"MACADDR_BLACKLIST", "NM_CONTROLLED", "LAST_CONNECT", "KEY_MGMT", NULL
+};
+
+static char *
+reference_get_value (shvarFile *s, const char *key)
+{
+	char *prefix, *value = NULL;
+	GList *iter;
+	int len;
+
+	prefix = g_strdup_printf ("%s=", key);
+	len = strlen (prefix);
+	for (iter = s->lineList; iter; iter = g_list_next (iter)) {
+		if (!strncmp (prefix, iter->data, len)) {
+			value = g_strdup ((char *) iter->data + len);
+			svUnescape (value);
+			break;
+		}
+	}
+	g_free (prefix);
+
+	if (value && !value[0]) {
+		g_free (value);
+		value = NULL;
+	}
+	return value;
+}
+
+static gboolean
+is_written_key (const char *key)
+{
+	const char **iter;
+
+	for (iter = written_keys; *iter; iter++) {
+		if (!strcmp (*iter, key))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static char *
+make_value (const char *key, guint i)
+{
+	if (!strcmp (key, "TYPE"))
+		return g_strdup ("Ethernet");
+	if (!strcmp (key, "DEVICE"))
+		return g_strdup_printf ("eth%u", i);
+	if (!strcmp (key, "HWADDR"))
+		return g_strdup_printf ("00:11:22:%02X:%02X:%02X", (i >> 16) & 0xFF, (i >> 8) & 0xFF, i & 0xFF);
+	if (!strcmp (key, "IPADDR"))
+		return g_strdup_printf ("10.%u.%u.2", (i >> 8) & 0xFF, i & 0xFF);
+	if (!strcmp (key, "GATEWAY"))
+		return g_strdup_printf ("10.%u.%u.1", (i >> 8) & 0xFF, i & 0xFF);
+	if (!strcmp (key, "NAME"))
+		return g_strdup_printf ("System eth%u", i);
+	if (!strcmp (key, "UUID"))
+		return g_strdup_printf ("5fcf4a0e-8d4f-4a8a-9c4e-%012x", i);
+	if (!strcmp (key, "ETHTOOL_OPTS"))
+		return g_strdup ("autoneg off speed 100 duplex full");
+	if (!strcmp (key, "MTU"))
+		return g_strdup ("1400");
+	if (!strcmp (key, "PREFIX"))
+		return g_strdup ("24");
+	return g_strdup (i % 2 ? "yes" : "no");
+}
+
+static void
+test_shvar_index (const char *dir)
+{
+	char *path, *value, *expected;
+	shvarFile *s;
+
+	/* Duplicate keys: the first line wins, and a later one takes over
+	 * when the first is removed.
+	 */
+	path = g_build_filename (dir, "ifcfg-dupes", NULL);
+	ASSERT (g_file_set_contents (path, "A=1\n# A=comment\nB=2\nA=3\n", -1, NULL),
+	        "shvar-index", "failed to write '%s'", path);
+
+	s = svNewFile (path);
+	ASSERT (s != NULL, "shvar-index", "failed to open '%s'", path);
+
+	value = svGetValue (s, "A", FALSE);
+	ASSERT (g_strcmp0 (value, "1") == 0, "shvar-index", "unexpected A '%s'", value);
+	g_free (value);
+
+	svSetValue (s, "A", NULL, FALSE);
+	value = svGetValue (s, "A", FALSE);
+	ASSERT (g_strcmp0 (value, "3") == 0, "shvar-index", "unexpected A '%s' after delete", value);
+	g_free (value);
+
+	/* Appended lines go to the end and are found */
+	svSetValue (s, "C", "with space", FALSE);
+	value = svGetValue (s, "C", FALSE);
+	ASSERT (g_strcmp0 (value, "with space") == 0, "shvar-index", "unexpected C '%s'", value);
+	g_free (value);
+	ASSERT (s->modified, "shvar-index", "file not marked modified");
+	ASSERT (svWriteFile (s, 0644) == 0, "shvar-index", "failed to write '%s'", path);
+	svCloseFile (s);
+
+	ASSERT (g_file_get_contents (path, &value, NULL, NULL),
+	        "shvar-index", "failed to read '%s'", path);
+	expected = "# A=comment\nB=2\nA=3\nC=\"with space\"\n";
+	ASSERT (strcmp (value, expected) == 0, "shvar-index", "unexpected contents '%s'", value);
+	g_free (value);
+
+	unlink (path);
+	g_free (path);
+}
+
+static void
+check_lookups (shvarFile *s)
+{
+	const char **key;
+
+	for (key = read_keys; *key; key++) {
+		char *value = svGetValue (s, *key, FALSE);
+		char *reference = reference_get_value (s, *key);
+
+		ASSERT (g_strcmp0 (value, reference) == 0,
+		        "shvar-lookups", "%s: %s is '%s', expected '%s'",
+		        s->fileName, *key, value, reference);
+		g_free (value);
+		g_free (reference);
+	}
+}
+
+static void
+test_shvar_lookups (const char *dir)
+{
+	shvarFile *files[NUM_FILES];
+	char *value;
+	guint i;
+	const char **key;
+
+	/* Write the files */
+	for (i = 0; i < NUM_FILES; i++) {
+		char *path, *name = g_strdup_printf ("ifcfg-test-%u", i);
+		shvarFile *s;
+
+		path = g_build_filename (dir, name, NULL);
+		s = svCreateFile (path);
+		ASSERT (s != NULL, "shvar-lookups", "failed to create '%s'", path);
+		for (key = written_keys; *key; key++) {
+			char *v = make_value (*key, i);
+
+			svSetValue (s, *key, v, FALSE);
+			g_free (v);
+		}
+		/* writer.c clears everything it doesn't set */
+		for (key = read_keys; *key; key++) {
+			if (!is_written_key (*key))
+				svSetValue (s, *key, NULL, FALSE);
+		}
+		ASSERT (svWriteFile (s, 0644) == 0, "shvar-lookups", "failed to write '%s'", path);
+		svCloseFile (s);
+		g_free (path);
+		g_free (name);
+	}
+
+	/* Parse them back */
+	for (i = 0; i < NUM_FILES; i++) {
+		char *path, *name = g_strdup_printf ("ifcfg-test-%u", i);
+
+		path = g_build_filename (dir, name, NULL);
+		files[i] = svNewFile (path);
+		ASSERT (files[i] != NULL, "shvar-lookups", "failed to open '%s'", path);
+		check_lookups (files[i]);
+		g_free (path);
+		g_free (name);
+	}
+
+	/* Change, remove and add values; the index must follow */
+	for (i = 0; i < NUM_FILES; i++) {
+		svSetValue (files[i], "ONBOOT", "no", FALSE);
+		svSetValue (files[i], "MTU", NULL, FALSE);
+		svSetValue (files[i], "LAST_CONNECT", "1234567890", FALSE);
+		check_lookups (files[i]);
+
+		value = svGetValue (files[i], "MTU", FALSE);
+		ASSERT (value == NULL, "shvar-lookups", "%s: removed MTU is '%s'",
+		        files[i]->fileName, value);
+		value = svGetValue (files[i], "LAST_CONNECT", FALSE);
+		ASSERT (g_strcmp0 (value, "1234567890") == 0, "shvar-lookups",
+		        "%s: unexpected LAST_CONNECT '%s'", files[i]->fileName, value);
+		g_free (value);
+
+		/* svWriteFile() leaves the file open */
+		ASSERT (svWriteFile (files[i], 0644) == 0,
+		        "shvar-lookups", "failed to rewrite '%s'", files[i]->fileName);
+		unlink (files[i]->fileName);
+		svCloseFile (files[i]);
+	}
+}
+
+static void
+test_shvar_perf (const char *dir)
+{
+	GTimer *timer;
+	shvarFile **files;
+	gdouble t_write, t_parse, t_index, t_linear, t_rewrite;
+	guint i, lookups = 0;
+	const char **key;
+
+	files = g_new0 (shvarFile *, NUM_FILES_PERF);
+	timer = g_timer_new ();
+
+	/* Write the tree */
+	for (i = 0; i < NUM_FILES_PERF; i++) {
+		char *path, *name = g_strdup_printf ("ifcfg-perf-%05u", i);
+		shvarFile *s;
+
+		path = g_build_filename (dir, name, NULL);
+		s = svCreateFile (path);
+		ASSERT (s != NULL, "shvar-perf", "failed to create '%s'", path);
+		for (key = written_keys; *key; key++) {
+			char *v = make_value (*key, i);
+
+			svSetValue (s, *key, v, FALSE);
+			g_free (v);
+		}
+		for (key = read_keys; *key; key++) {
+			if (!is_written_key (*key))
+				svSetValue (s, *key, NULL, FALSE);
+		}
+		ASSERT (svWriteFile (s, 0644) == 0, "shvar-perf", "failed to write '%s'", path);
+		svCloseFile (s);
+		g_free (path);
+		g_free (name);
+	}
+	t_write = g_timer_elapsed (timer, NULL);
+
+	/* Parse it back */
+	g_timer_start (timer);
+	for (i = 0; i < NUM_FILES_PERF; i++) {
+		char *path, *name = g_strdup_printf ("ifcfg-perf-%05u", i);
+
+		path = g_build_filename (dir, name, NULL);
+		files[i] = svNewFile (path);
+		ASSERT (files[i] != NULL, "shvar-perf", "failed to open '%s'", path);
+		g_free (path);
+		g_free (name);
+	}
+	t_parse = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	for (i = 0; i < NUM_FILES_PERF; i++) {
+		for (key = read_keys; *key; key++, lookups++)
+			g_free (svGetValue (files[i], *key, FALSE));
+	}
+	t_index = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	for (i = 0; i < NUM_FILES_PERF; i++) {
+		for (key = read_keys; *key; key++)
+			g_free (reference_get_value (files[i], *key));
+	}
+	t_linear = g_timer_elapsed (timer, NULL);
+
+	/* Change a few values and rewrite every file; svWriteFile() leaves the
+	 * file open, so close each one right away.
+	 */
+	g_timer_start (timer);
+	for (i = 0; i < NUM_FILES_PERF; i++) {
+		svSetValue (files[i], "ONBOOT", "no", FALSE);
+		svSetValue (files[i], "MTU", NULL, FALSE);
+		svSetValue (files[i], "LAST_CONNECT", "1234567890", FALSE);
+		ASSERT (svWriteFile (files[i], 0644) == 0,
+		        "shvar-perf", "failed to rewrite '%s'", files[i]->fileName);
+		g_timer_stop (timer);
+		unlink (files[i]->fileName);
+		svCloseFile (files[i]);
+		g_timer_continue (timer);
+	}
+	t_rewrite = g_timer_elapsed (timer, NULL);
+
+	g_free (files);
+	g_timer_destroy (timer);
+
+	fprintf (stdout, "shvar: %d files: write %.1f ms, parse %.1f ms, rewrite %.1f ms\n",
+	         NUM_FILES_PERF, t_write * 1000, t_parse * 1000, t_rewrite * 1000);
+	fprintf (stdout, "shvar: %u lookups: linear %.1f ms, indexed %.1f ms\n",
+	         lookups, t_linear * 1000, t_index * 1000);
+}
+
+int main (int argc, char **argv)
+{
+	char *base, *dir;
+
+	g_test_init (&argc, &argv, NULL);
+
+	dir = g_build_filename (g_get_tmp_dir (), "nm-test-ifcfg-rh-shvar-XXXXXX", NULL);
+	if (!mkdtemp (dir))
+		FAIL ("shvar-lookups", "failed to create scratch directory '%s'", dir);
+
+	test_shvar_index (dir);
+	test_shvar_lookups (dir);
+	if (g_test_perf ())
+		test_shvar_perf (dir);
+
+	rmdir (dir);
+	g_free (dir);
+
+	base = g_path_get_basename (argv[0]);
+	fprintf (stdout, "%s: SUCCESS\n", base);
+	g_free (base);
+	return 0;
+}
@@ -38,6 +38,8 @@
 #include "plugin.h"
 #include "nm-system-config-interface.h"
 #include "nm-keyfile-connection.h"
+#include "nm-connection-loader.h"
+#include "reader.h"
 #include "writer.h"
 #include "common.h"
 #include "utils.h"
@@ -87,12 +89,55 @@ _internal_new_connection (SCPluginKeyfile *self,
 	return (NMSettingsConnection *) connection;
 }
 
+typedef struct {
+	NMConnection *connection;
+	GError *error;
+} ReadResult;
+
+/* Runs on a connection loader thread */
+static gpointer
+read_connection_file (const char *path, gpointer user_data)
+{
+	ReadResult *result = g_slice_new0 (ReadResult);
+
+	result->connection = nm_keyfile_plugin_connection_from_file (path, &result->error);
+	return result;
+}
+
+static void
+claim_connection_file (const char *path, gpointer data, gpointer user_data)
+{
+	SCPluginKeyfile *self = SC_PLUGIN_KEYFILE (user_data);
+	ReadResult *result = data;
+	NMSettingsConnection *connection = NULL;
+	char *item;
+
+	item = g_path_get_basename (path);
+	PLUGIN_PRINT (KEYFILE_PLUGIN_NAME, "parsing %s ... ", item);
+	g_free (item);
+
+	if (result->connection) {
+		connection = _internal_new_connection (self, path, result->connection, &result->error);
+		g_object_unref (result->connection);
+	}
+
+	if (connection) {
+		PLUGIN_PRINT (KEYFILE_PLUGIN_NAME, "    read connection '%s'",
+		              nm_connection_get_id (NM_CONNECTION (connection)));
+	} else {
+		PLUGIN_PRINT (KEYFILE_PLUGIN_NAME, "    error: %s",
+			          (result->error && result->error->message) ? result->error->message : "(unknown)");
+	}
+	g_clear_error (&result->error);
+	g_slice_free (ReadResult, result);
+}
+
 static void
 read_connections (NMSystemConfigInterface *config)
 {
-	SCPluginKeyfile *self = SC_PLUGIN_KEYFILE (config);
 	GDir *dir;
 	GError *error = NULL;
+	GPtrArray *paths;
 	const char *item;
 
 	dir = g_dir_open (KEYFILE_DIR, 0, &error);
@@ -105,28 +150,17 @@ read_connections (NMSystemConfigInterface *config)
 		return;
 	}
 
+	paths = g_ptr_array_new_with_free_func (g_free);
 	while ((item = g_dir_read_name (dir))) {
-		NMSettingsConnection *connection;
-		char *full_path;
-
 		if (nm_keyfile_plugin_utils_should_ignore_file (item))
 			continue;
-
-		full_path = g_build_filename (KEYFILE_DIR, item, NULL);
-		PLUGIN_PRINT (KEYFILE_PLUGIN_NAME, "parsing %s ... ", item);
-
-		connection = _internal_new_connection (self, full_path, NULL, &error);
-		if (connection) {
-			PLUGIN_PRINT (KEYFILE_PLUGIN_NAME, "    read connection '%s'",
-			              nm_connection_get_id (NM_CONNECTION (connection)));
-		} else {
-			PLUGIN_PRINT (KEYFILE_PLUGIN_NAME, "    error: %s",
-				          (error && error->message) ? error->message : "(unknown)");
-		}
-		g_clear_error (&error);
-		g_free (full_path);
+		g_ptr_array_add (paths, g_build_filename (KEYFILE_DIR, item, NULL));
 	}
 	g_dir_close (dir);
+
+	/* Parse the files in parallel, then create the connections here */
+	nm_connection_loader_run (paths, 0, read_connection_file, claim_connection_file, config);
+	g_ptr_array_free (paths, TRUE);
 }
 
 static void
@@ -0,0 +1,267 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ *
+ */
+
+#include <glib.h>
+#include <glib-object.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <nm-connection.h>
+
+#include "nm-connection-loader.h"
+#include "reader.h"
+
+/* Enough keyfiles to keep several threads busy */
+#define NUM_KEYFILES 20
+
+/* For the scaling benchmark, run with -m perf */
+#define NUM_KEYFILES_PERF 5000
+
+typedef struct {
+	guint claimed;
+	guint failed;
+} ClaimData;
+
+static gpointer
+read_path (const char *path, gpointer user_data)
+{
+	return g_strdup_printf ("read %s", path);
+}
+
+static void
+claim_path (const char *path, gpointer result, gpointer user_data)
+{
+	ClaimData *data = user_data;
+	char *expected;
+
+	/* Results come back in order, and each one with its own path */
+	expected = g_strdup_printf ("%u", data->claimed);
+	g_assert_cmpstr (path, ==, expected);
+	g_free (expected);
+	expected = g_strdup_printf ("read %u", data->claimed);
+	g_assert_cmpstr (result, ==, expected);
+	g_free (expected);
+	g_free (result);
+	data->claimed++;
+}
+
+static void
+test_loader_order (void)
+{
+	GPtrArray *paths;
+	ClaimData data;
+	guint i, threads[] = { 1, 4, 0 };
+
+	paths = g_ptr_array_new_with_free_func (g_free);
+	for (i = 0; i < 1000; i++)
+		g_ptr_array_add (paths, g_strdup_printf ("%u", i));
+
+	for (i = 0; i < G_N_ELEMENTS (threads); i++) {
+		memset (&data, 0, sizeof (data));
+		nm_connection_loader_run (paths, threads[i], read_path, claim_path, &data);
+		g_assert_cmpint (data.claimed, ==, paths->len);
+	}
+
+	/* Nothing to read */
+	g_ptr_array_set_size (paths, 0);
+	memset (&data, 0, sizeof (data));
+	nm_connection_loader_run (paths, 0, read_path, claim_path, &data);
+	g_assert_cmpint (data.claimed, ==, 0);
+
+	g_ptr_array_free (paths, TRUE);
+}
+
+/*******************************************/
+
+static gpointer
+read_keyfile (const char *path, gpointer user_data)
+{
+	return nm_keyfile_plugin_connection_from_file (path, NULL);
+}
+
+static void
+claim_keyfile (const char *path, gpointer result, gpointer user_data)
+{
+	ClaimData *data = user_data;
+	NMConnection *connection = result;
+	char *expected;
+
+	if (!connection) {
+		data->failed++;
+		return;
+	}
+
+	/* Files are named after the connection's index, like its UUID */
+	expected = g_strdup_printf ("5fcf4a0e-8d4f-4a8a-9c4e-%012u", data->claimed);
+	g_assert (g_str_has_suffix (path, expected + strlen ("5fcf4a0e-8d4f-4a8a-9c4e-")));
+	g_assert_cmpstr (nm_connection_get_uuid (connection), ==, expected);
+	g_free (expected);
+
+	g_object_unref (connection);
+	data->claimed++;
+}
+
+static GPtrArray *
+write_keyfiles (const char *dir, guint num)
+{
+	GPtrArray *paths;
+	guint i;
+
+	paths = g_ptr_array_new_with_free_func (g_free);
+	for (i = 0; i < num; i++) {
+		char *name, *path, *contents;
+
+		name = g_strdup_printf ("test-%012u", i);
+		path = g_build_filename (dir, name, NULL);
+		contents = g_strdup_printf ("[connection]\n"
+		                            "id=Wired %u\n"
+		                            "uuid=5fcf4a0e-8d4f-4a8a-9c4e-%012u\n"
+		                            "type=802-3-ethernet\n"
+		                            "autoconnect=false\n"
+		                            "\n"
+		                            "[802-3-ethernet]\n"
+		                            "mac-address=00:11:22:%02X:%02X:%02X\n"
+		                            "mtu=1400\n"
+		                            "\n"
+		                            "[ipv4]\n"
+		                            "method=manual\n"
+		                            "dns=10.0.0.1;10.0.0.2;\n"
+		                            "addresses1=10.%u.%u.2;24;10.%u.%u.1;\n"
+		                            "routes1=192.168.%u.0/24,10.%u.%u.254,10\n"
+		                            "\n"
+		                            "[ipv6]\n"
+		                            "method=auto\n",
+		                            i, i,
+		                            (i >> 16) & 0xFF, (i >> 8) & 0xFF, i & 0xFF,
+		                            (i >> 8) & 0xFF, i & 0xFF, (i >> 8) & 0xFF, i & 0xFF,
+		                            i & 0xFF, (i >> 8) & 0xFF, i & 0xFF);
+		g_assert (g_file_set_contents (path, contents, -1, NULL));
+		/* The keyfile reader refuses files anyone else could read */
+		g_assert (chmod (path, 0600) == 0);
+		g_ptr_array_add (paths, path);
+		g_free (contents);
+		g_free (name);
+	}
+	return paths;
+}
+
+static void
+remove_keyfiles (const char *dir, GPtrArray *paths)
+{
+	guint i;
+
+	for (i = 0; i < paths->len; i++)
+		unlink (g_ptr_array_index (paths, i));
+	g_ptr_array_free (paths, TRUE);
+	rmdir (dir);
+}
+
+static void
+test_loader_keyfile (void)
+{
+	GPtrArray *paths;
+	ClaimData data;
+	char *dir;
+	guint i, threads[] = { 1, 4, 0 };
+
+	dir = g_build_filename (g_get_tmp_dir (), "nm-test-connection-loader-XXXXXX", NULL);
+	g_assert (mkdtemp (dir) != NULL);
+	paths = write_keyfiles (dir, NUM_KEYFILES);
+
+	for (i = 0; i < G_N_ELEMENTS (threads); i++) {
+		memset (&data, 0, sizeof (data));
+		nm_connection_loader_run (paths, threads[i], read_keyfile, claim_keyfile, &data);
+		g_assert_cmpint (data.failed, ==, 0);
+		g_assert_cmpint (data.claimed, ==, paths->len);
+	}
+
+	remove_keyfiles (dir, paths);
+	g_free (dir);
+}
+
+static void
+test_loader_keyfile_scaling (void)
+{
+	GPtrArray *paths;
+	ClaimData data;
+	GTimer *timer;
+	char *dir;
+	guint n, max_threads;
+	gdouble elapsed, serial = 0;
+
+	dir = g_build_filename (g_get_tmp_dir (), "nm-test-connection-loader-XXXXXX", NULL);
+	g_assert (mkdtemp (dir) != NULL);
+	paths = write_keyfiles (dir, NUM_KEYFILES_PERF);
+
+	timer = g_timer_new ();
+	max_threads = nm_connection_loader_get_default_threads ();
+	for (n = 1; ; n = MIN (n * 2, max_threads)) {
+		memset (&data, 0, sizeof (data));
+		g_timer_start (timer);
+		nm_connection_loader_run (paths, n, read_keyfile, claim_keyfile, &data);
+		elapsed = g_timer_elapsed (timer, NULL);
+
+		g_assert_cmpint (data.failed, ==, 0);
+		g_assert_cmpint (data.claimed, ==, paths->len);
+
+		if (n == 1)
+			serial = elapsed;
+		g_print ("%u keyfiles with %2u thread(s): %.1f ms (%.2fx)\n",
+		         paths->len, n, elapsed * 1000, serial / elapsed);
+
+		if (n == max_threads)
+			break;
+	}
+	g_timer_destroy (timer);
+
+	remove_keyfiles (dir, paths);
+	g_free (dir);
+}
+
+/*******************************************/
+
+#if GLIB_CHECK_VERSION(2,25,12)
+typedef GTestFixtureFunc TCFunc;
+#else
+typedef void (*TCFunc)(void);
+#endif
+
+#define TESTCASE(t, d) g_test_create_case (#t, 0, d, NULL, (TCFunc) t, NULL)
+
+int main (int argc, char **argv)
+{
+	GTestSuite *suite;
+
+	if (!g_thread_supported ())
+		g_thread_init (NULL);
+	g_type_init ();
+	g_test_init (&argc, &argv, NULL);
+
+	suite = g_test_get_root ();
+
+	g_test_suite_add (suite, TESTCASE (test_loader_order, NULL));
+	g_test_suite_add (suite, TESTCASE (test_loader_keyfile, NULL));
+	if (g_test_perf ())
+		g_test_suite_add (suite, TESTCASE (test_loader_keyfile_scaling, NULL));
+
+	return g_test_run ();
+}
@@ -0,0 +1,172 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ *
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nm-state-db.h"
+
+static char *
+make_db_path (void)
+{
+	char *dir, *path;
+
+	dir = g_build_filename (g_get_tmp_dir (), "nm-test-state-db-XXXXXX", NULL);
+	g_assert (mkdtemp (dir) != NULL);
+	path = g_build_filename (dir, "timestamps", NULL);
+	g_free (dir);
+	return path;
+}
+
+static void
+remove_db_path (const char *path)
+{
+	char *journal, *dir;
+
+	journal = g_strdup_printf ("%s.journal", path);
+	unlink (journal);
+	unlink (path);
+	dir = g_path_get_dirname (path);
+	rmdir (dir);
+	g_free (dir);
+	g_free (journal);
+}
+
+/*******************************************/
+
+static void
+test_state_db_flush (void)
+{
+	NMStateDb *db;
+	GKeyFile *keyfile;
+	char *path, *journal, *value;
+	GError *error = NULL;
+
+	path = make_db_path ();
+	g_assert (g_file_set_contents (path, "# comment\n[other]\nfoo=bar\n[timestamps]\nold=1\n", -1, NULL));
+
+	db = nm_state_db_new (path, "timestamps", 60);
+	g_assert (nm_state_db_load (db, &error));
+	g_assert_no_error (error);
+	g_assert_cmpstr (nm_state_db_get (db, "old"), ==, "1");
+
+	nm_state_db_set (db, "a", "100");
+	nm_state_db_set (db, "b", "200");
+	nm_state_db_set (db, "a", "150");
+	nm_state_db_remove (db, "old");
+	g_assert (nm_state_db_is_dirty (db));
+
+	/* Nothing is rewritten until the flush, but the journal has it all */
+	journal = nm_state_db_get_journal_path (db);
+	g_assert (g_file_test (journal, G_FILE_TEST_EXISTS));
+
+	g_assert (nm_state_db_flush (db, &error));
+	g_assert_no_error (error);
+	g_assert (!nm_state_db_is_dirty (db));
+	g_assert (!g_file_test (journal, G_FILE_TEST_EXISTS));
+
+	/* Setting an unchanged value is free */
+	nm_state_db_set (db, "b", "200");
+	g_assert (!nm_state_db_is_dirty (db));
+	nm_state_db_free (db);
+
+	keyfile = g_key_file_new ();
+	g_assert (g_key_file_load_from_file (keyfile, path, G_KEY_FILE_KEEP_COMMENTS, NULL));
+	value = g_key_file_get_value (keyfile, "timestamps", "a", NULL);
+	g_assert_cmpstr (value, ==, "150");
+	g_free (value);
+	value = g_key_file_get_value (keyfile, "timestamps", "b", NULL);
+	g_assert_cmpstr (value, ==, "200");
+	g_free (value);
+	g_assert (!g_key_file_has_key (keyfile, "timestamps", "old", NULL));
+	value = g_key_file_get_value (keyfile, "other", "foo", NULL);
+	g_assert_cmpstr (value, ==, "bar");
+	g_free (value);
+	g_key_file_free (keyfile);
+
+	remove_db_path (path);
+	g_free (journal);
+	g_free (path);
+}
+
+static void
+test_state_db_journal_replay (void)
+{
+	NMStateDb *db, *recovered;
+	char *path, *journal, *contents, *torn;
+
+	path = make_db_path ();
+
+	db = nm_state_db_new (path, "seen-bssids", 60);
+	nm_state_db_set (db, "uuid-1", "00:11:22:33:44:55,");
+	nm_state_db_set (db, "uuid-2", "66:77:88:99:aa:bb,");
+	nm_state_db_remove (db, "uuid-2");
+
+	/* Simulate a crash in the middle of writing another record */
+	journal = nm_state_db_get_journal_path (db);
+	g_assert (g_file_get_contents (journal, &contents, NULL, NULL));
+	torn = g_strdup_printf ("%sS\tuuid-3\tcc:dd", contents);
+	g_assert (g_file_set_contents (journal, torn, -1, NULL));
+	g_free (contents);
+	g_free (torn);
+
+	/* Without a database file, everything comes from the journal */
+	recovered = nm_state_db_new (path, "seen-bssids", 60);
+	g_assert (nm_state_db_load (recovered, NULL));
+	g_assert_cmpstr (nm_state_db_get (recovered, "uuid-1"), ==, "00:11:22:33:44:55,");
+	g_assert (nm_state_db_get (recovered, "uuid-2") == NULL);
+	g_assert (nm_state_db_get (recovered, "uuid-3") == NULL);
+	g_assert (nm_state_db_is_dirty (recovered));
+
+	g_assert (nm_state_db_flush (recovered, NULL));
+	g_assert (g_file_test (path, G_FILE_TEST_EXISTS));
+	nm_state_db_free (recovered);
+	nm_state_db_free (db);
+
+	remove_db_path (path);
+	g_free (journal);
+	g_free (path);
+}
+
+/*******************************************/
+
+#if GLIB_CHECK_VERSION(2,25,12)
+typedef GTestFixtureFunc TCFunc;
+#else
+typedef void (*TCFunc)(void);
+#endif
+
+#define TESTCASE(t, d) g_test_create_case (#t, 0, d, NULL, (TCFunc) t, NULL)
+
+int main (int argc, char **argv)
+{
+	GTestSuite *suite;
+
+	g_test_init (&argc, &argv, NULL);
+
+	suite = g_test_get_root ();
+
+	g_test_suite_add (suite, TESTCASE (test_state_db_flush, NULL));
+	g_test_suite_add (suite, TESTCASE (test_state_db_journal_replay, NULL));
+
+	return g_test_run ();
+}
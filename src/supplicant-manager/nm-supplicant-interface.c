@@ -40,6 +40,23 @@
 #define WPAS_ERROR_INVALID_IFACE    WPAS_DBUS_INTERFACE ".InvalidInterface"
 #define WPAS_ERROR_EXISTS_ERROR     WPAS_DBUS_INTERFACE ".InterfaceExists"
 
+/* BSS property changes of all interfaces are received through one filter
+ * on the bus connection and handed to the interface owning the BSS path.
+ */
+#define WPAS_BSS_PROPS_MATCH \
+	"type='signal',sender='" WPAS_DBUS_SERVICE "'," \
+	"interface='" DBUS_INTERFACE_PROPERTIES "',member='PropertiesChanged'," \
+	"arg0='" WPAS_DBUS_IFACE_BSS "'"
+/* wpa_supplicant 0.7.x only has its own PropertiesChanged signal */
+#define WPAS_BSS_OLD_PROPS_MATCH \
+	"type='signal',sender='" WPAS_DBUS_SERVICE "'," \
+	"interface='" WPAS_DBUS_IFACE_BSS "',member='PropertiesChanged'"
+
+/* BSS changes are passed on when a scan completes, or after this many
+ * seconds when they happen outside of a scan.
+ */
+#define BSS_UPDATES_DELAY 2
+
 G_DEFINE_TYPE (NMSupplicantInterface, nm_supplicant_interface, G_TYPE_OBJECT)
 
 static void wpas_iface_properties_changed (DBusGProxy *proxy,
@@ -104,7 +121,13 @@ typedef struct {
 	DBusGProxy *          props_proxy;
 	char *                net_path;
 	guint32               blobs_left;
-	GHashTable *          bss_proxies;
+
+	char *                bss_prefix;    /* object path prefix of our BSSs */
+	gboolean              bss_filter;    /* BSS signal filter installed */
+	GHashTable *          bss_paths;     /* known BSSs */
+	GHashTable *          bss_pending;   /* BSS path -> DBusPendingCall for GetAll */
+	GHashTable *          bss_updates;   /* BSSs changed since the last flush */
+	guint                 bss_updates_id;
 
 	time_t                last_scan;
 
@@ -113,28 +136,6 @@ typedef struct {
 	gboolean              disposed;
 } NMSupplicantInterfacePrivate;
 
-/* FIXME: remove this and just store the standard D-Bus properties
- * proxy object in bss_proxies when we drop support for wpa_supplicant
- * 0.7.x.
- */
-typedef struct {
-	/* Proxy for standard D-Bus Properties interface */
-	DBusGProxy *props;
-	/* Proxy for old wpa_supplicant-specific PropertiesChanged signal */
-	DBusGProxy *old_props;
-} BssProxies;
-
-static void
-bss_proxies_free (gpointer data)
-{
-	BssProxies *proxies = data;
-
-	g_object_unref (proxies->props);
-	g_object_unref (proxies->old_props);
-	memset (proxies, 0, sizeof (*proxies));
-	g_free (proxies);
-}
-
 static gboolean
 cancel_all_cb (GObject *object, gpointer call_id, gpointer user_data)
 {
@@ -235,55 +236,408 @@ signal_new_bss (NMSupplicantInterface *self,
 }
 
 static void
-bssid_properties_cb  (DBusGProxy *proxy, DBusGProxyCall *call_id, gpointer user_data)
+destroy_gvalue (gpointer data)
 {
-	NMSupplicantInfo *info = (NMSupplicantInfo *) user_data;
-	GError *error = NULL;
+	GValue *value = (GValue *) data;
+
+	g_value_unset (value);
+	g_slice_free (GValue, value);
+}
+
+static gboolean iter_to_gvalue (DBusMessageIter *iter, GValue *value);
+
+/* Converts an a{sv} to the GHashTable dbus-glib would have given us */
+static GHashTable *
+iter_to_props (DBusMessageIter *iter)
+{
+	DBusMessageIter array, entry;
+	GHashTable *props;
+
+	if (   dbus_message_iter_get_arg_type (iter) != DBUS_TYPE_ARRAY
+	    || dbus_message_iter_get_element_type (iter) != DBUS_TYPE_DICT_ENTRY)
+		return NULL;
+
+	props = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, destroy_gvalue);
+
+	dbus_message_iter_recurse (iter, &array);
+	while (dbus_message_iter_get_arg_type (&array) == DBUS_TYPE_DICT_ENTRY) {
+		const char *key;
+		GValue *value;
+
+		dbus_message_iter_recurse (&array, &entry);
+		if (dbus_message_iter_get_arg_type (&entry) == DBUS_TYPE_STRING) {
+			dbus_message_iter_get_basic (&entry, &key);
+			dbus_message_iter_next (&entry);
+
+			/* Properties of types we don't know are left out */
+			value = g_slice_new0 (GValue);
+			if (iter_to_gvalue (&entry, value))
+				g_hash_table_insert (props, g_strdup (key), value);
+			else
+				g_slice_free (GValue, value);
+		}
+		dbus_message_iter_next (&array);
+	}
+
+	return props;
+}
+
+static gboolean
+iter_to_gvalue (DBusMessageIter *iter, GValue *value)
+{
+	DBusMessageIter sub;
+	union {
+		dbus_bool_t b;
+		unsigned char y;
+		dbus_int16_t n;
+		dbus_uint16_t q;
+		dbus_int32_t i;
+		dbus_uint32_t u;
+		dbus_int64_t x;
+		dbus_uint64_t t;
+		const char *s;
+	} v;
+
+	switch (dbus_message_iter_get_arg_type (iter)) {
+	case DBUS_TYPE_VARIANT:
+		dbus_message_iter_recurse (iter, &sub);
+		return iter_to_gvalue (&sub, value);
+	case DBUS_TYPE_BOOLEAN:
+		dbus_message_iter_get_basic (iter, &v.b);
+		g_value_init (value, G_TYPE_BOOLEAN);
+		g_value_set_boolean (value, v.b);
+		return TRUE;
+	case DBUS_TYPE_BYTE:
+		dbus_message_iter_get_basic (iter, &v.y);
+		g_value_init (value, G_TYPE_UCHAR);
+		g_value_set_uchar (value, v.y);
+		return TRUE;
+	case DBUS_TYPE_INT16:
+		dbus_message_iter_get_basic (iter, &v.n);
+		g_value_init (value, G_TYPE_INT);
+		g_value_set_int (value, v.n);
+		return TRUE;
+	case DBUS_TYPE_UINT16:
+		dbus_message_iter_get_basic (iter, &v.q);
+		g_value_init (value, G_TYPE_UINT);
+		g_value_set_uint (value, v.q);
+		return TRUE;
+	case DBUS_TYPE_INT32:
+		dbus_message_iter_get_basic (iter, &v.i);
+		g_value_init (value, G_TYPE_INT);
+		g_value_set_int (value, v.i);
+		return TRUE;
+	case DBUS_TYPE_UINT32:
+		dbus_message_iter_get_basic (iter, &v.u);
+		g_value_init (value, G_TYPE_UINT);
+		g_value_set_uint (value, v.u);
+		return TRUE;
+	case DBUS_TYPE_INT64:
+		dbus_message_iter_get_basic (iter, &v.x);
+		g_value_init (value, G_TYPE_INT64);
+		g_value_set_int64 (value, v.x);
+		return TRUE;
+	case DBUS_TYPE_UINT64:
+		dbus_message_iter_get_basic (iter, &v.t);
+		g_value_init (value, G_TYPE_UINT64);
+		g_value_set_uint64 (value, v.t);
+		return TRUE;
+	case DBUS_TYPE_STRING:
+		dbus_message_iter_get_basic (iter, &v.s);
+		g_value_init (value, G_TYPE_STRING);
+		g_value_set_string (value, v.s);
+		return TRUE;
+	case DBUS_TYPE_OBJECT_PATH:
+		dbus_message_iter_get_basic (iter, &v.s);
+		g_value_init (value, DBUS_TYPE_G_OBJECT_PATH);
+		g_value_set_boxed (value, v.s);
+		return TRUE;
+	case DBUS_TYPE_ARRAY:
+		break;
+	default:
+		return FALSE;
+	}
+
+	switch (dbus_message_iter_get_element_type (iter)) {
+	case DBUS_TYPE_BYTE: {
+		const guint8 *data;
+		int len = 0;
+		GArray *array;
+
+		dbus_message_iter_recurse (iter, &sub);
+		dbus_message_iter_get_fixed_array (&sub, &data, &len);
+		array = g_array_sized_new (FALSE, FALSE, 1, len);
+		g_array_append_vals (array, data, len);
+		g_value_init (value, DBUS_TYPE_G_UCHAR_ARRAY);
+		g_value_take_boxed (value, array);
+		return TRUE;
+	}
+	case DBUS_TYPE_UINT32: {
+		const dbus_uint32_t *data;
+		int len = 0, i;
+		GArray *array;
+
+		dbus_message_iter_recurse (iter, &sub);
+		dbus_message_iter_get_fixed_array (&sub, &data, &len);
+		array = g_array_sized_new (FALSE, FALSE, sizeof (guint), len);
+		for (i = 0; i < len; i++) {
+			guint u = data[i];
+
+			g_array_append_val (array, u);
+		}
+		g_value_init (value, DBUS_TYPE_G_ARRAY_OF_UINT);
+		g_value_take_boxed (value, array);
+		return TRUE;
+	}
+	case DBUS_TYPE_STRING: {
+		GPtrArray *strv = g_ptr_array_new ();
+
+		dbus_message_iter_recurse (iter, &sub);
+		while (dbus_message_iter_get_arg_type (&sub) == DBUS_TYPE_STRING) {
+			dbus_message_iter_get_basic (&sub, &v.s);
+			g_ptr_array_add (strv, g_strdup (v.s));
+			dbus_message_iter_next (&sub);
+		}
+		g_ptr_array_add (strv, NULL);
+		g_value_init (value, G_TYPE_STRV);
+		g_value_take_boxed (value, g_ptr_array_free (strv, FALSE));
+		return TRUE;
+	}
+	case DBUS_TYPE_OBJECT_PATH: {
+		GPtrArray *paths = g_ptr_array_new ();
+
+		dbus_message_iter_recurse (iter, &sub);
+		while (dbus_message_iter_get_arg_type (&sub) == DBUS_TYPE_OBJECT_PATH) {
+			dbus_message_iter_get_basic (&sub, &v.s);
+			g_ptr_array_add (paths, g_strdup (v.s));
+			dbus_message_iter_next (&sub);
+		}
+		g_value_init (value, DBUS_TYPE_G_ARRAY_OF_OBJECT_PATH);
+		g_value_take_boxed (value, paths);
+		return TRUE;
+	}
+	case DBUS_TYPE_DICT_ENTRY: {
+		GHashTable *dict = iter_to_props (iter);
+
+		if (!dict)
+			return FALSE;
+		g_value_init (value, DBUS_TYPE_G_MAP_OF_VARIANT);
+		g_value_take_boxed (value, dict);
+		return TRUE;
+	}
+	default:
+		return FALSE;
+	}
+}
+
+typedef struct {
+	NMSupplicantInterface *self;
+	char *path;
+} BssPropsCall;
+
+static void
+bss_props_call_free (void *data)
+{
+	BssPropsCall *call = data;
+
+	g_free (call->path);
+	g_slice_free (BssPropsCall, call);
+}
+
+static void
+bss_props_reply (DBusPendingCall *pending, void *user_data)
+{
+	BssPropsCall *call = user_data;
+	NMSupplicantInterfacePrivate *priv = NM_SUPPLICANT_INTERFACE_GET_PRIVATE (call->self);
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusError error;
 	GHashTable *props = NULL;
 
-	if (dbus_g_proxy_end_call (proxy, call_id, &error,
-	                           DBUS_TYPE_G_MAP_OF_VARIANT, &props,
-	                           G_TYPE_INVALID)) {
-		signal_new_bss (info->interface, dbus_g_proxy_get_path (proxy), props);
-		g_hash_table_destroy (props);
-	} else {
-		if (!strstr (error->message, "The BSSID requested was invalid")) {
+	/* Keep @call alive while the pending call is dropped from the table */
+	dbus_pending_call_ref (pending);
+	reply = dbus_pending_call_steal_reply (pending);
+	g_hash_table_remove (priv->bss_pending, call->path);
+
+	if (!reply)
+		goto out;
+
+	dbus_error_init (&error);
+	if (dbus_set_error_from_message (&error, reply)) {
+		if (!error.message || !strstr (error.message, "The BSSID requested was invalid")) {
 			nm_log_warn (LOGD_SUPPLICANT, "Couldn't retrieve BSSID properties: %s.",
-			             error->message);
+			             error.message ? error.message : error.name);
+		}
+		dbus_error_free (&error);
+	} else {
+		dbus_message_iter_init (reply, &iter);
+		props = iter_to_props (&iter);
+		if (props) {
+			signal_new_bss (call->self, call->path, props);
+			g_hash_table_destroy (props);
 		}
-		g_error_free (error);
 	}
+
+	dbus_message_unref (reply);
+out:
+	dbus_pending_call_unref (pending);
 }
 
 static void
-bss_properties_changed (DBusGProxy *proxy,
-                        const char *interface,
-                        GHashTable *props,
-                        const char **unused,
-                        gpointer user_data)
+bss_pending_cancel (gpointer data)
+{
+	DBusPendingCall *pending = data;
+
+	dbus_pending_call_cancel (pending);
+	dbus_pending_call_unref (pending);
+}
+
+/* Asks for the properties of a BSS that was announced without them.
+ * The call is sent directly on the connection, so unlike a DBusGProxy it
+ * doesn't cost a bus match rule per BSS.
+ */
+static void
+request_bss_props (NMSupplicantInterface *self, const char *object_path)
 {
-	NMSupplicantInterface *self = NM_SUPPLICANT_INTERFACE (user_data);
 	NMSupplicantInterfacePrivate *priv = NM_SUPPLICANT_INTERFACE_GET_PRIVATE (self);
+	DBusConnection *connection;
+	DBusMessage *message;
+	DBusPendingCall *pending = NULL;
+	const char *iface = WPAS_DBUS_IFACE_BSS;
+	BssPropsCall *call;
+
+	connection = dbus_g_connection_get_connection (nm_dbus_manager_get_connection (priv->dbus_mgr));
+	message = dbus_message_new_method_call (WPAS_DBUS_SERVICE,
+	                                        object_path,
+	                                        DBUS_INTERFACE_PROPERTIES,
+	                                        "GetAll");
+	g_return_if_fail (message != NULL);
+	dbus_message_append_args (message, DBUS_TYPE_STRING, &iface, DBUS_TYPE_INVALID);
+
+	if (!dbus_connection_send_with_reply (connection, message, &pending, -1) || !pending) {
+		nm_log_warn (LOGD_SUPPLICANT, "(%s): couldn't request BSS %s properties",
+		             priv->dev, object_path);
+		dbus_message_unref (message);
+		return;
+	}
+	dbus_message_unref (message);
 
-	if (priv->scanning)
-		priv->last_scan = time (NULL);
+	call = g_slice_new0 (BssPropsCall);
+	call->self = self;
+	call->path = g_strdup (object_path);
+	dbus_pending_call_set_notify (pending, bss_props_reply, call, bss_props_call_free);
 
-	if (g_strcmp0 (interface, WPAS_DBUS_IFACE_BSS) == 0)
-		g_signal_emit (self, signals[BSS_UPDATED], 0, dbus_g_proxy_get_path (proxy), props);
+	g_hash_table_insert (priv->bss_pending, g_strdup (object_path), pending);
 }
 
 static void
-old_bss_properties_changed (DBusGProxy *proxy,
-                            GHashTable *props,
-                            gpointer user_data)
+flush_bss_updates (NMSupplicantInterface *self)
+{
+	NMSupplicantInterfacePrivate *priv = NM_SUPPLICANT_INTERFACE_GET_PRIVATE (self);
+	GHashTableIter iter;
+	const char *path;
+	char **paths;
+	guint i = 0;
+
+	if (priv->bss_updates_id) {
+		g_source_remove (priv->bss_updates_id);
+		priv->bss_updates_id = 0;
+	}
+
+	if (g_hash_table_size (priv->bss_updates) == 0)
+		return;
+
+	paths = g_new0 (char *, g_hash_table_size (priv->bss_updates) + 1);
+	g_hash_table_iter_init (&iter, priv->bss_updates);
+	while (g_hash_table_iter_next (&iter, (gpointer) &path, NULL)) {
+		paths[i++] = (char *) path;
+		g_hash_table_iter_steal (&iter);
+	}
+
+	nm_log_dbg (LOGD_SUPPLICANT, "(%s): %u BSSs updated", priv->dev, i);
+	g_signal_emit (self, signals[BSS_UPDATED], 0, paths);
+	g_strfreev (paths);
+}
+
+static gboolean
+bss_updates_timeout (gpointer user_data)
+{
+	NMSupplicantInterface *self = NM_SUPPLICANT_INTERFACE (user_data);
+
+	NM_SUPPLICANT_INTERFACE_GET_PRIVATE (self)->bss_updates_id = 0;
+	flush_bss_updates (self);
+	return FALSE;
+}
+
+static DBusHandlerResult
+bss_signal_filter (DBusConnection *connection, DBusMessage *message, void *user_data)
 {
 	NMSupplicantInterface *self = NM_SUPPLICANT_INTERFACE (user_data);
 	NMSupplicantInterfacePrivate *priv = NM_SUPPLICANT_INTERFACE_GET_PRIVATE (self);
+	const char *path, *iface = NULL;
+
+	if (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_SIGNAL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	path = dbus_message_get_path (message);
+	if (!path || !priv->bss_prefix || !g_str_has_prefix (path, priv->bss_prefix))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	if (dbus_message_is_signal (message, DBUS_INTERFACE_PROPERTIES, "PropertiesChanged")) {
+		if (   !dbus_message_get_args (message, NULL, DBUS_TYPE_STRING, &iface, DBUS_TYPE_INVALID)
+		    || g_strcmp0 (iface, WPAS_DBUS_IFACE_BSS))
+			return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	} else if (!dbus_message_is_signal (message, WPAS_DBUS_IFACE_BSS, "PropertiesChanged"))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	if (!g_hash_table_lookup (priv->bss_paths, path))
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
 	if (priv->scanning)
 		priv->last_scan = time (NULL);
 
-	g_signal_emit (self, signals[BSS_UPDATED], 0, dbus_g_proxy_get_path (proxy), props);
+	/* Passed on once the scan is done */
+	if (!g_hash_table_lookup (priv->bss_updates, path))
+		g_hash_table_insert (priv->bss_updates, g_strdup (path), GUINT_TO_POINTER (TRUE));
+	if (!priv->bss_updates_id)
+		priv->bss_updates_id = g_timeout_add_seconds (BSS_UPDATES_DELAY, bss_updates_timeout, self);
+
+	/* Signals may be of interest to other filters too */
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static void
+add_bss_filter (NMSupplicantInterface *self)
+{
+	NMSupplicantInterfacePrivate *priv = NM_SUPPLICANT_INTERFACE_GET_PRIVATE (self);
+	DBusConnection *connection;
+
+	connection = dbus_g_connection_get_connection (nm_dbus_manager_get_connection (priv->dbus_mgr));
+	if (!dbus_connection_add_filter (connection, bss_signal_filter, self, NULL)) {
+		nm_log_warn (LOGD_SUPPLICANT, "(%s): couldn't add BSS signal filter", priv->dev);
+		return;
+	}
+
+	/* No error argument: don't block waiting for the bus */
+	dbus_bus_add_match (connection, WPAS_BSS_PROPS_MATCH, NULL);
+	dbus_bus_add_match (connection, WPAS_BSS_OLD_PROPS_MATCH, NULL);
+	priv->bss_filter = TRUE;
+}
+
+static void
+remove_bss_filter (NMSupplicantInterface *self)
+{
+	NMSupplicantInterfacePrivate *priv = NM_SUPPLICANT_INTERFACE_GET_PRIVATE (self);
+	DBusConnection *connection;
+
+	if (!priv->bss_filter)
+		return;
+	priv->bss_filter = FALSE;
+
+	connection = dbus_g_connection_get_connection (nm_dbus_manager_get_connection (priv->dbus_mgr));
+	dbus_connection_remove_filter (connection, bss_signal_filter, self);
+	dbus_bus_remove_match (connection, WPAS_BSS_PROPS_MATCH, NULL);
+	dbus_bus_remove_match (connection, WPAS_BSS_OLD_PROPS_MATCH, NULL);
 }
 
 static void
@@ -292,66 +646,21 @@ handle_new_bss (NMSupplicantInterface *self,
                 GHashTable *props)
 {
 	NMSupplicantInterfacePrivate *priv = NM_SUPPLICANT_INTERFACE_GET_PRIVATE (self);
-	NMSupplicantInfo *info;
-	DBusGProxyCall *call;
-	BssProxies *proxies;
 
 	g_return_if_fail (object_path != NULL);
 
-	if (g_hash_table_lookup (priv->bss_proxies, object_path))
+	if (g_hash_table_lookup (priv->bss_paths, object_path))
 		return;
 
-	proxies = g_malloc0 (sizeof (*proxies));
-	proxies->props = dbus_g_proxy_new_for_name (nm_dbus_manager_get_connection (priv->dbus_mgr),
-	                                            WPAS_DBUS_SERVICE,
-	                                            object_path,
-	                                            DBUS_INTERFACE_PROPERTIES);
-	proxies->old_props = dbus_g_proxy_new_for_name (nm_dbus_manager_get_connection (priv->dbus_mgr),
-	                                                WPAS_DBUS_SERVICE,
-	                                                object_path,
-	                                                WPAS_DBUS_IFACE_BSS);
-	g_hash_table_insert (priv->bss_proxies,
-	                     (gpointer) dbus_g_proxy_get_path (proxies->props),
-	                     proxies);
-
-	/* Standard D-Bus PropertiesChanged signal */
-	dbus_g_object_register_marshaller (_nm_marshal_VOID__STRING_BOXED_BOXED,
-	                                   G_TYPE_NONE,
-	                                   G_TYPE_STRING, DBUS_TYPE_G_MAP_OF_VARIANT, G_TYPE_STRV,
-	                                   G_TYPE_INVALID);
-	dbus_g_proxy_add_signal (proxies->props, "PropertiesChanged",
-	                         G_TYPE_STRING, DBUS_TYPE_G_MAP_OF_VARIANT, G_TYPE_STRV,
-	                         G_TYPE_INVALID);
-	dbus_g_proxy_connect_signal (proxies->props, "PropertiesChanged",
-	                             G_CALLBACK (bss_properties_changed),
-	                             self, NULL);
+	g_hash_table_insert (priv->bss_paths, g_strdup (object_path), GUINT_TO_POINTER (TRUE));
 
-	/* Old wpa_supplicant-specific PropertiesChanged signal; since it's using
-	 * a different interface, we have to use a different DBusGProxy
+	/* BSSAdded carries the properties; only paths learned from the
+	 * interface's BSSs property need a GetAll.
 	 */
-	dbus_g_object_register_marshaller (g_cclosure_marshal_VOID__BOXED,
-	                                   G_TYPE_NONE,
-	                                   DBUS_TYPE_G_MAP_OF_VARIANT,
-	                                   G_TYPE_INVALID);
-	dbus_g_proxy_add_signal (proxies->old_props, "PropertiesChanged",
-	                         DBUS_TYPE_G_MAP_OF_VARIANT,
-	                         G_TYPE_INVALID);
-	dbus_g_proxy_connect_signal (proxies->old_props, "PropertiesChanged",
-	                             G_CALLBACK (old_bss_properties_changed),
-	                             self, NULL);
-
-	if (props) {
+	if (props)
 		signal_new_bss (self, object_path, props);
-	} else {
-		info = nm_supplicant_info_new (self, proxies->props, priv->other_pcalls);
-		call = dbus_g_proxy_begin_call (proxies->props, "GetAll",
-		                                bssid_properties_cb,
-		                                info,
-		                                nm_supplicant_info_destroy,
-		                                G_TYPE_STRING, WPAS_DBUS_IFACE_BSS,
-		                                G_TYPE_INVALID);
-		nm_supplicant_info_set_call (info, call);
-	}
+	else
+		request_bss_props (self, object_path);
 }
 
 static void
@@ -377,9 +686,12 @@ wpas_iface_bss_removed (DBusGProxy *proxy,
 	NMSupplicantInterface *self = NM_SUPPLICANT_INTERFACE (user_data);
 	NMSupplicantInterfacePrivate *priv = NM_SUPPLICANT_INTERFACE_GET_PRIVATE (self);
 
+	g_hash_table_remove (priv->bss_updates, object_path);
+	g_hash_table_remove (priv->bss_pending, object_path);
+
 	g_signal_emit (self, signals[BSS_REMOVED], 0, object_path);
 
-	g_hash_table_remove (priv->bss_proxies, object_path);
+	g_hash_table_remove (priv->bss_paths, object_path);
 }
 
 static int
@@ -437,6 +749,14 @@ set_state (NMSupplicantInterface *self, guint32 new_state)
 		/* Cancel all pending calls when going down */
 		cancel_all_callbacks (priv->other_pcalls);
 		cancel_all_callbacks (priv->assoc_pcalls);
+		g_hash_table_remove_all (priv->bss_pending);
+
+		remove_bss_filter (self);
+		if (priv->bss_updates_id) {
+			g_source_remove (priv->bss_updates_id);
+			priv->bss_updates_id = 0;
+		}
+		g_hash_table_remove_all (priv->bss_updates);
 
 		/* Disconnect supplicant manager state listeners since we're done */
 		if (priv->smgr_avail_id) {
@@ -538,6 +858,10 @@ wpas_iface_scan_done (DBusGProxy *proxy,
 
 	/* Cache last scan completed time */
 	priv->last_scan = time (NULL);
+
+	/* Everything the scan changed goes out in one batch */
+	flush_bss_updates (self);
+
 	g_signal_emit (self, signals[SCAN_DONE], 0, success);
 }
 
@@ -849,6 +1173,8 @@ interface_add_done (NMSupplicantInterface *self, char *path)
 	nm_log_dbg (LOGD_SUPPLICANT, "(%s): interface added to supplicant", priv->dev);
 
 	priv->object_path = path;
+	priv->bss_prefix = g_strconcat (path, "/BSSs/", NULL);
+	add_bss_filter (self);
 
 	priv->iface_proxy = dbus_g_proxy_new_for_name (nm_dbus_manager_get_connection (priv->dbus_mgr),
 	                                               WPAS_DBUS_SERVICE,
@@ -1333,15 +1659,6 @@ scan_request_cb (DBusGProxy *proxy, DBusGProxyCall *call_id, gpointer user_data)
 	g_clear_error (&err);
 }
 
-static void
-destroy_gvalue (gpointer data)
-{
-	GValue *value = (GValue *) data;
-
-	g_value_unset (value);
-	g_slice_free (GValue, value);
-}
-
 static GValue *
 string_to_gvalue (const char *str)
 {
@@ -1532,7 +1849,9 @@ nm_supplicant_interface_init (NMSupplicantInterface * self)
 	                                              WPAS_DBUS_PATH,
 	                                              WPAS_DBUS_INTERFACE);
 
-	priv->bss_proxies = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, bss_proxies_free);
+	priv->bss_paths = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	priv->bss_pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, bss_pending_cancel);
+	priv->bss_updates = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
 static void
@@ -1578,6 +1897,11 @@ dispose (GObject *object)
 	/* Cancel pending calls before unrefing the dbus manager */
 	cancel_all_callbacks (priv->other_pcalls);
 	nm_call_store_destroy (priv->other_pcalls);
+	g_hash_table_destroy (priv->bss_pending);
+
+	remove_bss_filter (NM_SUPPLICANT_INTERFACE (object));
+	if (priv->bss_updates_id)
+		g_source_remove (priv->bss_updates_id);
 
 	cancel_all_callbacks (priv->assoc_pcalls);
 	nm_call_store_destroy (priv->assoc_pcalls);
@@ -1593,7 +1917,9 @@ dispose (GObject *object)
 	if (priv->wpas_proxy)
 		g_object_unref (priv->wpas_proxy);
 
-	g_hash_table_destroy (priv->bss_proxies);
+	g_hash_table_destroy (priv->bss_paths);
+	g_hash_table_destroy (priv->bss_updates);
+	g_free (priv->bss_prefix);
 
 	if (priv->smgr) {
 		if (priv->smgr_avail_id)
@@ -1668,8 +1994,8 @@ nm_supplicant_interface_class_init (NMSupplicantInterfaceClass *klass)
 		              G_SIGNAL_RUN_LAST,
 		              G_STRUCT_OFFSET (NMSupplicantInterfaceClass, bss_updated),
 		              NULL, NULL,
-		              _nm_marshal_VOID__STRING_POINTER,
-		              G_TYPE_NONE, 2, G_TYPE_STRING, G_TYPE_POINTER);
+		              g_cclosure_marshal_VOID__BOXED,
+		              G_TYPE_NONE, 1, G_TYPE_STRV);
 
 	signals[BSS_REMOVED] =
 		g_signal_new (NM_SUPPLICANT_INTERFACE_BSS_REMOVED,
@@ -93,10 +93,9 @@ typedef struct {
 	                          const char *object_path,
 	                          GHashTable *props);
 
-	/* a BSS property changed */
+	/* properties of these BSSs changed during the last scan */
 	void (*bss_updated)      (NMSupplicantInterface *iface,
-	                          const char *object_path,
-	                          GHashTable *props);
+	                          const char **object_paths);
 
 	/* supplicant removed a BSS from its scan list */
 	void (*bss_removed)      (NMSupplicantInterface *iface,
@@ -0,0 +1,296 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ *
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "nm-device-index.h"
+
+#define STARTUP_DEVICES 50
+#define STARTUP_DEVICES_PERF 5000
+
+typedef struct {
+	int ifindex;
+	char *udi;
+	char *path;
+	char *iface;
+	char *ip_iface;
+} FakeDevice;
+
+static FakeDevice *
+fake_device_new (int ifindex, const char *iface)
+{
+	FakeDevice *dev = g_new0 (FakeDevice, 1);
+
+	dev->ifindex = ifindex;
+	dev->iface = g_strdup (iface);
+	dev->ip_iface = g_strdup (iface);
+	dev->udi = g_strdup_printf ("/sys/devices/virtual/net/%s", iface);
+	return dev;
+}
+
+static void
+fake_device_free (FakeDevice *dev)
+{
+	g_free (dev->udi);
+	g_free (dev->path);
+	g_free (dev->iface);
+	g_free (dev->ip_iface);
+	g_free (dev);
+}
+
+static void
+index_add (NMDeviceIndex *index, FakeDevice *dev)
+{
+	nm_device_index_add (index, dev, dev->ifindex, dev->udi, dev->path, dev->iface, dev->ip_iface);
+}
+
+static void
+index_update (NMDeviceIndex *index, FakeDevice *dev)
+{
+	nm_device_index_update (index, dev, dev->ifindex, dev->udi, dev->path, dev->iface, dev->ip_iface);
+}
+
+/*******************************************/
+
+static void
+test_device_index_lookup (void)
+{
+	NMDeviceIndex *index;
+	FakeDevice *eth0, *eth1, *modem;
+	GSList *list;
+
+	index = nm_device_index_new ();
+
+	eth0 = fake_device_new (2, "eth0");
+	eth1 = fake_device_new (3, "eth1");
+	index_add (index, eth0);
+	index_add (index, eth1);
+	g_assert_cmpint (nm_device_index_size (index), ==, 2);
+
+	g_assert (nm_device_index_lookup_ifindex (index, 2) == eth0);
+	g_assert (nm_device_index_lookup_ifindex (index, 3) == eth1);
+	g_assert (nm_device_index_lookup_ifindex (index, 4) == NULL);
+	g_assert (nm_device_index_lookup_udi (index, "/sys/devices/virtual/net/eth1") == eth1);
+	g_assert (nm_device_index_lookup_ip_iface (index, "eth0") == eth0);
+	g_assert (nm_device_index_lookup_ip_iface (index, NULL) == NULL);
+
+	/* Not exported yet */
+	g_assert (nm_device_index_lookup_path (index, "/org/freedesktop/NetworkManager/Devices/0") == NULL);
+	eth0->path = g_strdup ("/org/freedesktop/NetworkManager/Devices/0");
+	index_update (index, eth0);
+	g_assert (nm_device_index_lookup_path (index, "/org/freedesktop/NetworkManager/Devices/0") == eth0);
+
+	/* A modem without kernel interface claiming eth1 as its IP interface;
+	 * the device registered first still wins.
+	 */
+	modem = fake_device_new (0, "ttyUSB0");
+	g_free (modem->ip_iface);
+	modem->ip_iface = g_strdup ("eth1");
+	index_add (index, modem);
+	g_assert (nm_device_index_lookup_ifindex (index, 0) == NULL);
+	g_assert (nm_device_index_lookup_ip_iface (index, "eth1") == eth1);
+
+	list = nm_device_index_lookup_iface (index, "ttyUSB0");
+	g_assert_cmpint (g_slist_length (list), ==, 1);
+	g_assert (list->data == modem);
+	g_slist_free (list);
+
+	nm_device_index_remove (index, eth1);
+	g_assert (nm_device_index_lookup_ip_iface (index, "eth1") == modem);
+	g_assert (nm_device_index_lookup_ifindex (index, 3) == NULL);
+	g_assert (nm_device_index_lookup_iface (index, "eth1") == NULL);
+
+	/* IP interface change */
+	g_free (modem->ip_iface);
+	modem->ip_iface = g_strdup ("ppp0");
+	index_update (index, modem);
+	g_assert (nm_device_index_lookup_ip_iface (index, "eth1") == NULL);
+	g_assert (nm_device_index_lookup_ip_iface (index, "ppp0") == modem);
+
+	g_assert_cmpint (nm_device_index_size (index), ==, 2);
+	nm_device_index_free (index);
+
+	fake_device_free (eth0);
+	fake_device_free (eth1);
+	fake_device_free (modem);
+}
+
+/*******************************************/
+
+/* What the manager did before: scan the device list for every lookup */
+static FakeDevice *
+scan_by_ifindex (GSList *devices, int ifindex)
+{
+	for (; devices; devices = devices->next) {
+		FakeDevice *dev = devices->data;
+
+		if (dev->ifindex == ifindex)
+			return dev;
+	}
+	return NULL;
+}
+
+static FakeDevice *
+scan_by_ip_iface (GSList *devices, const char *ip_iface)
+{
+	for (; devices; devices = devices->next) {
+		FakeDevice *dev = devices->data;
+
+		if (g_strcmp0 (dev->ip_iface, ip_iface) == 0)
+			return dev;
+	}
+	return NULL;
+}
+
+static FakeDevice **
+make_startup_devices (int num)
+{
+	FakeDevice **devs;
+	int i;
+
+	devs = g_new0 (FakeDevice *, num);
+	for (i = 0; i < num; i++) {
+		char *iface = g_strdup_printf ("veth%d", i);
+
+		devs[i] = fake_device_new (i + 1, iface);
+		devs[i]->path = g_strdup_printf ("/org/freedesktop/NetworkManager/Devices/%d", i);
+		g_free (iface);
+	}
+	return devs;
+}
+
+static void
+free_startup_devices (FakeDevice **devs, int num)
+{
+	int i;
+
+	for (i = 0; i < num; i++)
+		fake_device_free (devs[i]);
+	g_free (devs);
+}
+
+/* Replays what happens for each interface udev reports at startup:
+ * udev_device_added_cb() checks the ifindex, add_device() checks the IP
+ * interface, and the device is then exported on D-Bus.
+ */
+static void
+add_startup_devices (NMDeviceIndex *index, FakeDevice **devs, int num)
+{
+	int i;
+
+	for (i = 0; i < num; i++) {
+		g_assert (nm_device_index_lookup_ifindex (index, devs[i]->ifindex) == NULL);
+		g_assert (nm_device_index_lookup_ip_iface (index, devs[i]->ip_iface) == NULL);
+		index_add (index, devs[i]);
+		index_update (index, devs[i]);
+	}
+}
+
+static void
+test_device_index_startup (void)
+{
+	NMDeviceIndex *index;
+	FakeDevice **devs;
+	GSList *list = NULL;
+	int i;
+
+	devs = make_startup_devices (STARTUP_DEVICES);
+	for (i = 0; i < STARTUP_DEVICES; i++)
+		list = g_slist_append (list, devs[i]);
+
+	index = nm_device_index_new ();
+	add_startup_devices (index, devs, STARTUP_DEVICES);
+
+	/* Same answers as the list scan */
+	g_assert_cmpint (nm_device_index_size (index), ==, STARTUP_DEVICES);
+	for (i = 0; i < STARTUP_DEVICES; i++) {
+		g_assert (nm_device_index_lookup_path (index, devs[i]->path) == devs[i]);
+		g_assert (nm_device_index_lookup_ifindex (index, devs[i]->ifindex) == scan_by_ifindex (list, devs[i]->ifindex));
+		g_assert (nm_device_index_lookup_ip_iface (index, devs[i]->ip_iface) == scan_by_ip_iface (list, devs[i]->ip_iface));
+	}
+	g_assert (nm_device_index_lookup_ifindex (index, STARTUP_DEVICES + 1) == NULL);
+
+	nm_device_index_free (index);
+	g_slist_free (list);
+	free_startup_devices (devs, STARTUP_DEVICES);
+}
+
+static void
+test_device_index_startup_perf (void)
+{
+	NMDeviceIndex *index;
+	FakeDevice **devs;
+	GSList *list = NULL;
+	GTimer *timer;
+	double t_scan, t_index;
+	int i;
+
+	devs = make_startup_devices (STARTUP_DEVICES_PERF);
+
+	timer = g_timer_new ();
+	for (i = 0; i < STARTUP_DEVICES_PERF; i++) {
+		g_assert (scan_by_ifindex (list, devs[i]->ifindex) == NULL);
+		g_assert (scan_by_ip_iface (list, devs[i]->ip_iface) == NULL);
+		list = g_slist_append (list, devs[i]);
+	}
+	t_scan = g_timer_elapsed (timer, NULL);
+
+	index = nm_device_index_new ();
+	g_timer_start (timer);
+	add_startup_devices (index, devs, STARTUP_DEVICES_PERF);
+	t_index = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	g_assert_cmpint (nm_device_index_size (index), ==, STARTUP_DEVICES_PERF);
+
+	g_test_message ("%d devices: list scan %.1f ms, indexed %.1f ms",
+	                STARTUP_DEVICES_PERF, t_scan * 1000, t_index * 1000);
+
+	nm_device_index_free (index);
+	g_slist_free (list);
+	free_startup_devices (devs, STARTUP_DEVICES_PERF);
+}
+
+/*******************************************/
+
+#if GLIB_CHECK_VERSION(2,25,12)
+typedef GTestFixtureFunc TCFunc;
+#else
+typedef void (*TCFunc)(void);
+#endif
+
+#define TESTCASE(t, d) g_test_create_case (#t, 0, d, NULL, (TCFunc) t, NULL)
+
+int main (int argc, char **argv)
+{
+	GTestSuite *suite;
+
+	g_test_init (&argc, &argv, NULL);
+
+	suite = g_test_get_root ();
+
+	g_test_suite_add (suite, TESTCASE (test_device_index_lookup, NULL));
+	g_test_suite_add (suite, TESTCASE (test_device_index_startup, NULL));
+	if (g_test_perf ())
+		g_test_suite_add (suite, TESTCASE (test_device_index_startup_perf, NULL));
+
+	return g_test_run ();
+}
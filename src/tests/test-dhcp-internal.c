@@ -0,0 +1,488 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ *
+ */
+
+#include <glib.h>
+#include <dbus/dbus-glib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
+
+#include "nm-test-helpers.h"
+#include <nm-utils.h>
+
+#include "nm-dhcp-manager.h"
+#include "nm-dhcp-packet.h"
+
+static const guint8 client_mac[ETH_ALEN] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 };
+
+static guint32
+addr (const char *str)
+{
+	struct in_addr tmp;
+
+	g_assert (inet_pton (AF_INET, str, &tmp) > 0);
+	return tmp.s_addr;
+}
+
+static void
+add_addr_option (GByteArray *packet, guint8 code, const char *str)
+{
+	guint32 a = addr (str);
+
+	nm_dhcp_packet_add_option (packet, code, &a, 4);
+}
+
+static GByteArray *
+make_ack (guint32 xid)
+{
+	static const guint8 classless[] = {
+		0,                                  /* default route */
+		192, 168, 1, 254,
+		24, 10, 0, 0,                       /* 10.0.0.0/24 */
+		192, 168, 1, 2,
+	};
+	/* "example.com", then "eng.example.com" pointing back at it */
+	static const guint8 search[] = {
+		7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0,
+		3, 'e', 'n', 'g', 0xC0, 0x00,
+	};
+	GByteArray *packet;
+	guint32 dns[2];
+
+	packet = nm_dhcp_packet_new (NM_DHCP_OP_REPLY, NM_DHCP_MSG_ACK, xid,
+	                             client_mac, sizeof (client_mac),
+	                             0, addr ("192.168.1.106"));
+	add_addr_option (packet, NM_DHCP_OPTION_SUBNET_MASK, "255.255.255.0");
+	add_addr_option (packet, NM_DHCP_OPTION_SERVER_ID, "192.168.1.1");
+	add_addr_option (packet, NM_DHCP_OPTION_ROUTER, "192.168.1.1");
+	nm_dhcp_packet_add_option_u32 (packet, NM_DHCP_OPTION_LEASE_TIME, 3600);
+
+	/* Split in two (RFC 3396) */
+	dns[0] = addr ("192.168.1.10");
+	dns[1] = addr ("192.168.1.11");
+	nm_dhcp_packet_add_option (packet, NM_DHCP_OPTION_DNS_SERVER, &dns[0], 4);
+	nm_dhcp_packet_add_option (packet, NM_DHCP_OPTION_DNS_SERVER, &dns[1], 4);
+
+	nm_dhcp_packet_add_option (packet, NM_DHCP_OPTION_DOMAIN_NAME, "example.com", 11);
+	nm_dhcp_packet_add_option (packet, NM_DHCP_OPTION_CLASSLESS_ROUTE, classless, sizeof (classless));
+	nm_dhcp_packet_add_option (packet, NM_DHCP_OPTION_DOMAIN_SEARCH, search, sizeof (search));
+	nm_dhcp_packet_end (packet);
+	return packet;
+}
+
+static void
+test_packet_parse (void)
+{
+	GByteArray *packet;
+	NMDHCPMessageType type;
+	NMDHCPLease *lease = NULL;
+	guint8 other_mac[ETH_ALEN] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x66 };
+	NMDHCPRoute *route;
+
+	packet = make_ack (0x12345678);
+
+	ASSERT (nm_dhcp_packet_parse (packet->data, packet->len, NM_DHCP_OP_REPLY, 0x12345678,
+	                              client_mac, sizeof (client_mac), &type, &lease) == TRUE,
+	        "dhcp-packet-parse", "failed to parse ACK");
+	ASSERT (type == NM_DHCP_MSG_ACK, "dhcp-packet-parse", "unexpected message type %d", type);
+	ASSERT (lease != NULL, "dhcp-packet-parse", "no lease");
+
+	ASSERT (lease->address == addr ("192.168.1.106"), "dhcp-packet-parse", "unexpected address");
+	ASSERT (lease->netmask == addr ("255.255.255.0"), "dhcp-packet-parse", "unexpected netmask");
+	ASSERT (lease->server_id == addr ("192.168.1.1"), "dhcp-packet-parse", "unexpected server ID");
+	ASSERT (lease->lease_time == 3600, "dhcp-packet-parse", "unexpected lease time %u", lease->lease_time);
+	ASSERT (lease->dns_servers->len == 2, "dhcp-packet-parse",
+	        "unexpected number of nameservers %u", lease->dns_servers->len);
+	ASSERT (g_array_index (lease->dns_servers, guint32, 1) == addr ("192.168.1.11"),
+	        "dhcp-packet-parse", "unexpected second nameserver");
+	ASSERT (strcmp (lease->domain_name, "example.com") == 0,
+	        "dhcp-packet-parse", "unexpected domain name '%s'", lease->domain_name);
+
+	ASSERT (lease->domain_search && g_strv_length (lease->domain_search) == 2,
+	        "dhcp-packet-parse", "unexpected domain search list");
+	ASSERT (strcmp (lease->domain_search[1], "eng.example.com") == 0,
+	        "dhcp-packet-parse", "unexpected compressed search domain '%s'", lease->domain_search[1]);
+
+	ASSERT (lease->classless == TRUE, "dhcp-packet-parse", "classless routes not found");
+	ASSERT (lease->routes->len == 2, "dhcp-packet-parse",
+	        "unexpected number of routes %u", lease->routes->len);
+	route = &g_array_index (lease->routes, NMDHCPRoute, 1);
+	ASSERT (route->dest == addr ("10.0.0.0") && route->prefix == 24 && route->gateway == addr ("192.168.1.2"),
+	        "dhcp-packet-parse", "unexpected classless route");
+	nm_dhcp_lease_free (lease);
+
+	/* Replies to somebody else */
+	ASSERT (nm_dhcp_packet_parse (packet->data, packet->len, NM_DHCP_OP_REPLY, 0x12345679,
+	                              client_mac, sizeof (client_mac), &type, NULL) == FALSE,
+	        "dhcp-packet-parse", "accepted wrong transaction ID");
+	ASSERT (nm_dhcp_packet_parse (packet->data, packet->len, NM_DHCP_OP_REPLY, 0x12345678,
+	                              other_mac, sizeof (other_mac), &type, NULL) == FALSE,
+	        "dhcp-packet-parse", "accepted wrong hardware address");
+	ASSERT (nm_dhcp_packet_parse (packet->data, packet->len, NM_DHCP_OP_REQUEST, 0x12345678,
+	                              client_mac, sizeof (client_mac), &type, NULL) == FALSE,
+	        "dhcp-packet-parse", "accepted wrong operation");
+
+	/* Truncated in the middle of the options */
+	ASSERT (nm_dhcp_packet_parse (packet->data, 245, NM_DHCP_OP_REPLY, 0x12345678,
+	                              client_mac, sizeof (client_mac), &type, NULL) == FALSE,
+	        "dhcp-packet-parse", "accepted truncated message");
+
+	g_byte_array_free (packet, TRUE);
+}
+
+static void
+test_packet_udp (void)
+{
+	GByteArray *packet, *datagram;
+	const guint8 *payload;
+	gsize payload_len;
+
+	packet = make_ack (1);
+	datagram = nm_dhcp_packet_wrap_udp (packet, addr ("192.168.1.1"), NM_DHCP_SERVER_PORT,
+	                                    INADDR_BROADCAST, NM_DHCP_CLIENT_PORT);
+
+	ASSERT (nm_dhcp_packet_unwrap_udp (datagram->data, datagram->len, NM_DHCP_CLIENT_PORT,
+	                                   &payload, &payload_len) == TRUE,
+	        "dhcp-packet-udp", "failed to unwrap datagram");
+	ASSERT (payload_len == packet->len && memcmp (payload, packet->data, packet->len) == 0,
+	        "dhcp-packet-udp", "payload differs");
+
+	ASSERT (nm_dhcp_packet_unwrap_udp (datagram->data, datagram->len, NM_DHCP_SERVER_PORT,
+	                                   &payload, &payload_len) == FALSE,
+	        "dhcp-packet-udp", "accepted wrong port");
+
+	/* Corrupt the payload; the UDP checksum must catch it */
+	datagram->data[datagram->len - 1] ^= 0x01;
+	ASSERT (nm_dhcp_packet_unwrap_udp (datagram->data, datagram->len, NM_DHCP_CLIENT_PORT,
+	                                   &payload, &payload_len) == FALSE,
+	        "dhcp-packet-udp", "accepted bad checksum");
+
+	g_byte_array_free (datagram, TRUE);
+	g_byte_array_free (packet, TRUE);
+}
+
+static void
+test_lease_to_config (void)
+{
+	GByteArray *packet;
+	NMDHCPMessageType type;
+	NMDHCPLease *lease = NULL;
+	NMIP4Config *config;
+	NMIP4Address *address;
+	NMIP4Route *route;
+
+	packet = make_ack (1);
+	ASSERT (nm_dhcp_packet_parse (packet->data, packet->len, NM_DHCP_OP_REPLY, 1,
+	                              client_mac, sizeof (client_mac), &type, &lease) == TRUE,
+	        "dhcp-lease-to-config", "failed to parse ACK");
+
+	config = nm_dhcp_lease_to_ip4_config (lease, "eth0");
+	ASSERT (config != NULL, "dhcp-lease-to-config", "failed to convert lease");
+
+	address = nm_ip4_config_get_address (config, 0);
+	ASSERT (nm_ip4_address_get_address (address) == addr ("192.168.1.106"),
+	        "dhcp-lease-to-config", "unexpected address");
+	ASSERT (nm_ip4_address_get_prefix (address) == 24,
+	        "dhcp-lease-to-config", "unexpected prefix");
+
+	/* The classless default route wins over the router option */
+	ASSERT (nm_ip4_address_get_gateway (address) == addr ("192.168.1.254"),
+	        "dhcp-lease-to-config", "unexpected gateway");
+
+	ASSERT (nm_ip4_config_get_num_routes (config) == 1,
+	        "dhcp-lease-to-config", "unexpected number of routes");
+	route = nm_ip4_config_get_route (config, 0);
+	ASSERT (nm_ip4_route_get_dest (route) == addr ("10.0.0.0"),
+	        "dhcp-lease-to-config", "unexpected route destination");
+
+	ASSERT (nm_ip4_config_get_num_nameservers (config) == 2,
+	        "dhcp-lease-to-config", "unexpected number of nameservers");
+	ASSERT (nm_ip4_config_get_num_searches (config) == 2,
+	        "dhcp-lease-to-config", "unexpected number of search domains");
+
+	g_object_unref (config);
+	nm_dhcp_lease_free (lease);
+	g_byte_array_free (packet, TRUE);
+}
+
+/*******************************************/
+
+/* A fake DHCP server on one end of a veth pair, the internal client on
+ * the other.  It needs root and changes the host's interfaces, so it only
+ * runs when asked for with NM_TEST_DHCP_VETH=1, not from 'make check'.
+ */
+#define VETH_ENV "NM_TEST_DHCP_VETH"
+
+typedef struct {
+	GMainLoop *loop;
+	int fd;
+	int ifindex;
+	guint n_offers;
+	guint n_acks;
+	NMDHCPState state;
+} FakeServer;
+
+static void
+server_reply (FakeServer *server, NMDHCPMessageType type, guint32 xid, const guint8 *chaddr)
+{
+	GByteArray *packet, *datagram;
+	struct sockaddr_ll sll;
+
+	packet = nm_dhcp_packet_new (NM_DHCP_OP_REPLY, type, xid, chaddr, ETH_ALEN,
+	                             0, addr ("10.99.0.50"));
+	add_addr_option (packet, NM_DHCP_OPTION_SERVER_ID, "10.99.0.1");
+	add_addr_option (packet, NM_DHCP_OPTION_SUBNET_MASK, "255.255.255.0");
+	add_addr_option (packet, NM_DHCP_OPTION_ROUTER, "10.99.0.1");
+	add_addr_option (packet, NM_DHCP_OPTION_DNS_SERVER, "10.99.0.2");
+	nm_dhcp_packet_add_option_u32 (packet, NM_DHCP_OPTION_LEASE_TIME, 600);
+	nm_dhcp_packet_end (packet);
+
+	datagram = nm_dhcp_packet_wrap_udp (packet, addr ("10.99.0.1"), NM_DHCP_SERVER_PORT,
+	                                    INADDR_BROADCAST, NM_DHCP_CLIENT_PORT);
+
+	memset (&sll, 0, sizeof (sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons (ETH_P_IP);
+	sll.sll_ifindex = server->ifindex;
+	sll.sll_halen = ETH_ALEN;
+	memset (sll.sll_addr, 0xff, ETH_ALEN);
+	g_assert (sendto (server->fd, datagram->data, datagram->len, 0,
+	                  (struct sockaddr *) &sll, sizeof (sll)) >= 0);
+
+	g_byte_array_free (datagram, TRUE);
+	g_byte_array_free (packet, TRUE);
+}
+
+static gboolean
+server_cb (GIOChannel *channel, GIOCondition condition, gpointer user_data)
+{
+	FakeServer *server = user_data;
+	guint8 buf[2048];
+	const guint8 *payload;
+	gsize payload_len;
+	NMDHCPMessageType type;
+	guint32 xid;
+	ssize_t len;
+
+	len = recv (server->fd, buf, sizeof (buf), 0);
+	if (len <= 0)
+		return TRUE;
+	if (!nm_dhcp_packet_unwrap_udp (buf, len, NM_DHCP_SERVER_PORT, &payload, &payload_len))
+		return TRUE;
+	if (payload_len < 44)
+		return TRUE;
+
+	/* Answer whoever is asking */
+	memcpy (&xid, payload + 4, 4);
+	xid = ntohl (xid);
+	if (!nm_dhcp_packet_parse (payload, payload_len, NM_DHCP_OP_REQUEST, xid,
+	                           NULL, 0, &type, NULL))
+		return TRUE;
+
+	if (type == NM_DHCP_MSG_DISCOVER) {
+		server->n_offers++;
+		server_reply (server, NM_DHCP_MSG_OFFER, xid, payload + 28);
+	} else if (type == NM_DHCP_MSG_REQUEST) {
+		server->n_acks++;
+		server_reply (server, NM_DHCP_MSG_ACK, xid, payload + 28);
+	}
+	return TRUE;
+}
+
+static void
+client_state_changed (NMDHCPClient *client, NMDHCPState state, gpointer user_data)
+{
+	FakeServer *server = user_data;
+
+	server->state = state;
+	if (state == DHC_BOUND4 || state == DHC_FAIL || state == DHC_TIMEOUT)
+		g_main_loop_quit (server->loop);
+}
+
+static gboolean
+loop_timeout (gpointer user_data)
+{
+	g_main_loop_quit (((FakeServer *) user_data)->loop);
+	return FALSE;
+}
+
+static GByteArray *
+read_hwaddr (const char *iface)
+{
+	char *path, *contents = NULL;
+	GByteArray *hwaddr = NULL;
+	guint8 buf[ETH_ALEN];
+
+	path = g_strdup_printf ("/sys/class/net/%s/address", iface);
+	if (g_file_get_contents (path, &contents, NULL, NULL)) {
+		g_strstrip (contents);
+		if (nm_utils_hwaddr_aton (contents, ARPHRD_ETHER, buf)) {
+			hwaddr = g_byte_array_sized_new (ETH_ALEN);
+			g_byte_array_append (hwaddr, buf, ETH_ALEN);
+		}
+	}
+	g_free (contents);
+	g_free (path);
+	return hwaddr;
+}
+
+static gboolean
+run_ip (const char *fmt, ...)
+{
+	va_list args;
+	char *cmd;
+	int status = -1;
+	gboolean success;
+
+	va_start (args, fmt);
+	cmd = g_strdup_vprintf (fmt, args);
+	va_end (args);
+
+	success =    g_spawn_command_line_sync (cmd, NULL, NULL, &status, NULL)
+	          && WIFEXITED (status)
+	          && WEXITSTATUS (status) == 0;
+	g_free (cmd);
+	return success;
+}
+
+static void
+test_veth_lease (void)
+{
+	char veth_client[IFNAMSIZ], veth_server[IFNAMSIZ];
+	NMDHCPManager *manager;
+	NMDHCPClient *client;
+	FakeServer server;
+	struct sockaddr_ll sll;
+	GIOChannel *channel;
+	GByteArray *hwaddr;
+	NMIP4Config *config;
+	GError *error = NULL;
+	guint io_id;
+
+	if (g_strcmp0 (g_getenv (VETH_ENV), "1") != 0) {
+		fprintf (stdout, "dhcp-veth-lease: skipped (set " VETH_ENV "=1 to run)\n");
+		return;
+	}
+	if (getuid () != 0) {
+		fprintf (stdout, "dhcp-veth-lease: skipped (needs root)\n");
+		return;
+	}
+
+	/* Names of our own, so parallel runs don't trip over each other */
+	snprintf (veth_client, sizeof (veth_client), "nmdt%u-c", (guint) getpid () % 100000);
+	snprintf (veth_server, sizeof (veth_server), "nmdt%u-s", (guint) getpid () % 100000);
+	if (   !run_ip ("ip link add %s type veth peer name %s", veth_client, veth_server)
+	    || !run_ip ("ip link set %s up", veth_client)
+	    || !run_ip ("ip link set %s up", veth_server)) {
+		run_ip ("ip link del %s", veth_client);
+		fprintf (stdout, "dhcp-veth-lease: skipped (could not create veth pair)\n");
+		return;
+	}
+
+	memset (&server, 0, sizeof (server));
+	server.loop = g_main_loop_new (NULL, FALSE);
+	server.ifindex = if_nametoindex (veth_server);
+	server.fd = socket (AF_PACKET, SOCK_DGRAM, htons (ETH_P_IP));
+	ASSERT (server.fd >= 0, "dhcp-veth-lease", "could not create server socket");
+	memset (&sll, 0, sizeof (sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons (ETH_P_IP);
+	sll.sll_ifindex = server.ifindex;
+	ASSERT (bind (server.fd, (struct sockaddr *) &sll, sizeof (sll)) == 0,
+	        "dhcp-veth-lease", "could not bind server socket");
+	channel = g_io_channel_unix_new (server.fd);
+	io_id = g_io_add_watch (channel, G_IO_IN, server_cb, &server);
+	g_io_channel_unref (channel);
+
+	manager = nm_dhcp_manager_new ("internal", &error);
+	ASSERT (manager != NULL && error == NULL,
+	        "dhcp-veth-lease", "could not create DHCP manager: %s",
+	        error ? error->message : "(none)");
+
+	hwaddr = read_hwaddr (veth_client);
+	ASSERT (hwaddr != NULL, "dhcp-veth-lease", "could not read hardware address");
+
+	client = nm_dhcp_manager_start_ip4 (manager, veth_client, hwaddr,
+	                                    "d7a6e1a0-5ae6-4d53-9a1c-1e1d8e5d0a0b",
+	                                    NULL, 20, NULL);
+	ASSERT (client != NULL, "dhcp-veth-lease", "could not start DHCP client");
+	g_signal_connect (client, "state-changed", G_CALLBACK (client_state_changed), &server);
+
+	g_timeout_add_seconds (20, loop_timeout, &server);
+	g_main_loop_run (server.loop);
+
+	ASSERT (server.state == DHC_BOUND4, "dhcp-veth-lease",
+	        "client did not bind (state %d)", server.state);
+	ASSERT (server.n_offers >= 1 && server.n_acks >= 1,
+	        "dhcp-veth-lease", "unexpected exchange: %u offers, %u acks",
+	        server.n_offers, server.n_acks);
+
+	config = nm_dhcp_client_get_ip4_config (client, TRUE);
+	ASSERT (config != NULL, "dhcp-veth-lease", "no IPv4 config");
+	ASSERT (nm_ip4_address_get_address (nm_ip4_config_get_address (config, 0)) == addr ("10.99.0.50"),
+	        "dhcp-veth-lease", "unexpected address");
+	ASSERT (nm_ip4_address_get_gateway (nm_ip4_config_get_address (config, 0)) == addr ("10.99.0.1"),
+	        "dhcp-veth-lease", "unexpected gateway");
+	ASSERT (nm_ip4_config_get_num_nameservers (config) == 1,
+	        "dhcp-veth-lease", "unexpected number of nameservers");
+	g_object_unref (config);
+
+	nm_dhcp_client_stop (client, TRUE);
+	g_object_unref (client);
+	g_object_unref (manager);
+
+	g_source_remove (io_id);
+	close (server.fd);
+	g_main_loop_unref (server.loop);
+	g_byte_array_free (hwaddr, TRUE);
+	if (!run_ip ("ip link del %s", veth_client))
+		fprintf (stdout, "dhcp-veth-lease: could not remove %s\n", veth_client);
+}
+
+int main (int argc, char **argv)
+{
+	GError *error = NULL;
+	char *base;
+
+	g_type_init ();
+
+	if (!nm_utils_init (&error))
+		FAIL ("nm-utils-init", "failed to initialize libnm-util: %s", error->message);
+
+	test_packet_parse ();
+	test_packet_udp ();
+	test_lease_to_config ();
+	test_veth_lease ();
+
+	base = g_path_get_basename (argv[0]);
+	fprintf (stdout, "%s: SUCCESS\n", base);
+	g_free (base);
+	return 0;
+}
@@ -29,49 +29,22 @@
 #include <nm-utils.h>
 
 #include "nm-dhcp-manager.h"
+#include "nm-dhcp-event.h"
 
 typedef struct {
 	const char *name;
 	const char *value;
 } Option;
 
-static void
-destroy_gvalue (gpointer data)
-{
-	GValue *value = (GValue *) data;
-
-	g_value_unset (value);
-	g_slice_free (GValue, value);
-}
-
-static GValue *
-string_to_byte_array_gvalue (const char *str)
-{
-	GByteArray *array;
-	GValue *val;
-
-	array = g_byte_array_sized_new (strlen (str));
-	g_byte_array_append (array, (const guint8 *) str, strlen (str));
-
-	val = g_slice_new0 (GValue);
-	g_value_init (val, DBUS_TYPE_G_UCHAR_ARRAY);
-	g_value_take_boxed (val, array);
-
-	return val;
-}
-
 static GHashTable *
 fill_table (Option *test_options, GHashTable *table)
 {
 	Option *opt;
 
 	if (!table)
-		table = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, destroy_gvalue);
-	for (opt = test_options; opt->name; opt++) {
-		g_hash_table_insert (table,
-		                     (gpointer) opt->name,
-		                     string_to_byte_array_gvalue (opt->value));
-	}
+		table = g_hash_table_new (g_str_hash, g_str_equal);
+	for (opt = test_options; opt->name; opt++)
+		g_hash_table_insert (table, (gpointer) opt->name, (gpointer) opt->value);
 	return table;
 }
 
@@ -721,7 +694,7 @@ test_ip4_missing_prefix (const char *client, const char *ip, guint32 expected_pr
 	NMIP4Address *addr;
 
 	options = fill_table (generic_options, NULL);
-	g_hash_table_insert (options, "new_ip_address", string_to_byte_array_gvalue (ip));
+	g_hash_table_insert (options, "new_ip_address", (gpointer) ip);
 	g_hash_table_remove (options, "new_subnet_mask");
 
 	ip4_config = nm_dhcp_manager_test_ip4_options_to_config (client, "eth0", options, "rebind");
@@ -755,8 +728,8 @@ test_ip4_prefix_classless (const char *client)
 	 */
 
 	options = fill_table (generic_options, NULL);
-	g_hash_table_insert (options, "new_ip_address", string_to_byte_array_gvalue ("172.16.54.22"));
-	g_hash_table_insert (options, "new_subnet_mask", string_to_byte_array_gvalue ("255.255.252.0"));
+	g_hash_table_insert (options, "new_ip_address", "172.16.54.22");
+	g_hash_table_insert (options, "new_subnet_mask", "255.255.252.0");
 
 	ip4_config = nm_dhcp_manager_test_ip4_options_to_config (client, "eth0", options, "rebind");
 	ASSERT (ip4_config != NULL,
@@ -776,6 +749,60 @@ test_ip4_prefix_classless (const char *client)
 	g_hash_table_destroy (options);
 }
 
+static void
+test_event_parse (void)
+{
+	static const char event[] = NM_DHCP_EVENT_MAGIC "\0"
+	                            "interface=eth0\0"
+	                            "pid=1234\0"
+	                            "reason=BOUND\0"
+	                            "new_domain_name=caf\xc3\xa9.example.com\0"
+	                            "new_nis_domain=\0";
+	GHashTable *options;
+	GError *error = NULL;
+
+	options = nm_dhcp_event_parse (event, sizeof (event) - 1, &error);
+	ASSERT (options != NULL,
+	        "dhcp-event-parse", "failed to parse event: %s", error ? error->message : "(none)");
+
+	ASSERT (g_hash_table_size (options) == 5,
+	        "dhcp-event-parse", "unexpected number of options %d", g_hash_table_size (options));
+	ASSERT (strcmp (g_hash_table_lookup (options, "interface"), "eth0") == 0,
+	        "dhcp-event-parse", "unexpected interface");
+	ASSERT (strcmp (g_hash_table_lookup (options, "pid"), "1234") == 0,
+	        "dhcp-event-parse", "unexpected pid");
+
+	/* Non-ASCII characters are replaced */
+	ASSERT (strcmp (g_hash_table_lookup (options, "new_domain_name"), "caf??.example.com") == 0,
+	        "dhcp-event-parse", "unexpected domain name '%s'",
+	        (char *) g_hash_table_lookup (options, "new_domain_name"));
+	ASSERT (strcmp (g_hash_table_lookup (options, "new_nis_domain"), "") == 0,
+	        "dhcp-event-parse", "unexpected NIS domain");
+
+	g_hash_table_destroy (options);
+}
+
+static void
+test_event_parse_invalid (void)
+{
+	static const char bad_magic[] = "NMDHCP0\0interface=eth0\0";
+	static const char truncated[] = NM_DHCP_EVENT_MAGIC "\0interface=eth0\0pid=12";
+	static const char no_value[] = NM_DHCP_EVENT_MAGIC "\0interface=eth0\0reason\0";
+	GError *error = NULL;
+
+	ASSERT (nm_dhcp_event_parse (bad_magic, sizeof (bad_magic) - 1, &error) == NULL,
+	        "dhcp-event-parse-invalid", "accepted event with bad magic");
+	g_clear_error (&error);
+
+	ASSERT (nm_dhcp_event_parse (truncated, sizeof (truncated) - 1, &error) == NULL,
+	        "dhcp-event-parse-invalid", "accepted truncated event");
+	g_clear_error (&error);
+
+	ASSERT (nm_dhcp_event_parse (no_value, sizeof (no_value) - 1, &error) == NULL,
+	        "dhcp-event-parse-invalid", "accepted option without value");
+	g_clear_error (&error);
+}
+
 int main (int argc, char **argv)
 {
 	GError *error = NULL;
@@ -788,6 +815,9 @@ int main (int argc, char **argv)
 	if (!nm_utils_init (&error))
 		FAIL ("nm-utils-init", "failed to initialize libnm-util: %s", error->message);
 
+	test_event_parse ();
+	test_event_parse_invalid ();
+
 	/* The tests */
 	for (i = 0; i < 2; i++) {
 		const char *client_path = clients[i][0];
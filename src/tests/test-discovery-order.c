@@ -0,0 +1,257 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ *
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "nm-discovery-order.h"
+
+#define STARTUP_LINKS 100
+#define STARTUP_LINKS_PERF 20000
+
+typedef struct {
+	int ifindex;
+	int parent;
+	int master;
+} FakeLink;
+
+typedef struct {
+	GHashTable *links;   /* ifindex -> FakeLink */
+	guint calls;
+} FakeKernel;
+
+static int
+get_ifindex (gpointer item)
+{
+	return ((FakeLink *) item)->ifindex;
+}
+
+static void
+depends_on (int ifindex, int *out_parent, int *out_master, gpointer user_data)
+{
+	FakeKernel *kernel = user_data;
+	FakeLink *link;
+
+	kernel->calls++;
+	link = g_hash_table_lookup (kernel->links, GINT_TO_POINTER (ifindex));
+	if (link) {
+		*out_parent = link->parent;
+		*out_master = link->master;
+	}
+}
+
+static void
+fake_kernel_init (FakeKernel *kernel, FakeLink *links, guint n)
+{
+	guint i;
+
+	kernel->calls = 0;
+	kernel->links = g_hash_table_new (g_direct_hash, g_direct_equal);
+	for (i = 0; i < n; i++)
+		g_hash_table_insert (kernel->links, GINT_TO_POINTER (links[i].ifindex), &links[i]);
+}
+
+static int
+position (GSList *list, int ifindex)
+{
+	int i;
+
+	for (i = 0; list; list = g_slist_next (list), i++) {
+		if (get_ifindex (list->data) == ifindex)
+			return i;
+	}
+	g_assert_not_reached ();
+	return -1;
+}
+
+static void
+assert_ordered (GSList *list)
+{
+	GSList *iter;
+	int i;
+
+	for (iter = list, i = 0; iter; iter = g_slist_next (iter), i++) {
+		FakeLink *link = iter->data;
+		GSList *found;
+
+		for (found = list; found; found = g_slist_next (found)) {
+			FakeLink *other = found->data;
+
+			if (other->ifindex == link->parent || other->ifindex == link->master)
+				g_assert_cmpint (position (list, other->ifindex), <, i);
+		}
+	}
+}
+
+static void
+test_discovery_order (void)
+{
+	/* udev listing VLANs and bond ports before what they depend on */
+	FakeLink links[] = {
+		{ 10, 2, 0 },   /* eth0.10 on eth0 */
+		{ 11, 10, 0 },  /* QinQ on eth0.10 */
+		{ 3, 0, 5 },    /* eth1, port of bond0 */
+		{ 2, 0, 0 },    /* eth0 */
+		{ 4, 0, 5 },    /* eth2, port of bond0 */
+		{ 5, 0, 0 },    /* bond0 */
+		{ 12, 5, 7 },   /* bond0.12, port of br0 */
+		{ 7, 0, 0 },    /* br0 */
+		{ 13, 99, 0 },  /* VLAN on an interface udev doesn't know */
+		{ 0, 0, 0 },    /* ADSL, no ifindex */
+	};
+	FakeKernel kernel;
+	GSList *list = NULL;
+	guint i;
+
+	fake_kernel_init (&kernel, links, G_N_ELEMENTS (links));
+	for (i = 0; i < G_N_ELEMENTS (links); i++)
+		list = g_slist_append (list, &links[i]);
+
+	list = nm_discovery_order (list, get_ifindex, depends_on, &kernel);
+	g_assert_cmpint (g_slist_length (list), ==, G_N_ELEMENTS (links));
+	assert_ordered (list);
+
+	/* Devices without dependencies keep their udev order */
+	g_assert_cmpint (position (list, 2), <, position (list, 5));
+	g_assert_cmpint (position (list, 5), <, position (list, 7));
+	g_assert_cmpint (position (list, 13), <, position (list, 0));
+
+	/* Nothing is asked about twice, or about items without an ifindex */
+	g_assert_cmpint (kernel.calls, ==, G_N_ELEMENTS (links) - 1);
+
+	g_slist_free (list);
+	g_hash_table_destroy (kernel.links);
+}
+
+static void
+test_discovery_order_loop (void)
+{
+	/* The kernel shouldn't allow this, but don't hang or drop devices */
+	FakeLink links[] = {
+		{ 1, 2, 0 },
+		{ 2, 3, 0 },
+		{ 3, 1, 0 },
+		{ 4, 4, 4 },
+	};
+	FakeKernel kernel;
+	GSList *list = NULL;
+	guint i;
+
+	fake_kernel_init (&kernel, links, G_N_ELEMENTS (links));
+	for (i = 0; i < G_N_ELEMENTS (links); i++)
+		list = g_slist_append (list, &links[i]);
+
+	list = nm_discovery_order (list, get_ifindex, depends_on, &kernel);
+	g_assert_cmpint (g_slist_length (list), ==, G_N_ELEMENTS (links));
+	for (i = 0; i < G_N_ELEMENTS (links); i++)
+		position (list, links[i].ifindex);
+
+	g_slist_free (list);
+	g_hash_table_destroy (kernel.links);
+}
+
+static void
+order_startup_links (guint num_links, gboolean timed)
+{
+	FakeLink *links;
+	FakeKernel kernel;
+	GSList *list = NULL, *iter;
+	GHashTable *placed;
+	GTimer *timer = NULL;
+	guint i;
+
+	/* A parent and four VLANs per group, listed VLANs first, like udev
+	 * may do on a host with many tagged interfaces.
+	 */
+	links = g_new0 (FakeLink, num_links);
+	for (i = 0; i < num_links; i++) {
+		links[i].ifindex = i + 1;
+		if (i % 5 != 4)
+			links[i].parent = (i - i % 5) + 5;
+	}
+	fake_kernel_init (&kernel, links, num_links);
+	for (i = num_links; i > 0; i--)
+		list = g_slist_prepend (list, &links[i - 1]);
+
+	if (timed)
+		timer = g_timer_new ();
+	list = nm_discovery_order (list, get_ifindex, depends_on, &kernel);
+	if (timed) {
+		g_test_message ("%u links ordered in %.1f ms",
+		                num_links, g_timer_elapsed (timer, NULL) * 1000);
+		g_timer_destroy (timer);
+	}
+
+	/* Parents come before their VLANs, and each link is looked up once */
+	g_assert_cmpint (g_slist_length (list), ==, num_links);
+	placed = g_hash_table_new (g_direct_hash, g_direct_equal);
+	for (iter = list; iter; iter = g_slist_next (iter)) {
+		FakeLink *link = iter->data;
+
+		if (link->parent)
+			g_assert (g_hash_table_lookup (placed, GINT_TO_POINTER (link->parent)));
+		g_hash_table_insert (placed, GINT_TO_POINTER (link->ifindex), link);
+	}
+	g_assert_cmpint (kernel.calls, ==, num_links);
+
+	g_hash_table_destroy (placed);
+	g_slist_free (list);
+	g_hash_table_destroy (kernel.links);
+	g_free (links);
+}
+
+static void
+test_discovery_order_startup (void)
+{
+	order_startup_links (STARTUP_LINKS, FALSE);
+}
+
+static void
+test_discovery_order_startup_perf (void)
+{
+	order_startup_links (STARTUP_LINKS_PERF, TRUE);
+}
+
+/*******************************************/
+
+#if GLIB_CHECK_VERSION(2,25,12)
+typedef GTestFixtureFunc TCFunc;
+#else
+typedef void (*TCFunc)(void);
+#endif
+
+#define TESTCASE(t, d) g_test_create_case (#t, 0, d, NULL, (TCFunc) t, NULL)
+
+int main (int argc, char **argv)
+{
+	GTestSuite *suite;
+
+	g_test_init (&argc, &argv, NULL);
+
+	suite = g_test_get_root ();
+
+	g_test_suite_add (suite, TESTCASE (test_discovery_order, NULL));
+	g_test_suite_add (suite, TESTCASE (test_discovery_order_loop, NULL));
+	g_test_suite_add (suite, TESTCASE (test_discovery_order_startup, NULL));
+	if (g_test_perf ())
+		g_test_suite_add (suite, TESTCASE (test_discovery_order_startup_perf, NULL));
+
+	return g_test_run ();
+}
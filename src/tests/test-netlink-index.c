@@ -0,0 +1,595 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ *
+ */
+
+#include <glib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <linux/if.h>
+
+#include "nm-netlink-index.h"
+
+#include <netlink/route/nexthop.h>
+
+#define ADDRS_PER_IFACE 4
+#define SYNC_ROUNDS     100
+
+static struct rtnl_addr *
+make_addr4 (int ifindex, guint32 host_addr, int prefix)
+{
+	struct rtnl_addr *addr;
+	struct nl_addr *local;
+	guint32 tmp = htonl (host_addr);
+
+	addr = rtnl_addr_alloc ();
+	g_assert (addr);
+	local = nl_addr_build (AF_INET, &tmp, sizeof (tmp));
+	g_assert (local);
+
+	rtnl_addr_set_ifindex (addr, ifindex);
+	rtnl_addr_set_family (addr, AF_INET);
+	rtnl_addr_set_local (addr, local);
+	rtnl_addr_set_prefixlen (addr, prefix);
+	nl_addr_put (local);
+
+	return addr;
+}
+
+static void
+free_addr_list (GSList *list)
+{
+	g_slist_foreach (list, (GFunc) nl_object_put, NULL);
+	g_slist_free (list);
+}
+
+/*******************************************/
+
+static void
+test_addr_index (void)
+{
+	NMNetlinkAddrIndex *index;
+	struct rtnl_addr *a, *b, *c, *dup;
+	GSList *list;
+
+	index = nm_netlink_addr_index_new ();
+
+	a = make_addr4 (2, 0x0a000001, 24);
+	b = make_addr4 (2, 0x0a000002, 24);
+	c = make_addr4 (3, 0x0a000001, 24);
+	g_assert (nm_netlink_addr_index_add (index, a));
+	g_assert (nm_netlink_addr_index_add (index, b));
+	g_assert (nm_netlink_addr_index_add (index, c));
+
+	list = nm_netlink_addr_index_get (index, 2, AF_UNSPEC);
+	g_assert_cmpint (g_slist_length (list), ==, 2);
+	free_addr_list (list);
+
+	list = nm_netlink_addr_index_get (index, 2, AF_INET6);
+	g_assert (list == NULL);
+
+	/* An identical address replaces the existing entry */
+	dup = make_addr4 (2, 0x0a000001, 24);
+	g_assert (nm_netlink_addr_index_add (index, dup) == FALSE);
+	list = nm_netlink_addr_index_get (index, 2, AF_INET);
+	g_assert_cmpint (g_slist_length (list), ==, 2);
+	g_assert (g_slist_find (list, dup) != NULL);
+	g_assert (g_slist_find (list, a) == NULL);
+	free_addr_list (list);
+
+	g_assert (nm_netlink_addr_index_remove (index, a));
+	g_assert (nm_netlink_addr_index_remove (index, b));
+	g_assert (nm_netlink_addr_index_remove (index, b) == FALSE);
+	list = nm_netlink_addr_index_get (index, 2, AF_UNSPEC);
+	g_assert (list == NULL);
+
+	list = nm_netlink_addr_index_get (index, 3, AF_UNSPEC);
+	g_assert_cmpint (g_slist_length (list), ==, 1);
+	g_assert (list->data == c);
+	free_addr_list (list);
+
+	nm_netlink_addr_index_free (index);
+	rtnl_addr_put (a);
+	rtnl_addr_put (b);
+	rtnl_addr_put (c);
+	rtnl_addr_put (dup);
+}
+
+static void
+test_addr_diff (void)
+{
+	GSList *existing = NULL, *unwanted;
+	struct rtnl_addr **addrs;
+	struct rtnl_addr *keep, *stale1, *stale2;
+
+	keep = make_addr4 (1, 0x0a000001, 24);
+	stale1 = make_addr4 (1, 0x0a000002, 24);
+	stale2 = make_addr4 (1, 0x0a000101, 24);
+	existing = g_slist_append (existing, keep);
+	existing = g_slist_append (existing, stale1);
+	existing = g_slist_append (existing, stale2);
+
+	addrs = g_new0 (struct rtnl_addr *, 4);
+	addrs[0] = make_addr4 (1, 0x0a000001, 24);  /* already there */
+	addrs[1] = make_addr4 (1, 0x0a000002, 16);  /* different prefix */
+	addrs[2] = make_addr4 (1, 0x0a000201, 24);  /* new */
+
+	unwanted = nm_netlink_addr_diff (existing, addrs, 3);
+	g_assert_cmpint (g_slist_length (unwanted), ==, 2);
+	g_assert (unwanted->data == stale1);
+	g_assert (unwanted->next->data == stale2);
+	g_slist_free (unwanted);
+
+	g_assert (addrs[0] == NULL);
+	g_assert (addrs[1] != NULL);
+	g_assert (addrs[2] != NULL);
+	rtnl_addr_put (addrs[1]);
+	rtnl_addr_put (addrs[2]);
+	g_free (addrs);
+
+	/* Nothing wanted; everything goes */
+	unwanted = nm_netlink_addr_diff (existing, NULL, 0);
+	g_assert_cmpint (g_slist_length (unwanted), ==, 3);
+	g_slist_free (unwanted);
+
+	free_addr_list (existing);
+}
+
+/*******************************************/
+
+static struct rtnl_addr **
+make_wanted (int ifindex)
+{
+	struct rtnl_addr **addrs;
+	int i;
+
+	/* Half of the interface's addresses stay, half are replaced */
+	addrs = g_new0 (struct rtnl_addr *, ADDRS_PER_IFACE + 1);
+	for (i = 0; i < ADDRS_PER_IFACE; i++)
+		addrs[i] = make_addr4 (ifindex, 0xc0a80001 + i + (i % 2) * 100, 24);
+	return addrs;
+}
+
+static void
+free_wanted (struct rtnl_addr **addrs)
+{
+	int i;
+
+	for (i = 0; i < ADDRS_PER_IFACE; i++) {
+		if (addrs[i])
+			rtnl_addr_put (addrs[i]);
+	}
+	g_free (addrs);
+}
+
+/* What sync_addresses() used to do: walk every address on the host and
+ * compare each one on the interface to every wanted address.
+ */
+static guint
+full_scan_sync (GSList *all, int ifindex, struct rtnl_addr **addrs)
+{
+	GSList *iter;
+	guint n_unwanted = 0;
+	int i;
+
+	for (iter = all; iter; iter = g_slist_next (iter)) {
+		if (rtnl_addr_get_ifindex (iter->data) != ifindex)
+			continue;
+
+		for (i = 0; i < ADDRS_PER_IFACE; i++) {
+			if (addrs[i] && nl_object_identical (iter->data, (struct nl_object *) addrs[i]))
+				break;
+		}
+		if (i < ADDRS_PER_IFACE) {
+			rtnl_addr_put (addrs[i]);
+			addrs[i] = NULL;
+		} else
+			n_unwanted++;
+	}
+	return n_unwanted;
+}
+
+static guint
+indexed_sync (NMNetlinkAddrIndex *index, int ifindex, struct rtnl_addr **addrs)
+{
+	GSList *existing, *unwanted;
+	guint n_unwanted;
+
+	existing = nm_netlink_addr_index_get (index, ifindex, AF_INET);
+	unwanted = nm_netlink_addr_diff (existing, addrs, ADDRS_PER_IFACE);
+	n_unwanted = g_slist_length (unwanted);
+	g_slist_free (unwanted);
+	free_addr_list (existing);
+
+	return n_unwanted;
+}
+
+/* An index and a flat list of the same addresses: the interface being
+ * activated, followed by lots of other interfaces.
+ */
+static NMNetlinkAddrIndex *
+make_host_addrs (int target, int n_existing, GSList **out_all)
+{
+	NMNetlinkAddrIndex *index;
+	struct rtnl_addr *addr;
+	GSList *all = NULL;
+	int i;
+
+	index = nm_netlink_addr_index_new ();
+	for (i = 0; i < ADDRS_PER_IFACE; i++) {
+		addr = make_addr4 (target, 0xc0a80001 + i, 24);
+		nm_netlink_addr_index_add (index, addr);
+		all = g_slist_prepend (all, addr);
+	}
+	for (i = 0; i < n_existing; i++) {
+		addr = make_addr4 (target + 1 + i / ADDRS_PER_IFACE, 0x0a000000 + i, 8);
+		nm_netlink_addr_index_add (index, addr);
+		all = g_slist_prepend (all, addr);
+	}
+
+	*out_all = all;
+	return index;
+}
+
+static void
+test_addr_sync (void)
+{
+	NMNetlinkAddrIndex *index;
+	GSList *all;
+	struct rtnl_addr **addrs;
+	guint n_scan, n_index;
+
+	index = make_host_addrs (1, 1000, &all);
+
+	/* Both have to agree on what to remove */
+	addrs = make_wanted (1);
+	n_scan = full_scan_sync (all, 1, addrs);
+	free_wanted (addrs);
+
+	addrs = make_wanted (1);
+	n_index = indexed_sync (index, 1, addrs);
+	free_wanted (addrs);
+
+	g_assert_cmpint (n_scan, ==, ADDRS_PER_IFACE / 2);
+	g_assert_cmpint (n_index, ==, n_scan);
+
+	free_addr_list (all);
+	nm_netlink_addr_index_free (index);
+}
+
+static void
+time_addr_sync (int n_existing)
+{
+	NMNetlinkAddrIndex *index;
+	GSList *all;
+	struct rtnl_addr **addrs;
+	GTimer *timer;
+	double t_scan = 0, t_index = 0;
+	int i;
+
+	index = make_host_addrs (1, n_existing, &all);
+
+	timer = g_timer_new ();
+	for (i = 0; i < SYNC_ROUNDS; i++) {
+		addrs = make_wanted (1);
+		g_timer_start (timer);
+		full_scan_sync (all, 1, addrs);
+		t_scan += g_timer_elapsed (timer, NULL);
+		free_wanted (addrs);
+
+		addrs = make_wanted (1);
+		g_timer_start (timer);
+		indexed_sync (index, 1, addrs);
+		t_index += g_timer_elapsed (timer, NULL);
+		free_wanted (addrs);
+	}
+	g_timer_destroy (timer);
+
+	g_test_message ("%d existing addresses: full scan %.3f ms, indexed %.3f ms per sync",
+	                n_existing,
+	                t_scan * 1000 / SYNC_ROUNDS,
+	                t_index * 1000 / SYNC_ROUNDS);
+
+	free_addr_list (all);
+	nm_netlink_addr_index_free (index);
+}
+
+static void
+test_addr_sync_perf (void)
+{
+	time_addr_sync (1000);
+	time_addr_sync (10000);
+}
+
+/*******************************************/
+
+static struct rtnl_route *
+make_route4 (int oif, guint32 host_dst, int prefix, guint32 metric)
+{
+	struct rtnl_route *route;
+	struct rtnl_nexthop *nh;
+	struct nl_addr *dst;
+	guint32 tmp = htonl (host_dst);
+
+	route = rtnl_route_alloc ();
+	g_assert (route);
+	rtnl_route_set_family (route, AF_INET);
+	rtnl_route_set_table (route, RT_TABLE_MAIN);
+	rtnl_route_set_priority (route, metric);
+
+	dst = nl_addr_build (AF_INET, &tmp, sizeof (tmp));
+	g_assert (dst);
+	nl_addr_set_prefixlen (dst, prefix);
+	rtnl_route_set_dst (route, dst);
+	nl_addr_put (dst);
+
+	nh = rtnl_route_nh_alloc ();
+	g_assert (nh);
+	rtnl_route_nh_set_ifindex (nh, oif);
+	rtnl_route_add_nexthop (route, nh);
+
+	return route;
+}
+
+static void
+free_route_list (GSList *list)
+{
+	g_slist_foreach (list, (GFunc) nl_object_put, NULL);
+	g_slist_free (list);
+}
+
+static void
+test_route_index (void)
+{
+	NMNetlinkRouteIndex *index;
+	struct rtnl_route *def1, *def2, *net, *other, *moved;
+	GSList *list;
+
+	index = nm_netlink_route_index_new ();
+
+	def1 = make_route4 (2, 0, 0, 0);
+	def2 = make_route4 (2, 0, 0, 100);
+	net = make_route4 (2, 0x0a000000, 8, 0);
+	other = make_route4 (3, 0xc0a80000, 16, 0);
+	nm_netlink_route_index_add (index, def1);
+	nm_netlink_route_index_add (index, def2);
+	nm_netlink_route_index_add (index, net);
+	nm_netlink_route_index_add (index, other);
+	g_assert_cmpint (nm_netlink_route_index_size (index), ==, 4);
+
+	list = nm_netlink_route_index_get (index, 2, AF_INET);
+	g_assert_cmpint (g_slist_length (list), ==, 3);
+	free_route_list (list);
+
+	list = nm_netlink_route_index_get (index, 2, AF_INET6);
+	g_assert (list == NULL);
+
+	list = nm_netlink_route_index_get (index, 0, AF_UNSPEC);
+	g_assert_cmpint (g_slist_length (list), ==, 4);
+	free_route_list (list);
+
+	/* Both default routes, and only those */
+	list = nm_netlink_route_index_lookup (index, AF_INET, 2, RT_TABLE_MAIN, NULL);
+	g_assert_cmpint (g_slist_length (list), ==, 2);
+	g_assert (g_slist_find (list, def1) != NULL);
+	g_assert (g_slist_find (list, def2) != NULL);
+	free_route_list (list);
+
+	list = nm_netlink_route_index_lookup (index, AF_INET, 3, RT_TABLE_MAIN, NULL);
+	g_assert (list == NULL);
+
+	/* Replacing a route with one through another interface moves it */
+	moved = make_route4 (3, 0, 0, 100);
+	nm_netlink_route_index_add (index, moved);
+	g_assert_cmpint (nm_netlink_route_index_size (index), ==, 4);
+	list = nm_netlink_route_index_lookup (index, AF_INET, 2, RT_TABLE_MAIN, NULL);
+	g_assert_cmpint (g_slist_length (list), ==, 1);
+	g_assert (list->data == def1);
+	free_route_list (list);
+	list = nm_netlink_route_index_lookup (index, AF_INET, 3, RT_TABLE_MAIN, NULL);
+	g_assert_cmpint (g_slist_length (list), ==, 1);
+	g_assert (list->data == moved);
+	free_route_list (list);
+
+	nm_netlink_route_index_remove (index, def1);
+	nm_netlink_route_index_remove (index, net);
+	list = nm_netlink_route_index_get (index, 2, AF_UNSPEC);
+	g_assert (list == NULL);
+	g_assert_cmpint (nm_netlink_route_index_size (index), ==, 2);
+
+	nm_netlink_route_index_free (index);
+	rtnl_route_put (def1);
+	rtnl_route_put (def2);
+	rtnl_route_put (net);
+	rtnl_route_put (other);
+	rtnl_route_put (moved);
+}
+
+static struct rtnl_route *
+make_route6_default (int oif)
+{
+	struct rtnl_route *route;
+	struct rtnl_nexthop *nh;
+	struct nl_addr *dst;
+	struct in6_addr any = IN6ADDR_ANY_INIT;
+
+	route = rtnl_route_alloc ();
+	g_assert (route);
+	rtnl_route_set_family (route, AF_INET6);
+	rtnl_route_set_table (route, RT_TABLE_MAIN);
+
+	dst = nl_addr_build (AF_INET6, &any, sizeof (any));
+	g_assert (dst);
+	nl_addr_set_prefixlen (dst, 0);
+	rtnl_route_set_dst (route, dst);
+	nl_addr_put (dst);
+
+	nh = rtnl_route_nh_alloc ();
+	g_assert (nh);
+	rtnl_route_nh_set_ifindex (nh, oif);
+	rtnl_route_add_nexthop (route, nh);
+
+	return route;
+}
+
+static guint
+count_routes (NMNetlinkRouteIndex *index, int ifindex, int family)
+{
+	GSList *list;
+	guint n;
+
+	list = nm_netlink_route_index_get (index, ifindex, family);
+	n = g_slist_length (list);
+	free_route_list (list);
+	return n;
+}
+
+static void
+test_route_index_link_down (void)
+{
+	NMNetlinkRouteIndex *index;
+	struct rtnl_route *net, *def6, *other;
+
+	index = nm_netlink_route_index_new ();
+	net = make_route4 (2, 0x0a000000, 8, 0);
+	def6 = make_route6_default (2);
+	other = make_route4 (3, 0xc0a80000, 16, 0);
+	nm_netlink_route_index_add (index, net);
+	nm_netlink_route_index_add (index, def6);
+	nm_netlink_route_index_add (index, other);
+
+	/* Still up: nothing goes */
+	nm_netlink_route_index_link_changed (index, 2, IFF_UP, FALSE);
+	g_assert_cmpint (nm_netlink_route_index_size (index), ==, 3);
+
+	/* Down: the IPv4 routes through it go; IPv6 ones are announced */
+	nm_netlink_route_index_link_changed (index, 2, 0, FALSE);
+	g_assert_cmpint (count_routes (index, 2, AF_INET), ==, 0);
+	g_assert_cmpint (count_routes (index, 2, AF_INET6), ==, 1);
+	g_assert_cmpint (count_routes (index, 3, AF_INET), ==, 1);
+
+	nm_netlink_route_index_free (index);
+	rtnl_route_put (net);
+	rtnl_route_put (def6);
+	rtnl_route_put (other);
+}
+
+static void
+test_route_index_link_removed (void)
+{
+	NMNetlinkRouteIndex *index;
+	struct rtnl_route *net, *def6, *other;
+
+	index = nm_netlink_route_index_new ();
+	net = make_route4 (2, 0x0a000000, 8, 0);
+	def6 = make_route6_default (2);
+	other = make_route4 (3, 0xc0a80000, 16, 0);
+	nm_netlink_route_index_add (index, net);
+	nm_netlink_route_index_add (index, def6);
+	nm_netlink_route_index_add (index, other);
+
+	/* Every route through a deleted link goes */
+	nm_netlink_route_index_link_changed (index, 2, IFF_UP, TRUE);
+	g_assert_cmpint (count_routes (index, 2, AF_UNSPEC), ==, 0);
+	g_assert_cmpint (nm_netlink_route_index_size (index), ==, 1);
+	g_assert_cmpint (count_routes (index, 3, AF_INET), ==, 1);
+
+	nm_netlink_route_index_free (index);
+	rtnl_route_put (net);
+	rtnl_route_put (def6);
+	rtnl_route_put (other);
+}
+
+static void
+test_route_index_addr_removed (void)
+{
+	NMNetlinkRouteIndex *index;
+	struct rtnl_route *net, *src_route, *other;
+	struct rtnl_addr *addr, *addr2;
+	struct nl_addr *src;
+	guint32 tmp = htonl (0x0a000002);
+
+	index = nm_netlink_route_index_new ();
+	net = make_route4 (2, 0x0a000000, 8, 0);
+	other = make_route4 (3, 0xc0a80000, 16, 0);
+
+	/* Through another interface, but with the removed address as source */
+	src_route = make_route4 (3, 0xac100000, 12, 0);
+	src = nl_addr_build (AF_INET, &tmp, sizeof (tmp));
+	g_assert (src);
+	rtnl_route_set_pref_src (src_route, src);
+	nl_addr_put (src);
+
+	nm_netlink_route_index_add (index, net);
+	nm_netlink_route_index_add (index, src_route);
+	nm_netlink_route_index_add (index, other);
+
+	/* Another address is left on the interface; only the routes using
+	 * the removed one as their source go.
+	 */
+	addr = make_addr4 (2, 0x0a000002, 8);
+	nm_netlink_route_index_addr_removed (index, addr, FALSE);
+	g_assert_cmpint (nm_netlink_route_index_size (index), ==, 2);
+	g_assert_cmpint (count_routes (index, 2, AF_INET), ==, 1);
+	g_assert_cmpint (count_routes (index, 3, AF_INET), ==, 1);
+
+	/* The last one takes the interface's IPv4 routes with it */
+	addr2 = make_addr4 (2, 0x0a000003, 8);
+	nm_netlink_route_index_addr_removed (index, addr2, TRUE);
+	g_assert_cmpint (count_routes (index, 2, AF_INET), ==, 0);
+	g_assert_cmpint (count_routes (index, 3, AF_INET), ==, 1);
+
+	nm_netlink_route_index_free (index);
+	rtnl_addr_put (addr);
+	rtnl_addr_put (addr2);
+	rtnl_route_put (net);
+	rtnl_route_put (src_route);
+	rtnl_route_put (other);
+}
+
+/*******************************************/
+
+#if GLIB_CHECK_VERSION(2,25,12)
+typedef GTestFixtureFunc TCFunc;
+#else
+typedef void (*TCFunc)(void);
+#endif
+
+#define TESTCASE(t, d) g_test_create_case (#t, 0, d, NULL, (TCFunc) t, NULL)
+
+int main (int argc, char **argv)
+{
+	GTestSuite *suite;
+
+	g_test_init (&argc, &argv, NULL);
+
+	suite = g_test_get_root ();
+
+	g_test_suite_add (suite, TESTCASE (test_addr_index, NULL));
+	g_test_suite_add (suite, TESTCASE (test_addr_diff, NULL));
+	g_test_suite_add (suite, TESTCASE (test_addr_sync, NULL));
+	g_test_suite_add (suite, TESTCASE (test_route_index, NULL));
+	g_test_suite_add (suite, TESTCASE (test_route_index_link_down, NULL));
+	g_test_suite_add (suite, TESTCASE (test_route_index_link_removed, NULL));
+	g_test_suite_add (suite, TESTCASE (test_route_index_addr_removed, NULL));
+	if (g_test_perf ())
+		g_test_suite_add (suite, TESTCASE (test_addr_sync_perf, NULL));
+
+	return g_test_run ();
+}
+
@@ -0,0 +1,201 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ *
+ */
+
+#include <glib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "nm-netlink-transaction.h"
+
+#include <netlink/route/nexthop.h>
+
+/* No such interface; the kernel rejects every request, which is fine,
+ * as long as it rejects them one by one rather than the datagram.
+ */
+#define BOGUS_IFINDEX 0x7ffffff0
+
+/* More route requests than fit in one datagram */
+#define NUM_ROUTES 2000
+
+/* The transaction code only wants this for its warnings */
+char *
+nm_netlink_index_to_iface (int idx)
+{
+	return NULL;
+}
+
+static struct nl_sock *
+socket_new (void)
+{
+	struct nl_sock *sk;
+
+	sk = nl_socket_alloc ();
+	g_assert (sk);
+	g_assert_cmpint (nl_connect (sk, NETLINK_ROUTE), ==, 0);
+	return sk;
+}
+
+static void
+test_datagram_limit (void)
+{
+	struct nl_sock *sk;
+	struct nlmsghdr *hdr;
+	guint max, len;
+	guint8 *buf;
+
+	sk = socket_new ();
+	max = nm_netlink_transaction_setup_socket (sk);
+	g_assert_cmpint (max, >, 4096);
+	g_assert_cmpint (max, <=, 64 * 1024);
+
+	/* A datagram filled right up to the limit with one NOOP message the
+	 * kernel ignores; it must get past netlink_sendmsg()'s size check.
+	 */
+	len = NLMSG_ALIGN (max - NLMSG_ALIGNTO + 1);
+	g_assert_cmpint (len, <=, max);
+	buf = g_malloc0 (len);
+	hdr = (struct nlmsghdr *) buf;
+	hdr->nlmsg_len = len;
+	hdr->nlmsg_type = NLMSG_NOOP;
+	hdr->nlmsg_flags = NLM_F_REQUEST;
+	g_assert_cmpint (nl_sendto (sk, buf, len), ==, len);
+
+	g_free (buf);
+	nl_socket_free (sk);
+}
+
+/*******************************************/
+
+typedef struct {
+	GMainLoop *loop;
+	guint errors;
+	guint num_failed;
+	gboolean done;
+} CommitData;
+
+static struct rtnl_route *
+make_route4 (int oif, guint32 host_dst, int prefix)
+{
+	struct rtnl_route *route;
+	struct rtnl_nexthop *nh;
+	struct nl_addr *dst;
+	guint32 tmp = htonl (host_dst);
+
+	route = rtnl_route_alloc ();
+	g_assert (route);
+	rtnl_route_set_family (route, AF_INET);
+	rtnl_route_set_table (route, RT_TABLE_MAIN);
+
+	dst = nl_addr_build (AF_INET, &tmp, sizeof (tmp));
+	g_assert (dst);
+	nl_addr_set_prefixlen (dst, prefix);
+	rtnl_route_set_dst (route, dst);
+	nl_addr_put (dst);
+
+	nh = rtnl_route_nh_alloc ();
+	g_assert (nh);
+	rtnl_route_nh_set_ifindex (nh, oif);
+	rtnl_route_add_nexthop (route, nh);
+
+	return route;
+}
+
+static void
+commit_error_cb (NMNetlinkTransaction *trans,
+                 struct nl_object *object,
+                 int msgtype,
+                 int err,
+                 gpointer user_data)
+{
+	CommitData *data = user_data;
+
+	/* The datagram itself must never be too large */
+	g_assert_cmpint (err, !=, -NLE_MSGSIZE);
+	g_assert_cmpint (msgtype, ==, RTM_NEWROUTE);
+	data->errors++;
+}
+
+static void
+commit_done_cb (NMNetlinkTransaction *trans, guint num_failed, gpointer user_data)
+{
+	CommitData *data = user_data;
+
+	data->num_failed = num_failed;
+	data->done = TRUE;
+	g_main_loop_quit (data->loop);
+}
+
+static void
+test_commit_large (void)
+{
+	NMNetlinkTransaction *trans;
+	CommitData data;
+	guint i;
+
+	memset (&data, 0, sizeof (data));
+	data.loop = g_main_loop_new (NULL, FALSE);
+
+	trans = nm_netlink_transaction_new (BOGUS_IFINDEX);
+	for (i = 0; i < NUM_ROUTES; i++) {
+		struct rtnl_route *route;
+
+		route = make_route4 (BOGUS_IFINDEX, 0x0a000000 + (i << 8), 24);
+		g_assert (nm_netlink_transaction_add_route (trans, route, NLM_F_CREATE));
+		rtnl_route_put (route);
+	}
+	g_assert_cmpint (nm_netlink_transaction_get_size (trans), ==, NUM_ROUTES);
+
+	nm_netlink_transaction_commit (trans, commit_error_cb, commit_done_cb, &data);
+	if (!data.done)
+		g_main_loop_run (data.loop);
+
+	/* Acknowledgements may be lost if the receive buffer overflows; those
+	 * requests count as done.  Every one that came back was refused.
+	 */
+	g_assert (data.done);
+	g_assert_cmpint (data.num_failed, >, 0);
+	g_assert_cmpint (data.num_failed, ==, data.errors);
+
+	g_main_loop_unref (data.loop);
+}
+
+/*******************************************/
+
+#if GLIB_CHECK_VERSION(2,25,12)
+typedef GTestFixtureFunc TCFunc;
+#else
+typedef void (*TCFunc)(void);
+#endif
+
+#define TESTCASE(t, d) g_test_create_case (#t, 0, d, NULL, (TCFunc) t, NULL)
+
+int main (int argc, char **argv)
+{
+	GTestSuite *suite;
+
+	g_test_init (&argc, &argv, NULL);
+
+	suite = g_test_get_root ();
+
+	g_test_suite_add (suite, TESTCASE (test_datagram_limit, NULL));
+	g_test_suite_add (suite, TESTCASE (test_commit_large, NULL));
+
+	return g_test_run ();
+}
@@ -0,0 +1,425 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ *
+ */
+
+#include <glib.h>
+#include <glib-object.h>
+#include <string.h>
+
+#include "nm-properties-changed-signal.h"
+
+#define NUM_OBJECTS 50
+#define NUM_OBJECTS_PERF 10000
+
+/*******************************************/
+
+typedef struct {
+	GObject parent;
+	guint foo_bar;
+	char *baz;
+	gboolean hidden;
+} TestObject;
+
+typedef struct {
+	GObjectClass parent;
+
+	void (*properties_changed) (TestObject *object, GHashTable *properties);
+} TestObjectClass;
+
+enum {
+	PROP_0,
+	PROP_FOO_BAR,
+	PROP_BAZ,
+	PROP_HIDDEN,
+};
+
+GType test_object_get_type (void);
+G_DEFINE_TYPE (TestObject, test_object, G_TYPE_OBJECT)
+
+static void
+test_object_init (TestObject *self)
+{
+}
+
+static void
+set_property (GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+	TestObject *self = (TestObject *) object;
+
+	switch (prop_id) {
+	case PROP_FOO_BAR:
+		self->foo_bar = g_value_get_uint (value);
+		break;
+	case PROP_BAZ:
+		g_free (self->baz);
+		self->baz = g_value_dup_string (value);
+		break;
+	case PROP_HIDDEN:
+		self->hidden = g_value_get_boolean (value);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
+}
+
+static void
+get_property (GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+	TestObject *self = (TestObject *) object;
+
+	switch (prop_id) {
+	case PROP_FOO_BAR:
+		g_value_set_uint (value, self->foo_bar);
+		break;
+	case PROP_BAZ:
+		g_value_set_string (value, self->baz);
+		break;
+	case PROP_HIDDEN:
+		g_value_set_boolean (value, self->hidden);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
+}
+
+static void
+finalize (GObject *object)
+{
+	g_free (((TestObject *) object)->baz);
+
+	G_OBJECT_CLASS (test_object_parent_class)->finalize (object);
+}
+
+static void
+test_object_class_init (TestObjectClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->set_property = set_property;
+	object_class->get_property = get_property;
+	object_class->finalize = finalize;
+
+	g_object_class_install_property (object_class, PROP_FOO_BAR,
+		g_param_spec_uint ("foo-bar", "", "", 0, G_MAXUINT, 0, G_PARAM_READWRITE));
+	g_object_class_install_property (object_class, PROP_BAZ,
+		g_param_spec_string ("baz", "", "", NULL, G_PARAM_READWRITE));
+	g_object_class_install_property (object_class, PROP_HIDDEN,
+		g_param_spec_boolean ("hidden", "", "", FALSE,
+		                      G_PARAM_READWRITE | NM_PROPERTY_PARAM_NO_EXPORT));
+
+	nm_properties_changed_signal_new (object_class,
+	                                  G_STRUCT_OFFSET (TestObjectClass, properties_changed));
+}
+
+/* Subclasses that only differ in priority */
+
+typedef TestObject TestHigh;
+typedef TestObjectClass TestHighClass;
+
+GType test_high_get_type (void);
+G_DEFINE_TYPE (TestHigh, test_high, test_object_get_type ())
+
+static void
+test_high_init (TestHigh *self)
+{
+}
+
+static void
+test_high_class_init (TestHighClass *klass)
+{
+	nm_properties_changed_signal_set_priority (G_OBJECT_CLASS (klass),
+	                                           NM_PROPERTIES_CHANGED_PRIORITY_HIGH);
+}
+
+typedef TestObject TestLow;
+typedef TestObjectClass TestLowClass;
+
+GType test_low_get_type (void);
+G_DEFINE_TYPE (TestLow, test_low, test_object_get_type ())
+
+static void
+test_low_init (TestLow *self)
+{
+}
+
+static void
+test_low_class_init (TestLowClass *klass)
+{
+	nm_properties_changed_signal_set_priority (G_OBJECT_CLASS (klass),
+	                                           NM_PROPERTIES_CHANGED_PRIORITY_LOW);
+}
+
+/*******************************************/
+
+typedef struct {
+	GSList *objects;   /* in emission order */
+	GHashTable *last;  /* copy of the last property names seen */
+	guint count;
+} Emissions;
+
+static void
+properties_changed_cb (GObject *object, GHashTable *properties, Emissions *e)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	e->objects = g_slist_append (e->objects, object);
+	e->count++;
+
+	g_hash_table_remove_all (e->last);
+	g_hash_table_iter_init (&iter, properties);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		GValue *copy = g_new0 (GValue, 1);
+
+		g_value_init (copy, G_VALUE_TYPE (value));
+		g_value_copy (value, copy);
+		g_hash_table_insert (e->last, g_strdup (key), copy);
+	}
+}
+
+static void
+free_value (gpointer data)
+{
+	g_value_unset (data);
+	g_free (data);
+}
+
+static void
+emissions_init (Emissions *e)
+{
+	memset (e, 0, sizeof (*e));
+	e->last = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, free_value);
+}
+
+static void
+emissions_clear (Emissions *e)
+{
+	g_slist_free (e->objects);
+	g_hash_table_destroy (e->last);
+}
+
+static GObject *
+new_watched (GType type, Emissions *e)
+{
+	GObject *object = g_object_new (type, NULL);
+
+	g_signal_connect (object, "properties-changed", G_CALLBACK (properties_changed_cb), e);
+	return object;
+}
+
+static void
+run_pending (void)
+{
+	while (g_main_context_pending (NULL))
+		g_main_context_iteration (NULL, FALSE);
+}
+
+static void
+test_coalesce (void)
+{
+	Emissions e;
+	GObject *object;
+	GValue *value;
+	guint64 emitted, coalesced, emitted2, coalesced2;
+
+	emissions_init (&e);
+	object = new_watched (test_object_get_type (), &e);
+	nm_properties_changed_signal_get_counters (&emitted, &coalesced);
+
+	g_object_set (object, "foo-bar", 1, NULL);
+	g_object_set (object, "foo-bar", 2, NULL);
+	g_object_set (object, "baz", "hello", NULL);
+	g_object_set (object, "foo-bar", 3, NULL);
+	g_object_set (object, "hidden", TRUE, NULL);
+	g_assert_cmpint (e.count, ==, 0);
+
+	run_pending ();
+
+	/* One signal with the latest values and D-Bus names */
+	g_assert_cmpint (e.count, ==, 1);
+	g_assert_cmpint (g_hash_table_size (e.last), ==, 2);
+	value = g_hash_table_lookup (e.last, "FooBar");
+	g_assert (value);
+	g_assert_cmpint (g_value_get_uint (value), ==, 3);
+	value = g_hash_table_lookup (e.last, "Baz");
+	g_assert (value);
+	g_assert_cmpstr (g_value_get_string (value), ==, "hello");
+
+	nm_properties_changed_signal_get_counters (&emitted2, &coalesced2);
+	g_assert_cmpint (emitted2 - emitted, ==, 1);
+	g_assert_cmpint (coalesced2 - coalesced, ==, 3);
+
+	/* Objects destroyed with pending changes emit nothing */
+	g_object_set (object, "foo-bar", 4, NULL);
+	g_object_unref (object);
+	run_pending ();
+	g_assert_cmpint (e.count, ==, 1);
+
+	emissions_clear (&e);
+}
+
+static void
+test_priority (void)
+{
+	Emissions e;
+	GObject *low, *def, *high;
+
+	emissions_init (&e);
+	low = new_watched (test_low_get_type (), &e);
+	def = new_watched (test_object_get_type (), &e);
+	high = new_watched (test_high_get_type (), &e);
+
+	g_object_set (low, "foo-bar", 1, NULL);
+	g_object_set (def, "foo-bar", 1, NULL);
+	g_object_set (high, "foo-bar", 1, NULL);
+	run_pending ();
+
+	g_assert_cmpint (e.count, ==, 3);
+	g_assert (g_slist_nth_data (e.objects, 0) == high);
+	g_assert (g_slist_nth_data (e.objects, 1) == def);
+	g_assert (g_slist_nth_data (e.objects, 2) == low);
+
+	g_object_unref (low);
+	g_object_unref (def);
+	g_object_unref (high);
+	emissions_clear (&e);
+}
+
+static void
+test_interval (void)
+{
+	Emissions e;
+	GObject *object;
+	GTimer *timer;
+	guint i;
+
+	emissions_init (&e);
+	object = new_watched (test_object_get_type (), &e);
+
+	nm_properties_changed_signal_set_interval (100);
+	g_object_set (object, "foo-bar", 1, NULL);
+	while (e.count == 0)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_cmpint (e.count, ==, 1);
+
+	/* Changes right after a flush wait for the interval and are merged */
+	timer = g_timer_new ();
+	for (i = 2; i < 10; i++)
+		g_object_set (object, "foo-bar", i, NULL);
+	run_pending ();
+	g_assert_cmpint (e.count, ==, 1);
+
+	while (e.count == 1)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_cmpint (e.count, ==, 2);
+	g_assert_cmpint (g_value_get_uint (g_hash_table_lookup (e.last, "FooBar")), ==, 9);
+	g_assert (g_timer_elapsed (timer, NULL) >= 0.05);
+
+	nm_properties_changed_signal_set_interval (0);
+	g_timer_destroy (timer);
+	g_object_unref (object);
+	emissions_clear (&e);
+}
+
+static void
+change_many_objects (guint num_objects, gboolean timed)
+{
+	Emissions e;
+	GObject **objects;
+	GTimer *timer = NULL;
+	guint64 emitted, coalesced, emitted2, coalesced2;
+	guint i;
+
+	emissions_init (&e);
+	objects = g_new (GObject *, num_objects);
+	for (i = 0; i < num_objects; i++)
+		objects[i] = new_watched (i % 2 ? test_low_get_type () : test_object_get_type (), &e);
+
+	/* Like a scan touching every access point a few times */
+	nm_properties_changed_signal_get_counters (&emitted, &coalesced);
+	if (timed)
+		timer = g_timer_new ();
+	for (i = 0; i < num_objects; i++) {
+		g_object_set (objects[i], "foo-bar", i, NULL);
+		g_object_set (objects[i], "baz", "ssid", NULL);
+		g_object_set (objects[i], "foo-bar", i + 1, NULL);
+	}
+	run_pending ();
+	nm_properties_changed_signal_get_counters (&emitted2, &coalesced2);
+
+	g_assert_cmpint (e.count, ==, num_objects);
+	g_assert_cmpint (emitted2 - emitted, ==, num_objects);
+	g_assert_cmpint (coalesced2 - coalesced, ==, num_objects * 2);
+
+	if (timed) {
+		g_test_message ("%u objects: %" G_GUINT64_FORMAT " signals, %" G_GUINT64_FORMAT
+		                " changes coalesced, %.1f ms",
+		                num_objects, emitted2 - emitted, coalesced2 - coalesced,
+		                g_timer_elapsed (timer, NULL) * 1000);
+		g_timer_destroy (timer);
+	}
+
+	for (i = 0; i < num_objects; i++)
+		g_object_unref (objects[i]);
+	g_free (objects);
+	emissions_clear (&e);
+}
+
+static void
+test_many_objects (void)
+{
+	change_many_objects (NUM_OBJECTS, FALSE);
+}
+
+static void
+test_many_objects_perf (void)
+{
+	change_many_objects (NUM_OBJECTS_PERF, TRUE);
+}
+
+/*******************************************/
+
+#if GLIB_CHECK_VERSION(2,25,12)
+typedef GTestFixtureFunc TCFunc;
+#else
+typedef void (*TCFunc)(void);
+#endif
+
+#define TESTCASE(t, d) g_test_create_case (#t, 0, d, NULL, (TCFunc) t, NULL)
+
+int main (int argc, char **argv)
+{
+	GTestSuite *suite;
+
+	g_type_init ();
+	g_test_init (&argc, &argv, NULL);
+
+	suite = g_test_get_root ();
+
+	g_test_suite_add (suite, TESTCASE (test_coalesce, NULL));
+	g_test_suite_add (suite, TESTCASE (test_priority, NULL));
+	g_test_suite_add (suite, TESTCASE (test_interval, NULL));
+	g_test_suite_add (suite, TESTCASE (test_many_objects, NULL));
+	if (g_test_perf ())
+		g_test_suite_add (suite, TESTCASE (test_many_objects_perf, NULL));
+
+	return g_test_run ();
+}
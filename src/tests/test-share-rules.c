@@ -0,0 +1,122 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Red Hat, Inc.
+ *
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "nm-share-rules.h"
+
+static GSList *
+share_rules_new (void)
+{
+	GSList *rules = NULL;
+
+	/* Like start_sharing(), with the nat rule between filter rules */
+	rules = g_slist_append (rules, nm_share_rule_new ("filter", "INPUT --in-interface wlan0 --protocol udp --destination-port 67 --jump ACCEPT"));
+	rules = g_slist_append (rules, nm_share_rule_new ("filter", "FORWARD --in-interface wlan0 --jump REJECT"));
+	rules = g_slist_append (rules, nm_share_rule_new ("nat", "POSTROUTING --source 10.42.0.0/255.255.255.0 ! --destination 10.42.0.0/255.255.255.0 --jump MASQUERADE"));
+	rules = g_slist_append (rules, nm_share_rule_new ("filter", "FORWARD --in-interface wlan0 --out-interface wlan0 --jump ACCEPT"));
+	return rules;
+}
+
+static void
+share_rules_free (GSList *rules)
+{
+	g_slist_foreach (rules, (GFunc) nm_share_rule_free, NULL);
+	g_slist_free (rules);
+}
+
+static void
+test_restore_input_insert (void)
+{
+	GSList *rules = share_rules_new ();
+	char *input;
+
+	input = nm_share_rules_to_restore_input (rules, TRUE);
+	g_assert_cmpstr (input, ==,
+	                 "*filter\n"
+	                 "--insert INPUT --in-interface wlan0 --protocol udp --destination-port 67 --jump ACCEPT\n"
+	                 "--insert FORWARD --in-interface wlan0 --jump REJECT\n"
+	                 "--insert FORWARD --in-interface wlan0 --out-interface wlan0 --jump ACCEPT\n"
+	                 "COMMIT\n"
+	                 "*nat\n"
+	                 "--insert POSTROUTING --source 10.42.0.0/255.255.255.0 ! --destination 10.42.0.0/255.255.255.0 --jump MASQUERADE\n"
+	                 "COMMIT\n");
+	g_free (input);
+
+	share_rules_free (rules);
+}
+
+static void
+test_restore_input_delete (void)
+{
+	GSList *rules = share_rules_new ();
+	char *input;
+
+	/* Teardown undoes the setup in reverse */
+	input = nm_share_rules_to_restore_input (rules, FALSE);
+	g_assert_cmpstr (input, ==,
+	                 "*filter\n"
+	                 "--delete FORWARD --in-interface wlan0 --out-interface wlan0 --jump ACCEPT\n"
+	                 "--delete FORWARD --in-interface wlan0 --jump REJECT\n"
+	                 "--delete INPUT --in-interface wlan0 --protocol udp --destination-port 67 --jump ACCEPT\n"
+	                 "COMMIT\n"
+	                 "*nat\n"
+	                 "--delete POSTROUTING --source 10.42.0.0/255.255.255.0 ! --destination 10.42.0.0/255.255.255.0 --jump MASQUERADE\n"
+	                 "COMMIT\n");
+	g_free (input);
+
+	share_rules_free (rules);
+}
+
+static void
+test_restore_input_empty (void)
+{
+	char *input;
+
+	input = nm_share_rules_to_restore_input (NULL, TRUE);
+	g_assert_cmpstr (input, ==, "");
+	g_free (input);
+}
+
+/*******************************************/
+
+#if GLIB_CHECK_VERSION(2,25,12)
+typedef GTestFixtureFunc TCFunc;
+#else
+typedef void (*TCFunc)(void);
+#endif
+
+#define TESTCASE(t, d) g_test_create_case (#t, 0, d, NULL, (TCFunc) t, NULL)
+
+int main (int argc, char **argv)
+{
+	GTestSuite *suite;
+
+	g_test_init (&argc, &argv, NULL);
+
+	suite = g_test_get_root ();
+
+	g_test_suite_add (suite, TESTCASE (test_restore_input_insert, NULL));
+	g_test_suite_add (suite, TESTCASE (test_restore_input_delete, NULL));
+	g_test_suite_add (suite, TESTCASE (test_restore_input_empty, NULL));
+
+	return g_test_run ();
+}
@@ -464,6 +464,17 @@ check_connection_available (NMDevice *device, NMConnection *connection)
 	return FALSE;
 }
 
+static char *
+get_availability_key (NMDevice *device, NMConnection *connection)
+{
+	NMSettingWimax *s_wimax;
+
+	s_wimax = nm_connection_get_setting_wimax (connection);
+	if (!s_wimax)
+		return NULL;
+	return g_strdup (nm_setting_wimax_get_network_name (s_wimax));
+}
+
 static gboolean
 complete_connection (NMDevice *device,
                      NMConnection *connection,
@@ -1052,12 +1063,11 @@ remove_outdated_nsps (NMDeviceWimax *self,
 
 		g_signal_emit (self, signals[NSP_REMOVED], 0, nsp);
 		priv->nsp_list = g_slist_remove (priv->nsp_list, nsp);
+		nm_device_recheck_available_connections_by_key (NM_DEVICE (self),
+		                                                nm_wimax_nsp_get_name (nsp));
 		g_object_unref (nsp);
 	}
 
-	if (g_slist_length(to_remove) > 0)
-	    nm_device_recheck_available_connections (NM_DEVICE (self));
-
 	g_slist_free (to_remove);
 }
 
@@ -1105,7 +1115,7 @@ wmx_scan_result_cb (struct wmxsdk *wmxsdk,
 			priv->nsp_list = g_slist_append (priv->nsp_list, nsp);
 			nm_wimax_nsp_export_to_dbus (nsp);
 			g_signal_emit (self, signals[NSP_ADDED], 0, nsp);
-			nm_device_recheck_available_connections (NM_DEVICE (self));
+			nm_device_recheck_available_connections_by_key (NM_DEVICE (self), nsp_name);
 		}
 	}
 }
@@ -1489,6 +1499,7 @@ nm_device_wimax_class_init (NMDeviceWimaxClass *klass)
 	device_class->get_hw_address = get_hw_address;
 	device_class->check_connection_compatible = check_connection_compatible;
 	device_class->check_connection_available = check_connection_available;
+	device_class->get_availability_key = get_availability_key;
 	device_class->complete_connection = complete_connection;
 	device_class->get_best_auto_connection = get_best_auto_connection;
 	device_class->get_generic_capabilities = get_generic_capabilities;
@@ -259,6 +259,8 @@ nm_wimax_nsp_class_init (NMWimaxNspClass *klass)
 	signals[PROPERTIES_CHANGED] = 
 		nm_properties_changed_signal_new (object_class,
 										  G_STRUCT_OFFSET (NMWimaxNspClass, properties_changed));
+	/* NSPs change in bulk with every scan, like access points */
+	nm_properties_changed_signal_set_priority (object_class, NM_PROPERTIES_CHANGED_PRIORITY_LOW);
 
 	dbus_g_object_type_install_info (G_TYPE_FROM_CLASS (klass),
 							   &dbus_glib_nm_wimax_nsp_object_info);